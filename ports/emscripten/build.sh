@@ -0,0 +1,37 @@
+#!/bin/sh
+
+# Build a small static libmpg123 for use in the browser, with emscripten.
+# The decoder is generic_vector, compiled to WebAssembly SIMD128.
+# Run this from the top source directory (after autoreconf -iv for a git
+# checkout). Give build type as argument: simd (default) or plain, the
+# latter for engines without SIMD support, using the generic decoder.
+
+build_type=$1
+test -z "$build_type" && build_type=simd
+
+case $build_type in
+  simd)
+    decoder=wasm_simd
+  ;;
+  plain)
+    decoder=generic_fpu
+  ;;
+  *)
+    echo "Unknown build type!"
+    exit 1
+  ;;
+esac
+
+# Only what a player in the browser needs: decoding from memory or own
+# callbacks into float or 16 bit samples. No network, output modules,
+# threads or the frontend's buffer. Layer I/II/III and ID3v2 stay.
+opts="--host=wasm32-unknown-emscripten --with-cpu=$decoder
+ --disable-shared --enable-static --disable-modules --with-audio=dummy
+ --disable-network --disable-buffer --disable-threads --disable-8bit
+ --disable-32bit --disable-ntom --disable-downsample --disable-lfs-alias
+ --disable-profile-stages --with-optimization=2"
+
+emconfigure ./configure $opts &&
+emmake make clean &&
+emmake make src/libmpg123/libmpg123.la &&
+echo "Result: src/libmpg123/.libs/libmpg123.a"
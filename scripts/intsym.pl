@@ -12,6 +12,7 @@ my @instances =
 ,	asmdir => 'src/libmpg123'
 ,	headers => [qw(
 		compat/compat
+		libmpg123/crc
 		libmpg123/decode
 		libmpg123/dither
 		libmpg123/frame
@@ -26,10 +27,13 @@ my @instances =
 		libmpg123/optimize
 		libmpg123/parse
 		libmpg123/reader
+		libmpg123/tabshare
 		libout123/module
 		libout123/buffer
 		libout123/xfermem
 		libout123/wav
+		libout123/convert
+		libout123/pull
 		libout123/out123_int
 		libout123/stringlists
 	)]
@@ -112,6 +112,36 @@ long brate(struct ratepair *table, long arate, int count, int *last)
 	return 0;
 }
 
+/* A device that plays none of the MPEG rates, like a JACK server fixed to
+   96 kHz, can still tell its own rate with the default format. Let the
+   decoder resample to that instead of failing or leaving it to some
+   resampler in the audio system. Returns 1 if the rate changed. */
+static int adopt_device_rate( mpg123_handle *mh
+,	struct mpg123_fmt *fmts, int fmtcount )
+{
+	long rate;
+	int fi;
+
+	if(fmtcount < 1 || param.force_rate > 0 || param.down_sample)
+		return 0;
+	for(fi=1; fi<fmtcount; ++fi)
+		if(fmts[fi].encoding > 0)
+			return 0;
+	if(fmts[0].rate <= 0)
+		return 0;
+	rate = param.pitch == 0
+	?	fmts[0].rate
+	:	(long)(fmts[0].rate/(param.pitch+1.0)+0.5);
+	if(pitch_rate(rate) != fmts[0].rate
+	||	mpg123_param(mh, MPG123_FORCE_RATE, rate, 0.) != MPG123_OK)
+		return 0;
+	if(!param.quiet)
+		fprintf( stderr, "Note: resampling to device rate of %li Hz\n"
+		,	fmts[0].rate );
+	param.force_rate = rate;
+	return 1;
+}
+
 /* This uses the currently opened audio device, queries its caps.
    In case of buffered playback, this works _once_ by querying the buffer for the caps before entering the main loop. */
 void audio_capabilities(out123_handle *ao, mpg123_handle *mh)
@@ -149,25 +179,36 @@ void audio_capabilities(out123_handle *ao, mpg123_handle *mh)
 			,	force_fmt, out123_enc_name(force_fmt));
 	}
 	/* Lots of preparation of rate lists. */
-	rlimit = param.force_rate > 0 ? num_rates+1 : num_rates;
-	outrates = malloc(sizeof(*rates)*rlimit);
-	unpitch  = malloc(sizeof(*unpitch)*rlimit);
-	if(!outrates || !unpitch)
+	while(1)
 	{
-		if(!param.quiet)
-			error("DOOM");
-		return;
-	}
-	for(ri = 0; ri<rlimit; ri++)
-	{
-		decode_rate = ri < num_rates ? rates[ri] : param.force_rate;
-		outrates[ri] = pitch_rate(decode_rate);
-		unpitch[ri].a = outrates[ri];
-		unpitch[ri].b = decode_rate;
+		rlimit = param.force_rate > 0 ? num_rates+1 : num_rates;
+		outrates = malloc(sizeof(*rates)*rlimit);
+		unpitch  = malloc(sizeof(*unpitch)*rlimit);
+		if(!outrates || !unpitch)
+		{
+			if(!param.quiet)
+				error("DOOM");
+			free(outrates);
+			free(unpitch);
+			return;
+		}
+		for(ri = 0; ri<rlimit; ri++)
+		{
+			decode_rate = ri < num_rates ? rates[ri] : param.force_rate;
+			outrates[ri] = pitch_rate(decode_rate);
+			unpitch[ri].a = outrates[ri];
+			unpitch[ri].b = decode_rate;
+		}
+		/* Actually query formats possible with given rates. */
+		fmtcount = out123_formats(ao, outrates, rlimit, 1, 2, &outfmts);
+		free(outrates);
+		/* Once more with the device rate, if the decoder shall resample to it. */
+		if(!adopt_device_rate(mh, outfmts, fmtcount))
+			break;
+		free(outfmts);
+		outfmts = NULL;
+		free(unpitch);
 	}
-	/* Actually query formats possible with given rates. */
-	fmtcount = out123_formats(ao, outrates, rlimit, 1, 2, &outfmts);
-	free(outrates);
 	if(fmtcount > 0)
 	{
 		int fi;
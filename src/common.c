@@ -12,6 +12,7 @@
 #include "mpg123app.h"
 #include "out123.h"
 #include <sys/stat.h>
+#include <time.h>
 #include "common.h"
 
 #ifdef __EMX__
@@ -211,6 +212,52 @@ void print_buf(const char* prefix, out123_handle *ao)
 
 
 
+#if !defined(WIN32) && !defined(GENERIC)
+#define STAT_CLOCK
+#endif
+
+int stat_due(void)
+{
+#ifdef STAT_CLOCK
+	static struct timeval last;
+	static int have_last = FALSE;
+	struct timeval now;
+	double elapsed;
+
+	if(param.stat_interval <= 0.)
+		return TRUE;
+	gettimeofday(&now, NULL);
+	elapsed = (double)(now.tv_sec - last.tv_sec)
+	+	1e-6*(now.tv_usec - last.tv_usec);
+	/* Going back in time means the clock got set, start over. */
+	if(have_last && elapsed >= 0. && elapsed < param.stat_interval)
+		return FALSE;
+	last = now;
+	have_last = TRUE;
+	return TRUE;
+#else
+	/* No clock, every eighth frame as ever. */
+	static unsigned int calls = 0;
+	return param.stat_interval <= 0. || !(calls++ & 0x7);
+#endif
+}
+
+/* Asking the terminal for its size on each update is a system call too
+   much, once a second catches resizing well enough. */
+static int stat_width(void)
+{
+	static int width = -1;
+	static time_t checked = 0;
+	time_t now = time(NULL);
+
+	if(now != checked)
+	{
+		width = term_width(STDERR_FILENO);
+		checked = now;
+	}
+	return width;
+}
+
 /* Note about position info with buffering:
    Negative positions mean that the previous track is still playing from the
    buffer. It's a countdown. The frame counter always relates to the last
@@ -231,7 +278,8 @@ void print_stat(mpg123_handle *fr, long offset, out123_handle *ao, int draw_bar)
 	long rate;
 	int framesize;
 	struct mpg123_frameinfo mi;
-	char linebuf[256];
+	/* Reused for each update, longer lines are cut. */
+	static char linebuf[1024];
 	char *line = NULL;
 
 #ifndef WIN32
@@ -270,7 +318,17 @@ void print_stat(mpg123_handle *fr, long offset, out123_handle *ao, int draw_bar)
 	rframes = frames-frame;
 	elapsed = decoded + offset*spf - buffered; /* May be negative, a countdown. */
 	remain  = elapsed > 0 ? length - elapsed : length;
-	if(  MPG123_OK == mpg123_info(fr, &mi)
+	if(param.machine_stat)
+	{
+		/* Just the numbers for whoever reads this, no terminal business. */
+		if(  MPG123_OK == mpg123_info(fr, &mi)
+		  && MPG123_OK == mpg123_getvolume(fr, &basevol, &realvol, NULL) )
+			fprintf( stderr, "STAT %"OFF_P" %"OFF_P" %.2f %.2f %.2f %d %u %ld\n"
+			,	(off_p)frame, (off_p)rframes
+			,	(double)elapsed/rate, (double)remain/rate, (double)buffered/rate
+			,	mi.bitrate, roundui(realvol*100), mpg123_clip(fr) );
+	}
+	else if(  MPG123_OK == mpg123_info(fr, &mi)
 	  && MPG123_OK == mpg123_getvolume(fr, &basevol, &realvol, NULL) )
 	{
 		char framefmt[10];
@@ -285,13 +343,13 @@ void print_stat(mpg123_handle *fr, long offset, out123_handle *ao, int draw_bar)
 		char timesep[3];
 		char sign[3] = {' ', ' ', ' '};
 
-		/* 255 is enough for the data I prepare, if there is no terminal width to
-		   fill */
-		maxlen  = term_width(STDERR_FILENO);
+		/* The buffer is enough for the data I prepare, if there is no terminal
+		   width to fill. Wider terminals just get a shorter bar. */
+		maxlen  = stat_width();
+		if(maxlen >= (int)sizeof(linebuf))
+			maxlen = sizeof(linebuf)-1;
 		linelen = maxlen > 0 ? maxlen : (sizeof(linebuf)-1);
-		line = linelen >= sizeof(linebuf)
-		?	malloc(linelen+1) /* Only malloc if it is a really long line. */
-		:	linebuf; /* Small buffer on stack is enough. */
+		line = linebuf;
 
 		tim[0] = (double)elapsed/rate;
 		tim[1] = (double)remain/rate;
@@ -438,8 +496,6 @@ void print_stat(mpg123_handle *fr, long offset, out123_handle *ao, int draw_bar)
 			fprintf(stderr, "\r%s", line);
 		fprintf(stderr, "\nICY-META: %s\n", icy);
 	}
-	if(line && line != linebuf)
-		free(line);
 }
 
 void clear_stat()
@@ -24,6 +24,9 @@ int term_width(int fd);
 
 void print_header(mpg123_handle *);
 void print_header_compact(mpg123_handle *);
+/* TRUE if it is time for the next status update during playback,
+   after param.stat_interval. */
+int stat_due(void);
 void print_stat(mpg123_handle *fr, long offset, out123_handle *ao, int draw_bar);
 void print_buf(const char* prefix, out123_handle *ao);
 void clear_stat();
@@ -285,4 +285,25 @@ typedef int socklen_t;
 void (*catchsignal(int signum, void(*handler)()))();
 #endif
 
+/* Heap memory goes through hooks that the application can install via
+   mpg123_allocator(), out123_allocator() or syn123_allocator(), default
+   is the C library. Each copy of this code has its own hooks, those
+   libraries as shared objects each their own, a static build one for all.
+   The hooks are set as a whole (all NULL for the default), before anything
+   got allocated. */
+int compat_allocator( void *(*r_alloc)(void *handle, size_t size)
+,	void *(*r_realloc)(void *handle, void *ptr, size_t size), void (*r_free)(void *handle, void *ptr)
+,	void *handle );
+void *compat_malloc(size_t size);
+void *compat_calloc(size_t nmemb, size_t size);
+void *compat_realloc(void *ptr, size_t size);
+void compat_free(void *ptr);
+/* After all system headers, so that their declarations are unaffected. */
+#ifndef COMPAT_SYSTEM_ALLOC
+#define malloc(size)        compat_malloc(size)
+#define calloc(nmemb, size) compat_calloc(nmemb, size)
+#define realloc(ptr, size)  compat_realloc(ptr, size)
+#define free(ptr)           compat_free(ptr)
+#endif
+
 #endif
@@ -9,14 +9,75 @@
 	initially written by Thomas Orgis, Windows Unicode stuff by JonY.
 */
 
+#define COMPAT_SYSTEM_ALLOC
 #include "compat.h"
 #include "debug.h"
 
+static struct
+{
+	void *(*r_alloc)(void *handle, size_t size);
+	void *(*r_realloc)(void *handle, void *ptr, size_t size);
+	void (*r_free)(void *handle, void *ptr);
+	void *handle;
+} hooks = { NULL, NULL, NULL, NULL };
+
+int compat_allocator( void *(*r_alloc)(void *handle, size_t size)
+,	void *(*r_realloc)(void *handle, void *ptr, size_t size)
+,	void (*r_free)(void *handle, void *ptr), void *handle )
+{
+	/* Half a set of hooks would mix up the heaps. */
+	if(!r_alloc != !r_realloc || !r_alloc != !r_free)
+		return -1;
+	hooks.r_alloc   = r_alloc;
+	hooks.r_realloc = r_realloc;
+	hooks.r_free    = r_free;
+	hooks.handle    = r_alloc ? handle : NULL;
+	return 0;
+}
+
+void *compat_malloc(size_t size)
+{
+	return hooks.r_alloc
+	?	hooks.r_alloc(hooks.handle, size)
+	:	malloc(size);
+}
+
+void *compat_calloc(size_t nmemb, size_t size)
+{
+	void *ptr;
+	if(!hooks.r_alloc)
+		return calloc(nmemb, size);
+	if(size && nmemb > SIZE_MAX/size)
+		return NULL;
+	ptr = hooks.r_alloc(hooks.handle, nmemb*size);
+	if(ptr)
+		memset(ptr, 0, nmemb*size);
+	return ptr;
+}
+
+void *compat_realloc(void *ptr, size_t size)
+{
+	return hooks.r_realloc
+	?	hooks.r_realloc(hooks.handle, ptr, size)
+	:	realloc(ptr, size);
+}
+
+void compat_free(void *ptr)
+{
+	if(hooks.r_free)
+	{
+		if(ptr)
+			hooks.r_free(hooks.handle, ptr);
+	}
+	else
+		free(ptr);
+}
+
 /* A safe realloc also for very old systems where realloc(NULL, size) returns NULL. */
 void *safe_realloc(void *ptr, size_t size)
 {
-	if(ptr == NULL) return malloc(size);
-	else return realloc(ptr, size);
+	if(ptr == NULL) return compat_malloc(size);
+	else return compat_realloc(ptr, size);
 }
 
 #ifndef HAVE_STRERROR
@@ -36,7 +97,7 @@ char* compat_strdup(const char *src)
 	{
 		size_t len;
 		len = strlen(src)+1;
-		if((dest = malloc(len)))
+		if((dest = compat_malloc(len)))
 			memcpy(dest, src, len);
 	}
 	return dest;
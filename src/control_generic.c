@@ -37,6 +37,7 @@
 #include "genre.h"
 #include "playlist.h"
 #include "audio.h"
+#include "mixer.h"
 #define MODE_STOPPED 0
 #define MODE_PLAYING 1
 #define MODE_PAUSED 2
@@ -55,6 +56,15 @@ int control_file = STDIN_FILENO;
 FILE *outstream;
 static int mode = MODE_STOPPED;
 static int init = 0;
+/* Periodic status during playback: every progress_frames MPEG frames or
+   frames worth progress_seconds, the latter winning if set. With
+   progress_full, that is the one-line STATUS snapshot instead of @F. */
+static long progress_frames = 1;
+static double progress_seconds = 0.;
+static int progress_full = FALSE;
+static off_t progress_last = -1;
+/* Playing streams added by MIX instead of a loaded track. */
+static int mixing = FALSE;
 
 #include "debug.h"
 
@@ -119,6 +129,56 @@ void generic_sendstat (mpg123_handle *fr)
 	generic_sendmsg("F %"OFF_P" %"OFF_P" %3.2f %3.2f", (off_p)current_frame, (off_p)frames_left, current_seconds, seconds_left);
 }
 
+/* All the numbers a frontend polls for, in one JSON object on one line. */
+static void generic_sendstatus(mpg123_handle *fr)
+{
+	off_t current_frame = 0, frames_left = 0;
+	double current_seconds = 0., seconds_left = 0.;
+	off_t pos = 0, len = 0;
+	long rate = 0;
+	int ch = 0;
+	double vol = 0.;
+	size_t buffered = out123_buffered(ao);
+
+	if(mode != MODE_STOPPED)
+	{
+		mpg123_position( fr, 0, buffered, &current_frame, &frames_left
+		,	&current_seconds, &seconds_left );
+		pos = mpg123_tell(fr);
+		len = mpg123_length(fr);
+		mpg123_getformat2(fr, &rate, &ch, NULL, 0);
+	}
+	mpg123_getvolume(fr, &vol, NULL, NULL);
+	generic_sendmsg( "STATUS {\"mode\":%i,\"frame\":%"OFF_P",\"frames_left\":%"OFF_P
+		",\"seconds\":%.2f,\"seconds_left\":%.2f,\"sample\":%"OFF_P",\"samples\":%"OFF_P
+		",\"rate\":%li,\"channels\":%i,\"volume\":%f,\"pitch\":%f,\"buffered\":%"SIZE_P"}"
+	,	mode == MODE_PLAYING ? 2 : (mode == MODE_PAUSED ? 1 : 0) /* as with @P */
+	,	(off_p)current_frame, (off_p)frames_left, current_seconds, seconds_left
+	,	(off_p)pos, (off_p)len, rate, ch, vol*100, param.pitch, (size_p)buffered );
+}
+
+/* TRUE if the periodic status is to be sent after the current frame. */
+static int progress_due(mpg123_handle *fr)
+{
+	long interval = progress_frames;
+
+	if(progress_seconds > 0.)
+	{
+		double tpf = mpg123_tpf(fr);
+		interval = tpf > 0. ? (long)(progress_seconds/tpf) : 1;
+		if(interval < 1)
+			interval = 1;
+	}
+	else if(interval < 1)
+		return FALSE;
+	if(progress_last < 0 || framenum < progress_last || framenum-progress_last >= interval)
+	{
+		progress_last = framenum;
+		return TRUE;
+	}
+	return FALSE;
+}
+
 static void generic_sendv1(mpg123_id3v1 *v1, const char *prefix)
 {
 	int i;
@@ -226,14 +286,60 @@ void generic_sendinfo (char *filename)
 	generic_sendmsg("I %s", s);
 }
 
-static void generic_load(mpg123_handle *fr, char *arg, int state)
+/* End the track or the mix, whatever is playing. */
+static void generic_stop(void)
 {
-	out123_drop(ao);
-	if(mode != MODE_STOPPED)
-	{
+	if(mixing)
+		mixer_clear();
+	else if(mode != MODE_STOPPED)
 		close_track();
-		mode = MODE_STOPPED;
+	mixing = FALSE;
+	mode = MODE_STOPPED;
+}
+
+static void generic_mixended(int id, const char *name)
+{
+	generic_sendmsg("MIXEND %i", id);
+}
+
+static void generic_mixentry(int id, const char *name, double volume, off_t pos)
+{
+	generic_sendmsg("MIXLIST %i %f %"OFF_P" %s", id, volume*100, (off_p)pos, name);
+}
+
+/* Add a stream to the mix, replacing a loaded track. */
+static void generic_mix(char *arg)
+{
+	int id;
+
+	if(mixer_init(param.force_rate, param.mixer_threads))
+	{
+		generic_sendmsg("E Cannot set up mixer");
+		return;
+	}
+	if(!mixing)
+	{
+		out123_drop(ao);
+		generic_stop();
+	}
+	if((id = mixer_add(arg)) < 0)
+	{
+		generic_sendmsg("E Cannot mix: %s", arg);
+		return;
+	}
+	generic_sendmsg("MIX %i %s", id, arg);
+	if(!mixing)
+	{
+		mixing = TRUE;
+		mode = MODE_PLAYING;
+		generic_sendmsg("P 2");
 	}
+}
+
+static void generic_load(mpg123_handle *fr, char *arg, int state)
+{
+	out123_drop(ao);
+	generic_stop();
 	if(!open_track(arg))
 	{
 		generic_sendmsg("E Error opening stream: %s", arg);
@@ -252,6 +358,7 @@ static void generic_load(mpg123_handle *fr, char *arg, int state)
 
 	mode = state;
 	init = 1;
+	progress_last = -1;
 	generic_sendmsg(mode == MODE_PAUSED ? "P 1" : "P 2");
 }
 
@@ -296,10 +403,39 @@ static void generic_loadlist(mpg123_handle *fr, char *arg)
 	free_playlist(); /* Free memory after it is not needed anymore. */
 }
 
-int control_generic (mpg123_handle *fr)
+/* Check for commands on the control file. Blocking, this sleeps until
+   there are some, without any timeout to wake up for, so an idle player
+   costs nothing. Returns >0 if there is something to read, 0 if not
+   and <0 on errors. Signals interrupting the wait are no errors. */
+static int command_ready(int block)
 {
 	struct timeval tv;
-	fd_set fds;
+	int n;
+#ifdef WANT_WIN32_FIFO
+	do
+	{
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		n = win32_fifo_read_peek(block ? NULL : &tv);
+	} while(block && n == 0);
+#else
+	do
+	{
+		fd_set fds;
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		FD_ZERO(&fds);
+		FD_SET(control_file, &fds);
+		n = select(control_file+1, &fds, NULL, NULL, block ? NULL : &tv);
+	} while(block && n < 0 && errno == EINTR);
+	if(n < 0 && errno == EINTR)
+		n = 0;
+#endif
+	return n;
+}
+
+int control_generic (mpg123_handle *fr)
+{
 	int n;
 
 	/* ThOr */
@@ -323,7 +459,7 @@ int control_generic (mpg123_handle *fr)
 #endif
 	/* the command behaviour is different, so is the ID */
 	/* now also with version for command availability */
-	fprintf(outstream, "@R MPG123 (ThOr) v8\n");
+	fprintf(outstream, "@R MPG123 (ThOr) v9\n");
 #ifdef FIFO
 	if(param.fifo)
 	{
@@ -352,17 +488,19 @@ int control_generic (mpg123_handle *fr)
 
 	while (alive)
 	{
-		tv.tv_sec = 0;
-		tv.tv_usec = 0;
-		FD_ZERO(&fds);
-		FD_SET(control_file, &fds);
 		/* play frame if no command needs to be processed */
 		if (mode == MODE_PLAYING) {
-#ifdef WANT_WIN32_FIFO
-			n = win32_fifo_read_peek(&tv);
-#else
-			n = select(32, &fds, NULL, NULL, &tv);
-#endif
+			n = command_ready(FALSE);
+			if (n == 0 && mixing) {
+				if(mixer_play(ao, generic_mixended) <= 0)
+				{
+					out123_pause(ao);
+					mixing = FALSE;
+					mode = MODE_STOPPED;
+					generic_sendmsg("P 0");
+				}
+				continue;
+			}
 			if (n == 0) {
 				if (!play_frame())
 				{
@@ -389,7 +527,13 @@ int control_generic (mpg123_handle *fr)
 				}
 				if(silent == 0)
 				{
-					generic_sendstat(fr);
+					if(progress_due(fr))
+					{
+						if(progress_full)
+							generic_sendstatus(fr);
+						else
+							generic_sendstat(fr);
+					}
 					if(mpg123_meta_check(fr) & MPG123_NEW_ICY)
 					{
 						char *meta;
@@ -399,18 +543,8 @@ int control_generic (mpg123_handle *fr)
 				}
 			}
 		}
-		else {
-			/* wait for command */
-			while (1) {
-#ifdef WANT_WIN32_FIFO
-				n = win32_fifo_read_peek(NULL);
-#else
-				n = select(32, &fds, NULL, NULL, NULL);
-#endif
-				if (n > 0)
-					break;
-			}
-		}
+		else /* wait for command */
+			n = command_ready(TRUE);
 
 		/*  on error */
 		if (n < 0) {
@@ -499,8 +633,7 @@ int control_generic (mpg123_handle *fr)
 						/* Do we want to drop here? */
 						out123_drop(ao);
 						out123_pause(ao);
-						close_track();
-						mode = MODE_STOPPED;
+						generic_stop();
 						generic_sendmsg("P 0");
 					} else generic_sendmsg("P 0");
 					continue;
@@ -513,6 +646,18 @@ int control_generic (mpg123_handle *fr)
 					continue;
 				}
 
+				if(!strcasecmp(comstr, "MIXLIST")) {
+					generic_sendmsg("MIXLIST {");
+					mixer_list(generic_mixentry);
+					generic_sendmsg("MIXLIST }");
+					continue;
+				}
+
+				if(!strcasecmp(comstr, "STATUS")) {
+					generic_sendstatus(fr);
+					continue;
+				}
+
 				if(!strcasecmp(comstr, "T") || !strcasecmp(comstr, "TAG")) {
 					generic_sendalltag(fr);
 					continue;
@@ -605,6 +750,12 @@ int control_generic (mpg123_handle *fr)
 					generic_sendmsg("H SEQ <bass> <mid> <treble>: simple eq setting...");
 					generic_sendmsg("H PITCH <[+|-]value>: adjust playback speed (+0.01 is 1 %% faster)");
 					generic_sendmsg("H SILENCE: be silent during playback (meaning silence in text form)");
+					generic_sendmsg("H PROGRESS <frames>|<seconds>s [STATUS]: send the playback status every <frames> MPEG frames (0: never) or <seconds> of audio, as @F line or @STATUS snapshot");
+					generic_sendmsg("H MIX <url>: add a stream to the mix of streams playing at once (replacing a loaded track), answered by @MIX <id> <url>; @MIXEND <id> tells a stream ended");
+					generic_sendmsg("H UNMIX <id>: remove a stream from the mix");
+					generic_sendmsg("H MIXVOL <id> <percent>: set the volume of a stream in the mix");
+					generic_sendmsg("H MIXLIST: list the mix as @MIXLIST <id> <percent> <sample> <url> lines in a MIXLIST block (like TAG)");
+					generic_sendmsg("H STATUS: print mode, position, length, format, volume, pitch and buffer fill as one JSON object on one @STATUS line");
 					generic_sendmsg("H STATE: Print auxiliary state info in several lines (just try it to see what info is there).");
 					generic_sendmsg("H TAG/T: Print all available (ID3) tag info, for ID3v2 that gives output of all collected text fields, using the ID3v2.3/4 4-character names. NOTE: ID3v2 data will be deleted on non-forward seeks.");
 					generic_sendmsg("H    The output is multiple lines, begin marked by \"@T {\", end by \"@T }\".");
@@ -770,6 +921,62 @@ int control_generic (mpg123_handle *fr)
 						continue;
 					}
 
+					/* Mixing several streams */
+					if(!strcasecmp(cmd, "MIX")) { generic_mix(arg); continue; }
+
+					if(!strcasecmp(cmd, "UNMIX"))
+					{
+						if(mixer_remove(atoi(arg)))
+							generic_sendmsg("E No such stream in the mix: %s", arg);
+						else
+							generic_sendmsg("UNMIX %i", atoi(arg));
+						continue;
+					}
+
+					if(!strcasecmp(cmd, "MIXVOL"))
+					{
+						int id;
+						double v;
+						if(sscanf(arg, "%i %lf", &id, &v) == 2 && !mixer_volume(id, v/100))
+							generic_sendmsg("MIXVOL %i %f", id, v);
+						else
+							generic_sendmsg("E invalid arguments for MIXVOL: %s", arg);
+						continue;
+					}
+
+					/* PROGRESS interval and kind */
+					if(!strcasecmp(cmd, "PROGRESS"))
+					{
+						char *end;
+						double v = strtod(arg, &end);
+						int bad = (end == arg || v < 0);
+						int full = FALSE;
+						int secs = (*end == 's' || *end == 'S');
+						if(secs)
+							++end;
+						while(*end && isspace(*end))
+							++end;
+						if(*end && !strcasecmp(end, "STATUS"))
+						{
+							full = TRUE;
+							end += strlen(end);
+						}
+						if(bad || *end)
+						{
+							generic_sendmsg("E invalid arguments for PROGRESS: %s", arg);
+							continue;
+						}
+						progress_full = full;
+						progress_seconds = secs ? v : 0.;
+						progress_frames = secs ? (v > 0.) : (long)v;
+						progress_last = -1;
+						if(secs)
+							generic_sendmsg("PROGRESS %gs %s", v, full ? "STATUS" : "F");
+						else
+							generic_sendmsg("PROGRESS %li %s", progress_frames, full ? "STATUS" : "F");
+						continue;
+					}
+
 					/* RVA mode */
 					if(!strcasecmp(cmd, "RVA"))
 					{
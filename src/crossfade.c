@@ -0,0 +1,197 @@
+/*
+	crossfade: blending the end of a track into the start of the next one
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	There is only one decoder, so the end of a track is not played, but held
+	back in memory once the decoder is within the fade length of the end
+	(known from mpg123_length()). The start of the next track is then mixed
+	into that tail with syn123_crossfade() and played in its place. Tracks of
+	unknown length, seeks out of the held part, a change of format and the
+	end of the playlist just play the tail as it is.
+*/
+
+#include "crossfade.h"
+#include "syn123.h"
+#include "debug.h"
+
+enum fade_state { fade_idle = 0, fade_hold, fade_mix };
+
+static double fade_seconds = 0.;
+static enum fade_state state = fade_idle;
+static long rate = 0;
+static int channels = 0;
+static int encoding = 0;
+static size_t framesize = 0;
+static syn123_handle *sh = NULL;
+static unsigned char *tail = NULL;
+static size_t tail_size = 0; /* bytes */
+static size_t tail_fill = 0; /* bytes */
+static size_t mix_pos = 0;    /* frames of the tail mixed already */
+static size_t mix_length = 0; /* frames of the tail at the start */
+static off_t hold_end = 0;   /* track position after the held data */
+static int hold_off = FALSE; /* no luck with holding for this track */
+
+void crossfade_setup(double seconds)
+{
+	fade_seconds = seconds > 0. ? seconds : 0.;
+}
+
+static void drop_tail(void)
+{
+	state = fade_idle;
+	tail_fill = 0;
+	mix_pos = 0;
+}
+
+/* Play what is left of the tail without mixing. A fade already started
+   cannot continue, that rest is dropped. */
+static void play_tail(out123_handle *ao)
+{
+	if(!mix_pos && tail_fill)
+	{
+		debug1("playing %"SIZE_P" bytes of held tail", (size_p)tail_fill);
+		if(out123_play(ao, tail, tail_fill) < tail_fill && !intflag)
+			error1("cannot play held tail: %s", out123_strerror(ao));
+	}
+	drop_tail();
+}
+
+void crossfade_next(void)
+{
+	if(state == fade_hold)
+	{
+		state = fade_mix;
+		mix_pos = 0;
+		mix_length = tail_fill/framesize;
+	}
+	else if(state == fade_mix && mix_pos)
+		drop_tail();
+	hold_off = FALSE;
+}
+
+void crossfade_format(out123_handle *ao, long r, int c, int e)
+{
+	int err;
+
+	if(fade_seconds <= 0.)
+		return;
+	if(sh && r == rate && c == channels && e == encoding)
+		return;
+	play_tail(ao);
+	rate = r;
+	channels = c;
+	encoding = e;
+	framesize = out123_encsize(e)*c;
+	free(tail);
+	tail = NULL;
+	tail_size = 0;
+	if(sh)
+		syn123_del(sh);
+	/* Only the work buffer is of interest, no waves. */
+	sh = framesize ? syn123_new(r, c, e, 0, &err) : NULL;
+	if(!sh && param.verbose)
+		fprintf(stderr, "\nNote: no crossfade for this format\n");
+}
+
+/* Keep the audio for later, TRUE on success. */
+static int hold(unsigned char *audio, size_t bytes)
+{
+	if(tail_fill + bytes > tail_size)
+	{
+		/* Twice the fade for length estimates that are off a bit,
+		   but no endless hoarding. */
+		size_t need = 2*(size_t)(fade_seconds*rate)*framesize;
+		unsigned char *nt;
+		if(tail_fill + bytes > need || !(nt = realloc(tail, need)))
+			return FALSE;
+		tail = nt;
+		tail_size = need;
+	}
+	memcpy(tail+tail_fill, audio, bytes);
+	tail_fill += bytes;
+	return TRUE;
+}
+
+void crossfade_audio( mpg123_handle *mh, out123_handle *ao
+,	unsigned char *audio, size_t *bytes )
+{
+	size_t frames;
+	size_t skip = 0;
+	off_t start;
+
+	if(fade_seconds <= 0. || !sh || !*bytes)
+		return;
+	frames = *bytes/framesize;
+	if(state == fade_mix)
+	{
+		unsigned char *t = tail + mix_pos*framesize;
+		size_t m = mix_length - mix_pos;
+		if(m > frames)
+			m = frames;
+		if(syn123_crossfade( t, audio, encoding, channels, m
+		,	mix_pos, mix_length, sh ))
+			play_tail(ao);
+		else
+		{
+			memcpy(audio, t, m*framesize);
+			if((mix_pos += m) == mix_length)
+				drop_tail();
+		}
+	}
+	/* The decoder still counts the handed out audio as unread. */
+	start = mpg123_tell(mh);
+	if(state == fade_hold && start != hold_end)
+		play_tail(ao); /* Seeked away. */
+	if(state == fade_idle && !hold_off)
+	{
+		off_t length = mpg123_length(mh);
+		off_t window = length - (off_t)(fade_seconds*rate);
+		if(length <= 0 || start + (off_t)frames <= window)
+			return;
+		if(start < window)
+			skip = (size_t)(window - start);
+		state = fade_hold;
+		debug2("holding back from %"OFF_P" of %"OFF_P
+		,	(off_p)(start+skip), (off_p)length);
+	}
+	if(state != fade_hold)
+		return;
+	if(hold(audio + skip*framesize, (frames-skip)*framesize))
+	{
+		*bytes = skip*framesize;
+		hold_end = start + (off_t)frames;
+	}
+	else
+	{
+		hold_off = TRUE;
+		play_tail(ao);
+	}
+}
+
+int crossfade_active(void)
+{
+	return fade_seconds > 0.;
+}
+
+int crossfade_held(void)
+{
+	return state == fade_hold;
+}
+
+void crossfade_flush(out123_handle *ao)
+{
+	play_tail(ao);
+}
+
+void crossfade_exit(void)
+{
+	drop_tail();
+	free(tail);
+	tail = NULL;
+	tail_size = 0;
+	if(sh)
+		syn123_del(sh);
+	sh = NULL;
+}
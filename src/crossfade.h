@@ -0,0 +1,36 @@
+/*
+	crossfade: blending the end of a track into the start of the next one
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#ifndef CROSSFADE_H
+#define CROSSFADE_H
+
+#include "mpg123app.h"
+#include "out123.h"
+
+/* Crossfade over the given seconds from now on, zero disables it. */
+void crossfade_setup(double seconds);
+/* Tell that a new track has been opened. A tail held back from the
+   previous one is mixed into the start of this one then. */
+void crossfade_next(void);
+/* Before starting the output anew, with the old format still playing.
+   A held tail is played out if the new format does not match it. */
+void crossfade_format(out123_handle *ao, long rate, int channels, int encoding);
+/* Work on the audio just decoded from mh, holding back the end of the
+   track and mixing a held tail into the start. The audio is modified in
+   place and bytes changed to the amount that is to be played now. */
+void crossfade_audio( mpg123_handle *mh, out123_handle *ao
+,	unsigned char *audio, size_t *bytes );
+/* TRUE if crossfading is configured at all. */
+int crossfade_active(void);
+/* TRUE if the end of the current track is held back. */
+int crossfade_held(void);
+/* Play out a held tail, as there is no next track to mix it with. */
+void crossfade_flush(out123_handle *ao);
+/* Free everything. */
+void crossfade_exit(void);
+
+#endif
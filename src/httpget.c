@@ -34,6 +34,9 @@
 
 #include <errno.h>
 #include "true.h"
+#if !defined (WANT_WIN32_SOCKETS)
+#include <sys/socket.h>
+#endif
 #endif
 
 #include <ctype.h>
@@ -160,46 +163,94 @@ static int writestring (int fd, mpg123_string *string)
 	return TRUE;
 }
 
-static size_t readstring (mpg123_string *string, size_t maxlen, int fd)
+/* Arbitrary limit for the response head. */
+#define HTTP_HEAD_MAX (1024*1024)
+#define HTTP_HEAD_CHUNK 4096
+
+/* Read the response head (status line and header lines up to the empty
+   line) in chunks instead of one byte per read() as it used to be. The
+   socket is peeked at and only the bytes up to the end of the head are
+   taken from it. So the body stays in the socket for whatever reads it
+   next (with timeout, ICY, ranges or dumping), nothing is left around
+   here to hand over. Returns TRUE with the zero-terminated head. */
+static int readhead(mpg123_string *head, int fd)
 {
-	int err;
-	debug2("Attempting readstring on %d for %"SIZE_P" bytes", fd, (size_p)maxlen);
-	string->fill = 0;
-	while(maxlen == 0 || string->fill < maxlen)
+	size_t end = 0;
+
+	debug1("Attempting readhead on %d", fd);
+	head->fill = 0;
+	while(!end)
 	{
-		if(string->size-string->fill < 1)
-		if(!mpg123_grow_string(string, string->fill+4096))
+		ssize_t got;
+		size_t avail, i, take;
+
+		if(head->fill >= HTTP_HEAD_MAX)
 		{
-			error("Cannot allocate memory for reading.");
-			string->fill = 0;
-			return 0;
+			error("HTTP response head exceeds max. length");
+			return FALSE;
 		}
-		err = read(fd,string->p+string->fill,1);
-		/* Whoa... reading one byte at a time... one could ensure the line break in another way, but more work. */
-		if( err == 1)
+		if(  head->size < head->fill+HTTP_HEAD_CHUNK+1
+		  && !mpg123_grow_string(head, head->fill+HTTP_HEAD_CHUNK+1) )
 		{
-			string->fill++;
-			if(string->p[string->fill-1] == '\n') break;
+			error("Cannot allocate memory for reading.");
+			return FALSE;
 		}
-		else if(errno != EINTR)
+		got = recv(fd, head->p+head->fill, HTTP_HEAD_CHUNK, MSG_PEEK);
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got <= 0)
 		{
 			error("Error reading from socket or unexpected EOF.");
-			string->fill = 0;
-			/* bail out to prevent endless loop */
-			return 0;
+			return FALSE;
+		}
+		/* Look for an empty line, also just after the line end in what
+		   was there before. */
+		avail = head->fill + got;
+		for(i = head->fill > 2 ? head->fill-2 : 0; !end && i < avail; ++i)
+		{
+			if(head->p[i] != '\n')
+				continue;
+			if(i+1 < avail && head->p[i+1] == '\n')
+				end = i+2;
+			else if(i+2 < avail && head->p[i+1] == '\r' && head->p[i+2] == '\n')
+				end = i+3;
+		}
+		take = end ? end - head->fill : (size_t)got;
+		while(take)
+		{
+			got = read(fd, head->p+head->fill, take);
+			if(got < 0 && errno == EINTR)
+				continue;
+			if(got <= 0)
+			{
+				error("Error reading from socket or unexpected EOF.");
+				return FALSE;
+			}
+			head->fill += got;
+			take -= got;
 		}
 	}
+	head->p[head->fill++] = 0;
+	return TRUE;
+}
 
-	if(!mpg123_grow_string(string, string->fill+1))
-	{
-		string->fill=0;
-	}
-	else
-	{
-		string->p[string->fill] = 0;
-		string->fill++;
-	}
-	return string->fill;
+/* Copy the next line of the head to line, including the line end and
+   a zero byte. Returns line->fill, zero when the head is used up. */
+static size_t headline(mpg123_string *line, mpg123_string *head, size_t *pos)
+{
+	size_t len = 0;
+	size_t avail = head->fill ? head->fill-1 : 0;
+
+	line->fill = 0;
+	while(*pos+len < avail && head->p[*pos+len++] != '\n')
+		;
+	if(!len || !mpg123_grow_string(line, len+1))
+		return 0;
+	memcpy(line->p, head->p+*pos, len);
+	line->p[len] = 0;
+	line->fill = len+1;
+	*pos += len;
+	return line->fill;
 }
 #endif /* WANT_WIN32_SOCKETS */
 
@@ -502,15 +553,261 @@ static int resolve_redirect(mpg123_string *response, mpg123_string *request_url,
 	return TRUE;
 }
 
+/*
+	Seeking in HTTP resources via range requests.
+	When the server announces "Accept-Ranges: bytes" and the length of a
+	plain (non-ICY) resource, the socket handed out by http_open() can be
+	read and seeked through http_read() and http_seek(). Seeks only move
+	a virtual position; the next read reconnects with a Range header and
+	puts the new connection in place of the old socket descriptor, so the
+	decoder never notices. Short forward skips just read over the data.
+	There is only one such resource at a time.
+*/
+
+/* Forward skips up to that are cheaper than a new connection. */
+#define RANGE_SKIP_LIMIT 65536
+
+struct http_range
+{
+	int fd;               /* socket, -1 for none yet */
+	mpg123_string host;   /* where to connect to (server or proxy) */
+	mpg123_string port;
+	mpg123_string request; /* GET request without the final empty line */
+	off_t length;
+	off_t pos;  /* position as seen by the reader */
+	off_t spos; /* position of the data on the socket */
+};
+
+/* The one handed out by http_open(). */
+static struct http_range ranged =
+{ -1, { NULL, 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 }, 0, 0, 0 };
+
+static void range_setup( int sock, mpg123_string *host, mpg123_string *port
+,	mpg123_string *request, off_t length )
+{
+	if(  !mpg123_copy_string(host, &ranged.host)
+	  || !mpg123_copy_string(port, &ranged.port)
+	  || !mpg123_copy_string(request, &ranged.request)
+	  || ranged.request.fill < 3 )
+		return;
+	/* Strip the empty line to be able to add the Range header. */
+	ranged.request.fill -= 2;
+	ranged.request.p[ranged.request.fill-1] = 0;
+	ranged.length = length;
+	ranged.pos = ranged.spos = 0;
+	ranged.fd = sock;
+	if(param.verbose > 1)
+		fprintf( stderr, "Note: HTTP resource is seekable (%"OFF_P" bytes)\n"
+		,	(off_p)length );
+}
+
+/* New connection starting at r->pos, replacing the old one if there is
+   one. Returns TRUE on success. */
+static int range_reconnect(struct http_range *r)
+{
+	mpg123_string request, response;
+	char range[64];
+	int sock;
+	int ret = FALSE;
+
+	mpg123_init_string(&request);
+	mpg123_init_string(&response);
+	snprintf( range, sizeof(range), "Range: bytes=%"OFF_P"-\r\n\r\n"
+	,	(off_p)r->pos );
+	if(  !mpg123_copy_string(&r->request, &request)
+	  || !mpg123_add_string(&request, range) )
+		goto range_end;
+	if((sock = open_connection(&r->host, &r->port)) < 0)
+		goto range_end;
+	if(param.verbose > 2) fprintf(stderr, "HTTP request:\n%s\n", request.p);
+	/* The header lines are of no interest, just the status. */
+	if(  writestring(sock, &request)
+	  && readhead(&response, sock) )
+	{
+		char *sptr = strchr(response.p, ' ');
+		/* Partial content, or the whole when asking for it. */
+		if( sptr && ( !strncmp(sptr+1, "206", 3)
+		  || (!r->pos && !strncmp(sptr+1, "200", 3)) ) )
+		{
+			if(r->fd < 0)
+			{
+				r->fd = sock;
+				sock = -1;
+				ret = TRUE;
+			}
+			else
+				ret = dup2(sock, r->fd) >= 0;
+		}
+		else
+		{
+			char *eol = strchr(response.p, '\n');
+			if(eol)
+				*eol = 0;
+			error1("HTTP range request failed: %s", sptr ? sptr+1 : response.p);
+		}
+	}
+	if(sock >= 0)
+		close(sock);
+	if(ret)
+		r->spos = r->pos;
+
+range_end:
+	mpg123_free_string(&request);
+	mpg123_free_string(&response);
+	return ret;
+}
+
+static ssize_t range_read(struct http_range *r, void *buf, size_t count)
+{
+	ssize_t ret;
+
+	if(r->pos >= r->length)
+		return 0;
+	if(  r->fd >= 0 && r->pos > r->spos
+	  && r->pos - r->spos <= RANGE_SKIP_LIMIT )
+	{
+		char skipbuf[4096];
+		while(r->spos < r->pos)
+		{
+			size_t skip = r->pos - r->spos;
+			if(skip > sizeof(skipbuf))
+				skip = sizeof(skipbuf);
+			if((ret = read(r->fd, skipbuf, skip)) <= 0)
+				break;
+			r->spos += ret;
+		}
+	}
+	if((r->fd < 0 || r->pos != r->spos) && !range_reconnect(r))
+	{
+		errno = EIO;
+		return -1;
+	}
+	ret = read(r->fd, buf, count);
+	if(ret > 0)
+		r->pos = r->spos += ret;
+	return ret;
+}
+
+static off_t range_seek(struct http_range *r, off_t offset, int whence)
+{
+	off_t pos;
+
+	switch(whence)
+	{
+		case SEEK_SET: pos = offset; break;
+		case SEEK_CUR: pos = r->pos + offset; break;
+		case SEEK_END: pos = r->length + offset; break;
+		default: pos = -1;
+	}
+	if(pos < 0 || pos > r->length)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	return (r->pos = pos);
+}
+
+ssize_t http_read(int fd, void *buf, size_t count)
+{
+	if(fd < 0 || fd != ranged.fd)
+		return read(fd, buf, count);
+	return range_read(&ranged, buf, count);
+}
+
+off_t http_seek(int fd, off_t offset, int whence)
+{
+	if(fd < 0 || fd != ranged.fd)
+		return lseek(fd, offset, whence);
+	return range_seek(&ranged, offset, whence);
+}
+
+int http_seekable(int fd)
+{
+	return fd >= 0 && fd == ranged.fd;
+}
+
+void http_close(int fd)
+{
+	if(fd >= 0 && fd == ranged.fd)
+		ranged.fd = -1;
+}
+
+/*
+	Handles for the resource with a connection of their own each, for
+	fetching several byte ranges at once. The connection is only made
+	with the first read, as a seek usually comes before that.
+*/
+
+static struct http_range *range_copy(struct http_range *r)
+{
+	struct http_range *c = malloc(sizeof(*c));
+	if(c == NULL)
+		return NULL;
+	c->fd = -1;
+	mpg123_init_string(&c->host);
+	mpg123_init_string(&c->port);
+	mpg123_init_string(&c->request);
+	c->length = r->length;
+	c->pos = c->spos = 0;
+	if(  !mpg123_copy_string(&r->host, &c->host)
+	  || !mpg123_copy_string(&r->port, &c->port)
+	  || !mpg123_copy_string(&r->request, &c->request) )
+	{
+		http_handle_close(c);
+		return NULL;
+	}
+	return c;
+}
+
+void *http_handle(int fd)
+{
+	return http_seekable(fd) ? range_copy(&ranged) : NULL;
+}
+
+void *http_handle_dup(void *handle)
+{
+	return range_copy(handle);
+}
+
+ssize_t http_handle_read(void *handle, void *buf, size_t count)
+{
+	return range_read(handle, buf, count);
+}
+
+int64_t http_handle_seek(void *handle, int64_t offset, int whence)
+{
+	if((off_t)offset != offset)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	return range_seek(handle, (off_t)offset, whence);
+}
+
+void http_handle_close(void *handle)
+{
+	struct http_range *r = handle;
+	if(r->fd >= 0)
+		close(r->fd);
+	mpg123_free_string(&r->host);
+	mpg123_free_string(&r->port);
+	mpg123_free_string(&r->request);
+	free(r);
+}
+
 int http_open(char* url, struct httpdata *hd)
 {
 	mpg123_string purl, host, port, path;
 	mpg123_string request, response, request_url;
 	mpg123_string httpauth1;
+	mpg123_string head;
+	size_t headpos;
 	int sock = -1;
 	int oom  = 0;
 	int relocate, numrelocs = 0;
 	int got_location = FALSE;
+	off_t length = -1; /* Content-Length, for seeking */
+	int ranges = FALSE; /* Server accepts byte ranges. */
 	/*
 		workaround for http://www.global24music.com/rautemusik/files/extreme/isdn.pls
 		this site's apache gives me a relocation to the same place when I give the port in Host request field
@@ -525,6 +822,7 @@ int http_open(char* url, struct httpdata *hd)
 	mpg123_init_string(&response);
 	mpg123_init_string(&request_url);
 	mpg123_init_string(&httpauth1);
+	mpg123_init_string(&head);
 
 	/* Get initial info for proxy server. Once. */
 	if(hd->proxystate == PROXY_UNKNOWN && !proxy_init(hd)) goto exit;
@@ -611,15 +909,11 @@ int http_open(char* url, struct httpdata *hd)
 		if(param.verbose > 2) fprintf(stderr, "HTTP request:\n%s\n",request.p);
 		if(!writestring(sock, &request)){ http_failure; }
 		relocate = FALSE;
-		/* Arbitrary length limit here... */
+		/* The whole head at once, then going through its lines. */
+		if(!readhead(&head, sock)){ http_failure; }
+		headpos = 0;
 #define safe_readstring \
-		readstring(&response, SIZE_MAX/16, sock); \
-		if(response.fill > SIZE_MAX/16) /* > because of appended zero. */ \
-		{ \
-			error("HTTP response line exceeds max. length"); \
-			http_failure; \
-		} \
-		else if(response.fill == 0) \
+		if(!headline(&response, &head, &headpos)) \
 		{ \
 			error("readstring failed"); \
 			http_failure; \
@@ -648,6 +942,8 @@ int http_open(char* url, struct httpdata *hd)
 
 		/* If we are relocated, we need to look out for a Location header. */
 		got_location = FALSE;
+		length = -1;
+		ranges = FALSE;
 
 		do
 		{
@@ -679,6 +975,10 @@ int http_open(char* url, struct httpdata *hd)
 					hd->icy_interval = (off_t) atol(tmp); /* atoll ? */
 					debug1("got icy-metaint %li", (long int)hd->icy_interval);
 				}
+				if((tmp = get_header_val("content-length", &response)))
+					length = (off_t) atobigint(tmp);
+				if((tmp = get_header_val("accept-ranges", &response)))
+					ranges = !strncasecmp(tmp, "bytes", 5);
 			}
 		} while(response.p[0] != '\r' && response.p[0] != '\n');
 		if(relocate)
@@ -700,6 +1000,10 @@ int http_open(char* url, struct httpdata *hd)
 
 		http_failure;
 	}
+	/* ICY streams interleave metadata, byte offsets would be wrong.
+	   The library also refuses timeouts with our own read function. */
+	if(ranges && length > 0 && !hd->icy_interval && param.timeout <= 0)
+		range_setup(sock, &host, &port, &request, length);
 
 exit: /* The end as well as the exception handling point... */
 	if(oom) error("Apparently, I ran out of memory or had some bad input data...");
@@ -712,6 +1016,7 @@ exit: /* The end as well as the exception handling point... */
 	mpg123_free_string(&response);
 	mpg123_free_string(&request_url);
 	mpg123_free_string(&httpauth1);
+	mpg123_free_string(&head);
 	return sock;
 }
 #endif /*WANT_WIN32_SOCKETS*/
@@ -727,5 +1032,53 @@ int http_open (char* url, struct httpdata *hd)
 }
 #endif
 
+#if !defined(NETWORK) || defined(WANT_WIN32_SOCKETS)
+/* No seekable HTTP, just the plain file operations. */
+ssize_t http_read(int fd, void *buf, size_t count)
+{
+	return read(fd, buf, count);
+}
+
+off_t http_seek(int fd, off_t offset, int whence)
+{
+	return lseek(fd, offset, whence);
+}
+
+int http_seekable(int fd)
+{
+	return 0;
+}
+
+void http_close(int fd)
+{
+}
+
+void *http_handle(int fd)
+{
+	return NULL;
+}
+
+void *http_handle_dup(void *handle)
+{
+	return NULL;
+}
+
+ssize_t http_handle_read(void *handle, void *buf, size_t count)
+{
+	errno = EBADF;
+	return -1;
+}
+
+int64_t http_handle_seek(void *handle, int64_t offset, int whence)
+{
+	errno = EBADF;
+	return -1;
+}
+
+void http_handle_close(void *handle)
+{
+}
+#endif
+
 /* EOF */
 
@@ -63,4 +63,23 @@ extern unsigned long proxyip;
 extern int http_open (char* url, struct httpdata *hd);
 extern char *httpauth;
 
+/* Reader functions for libmpg123 that make resources from http_open()
+   seekable via range requests, if the server supports that (see
+   http_seekable()). Other descriptors get plain read() and lseek(). */
+ssize_t http_read(int fd, void *buf, size_t count);
+off_t http_seek(int fd, off_t offset, int whence);
+/* TRUE if fd is a seekable HTTP resource. */
+int http_seekable(int fd);
+/* Forget about fd before closing it. */
+void http_close(int fd);
+/* A handle for mpg123_reader64() on the seekable HTTP resource behind fd,
+   NULL if there is none such. It does not touch fd, but connects anew on
+   the first read, as do copies from http_handle_dup(), so that several of
+   them fetch different byte ranges at once. */
+void *http_handle(int fd);
+void *http_handle_dup(void *handle);
+ssize_t http_handle_read(void *handle, void *buf, size_t count);
+int64_t http_handle_seek(void *handle, int64_t offset, int whence);
+void http_handle_close(void *handle);
+
 #endif
@@ -28,9 +28,22 @@
 #define compat_dlclose INT123_compat_dlclose
 #define unintr_write INT123_unintr_write
 #define unintr_read INT123_unintr_read
+#define compat_allocator INT123_compat_allocator
+#define compat_malloc INT123_compat_malloc
+#define compat_calloc INT123_compat_calloc
+#define compat_realloc INT123_compat_realloc
+#define compat_free INT123_compat_free
+#define init_crc INT123_init_crc
+#define crc_mismatch INT123_crc_mismatch
 #define ntom_set_ntom INT123_ntom_set_ntom
 #define synth_1to1 INT123_synth_1to1
+#define synth_1to1_stereo_block INT123_synth_1to1_stereo_block
 #define synth_1to1_dither INT123_synth_1to1_dither
+#define synth_1to1_dither_wrap INT123_synth_1to1_dither_wrap
+#define synth_1to1_dither_wrap_mono INT123_synth_1to1_dither_wrap_mono
+#define synth_1to1_dither_wrap_m2s INT123_synth_1to1_dither_wrap_m2s
+#define synth_1to1_dither_stereo_wrap INT123_synth_1to1_dither_stereo_wrap
+#define synth_1to1_dither_stereo_block_wrap INT123_synth_1to1_dither_stereo_block_wrap
 #define synth_1to1_i386 INT123_synth_1to1_i386
 #define synth_1to1_i586 INT123_synth_1to1_i586
 #define synth_1to1_i586_dither INT123_synth_1to1_i586_dither
@@ -43,13 +56,22 @@
 #define synth_1to1_stereo_altivec INT123_synth_1to1_stereo_altivec
 #define synth_1to1_x86_64 INT123_synth_1to1_x86_64
 #define synth_1to1_stereo_x86_64 INT123_synth_1to1_stereo_x86_64
+#define synth_1to1_stereo_x86_64_block INT123_synth_1to1_stereo_x86_64_block
 #define synth_1to1_avx INT123_synth_1to1_avx
 #define synth_1to1_stereo_avx INT123_synth_1to1_stereo_avx
+#define synth_1to1_stereo_avx_block INT123_synth_1to1_stereo_avx_block
+#define synth_1to1_avx512 INT123_synth_1to1_avx512
+#define synth_1to1_stereo_avx512 INT123_synth_1to1_stereo_avx512
+#define synth_1to1_stereo_avx512_block INT123_synth_1to1_stereo_avx512_block
 #define synth_1to1_arm INT123_synth_1to1_arm
 #define synth_1to1_neon INT123_synth_1to1_neon
 #define synth_1to1_stereo_neon INT123_synth_1to1_stereo_neon
 #define synth_1to1_neon64 INT123_synth_1to1_neon64
 #define synth_1to1_stereo_neon64 INT123_synth_1to1_stereo_neon64
+#define synth_1to1_stereo_neon64_block INT123_synth_1to1_stereo_neon64_block
+#define synth_1to1_vector INT123_synth_1to1_vector
+#define synth_1to1_stereo_vector INT123_synth_1to1_stereo_vector
+#define synth_1to1_stereo_vector_block INT123_synth_1to1_stereo_vector_block
 #define absynth_1to1_i486 INT123_absynth_1to1_i486
 #define synth_1to1_mono INT123_synth_1to1_mono
 #define synth_1to1_m2s INT123_synth_1to1_m2s
@@ -58,11 +80,15 @@
 #define synth_2to1_i386 INT123_synth_2to1_i386
 #define synth_2to1_mono INT123_synth_2to1_mono
 #define synth_2to1_m2s INT123_synth_2to1_m2s
+#define synth_2to1_pick INT123_synth_2to1_pick
+#define synth_2to1_stereo_pick INT123_synth_2to1_stereo_pick
 #define synth_4to1 INT123_synth_4to1
 #define synth_4to1_dither INT123_synth_4to1_dither
 #define synth_4to1_i386 INT123_synth_4to1_i386
 #define synth_4to1_mono INT123_synth_4to1_mono
 #define synth_4to1_m2s INT123_synth_4to1_m2s
+#define synth_4to1_pick INT123_synth_4to1_pick
+#define synth_4to1_stereo_pick INT123_synth_4to1_stereo_pick
 #define synth_ntom INT123_synth_ntom
 #define synth_ntom_mono INT123_synth_ntom_mono
 #define synth_ntom_m2s INT123_synth_ntom_m2s
@@ -90,24 +116,40 @@
 #define synth_1to1_real_stereo_sse INT123_synth_1to1_real_stereo_sse
 #define synth_1to1_real_x86_64 INT123_synth_1to1_real_x86_64
 #define synth_1to1_real_stereo_x86_64 INT123_synth_1to1_real_stereo_x86_64
+#define synth_1to1_real_stereo_x86_64_block INT123_synth_1to1_real_stereo_x86_64_block
 #define synth_1to1_real_avx INT123_synth_1to1_real_avx
 #define synth_1to1_fltst_avx INT123_synth_1to1_fltst_avx
+#define synth_1to1_fltst_avx_block INT123_synth_1to1_fltst_avx_block
+#define synth_1to1_real_avx512 INT123_synth_1to1_real_avx512
+#define synth_1to1_fltst_avx512 INT123_synth_1to1_fltst_avx512
+#define synth_1to1_fltst_avx512_block INT123_synth_1to1_fltst_avx512_block
 #define synth_1to1_real_altivec INT123_synth_1to1_real_altivec
 #define synth_1to1_fltst_altivec INT123_synth_1to1_fltst_altivec
 #define synth_1to1_real_neon INT123_synth_1to1_real_neon
 #define synth_1to1_real_stereo_neon INT123_synth_1to1_real_stereo_neon
 #define synth_1to1_real_neon64 INT123_synth_1to1_real_neon64
 #define synth_1to1_fltst_neon64 INT123_synth_1to1_fltst_neon64
+#define synth_1to1_fltst_neon64_block INT123_synth_1to1_fltst_neon64_block
+#define synth_1to1_real_sve INT123_synth_1to1_real_sve
+#define synth_1to1_fltst_sve INT123_synth_1to1_fltst_sve
+#define synth_1to1_fltst_sve_block INT123_synth_1to1_fltst_sve_block
+#define synth_1to1_real_vector INT123_synth_1to1_real_vector
+#define synth_1to1_real_stereo_vector INT123_synth_1to1_real_stereo_vector
+#define synth_1to1_real_stereo_vector_block INT123_synth_1to1_real_stereo_vector_block
 #define synth_1to1_real_mono INT123_synth_1to1_real_mono
 #define synth_1to1_real_m2s INT123_synth_1to1_real_m2s
 #define synth_2to1_real INT123_synth_2to1_real
 #define synth_2to1_real_i386 INT123_synth_2to1_real_i386
 #define synth_2to1_real_mono INT123_synth_2to1_real_mono
 #define synth_2to1_real_m2s INT123_synth_2to1_real_m2s
+#define synth_2to1_real_pick INT123_synth_2to1_real_pick
+#define synth_2to1_real_stereo_pick INT123_synth_2to1_real_stereo_pick
 #define synth_4to1_real INT123_synth_4to1_real
 #define synth_4to1_real_i386 INT123_synth_4to1_real_i386
 #define synth_4to1_real_mono INT123_synth_4to1_real_mono
 #define synth_4to1_real_m2s INT123_synth_4to1_real_m2s
+#define synth_4to1_real_pick INT123_synth_4to1_real_pick
+#define synth_4to1_real_stereo_pick INT123_synth_4to1_real_stereo_pick
 #define synth_ntom_real INT123_synth_ntom_real
 #define synth_ntom_real_mono INT123_synth_ntom_real_mono
 #define synth_ntom_real_m2s INT123_synth_ntom_real_m2s
@@ -117,24 +159,42 @@
 #define synth_1to1_s32_stereo_sse INT123_synth_1to1_s32_stereo_sse
 #define synth_1to1_s32_x86_64 INT123_synth_1to1_s32_x86_64
 #define synth_1to1_s32_stereo_x86_64 INT123_synth_1to1_s32_stereo_x86_64
+#define synth_1to1_s32_stereo_x86_64_block INT123_synth_1to1_s32_stereo_x86_64_block
 #define synth_1to1_s32_avx INT123_synth_1to1_s32_avx
 #define synth_1to1_s32_stereo_avx INT123_synth_1to1_s32_stereo_avx
+#define synth_1to1_s32_stereo_avx_block INT123_synth_1to1_s32_stereo_avx_block
+#define synth_1to1_s32_avx512 INT123_synth_1to1_s32_avx512
+#define synth_1to1_s32_stereo_avx512 INT123_synth_1to1_s32_stereo_avx512
+#define synth_1to1_s32_stereo_avx512_block INT123_synth_1to1_s32_stereo_avx512_block
 #define synth_1to1_s32_altivec INT123_synth_1to1_s32_altivec
 #define synth_1to1_s32_stereo_altivec INT123_synth_1to1_s32_stereo_altivec
 #define synth_1to1_s32_neon INT123_synth_1to1_s32_neon
 #define synth_1to1_s32_stereo_neon INT123_synth_1to1_s32_stereo_neon
 #define synth_1to1_s32_neon64 INT123_synth_1to1_s32_neon64
 #define synth_1to1_s32st_neon64 INT123_synth_1to1_s32st_neon64
+#define synth_1to1_s32st_neon64_block INT123_synth_1to1_s32st_neon64_block
+#define synth_1to1_s32_vector INT123_synth_1to1_s32_vector
+#define synth_1to1_s32_stereo_vector INT123_synth_1to1_s32_stereo_vector
+#define synth_1to1_s32_stereo_vector_block INT123_synth_1to1_s32_stereo_vector_block
 #define synth_1to1_s32_mono INT123_synth_1to1_s32_mono
 #define synth_1to1_s32_m2s INT123_synth_1to1_s32_m2s
+#define synth_1to1_s24_wrap INT123_synth_1to1_s24_wrap
+#define synth_1to1_s24_wrap_mono INT123_synth_1to1_s24_wrap_mono
+#define synth_1to1_s24_wrap_m2s INT123_synth_1to1_s24_wrap_m2s
+#define synth_1to1_s24_stereo_wrap INT123_synth_1to1_s24_stereo_wrap
+#define synth_1to1_s24_stereo_block_wrap INT123_synth_1to1_s24_stereo_block_wrap
 #define synth_2to1_s32 INT123_synth_2to1_s32
 #define synth_2to1_s32_i386 INT123_synth_2to1_s32_i386
 #define synth_2to1_s32_mono INT123_synth_2to1_s32_mono
 #define synth_2to1_s32_m2s INT123_synth_2to1_s32_m2s
+#define synth_2to1_s32_pick INT123_synth_2to1_s32_pick
+#define synth_2to1_s32_stereo_pick INT123_synth_2to1_s32_stereo_pick
 #define synth_4to1_s32 INT123_synth_4to1_s32
 #define synth_4to1_s32_i386 INT123_synth_4to1_s32_i386
 #define synth_4to1_s32_mono INT123_synth_4to1_s32_mono
 #define synth_4to1_s32_m2s INT123_synth_4to1_s32_m2s
+#define synth_4to1_s32_pick INT123_synth_4to1_s32_pick
+#define synth_4to1_s32_stereo_pick INT123_synth_4to1_s32_stereo_pick
 #define synth_ntom_s32 INT123_synth_ntom_s32
 #define synth_ntom_s32_mono INT123_synth_ntom_s32_mono
 #define synth_ntom_s32_m2s INT123_synth_ntom_s32_m2s
@@ -142,6 +202,7 @@
 #define dct64_i386 INT123_dct64_i386
 #define dct64_altivec INT123_dct64_altivec
 #define dct64_i486 INT123_dct64_i486
+#define dct64_vector INT123_dct64_vector
 #define dct36 INT123_dct36
 #define dct36_3dnow INT123_dct36_3dnow
 #define dct36_3dnowext INT123_dct36_3dnowext
@@ -150,6 +211,17 @@
 #define dct36_avx INT123_dct36_avx
 #define dct36_neon INT123_dct36_neon
 #define dct36_neon64 INT123_dct36_neon64
+#define dct36_quad_vector INT123_dct36_quad_vector
+#define antialias INT123_antialias
+#define antialias_x86_64 INT123_antialias_x86_64
+#define dct12_quad INT123_dct12_quad
+#define dct12_quad_x86_64 INT123_dct12_quad_x86_64
+#define hybrid_tail INT123_hybrid_tail
+#define hybrid_tail_x86_64 INT123_hybrid_tail_x86_64
+#define i_stereo_generic INT123_i_stereo_generic
+#define i_stereo_x86_64 INT123_i_stereo_x86_64
+#define ms_stereo_generic INT123_ms_stereo_generic
+#define ms_stereo_x86_64 INT123_ms_stereo_x86_64
 #define synth_ntom_set_step INT123_synth_ntom_set_step
 #define ntom_val INT123_ntom_val
 #define ntom_frame_outsamples INT123_ntom_frame_outsamples
@@ -157,6 +229,7 @@
 #define ntom_ins2outs INT123_ntom_ins2outs
 #define ntom_frameoff INT123_ntom_frameoff
 #define init_layer3 INT123_init_layer3
+#define layer3_pipe_exit INT123_layer3_pipe_exit
 #define init_layer3_gainpow2 INT123_init_layer3_gainpow2
 #define init_layer3_stuff INT123_init_layer3_stuff
 #define init_layer12 INT123_init_layer12
@@ -164,6 +237,7 @@
 #define init_layer12_stuff INT123_init_layer12_stuff
 #define prepare_decode_tables INT123_prepare_decode_tables
 #define make_decode_tables INT123_make_decode_tables
+#define make_decwin INT123_make_decwin
 #define make_decode_tables_mmx INT123_make_decode_tables_mmx
 #define init_layer3_gainpow2_mmx INT123_init_layer3_gainpow2_mmx
 #define init_layer12_table_mmx INT123_init_layer12_table_mmx
@@ -172,21 +246,31 @@
 #define do_layer2 INT123_do_layer2
 #define do_layer1 INT123_do_layer1
 #define do_equalizer INT123_do_equalizer
+#define do_gain INT123_do_gain
+#define do_mono_mix INT123_do_mono_mix
 #define dither_table_init INT123_dither_table_init
 #define frame_dither_init INT123_frame_dither_init
 #define invalidate_format INT123_invalidate_format
+#define prof_clock INT123_prof_clock
 #define frame_init INT123_frame_init
 #define frame_init_par INT123_frame_init_par
+#define frame_default_pars INT123_frame_default_pars
 #define frame_outbuffer INT123_frame_outbuffer
 #define frame_output_format INT123_frame_output_format
 #define frame_buffers INT123_frame_buffers
 #define frame_reset INT123_frame_reset
+#define frame_recycle INT123_frame_recycle
+#define frame_memory_part INT123_frame_memory_part
+#define frame_memory INT123_frame_memory
 #define frame_buffers_reset INT123_frame_buffers_reset
 #define frame_exit INT123_frame_exit
 #define frame_index_find INT123_frame_index_find
+#define frame_vbri_find INT123_frame_vbri_find
 #define frame_index_setup INT123_frame_index_setup
 #define do_volume INT123_do_volume
 #define do_rva INT123_do_rva
+#define frame_decode_tables INT123_frame_decode_tables
+#define frame_gain INT123_frame_gain
 #define frame_gapless_init INT123_frame_gapless_init
 #define frame_gapless_realinit INT123_frame_gapless_realinit
 #define frame_gapless_update INT123_frame_gapless_update
@@ -194,6 +278,9 @@
 #define frame_gapless_ignore INT123_frame_gapless_ignore
 #define frame_expect_outsamples INT123_frame_expect_outsamples
 #define frame_skip INT123_frame_skip
+#define frame_meta_notify INT123_frame_meta_notify
+#define frame_coeff_notify INT123_frame_coeff_notify
+#define frame_zero_byte INT123_frame_zero_byte
 #define frame_ins2outs INT123_frame_ins2outs
 #define frame_outs INT123_frame_outs
 #define frame_expect_outsampels INT123_frame_expect_outsampels
@@ -202,7 +289,26 @@
 #define frame_set_seek INT123_frame_set_seek
 #define frame_tell_seek INT123_frame_tell_seek
 #define frame_fill_toc INT123_frame_fill_toc
+#define frame_free_vbri INT123_frame_free_vbri
+#define seekcache_pending INT123_seekcache_pending
+#define seekcache_store INT123_seekcache_store
+#define seekcache_restore INT123_seekcache_restore
+#define seekcache_clear INT123_seekcache_clear
+#define seekcache_free INT123_seekcache_free
+#define snapshot_write INT123_snapshot_write
+#define snapshot_read INT123_snapshot_read
+#define scan_parallel INT123_scan_parallel
+#define threads_of INT123_threads_of
+#define threads_count INT123_threads_count
+#define task_group_init INT123_task_group_init
+#define task_add INT123_task_add
+#define task_wait INT123_task_wait
 #define getbits INT123_getbits
+#define bitcache_load INT123_bitcache_load
+#define bitcache_start INT123_bitcache_start
+#define bitcache_refill INT123_bitcache_refill
+#define bitcache_get INT123_bitcache_get
+#define bitcache_end INT123_bitcache_end
 #define getcpuflags INT123_getcpuflags
 #define icy2utf8 INT123_icy2utf8
 #define init_icy INT123_init_icy
@@ -212,6 +318,10 @@
 #define exit_id3 INT123_exit_id3
 #define reset_id3 INT123_reset_id3
 #define id3_link INT123_id3_link
+#define id3_process_lazy INT123_id3_process_lazy
+#define id3_has_pictures INT123_id3_has_pictures
+#define id3_text INT123_id3_text
+#define id3_memory INT123_id3_memory
 #define parse_new_id3 INT123_parse_new_id3
 #define id3_to_utf8 INT123_id3_to_utf8
 #define fi_init INT123_fi_init
@@ -220,6 +330,19 @@
 #define fi_add INT123_fi_add
 #define fi_set INT123_fi_set
 #define fi_reset INT123_fi_reset
+#define ci_init INT123_ci_init
+#define ci_exit INT123_ci_exit
+#define ci_reset INT123_ci_reset
+#define ci_add INT123_ci_add
+#define ci_find INT123_ci_find
+#define ci_memory INT123_ci_memory
+#define ri_init INT123_ri_init
+#define ri_exit INT123_ri_exit
+#define ri_resize INT123_ri_resize
+#define ri_reset INT123_ri_reset
+#define ri_add INT123_ri_add
+#define ri_find INT123_ri_find
+#define fi_hash INT123_fi_hash
 #define double_to_long_rounded INT123_double_to_long_rounded
 #define scale_rounded INT123_scale_rounded
 #define decode_update INT123_decode_update
@@ -231,6 +354,7 @@
 #define frame_cpu_opt INT123_frame_cpu_opt
 #define set_synth_functions INT123_set_synth_functions
 #define dectype INT123_dectype
+#define fastest_decoder INT123_fastest_decoder
 #define defdec INT123_defdec
 #define decclass INT123_decclass
 #define check_decoders INT123_check_decoders
@@ -248,13 +372,33 @@
 #define bc_cleanup INT123_bc_cleanup
 #define bc_poolsize INT123_bc_poolsize
 #define bc_fill INT123_bc_fill
+#define bc_memory INT123_bc_memory
 #define open_stream INT123_open_stream
 #define open_stream_handle INT123_open_stream_handle
 #define open_feed INT123_open_feed
 #define feed_more INT123_feed_more
+#define feed_borrow INT123_feed_borrow
 #define feed_forget INT123_feed_forget
 #define feed_set_pos INT123_feed_set_pos
+#define feed_need INT123_feed_need
+#define feed_end INT123_feed_end
 #define open_bad INT123_open_bad
+#define reader_poll_fd INT123_reader_poll_fd
+#define reader_tail INT123_reader_tail
+#define inplace_frame_body INT123_inplace_frame_body
+#define prefetch_start INT123_prefetch_start
+#define prefetch_stop INT123_prefetch_stop
+#define prefetch_read INT123_prefetch_read
+#define prefetch_seek INT123_prefetch_seek
+#define prefetch_tail INT123_prefetch_tail
+#define uring_start INT123_uring_start
+#define uring_stop INT123_uring_stop
+#define uring_read INT123_uring_read
+#define uring_seek INT123_uring_seek
+#define uring_fd INT123_uring_fd
+#define tab_decwin INT123_tab_decwin
+#define tab_layer INT123_tab_layer
+#define tab_release INT123_tab_release
 #define open_module INT123_open_module
 #define close_module INT123_close_module
 #define list_modules INT123_list_modules
@@ -266,6 +410,8 @@
 #define buffer_formats INT123_buffer_formats
 #define buffer_start INT123_buffer_start
 #define buffer_ndrain INT123_buffer_ndrain
+#define buffer_latency INT123_buffer_latency
+#define buffer_stats INT123_buffer_stats
 #define buffer_stop INT123_buffer_stop
 #define buffer_close INT123_buffer_close
 #define buffer_continue INT123_buffer_continue
@@ -275,6 +421,7 @@
 #define buffer_pause INT123_buffer_pause
 #define buffer_drop INT123_buffer_drop
 #define buffer_write INT123_buffer_write
+#define buffer_preload INT123_buffer_preload
 #define buffer_fill INT123_buffer_fill
 #define read_buf INT123_read_buf
 #define xfer_write_string INT123_xfer_write_string
@@ -290,26 +437,47 @@
 #define xfermem_writer_block INT123_xfermem_writer_block
 #define xfermem_write INT123_xfermem_write
 #define xfermem_done INT123_xfermem_done
+#define xfermem_init_threads INT123_xfermem_init_threads
+#define xfermem_reader_moved INT123_xfermem_reader_moved
 #define au_open INT123_au_open
 #define cdr_open INT123_cdr_open
 #define raw_open INT123_raw_open
+#define rawidx_open INT123_rawidx_open
 #define wav_open INT123_wav_open
 #define wav_write INT123_wav_write
+#define rawidx_write INT123_rawidx_write
 #define wav_close INT123_wav_close
 #define au_close INT123_au_close
 #define raw_close INT123_raw_close
+#define rawidx_close INT123_rawidx_close
 #define cdr_formats INT123_cdr_formats
 #define au_formats INT123_au_formats
 #define raw_formats INT123_raw_formats
 #define wav_formats INT123_wav_formats
 #define wav_drain INT123_wav_drain
+#define conv_setup INT123_conv_setup
+#define conv_free INT123_conv_free
+#define conv_play INT123_conv_play
+#define conv_flush INT123_conv_flush
+#define conv_reset INT123_conv_reset
+#define conv_client_bytes INT123_conv_client_bytes
+#define conv_client_format INT123_conv_client_format
+#define pull_prepare INT123_pull_prepare
+#define pull_start INT123_pull_start
+#define pull_feeder INT123_pull_feeder
+#define pull_stop INT123_pull_stop
+#define pull_finish INT123_pull_finish
+#define play_device INT123_play_device
 #define write_parameters INT123_write_parameters
 #define read_parameters INT123_read_parameters
+#define fmtcache_clear INT123_fmtcache_clear
 #define stringlists_add INT123_stringlists_add
 #define check_neon INT123_check_neon
+#define check_sve INT123_check_sve
 #define dct64_3dnow INT123_dct64_3dnow
 #define dct64_3dnowext INT123_dct64_3dnowext
 #define dct64_avx INT123_dct64_avx
+#define dct64_real_avx512 INT123_dct64_real_avx512
 #define dct64_real_avx INT123_dct64_real_avx
 #define dct64_mmx INT123_dct64_mmx
 #define dct64_MMX INT123_dct64_MMX
@@ -332,6 +500,7 @@
 #define synth_1to1_neon64_asm INT123_synth_1to1_neon64_asm
 #define synth_1to1_neon64_accurate_asm INT123_synth_1to1_neon64_accurate_asm
 #define synth_1to1_real_neon64_asm INT123_synth_1to1_real_neon64_asm
+#define synth_1to1_real_sve_asm INT123_synth_1to1_real_sve_asm
 #define synth_1to1_s32_neon64_asm INT123_synth_1to1_s32_neon64_asm
 #define synth_1to1_neon_accurate_asm INT123_synth_1to1_neon_accurate_asm
 #define synth_1to1_real_neon_asm INT123_synth_1to1_real_neon_asm
@@ -340,6 +509,9 @@
 #define synth_1to1_real_sse_asm INT123_synth_1to1_real_sse_asm
 #define synth_1to1_s32_sse_asm INT123_synth_1to1_s32_sse_asm
 #define synth_1to1_s_avx_asm INT123_synth_1to1_s_avx_asm
+#define synth_1to1_s_avx512_accurate_asm INT123_synth_1to1_s_avx512_accurate_asm
+#define synth_1to1_real_s_avx512_asm INT123_synth_1to1_real_s_avx512_asm
+#define synth_1to1_s32_s_avx512_asm INT123_synth_1to1_s32_s_avx512_asm
 #define synth_1to1_s_avx_accurate_asm INT123_synth_1to1_s_avx_accurate_asm
 #define synth_1to1_real_s_avx_asm INT123_synth_1to1_real_s_avx_asm
 #define synth_1to1_s32_s_avx_asm INT123_synth_1to1_s32_s_avx_asm
@@ -347,6 +519,7 @@
 #define synth_1to1_s_neon64_asm INT123_synth_1to1_s_neon64_asm
 #define synth_1to1_s_neon64_accurate_asm INT123_synth_1to1_s_neon64_accurate_asm
 #define synth_1to1_real_s_neon64_asm INT123_synth_1to1_real_s_neon64_asm
+#define synth_1to1_real_s_sve_asm INT123_synth_1to1_real_s_sve_asm
 #define synth_1to1_s32_s_neon64_asm INT123_synth_1to1_s32_s_neon64_asm
 #define synth_1to1_s_neon_accurate_asm INT123_synth_1to1_s_neon_accurate_asm
 #define synth_1to1_real_s_neon_asm INT123_synth_1to1_real_s_neon_asm
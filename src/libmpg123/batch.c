@@ -0,0 +1,503 @@
+/*
+	batch: polyphase synthesis of several streams in the lanes of vectors
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Each stream keeps its own handle for parsing and dequantization. Only
+	the synth functions of the handles are replaced, for the duration of
+	one frame, by ones that store the subband samples of each time slot into
+	lane k of a vector of BATCH_LANES streams. The DCT64 and the windowing
+	then run on these vectors for all streams in lockstep. The window does
+	not depend on the stream, so each product is a vector times a broadcast
+	coefficient and there are no shuffles at all, only the scatter of the
+	results into the interleaved output of each stream.
+
+	The lanes share one buffer offset (bo), which is fine because all of
+	them advance by the same number of time slots per frame. That is why
+	the streams must agree on the samples per frame and the channel count.
+	The output is raw float, like the generic decoder produces it, without
+	gapless trimming or resampling.
+
+	mpg123_batch_decode_subbands() stops before the synthesis and hands the
+	captured samples out per stream, for a caller that runs the filterbank
+	elsewhere (a GPU for bulk transcoding, say).
+*/
+
+#include "mpg123lib_intern.h"
+
+#include "debug.h"
+
+#if defined(HAVE_GCC_VECTORS) && defined(REAL_IS_FLOAT) && !defined(NO_REAL)
+
+/* Eight floats fill an AVX register, the compiler splits them for SSE. */
+#define BATCH_LANES 8
+/* Time slots of a frame: 36 for layer II and III, 12 for layer I. */
+#define BATCH_SLOTS 36
+
+typedef real breal __attribute__((vector_size(BATCH_LANES*sizeof(real))));
+
+#define DCT64_NAME dct64_batch
+#define DCT64_T breal
+#include "dct64_impl.h"
+
+struct batch_group
+{
+	breal in[BATCH_SLOTS][2][SBLIMIT]; /* captured subband samples */
+	breal buffs[2][2][0x110];          /* like real_buffs of a handle */
+};
+
+struct mpg123_batch_struct
+{
+	size_t count;
+	size_t groups;
+	int channels;
+	mpg123_handle **mh;
+	unsigned char *ended;
+	void *raw; /* allocation for the groups */
+	struct batch_group *group;
+	float *out; /* BATCH_SLOTS*SBLIMIT*channels per stream */
+	real decwin[512+32];
+	int bo;
+};
+
+static void capture(real *bandPtr, int channel, mpg123_handle *fr)
+{
+	struct batch_group *g = fr->batch->group + fr->batch_lane/BATCH_LANES;
+	int lane = fr->batch_lane % BATCH_LANES;
+	int sb;
+
+	if(fr->batch_slots >= BATCH_SLOTS)
+		return;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings) do_equalizer(bandPtr,channel,fr->equalizer);
+#endif
+	for(sb=0; sb<SBLIMIT; ++sb)
+		g->in[fr->batch_slots][channel][sb][lane] = bandPtr[sb];
+}
+
+static int capture_synth(real *bandPtr, int channel, mpg123_handle *fr, int final)
+{
+	capture(bandPtr, channel, fr);
+	if(final)
+		++fr->batch_slots;
+	return 0;
+}
+
+static int capture_stereo(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	capture(bandPtr_l, 0, fr);
+	capture(bandPtr_r, 1, fr);
+	++fr->batch_slots;
+	return 0;
+}
+
+static int capture_stereo_block( real *bandPtr_l, real *bandPtr_r, int count
+,	mpg123_handle *fr )
+{
+	for(; count > 0; --count)
+	{
+		capture_stereo(bandPtr_l, bandPtr_r, fr);
+		bandPtr_l += SBLIMIT;
+		bandPtr_r += SBLIMIT;
+	}
+	return 0;
+}
+
+/* Mono stream, or mixed down: sent to both channels of stereo output. */
+static int capture_mono(real *bandPtr, mpg123_handle *fr)
+{
+	capture(bandPtr, 0, fr);
+	if(fr->af.channels == 2)
+	{
+		struct batch_group *g = fr->batch->group + fr->batch_lane/BATCH_LANES;
+		int lane = fr->batch_lane % BATCH_LANES;
+		int sb;
+		if(fr->batch_slots < BATCH_SLOTS)
+			for(sb=0; sb<SBLIMIT; ++sb)
+				g->in[fr->batch_slots][1][sb][lane] = g->in[fr->batch_slots][0][sb][lane];
+	}
+	++fr->batch_slots;
+	return 0;
+}
+
+/* The generic synth_1to1 for one channel of one time slot, on vectors and
+   with float output. */
+static void batch_synth( mpg123_batch *b, struct batch_group *g, int ch
+,	breal *bandPtr, float **out, int stride )
+{
+	breal (*buf)[0x110] = g->buffs[ch];
+	breal *b0, sum;
+	real *window;
+	int bo1, j, n = 0;
+
+	if(b->bo & 0x1)
+	{
+		b0 = buf[0];
+		bo1 = b->bo;
+		dct64_batch(buf[1]+((b->bo+1)&0xf),buf[0]+b->bo,bandPtr);
+	}
+	else
+	{
+		b0 = buf[1];
+		bo1 = b->bo+1;
+		dct64_batch(buf[0]+b->bo,buf[1]+b->bo+1,bandPtr);
+	}
+
+#define BATCH_WRITE \
+	{ \
+		int lane; \
+		sum *= (real)1./SHORT_SCALE; \
+		for(lane=0; lane<BATCH_LANES; ++lane) \
+			if(out[lane]) \
+				out[lane][n*stride] = sum[lane]; \
+		++n; \
+	}
+
+	window = b->decwin + 16 - bo1;
+	for(j=16; j; j--, b0+=0x10, window+=0x20)
+	{
+		sum  = window[0x0] * b0[0x0];
+		sum -= window[0x1] * b0[0x1];
+		sum += window[0x2] * b0[0x2];
+		sum -= window[0x3] * b0[0x3];
+		sum += window[0x4] * b0[0x4];
+		sum -= window[0x5] * b0[0x5];
+		sum += window[0x6] * b0[0x6];
+		sum -= window[0x7] * b0[0x7];
+		sum += window[0x8] * b0[0x8];
+		sum -= window[0x9] * b0[0x9];
+		sum += window[0xA] * b0[0xA];
+		sum -= window[0xB] * b0[0xB];
+		sum += window[0xC] * b0[0xC];
+		sum -= window[0xD] * b0[0xD];
+		sum += window[0xE] * b0[0xE];
+		sum -= window[0xF] * b0[0xF];
+		BATCH_WRITE
+	}
+	sum  = window[0x0] * b0[0x0];
+	sum += window[0x2] * b0[0x2];
+	sum += window[0x4] * b0[0x4];
+	sum += window[0x6] * b0[0x6];
+	sum += window[0x8] * b0[0x8];
+	sum += window[0xA] * b0[0xA];
+	sum += window[0xC] * b0[0xC];
+	sum += window[0xE] * b0[0xE];
+	BATCH_WRITE
+	b0 -= 0x10;
+	window -= 0x20;
+	window += bo1<<1;
+	for(j=15; j; j--, b0-=0x10, window-=0x20)
+	{
+		sum = -window[-0x1] * b0[0x0];
+		sum -= window[-0x2] * b0[0x1];
+		sum -= window[-0x3] * b0[0x2];
+		sum -= window[-0x4] * b0[0x3];
+		sum -= window[-0x5] * b0[0x4];
+		sum -= window[-0x6] * b0[0x5];
+		sum -= window[-0x7] * b0[0x6];
+		sum -= window[-0x8] * b0[0x7];
+		sum -= window[-0x9] * b0[0x8];
+		sum -= window[-0xA] * b0[0x9];
+		sum -= window[-0xB] * b0[0xA];
+		sum -= window[-0xC] * b0[0xB];
+		sum -= window[-0xD] * b0[0xC];
+		sum -= window[-0xE] * b0[0xD];
+		sum -= window[-0xF] * b0[0xE];
+		sum -= window[-0x10] * b0[0xF];
+		BATCH_WRITE
+	}
+#undef BATCH_WRITE
+}
+
+/* The next frame of a stream into its lane, 1 at the end, 0 or error code.
+   Frames skipped before a seek target are still decoded by the handle's
+   own synth inside mpg123_framebyframe_next(). */
+static int batch_frame(mpg123_batch *b, size_t i)
+{
+	mpg123_handle *mh = b->mh[i];
+	while(1)
+	{
+		int err;
+		func_synth synth;
+		func_synth_stereo synth_stereo;
+		func_synth_stereo_block synth_stereo_block;
+		func_synth_mono synth_mono;
+
+		if(!mh->to_decode)
+		{
+			err = mpg123_framebyframe_next(mh);
+			/* A cut off file, or a feeder without data: no waiting for
+			   one stream in lockstep. */
+			if(err == MPG123_DONE || err == MPG123_NEED_MORE)
+				return 1;
+			if(err == MPG123_NEW_FORMAT)
+			{
+				if( mh->af.encoding != MPG123_ENC_FLOAT_32
+				||	mh->af.channels != b->channels )
+					return MPG123_BAD_OUTFORMAT;
+			}
+			else if(err != MPG123_OK)
+				return err;
+			if(!mh->to_decode)
+				continue;
+		}
+		if(mh->decoder_change && decode_update(mh) < 0)
+			return MPG123_ERR;
+		if(mh->down_sample != 0)
+			return MPG123_BAD_OUTFORMAT;
+
+		synth = mh->synth;
+		synth_stereo = mh->synth_stereo;
+		synth_stereo_block = mh->synth_stereo_block;
+		synth_mono = mh->synth_mono;
+		mh->synth = capture_synth;
+		mh->synth_stereo = capture_stereo;
+		mh->synth_stereo_block = capture_stereo_block;
+		mh->synth_mono = capture_mono;
+		mh->batch = b;
+		mh->batch_lane = (int)i;
+		mh->batch_slots = 0;
+		(mh->do_layer)(mh);
+		mh->synth = synth;
+		mh->synth_stereo = synth_stereo;
+		mh->synth_stereo_block = synth_stereo_block;
+		mh->synth_mono = synth_mono;
+		mh->batch = NULL;
+
+		mh->to_decode = mh->to_ignore = FALSE;
+		/* A broken frame ended early, the rest is synthesized from silence
+		   to keep the lanes in step. */
+		if(mh->batch_slots < mh->spf/SBLIMIT)
+		{
+			struct batch_group *g = b->group + i/BATCH_LANES;
+			int lane = i % BATCH_LANES;
+			int s, ch, sb;
+			for(s=mh->batch_slots; s<mh->spf/SBLIMIT && s<BATCH_SLOTS; ++s)
+				for(ch=0; ch<2; ++ch)
+					for(sb=0; sb<SBLIMIT; ++sb)
+						g->in[s][ch][sb][lane] = 0;
+			mh->batch_slots = s;
+		}
+		return 0;
+	}
+}
+
+mpg123_batch attribute_align_arg *mpg123_batch_new( mpg123_handle **mh
+,	size_t count, int *error )
+{
+	mpg123_batch *b = NULL;
+	int err = MPG123_OK;
+	size_t i;
+
+	if(!mh || !count)
+		err = MPG123_BAD_PARS;
+	for(i=0; err == MPG123_OK && i<count; ++i)
+	{
+		long rate;
+		int channels, enc;
+		if(!mh[i])
+			err = MPG123_BAD_HANDLE;
+		else if(mpg123_getformat(mh[i], &rate, &channels, &enc) != MPG123_OK)
+			err = mh[i]->err;
+		else if( enc != MPG123_ENC_FLOAT_32 || mh[i]->down_sample != 0
+		||	channels != mh[0]->af.channels )
+			err = MPG123_BAD_OUTFORMAT;
+	}
+	if(err == MPG123_OK && !(b = malloc(sizeof(*b))))
+		err = MPG123_OUT_OF_MEM;
+	if(err == MPG123_OK)
+	{
+		b->count = count;
+		b->groups = (count+BATCH_LANES-1)/BATCH_LANES;
+		b->channels = mh[0]->af.channels;
+		b->mh = malloc(sizeof(*b->mh)*count);
+		b->ended = calloc(count, 1);
+		b->raw = malloc(sizeof(struct batch_group)*b->groups+63);
+		b->out = malloc(sizeof(float)*BATCH_SLOTS*SBLIMIT*b->channels*count);
+		if(!b->mh || !b->ended || !b->raw || !b->out)
+		{
+			mpg123_batch_delete(b);
+			b = NULL;
+			err = MPG123_OUT_OF_MEM;
+		}
+	}
+	if(b)
+	{
+		memcpy(b->mh, mh, sizeof(*b->mh)*count);
+		b->group = (struct batch_group*)
+		(	(char*)b->raw + (64 - (uintptr_t)b->raw % 64) % 64 );
+		memset(b->group, 0, sizeof(struct batch_group)*b->groups);
+		/* The volume of the first stream applies to all. */
+		make_decwin( b->decwin
+		,	mh[0]->lastscale < 0 ? mh[0]->p.outscale : mh[0]->lastscale );
+		b->bo = 1;
+	}
+	if(error)
+		*error = err;
+	return b;
+}
+
+/* Decode the next frame of all streams up to the captured subband samples.
+   Returns the common number of time slots, 0 when all streams ended, or a
+   negative error code. */
+static int batch_collect(mpg123_batch *b)
+{
+	size_t i;
+	int slots = -1;
+	int ret;
+	int active = 0;
+
+	for(i=0; i<b->count; ++i)
+	{
+		if(b->ended[i])
+			continue;
+		ret = batch_frame(b, i);
+		if(ret < 0)
+			return ret;
+		if(ret)
+		{
+			b->ended[i] = 1;
+			continue;
+		}
+		if(slots < 0)
+			slots = b->mh[i]->batch_slots;
+		else if(b->mh[i]->batch_slots != slots)
+		{
+			mpg123_handle *fr = b->mh[i];
+			if(NOQUIET)
+				error("batch streams differ in samples per frame");
+			return MPG123_BAD_OUTFORMAT;
+		}
+		++active;
+	}
+	return active ? slots : 0;
+}
+
+int attribute_align_arg mpg123_batch_decode_frame( mpg123_batch *b
+,	unsigned char **audio, size_t *bytes )
+{
+	size_t i, gi;
+	int ch, s, slots;
+
+	if(!b)
+		return MPG123_BAD_HANDLE;
+	if(!audio || !bytes)
+		return MPG123_ERR_NULL;
+	for(i=0; i<b->count; ++i)
+	{
+		audio[i] = NULL;
+		bytes[i] = 0;
+	}
+	slots = batch_collect(b);
+	if(slots < 0)
+		return slots;
+	if(!slots)
+		return MPG123_DONE;
+
+	for(gi=0; gi<b->groups; ++gi)
+	{
+		struct batch_group *g = b->group+gi;
+		float *out[BATCH_LANES];
+		int bo = b->bo;
+		for(ch=0; ch<b->channels; ++ch)
+		{
+			int lane;
+			b->bo = bo;
+			for(lane=0; lane<BATCH_LANES; ++lane)
+			{
+				i = gi*BATCH_LANES+lane;
+				out[lane] = i < b->count && !b->ended[i]
+				?	b->out + i*BATCH_SLOTS*SBLIMIT*b->channels + ch
+				:	NULL;
+			}
+			for(s=0; s<slots; ++s)
+			{
+				b->bo = (b->bo-1) & 0xf;
+				batch_synth(b, g, ch, g->in[s][ch], out, b->channels);
+				for(lane=0; lane<BATCH_LANES; ++lane)
+					if(out[lane])
+						out[lane] += SBLIMIT*b->channels;
+			}
+		}
+	}
+	for(i=0; i<b->count; ++i)
+		if(!b->ended[i])
+		{
+			audio[i] = (unsigned char*)(b->out + i*BATCH_SLOTS*SBLIMIT*b->channels);
+			bytes[i] = sizeof(float)*slots*SBLIMIT*b->channels;
+		}
+	return MPG123_OK;
+}
+
+int attribute_align_arg mpg123_batch_decode_subbands( mpg123_batch *b
+,	float *subbands, size_t *slots )
+{
+	size_t i;
+	int ch, s, sb, n;
+
+	if(!b)
+		return MPG123_BAD_HANDLE;
+	if(!subbands || !slots)
+		return MPG123_ERR_NULL;
+	for(i=0; i<b->count; ++i)
+		slots[i] = 0;
+	n = batch_collect(b);
+	if(n < 0)
+		return n;
+	if(!n)
+		return MPG123_DONE;
+	for(i=0; i<b->count; ++i)
+	{
+		struct batch_group *g = b->group + i/BATCH_LANES;
+		int lane = i % BATCH_LANES;
+		float *out = subbands + i*b->channels*BATCH_SLOTS*SBLIMIT;
+		if(b->ended[i])
+			continue;
+		for(ch=0; ch<b->channels; ++ch)
+			for(s=0; s<n; ++s)
+				for(sb=0; sb<SBLIMIT; ++sb)
+					*out++ = g->in[s][ch][sb][lane];
+		slots[i] = n;
+	}
+	return MPG123_OK;
+}
+
+void attribute_align_arg mpg123_batch_delete(mpg123_batch *b)
+{
+	if(!b)
+		return;
+	free(b->mh);
+	free(b->ended);
+	free(b->raw);
+	free(b->out);
+	free(b);
+}
+
+#else
+
+mpg123_batch attribute_align_arg *mpg123_batch_new( mpg123_handle **mh
+,	size_t count, int *error )
+{
+	if(error)
+		*error = MPG123_MISSING_FEATURE;
+	return NULL;
+}
+
+int attribute_align_arg mpg123_batch_decode_frame( mpg123_batch *b
+,	unsigned char **audio, size_t *bytes )
+{
+	return MPG123_MISSING_FEATURE;
+}
+
+int attribute_align_arg mpg123_batch_decode_subbands( mpg123_batch *b
+,	float *subbands, size_t *slots )
+{
+	return MPG123_MISSING_FEATURE;
+}
+
+void attribute_align_arg mpg123_batch_delete(mpg123_batch *b)
+{
+}
+
+#endif
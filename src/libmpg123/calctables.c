@@ -0,0 +1,141 @@
+/*
+	calctables: print the constant floating point decoding tables as C code
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	This is run at build time with --enable-build-tables to create
+	build_tables.h, which tabinit.c and layer3.c include instead of
+	filling their tables in mpg123_init(). The values come from the same
+	code in tables_impl.h, compiled with the same settings as the decoder.
+	They are printed with 17 significant digits, which is enough to get
+	the very same bits back from the C compiler (and stays C89, unlike
+	hex floats).
+
+	The layer III windows stay writable, as the dct36 and dct12 variants
+	take them as plain real pointers. All the others become const.
+*/
+
+#include "mpg123lib_intern.h"
+
+static real cos64[16],cos32[8],cos16[4],cos8[2],cos4[1];
+
+/* decode.h declares some of these for the vector code, and const with
+   BUILD_TABLES. Keep clear of those, the names only matter for the printout. */
+#undef tfcos36
+#define tfcos36 calc_tfcos36
+#define COS6_1 calc_COS6_1
+#define COS6_2 calc_COS6_2
+#define cos9 calc_cos9
+#define cos18 calc_cos18
+
+/* As in layer3.c for floating point. */
+#define POW43_SIZE 1024
+#define NEW_DCT9
+static real ispow[POW43_SIZE];
+static real aa_ca[8],aa_cs[8];
+static real win[4][36];
+static real win1[4][36];
+static real COS9[9];
+static real COS6_1,COS6_2;
+static real tfcos36[9];
+static real tfcos12[3];
+static real cos9[3],cos18[3];
+static real tan1_1[16],tan2_1[16],tan1_2[16],tan2_2[16];
+static real pow1_1[2][32],pow2_1[2][32],pow1_2[2][32],pow2_2[2][32];
+
+#define TABLES_COS
+#define TABLES_LAYER3
+#include "tables_impl.h"
+
+static void print_values(const real *tab, size_t count, const char *indent)
+{
+	size_t i;
+	for(i=0; i<count; ++i)
+		printf( "%s%.17g%s", i%4 ? " " : indent, (double)tab[i]
+		,	i+1 == count ? "" : (i%4 == 3 ? ",\n" : ",") );
+	printf("\n");
+}
+
+/* One table, qual being something like "static const". */
+static void print_table( const char *qual, const char *name
+,	const real *tab, size_t count )
+{
+	printf("%s real %s[%lu] =\n{\n", qual, name, (unsigned long)count);
+	print_values(tab, count, "\t");
+	printf("};\n");
+}
+
+/* A two-dimensional table, rows of count values. */
+static void print_table2( const char *qual, const char *name
+,	const real *tab, size_t rows, size_t count )
+{
+	size_t r;
+	printf( "%s real %s[%lu][%lu] =\n{\n", qual, name
+	,	(unsigned long)rows, (unsigned long)count );
+	for(r=0; r<rows; ++r)
+	{
+		printf("\t{\n");
+		print_values(tab+r*count, count, "\t\t");
+		printf("\t}%s\n", r+1 == rows ? "" : ",");
+	}
+	printf("};\n");
+}
+
+static void print_value(const char *qual, const char *name, real val)
+{
+	printf("%s real %s = %.17g;\n", qual, name, (double)val);
+}
+
+int main(void)
+{
+	real *costabs[5] = { cos64,cos32,cos16,cos8,cos4 };
+	int i,j;
+
+	calc_cos_tables(costabs);
+	calc_layer3_tables();
+	/* As in init_layer3(). */
+	for(j=0;j<4;j++)
+	{
+		const int len[4] = { 36,36,12,36 };
+		for(i=0;i<len[j];i+=2) win1[j][i] = + win[j][i];
+
+		for(i=1;i<len[j];i+=2) win1[j][i] = - win[j][i];
+	}
+
+	printf("/* build_tables.h: generated by calctables, do not edit */\n\n");
+
+	printf("#ifdef TABLES_COS\n");
+	print_table("static ALIGNED(16) const", "cos64", cos64, 16);
+	print_table("static ALIGNED(16) const", "cos32", cos32, 8);
+	print_table("static ALIGNED(16) const", "cos16", cos16, 4);
+	print_table("static ALIGNED(16) const", "cos8",  cos8,  2);
+	print_table("static ALIGNED(16) const", "cos4",  cos4,  1);
+	printf("#endif\n\n");
+
+	printf("#ifdef TABLES_LAYER3\n");
+	print_table("static ALIGNED(64) const", "ispow", ispow, POW43_SIZE);
+	print_table("static const", "aa_ca", aa_ca, 8);
+	print_table("static const", "aa_cs", aa_cs, 8);
+	print_table2("static ALIGNED(16)", "win",  win[0],  4, 36);
+	print_table2("static ALIGNED(16)", "win1", win1[0], 4, 36);
+	printf("/* dct36_3dnow and dct36_quad_vector want these */\n");
+	print_table("const", "COS9", COS9, 9);
+	print_value("const", "COS6_1", COS6_1);
+	print_value("const", "COS6_2", COS6_2);
+	print_table("const", "tfcos36", tfcos36, 9);
+	print_table("const", "cos9",  cos9,  3);
+	print_table("const", "cos18", cos18, 3);
+	print_table("static const", "tfcos12", tfcos12, 3);
+	print_table("static const", "tan1_1", tan1_1, 16);
+	print_table("static const", "tan2_1", tan2_1, 16);
+	print_table("static const", "tan1_2", tan1_2, 16);
+	print_table("static const", "tan2_2", tan2_2, 16);
+	print_table2("static const", "pow1_1", pow1_1[0], 2, 32);
+	print_table2("static const", "pow2_1", pow2_1[0], 2, 32);
+	print_table2("static const", "pow1_2", pow1_2[0], 2, 32);
+	print_table2("static const", "pow2_2", pow2_2[0], 2, 32);
+	printf("#endif\n");
+
+	return (fflush(stdout) || ferror(stdout)) ? 1 : 0;
+}
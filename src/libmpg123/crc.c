@@ -0,0 +1,89 @@
+/*
+	crc: checking the CRC-16 of error protected MPEG audio frames
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The checksum uses the polynomial x^16+x^15+x^2+1 (0x8005), most
+	significant bit first, starting with all bits set. It covers the last two
+	bytes of the header and the most important part of the frame data: the
+	bit allocation for layer I, additionally the scale factor selection for
+	layer II, the side info for layer III.
+
+	The protected part is up to 32 bytes, which would be fast enough with a
+	simple table lookup per byte. To keep the check cheap next to the
+	decoding, four bytes are handled per step with four tables (slicing-by-4),
+	each table giving the checksum of a byte followed by some zero bytes.
+	The 16 bit state only overlaps with the first two of the four bytes.
+*/
+
+#include "crc.h"
+#include "debug.h"
+
+#define CRC_POLY 0x8005
+
+/* crc_table[k][b]: checksum of byte b followed by k zero bytes. */
+static unsigned short crc_table[4][256];
+
+void init_crc(void)
+{
+	unsigned int b, k;
+	for(b=0; b<256; ++b)
+	{
+		unsigned int crc = b << 8;
+		for(k=0; k<8; ++k)
+			crc = crc & 0x8000 ? (crc << 1) ^ CRC_POLY : crc << 1;
+		crc_table[0][b] = crc & 0xffff;
+	}
+	for(k=1; k<4; ++k)
+		for(b=0; b<256; ++b)
+		{
+			unsigned int crc = crc_table[k-1][b];
+			crc_table[k][b] = ((crc << 8) ^ crc_table[0][crc >> 8]) & 0xffff;
+		}
+}
+
+static unsigned int crc_bytes(unsigned int crc, const unsigned char *p, size_t n)
+{
+	for(; n>=4; n-=4, p+=4)
+		crc = crc_table[3][p[0] ^ (crc >> 8)]
+		^     crc_table[2][p[1] ^ (crc & 0xff)]
+		^     crc_table[1][p[2]]
+		^     crc_table[0][p[3]];
+	for(; n; --n, ++p)
+		crc = ((crc << 8) ^ crc_table[0][*p ^ (crc >> 8)]) & 0xffff;
+	return crc;
+}
+
+int crc_mismatch(mpg123_handle *fr, unsigned long bits)
+{
+	unsigned char head[2];
+	const unsigned char *data = fr->bsbuf + 2;
+	unsigned int crc;
+	unsigned int i;
+
+	if(!(fr->p.flags & MPG123_CHECK_CRC) || !fr->error_protection)
+		return 0;
+
+	head[0] = (fr->oldhead >> 8) & 0xff;
+	head[1] = fr->oldhead & 0xff;
+	crc = crc_bytes(0xffff, head, 2);
+	crc = crc_bytes(crc, data, bits >> 3);
+	/* Layer I and II end somewhere in a byte. */
+	data += bits >> 3;
+	for(i=0; i < (bits & 7); ++i)
+	{
+		unsigned int top = (crc >> 15) ^ (data[0] >> (7-i));
+		crc = (crc << 1) & 0xffff;
+		if(top & 1)
+			crc ^= CRC_POLY;
+	}
+	if(crc == fr->crc)
+		return 0;
+
+	++fr->crc_errors;
+	if(VERBOSE2)
+		fprintf( stderr, "Note: CRC mismatch (0x%04x instead of 0x%04x) in frame %li, concealing\n"
+		,	crc, fr->crc, (long)fr->num );
+	return 1;
+}
@@ -0,0 +1,28 @@
+#ifndef MPG123_H_CRC
+#define MPG123_H_CRC
+
+/*
+	crc: checking the CRC-16 of error protected MPEG audio frames
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "mpg123lib_intern.h"
+
+/* Compute the lookup tables, once for all handles. */
+void init_crc(void);
+
+/* Compare the checksum read into fr->crc with the one over the last two
+   header bytes and the given number of protected bits following the
+   checksum in fr->bsbuf. Returns 0 if the frame is fine or the check is
+   not enabled by MPG123_CHECK_CRC, nonzero for a corrupted frame, which
+   is counted in fr->crc_errors. */
+int crc_mismatch(mpg123_handle *fr, unsigned long bits);
+
+/* Bits read since the checksum, for layer I and II that check right
+   after the protected part of the frame. */
+#define crc_bits_read(fr) \
+	((unsigned long)((fr)->wordpointer - (fr)->bsbuf - 2)*8 + (fr)->bitindex)
+
+#endif
@@ -0,0 +1,192 @@
+/*
+	dct36_vector.c: DCT36 for four subbands at once, with compiler vector extensions
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	This is the NEW_DCT9 code path of dct36() in layer3.c, with each vector
+	lane working on its own subband. There are no shuffles inside the
+	transform, only the transposes for getting the subbands into lanes and
+	back. The lanes of odd subbands use the other window (win1), as
+	III_hybrid() does for the pairs.
+*/
+
+#include "vectors.h"
+
+/* Value k of the four subbands at p, 18 apart, in v[k]. */
+static void load_subbands(const real *p, vreal *v)
+{
+	int k;
+	for(k=0; k<16; k+=4)
+	{
+		v[k]   = vload(p+k);
+		v[k+1] = vload(p+18+k);
+		v[k+2] = vload(p+36+k);
+		v[k+3] = vload(p+54+k);
+		VTRANSPOSE(v[k], v[k+1], v[k+2], v[k+3]);
+	}
+	for(; k<18; ++k)
+	{
+		vreal t = { p[k], p[18+k], p[36+k], p[54+k] };
+		v[k] = t;
+	}
+}
+
+static void store_subbands(real *p, const vreal *v)
+{
+	int k;
+	for(k=0; k<16; k+=4)
+	{
+		vreal a = v[k], b = v[k+1], c = v[k+2], d = v[k+3];
+		VTRANSPOSE(a, b, c, d);
+		vstore(p+k,    a);
+		vstore(p+18+k, b);
+		vstore(p+36+k, c);
+		vstore(p+54+k, d);
+	}
+	for(; k<18; ++k)
+	{
+		p[k]    = v[k][0];
+		p[18+k] = v[k][1];
+		p[36+k] = v[k][2];
+		p[54+k] = v[k][3];
+	}
+}
+
+void dct36_quad_vector(real *inbuf, real *o1, real *o2, real *wintab, real *wintab1, real *tsbuf)
+{
+	vreal in[18], out1[18], out2[18], tmp[18];
+
+	load_subbands(inbuf, in);
+
+	in[17]+=in[16]; in[16]+=in[15]; in[15]+=in[14];
+	in[14]+=in[13]; in[13]+=in[12]; in[12]+=in[11];
+	in[11]+=in[10]; in[10]+=in[9];  in[9] +=in[8];
+	in[8] +=in[7];  in[7] +=in[6];  in[6] +=in[5];
+	in[5] +=in[4];  in[4] +=in[3];  in[3] +=in[2];
+	in[2] +=in[1];  in[1] +=in[0];
+
+	in[17]+=in[15]; in[15]+=in[13]; in[13]+=in[11]; in[11]+=in[9];
+	in[9] +=in[7];  in[7] +=in[5];  in[5] +=in[3];  in[3] +=in[1];
+
+	{
+		vreal t3;
+		{
+			vreal t0, t1, t2;
+
+			t0 = COS6_2 * (in[8] + in[16] - in[4]);
+			t1 = COS6_2 * in[12];
+
+			t3 = in[0];
+			t2 = t3 - t1 - t1;
+			tmp[1] = tmp[7] = t2 - t0;
+			tmp[4]          = t2 + t0 + t0;
+			t3 += t1;
+
+			t2 = COS6_1 * (in[10] + in[14] - in[2]);
+			tmp[1] -= t2;
+			tmp[7] += t2;
+		}
+		{
+			vreal t0, t1, t2;
+
+			t0 = cos9[0] * (in[4] + in[8] );
+			t1 = cos9[1] * (in[8] - in[16]);
+			t2 = cos9[2] * (in[4] + in[16]);
+
+			tmp[2] = tmp[6] = t3 - t0      - t2;
+			tmp[0] = tmp[8] = t3 + t0 + t1;
+			tmp[3] = tmp[5] = t3      - t1 + t2;
+		}
+	}
+	{
+		vreal t0, t1, t2, t3;
+
+		t1 = cos18[0] * (in[2]  + in[10]);
+		t2 = cos18[1] * (in[10] - in[14]);
+		t3 = COS6_1   *  in[6];
+
+		t0 = t1 + t2 + t3;
+		tmp[0] += t0;
+		tmp[8] -= t0;
+
+		t2 -= t3;
+		t1 -= t3;
+
+		t3 = cos18[2] * (in[2] + in[14]);
+
+		t1 += t3;
+		tmp[3] += t1;
+		tmp[5] -= t1;
+
+		t2 -= t3;
+		tmp[2] += t2;
+		tmp[6] -= t2;
+	}
+	{
+		vreal t0, t1, t2, t3, t4, t5, t6, t7;
+
+		t1 = COS6_2 * in[13];
+		t2 = COS6_2 * (in[9] + in[17] - in[5]);
+
+		t3 = in[1] + t1;
+		t4 = in[1] - t1 - t1;
+		t5 = t4 - t2;
+
+		t0 = cos9[0] * (in[5] + in[9]);
+		t1 = cos9[1] * (in[9] - in[17]);
+
+		tmp[13] = (t4 + t2 + t2) * tfcos36[17-13];
+		t2 = cos9[2] * (in[5] + in[17]);
+
+		t6 = t3 - t0 - t2;
+		t0 += t3 + t1;
+		t3 += t2 - t1;
+
+		t2 = cos18[0] * (in[3]  + in[11]);
+		t4 = cos18[1] * (in[11] - in[15]);
+		t7 = COS6_1   *  in[7];
+
+		t1 = t2 + t4 + t7;
+		tmp[17] = (t0 + t1) * tfcos36[17-17];
+		tmp[9]  = (t0 - t1) * tfcos36[17-9];
+		t1 = cos18[2] * (in[3] + in[15]);
+		t2 += t1 - t7;
+
+		tmp[14] = (t3 + t2) * tfcos36[17-14];
+		t0 = COS6_1 * (in[11] + in[15] - in[3]);
+		tmp[12] = (t3 - t2) * tfcos36[17-12];
+
+		t4 -= t1 + t7;
+
+		tmp[16] = (t5 - t0) * tfcos36[17-16];
+		tmp[10] = (t5 + t0) * tfcos36[17-10];
+		tmp[15] = (t6 + t4) * tfcos36[17-15];
+		tmp[11] = (t6 - t4) * tfcos36[17-11];
+	}
+
+	load_subbands(o1, out1);
+
+/* Window value i for the even and odd subbands. */
+#define W(i) ((vreal){ wintab[i], wintab1[i], wintab[i], wintab1[i] })
+#define MACRO(v) { \
+		vreal tmpval; \
+		tmpval = tmp[(v)] + tmp[17-(v)]; \
+		out2[9+(v)] = tmpval * W(27+(v)); \
+		out2[8-(v)] = tmpval * W(26-(v)); \
+		tmpval = tmp[(v)] - tmp[17-(v)]; \
+		vstore(tsbuf+SBLIMIT*(8-(v)), out1[8-(v)] + tmpval * W(8-(v))); \
+		vstore(tsbuf+SBLIMIT*(9+(v)), out1[9+(v)] + tmpval * W(9+(v))); }
+
+	MACRO(0);
+	MACRO(1);
+	MACRO(2);
+	MACRO(3);
+	MACRO(4);
+	MACRO(5);
+	MACRO(6);
+	MACRO(7);
+	MACRO(8);
+
+	store_subbands(o2, out2);
+}
@@ -29,7 +29,8 @@ void dct64_altivec(real *out0,real *out1,real *samples)
   ALIGNED(16) real bufs[32];
 
 	{
-		register real *b1,*costab;
+		register real *b1;
+		register const real *costab;
 		
 		vector unsigned char vinvert,vperm1,vperm2,vperm3,vperm4;
 		vector float v1,v2,v3,v4,v5,v6,v7,v8;
@@ -1,305 +1,140 @@
 /*
-	dct64.c: DCT64, another plain C version
-...wondering about vectors...
+	dct64_vector.c: DCT64 with compiler vector extensions
 
-	copyright ?-2006 by the mpg123 project - free software under the terms of the LGPL 2.1
+	copyright ?-2020 by the mpg123 project - free software under the terms of the LGPL 2.1
 	see COPYING and AUTHORS files in distribution or http://mpg123.org
 	initially written by Michael Hipp
 	Thomas made it look more explicit to see what's going on...
-*/
-
-/*
- * Discrete Cosine Tansform (DCT) for subband synthesis
- *
- * -funroll-loops (for gcc) will remove the loops for better performance
- * using loops in the source-code enhances readabillity
- *
- *
- * TODO: write an optimized version for the down-sampling modes
- *       (in these modes the bands 16-31 (2:1) or 8-31 (4:1) are zero 
- */
-
-
-#include "mpg123lib_intern.h"
-
-static void vec4add(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<4;++i) b[i] += a[i];
-}
-
-static void vec4iadd(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<4;++i) b[i] += a[3-i];
-}
-
-static void vec4sub(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<4;++i) b[i] -= a[i];
-}
-
-static void vec4isub(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<4;++i) b[i] -= a[3-i];
-}
-
-static void vec4copy(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<4;++i) b[i] = a[i];
-}
-
-static void vec4icopy(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<4;++i) b[i] = a[3-i];
-}
-
-static void vec4mul(real *a, real *b)
-{
-	int i;
-	for(i=0;i<4;++i) b[i] *= a[i];
-}
-
-static void vec4imul(real *a, real *b)
-{
-	int i;
-	for(i=0;i<4;++i) b[i] *= a[3-i];
-}
-
-static void vec8add(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<8;++i) b[i] += a[i];
-}
-
-static void vec8iadd(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<8;++i) b[i] += a[7-i];
-}
-
-static void vec8sub(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<8;++i) b[i] -= a[i];
-}
-
-static void vec8isub(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<8;++i) b[i] -= a[7-i];
-}
-
-static void vec8copy(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<8;++i) b[i] = a[i];
-}
-
-static void vec8icopy(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<8;++i) b[i] = a[7-i];
-}
-
-static void vec8mul(real *a, real *b)
-{
-	int i;
-	for(i=0;i<8;++i) b[i] *= a[i];
-}
-
-static void vec8imul(real *a, real *b)
-{
-	int i;
-	for(i=0;i<8;++i) b[i] *= a[7-i];
-}
-
-static void vec16add(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<16;++i) b[i] += a[i];
-}
-
-static void vec16iadd(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<16;++i) b[i] += a[15-i];
-}
-
-static void vec16sub(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<16;++i) b[i] -= a[i];
-}
 
-static void vec16copy(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<16;++i) b[i] = a[i];
-}
-
-static void vec16icopy(real * __restrict__ a, real * __restrict__ b)
-{
-	int i;
-	for(i=0;i<16;++i) b[i] = a[15-i];
-}
-
-static void vec16mul(real *a, real *b)
-{
-	int i;
-	for(i=0;i<16;++i) b[i] *= a[i];
-}
+	The same butterflies as dct64.c, computing each value with the same
+	operations and thus identical results. The first stages work on groups
+	of four, the reversed halves being lane swaps. The final additions are
+	scattered enough to stay scalar.
+*/
 
-static void vec16imul(real *a, real *b)
-{
-	int i;
-	for(i=0;i<16;++i) b[i] *= a[15-i];
-}
+#include "vectors.h"
 
-void dct64(real *out0,real *out1,real * samples)
+void dct64_vector(real *out0, real *out1, real *samples)
 {
 	real bufs[64];
+	int i;
 
+	/* Stage 1: samples -> bufs[0..31] */
+	for(i=0; i<16; i+=4)
 	{
-		int i,j;
-
-		/* for(i=0; i<16; ++i) bufs[i] = samples[i] + samples[31-i]; */
-		vec16copy(samples,    bufs);
-		vec16iadd(samples+16, bufs);
-
-		/*for(i=0;i<16;++i) bufs[16+i] = REAL_MUL(samples[15-i] - samples[16+i], pnts[0][15-i]);*/
-		vec16icopy(samples,    bufs+16);
-		vec16sub  (samples+16, bufs+16);
-		vec16imul (pnts[0],    bufs+16);
-
-		/* for(i=0;i<8;++i) bufs[32+i] = bufs[i]    + bufs[15-i]; */
-		vec8copy(bufs,   bufs+32);
-		vec8iadd(bufs+8, bufs+32);
-		/* for(i=0;i<8;++i) bufs[40+i] = REAL_MUL( bufs[7-i]  - bufs[8+i],  pnts[1][7-i] ); */
-		vec8icopy(bufs,    bufs+40);
-		vec8sub  (bufs+8,  bufs+40);
-		vec8imul (pnts[1], bufs+40);
-		/* for(i=0;i<8;++i) bufs[48+i] = bufs[16+i] + bufs[31-i]; */
-		vec8copy(bufs+16, bufs+48);
-		vec8iadd(bufs+24, bufs+48);
-		/* for(i=0;i<8;++i) bufs[56+i] = REAL_MUL( bufs[24+i] - bufs[23-i], pnts[1][7-i] ); */
-		vec8copy(bufs+24, bufs+56);
-		vec8isub(bufs+16, bufs+56);
-		vec8imul(pnts[1], bufs+56);
+		vstore(bufs+i, vload(samples+i) + vload_rev(samples+28-i));
+		vstore( bufs+16+i, (vload_rev(samples+12-i) - vload(samples+16+i))
+		*	vload_rev(pnts[0]+12-i) );
+	}
 
+	/* Stage 2: bufs[0..31] -> bufs[32..63] */
+	for(i=0; i<8; i+=4)
+	{
+		vreal c = vload_rev(pnts[1]+4-i);
+		vstore(bufs+32+i, vload(bufs+i) + vload_rev(bufs+12-i));
+		vstore(bufs+40+i, (vload_rev(bufs+4-i) - vload(bufs+8+i)) * c);
+		vstore(bufs+48+i, vload(bufs+16+i) + vload_rev(bufs+28-i));
+		vstore(bufs+56+i, (vload(bufs+24+i) - vload_rev(bufs+20-i)) * c);
+	}
 
-		for(j=0;j<2;++j)
+	/* Stage 3: bufs[32..63] -> bufs[0..31] */
+	{
+		vreal c = vload_rev(pnts[2]);
+		for(i=0; i<32; i+=16)
 		{
-			int off = j*16;
-			/*for(i=0;i<4;++i) bufs[off+i]    = bufs[off+32+i] + bufs[off+39-i];*/
-			vec4copy(bufs+off+32, bufs+off);
-			vec4iadd(bufs+off+36, bufs+off);
-			/*for(i=0;i<4;++i) bufs[off+4+i]  = REAL_MUL( bufs[off+35-i] - bufs[off+36+i], pnts[2][3-i] );*/
-			vec4icopy(bufs+off+32, bufs+off+4);
-			vec4sub  (bufs+off+36, bufs+off+4);
-			vec4imul (pnts[2],     bufs+off+4);
-			/*for(i=0;i<4;++i) bufs[off+8+i]  = bufs[off+40+i] + bufs[off+47-i];*/
-			vec4copy(bufs+off+40, bufs+off+8);
-			vec4iadd(bufs+off+44, bufs+off+8);
-			/*for(i=0;i<4;++i) bufs[off+12+i] = REAL_MUL( bufs[off+44+i] - bufs[off+43-i], pnts[2][3-i] );*/
-			vec4copy(bufs+off+44, bufs+off+12);
-			vec4isub(bufs+off+40, bufs+off+12);
-			vec4imul(pnts[2],     bufs+off+12);
+			vreal x = vload(bufs+32+i);
+			vreal y = vload(bufs+36+i);
+			vstore(bufs+i, x + VREV(y));
+			vstore(bufs+4+i, (VREV(x) - y) * c);
+			x = vload(bufs+40+i);
+			y = vload(bufs+44+i);
+			vstore(bufs+8+i, x + VREV(y));
+			vstore(bufs+12+i, (y - VREV(x)) * c);
 		}
+	}
 
-		for(j=0;j<4;++j)
+	/* Stage 4: bufs[0..31] -> bufs[32..63] */
+	{
+		vreal c = { 0, 0, pnts[3][1], pnts[3][0] };
+		for(i=0; i<32; i+=8)
 		{
-			int off = j*8;
-			bufs[off+32+0] = bufs[off+0] + bufs[off+3];
-			bufs[off+32+1] = bufs[off+1] + bufs[off+2];
-			bufs[off+32+2] = REAL_MUL( bufs[off+1] - bufs[off+2], pnts[3][1] );
-			bufs[off+32+3] = REAL_MUL( bufs[off+0] - bufs[off+3], pnts[3][0] );
-			bufs[off+32+4] = bufs[off+4] + bufs[off+7];
-			bufs[off+32+5] = bufs[off+5] + bufs[off+6];
-			bufs[off+32+6] = REAL_MUL( bufs[off+6] - bufs[off+5], pnts[3][1] );
-			bufs[off+32+7] = REAL_MUL( bufs[off+7] - bufs[off+4], pnts[3][0] );
+			vreal x = vload(bufs+i);
+			vreal rx = VREV(x);
+			vreal y = vload(bufs+4+i);
+			vreal ry = VREV(y);
+			vstore(bufs+32+i, VSHUF(x + rx, (rx - x) * c, 0, 1, 6, 7));
+			vstore(bufs+36+i, VSHUF(y + ry, (y - ry) * c, 0, 1, 6, 7));
 		}
+	}
 
-		for(j=0;j<8;++j)
+	/* Stage 5: bufs[32..63] -> bufs[0..31] */
+	{
+		vreal c = { 0, pnts[4][0], 0, -pnts[4][0] };
+		for(i=0; i<32; i+=4)
 		{
-			int off = j*4;
-			real v0,v1;
-			v0 = bufs[off+32+0]; v1 = bufs[off+32+1];
-			bufs[off+0] = v0 + v1;
-			bufs[off+1] = REAL_MUL( v0-v1, pnts[4][0] );
-			v0 = bufs[off+32+2]; v1 = bufs[off+32+3];
-			bufs[off+2] = v0 + v1;
-			bufs[off+3] = REAL_MUL( v1-v0, pnts[4][0] );
+			vreal x = vload(bufs+32+i);
+			vreal p = VSHUF(x, x, 1, 0, 3, 2);
+			vstore(bufs+i, VSHUF(x + p, (p - x) * c, 0, 5, 2, 7));
 		}
 	}
 
+	{
+		real *b1;
 
- {
-  register real *b1;
-  register int i;
-
-  for(b1=bufs,i=8;i;i--,b1+=4)
-    b1[2] += b1[3];
-
-  for(b1=bufs,i=4;i;i--,b1+=8)
-  {
-    b1[4] += b1[6];
-    b1[6] += b1[5];
-    b1[5] += b1[7];
-  }
-
-  for(b1=bufs,i=2;i;i--,b1+=16)
-  {
-    b1[8]  += b1[12];
-    b1[12] += b1[10];
-    b1[10] += b1[14];
-    b1[14] += b1[9];
-    b1[9]  += b1[13];
-    b1[13] += b1[11];
-    b1[11] += b1[15];
-  }
- }
-
+		for(b1=bufs,i=8;i;i--,b1+=4)
+			b1[2] += b1[3];
 
-  out0[0x10*16] = bufs[0];
-  out0[0x10*15] = bufs[16+0]  + bufs[16+8];
-  out0[0x10*14] = bufs[8];
-  out0[0x10*13] = bufs[16+8]  + bufs[16+4];
-  out0[0x10*12] = bufs[4];
-  out0[0x10*11] = bufs[16+4]  + bufs[16+12];
-  out0[0x10*10] = bufs[12];
-  out0[0x10* 9] = bufs[16+12] + bufs[16+2];
-  out0[0x10* 8] = bufs[2];
-  out0[0x10* 7] = bufs[16+2]  + bufs[16+10];
-  out0[0x10* 6] = bufs[10];
-  out0[0x10* 5] = bufs[16+10] + bufs[16+6];
-  out0[0x10* 4] = bufs[6];
-  out0[0x10* 3] = bufs[16+6]  + bufs[16+14];
-  out0[0x10* 2] = bufs[14];
-  out0[0x10* 1] = bufs[16+14] + bufs[16+1];
-  out0[0x10* 0] = bufs[1];
+		for(b1=bufs,i=4;i;i--,b1+=8)
+		{
+			b1[4] += b1[6];
+			b1[6] += b1[5];
+			b1[5] += b1[7];
+		}
 
-  out1[0x10* 0] = bufs[1];
-  out1[0x10* 1] = bufs[16+1]  + bufs[16+9];
-  out1[0x10* 2] = bufs[9];
-  out1[0x10* 3] = bufs[16+9]  + bufs[16+5];
-  out1[0x10* 4] = bufs[5];
-  out1[0x10* 5] = bufs[16+5]  + bufs[16+13];
-  out1[0x10* 6] = bufs[13];
-  out1[0x10* 7] = bufs[16+13] + bufs[16+3];
-  out1[0x10* 8] = bufs[3];
-  out1[0x10* 9] = bufs[16+3]  + bufs[16+11];
-  out1[0x10*10] = bufs[11];
-  out1[0x10*11] = bufs[16+11] + bufs[16+7];
-  out1[0x10*12] = bufs[7];
-  out1[0x10*13] = bufs[16+7]  + bufs[16+15];
-  out1[0x10*14] = bufs[15];
-  out1[0x10*15] = bufs[16+15];
+		for(b1=bufs,i=2;i;i--,b1+=16)
+		{
+			b1[8]  += b1[12];
+			b1[12] += b1[10];
+			b1[10] += b1[14];
+			b1[14] += b1[9];
+			b1[9]  += b1[13];
+			b1[13] += b1[11];
+			b1[11] += b1[15];
+		}
+	}
 
+	out0[0x10*16] = bufs[0];
+	out0[0x10*15] = bufs[16+0]  + bufs[16+8];
+	out0[0x10*14] = bufs[8];
+	out0[0x10*13] = bufs[16+8]  + bufs[16+4];
+	out0[0x10*12] = bufs[4];
+	out0[0x10*11] = bufs[16+4]  + bufs[16+12];
+	out0[0x10*10] = bufs[12];
+	out0[0x10* 9] = bufs[16+12] + bufs[16+2];
+	out0[0x10* 8] = bufs[2];
+	out0[0x10* 7] = bufs[16+2]  + bufs[16+10];
+	out0[0x10* 6] = bufs[10];
+	out0[0x10* 5] = bufs[16+10] + bufs[16+6];
+	out0[0x10* 4] = bufs[6];
+	out0[0x10* 3] = bufs[16+6]  + bufs[16+14];
+	out0[0x10* 2] = bufs[14];
+	out0[0x10* 1] = bufs[16+14] + bufs[16+1];
+	out0[0x10* 0] = bufs[1];
+
+	out1[0x10* 0] = bufs[1];
+	out1[0x10* 1] = bufs[16+1]  + bufs[16+9];
+	out1[0x10* 2] = bufs[9];
+	out1[0x10* 3] = bufs[16+9]  + bufs[16+5];
+	out1[0x10* 4] = bufs[5];
+	out1[0x10* 5] = bufs[16+5]  + bufs[16+13];
+	out1[0x10* 6] = bufs[13];
+	out1[0x10* 7] = bufs[16+13] + bufs[16+3];
+	out1[0x10* 8] = bufs[3];
+	out1[0x10* 9] = bufs[16+3]  + bufs[16+11];
+	out1[0x10*10] = bufs[11];
+	out1[0x10*11] = bufs[16+11] + bufs[16+7];
+	out1[0x10*12] = bufs[7];
+	out1[0x10*13] = bufs[16+7]  + bufs[16+15];
+	out1[0x10*14] = bufs[15];
+	out1[0x10*15] = bufs[16+15];
 }
-
-
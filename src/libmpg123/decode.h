@@ -12,11 +12,7 @@
 #define MPG123_DECODE_H
 
 /* Selection of class of output routines for basic format. */
-#ifndef REAL_IS_FIXED
 #define OUT_FORMATS 4 /* Basic output formats: 16bit, 8bit, real and s32 */
-#else
-#define OUT_FORMATS 2 /* Only up to 16bit */
-#endif
 
 #define OUT_16 0
 #define OUT_8  1
@@ -33,6 +29,15 @@
 void ntom_set_ntom(mpg123_handle *fr, off_t num);
 #endif
 
+/* The stereo synth the layers call for a block of time slots. The minimal
+   build (--enable-minimal-decoder) has only the generic 16 bit one and
+   calls it directly. */
+#ifdef SYNTH_DIRECT
+#define SYNTH_STEREO_BLOCK(fr) synth_1to1_stereo_block
+#else
+#define SYNTH_STEREO_BLOCK(fr) (fr)->synth_stereo_block
+#endif
+
 /* Let's collect all possible synth functions here, for an overview.
    If they are actually defined and used depends on preprocessor machinery.
    See synth.c and optimize.h for that, also some special C and assembler files. */
@@ -40,7 +45,14 @@ void ntom_set_ntom(mpg123_handle *fr, off_t num);
 #ifndef NO_16BIT
 /* The signed-16bit-producing variants. */
 int synth_1to1            (real*, int, mpg123_handle*, int);
+int synth_1to1_stereo_block(real*, real*, int, mpg123_handle*);
 int synth_1to1_dither     (real*, int, mpg123_handle*, int);
+/* MPG123_DITHER over the float synths. */
+int synth_1to1_dither_wrap       (real*, int, mpg123_handle*, int);
+int synth_1to1_dither_wrap_mono  (real*, mpg123_handle*);
+int synth_1to1_dither_wrap_m2s   (real*, mpg123_handle*);
+int synth_1to1_dither_stereo_wrap(real*, real*, mpg123_handle*);
+int synth_1to1_dither_stereo_block_wrap(real*, real*, int, mpg123_handle*);
 int synth_1to1_i386       (real*, int, mpg123_handle*, int);
 int synth_1to1_i586       (real*, int, mpg123_handle*, int);
 int synth_1to1_i586_dither(real*, int, mpg123_handle*, int);
@@ -53,13 +65,22 @@ int synth_1to1_altivec    (real*, int, mpg123_handle*, int);
 int synth_1to1_stereo_altivec(real*, real*, mpg123_handle*);
 int synth_1to1_x86_64     (real*, int, mpg123_handle*, int);
 int synth_1to1_stereo_x86_64(real*, real*, mpg123_handle*);
+int synth_1to1_stereo_x86_64_block(real*, real*, int, mpg123_handle*);
 int synth_1to1_avx        (real*, int, mpg123_handle*, int);
 int synth_1to1_stereo_avx (real*, real*, mpg123_handle*);
+int synth_1to1_stereo_avx_block(real*, real*, int, mpg123_handle*);
+int synth_1to1_avx512     (real*, int, mpg123_handle*, int);
+int synth_1to1_stereo_avx512(real*, real*, mpg123_handle*);
+int synth_1to1_stereo_avx512_block(real*, real*, int, mpg123_handle*);
 int synth_1to1_arm        (real*, int, mpg123_handle*, int);
 int synth_1to1_neon       (real*, int, mpg123_handle*, int);
 int synth_1to1_stereo_neon(real*, real*, mpg123_handle*);
 int synth_1to1_neon64     (real*, int, mpg123_handle*, int);
 int synth_1to1_stereo_neon64(real*, real*, mpg123_handle*);
+int synth_1to1_stereo_neon64_block(real*, real*, int, mpg123_handle*);
+int synth_1to1_vector     (real*, int, mpg123_handle*, int);
+int synth_1to1_stereo_vector(real*, real*, mpg123_handle*);
+int synth_1to1_stereo_vector_block(real*, real*, int, mpg123_handle*);
 /* This is different, special usage in layer3.c only.
    Hence, the name... and now forget about it.
    Never use it outside that special portion of code inside layer3.c! */
@@ -75,11 +96,15 @@ int synth_2to1_dither     (real*, int, mpg123_handle*, int);
 int synth_2to1_i386       (real*, int, mpg123_handle*, int);
 int synth_2to1_mono       (real*, mpg123_handle*);
 int synth_2to1_m2s(real*, mpg123_handle*);
+int synth_2to1_pick       (real*, int, mpg123_handle*, int);
+int synth_2to1_stereo_pick(real*, real*, mpg123_handle*);
 int synth_4to1            (real *,int, mpg123_handle*, int);
 int synth_4to1_dither     (real *,int, mpg123_handle*, int);
 int synth_4to1_i386       (real*, int, mpg123_handle*, int);
 int synth_4to1_mono       (real*, mpg123_handle*);
 int synth_4to1_m2s(real*, mpg123_handle*);
+int synth_4to1_pick       (real*, int, mpg123_handle*, int);
+int synth_4to1_stereo_pick(real*, real*, mpg123_handle*);
 #endif
 #ifndef NO_NTOM
 /* NtoM is really just one implementation. */
@@ -120,8 +145,6 @@ int synth_ntom_8bit_m2s(real*, mpg123_handle*);
 #endif
 #endif
 
-#ifndef REAL_IS_FIXED
-
 #ifndef NO_REAL
 /* The real-producing variants. */
 int synth_1to1_real            (real*, int, mpg123_handle*, int);
@@ -130,14 +153,26 @@ int synth_1to1_real_sse        (real*, int, mpg123_handle*, int);
 int synth_1to1_real_stereo_sse (real*, real*, mpg123_handle*);
 int synth_1to1_real_x86_64     (real*, int, mpg123_handle*, int);
 int synth_1to1_real_stereo_x86_64(real*, real*, mpg123_handle*);
+int synth_1to1_real_stereo_x86_64_block(real*, real*, int, mpg123_handle*);
 int synth_1to1_real_avx        (real*, int, mpg123_handle*, int);
 int synth_1to1_fltst_avx (real*, real*, mpg123_handle*);
+int synth_1to1_fltst_avx_block(real*, real*, int, mpg123_handle*);
+int synth_1to1_real_avx512     (real*, int, mpg123_handle*, int);
+int synth_1to1_fltst_avx512(real*, real*, mpg123_handle*);
+int synth_1to1_fltst_avx512_block(real*, real*, int, mpg123_handle*);
 int synth_1to1_real_altivec    (real*, int, mpg123_handle*, int);
 int synth_1to1_fltst_altivec(real*, real*, mpg123_handle*);
 int synth_1to1_real_neon       (real*, int, mpg123_handle*, int);
 int synth_1to1_real_stereo_neon(real*, real*, mpg123_handle*);
 int synth_1to1_real_neon64     (real*, int, mpg123_handle*, int);
 int synth_1to1_fltst_neon64(real*, real*, mpg123_handle*);
+int synth_1to1_fltst_neon64_block(real*, real*, int, mpg123_handle*);
+int synth_1to1_real_sve        (real*, int, mpg123_handle*, int);
+int synth_1to1_fltst_sve(real*, real*, mpg123_handle*);
+int synth_1to1_fltst_sve_block(real*, real*, int, mpg123_handle*);
+int synth_1to1_real_vector     (real*, int, mpg123_handle*, int);
+int synth_1to1_real_stereo_vector(real*, real*, mpg123_handle*);
+int synth_1to1_real_stereo_vector_block(real*, real*, int, mpg123_handle*);
 int synth_1to1_real_mono       (real*, mpg123_handle*);
 int synth_1to1_real_m2s(real*, mpg123_handle*);
 #ifndef NO_DOWNSAMPLE
@@ -145,10 +180,14 @@ int synth_2to1_real            (real*, int, mpg123_handle*, int);
 int synth_2to1_real_i386       (real*, int, mpg123_handle*, int);
 int synth_2to1_real_mono       (real*, mpg123_handle*);
 int synth_2to1_real_m2s(real*, mpg123_handle*);
+int synth_2to1_real_pick       (real*, int, mpg123_handle*, int);
+int synth_2to1_real_stereo_pick(real*, real*, mpg123_handle*);
 int synth_4to1_real            (real*, int, mpg123_handle*, int);
 int synth_4to1_real_i386       (real*, int, mpg123_handle*, int);
 int synth_4to1_real_mono       (real*, mpg123_handle*);
 int synth_4to1_real_m2s(real*, mpg123_handle*);
+int synth_4to1_real_pick       (real*, int, mpg123_handle*, int);
+int synth_4to1_real_stereo_pick(real*, real*, mpg123_handle*);
 #endif
 #ifndef NO_NTOM
 int synth_ntom_real            (real*, int, mpg123_handle*, int);
@@ -165,25 +204,44 @@ int synth_1to1_s32_sse        (real*, int, mpg123_handle*, int);
 int synth_1to1_s32_stereo_sse (real*, real*, mpg123_handle*);
 int synth_1to1_s32_x86_64     (real*, int, mpg123_handle*, int);
 int synth_1to1_s32_stereo_x86_64(real*, real*, mpg123_handle*);
+int synth_1to1_s32_stereo_x86_64_block(real*, real*, int, mpg123_handle*);
 int synth_1to1_s32_avx        (real*, int, mpg123_handle*, int);
 int synth_1to1_s32_stereo_avx (real*, real*, mpg123_handle*);
+int synth_1to1_s32_stereo_avx_block(real*, real*, int, mpg123_handle*);
+int synth_1to1_s32_avx512     (real*, int, mpg123_handle*, int);
+int synth_1to1_s32_stereo_avx512(real*, real*, mpg123_handle*);
+int synth_1to1_s32_stereo_avx512_block(real*, real*, int, mpg123_handle*);
 int synth_1to1_s32_altivec    (real*, int, mpg123_handle*, int);
 int synth_1to1_s32_stereo_altivec(real*, real*, mpg123_handle*);
 int synth_1to1_s32_neon       (real*, int, mpg123_handle*, int);
 int synth_1to1_s32_stereo_neon(real*, real*, mpg123_handle*);
 int synth_1to1_s32_neon64     (real*, int, mpg123_handle*, int);
 int synth_1to1_s32st_neon64(real*, real*, mpg123_handle*);
+int synth_1to1_s32st_neon64_block(real*, real*, int, mpg123_handle*);
+int synth_1to1_s32_vector     (real*, int, mpg123_handle*, int);
+int synth_1to1_s32_stereo_vector(real*, real*, mpg123_handle*);
+int synth_1to1_s32_stereo_vector_block(real*, real*, int, mpg123_handle*);
 int synth_1to1_s32_mono       (real*, mpg123_handle*);
 int synth_1to1_s32_m2s(real*, mpg123_handle*);
+/* Packed signed 24 bit output over the s32 synths above. */
+int synth_1to1_s24_wrap       (real*, int, mpg123_handle*, int);
+int synth_1to1_s24_wrap_mono  (real*, mpg123_handle*);
+int synth_1to1_s24_wrap_m2s   (real*, mpg123_handle*);
+int synth_1to1_s24_stereo_wrap(real*, real*, mpg123_handle*);
+int synth_1to1_s24_stereo_block_wrap(real*, real*, int, mpg123_handle*);
 #ifndef NO_DOWNSAMPLE
 int synth_2to1_s32            (real*, int, mpg123_handle*, int);
 int synth_2to1_s32_i386       (real*, int, mpg123_handle*, int);
 int synth_2to1_s32_mono       (real*, mpg123_handle*);
 int synth_2to1_s32_m2s(real*, mpg123_handle*);
+int synth_2to1_s32_pick       (real*, int, mpg123_handle*, int);
+int synth_2to1_s32_stereo_pick(real*, real*, mpg123_handle*);
 int synth_4to1_s32            (real*, int, mpg123_handle*, int);
 int synth_4to1_s32_i386       (real*, int, mpg123_handle*, int);
 int synth_4to1_s32_mono       (real*, mpg123_handle*);
 int synth_4to1_s32_m2s(real*, mpg123_handle*);
+int synth_4to1_s32_pick       (real*, int, mpg123_handle*, int);
+int synth_4to1_s32_stereo_pick(real*, real*, mpg123_handle*);
 #endif
 #ifndef NO_NTOM
 int synth_ntom_s32            (real*, int, mpg123_handle*, int);
@@ -192,8 +250,6 @@ int synth_ntom_s32_m2s(real*, mpg123_handle*);
 #endif
 #endif
 
-#endif /* FIXED */
-
 
 /* Inside these synth functions, some dct64 variants may be used.
    The special optimized ones that only appear in assembler code are not mentioned here.
@@ -202,6 +258,7 @@ void dct64        (real *,real *,real *);
 void dct64_i386   (real *,real *,real *);
 void dct64_altivec(real *,real *,real *);
 void dct64_i486(int*, int* , real*); /* Yeah, of no use outside of synth_i486.c .*/
+void dct64_vector (real *,real *,real *);
 
 /* This is used by the layer 3 decoder, one generic function and 3DNow variants. */
 void dct36         (real *,real *,real *,real *,real *);
@@ -212,6 +269,28 @@ void dct36_sse     (real *,real *,real *,real *,real *);
 void dct36_avx     (real *,real *,real *,real *,real *);
 void dct36_neon    (real *,real *,real *,real *,real *);
 void dct36_neon64  (real *,real *,real *,real *,real *);
+/* Four subbands at once, with the windows for even and odd ones. */
+void dct36_quad_vector(real *,real *,real *,real *,real *,real *);
+#ifdef OPT_GENERIC_VECTOR
+/* The constants of dct36 in layer3.c. */
+#ifdef BUILD_TABLES
+extern const real COS6_1, COS6_2, cos9[3], cos18[3], tfcos36[9];
+#else
+extern real COS6_1, COS6_2, cos9[3], cos18[3], tfcos36[9];
+#endif
+#endif
+/* The other parts of the hybrid stage, with SSE variants for x86-64. */
+void antialias         (real *,int);
+void antialias_x86_64  (real *,int);
+void dct12_quad        (real *,real *,real *,real *);
+void dct12_quad_x86_64 (real *,real *,real *,real *);
+void hybrid_tail       (real *,real *,real *,int);
+void hybrid_tail_x86_64(real *,real *,real *,int);
+/* The stereo processing before it, SSE again. */
+void i_stereo_generic  (real *,real *,const real *,int);
+void i_stereo_x86_64   (real *,real *,const real *,int);
+void ms_stereo_generic (real *,real *,int);
+void ms_stereo_x86_64  (real *,real *,int);
 
 /* Tools for NtoM resampling synth, defined in ntom.c . */
 int synth_ntom_set_step(mpg123_handle *fr); /* prepare ntom decoding */
@@ -233,6 +312,8 @@ off_t ntom_frameoff(mpg123_handle *fr, off_t soff);
    Make sure you call these once before it is too late. */
 #ifndef NO_LAYER3
 void init_layer3(void);
+/* Stop the MPG123_PIPELINE worker, if any. */
+void layer3_pipe_exit(mpg123_handle *fr);
 real init_layer3_gainpow2(mpg123_handle *fr, int i);
 void init_layer3_stuff(mpg123_handle *fr, real (*gainpow2)(mpg123_handle *fr, int i));
 #endif
@@ -244,10 +325,11 @@ void  init_layer12_stuff(mpg123_handle *fr, real* (*init_table)(mpg123_handle *f
 
 void prepare_decode_tables(void);
 
-extern real *pnts[5]; /* tabinit provides, dct64 needs */
+extern const real *pnts[5]; /* tabinit provides, dct64 needs */
 
 /* Runtime (re)init functions; needed more often. */
 void make_decode_tables(mpg123_handle *fr); /* For every volume change. */
+void make_decwin(real *decwin, double scale); /* the generic window alone */
 /* Stuff needed after updating synth setup (see set_synth_functions()). */
 
 #ifdef OPT_MMXORSSE
@@ -281,5 +363,11 @@ int do_layer1(mpg123_handle *fr);
 #endif
 /* There's an 3DNow counterpart in asm. */
 void do_equalizer(real *bandPtr,int channel, real equalizer[2][32]);
+/* Apply fr->gain to blocks of 32 subband samples of one or two
+   channels (right may be NULL), advancing the ramp per block. */
+void do_gain(mpg123_handle *fr, real *left, real *right, int blocks);
+/* Mix blocks of 32 subband samples of both channels into left, halved,
+   for mono output with one synth run instead of two. */
+void do_mono_mix(real *left, real *right, int blocks);
 
 #endif
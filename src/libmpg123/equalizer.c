@@ -9,9 +9,66 @@
 
 #include "mpg123lib_intern.h"
 
+/*
+	All values of a group are loaded before any is stored. The compiler does
+	not need to prove that both arrays are distinct then, it can just use
+	vector registers (SSE, AVX, NEON, ...) for the whole group.
+*/
 void do_equalizer(real *bandPtr,int channel, real equalizer[2][32]) 
 {
 	int i;
-	for(i=0;i<32;i++)
-	bandPtr[i] = REAL_MUL(bandPtr[i], equalizer[channel][i]);
+	real *eq = equalizer[channel];
+	for(i=0;i<32;i+=8)
+	{
+		real b0 = bandPtr[i+0], b1 = bandPtr[i+1], b2 = bandPtr[i+2], b3 = bandPtr[i+3];
+		real b4 = bandPtr[i+4], b5 = bandPtr[i+5], b6 = bandPtr[i+6], b7 = bandPtr[i+7];
+		real e0 = eq[i+0], e1 = eq[i+1], e2 = eq[i+2], e3 = eq[i+3];
+		real e4 = eq[i+4], e5 = eq[i+5], e6 = eq[i+6], e7 = eq[i+7];
+		bandPtr[i+0] = REAL_MUL(b0, e0);
+		bandPtr[i+1] = REAL_MUL(b1, e1);
+		bandPtr[i+2] = REAL_MUL(b2, e2);
+		bandPtr[i+3] = REAL_MUL(b3, e3);
+		bandPtr[i+4] = REAL_MUL(b4, e4);
+		bandPtr[i+5] = REAL_MUL(b5, e5);
+		bandPtr[i+6] = REAL_MUL(b6, e6);
+		bandPtr[i+7] = REAL_MUL(b7, e7);
+	}
+}
+
+void do_gain(mpg123_handle *fr, real *left, real *right, int blocks)
+{
+	int b, i;
+	for(b=0; b<blocks; ++b)
+	{
+		real gain;
+		if(fr->gain_ramp)
+		{
+			if(--fr->gain_ramp)
+				fr->gain += fr->gain_step;
+			else
+				fr->gain = fr->gain_target;
+		}
+		gain = fr->gain;
+		for(i=0; i<SBLIMIT; ++i)
+			left[i] = REAL_MUL(left[i], gain);
+		left += SBLIMIT;
+		if(right != NULL)
+		{
+			for(i=0; i<SBLIMIT; ++i)
+				right[i] = REAL_MUL(right[i], gain);
+			right += SBLIMIT;
+		}
+	}
+	if(!fr->gain_ramp && fr->gain == DOUBLE_TO_REAL(1.0))
+		fr->have_gain = 0;
+}
+
+/* The synth is linear, mixing the subbands is the same as mixing the
+   synthesized samples. */
+void do_mono_mix(real *left, real *right, int blocks)
+{
+	int i;
+	real half = DOUBLE_TO_REAL(0.5);
+	for(i=0; i<blocks*SBLIMIT; ++i)
+		left[i] = REAL_MUL(left[i] + right[i], half);
 }
@@ -112,6 +112,30 @@ int mpg123_feature(const enum mpg123_feature_set key)
 #else
 		return 0;
 #endif
+		case MPG123_FEATURE_THREADS:
+#ifndef NO_THREADS
+		return 1;
+#else
+		return 0;
+#endif
+		case MPG123_FEATURE_PROFILE:
+#ifdef PROFILE_STAGES
+		return 1;
+#else
+		return 0;
+#endif
+		case MPG123_FEATURE_BATCH:
+#if defined(HAVE_GCC_VECTORS) && defined(REAL_IS_FLOAT) && !defined(NO_REAL)
+		return 1;
+#else
+		return 0;
+#endif
+		case MPG123_FEATURE_IO_URING:
+#ifdef HAVE_IO_URING
+		return 1;
+#else
+		return 0;
+#endif
 
 		default: return 0;
 	}
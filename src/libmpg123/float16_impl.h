@@ -0,0 +1,105 @@
+/*
+	float16: Conversion between single precision and 16 bit floats.
+
+	copyright 2020 by the mpg123 project
+	licensed under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	This is C source to include in your code to get the static functions
+	float_to_half(), half_to_float(), float_to_bfloat() and bfloat_to_float(),
+	the decoding ones only with FLOAT16_DECODE defined before (the output of
+	libmpg123 has no use for them). Like swap_bytes_impl.h, it serves
+	intentional duplication in libmpg123 (output) and libsyn123
+	(conversion) to avoid a dependency between them.
+
+	Half is IEEE binary16, bfloat is the upper half of a binary32 (same
+	exponent range, 8 bits of mantissa). Both are rounded to nearest even.
+	This works on the bits with selections instead of branches for the
+	normal numbers, so that plain loops over buffers get vectorized by the
+	compiler where the target has the instructions. Hardware conversion
+	(F16C, NEON fp16) would need intrinsics or target flags elsewhere.
+*/
+
+/* Other headers are already included! */
+
+union float16_bits
+{
+	float f;
+	uint32_t u;
+};
+
+static uint16_t float_to_half(float f)
+{
+	union float16_bits v;
+	uint32_t sign, u, r;
+
+	v.f = f;
+	sign = v.u & 0x80000000UL;
+	u = v.u ^ sign;
+	if(u >= 0x47800000UL) /* 65536 and beyond, infinity, NaN */
+		r = u > 0x7f800000UL ? 0x7e00 : 0x7c00;
+	else if(u < 0x38800000UL)
+	{
+		/* Subnormal half or zero: let the float addition of 0.5 shift the
+		   mantissa into place and round it. */
+		union float16_bits magic;
+		magic.u = 0x3f000000UL;
+		v.u = u;
+		v.f += magic.f;
+		r = v.u - magic.u;
+	}
+	else
+	{
+		/* Rebias the exponent, round the mantissa to 10 bits.
+		   An overflow of the mantissa goes into the exponent, up to
+		   infinity for 65520 and more. */
+		uint32_t odd = (u >> 13) & 1;
+		u += ((uint32_t)(15-127) << 23) + 0xfff + odd;
+		r = u >> 13;
+	}
+	return (uint16_t)(r | (sign >> 16));
+}
+
+#ifdef FLOAT16_DECODE
+static float half_to_float(uint16_t h)
+{
+	union float16_bits v;
+	uint32_t exp;
+
+	v.u = (uint32_t)(h & 0x7fff) << 13;
+	exp = v.u & (0x7c00UL << 13);
+	v.u += (uint32_t)(127-15) << 23;
+	if(exp == (0x7c00UL << 13)) /* infinity, NaN */
+		v.u += (uint32_t)(128-16) << 23;
+	else if(!exp) /* zero, subnormal: renormalize via float subtraction */
+	{
+		union float16_bits magic;
+		magic.u = 113UL << 23;
+		v.u += 1UL << 23;
+		v.f -= magic.f;
+	}
+	v.u |= (uint32_t)(h & 0x8000) << 16;
+	return v.f;
+}
+#endif
+
+static uint16_t float_to_bfloat(float f)
+{
+	union float16_bits v;
+
+	v.f = f;
+	/* Rounding would turn a NaN with low mantissa bits into infinity. */
+	if((v.u & 0x7fffffffUL) > 0x7f800000UL)
+		return (uint16_t)((v.u >> 16) | 0x40);
+	return (uint16_t)((v.u + 0x7fff + ((v.u >> 16) & 1)) >> 16);
+}
+
+#ifdef FLOAT16_DECODE
+static float bfloat_to_float(uint16_t b)
+{
+	union float16_bits v;
+
+	v.u = (uint32_t)b << 16;
+	return v.f;
+}
+#endif
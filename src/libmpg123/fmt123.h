@@ -33,8 +33,9 @@
  *  Also 32bit float will be usual beginning with mpg123-1.7.0 .
  *  What you should bear in mind is that (SSE, etc) optimized routines may be
  *  absent for some formats. We do have SSE for 16, 32 bit and float, though.
- *  24 bit integer is done via postprocessing of 32 bit output -- just cutting
+ *  24 bit integer is derived from 32 bit output -- just cutting
  *  the last byte, no rounding, even. If you want better, do it yourself.
+ *  The 16 bit float encodings are rounded from 32 bit float output.
  *
  *  All formats are in native byte order. If you need different endinaness, you
  *  can simply postprocess the output buffers (libmpg123 wouldn't do anything
@@ -52,8 +53,8 @@ enum mpg123_enc_enum
 ,	MPG123_ENC_32     = 0x100  
 /* 0000 0000 1000 0000 Some signed integer encoding. */
 ,	MPG123_ENC_SIGNED = 0x080  
-/* 0000 1110 0000 0000 Some float encoding. */
-,	MPG123_ENC_FLOAT  = 0xe00  
+/* 1000 1110 0000 0000 Some float encoding. */
+,	MPG123_ENC_FLOAT  = 0x8e00 
 /* 0000 0000 1101 0000 signed 16 bit */
 ,	MPG123_ENC_SIGNED_16   = (MPG123_ENC_16|MPG123_ENC_SIGNED|0x10)
 /* 0000 0000 0110 0000 unsigned 16 bit */
@@ -78,13 +79,18 @@ enum mpg123_enc_enum
 ,	MPG123_ENC_FLOAT_32    = 0x200
 /* 0000 0100 0000 0000 64bit float */
 ,	MPG123_ENC_FLOAT_64    = 0x400
+/* 0000 1000 0000 0000 16bit float (IEEE half precision) */
+,	MPG123_ENC_FLOAT_16    = 0x800
+/* 1000 0000 0000 0000 16bit bfloat (upper half of 32bit float) */
+,	MPG123_ENC_BFLOAT_16   = 0x8000
 /* Any possibly known encoding from the list above. */
 ,	MPG123_ENC_ANY = ( MPG123_ENC_SIGNED_16  | MPG123_ENC_UNSIGNED_16
 	                 | MPG123_ENC_UNSIGNED_8 | MPG123_ENC_SIGNED_8
 	                 | MPG123_ENC_ULAW_8     | MPG123_ENC_ALAW_8
 	                 | MPG123_ENC_SIGNED_32  | MPG123_ENC_UNSIGNED_32
 	                 | MPG123_ENC_SIGNED_24  | MPG123_ENC_UNSIGNED_24
-	                 | MPG123_ENC_FLOAT_32   | MPG123_ENC_FLOAT_64    )
+	                 | MPG123_ENC_FLOAT_32   | MPG123_ENC_FLOAT_64
+	                 | MPG123_ENC_FLOAT_16   | MPG123_ENC_BFLOAT_16   )
 };
 
 /** Get size of one PCM sample with given encoding.
@@ -103,7 +109,7 @@ enum mpg123_enc_enum
 	? 0 \
 	: ( (enc) & MPG123_ENC_8 \
 		?	1 \
-		:	( (enc) & MPG123_ENC_16 \
+		:	( (enc) & (MPG123_ENC_16|MPG123_ENC_FLOAT_16|MPG123_ENC_BFLOAT_16) \
 			?	2 \
 			:	( (enc) & MPG123_ENC_24 \
 				?	3 \
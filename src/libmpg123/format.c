@@ -11,11 +11,12 @@
 	postprocessing that converts the samples. This means happily creating
 	data with higher resolution from less accurate decoder output.
 
-	The main point is to still offer float encoding when the decoding core uses
-	a fixed point representation that has only 16 bit output. Actually, that's
-	the only point: A fixed-point build needs to create float from 16 bit, also
-	32 or 24 bit from the same source. That's all there is to it: Everything else
-	is covered by fallback synth functions. It may be a further step to check if
+	The main point was to still offer float encoding when the decoding core uses
+	a fixed point representation that had only 16 bit output. Fixed point builds
+	have their own 32 bit and float synths now, keeping the precision of the
+	integer sums. Only a build with NO_SYNTH32 still needs to create float from
+	16 bit, also 32 or 24 bit from the same source. Everything else is covered
+	by fallback synth functions. It may be a further step to check if
 	there are cases where conversion in postprocessing works well enough to omit
 	a certain specialized decoder ... but usually, they are justified by some
 	special way to get from float to integer to begin with.
@@ -48,6 +49,8 @@ static const int my_encodings[MPG123_ENCODINGS] =
 	/* Floating point range, see below. */
 	MPG123_ENC_FLOAT_32,
 	MPG123_ENC_FLOAT_64,
+	MPG123_ENC_FLOAT_16,
+	MPG123_ENC_BFLOAT_16,
 	/* 8 bit range, see below. */
 	MPG123_ENC_SIGNED_8,
 	MPG123_ENC_UNSIGNED_8,
@@ -58,17 +61,17 @@ static const int my_encodings[MPG123_ENCODINGS] =
 /* Make that match the above table.
    And yes, I still don't like this kludgy stuff. */
 /* range[0] <= i < range[1] for forced floating point */
-static const int enc_float_range[2] = { 6, 8 };
+static const int enc_float_range[2] = { 6, 10 };
 /* same for 8 bit encodings */
-static const int enc_8bit_range[2] = { 8, 12 };
+static const int enc_8bit_range[2] = { 10, 14 };
 
 /*
 	Only one type of float is supported.
 	Actually, double is a very special experimental case not occuring in normal
 	builds. Might actually get rid of it.
 
-	Remember here: Also with REAL_IS_FIXED, I want to be able to produce float
-	output (f32) via post-processing.
+	Remember here: Also with REAL_IS_FIXED, float output (f32) is produced,
+	just with the fixed point sums scaled in the synth.
 */
 # ifdef REAL_IS_DOUBLE
 #  define MPG123_FLOAT_ENC MPG123_ENC_FLOAT_64
@@ -76,6 +79,11 @@ static const int enc_8bit_range[2] = { 8, 12 };
 #  define MPG123_FLOAT_ENC MPG123_ENC_FLOAT_32
 # endif
 
+/* The 16 bit floats are made from single precision synth output. */
+#if !defined(NO_REAL) && !defined(NO_SYNTH32) && !defined(REAL_IS_DOUBLE)
+#  define FLOAT16_OUTPUT
+#endif
+
 /* The list of actually possible encodings. */
 static const int good_encodings[] =
 {
@@ -92,6 +100,10 @@ static const int good_encodings[] =
 #ifndef NO_REAL
 	MPG123_FLOAT_ENC,
 #endif
+#ifdef FLOAT16_OUTPUT
+	MPG123_ENC_FLOAT_16,
+	MPG123_ENC_BFLOAT_16,
+#endif
 #ifndef NO_8BIT
 	MPG123_ENC_SIGNED_8,
 	MPG123_ENC_UNSIGNED_8,
@@ -333,6 +345,12 @@ end: /* Here is the _good_ end. */
 			case MPG123_ENC_UNSIGNED_16:
 				fr->af.dec_enc = MPG123_ENC_SIGNED_16;
 			break;
+#endif
+#ifdef FLOAT16_OUTPUT
+			case MPG123_ENC_FLOAT_16:
+			case MPG123_ENC_BFLOAT_16:
+				fr->af.dec_enc = MPG123_ENC_FLOAT_32;
+			break;
 #endif
 			default:
 				fr->af.dec_enc = fr->af.encoding;
@@ -481,13 +499,14 @@ off_t samples_to_bytes(mpg123_handle *fr , off_t s)
 
 off_t bytes_to_samples(mpg123_handle *fr , off_t b)
 {
-	return b / fr->af.encsize / fr->af.channels;
+	/* No output format with MPG123_META_ONLY, but also nothing buffered. */
+	return b ? b / fr->af.encsize / fr->af.channels : 0;
 }
 
 /* Number of bytes needed for decoding _and_ post-processing. */
 off_t outblock_bytes(mpg123_handle *fr, off_t s)
 {
-	int encsize = (fr->af.encoding & MPG123_ENC_24)
+	int encsize = (fr->af.encoding & MPG123_ENC_24 && fr->af.dec_enc != fr->af.encoding)
 	? 4 /* Intermediate 32 bit. */
 	: (fr->af.encsize > fr->af.dec_encsize
 		? fr->af.encsize
@@ -495,56 +514,96 @@ off_t outblock_bytes(mpg123_handle *fr, off_t s)
 	return s * encsize * fr->af.channels;
 }
 
+/*
+	The conversions in postprocessing are fused with the byte swapping for
+	MPG123_FORCE_ENDIAN, so that each output format costs one pass over the
+	buffer at most.
+*/
+#define SWAP16(v) (uint16_t)(((uint16_t)(v)>>8)|((uint16_t)(v)<<8))
+#define SWAP32(v) ( ((uint32_t)(v)>>24) | (((uint32_t)(v)>>8)&0xff00UL) \
+                  | (((uint32_t)(v)<<8)&0xff0000UL) | ((uint32_t)(v)<<24) )
+
+#ifdef WORDS_BIGENDIAN
+#define NATIVE_BIG 1
+#else
+#define NATIVE_BIG 0
+#endif
+
+static const char *bufsizeerr = "Fatal: Buffer too small for postprocessing!";
+
 #ifndef NO_32BIT
 
-/* Remove every fourth byte, facilitating conversion from 32 bit to 24 bit integers.
-   This has to be aware of endianness, of course. */
-static void chop_fourth_byte(struct outbuffer *buf)
+/* The upper three bytes of a 32 bit word, highest first for big endian. */
+static void put24(unsigned char *w, uint32_t u, int big)
 {
-	unsigned char *wpos = buf->data;
-	unsigned char *rpos = buf->data;
-	size_t blocks = buf->fill/4;
-	size_t i;
-	for(i=0; i<blocks; ++i,wpos+=3,rpos+=4)
-		DROP4BYTE(wpos, rpos)
-	buf->fill = wpos-buf->data;
+	if(big)
+	{
+		w[0] = (unsigned char)(u>>24);
+		w[1] = (unsigned char)(u>>16);
+		w[2] = (unsigned char)(u>>8);
+	}
+	else
+	{
+		w[0] = (unsigned char)(u>>8);
+		w[1] = (unsigned char)(u>>16);
+		w[2] = (unsigned char)(u>>24);
+	}
 }
 
-static void conv_s32_to_u32(struct outbuffer *buf)
+static void conv_s32_to_u32(struct outbuffer *buf, int swap)
 {
 	size_t i;
 	int32_t  *ssamples = (int32_t*)  buf->data;
 	uint32_t *usamples = (uint32_t*) buf->data;
 	size_t count = buf->fill/sizeof(int32_t);
 
-	for(i=0; i<count; ++i)
-		usamples[i] = CONV_SU32(ssamples[i]);
+	if(swap)
+		for(i=0; i<count; ++i)
+			usamples[i] = SWAP32(CONV_SU32(ssamples[i]));
+	else
+		for(i=0; i<count; ++i)
+			usamples[i] = CONV_SU32(ssamples[i]);
 }
 
-#endif
-
-
-/* We always assume that whole numbers are written!
-   partials will be cut out. */
+/* Remove every fourth byte, facilitating conversion from 32 bit to 24 bit integers,
+   in the wanted byte order, optionally also to unsigned. */
+static void conv_s32_to_24(struct outbuffer *buf, int unsign, int swap)
+{
+	int big = NATIVE_BIG != swap;
+	unsigned char *wpos = buf->data;
+	int32_t *ssamples = (int32_t*) buf->data;
+	size_t count = buf->fill/sizeof(int32_t);
+	size_t i;
 
-static const char *bufsizeerr = "Fatal: Buffer too small for postprocessing!";
+	for(i=0; i<count; ++i, wpos+=3)
+	{
+		uint32_t u = unsign ? CONV_SU32(ssamples[i]) : (uint32_t)ssamples[i];
+		put24(wpos, u, big);
+	}
+	buf->fill = wpos-buf->data;
+}
 
+#endif
 
 #ifndef NO_16BIT
 
-static void conv_s16_to_u16(struct outbuffer *buf)
+static void conv_s16_to_u16(struct outbuffer *buf, int swap)
 {
 	size_t i;
 	int16_t  *ssamples = (int16_t*) buf->data;
 	uint16_t *usamples = (uint16_t*)buf->data;
 	size_t count = buf->fill/sizeof(int16_t);
 
-	for(i=0; i<count; ++i)
-		usamples[i] = CONV_SU16(ssamples[i]);
+	if(swap)
+		for(i=0; i<count; ++i)
+			usamples[i] = SWAP16(CONV_SU16(ssamples[i]));
+	else
+		for(i=0; i<count; ++i)
+			usamples[i] = CONV_SU16(ssamples[i]);
 }
 
 #ifndef NO_REAL
-static void conv_s16_to_f32(struct outbuffer *buf)
+static void conv_s16_to_f32(struct outbuffer *buf, int swap)
 {
 	ssize_t i;
 	int16_t *in = (int16_t*) buf->data;
@@ -562,19 +621,31 @@ static void conv_s16_to_f32(struct outbuffer *buf)
 	}
 
 	/* Work from the back since output is bigger. */
-	for(i=count-1; i>=0; --i)
-	out[i] = (float)in[i] * scale;
+	if(swap)
+	{
+		uint32_t *uout = (uint32_t*) buf->data;
+		for(i=count-1; i>=0; --i)
+		{
+			union { float f; uint32_t u; } v;
+			v.f = (float)in[i] * scale;
+			uout[i] = SWAP32(v.u);
+		}
+	}
+	else
+		for(i=count-1; i>=0; --i)
+			out[i] = (float)in[i] * scale;
 
 	buf->fill = count*sizeof(float);
 }
 #endif
 
 #ifndef NO_32BIT
-static void conv_s16_to_s32(struct outbuffer *buf)
+/* Signed or unsigned 32 bit, from the back since output is bigger. */
+static void conv_s16_to_32(struct outbuffer *buf, int unsign, int swap)
 {
 	ssize_t i;
 	int16_t  *in = (int16_t*) buf->data;
-	int32_t *out = (int32_t*) buf->data;
+	uint32_t *out = (uint32_t*) buf->data;
 	size_t count = buf->fill/sizeof(int16_t);
 
 	if(buf->size < count*sizeof(int32_t))
@@ -583,17 +654,69 @@ static void conv_s16_to_s32(struct outbuffer *buf)
 		return;
 	}
 
-	/* Work from the back since output is bigger. */
 	for(i=count-1; i>=0; --i)
 	{
-		out[i] = in[i];
 		/* Could just shift bytes, but would have to mess with sign bit. */
-		out[i] *= S32_RESCALE;
+		int32_t s = (int32_t)in[i] * S32_RESCALE;
+		uint32_t u = unsign ? CONV_SU32(s) : (uint32_t)s;
+		out[i] = swap ? SWAP32(u) : u;
 	}
 
 	buf->fill = count*sizeof(int32_t);
 }
+
+/* Signed or unsigned 24 bit, also from the back. The write position
+   3*i never reaches the unread samples below i. */
+static void conv_s16_to_24(struct outbuffer *buf, int unsign, int swap)
+{
+	int big = NATIVE_BIG != swap;
+	ssize_t i;
+	int16_t *in = (int16_t*) buf->data;
+	size_t count = buf->fill/sizeof(int16_t);
+
+	if(buf->size < count*3)
+	{
+		error1("%s", bufsizeerr);
+		return;
+	}
+
+	for(i=count-1; i>=0; --i)
+	{
+		int32_t s = (int32_t)in[i] * S32_RESCALE;
+		put24(buf->data+3*i, unsign ? CONV_SU32(s) : (uint32_t)s, big);
+	}
+
+	buf->fill = count*3;
+}
+#endif
 #endif
+
+#ifdef FLOAT16_OUTPUT
+#include "float16_impl.h"
+
+/* Round float to 16 bit float in place, the output being smaller. */
+static void conv_f32_to_f16(struct outbuffer *buf, int bfloat, int swap)
+{
+	size_t i;
+	float    *in  = (float*)    buf->data;
+	uint16_t *out = (uint16_t*) buf->data;
+	size_t count = buf->fill/sizeof(float);
+
+	if(bfloat)
+		for(i=0; i<count; ++i)
+		{
+			uint16_t h = float_to_bfloat(in[i]);
+			out[i] = swap ? SWAP16(h) : h;
+		}
+	else
+		for(i=0; i<count; ++i)
+		{
+			uint16_t h = float_to_half(in[i]);
+			out[i] = swap ? SWAP16(h) : h;
+		}
+
+	buf->fill = count*sizeof(uint16_t);
+}
 #endif
 
 #include "swap_bytes_impl.h"
@@ -613,10 +736,24 @@ void postprocess_buffer(mpg123_handle *fr)
 {
 	/*
 		This caters for the final output formats that are never produced by
-		decoder synth directly (wide unsigned and 24 bit formats) or that are
-		missing because of limited decoder precision (16 bit synth but 32 or
-		24 bit output).
+		decoder synth directly (wide unsigned and 24 bit formats other than
+		signed 24 bit at the native rate, 16 bit floats) or that are missing because of limited
+		decoder precision (16 bit synth but 32 or 24 bit output). Byte swapping
+		is done along with the conversion, or alone when there is none.
 	*/
+	int swap = 0;
+	if(fr->p.flags & MPG123_FORCE_ENDIAN)
+	{
+		swap =
+#ifdef WORDS_BIGENDIAN
+			!(
+#endif
+				fr->p.flags & MPG123_BIG_ENDIAN
+#ifdef WORDS_BIGENDIAN
+			)
+#endif
+		? 1 : 0;
+	}
 	switch(fr->af.dec_enc)
 	{
 #ifndef NO_32BIT
@@ -624,14 +761,16 @@ void postprocess_buffer(mpg123_handle *fr)
 		switch(fr->af.encoding)
 		{
 		case MPG123_ENC_UNSIGNED_32:
-			conv_s32_to_u32(&fr->buffer);
+			conv_s32_to_u32(&fr->buffer, swap);
+			swap = 0;
 		break;
 		case MPG123_ENC_UNSIGNED_24:
-			conv_s32_to_u32(&fr->buffer);
-			chop_fourth_byte(&fr->buffer);
+			conv_s32_to_24(&fr->buffer, 1, swap);
+			swap = 0;
 		break;
 		case MPG123_ENC_SIGNED_24:
-			chop_fourth_byte(&fr->buffer);
+			conv_s32_to_24(&fr->buffer, 0, swap);
+			swap = 0;
 		break;
 		}
 	break;
@@ -641,46 +780,50 @@ void postprocess_buffer(mpg123_handle *fr)
 		switch(fr->af.encoding)
 		{
 		case MPG123_ENC_UNSIGNED_16:
-			conv_s16_to_u16(&fr->buffer);
+			conv_s16_to_u16(&fr->buffer, swap);
+			swap = 0;
 		break;
 #ifndef NO_REAL
 		case MPG123_ENC_FLOAT_32:
-			conv_s16_to_f32(&fr->buffer);
+			conv_s16_to_f32(&fr->buffer, swap);
+			swap = 0;
 		break;
 #endif
 #ifndef NO_32BIT
 		case MPG123_ENC_SIGNED_32:
-			conv_s16_to_s32(&fr->buffer);
+			conv_s16_to_32(&fr->buffer, 0, swap);
+			swap = 0;
 		break;
 		case MPG123_ENC_UNSIGNED_32:
-			conv_s16_to_s32(&fr->buffer);
-			conv_s32_to_u32(&fr->buffer);
+			conv_s16_to_32(&fr->buffer, 1, swap);
+			swap = 0;
 		break;
 		case MPG123_ENC_UNSIGNED_24:
-			conv_s16_to_s32(&fr->buffer);
-			conv_s32_to_u32(&fr->buffer);
-			chop_fourth_byte(&fr->buffer);
+			conv_s16_to_24(&fr->buffer, 1, swap);
+			swap = 0;
 		break;
 		case MPG123_ENC_SIGNED_24:
-			conv_s16_to_s32(&fr->buffer);
-			chop_fourth_byte(&fr->buffer);
+			conv_s16_to_24(&fr->buffer, 0, swap);
+			swap = 0;
 		break;
 #endif
 		}
 	break;
 #endif
-	}
-	if(fr->p.flags & MPG123_FORCE_ENDIAN)
-	{
-		if(
-#ifdef WORDS_BIGENDIAN
-			!(
-#endif
-				fr->p.flags & MPG123_BIG_ENDIAN
-#ifdef WORDS_BIGENDIAN
-			)
+#ifdef FLOAT16_OUTPUT
+	case MPG123_ENC_FLOAT_32:
+		switch(fr->af.encoding)
+		{
+		case MPG123_ENC_FLOAT_16:
+		case MPG123_ENC_BFLOAT_16:
+			conv_f32_to_f16( &fr->buffer
+			,	fr->af.encoding == MPG123_ENC_BFLOAT_16, swap );
+			swap = 0;
+		break;
+		}
+	break;
 #endif
-		)
-			swap_endian(&fr->buffer, mpg123_encsize(fr->af.encoding));
 	}
+	if(swap)
+		swap_endian(&fr->buffer, mpg123_encsize(fr->af.encoding));
 }
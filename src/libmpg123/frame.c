@@ -12,9 +12,36 @@
 
 static void frame_fixed_reset(mpg123_handle *fr);
 
+#ifdef PROFILE_STAGES
+#include <time.h>
+
+uint64_t prof_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+#endif
+
 /* that's doubled in decode_ntom.c */
 #define NTOM_MUL (32768)
 
+/* layer1.fraction and layer2.fraction */
+#define LAYER12_SCRATCH_SIZE (sizeof(real) * (LAYER1_SCRATCH + LAYER2_SCRATCH))
+#ifndef NO_LAYER1
+#define LAYER1_SCRATCH (2 * SCALE_BLOCK * SBLIMIT)
+#else
+#define LAYER1_SCRATCH 0
+#endif
+#ifndef NO_LAYER2
+#define LAYER2_SCRATCH (2 * 4 * SBLIMIT)
+#else
+#define LAYER2_SCRATCH 0
+#endif
+/* hybrid_in, hybrid_out, hybrid_block, the concealment spectrum and
+   hybrid_in2 */
+#define LAYER3_SCRATCH_SIZE (sizeof(real) * 6 * 2 * SBLIMIT * SSLIMIT)
+
 #define aligned_pointer(p, type, alignment) align_the_pointer(p, alignment)
 static void *align_the_pointer(void *base, unsigned int alignment)
 {
@@ -33,7 +60,7 @@ static void *align_the_pointer(void *base, unsigned int alignment)
 	else     return base;
 }
 
-static void frame_default_pars(mpg123_pars *mp)
+void frame_default_pars(mpg123_pars *mp)
 {
 	mp->outscale = 1.0;
 	mp->flags = 0;
@@ -56,6 +83,8 @@ static void frame_default_pars(mpg123_pars *mp)
 	mp->resync_limit = 1024;
 #ifdef FRAME_INDEX
 	mp->index_size = INDEX_SIZE;
+	mp->index_compact = 0;
+	mp->index_ring = 0;
 #endif
 	mp->preframes = 4; /* That's good  for layer 3 ISO compliance bitstream. */
 	mpg123_fmt_all(mp);
@@ -63,8 +92,18 @@ static void frame_default_pars(mpg123_pars *mp)
 #ifndef NO_FEEDER
 	mp->feedpool = 5; 
 	mp->feedbuffer = 4096;
+	mp->feedpool_max = 0;
 #endif
 	mp->freeformat_framesize = -1;
+	mp->prefetch = 0;
+	mp->read_block = 0;
+	mp->uring = 0;
+	mp->nonblock = 0;
+	mp->seek_cache = 0;
+	mp->fixed_memory = 0;
+	mp->scan_threads = 0;
+	mp->silence = 0;
+	mp->peek_end_later = 0;
 }
 
 void frame_init(mpg123_handle *fr)
@@ -74,6 +113,7 @@ void frame_init(mpg123_handle *fr)
 
 void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 {
+	int i;
 	fr->own_buffer = TRUE;
 	fr->buffer.data = NULL;
 	fr->buffer.rdata = NULL;
@@ -81,8 +121,15 @@ void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 	fr->buffer.size = 0;
 	fr->rawbuffs = NULL;
 	fr->rawbuffss = 0;
-	fr->rawdecwin = NULL;
-	fr->rawdecwins = 0;
+	fr->decwin_tab = NULL;
+	fr->decwin = NULL;
+	fr->layer_tab = NULL;
+	for(i=0; i<TAB_KEEP; ++i)
+	{
+		fr->decwin_keep[i] = NULL;
+		fr->layer_keep[i] = NULL;
+	}
+	fr->gainpow2 = NULL;
 #ifndef NO_8BIT
 	fr->conv16to8_buf = NULL;
 #endif
@@ -90,7 +137,18 @@ void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 	fr->dithernoise = NULL;
 #endif
 	fr->layerscratch = NULL;
+	fr->layer3scratch = NULL;
+	fr->hybrid_block = NULL;
+#ifndef NO_LAYER3
+	fr->layer3.pipe = NULL;
+#endif
+#ifndef NO_EQUALIZER
+	fr->equalizer = NULL;
+#endif
 	fr->xing_toc = NULL;
+	fr->vbri_toc = NULL;
+	fr->vbri_fill = 0;
+	fr->seekcache = NULL;
 	fr->cpu_opts.type = defdec();
 	fr->cpu_opts.class = decclass(fr->cpu_opts.type);
 #ifndef NO_NTOM
@@ -98,10 +156,31 @@ void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 	fr->ntom_val[0] = NTOM_MUL>>1;
 	fr->ntom_val[1] = NTOM_MUL>>1;
 	fr->ntom_step = NTOM_MUL;
+	fr->ntom_synth = NULL;
+	fr->ntom_prev[0] = fr->ntom_prev[1] = 0.;
 #endif
 	/* unnecessary: fr->buffer.size = fr->buffer.fill = 0; */
 	mpg123_reset_eq(fr);
 	init_icy(&fr->icy);
+	fr->meta_callback = NULL;
+	fr->meta_handle = NULL;
+	fr->coeff_callback = NULL;
+	fr->coeff_handle = NULL;
+	fr->coeff_flags = 0;
+	fr->silence_callback = NULL;
+	fr->silence_handle = NULL;
+	fr->batch = NULL;
+	fr->list = NULL;
+	fr->list_start = NULL;
+	fr->list_count = 0;
+	fr->list_index = 0;
+	fr->list_range = -1;
+#ifndef NO_ICY
+	fr->icy.block = NULL;
+	fr->icy.blockpos = fr->icy.blockfill = 0;
+	fr->icy_callback = NULL;
+	fr->icy_handle = NULL;
+#endif
 	init_id3(fr);
 	/* frame_outbuffer is missing... */
 	/* frame_buffers is missing... that one needs cpu opt setting! */
@@ -112,7 +191,17 @@ void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 	fr->rdat.iohandle = NULL;
 	fr->rdat.r_read_handle = NULL;
 	fr->rdat.r_lseek_handle = NULL;
+	fr->rdat.r_lseek_handle64 = NULL;
 	fr->rdat.cleanup_handle = NULL;
+	fr->rdat.dup_handle = NULL;
+	fr->threads = NULL;
+#ifndef NO_THREADS
+	fr->rdat.prefetch = NULL;
+#endif
+#ifdef HAVE_IO_URING
+	fr->rdat.uring = NULL;
+#endif
+	fr->rdat.block = NULL;
 	fr->wrapperdata = NULL;
 	fr->wrapperclean = NULL;
 	fr->decoder_change = 1;
@@ -121,7 +210,7 @@ void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 	else memcpy(&fr->p, mp, sizeof(struct mpg123_pars_struct));
 
 #ifndef NO_FEEDER
-	bc_prepare(&fr->rdat.buffer, fr->p.feedpool, fr->p.feedbuffer);
+	bc_prepare(&fr->rdat.buffer, fr->p.feedpool, fr->p.feedpool_max, fr->p.feedbuffer);
 #endif
 
 	fr->down_sample = 0; /* Initialize to silence harmless errors when debugging. */
@@ -130,8 +219,18 @@ void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 	fr->synth = NULL;
 	fr->synth_mono = NULL;
 	fr->make_decode_tables = NULL;
+	fr->tables_type = nodec;
+	fr->tables_sblimit = -1;
+	fr->tables_down = -1;
+	fr->tables_scale = -1;
+	fr->have_gain = 0;
+	fr->gain_ramp = 0;
+	fr->gain = fr->gain_target = DOUBLE_TO_REAL(1.0);
+	fr->gain_step = DOUBLE_TO_REAL(0.0);
 #ifdef FRAME_INDEX
 	fi_init(&fr->index);
+	ci_init(&fr->cindex, 0);
+	ri_init(&fr->rindex);
 	frame_index_setup(fr); /* Apply the size setting. */
 #endif
 #ifndef NO_MOREINFO
@@ -175,7 +274,10 @@ int attribute_align_arg mpg123_reset_eq(mpg123_handle *mh)
 	if(mh == NULL) return MPG123_BAD_HANDLE;
 #ifndef NO_EQUALIZER
 	mh->have_eq_settings = 0;
-	for(i=0; i < 32; ++i) mh->equalizer[0][i] = mh->equalizer[1][i] = DOUBLE_TO_REAL(1.0);
+	seekcache_clear(mh);
+	/* Flat is the same as no equalizer at all. */
+	if(mh->equalizer != NULL)
+		for(i=0; i < 32; ++i) mh->equalizer[0][i] = mh->equalizer[1][i] = DOUBLE_TO_REAL(1.0);
 #endif
 	return MPG123_OK;
 }
@@ -195,6 +297,17 @@ int frame_outbuffer(mpg123_handle *fr)
 	}
 
 	debug1("need frame buffer of %"SIZE_P, (size_p)size);
+	if(fr->p.fixed_memory && fr->own_buffer)
+	{
+		/* Keep what is there if that is enough, else take the largest
+		   frame (1152 samples) at the output rate, resampled from the
+		   lowest MPEG rate, in stereo and the biggest encoding. */
+		size_t big = (1152*(size_t)((fr->af.rate+7999)/8000)+1)*2*8;
+		if(fr->buffer.rdata != NULL && fr->buffer.size >= size)
+			size = fr->buffer.size;
+		else if(size < big)
+			size = big;
+	}
 	if(fr->buffer.rdata != NULL && fr->buffer.size != size)
 	{
 		free(fr->buffer.rdata);
@@ -238,11 +351,12 @@ int attribute_align_arg mpg123_replace_buffer(mpg123_handle *mh, unsigned char *
 int frame_index_setup(mpg123_handle *fr)
 {
 	int ret = MPG123_ERR;
-	if(fr->p.index_size >= 0)
-	{ /* Simple fixed index. */
+	if(fr->p.index_size >= 0 || fr->p.fixed_memory)
+	{ /* Simple fixed index, also instead of a growing one. */
+		size_t size = (size_t)(fr->p.index_size >= 0 ? fr->p.index_size : -fr->p.index_size);
 		fr->index.grow_size = 0;
-		debug1("resizing index to %li", fr->p.index_size);
-		ret = fi_resize(&fr->index, (size_t)fr->p.index_size);
+		debug1("resizing index to %lu", (unsigned long)size);
+		ret = fi_resize(&fr->index, size);
 		debug2("index resized... %lu at %p", (unsigned long)fr->index.size, (void*)fr->index.data);
 	}
 	else
@@ -253,6 +367,13 @@ int frame_index_setup(mpg123_handle *fr)
 		else
 		ret = MPG123_OK; /* We have minimal size already... and since growing is OK... */
 	}
+	if(!fr->p.index_compact || fr->p.fixed_memory)
+		ci_exit(&fr->cindex);
+	else if(!fr->cindex.enabled)
+		ci_init(&fr->cindex, 1);
+	if(  (size_t)fr->p.index_ring != fr->rindex.size
+	  && ri_resize(&fr->rindex, (size_t)fr->p.index_ring) )
+		ret = MPG123_ERR;
 	debug2("set up frame index of size %lu (ret=%i)", (unsigned long)fr->index.size, ret);
 
 	return ret;
@@ -263,8 +384,25 @@ static void frame_decode_buffers_reset(mpg123_handle *fr)
 {
 	if(fr->rawbuffs) /* memset(NULL, 0, 0) not desired */
 		memset(fr->rawbuffs, 0, fr->rawbuffss);
+#ifndef NO_NTOM
+	fr->ntom_prev[0] = fr->ntom_prev[1] = 0.;
+#endif
 }
 
+#ifndef NO_LAYER3
+/* Nothing to repeat for MPG123_CONCEAL yet, it starts out with silence. */
+static void frame_conceal_reset(mpg123_handle *fr)
+{
+	int ch;
+	for(ch=0; ch<2; ++ch)
+	{
+		fr->layer3.conceal_type[ch] = 0;
+		fr->layer3.conceal_mixed[ch] = 0;
+		fr->layer3.conceal_maxb[ch] = 0;
+	}
+}
+#endif
+
 int frame_buffers(mpg123_handle *fr)
 {
 	int buffssize = 0;
@@ -330,79 +468,12 @@ int frame_buffers(mpg123_handle *fr)
 		fr->areal_buffs[i][j] = fr->areal_buffs[0][0] + (i*4+j)*0x110;
 	}
 #endif
-	/* now the different decwins... all of the same size, actually */
-	/* The MMX ones want 32byte alignment, which I'll try to ensure manually */
-	{
-		int decwin_size = (512+32)*sizeof(real);
-#ifdef OPT_MMXORSSE
-#ifdef OPT_MULTI
-		if(fr->cpu_opts.class == mmxsse)
-		{
-#endif
-			/* decwin_mmx will share, decwins will be appended ... sizeof(float)==4 */
-			if(decwin_size < (512+32)*4) decwin_size = (512+32)*4;
-
-			/* the second window + alignment zone -- we align for 32 bytes for SSE as
-			   requirement, 64 byte for matching cache line size (that matters!) */
-			decwin_size += (512+32)*4 + 63;
-			/* (512+32)*4/32 == 2176/32 == 68, so one decwin block retains alignment for 32 or 64 bytes */
-#ifdef OPT_MULTI
-		}
-#endif
-#endif
-#if defined(OPT_ALTIVEC) || defined(OPT_ARM) 
-		/* sizeof(real) >= 4 ... yes, it could be 8, for example.
-		   We got it intialized to at least (512+32)*sizeof(real).*/
-		decwin_size += 512*sizeof(real);
-#endif
-		/* Hm, that's basically realloc() ... */
-		if(fr->rawdecwin != NULL && fr->rawdecwins != decwin_size)
-		{
-			free(fr->rawdecwin);
-			fr->rawdecwin = NULL;
-		}
-
-		if(fr->rawdecwin == NULL)
-		fr->rawdecwin = (unsigned char*) malloc(decwin_size);
-
-		if(fr->rawdecwin == NULL) return -1;
-
-		fr->rawdecwins = decwin_size;
-		fr->decwin = (real*) fr->rawdecwin;
-#ifdef OPT_MMXORSSE
-#ifdef OPT_MULTI
-		if(fr->cpu_opts.class == mmxsse)
-		{
-#endif
-			/* align decwin, assign that to decwin_mmx, append decwins */
-			/* I need to add to decwin what is missing to the next full 64 byte -- also I want to make gcc -pedantic happy... */
-			fr->decwin = aligned_pointer(fr->rawdecwin,real,64);
-			debug1("aligned decwin: %p", (void*)fr->decwin);
-			fr->decwin_mmx = (float*)fr->decwin;
-			fr->decwins = fr->decwin_mmx+512+32;
-#ifdef OPT_MULTI
-		}
-		else debug("no decwins/decwin_mmx for that class");
-#endif
-#endif
-	}
-
 	/* Layer scratch buffers are of compile-time fixed size, so allocate only once. */
 	if(fr->layerscratch == NULL)
 	{
-		/* Allocate specific layer1/2/3 buffers, so that we know they'll work for SSE. */
-		size_t scratchsize = 0;
+		/* Allocate specific layer1/2 buffers, so that we know they'll work for SSE. */
+		size_t scratchsize = LAYER12_SCRATCH_SIZE;
 		real *scratcher;
-#ifndef NO_LAYER1
-		scratchsize += sizeof(real) * 2 * SBLIMIT;
-#endif
-#ifndef NO_LAYER2
-		scratchsize += sizeof(real) * 2 * 4 * SBLIMIT;
-#endif
-#ifndef NO_LAYER3
-		scratchsize += sizeof(real) * 2 * SBLIMIT * SSLIMIT; /* hybrid_in */
-		scratchsize += sizeof(real) * 2 * SSLIMIT * SBLIMIT; /* hybrid_out */
-#endif
 		/*
 			Now figure out correct alignment:
 			We need 16 byte minimum, smallest unit of the blocks is 2*SBLIMIT*sizeof(real), which is 64*4=256. Let's do 64bytes as heuristic for cache line (as proven useful in buffs above).
@@ -415,21 +486,38 @@ int frame_buffers(mpg123_handle *fr)
 		/* Those funky pointer casts silence compilers...
 		   One might change the code at hand to really just use 1D arrays, but in practice, that would not make a (positive) difference. */
 #ifndef NO_LAYER1
-		fr->layer1.fraction = (real(*)[SBLIMIT])scratcher;
-		scratcher += 2 * SBLIMIT;
+		fr->layer1.fraction = (real(*)[SCALE_BLOCK][SBLIMIT])scratcher;
+		scratcher += 2 * SCALE_BLOCK * SBLIMIT;
 #endif
 #ifndef NO_LAYER2
 		fr->layer2.fraction = (real(*)[4][SBLIMIT])scratcher;
 		scratcher += 2 * 4 * SBLIMIT;
 #endif
+		/* Note: These buffers don't need resetting here. */
+	}
 #ifndef NO_LAYER3
+	if(fr->lay == 3 && fr->layer3scratch == NULL)
+	{
+		real *scratcher;
+		fr->layer3scratch = malloc(LAYER3_SCRATCH_SIZE+63);
+		if(fr->layer3scratch == NULL) return -1;
+
+		scratcher = aligned_pointer(fr->layer3scratch,real,64);
 		fr->layer3.hybrid_in = (real(*)[SBLIMIT][SSLIMIT])scratcher;
 		scratcher += 2 * SBLIMIT * SSLIMIT;
 		fr->layer3.hybrid_out = (real(*)[SSLIMIT][SBLIMIT])scratcher;
 		scratcher += 2 * SSLIMIT * SBLIMIT;
-#endif
-		/* Note: These buffers don't need resetting here. */
+		/* The only one that carries state from one frame to the next. */
+		fr->hybrid_block = (real(*)[2][SBLIMIT*SSLIMIT])scratcher;
+		scratcher += 2 * 2 * SBLIMIT * SSLIMIT;
+		fr->hybrid_blc[0] = fr->hybrid_blc[1] = 0;
+		memset(fr->hybrid_block, 0, sizeof(real)*2*2*SBLIMIT*SSLIMIT);
+		fr->layer3.conceal = (real(*)[SBLIMIT][SSLIMIT])scratcher;
+		scratcher += 2 * SBLIMIT * SSLIMIT;
+		fr->layer3.hybrid_in2 = (real(*)[SBLIMIT][SSLIMIT])scratcher;
+		frame_conceal_reset(fr);
 	}
+#endif
 
 	/* Only reset the buffers we created just now. */
 	frame_decode_buffers_reset(fr);
@@ -445,12 +533,20 @@ int frame_buffers_reset(mpg123_handle *fr)
 	/* Wondering: could it be actually _wanted_ to retain buffer contents over different files? (special gapless / cut stuff) */
 	fr->bsbuf = fr->bsspace[1];
 	fr->bsbufold = fr->bsbuf;
+	fr->bstail_size = 0;
 	fr->bitreservoir = 0;
 	frame_decode_buffers_reset(fr);
 	memset(fr->bsspace, 0, 2*(MAXFRAMESIZE+512));
 	memset(fr->ssave, 0, 34);
 	fr->hybrid_blc[0] = fr->hybrid_blc[1] = 0;
-	memset(fr->hybrid_block, 0, sizeof(real)*2*2*SBLIMIT*SSLIMIT);
+	if(fr->hybrid_block)
+		memset(fr->hybrid_block, 0, sizeof(real)*2*2*SBLIMIT*SSLIMIT);
+#ifndef NO_LAYER3
+	if(fr->layer3scratch)
+		frame_conceal_reset(fr);
+	fr->layer3.silent_run = 0;
+	fr->layer3.silent_frame = FALSE;
+#endif
 	return 0;
 }
 
@@ -461,12 +557,20 @@ static void frame_icy_reset(mpg123_handle* fr)
 	fr->icy.data = NULL;
 	fr->icy.interval = 0;
 	fr->icy.next = 0;
+	fr->icy.blockpos = fr->icy.blockfill = 0;
 #endif
 }
 
 static void frame_free_toc(mpg123_handle *fr)
 {
 	if(fr->xing_toc != NULL){ free(fr->xing_toc); fr->xing_toc = NULL; }
+	frame_free_vbri(fr);
+}
+
+void frame_free_vbri(mpg123_handle *fr)
+{
+	if(fr->vbri_toc != NULL){ free(fr->vbri_toc); fr->vbri_toc = NULL; }
+	fr->vbri_fill = 0;
 }
 
 /* Just copy the Xing TOC over... */
@@ -496,13 +600,57 @@ int frame_reset(mpg123_handle* fr)
 	frame_buffers_reset(fr);
 	frame_fixed_reset(fr);
 	frame_free_toc(fr);
+	seekcache_clear(fr);
 #ifdef FRAME_INDEX
 	fi_reset(&fr->index);
+	ci_reset(&fr->cindex);
+	ri_reset(&fr->rindex);
 #endif
 
 	return 0;
 }
 
+/* Bring a closed handle back to the state of a fresh one with the given
+   parameters, keeping the buffers and decoding tables for the next user.
+   Returns 0 on success, -1 if the handle is not fit for reuse. */
+int frame_recycle(mpg123_handle *fr, mpg123_pars *mp)
+{
+	/* A user-supplied output buffer is gone with its user. */
+	if(!fr->own_buffer)
+		return -1;
+	if(mp == NULL) frame_default_pars(&fr->p);
+	else memcpy(&fr->p, mp, sizeof(struct mpg123_pars_struct));
+	fr->rdat.r_read = NULL;
+	fr->rdat.r_lseek = NULL;
+	fr->rdat.iohandle = NULL;
+	fr->rdat.r_read_handle = NULL;
+	fr->rdat.r_lseek_handle = NULL;
+	fr->rdat.r_lseek_handle64 = NULL;
+	fr->rdat.cleanup_handle = NULL;
+	fr->rdat.dup_handle = NULL;
+	fr->threads = NULL;
+	frame_fixed_reset(fr); /* Parameters like preframes come in here. */
+	mpg123_reset_eq(fr);
+#ifndef NO_FEEDER
+	bc_poolsize(&fr->rdat.buffer, fr->p.feedpool, fr->p.feedpool_max, fr->p.feedbuffer);
+#endif
+#ifdef FRAME_INDEX
+	if(frame_index_setup(fr) != MPG123_OK)
+		return -1;
+#endif
+#ifndef NO_MOREINFO
+	fr->pinfo = NULL;
+#endif
+	fr->coeff_callback = NULL;
+	fr->coeff_handle = NULL;
+	fr->coeff_flags = 0;
+	fr->err = MPG123_OK;
+	/* Have the new parameters applied on the next track, tables are made
+	   again only if they actually differ. */
+	fr->decoder_change = 1;
+	return 0;
+}
+
 /* Reset everythign except dynamic memory. */
 static void frame_fixed_reset(mpg123_handle *fr)
 {
@@ -518,10 +666,13 @@ static void frame_fixed_reset(mpg123_handle *fr)
 	fr->state_flags = FRAME_ACCURATE;
 	fr->silent_resync = 0;
 	fr->audio_start = 0;
+	fr->audio_hash = 0;
 	fr->clip = 0;
+	fr->crc_errors = 0;
 	fr->oldhead = 0;
 	fr->firsthead = 0;
 	fr->lay = 0;
+	fr->headcache = 0;
 	fr->vbr = MPG123_CBR;
 	fr->abr_rate = 0;
 	fr->track_frames = 0;
@@ -542,6 +693,10 @@ static void frame_fixed_reset(mpg123_handle *fr)
 	fr->ignoreframe = fr->firstframe-fr->p.preframes;
 	fr->header_change = 0;
 	fr->lastframe = -1;
+	fr->range_end = -1;
+	fr->segment_fill = 0;
+	fr->segment_start = 0;
+	fr->segment_cuts = 0;
 	fr->fresh = 1;
 	fr->new_format = 0;
 #ifdef GAPLESS
@@ -555,6 +710,10 @@ static void frame_fixed_reset(mpg123_handle *fr)
 	fr->bo = 1; /* the usual bo */
 #ifdef OPT_DITHER
 	fr->ditherindex = 0;
+#endif
+#ifdef PROFILE_STAGES
+	memset(fr->prof, 0, sizeof(fr->prof));
+	fr->prof_mark = 0;
 #endif
 	reset_id3(fr);
 	reset_icy(&fr->icy);
@@ -562,6 +721,7 @@ static void frame_fixed_reset(mpg123_handle *fr)
 #ifndef NO_ICY
 	fr->icy.interval = 0;
 	fr->icy.next = 0;
+	fr->icy.blockpos = fr->icy.blockfill = 0;
 #endif
 	fr->halfphase = 0; /* here or indeed only on first-time init? */
 	fr->error_protection = 0;
@@ -575,23 +735,89 @@ static void frame_fixed_reset(mpg123_handle *fr)
 	fr->id3v2_size = 0;
 }
 
+size_t frame_memory_part(mpg123_handle *fr, enum frame_mem part)
+{
+	size_t bytes = 0;
+	switch(part)
+	{
+		case mem_decoder:
+			if(fr->rawbuffs != NULL) bytes += fr->rawbuffss;
+			if(fr->layerscratch != NULL) bytes += LAYER12_SCRATCH_SIZE+63;
+			if(fr->layer3scratch != NULL) bytes += LAYER3_SCRATCH_SIZE+63;
+#ifndef NO_8BIT
+			if(fr->conv16to8_buf != NULL) bytes += 8192;
+#endif
+#ifdef OPT_DITHER
+			if(fr->dithernoise != NULL) bytes += sizeof(float)*DITHERSIZE;
+#endif
+#ifndef NO_EQUALIZER
+			if(fr->equalizer != NULL) bytes += sizeof(real)*2*32;
+#endif
+		break;
+		case mem_output:
+			if(fr->buffer.rdata != NULL) bytes += fr->buffer.size+15;
+		break;
+		case mem_index:
+#ifdef FRAME_INDEX
+			if(fr->index.data != NULL) bytes += fr->index.size*sizeof(off_t);
+			bytes += ci_memory(&fr->cindex);
+			bytes += fr->rindex.size*sizeof(off_t);
+#endif
+			if(fr->xing_toc != NULL) bytes += 100;
+			if(fr->vbri_toc != NULL) bytes += fr->vbri_fill*sizeof(off_t);
+		break;
+		case mem_feed:
+#ifndef NO_FEEDER
+			bytes += bc_memory(&fr->rdat.buffer);
+#endif
+		break;
+		case mem_meta:
+			if(fr->id3v2_raw != NULL) bytes += fr->id3v2_size+1;
+			bytes += id3_memory(fr);
+#ifndef NO_ICY
+			if(fr->icy.data != NULL) bytes += strlen(fr->icy.data)+1;
+			if(fr->icy.block != NULL) bytes += ICY_BLOCK;
+#endif
+		break;
+		default:
+		break;
+	}
+	return bytes;
+}
+
+size_t frame_memory(mpg123_handle *fr)
+{
+	size_t bytes = sizeof(*fr);
+	int part;
+	for(part = 0; part < mem_parts; ++part)
+		bytes += frame_memory_part(fr, part);
+	return bytes;
+}
+
 static void frame_free_buffers(mpg123_handle *fr)
 {
 	if(fr->rawbuffs != NULL) free(fr->rawbuffs);
 	fr->rawbuffs = NULL;
 	fr->rawbuffss = 0;
-	if(fr->rawdecwin != NULL) free(fr->rawdecwin);
-	fr->rawdecwin = NULL;
-	fr->rawdecwins = 0;
 #ifndef NO_8BIT
 	if(fr->conv16to8_buf != NULL) free(fr->conv16to8_buf);
 	fr->conv16to8_buf = NULL;
 #endif
 	if(fr->layerscratch != NULL) free(fr->layerscratch);
+	if(fr->layer3scratch != NULL) free(fr->layer3scratch);
+	fr->layer3scratch = NULL;
+	fr->hybrid_block = NULL;
+#ifndef NO_EQUALIZER
+	if(fr->equalizer != NULL) free(fr->equalizer);
+	fr->equalizer = NULL;
+#endif
 }
 
 void frame_exit(mpg123_handle *fr)
 {
+#ifndef NO_LAYER3
+	layer3_pipe_exit(fr);
+#endif
 	if(fr->buffer.rdata != NULL)
 	{
 		debug1("freeing buffer at %p", (void*)fr->buffer.rdata);
@@ -599,9 +825,13 @@ void frame_exit(mpg123_handle *fr)
 	}
 	fr->buffer.rdata = NULL;
 	frame_free_buffers(fr);
+	tab_release(fr);
 	frame_free_toc(fr);
+	seekcache_free(fr);
 #ifdef FRAME_INDEX
 	fi_exit(&fr->index);
+	ci_exit(&fr->cindex);
+	ri_exit(&fr->rindex);
 #endif
 #ifdef OPT_DITHER
 	if(fr->dithernoise != NULL)
@@ -612,6 +842,10 @@ void frame_exit(mpg123_handle *fr)
 #endif
 	exit_id3(fr);
 	clear_icy(&fr->icy);
+#ifndef NO_ICY
+	free(fr->icy.block);
+	fr->icy.block = NULL;
+#endif
 	/* Clean up possible mess from LFS wrapper. */
 	if(fr->wrapperclean != NULL)
 	{
@@ -647,6 +881,33 @@ int attribute_align_arg mpg123_set_moreinfo( mpg123_handle *mh
 #endif
 }
 
+int attribute_align_arg mpg123_coeff_callback( mpg123_handle *mh
+,	void (*callback)( void *handle, int kind, int channel
+	,	const float *coeff, size_t count )
+,	void *handle, int flags )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+#ifdef REAL_IS_FLOAT
+	mh->coeff_callback = callback;
+	mh->coeff_handle = handle;
+	mh->coeff_flags = callback != NULL ? flags : 0;
+	return MPG123_OK;
+#else
+	mh->err = MPG123_MISSING_FEATURE;
+	return MPG123_ERR;
+#endif
+}
+
+int attribute_align_arg mpg123_silence_callback( mpg123_handle *mh
+,	void (*callback)(void *handle, int64_t start, int64_t samples)
+,	void *handle )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	mh->silence_callback = callback;
+	mh->silence_handle = handle;
+	return MPG123_OK;
+}
+
 /*
 	Fuzzy frame offset searching (guessing).
 	When we don't have an accurate position, we may use an inaccurate one.
@@ -709,7 +970,17 @@ off_t frame_index_find(mpg123_handle *fr, off_t want_frame, off_t* get_frame)
 	off_t gopos = 0;
 	*get_frame = 0;
 #ifdef FRAME_INDEX
-	/* Possibly use VBRI index, too? I'd need an example for this... */
+	/* The compact index knows each frame, if it got that far, the ring
+	   index the recent ones. */
+	if(  (gopos = ci_find(&fr->cindex, want_frame)) >= 0
+	  || (gopos = ri_find(&fr->rindex, want_frame)) >= 0 )
+	{
+		*get_frame = want_frame;
+		fr->state_flags |= FRAME_ACCURATE;
+		debug2("exact index: 0x%lx for frame %li", (unsigned long)gopos, (long)want_frame);
+		return gopos;
+	}
+	gopos = 0;
 	if(fr->index.fill)
 	{
 		/* find in index */
@@ -748,6 +1019,22 @@ off_t frame_index_find(mpg123_handle *fr, off_t want_frame, off_t* get_frame)
 	return gopos;
 }
 
+/*
+	The VBRI table has exact positions of frame groups over the whole stream,
+	so it can be used for accurate seeking beyond the frame index. The caller
+	still has to verify that there is a frame header at the given position.
+*/
+off_t frame_vbri_find(mpg123_handle *fr, off_t want_frame, off_t* get_frame)
+{
+	size_t vi;
+	if(fr->vbri_toc == NULL || want_frame < 0) return -1;
+	vi = want_frame/fr->vbri_step;
+	if(vi >= fr->vbri_fill) vi = fr->vbri_fill - 1;
+	*get_frame = vi*fr->vbri_step;
+	debug2("VBRI: 0x%lx for frame %li", (unsigned long)fr->vbri_toc[vi], (long) *get_frame);
+	return fr->vbri_toc[vi];
+}
+
 off_t frame_ins2outs(mpg123_handle *fr, off_t ins)
 {	
 	off_t outs = 0;
@@ -940,6 +1227,35 @@ void frame_skip(mpg123_handle *fr)
 #endif
 }
 
+void frame_meta_notify(mpg123_handle *fr, int what)
+{
+	if(fr->meta_callback != NULL)
+		fr->meta_callback(fr->meta_handle, what);
+}
+
+void frame_coeff_notify( mpg123_handle *fr, int kind, int channel
+,	real *coeff, size_t count )
+{
+#ifdef REAL_IS_FLOAT
+	/* Frames decoded ahead of a seek target are not part of the stream. */
+	if( fr->coeff_callback != NULL && (fr->coeff_flags & kind)
+	&&	!(fr->to_ignore && fr->num < fr->firstframe) )
+		fr->coeff_callback(fr->coeff_handle, kind, channel, coeff, count);
+#endif
+}
+
+/* Zero is mostly a series of null bytes, but the 8 bit formats have a
+   different opinion. Unsigned 16 or 32 bit formats are handled later in
+   postprocessing. */
+int frame_zero_byte(mpg123_handle *fr)
+{
+#ifndef NO_8BIT
+	return fr->af.encoding & MPG123_ENC_8 ? fr->conv16to8[0] : 0;
+#else
+	return 0;
+#endif
+}
+
 /* Sample accurate seek prepare for decoder. */
 /* This gets unadjusted output samples and takes resampling into account */
 void frame_set_seek(mpg123_handle *fr, off_t sp)
@@ -1026,9 +1342,50 @@ void do_rva(mpg123_handle *fr)
 	{
 		debug3("changing scale value from %f to %f (peak estimated to %f)", fr->lastscale != -1 ? fr->lastscale : fr->p.outscale, newscale, (double) (newscale*peak));
 		fr->lastscale = newscale;
-		/* It may be too early, actually. */
-		if(fr->make_decode_tables != NULL) fr->make_decode_tables(fr); /* the actual work */
+		/* While decoding, the tables stay and the gain follows. */
+		if(!fr->decoder_change && fr->tables_scale > 0)
+			frame_gain(fr, newscale/fr->tables_scale);
+		else /* It may be too early, actually. */
+			frame_decode_tables(fr);
+	}
+}
+
+/* Blocks of 32 samples to get to a new gain, one frame of 1152. */
+#define GAIN_RAMP 36
+
+void frame_gain(mpg123_handle *fr, double gain)
+{
+	real target = DOUBLE_TO_REAL(gain);
+	if(target == fr->gain_target)
+		return;
+	fr->gain_target = target;
+	fr->gain_step = DOUBLE_TO_REAL((gain-REAL_TO_DOUBLE(fr->gain))/GAIN_RAMP);
+	fr->gain_ramp = GAIN_RAMP;
+	fr->have_gain = 1;
+	/* The synth history in snapshots carries the old gain. */
+	seekcache_clear(fr);
+}
+
+int frame_decode_tables(mpg123_handle *fr)
+{
+	double scale = fr->lastscale < 0 ? fr->p.outscale : fr->lastscale;
+	if(fr->make_decode_tables == NULL)
+		return 0;
+	/* The actual work, if no other handle did it already. */
+	if(scale != fr->tables_scale)
+	{
+		if(tab_decwin(fr, scale))
+		{
+			if(NOQUIET) error("Failed to set up decode tables!");
+			return -1;
+		}
+		fr->tables_scale = scale;
 	}
+	/* The tables have it all now. */
+	fr->have_gain = 0;
+	fr->gain_ramp = 0;
+	fr->gain = fr->gain_target = DOUBLE_TO_REAL(1.0);
+	return 0;
 }
 
 
@@ -20,6 +20,7 @@
 #include "index.h"
 #endif
 #include "synths.h"
+#include "tabshare.h"
 
 #ifdef OPT_DITHER
 #include "dither.h"
@@ -57,6 +58,20 @@ struct audioformat
 
 void invalidate_format(struct audioformat *af);
 
+/* A segment announced with mpg123_feed_segment(), starting at that input
+   offset, with the encoder delay and padding given (-1 for unknown) and
+   the frame count from its header, if any. */
+struct segment
+{
+	off_t pos;
+	long delay;
+	long padding;
+	off_t frames;
+};
+#define SEGMENT_QUEUE 8
+/* Samples of decoder output to drop, [begin, end) in input samples. */
+#define SEGMENT_CUTS 4
+
 struct mpg123_pars_struct
 {
 	int verbose;    /* verbose level */
@@ -79,12 +94,24 @@ struct mpg123_pars_struct
 	double outscale;
 	long resync_limit;
 	long index_size; /* Long, because: negative values have a meaning. */
+	long index_compact; /* keep the exact per-frame index, too */
+	long index_ring; /* frames kept in the ring index */
 	long preframes;
 #ifndef NO_FEEDER
 	long feedpool;
 	long feedbuffer;
+	long feedpool_max; /* upper limit of an adaptive pool, 0 for fixed size */
 #endif
 	long freeformat_framesize;
+	long prefetch; /* read-ahead ring size in bytes */
+	long read_block; /* block size for buffering small reads */
+	long uring; /* io_uring read-ahead in bytes */
+	long nonblock; /* MPG123_NEED_MORE instead of waiting for input */
+	long seek_cache; /* number of decoder snapshots kept for seeks */
+	long fixed_memory; /* no allocations after the first frame */
+	long scan_threads; /* threads for mpg123_scan() on big files */
+	long silence; /* MPG123_SILENCE: skip (1) or drop (2) digital silence */
+	long peek_end_later; /* ID3v1 at the end after opening, see reader_tail() */
 };
 
 enum frame_state_flags
@@ -92,14 +119,58 @@ enum frame_state_flags
 	 FRAME_ACCURATE      = 0x1  /**<     0001 Positions are considered accurate. */
 	,FRAME_FRANKENSTEIN  = 0x2  /**<     0010 This stream is concatenated. */
 	,FRAME_FRESH_DECODER = 0x4  /**<     0100 Decoder is fleshly initialized. */
+	,FRAME_SKIP_BODY     = 0x8  /**<     1000 Only parse headers, seek over bodies. */
+	,FRAME_INPLACE       = 0x10 /**< 0001 0000 Frame body is in the input data, not in bsspace. */
+	,FRAME_DROP_BODY     = 0x20 /**< 0010 0000 Seek over the body of a Layer I/II frame that is not played. */
+};
+
+#ifdef PROFILE_STAGES
+/* Stages of decoding that get their time accounted, see mpg123_getstate(). */
+enum prof_stage
+{
+	 prof_parse = 0  /* read_frame(): sync, header, frame body */
+	,prof_dequant    /* bit allocation / side info, scale factors, Huffman, dequantization */
+	,prof_stereo     /* layer III M/S and intensity stereo, channel selection */
+	,prof_hybrid     /* layer III antialias and IMDCT */
+	,prof_synth      /* polyphase synthesis */
+	,prof_postprocess
+	,prof_stages
 };
+/* Monotonic clock in nanoseconds. */
+uint64_t prof_clock(void);
+/* Start timing at the beginning of a sequence of stages ... */
+#define PROF_MARK(fr) (fr)->prof_mark = prof_clock()
+/* ... and account the time since the last mark or lap to the stage. */
+#define PROF_LAP(fr, stage) \
+{ \
+	uint64_t prof_now = prof_clock(); \
+	(fr)->prof[stage] += prof_now - (fr)->prof_mark; \
+	(fr)->prof_mark = prof_now; \
+}
+#else
+#define PROF_MARK(fr)
+#define PROF_LAP(fr, stage)
+#endif
+
+/* Static tracepoints (configure --enable-usdt) in the parser, reader and
+   decode paths, provider libmpg123. Nothing without sys/sdt.h. */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define MPGPROBE1(name, a)       DTRACE_PROBE1(libmpg123, name, a)
+#define MPGPROBE2(name, a, b)    DTRACE_PROBE2(libmpg123, name, a, b)
+#define MPGPROBE3(name, a, b, c) DTRACE_PROBE3(libmpg123, name, a, b, c)
+#else
+#define MPGPROBE1(name, a)
+#define MPGPROBE2(name, a, b)
+#define MPGPROBE3(name, a, b, c)
+#endif
 
 /* There is a lot to condense here... many ints can be merged as flags; though the main space is still consumed by buffers. */
 struct mpg123_handle_struct
 {
 	int fresh; /* to be moved into flags */
 	int new_format;
-	real hybrid_block[2][2][SBLIMIT*SSLIMIT];
+	real (*hybrid_block)[2][SBLIMIT*SSLIMIT]; /* in layer3scratch, see below */
 	int hybrid_blc[2];
 	/* the scratch vars for the decoders, sometimes real, sometimes short... sometimes int/long */ 
 	short *short_buffs[2][2];
@@ -114,8 +185,8 @@ struct mpg123_handle_struct
 	int ditherindex;
 	float *dithernoise;
 #endif
-	unsigned char* rawdecwin; /* the block with all decwins */
-	int rawdecwins; /* size of rawdecwin memory */
+	struct tab_decwin *decwin_tab; /* shared block with all decwins */
+	struct tab_decwin *decwin_keep[TAB_KEEP]; /* previous ones, most recent first */
 	real *decwin; /* _the_ decode table */
 #ifdef OPT_MMXORSSE
 	/* I am not really sure that I need both of them... used in assembler */
@@ -124,7 +195,7 @@ struct mpg123_handle_struct
 #endif
 #ifndef NO_EQUALIZER
 	int have_eq_settings;
-	real equalizer[2][32];
+	real (*equalizer)[32]; /* [2][32], only allocated when actually used */
 #endif
 	/* for halfspeed mode */
 	unsigned char ssave[34];
@@ -134,20 +205,24 @@ struct mpg123_handle_struct
 	unsigned char *conv16to8_buf;
 	unsigned char *conv16to8;
 #endif
-	/* There's some possible memory saving for stuff that is not _really_ dynamic. */
-
+	/* Tables that are not _really_ dynamic, shared with other handles. */
+	struct tab_layer *layer_tab;
+	struct tab_layer *layer_keep[TAB_KEEP];
 	/* layer3 */
-	int longLimit[9][23];
-	int shortLimit[9][14];
-	real gainpow2[256+118+4]; /* not really dynamic, just different for mmx */
+	int (*longLimit)[23];
+	int (*shortLimit)[14];
+	real *gainpow2; /* not really dynamic, just different for mmx */
 
 	/* layer2 */
-	real muls[27][64];	/* also used by layer 1 */
+	real (*muls)[64];	/* also used by layer 1 */
 
 #ifndef NO_NTOM
 	/* decode_ntom */
 	unsigned long ntom_val[2];
 	unsigned long ntom_step;
+	/* The plain synth that feeds the interpolation, last sample per channel. */
+	func_synth ntom_synth;
+	double ntom_prev[2];
 #endif
 	/* special i486 fun */
 #ifdef OPT_I486
@@ -163,11 +238,22 @@ struct mpg123_handle_struct
 #ifdef OPT_MULTI
 
 #ifndef NO_LAYER3
-#if (defined OPT_3DNOW_VINTAGE || defined OPT_3DNOWEXT_VINTAGE || defined OPT_SSE || defined OPT_X86_64 || defined OPT_AVX || defined OPT_NEON || defined OPT_NEON64)
+#if (defined OPT_3DNOW_VINTAGE || defined OPT_3DNOWEXT_VINTAGE || defined OPT_SSE || defined OPT_X86_64 || defined OPT_AVX || defined OPT_AVX512 || defined OPT_NEON || defined OPT_NEON64)
 		void (*the_dct36)(real *,real *,real *,real *,real *);
 #endif
+#if (defined OPT_X86_64 || defined OPT_AVX || defined OPT_AVX512)
+		void (*the_antialias)(real *,int);
+		void (*the_dct12_quad)(real *,real *,real *,real *);
+		void (*the_hybrid_tail)(real *,real *,real *,int);
+		void (*the_i_stereo)(real *,real *,const real *,int);
+		void (*the_ms_stereo)(real *,real *,int);
+#endif
+#ifdef OPT_GENERIC_VECTOR
+		void (*the_dct36_quad)(real *,real *,real *,real *,real *,real *);
+#endif
 #endif
 
+		int tune; /* Decoder "fastest": pick by timing once the output format is known. */
 #endif
 		enum optdec type;
 		enum optcla class;
@@ -179,9 +265,25 @@ struct mpg123_handle_struct
 	/* The runtime-chosen decoding, based on input and output format. */
 	func_synth synth;
 	func_synth_stereo synth_stereo;
+	func_synth_stereo_block synth_stereo_block;
 	func_synth_mono synth_mono;
+	/* The block synth below the wrappers for packed 24 bit or dithered output. */
+	func_synth_stereo_block synth_base_block;
 	/* Yes, this function is runtime-switched, too. */
 	void (*make_decode_tables)(mpg123_handle *fr); /* That is the volume control. */
+	/* What the current tables have been made for, so that the next track
+	   with the same setup does not compute them again. */
+	enum optdec tables_type;
+	int tables_sblimit;
+	int tables_down;
+	double tables_scale; /* < 0: tables need to be made */
+	/* Volume changes after that are applied to the subband samples,
+	   ramping from gain to gain_target over gain_ramp blocks of 32. */
+	int have_gain;
+	int gain_ramp;
+	real gain;
+	real gain_target;
+	real gain_step;
 
 	int stereo; /* I _think_ 1 for mono and 2 for stereo */
 	int jsbound;
@@ -217,9 +319,15 @@ struct mpg123_handle_struct
 	off_t input_offset; /* byte offset of this frame in input stream */
 	off_t playnum; /* playback offset... includes repetitions, reset at seeks */
 	off_t audio_start; /* The byte offset in the file where audio data begins. */
+	unsigned long audio_hash; /* Checksum of the first frame body, to recognize the stream. */
 	int state_flags;
 	char silent_resync; /* Do not complain for the next n resyncs. */
 	unsigned char* xing_toc; /* The seek TOC from Xing header. */
+	off_t *vbri_toc; /* Exact positions of every vbri_step-th frame from VBRI header. */
+	size_t vbri_fill;
+	off_t vbri_step;
+	struct seekcache *seekcache; /* decoder snapshots at seek targets */
+	mpg123_threads *threads; /* pool for parallel work, NULL for the default */
 	int freeformat;
 	long freeformat_framesize;
 
@@ -254,13 +362,25 @@ struct mpg123_handle_struct
 	unsigned char *bsbuf;
 	unsigned char *bsbufold;
 	int bsnum;
+	/* A Layer III body placed right behind the main data of the one before
+	   covers its end with side info, that end is kept here (see chain_body()
+	   in parse.c). */
+	unsigned char bstail[34];
+	int bstail_size;
 	/* That is the header matching the last read frame body. */
 	unsigned long oldhead;
 	/* That is the header that is supposedly the first of the stream. */
 	unsigned long firsthead;
+	/* The last header decode_header() went through without the padding bit
+	   (0 for none) and the frame sizes for it without and with padding
+	   (-1 if not seen yet). */
+	unsigned long headcache;
+	int headcache_size[2];
 	int abr_rate;
 #ifdef FRAME_INDEX
 	struct frame_index index;
+	struct frame_cindex cindex;
+	struct frame_rindex rindex;
 #endif
 
 	/* output data */
@@ -273,6 +393,23 @@ struct mpg123_handle_struct
 	off_t firstframe;  /* start decoding from here */
 	off_t lastframe;   /* last frame to decode (for gapless or num_frames limit) */
 	off_t ignoreframe; /* frames to decode but discard before firstframe */
+	off_t range_end;   /* mpg123_range() end in output samples, -1 for none */
+	/* Files of mpg123_open_list(), with their start in output samples
+	   (one more for the end of all) and the index of the one open now. */
+	char **list;
+	off_t *list_start;
+	size_t list_count;
+	size_t list_index;
+	off_t list_range;  /* mpg123_range() end over the whole list */
+	/* Feeding in segments: those announced and not reached yet, the one
+	   whose first frame is about to come (segment_start) and the pending
+	   gapless cuts of the segments so far. */
+	struct segment segment_queue[SEGMENT_QUEUE];
+	int segment_fill;
+	int segment_start;
+	struct segment segment_now;
+	off_t segment_cut[SEGMENT_CUTS][2];
+	int segment_cuts;
 #ifdef GAPLESS
 	off_t gapless_frames; /* frame count for the gapless part */
 	off_t firstoff; /* number of samples to ignore from firstframe */
@@ -284,6 +421,7 @@ struct mpg123_handle_struct
 	off_t fullend_os; /* gapless_frames translated to output samples */
 #endif
 	unsigned int crc; /* Well, I need a safe 16bit type, actually. But wider doesn't hurt. */
+	long crc_errors; /* frames concealed after a failed CRC check */
 	struct reader *rd; /* pointer to the reading functions */
 	struct reader_data rdat; /* reader data and state info */
 	struct mpg123_pars_struct p;
@@ -296,11 +434,31 @@ struct mpg123_handle_struct
 	unsigned char id3buf[128];
 #ifndef NO_ID3V2
 	mpg123_id3v2 id3v2;
+	/* Frames of id3v2_raw not processed yet, see MPG123_LAZY_ID3. */
+	struct id3_lazy *id3v2_lazy;
+	size_t id3v2_lazies;
+	/* Stream offsets of tags already parsed, not to do that again after seeks. */
+	off_t *id3v2_seen;
+	size_t id3v2_seens;
+	/* Strings and picture data of the above live in these blocks. */
+	struct id3_block *id3v2_blocks;
+	mpg123_string id3v2_conv; /* Text conversion before that. */
+	/* Allocated entries of the lists in id3v2. */
+	size_t id3v2_text_room;
+	size_t id3v2_comment_room;
+	size_t id3v2_extra_room;
+	size_t id3v2_picture_room;
 #endif
 	unsigned char *id3v2_raw;
 	size_t id3v2_size;
+	/* Called on new metadata, see mpg123_meta_callback(). */
+	void (*meta_callback)(void *handle, int what);
+	void *meta_handle;
 #ifndef NO_ICY
 	struct icy_meta icy;
+	/* Takes the metadata instead of icy.data, see mpg123_icy_callback(). */
+	void (*icy_callback)(void *handle, const char *meta, size_t size);
+	void *icy_handle;
 #endif
 	/*
 		More variables needed for decoders, layerX.c.
@@ -309,13 +467,15 @@ struct mpg123_handle_struct
 	*/
 	/*
 		Those layer-specific structs could actually share memory, as they are not in use simultaneously. One might allocate on decoder switch, too.
-		They all reside in one lump of memory (after each other), allocated to layerscratch.
+		The layer I and II ones reside in one lump of memory (after each other), allocated to layerscratch.
+		Layer III needs a lot more, including the hybrid_block state, and gets layer3scratch only once a Layer III frame is to be decoded.
 	*/
 	real *layerscratch;
+	real *layer3scratch;
 #ifndef NO_LAYER1
 	struct
 	{
-		real (*fraction)[SBLIMIT]; /* ALIGNED(16) real fraction[2][SBLIMIT]; */
+		real (*fraction)[SCALE_BLOCK][SBLIMIT]; /* ALIGNED(16) real fraction[2][SCALE_BLOCK][SBLIMIT]; */
 	} layer1;
 #endif
 #ifndef NO_LAYER2
@@ -330,6 +490,18 @@ struct mpg123_handle_struct
 	{
 		real (*hybrid_in)[SBLIMIT][SSLIMIT];  /* ALIGNED(16) real hybridIn[2][SBLIMIT][SSLIMIT]; */
 		real (*hybrid_out)[SSLIMIT][SBLIMIT]; /* ALIGNED(16) real hybridOut[2][SSLIMIT][SBLIMIT]; */
+		/* MPG123_PIPELINE: second granule while the worker has the first */
+		real (*hybrid_in2)[SBLIMIT][SSLIMIT];
+		struct III_pipe *pipe;
+		/* MPG123_CONCEAL: the last good granule and its block setup */
+		real (*conceal)[SBLIMIT][SSLIMIT];
+		unsigned int conceal_type[2];
+		unsigned int conceal_mixed[2];
+		unsigned int conceal_maxb[2];
+		/* MPG123_SILENCE: granules with zero spectrum in a row, and if all
+		   of the last frame were skipped as silence */
+		int silent_run;
+		int silent_frame;
 	} layer3;
 #endif
 	/* A place for storing additional data for the large file wrapper.
@@ -341,18 +513,51 @@ struct mpg123_handle_struct
 	int enc_padding;
 #ifndef NO_MOREINFO
 	struct mpg123_moreinfo *pinfo;
+#endif
+	/* Takes decoder coefficients, see mpg123_coeff_callback(). */
+	void (*coeff_callback)( void *handle, int kind, int channel
+	,	const float *coeff, size_t count );
+	void *coeff_handle;
+	int coeff_flags;
+	/* Told about frames dropped by MPG123_SILENCE. */
+	void (*silence_callback)(void *handle, int64_t start, int64_t samples);
+	void *silence_handle;
+	/* mpg123_batch_decode_frame(): where the synth functions put the
+	   subband samples instead */
+	struct mpg123_batch_struct *batch;
+	int batch_lane;
+	int batch_slots;
+#ifdef PROFILE_STAGES
+	uint64_t prof[prof_stages]; /* nanoseconds since opening the track */
+	uint64_t prof_mark;
 #endif
 };
 
 /* generic init, does not include dynamic buffers */
 void frame_init(mpg123_handle *fr);
 void frame_init_par(mpg123_handle *fr, mpg123_pars *mp);
+void frame_default_pars(mpg123_pars *mp);
 /* output buffer and format */
 int  frame_outbuffer(mpg123_handle *fr);
 int  frame_output_format(mpg123_handle *fr);
 
 int frame_buffers(mpg123_handle *fr); /* various decoder buffers, needed once */
 int frame_reset(mpg123_handle* fr);   /* reset for next track */
+int frame_recycle(mpg123_handle *fr, mpg123_pars *mp); /* reset for next user */
+/* Parts of the memory held by the handle, see MPG123_MEMORY_DECODER & co. */
+enum frame_mem
+{
+	 mem_decoder = 0 /* frame buffers and scratch, 8 bit table, dither noise, equalizer */
+	,mem_output      /* decoded audio buffer */
+	,mem_index       /* frame indices, Xing and VBRI TOC */
+	,mem_feed        /* feeder buffer chain and pool */
+	,mem_meta        /* ID3v2 tag, raw and parsed, ICY metadata and block */
+	,mem_parts
+};
+size_t frame_memory_part(mpg123_handle *fr, enum frame_mem part);
+/* Bytes of memory held by the handle, all the parts, not counting shared
+   tables. */
+size_t frame_memory(mpg123_handle *fr);
 int frame_buffers_reset(mpg123_handle *fr);
 void frame_exit(mpg123_handle *fr);   /* end, free all buffers */
 
@@ -361,11 +566,17 @@ void frame_exit(mpg123_handle *fr);   /* end, free all buffers */
 int mpg123_print_index(mpg123_handle *fr, FILE* out);
 /* Find a seek position in index. */
 off_t frame_index_find(mpg123_handle *fr, off_t want_frame, off_t* get_frame);
+/* Find a seek position in the VBRI table, -1 if there is none. */
+off_t frame_vbri_find(mpg123_handle *fr, off_t want_frame, off_t* get_frame);
 /* Apply index_size setting. */
 int frame_index_setup(mpg123_handle *fr);
 
 void do_volume(mpg123_handle *fr, double factor);
 void do_rva(mpg123_handle *fr);
+/* Get the decoding tables for the current scale, if not done yet. */
+int frame_decode_tables(mpg123_handle *fr);
+/* Ramp the subband gain to a new value relative to the tables. */
+void frame_gain(mpg123_handle *fr, double gain);
 
 /* samples per frame ...
 Layer I
@@ -403,6 +614,15 @@ off_t frame_expect_outsamples(mpg123_handle *fr);
 /* Skip this frame... do some fake action to get away without actually decoding it. */
 void frame_skip(mpg123_handle *fr);
 
+/* Tell the meta callback about new ID3/ICY data (MPG123_NEW_* flags). */
+void frame_meta_notify(mpg123_handle *fr, int what);
+/* Hand count coefficients of one channel to the coeff_callback, if the
+   kind is wanted. */
+void frame_coeff_notify( mpg123_handle *fr, int kind, int channel
+,	real *coeff, size_t count );
+/* A byte that, repeated, makes zero samples in the decoder output. */
+int frame_zero_byte(mpg123_handle *fr);
+
 /*
 	Seeking core functions:
 	- convert input sample offset to output sample offset
@@ -420,4 +640,28 @@ void frame_set_seek(mpg123_handle *fr, off_t sp);
 off_t frame_tell_seek(mpg123_handle *fr);
 /* Take a copy of the Xing VBR TOC for fuzzy seeking. */
 int frame_fill_toc(mpg123_handle *fr, unsigned char* in);
+/* Drop the VBRI table (also when it turned out not to match the stream). */
+void frame_free_vbri(mpg123_handle *fr);
+
+/* Decoder snapshots at seek targets, see seekcache.c. */
+/* Note that a real seek to that frame happened, to be stored when reached. */
+void seekcache_pending(mpg123_handle *fr, off_t frame);
+/* Store the state before reading frame fr->num+1, if that is pending. */
+void seekcache_store(mpg123_handle *fr);
+/* Restore the state for frame and position the stream, TRUE on success. */
+int seekcache_restore(mpg123_handle *fr, off_t frame);
+/* Drop the snapshots (and all the memory). */
+void seekcache_clear(mpg123_handle *fr);
+void seekcache_free(mpg123_handle *fr);
+/* The snapshot blob for mpg123_snapshot() and mpg123_restore(), setting
+   fr->err and returning MPG123_ERR on failure. */
+int snapshot_write( mpg123_handle *fr
+,	unsigned char *buf, size_t size, size_t *bytes );
+int snapshot_read(mpg123_handle *fr, const unsigned char *buf, size_t size);
+
+/* The rest of mpg123_scan() on worker threads, see parallel.c. Starting
+   after the first frame, counts frames and samples on top of the given
+   values. Returns 1 when done, 0 when the scan needs to be done the usual
+   way from the first frame (where the stream is again), or MPG123_ERR. */
+int scan_parallel(mpg123_handle *fr, off_t *frames, off_t *samples);
 #endif
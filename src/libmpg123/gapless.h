@@ -106,14 +106,55 @@ static void frame_buffercheck(mpg123_handle *fr)
 	}
 }
 
+/*
+	Cut what mpg123_feed_segment() wants gone for gapless segments out of
+	the freshly decoded frame, also from the middle. The cuts are sorted
+	and do not overlap, the ones behind this frame are forgotten.
+*/
+static void segment_cut(mpg123_handle *fr)
+{
+	off_t begin, end;
+	int i, done;
+
+	if(!fr->segment_cuts) return;
+	begin = frame_outs(fr, fr->num);
+	end   = begin + bytes_to_samples(fr, fr->buffer.fill);
+	/* From the back, earlier byte offsets stay valid. */
+	done = 0;
+	for(i=fr->segment_cuts-1; i>=0; --i)
+	{
+		off_t cb = frame_ins2outs(fr, fr->segment_cut[i][0]);
+		off_t ce = frame_ins2outs(fr, fr->segment_cut[i][1]);
+		if(ce <= end && !done)
+			done = i+1;
+		if(cb < begin) cb = begin;
+		if(ce > end)   ce = end;
+		if(cb < ce)
+		{
+			size_t from = samples_to_bytes(fr, cb-begin);
+			size_t to   = samples_to_bytes(fr, ce-begin);
+			memmove(fr->buffer.data+from, fr->buffer.data+to, fr->buffer.fill-to);
+			fr->buffer.fill -= to-from;
+			if(VERBOSE3) fprintf(stderr, "\nNote: Cut %"OFF_P" samples of segment delay/padding from frame %"OFF_P".\n", (off_p)(ce-cb), (off_p)fr->num);
+		}
+	}
+	if(done)
+	{
+		fr->segment_cuts -= done;
+		memmove(fr->segment_cut, fr->segment_cut+done, sizeof(fr->segment_cut[0])*fr->segment_cuts);
+	}
+}
+
 #define SAMPLE_ADJUST(mh,x)     sample_adjust(mh,x)
 #define SAMPLE_UNADJUST(mh,x)   sample_unadjust(mh,x)
 #define FRAME_BUFFERCHECK(mh) frame_buffercheck(mh)
+#define SEGMENT_CUT(mh)       segment_cut(mh)
 
 #else /* no gapless code included */
 
 #define SAMPLE_ADJUST(mh,x)   (x)
 #define SAMPLE_UNADJUST(mh,x) (x)
 #define FRAME_BUFFERCHECK(mh)
+#define SEGMENT_CUT(mh)
 
 #endif
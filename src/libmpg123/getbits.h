@@ -99,5 +99,109 @@ fprintf(stderr,":%lx\n",rval);
   ++fr->bitindex, --fr->bits_avail, \
   fr->wordpointer += (fr->bitindex>>3), fr->bitindex &= 7, fr->uctmp>>7 )
 
+/*
+  A cached bit reader for runs of small reads (Layer III side info and
+  scale factors): the bits are taken from the stream in whole words and
+  handed out from a register, instead of going through fr for each read.
+  Between bitcache_start() and bitcache_end(), the stream position in fr is
+  ahead by the bits still in the cache and no other reads may happen.
+  Reads past the available data give zeros and leave fr->bits_avail
+  negative after bitcache_end(), like getbits_fast() does.
+*/
+#if (defined SIZEOF_SIZE_T) && (SIZEOF_SIZE_T >= 8)
+#define BITCACHE_TYPE uint64_t
+#else
+#define BITCACHE_TYPE uint32_t
+#endif
+#define BITCACHE_BITS ((int)sizeof(BITCACHE_TYPE)*8)
+
+struct bitcache
+{
+  BITCACHE_TYPE word; /* next bits, from the top */
+  int fill; /* valid bits in word, negative for zeros given out past the end */
+};
+
+/* Big-endian load of a whole cache word, which compilers (GCC, Clang) turn
+   into a single unaligned load and byte swap. */
+static inline BITCACHE_TYPE bitcache_load(const unsigned char *wp)
+{
+  return
+#if (defined SIZEOF_SIZE_T) && (SIZEOF_SIZE_T >= 8)
+      (BITCACHE_TYPE)wp[0]<<56 | (BITCACHE_TYPE)wp[1]<<48
+    | (BITCACHE_TYPE)wp[2]<<40 | (BITCACHE_TYPE)wp[3]<<32
+    | (BITCACHE_TYPE)wp[4]<<24 | (BITCACHE_TYPE)wp[5]<<16
+    | (BITCACHE_TYPE)wp[6]<<8  | (BITCACHE_TYPE)wp[7];
+#else
+      (BITCACHE_TYPE)wp[0]<<24 | (BITCACHE_TYPE)wp[1]<<16
+    | (BITCACHE_TYPE)wp[2]<<8  | (BITCACHE_TYPE)wp[3];
+#endif
+}
+
+static inline void bitcache_start(mpg123_handle *fr, struct bitcache *bc)
+{
+  /* Get byte-aligned with the rest of the byte being read already. */
+  if(fr->bitindex)
+  {
+    bc->fill = 8-fr->bitindex;
+    bc->word = (BITCACHE_TYPE)(unsigned char)(*fr->wordpointer++ << fr->bitindex)
+      << (BITCACHE_BITS-8);
+    fr->bits_avail -= bc->fill;
+    fr->bitindex = 0;
+  }
+  else
+  {
+    bc->fill = 0;
+    bc->word = 0;
+  }
+}
+
+static inline void bitcache_refill(mpg123_handle *fr, struct bitcache *bc)
+{
+  if(bc->fill < 0)
+    return;
+  /* A whole word at once while it does not reach past the data. */
+  if(fr->bits_avail >= BITCACHE_BITS)
+  {
+    int bytes = (BITCACHE_BITS-bc->fill)>>3;
+    if(bytes)
+    {
+      bc->word |= ( bitcache_load(fr->wordpointer)
+      &  ~(BITCACHE_TYPE)0 << (BITCACHE_BITS-8*bytes) ) >> bc->fill;
+      fr->wordpointer += bytes;
+      fr->bits_avail -= 8*bytes;
+      bc->fill += 8*bytes;
+    }
+  }
+  else while(bc->fill <= BITCACHE_BITS-8 && fr->bits_avail > 0)
+  {
+    bc->word |= (BITCACHE_TYPE)*fr->wordpointer++ << (BITCACHE_BITS-8-bc->fill);
+    fr->bits_avail -= 8;
+    bc->fill += 8;
+  }
+}
+
+/* Up to 25 bits (57 with the 64 bit cache), zero bits are fine. */
+static inline unsigned int bitcache_get( mpg123_handle *fr, struct bitcache *bc
+,  int number_of_bits )
+{
+  unsigned int rval;
+  if(bc->fill < number_of_bits)
+    bitcache_refill(fr, bc);
+  /* Two steps to not shift by the full width for zero bits. */
+  rval = (unsigned int)(bc->word >> (BITCACHE_BITS-1-number_of_bits) >> 1);
+  bc->word <<= number_of_bits;
+  bc->fill -= number_of_bits;
+  return rval;
+}
+
+/* Give the bits not read back to the stream. */
+static inline void bitcache_end(mpg123_handle *fr, struct bitcache *bc)
+{
+  if(bc->fill > 0)
+    backbits(fr, bc->fill);
+  else
+    fr->bits_avail += bc->fill;
+}
+
 
 #endif
@@ -23,20 +23,25 @@
 #define XFLAG_MMX      0x00800000
 #define XFLAG_3DNOW    0x80000000
 #define XFLAG_3DNOWEXT 0x40000000
+/* structured extended flags, leaf 7 (EBX) */
+#define FLAG7_AVX512F  0x00010000
 /* eXtended Control Register 0 */
 #define XCR0FLAG_AVX   0x00000006
+#define XCR0FLAG_AVX512 0x000000E6
 
 
 struct cpuflags
 {
 #if defined(OPT_ARM) || defined(OPT_NEON) || defined(OPT_NEON64)
 	unsigned int has_neon;
+	unsigned int has_sve;
 #else
 	unsigned int id;
 	unsigned int std;
 	unsigned int std2;
 	unsigned int ext;
 	unsigned int xcr0_lo;
+	unsigned int std7b; /* cpuid leaf 7 (subleaf 0) EBX */
 #endif
 };
 
@@ -53,8 +58,10 @@ unsigned int getcpuflags(struct cpuflags* cf);
 #define cpu_sse2(s) (FLAG2_SSE2 & s.std2)
 #define cpu_sse3(s) (FLAG_SSE3 & s.std)
 #define cpu_avx(s) ((FLAG_AVX & s.std) == FLAG_AVX && (XCR0FLAG_AVX & s.xcr0_lo) == XCR0FLAG_AVX)
+#define cpu_avx512(s) (cpu_avx(s) && (FLAG7_AVX512F & s.std7b) && (XCR0FLAG_AVX512 & s.xcr0_lo) == XCR0FLAG_AVX512)
 #define cpu_fast_sse(s) ((((s.id & 0xf00)>>8) == 6 && FLAG_SSSE3 & s.std) /* for Intel/VIA; family 6 CPUs with SSSE3 */ || \
 						   (((s.id & 0xf00)>>8) == 0xf && (((s.id & 0x0ff00000)>>20) > 0 && ((s.id & 0x0ff00000)>>20) != 5))) /* for AMD; family > 0xF CPUs except Bobcat */
 #define cpu_neon(s) (s.has_neon)
+#define cpu_sve(s) (s.has_sve)
 
 #endif
@@ -12,6 +12,9 @@
 #include "getcpuflags.h"
 
 extern void check_neon(void);
+#ifdef OPT_SVE
+extern void check_sve(void);
+#endif
 
 #ifndef _M_ARM
 static sigjmp_buf jmpbuf;
@@ -38,21 +41,36 @@ unsigned int getcpuflags(struct cpuflags* cf)
 	sigaction(SIGILL, &act, &act_old);
 	
 	cf->has_neon = 0;
+	cf->has_sve = 0;
 	
 	if(!sigsetjmp(jmpbuf, 1)) {
 		check_neon();
 		cf->has_neon = 1;
 	}
+#ifdef OPT_SVE
+	if(cf->has_neon && !sigsetjmp(jmpbuf, 1)) {
+		check_sve();
+		cf->has_sve = 1;
+	}
+#endif
 	
 	sigaction(SIGILL, &act_old, NULL);
 #else
 	cf->has_neon = 0;
+	cf->has_sve = 0;
 
 	if (!setjmp(jmpbuf)) {
 		signal(SIGILL, mpg123_arm_catch_sigill);
 		check_neon();
 		cf->has_neon = 1;
 	}
+#ifdef OPT_SVE
+	if (cf->has_neon && !setjmp(jmpbuf)) {
+		signal(SIGILL, mpg123_arm_catch_sigill);
+		check_sve();
+		cf->has_sve = 1;
+	}
+#endif
 
 	signal(SIGILL, SIG_DFL);
 #endif
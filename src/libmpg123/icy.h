@@ -13,11 +13,22 @@
 #include "compat.h"
 #include "mpg123.h"
 
+/* Raw stream data is taken in blocks of that size and the ICY metadata
+   stripped from them. It has to hold the largest metadata (255*16 bytes)
+   with its length byte. */
+#define ICY_BLOCK 16384
+/* The longest metadata text. */
+#define ICY_META_MAX (255*16)
+
 struct icy_meta
 {
 	char* data;
 	off_t interval;
 	off_t next;
+	/* Raw stream data the metadata is stripped from, see icy_fullread(). */
+	unsigned char *block;
+	size_t blockpos;
+	size_t blockfill;
 };
 
 void init_icy(struct icy_meta *);
@@ -61,6 +61,16 @@ void init_id3(mpg123_handle *fr)
 	fr->id3v2.extra    = NULL;
 	fr->id3v2.pictures   = 0;
 	fr->id3v2.picture    = NULL;
+	fr->id3v2_lazy   = NULL;
+	fr->id3v2_lazies = 0;
+	fr->id3v2_seen   = NULL;
+	fr->id3v2_seens  = 0;
+	fr->id3v2_blocks = NULL;
+	mpg123_init_string(&fr->id3v2_conv);
+	fr->id3v2_text_room    = 0;
+	fr->id3v2_comment_room = 0;
+	fr->id3v2_extra_room   = 0;
+	fr->id3v2_picture_room = 0;
 }
 
 /* Managing of the text, comment and extra lists. */
@@ -88,124 +98,172 @@ static void init_mpg123_picture(mpg123_picture *pic)
 	pic->data = NULL;
 }
 
-/* Free memory of one element. */
+/* Free memory of one local element, not one of the lists. */
 static void free_mpg123_text(mpg123_text *txt)
 {
 	mpg123_free_string(&txt->text);
 	mpg123_free_string(&txt->description);
 }
 
-static void free_mpg123_picture(mpg123_picture * pic)
+/*
+	The strings and picture data of the lists are not allocated one by one,
+	but carved out of bigger blocks that are freed together. Such strings
+	must never be resized.
+*/
+struct id3_block
 {
-	mpg123_free_string(&pic->mime_type);
-	mpg123_free_string(&pic->description);
-	if (pic->data != NULL)
-		free(pic->data);
-}
+	struct id3_block *next;
+	size_t size;
+	size_t used;
+};
+
+#define ID3_BLOCK 4096
 
-/* Free memory of whole list. */
-#define free_comment(mh) free_id3_text(&((mh)->id3v2.comment_list), &((mh)->id3v2.comments))
-#define free_text(mh)    free_id3_text(&((mh)->id3v2.text),         &((mh)->id3v2.texts))
-#define free_extra(mh)   free_id3_text(&((mh)->id3v2.extra),        &((mh)->id3v2.extras))
-#define free_picture(mh) free_id3_picture(&((mh)->id3v2.picture),   &((mh)->id3v2.pictures))
-static void free_id3_text(mpg123_text **list, size_t *size)
+static void *id3_alloc(mpg123_handle *fr, size_t size)
 {
-	size_t i;
-	for(i=0; i<*size; ++i) free_mpg123_text(&((*list)[i]));
+	struct id3_block *b = fr->id3v2_blocks;
+	unsigned char *p;
 
-	free(*list);
-	*list = NULL;
-	*size = 0;
+	if(b == NULL || b->size - b->used < size)
+	{
+		size_t bsize = size > ID3_BLOCK ? size : ID3_BLOCK;
+		b = malloc(sizeof(*b)+bsize);
+		if(b == NULL)
+			return NULL;
+		b->size = bsize;
+		b->used = 0;
+		/* A big one of its own goes behind the current block, which still
+		   has room for the next small ones. */
+		if(fr->id3v2_blocks && size > ID3_BLOCK)
+		{
+			b->next = fr->id3v2_blocks->next;
+			fr->id3v2_blocks->next = b;
+		}
+		else
+		{
+			b->next = fr->id3v2_blocks;
+			fr->id3v2_blocks = b;
+		}
+	}
+	p = (unsigned char*)(b+1) + b->used;
+	b->used += size;
+	return p;
 }
-static void free_id3_picture(mpg123_picture **list, size_t *size)
+
+static void free_blocks(mpg123_handle *fr)
 {
-	size_t i;
-	for(i=0; i<*size; ++i) free_mpg123_picture(&((*list)[i]));
+	while(fr->id3v2_blocks)
+	{
+		struct id3_block *b = fr->id3v2_blocks;
+		fr->id3v2_blocks = b->next;
+		free(b);
+	}
+}
+
+/* Move what is in the conversion buffer into a list string. */
+static void keep_text(mpg123_handle *fr, mpg123_string *sb)
+{
+	mpg123_init_string(sb);
+	if(!fr->id3v2_conv.fill)
+		return;
+	sb->p = id3_alloc(fr, fr->id3v2_conv.fill);
+	if(sb->p == NULL)
+	{
+		if(NOQUIET) error("Unable to store ID3v2 text!");
+		return;
+	}
+	memcpy(sb->p, fr->id3v2_conv.p, fr->id3v2_conv.fill);
+	sb->size = sb->fill = fr->id3v2_conv.fill;
+}
 
-	free(*list);
+/* Free memory of whole list. The entries are in the blocks. */
+#define free_comment(mh) free_id3_list((void**)&((mh)->id3v2.comment_list), &((mh)->id3v2.comments), &((mh)->id3v2_comment_room))
+#define free_text(mh)    free_id3_list((void**)&((mh)->id3v2.text),         &((mh)->id3v2.texts),    &((mh)->id3v2_text_room))
+#define free_extra(mh)   free_id3_list((void**)&((mh)->id3v2.extra),        &((mh)->id3v2.extras),   &((mh)->id3v2_extra_room))
+#define free_picture(mh) free_id3_list((void**)&((mh)->id3v2.picture),      &((mh)->id3v2.pictures), &((mh)->id3v2_picture_room))
+static void free_id3_list(void **list, size_t *size, size_t *room)
+{
+	if(*list)
+		free(*list);
 	*list = NULL;
 	*size = 0;
+	*room = 0;
+}
+
+/* Make room for one more entry, doubling the allocation each time. */
+static void *grow_id3_list(void **list, size_t size, size_t *room, size_t entry)
+{
+	if(size == *room)
+	{
+		size_t newroom = *room ? 2 * *room : 4;
+		void *x = safe_realloc(*list, entry*newroom);
+		if(x == NULL) return NULL; /* bad */
+		*list = x;
+		*room = newroom;
+	}
+	return (unsigned char*)*list + entry*size;
 }
 
 /* Add items to the list. */
-#define add_comment(mh) add_id3_text(&((mh)->id3v2.comment_list), &((mh)->id3v2.comments))
-#define add_text(mh)    add_id3_text(&((mh)->id3v2.text),         &((mh)->id3v2.texts))
-#define add_extra(mh)   add_id3_text(&((mh)->id3v2.extra),        &((mh)->id3v2.extras))
-#define add_picture(mh)   add_id3_picture(&((mh)->id3v2.picture),       &((mh)->id3v2.pictures))
-static mpg123_text *add_id3_text(mpg123_text **list, size_t *size)
+#define add_comment(mh) add_id3_text((void**)&((mh)->id3v2.comment_list), &((mh)->id3v2.comments), &((mh)->id3v2_comment_room))
+#define add_text(mh)    add_id3_text((void**)&((mh)->id3v2.text),         &((mh)->id3v2.texts),    &((mh)->id3v2_text_room))
+#define add_extra(mh)   add_id3_text((void**)&((mh)->id3v2.extra),        &((mh)->id3v2.extras),   &((mh)->id3v2_extra_room))
+#define add_picture(mh) add_id3_picture((void**)&((mh)->id3v2.picture),   &((mh)->id3v2.pictures), &((mh)->id3v2_picture_room))
+static mpg123_text *add_id3_text(void **list, size_t *size, size_t *room)
 {
-	mpg123_text *x = safe_realloc(*list, sizeof(mpg123_text)*(*size+1));
+	mpg123_text *x = grow_id3_list(list, *size, room, sizeof(mpg123_text));
 	if(x == NULL) return NULL; /* bad */
 
-	*list  = x;
 	*size += 1;
-	init_mpg123_text(&((*list)[*size-1]));
+	init_mpg123_text(x);
 
-	return &((*list)[*size-1]); /* Return pointer to the added text. */
+	return x; /* Return pointer to the added text. */
 }
-static mpg123_picture *add_id3_picture(mpg123_picture **list, size_t *size)
+static mpg123_picture *add_id3_picture(void **list, size_t *size, size_t *room)
 {
-	mpg123_picture *x = safe_realloc(*list, sizeof(mpg123_picture)*(*size+1));
+	mpg123_picture *x = grow_id3_list(list, *size, room, sizeof(mpg123_picture));
 	if(x == NULL) return NULL; /* bad */
 
-	*list  = x;
 	*size += 1;
-	init_mpg123_picture(&((*list)[*size-1]));
+	init_mpg123_picture(x);
 
-	return &((*list)[*size-1]); /* Return pointer to the added picture. */
+	return x; /* Return pointer to the added picture. */
 }
 
 
-/* Remove the last item. */
-#define pop_comment(mh) pop_id3_text(&((mh)->id3v2.comment_list), &((mh)->id3v2.comments))
-#define pop_text(mh)    pop_id3_text(&((mh)->id3v2.text),         &((mh)->id3v2.texts))
-#define pop_extra(mh)   pop_id3_text(&((mh)->id3v2.extra),        &((mh)->id3v2.extras))
-#define pop_picture(mh)   pop_id3_picture(&((mh)->id3v2.picture),       &((mh)->id3v2.pictures))
-static void pop_id3_text(mpg123_text **list, size_t *size)
+/* Remove the last item. Its data stays in the blocks until the reset. */
+#define pop_comment(mh) pop_id3_list(&((mh)->id3v2.comments))
+#define pop_text(mh)    pop_id3_list(&((mh)->id3v2.texts))
+#define pop_extra(mh)   pop_id3_list(&((mh)->id3v2.extras))
+#define pop_picture(mh) pop_id3_list(&((mh)->id3v2.pictures))
+static void pop_id3_list(size_t *size)
 {
-	mpg123_text *x;
-	if(*size < 1) return;
-
-	free_mpg123_text(&((*list)[*size-1]));
-	if(*size > 1)
-	{
-		x = safe_realloc(*list, sizeof(mpg123_text)*(*size-1));
-		if(x != NULL){ *list  = x; *size -= 1; }
-	}
-	else
-	{
-		free(*list);
-		*list = NULL;
-		*size = 0;
-	}
-}
-static void pop_id3_picture(mpg123_picture **list, size_t *size)
-{
-	mpg123_picture *x;
-	if(*size < 1) return;
-
-	free_mpg123_picture(&((*list)[*size-1]));
-	if(*size > 1)
-	{
-		x = safe_realloc(*list, sizeof(mpg123_picture)*(*size-1));
-		if(x != NULL){ *list  = x; *size -= 1; }
-	}
-	else
-	{
-		free(*list);
-		*list = NULL;
-		*size = 0;
-	}
+	if(*size > 0)
+		*size -= 1;
 }
 
 /* OK, back to the higher level functions. */
 
+static void free_lazy(mpg123_handle *fr);
+
 void exit_id3(mpg123_handle *fr)
 {
+	/* The raw tag was only kept for the frames left for later. */
+	if(fr->id3v2_lazies && !(fr->p.flags & MPG123_STORE_RAW_ID3))
+	{
+		free(fr->id3v2_raw);
+		fr->id3v2_raw = NULL;
+		fr->id3v2_size = 0;
+	}
+	free_lazy(fr);
+	if(fr->id3v2_seen)
+		free(fr->id3v2_seen);
 	free_picture(fr);
 	free_comment(fr);
 	free_extra(fr);
 	free_text(fr);
+	free_blocks(fr);
+	mpg123_free_string(&fr->id3v2_conv);
 }
 
 void reset_id3(mpg123_handle *fr)
@@ -261,7 +319,7 @@ static void store_id3_text(mpg123_string *sb, unsigned char *source, size_t sour
 	if(notranslate)
 	{
 		/* Future: Add a path for ID3 errors. */
-		if(!mpg123_resize_string(sb, source_size))
+		if(!mpg123_grow_string(sb, source_size))
 		{
 			if(noquiet) error("Cannot resize target string, out of memory?");
 			return;
@@ -287,6 +345,15 @@ static void store_id3_text(mpg123_string *sb, unsigned char *source, size_t sour
 	else if(noquiet) error("unable to convert string to UTF-8 (out of memory, junk input?)!");
 }
 
+/* Store text for one of the lists, via the conversion buffer. */
+static void store_list_text( mpg123_handle *fr, mpg123_string *sb
+,	unsigned char *source, size_t source_size, const int notranslate )
+{
+	fr->id3v2_conv.fill = 0;
+	store_id3_text(&fr->id3v2_conv, source, source_size, NOQUIET, notranslate);
+	keep_text(fr, sb);
+}
+
 /* On error, sb->size is 0. */
 /* Also, encoding has been checked already! */
 void id3_to_utf8(mpg123_string *sb, unsigned char encoding, const unsigned char *source, size_t source_size, int noquiet)
@@ -370,7 +437,7 @@ static void process_text(mpg123_handle *fr, unsigned char *realdata, size_t real
 		return;
 	}
 	memcpy(t->id, id, 4);
-	store_id3_text(&t->text, realdata, realsize, NOQUIET, fr->p.flags & MPG123_PLAIN_ID3TEXT);
+	store_list_text(fr, &t->text, realdata, realsize, fr->p.flags & MPG123_PLAIN_ID3TEXT);
 	if(VERBOSE4) fprintf(stderr, "Note: ID3v2 %c%c%c%c text frame: %s\n", id[0], id[1], id[2], id[3], t->text.p);
 }
 
@@ -406,7 +473,9 @@ static void process_picture(mpg123_handle *fr, unsigned char *realdata, size_t r
 		if (NOQUIET) error("Unable to get mime type for picture; skipping picture.");
 		return;
 	}
-	id3_to_utf8(&i->mime_type, 0, realdata, workpoint - realdata, NOQUIET);
+	fr->id3v2_conv.fill = 0;
+	id3_to_utf8(&fr->id3v2_conv, 0, realdata, workpoint - realdata, NOQUIET);
+	keep_text(fr, &i->mime_type);
 	realsize -= workpoint - realdata;
 	realdata = workpoint;
 	/* get picture type */
@@ -419,7 +488,9 @@ static void process_picture(mpg123_handle *fr, unsigned char *realdata, size_t r
 		pop_picture(fr);
 		return;
 	}
-	id3_to_utf8(&i->description, encoding, realdata, workpoint - realdata, NOQUIET);
+	fr->id3v2_conv.fill = 0;
+	id3_to_utf8(&fr->id3v2_conv, encoding, realdata, workpoint - realdata, NOQUIET);
+	keep_text(fr, &i->description);
 	realsize -= workpoint - realdata;
 	if (realsize == 0) {
 		if (NOQUIET) error("No picture data defined; skipping picture.");
@@ -427,7 +498,7 @@ static void process_picture(mpg123_handle *fr, unsigned char *realdata, size_t r
 		return;
 	}
 	/* store_id3_picture(i, picture, realsize, NOQUIET)) */
-	i->data = (unsigned char*)malloc(realsize);
+	i->data = id3_alloc(fr, realsize);
 	if (i->data == NULL) {
 		if (NOQUIET) error("Unable to allocate memory for picture; skipping picture");
 		pop_picture(fr);
@@ -480,19 +551,20 @@ static void process_comment(mpg123_handle *fr, enum frame_types tt, unsigned cha
 	if(text == NULL)
 	{
 		if(NOQUIET) error("No comment text / valid description?");
-		pop_comment(fr);
+		if(tt == uslt) pop_text(fr);
+		else           pop_comment(fr);
 		return;
 	}
 
 	init_mpg123_text(&localcom);
 	/* Store the text, without translation to UTF-8, but for comments always a local copy in UTF-8.
 	   Reminder: No bailing out from here on without freeing the local comment data! */
-	store_id3_text(&xcom->description, descr-1, text-descr+1, NOQUIET, fr->p.flags & MPG123_PLAIN_ID3TEXT);
+	store_list_text(fr, &xcom->description, descr-1, text-descr+1, fr->p.flags & MPG123_PLAIN_ID3TEXT);
 	if(tt == comment)
 	store_id3_text(&localcom.description, descr-1, text-descr+1, NOQUIET, 0);
 
 	text[-1] = encoding; /* Byte abusal for encoding... */
-	store_id3_text(&xcom->text, text-1, realsize+1-(text-realdata), NOQUIET, fr->p.flags & MPG123_PLAIN_ID3TEXT);
+	store_list_text(fr, &xcom->text, text-1, realsize+1-(text-realdata), fr->p.flags & MPG123_PLAIN_ID3TEXT);
 	/* Remember: I will probably decode the above (again) for rva comment checking. So no messing around, please. */
 
 	if(VERBOSE4) /* Do _not_ print the verbatim text: The encoding might be funny! */
@@ -570,12 +642,12 @@ static void process_extra(mpg123_handle *fr, unsigned char* realdata, size_t rea
 
 	/* The outside storage gets reencoded to UTF-8 only if not requested otherwise.
 	   Remember that we really need the -1 here to hand in the encoding byte!*/
-	store_id3_text(&xex->description, descr-1, text-descr+1, NOQUIET, fr->p.flags & MPG123_PLAIN_ID3TEXT);
+	store_list_text(fr, &xex->description, descr-1, text-descr+1, fr->p.flags & MPG123_PLAIN_ID3TEXT);
 	/* Our local copy is always stored in UTF-8! */
 	store_id3_text(&localex.description, descr-1, text-descr+1, NOQUIET, 0);
 	/* At first, only store the outside copy of the payload. We may not need the local copy. */
 	text[-1] = encoding;
-	store_id3_text(&xex->text, text-1, realsize-(text-realdata)+1, NOQUIET, fr->p.flags & MPG123_PLAIN_ID3TEXT);
+	store_list_text(fr, &xex->text, text-1, realsize-(text-realdata)+1, fr->p.flags & MPG123_PLAIN_ID3TEXT);
 
 	/* Now check if we would like to interpret this extra info for RVA. */
 	if(localex.description.fill > 0)
@@ -624,6 +696,246 @@ static void process_extra(mpg123_handle *fr, unsigned char* realdata, size_t rea
 	free_mpg123_text(&localex);
 }
 
+/* Process one frame of the tag in tagdata, undoing unsynchronisation if
+   needed. */
+static void process_frame( mpg123_handle *fr, enum frame_types tt, char *id
+,	unsigned char *tagdata, unsigned long framesize, int unsync )
+{
+	size_t pos = 0;
+	int rva_mode = -1; /* mix / album */
+	unsigned long realsize = framesize;
+	unsigned char* realdata = tagdata;
+	if(unsync && framesize)
+	{
+		unsigned long ipos = 0;
+		unsigned long opos = 0;
+		debug("Id3v2: going to de-unsync the frame data");
+		/* de-unsync: FF00 -> FF; real FF00 is simply represented as FF0000 ... */
+		/* damn, that means I have to delete bytes from withing the data block... thus need temporal storage */
+		/* standard mandates that de-unsync should always be safe if flag is set */
+		realdata = (unsigned char*) malloc(framesize); /* will need <= bytes */
+		if(realdata == NULL)
+		{
+			if(NOQUIET) error("ID3v2: unable to allocate working buffer for de-unsync");
+			return;
+		}
+		/* now going byte per byte through the data... */
+		realdata[0] = tagdata[0];
+		opos = 1;
+		for(ipos = 1; ipos < framesize; ++ipos)
+		{
+			if(!((tagdata[ipos] == 0) && (tagdata[ipos-1] == 0xff)))
+			{
+				realdata[opos++] = tagdata[ipos];
+			}
+		}
+		realsize = opos;
+		debug2("ID3v2: de-unsync made %lu out of %lu bytes", realsize, framesize);
+	}
+	/* Avoid reading over boundary, even if there is a */
+	/* zero byte of padding for safety. */
+	if(realsize) switch(tt)
+	{
+		case comment:
+		case uslt:
+			process_comment(fr, tt, realdata, realsize, comment+1, id);
+		break;
+		case extra: /* perhaps foobar2000's work */
+			process_extra(fr, realdata, realsize, extra+1, id);
+		break;
+		case rva2: /* "the" RVA tag */
+		{
+			/* starts with null-terminated identification */
+			if(VERBOSE3) fprintf(stderr, "Note: RVA2 identification \"%s\"\n", realdata);
+			/* default: some individual value, mix mode */
+			rva_mode = 0;
+			if( !strncasecmp((char*)realdata, "album", 5)
+				 || !strncasecmp((char*)realdata, "audiophile", 10)
+				 || !strncasecmp((char*)realdata, "user", 4))
+			rva_mode = 1;
+			if(fr->rva.level[rva_mode] <= rva2+1)
+			{
+				pos += strlen((char*) realdata) + 1;
+				if(realdata[pos] == 1)
+				{
+					++pos;
+					/* only handle master channel */
+					debug("ID3v2: it is for the master channel");
+					/* two bytes adjustment, one byte for bits representing peak - n bytes, eh bits, for peak */
+					/* 16 bit signed integer = dB * 512  ... the double cast is needed to preserve the sign of negative values! */
+					fr->rva.gain[rva_mode] = (float) ( (((short)((signed char)realdata[pos])) << 8) | realdata[pos+1] ) / 512;
+					pos += 2;
+					if(VERBOSE3) fprintf(stderr, "Note: RVA value %fdB\n", fr->rva.gain[rva_mode]);
+					/* heh, the peak value is represented by a number of bits - but in what manner? Skipping that part */
+					fr->rva.peak[rva_mode] = 0;
+					fr->rva.level[rva_mode] = rva2+1;
+				}
+			}
+		}
+		break;
+		/* non-rva metainfo, simply store... */
+		case text:
+			process_text(fr, realdata, realsize, id);
+		break;
+		case picture:
+			if (fr->p.flags & MPG123_PICTURE)
+			process_picture(fr, realdata, realsize);
+
+			break;
+		default: if(NOQUIET) error1("ID3v2: unknown frame type %i", tt);
+	}
+	if(realdata != tagdata) free(realdata);
+}
+
+/* A frame left for later with MPG123_LAZY_ID3, inside id3v2_raw. */
+struct id3_lazy
+{
+	char id[5];
+	enum frame_types tt;
+	unsigned long pos;
+	unsigned long size;
+	int unsync;
+};
+
+/* Frames that can wait: plain text and pictures. Comments and TXXX may
+   carry RVA settings, RVA2 is one. */
+static int lazy_frame(mpg123_handle *fr, enum frame_types tt)
+{
+	return (fr->p.flags & MPG123_LAZY_ID3)
+	&&	(tt == text || tt == uslt || tt == picture);
+}
+
+static void add_lazy( mpg123_handle *fr, enum frame_types tt, char *id
+,	unsigned long pos, unsigned long size, int unsync )
+{
+	struct id3_lazy *x = safe_realloc( fr->id3v2_lazy
+	,	sizeof(*x)*(fr->id3v2_lazies+1) );
+	if(x == NULL)
+	{
+		if(NOQUIET) error("Unable to note ID3v2 frame for later!");
+		return;
+	}
+	fr->id3v2_lazy = x;
+	x += fr->id3v2_lazies++;
+	memcpy(x->id, id, 5);
+	x->tt = tt;
+	x->pos = pos;
+	x->size = size;
+	x->unsync = unsync;
+}
+
+static void free_lazy(mpg123_handle *fr)
+{
+	if(fr->id3v2_lazy)
+		free(fr->id3v2_lazy);
+	fr->id3v2_lazy = NULL;
+	fr->id3v2_lazies = 0;
+}
+
+void id3_process_lazy(mpg123_handle *fr)
+{
+	size_t i;
+
+	if(!fr->id3v2_lazies)
+		return;
+	debug1("ID3v2: processing %"SIZE_P" frames left for later", (size_p)fr->id3v2_lazies);
+	for(i=0; i<fr->id3v2_lazies; ++i)
+	{
+		struct id3_lazy *x = fr->id3v2_lazy+i;
+		process_frame( fr, x->tt, x->id, fr->id3v2_raw+10+x->pos
+		,	x->size, x->unsync );
+	}
+	free_lazy(fr);
+	if(!(fr->p.flags & MPG123_STORE_RAW_ID3))
+	{
+		free(fr->id3v2_raw);
+		fr->id3v2_raw = NULL;
+		fr->id3v2_size = 0;
+	}
+}
+
+/* Has the tag starting at that stream offset been parsed before? */
+static int tag_seen(mpg123_handle *fr, off_t pos)
+{
+	size_t i;
+	for(i=0; i<fr->id3v2_seens; ++i)
+		if(fr->id3v2_seen[i] == pos)
+			return 1;
+	return 0;
+}
+
+static void add_seen(mpg123_handle *fr, off_t pos)
+{
+	off_t *x = safe_realloc(fr->id3v2_seen, sizeof(*x)*(fr->id3v2_seens+1));
+	/* Only means that the tag may get parsed again. */
+	if(x == NULL)
+		return;
+	fr->id3v2_seen = x;
+	x[fr->id3v2_seens++] = pos;
+}
+
+size_t id3_memory(mpg123_handle *fr)
+{
+	size_t bytes = 0;
+	struct id3_block *b;
+	for(b = fr->id3v2_blocks; b != NULL; b = b->next)
+		bytes += sizeof(*b)+b->size;
+	bytes += (fr->id3v2_text_room+fr->id3v2_comment_room+fr->id3v2_extra_room)
+	*	sizeof(mpg123_text);
+	bytes += fr->id3v2_picture_room*sizeof(mpg123_picture);
+	bytes += fr->id3v2_lazies*sizeof(struct id3_lazy);
+	bytes += fr->id3v2_seens*sizeof(off_t);
+	bytes += fr->id3v2_conv.size;
+	return bytes;
+}
+
+int id3_has_pictures(mpg123_handle *fr)
+{
+	size_t i;
+
+	if(fr->id3v2.pictures)
+		return TRUE;
+	for(i=0; i<fr->id3v2_lazies; ++i)
+		if(fr->id3v2_lazy[i].tt == picture)
+			return TRUE;
+	return FALSE;
+}
+
+int id3_text(mpg123_handle *fr, const char *id, mpg123_string *sb)
+{
+	size_t i;
+
+	/* The last one wins, as when processing all of them. */
+	for(i=fr->id3v2_lazies; i>0; --i)
+	{
+		struct id3_lazy *x = fr->id3v2_lazy+i-1;
+		if(x->tt == text && !strncmp(x->id, id, 4))
+		{
+			unsigned char *data = fr->id3v2_raw+10+x->pos;
+			size_t size = x->size;
+			if(x->unsync)
+			{
+				/* Go the full way for the rare unsynchronised tag. */
+				id3_process_lazy(fr);
+				return id3_text(fr, id, sb);
+			}
+			if(!size)
+				return FALSE;
+			mpg123_free_string(sb);
+			store_id3_text( sb, data, size, NOQUIET
+			,	fr->p.flags & MPG123_PLAIN_ID3TEXT );
+			return sb->fill ? TRUE : FALSE;
+		}
+	}
+	for(i=fr->id3v2.texts; i>0; --i)
+	{
+		mpg123_text *t = fr->id3v2.text+i-1;
+		if(!strncmp(t->id, id, 4))
+			return mpg123_copy_string(&t->text, sb);
+	}
+	return FALSE;
+}
+
 /* Make a ID3v2.3+ 4-byte ID from a ID3v2.2 3-byte ID
    Note that not all frames survived to 2.4; the mapping goes to 2.3 .
    A notable miss is the old RVA frame, which is very unspecific anyway.
@@ -660,24 +972,65 @@ static int promote_framename(mpg123_handle *fr, char *id) /* fr because of VERBO
 
 #endif /* NO_ID3V2 */
 
+/*
+	The length is just what the tag claims, up to 256 MiB. The memory grows
+	with the data actually read, in steps doubling from ID3_CHUNK, so that a
+	truncated tag costs no more than what is there. The feeder has to hold
+	the whole tag before anything is allocated, retrying the tag from its
+	start with each new piece of data.
+*/
+#define ID3_CHUNK 65536
+
 int store_id3v2( mpg123_handle *fr
 ,	unsigned long first4bytes, unsigned char buf[6], unsigned long length )
 {
 	int ret = 1;
 	off_t ret2;
 	unsigned long fullen = 10+length;
+	unsigned long space = fullen;
+	unsigned long have = 0;
 	if(fr->id3v2_raw)
 		free(fr->id3v2_raw);
+	fr->id3v2_raw = NULL;
 	fr->id3v2_size = 0;
+	if((ret2 = feed_need(fr, length)) < 0)
+		return ret2;
+	if(space > 10+ID3_CHUNK)
+		space = 10+ID3_CHUNK;
 	/* Allocate one byte more for a closing zero as safety catch for strlen(). */
-	fr->id3v2_raw = malloc(fullen+1);
+	fr->id3v2_raw = malloc(space+1);
+	while(fr->id3v2_raw && have < length)
+	{
+		unsigned long chunk;
+		if(10+have == space)
+		{
+			unsigned long newspace = space > fullen/2 ? fullen : 2*space;
+			unsigned char *newraw = realloc(fr->id3v2_raw, newspace+1);
+			if(!newraw)
+			{
+				free(fr->id3v2_raw);
+				fr->id3v2_raw = NULL;
+				break;
+			}
+			fr->id3v2_raw = newraw;
+			space = newspace;
+		}
+		chunk = space-10-have;
+		if((ret2=fr->rd->read_frame_body(fr, fr->id3v2_raw+10+have, chunk)) <= 0)
+		{
+			free(fr->id3v2_raw);
+			fr->id3v2_raw = NULL;
+			return ret2;
+		}
+		have += chunk;
+	}
 	if(!fr->id3v2_raw)
 	{
 		fr->err = MPG123_OUT_OF_MEM;
 		if(NOQUIET)
 			error1("ID3v2: Arrg! Unable to allocate %lu bytes"
 				" for ID3v2 data - trying to skip instead.", length+1);
-		if((ret2=fr->rd->skip_bytes(fr,length)) < 0)
+		if((ret2=fr->rd->skip_bytes(fr,length-have)) < 0)
 			ret = ret2;
 		else
 			ret = 0;
@@ -689,17 +1042,9 @@ int store_id3v2( mpg123_handle *fr
 		fr->id3v2_raw[2] = (first4bytes>>8)  & 0xff;
 		fr->id3v2_raw[3] =  first4bytes      & 0xff;
 		memcpy(fr->id3v2_raw+4, buf, 6);
-		if((ret2=fr->rd->read_frame_body(fr, fr->id3v2_raw+10, length)) < 0)
-		{
-			ret=ret2;
-			free(fr->id3v2_raw);
-			fr->id3v2_raw = NULL;
-		}
-		else
-		{ /* Closing with a zero for paranoia. */
-			fr->id3v2_raw[fullen] = 0;
-			fr->id3v2_size = fullen;
-		}
+		/* Closing with a zero for paranoia. */
+		fr->id3v2_raw[fullen] = 0;
+		fr->id3v2_size = fullen;
 	}
 	return ret;
 }
@@ -727,18 +1072,26 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 	unsigned int footlen = 0;
 #ifndef NO_ID3V2
 	int skiptag = 0;
+	off_t tagstart;
 #endif
 	unsigned char major = first4bytes & 0xff;
 	debug1("ID3v2: major tag version: %i", major);
 
 	if(major == 0xff) return 0; /* Invalid... */
-	if((ret2 = fr->rd->read_frame_body(fr, buf, 6)) < 0) /* read more header information */
+#ifndef NO_ID3V2
+	/* The 4 bytes given to us are already read. */
+	tagstart = fr->rd->tell(fr) - 4;
+#endif
+	if((ret2 = fr->rd->read_frame_body(fr, buf, 6)) <= 0) /* read more header information */
 	return ret2;
 
 	if(buf[0] == 0xff) return 0; /* Revision, will never be 0xff. */
 
 	if(fr->p.flags & MPG123_STORE_RAW_ID3)
 		storetag = 1;
+	/* A tag in the middle of the stream would need fresh memory. */
+	if(fr->p.fixed_memory && fr->firsthead)
+		storetag = 0;
 	/* second new byte are some nice flags, if these are invalid skip the whole thing */
 	flags = buf[1];
 	debug1("ID3v2: flags 0x%08x", flags);
@@ -792,6 +1145,12 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 			fprintf(stderr, "Note: Skipping ID3v2 tag per user request.\n");
 		skiptag = 1;
 	}
+	if(fr->p.fixed_memory && fr->firsthead)
+	{
+		if(VERBOSE3)
+			fprintf(stderr, "Note: Skipping ID3v2 tag after the first frame (fixed memory).\n");
+		skiptag = 1;
+	}
 	if((flags & UNKNOWN_FLAGS) || (major > 4) || (major < 2))
 	{
 		if(NOQUIET)
@@ -806,11 +1165,24 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 			warning1("ID3v2: unrealistic small tag lengh %lu, skipping", length);
 		skiptag = 1;
 	}
+	if(!skiptag && tag_seen(fr, tagstart))
+	{
+		/* Back here after a seek, the data is known already. */
+		if(VERBOSE3)
+			fprintf(stderr, "Note: Skipping ID3v2 tag parsed before.\n");
+		if((ret2=fr->rd->skip_bytes(fr,length+footlen))<0)
+			return ret2;
+		return 0;
+	}
 	if(!skiptag)
 		storetag = 1;
 #endif
 	if(storetag)
 	{
+#ifndef NO_ID3V2
+		/* The raw data of an earlier tag is about to go away. */
+		id3_process_lazy(fr);
+#endif
 		/* Stores whole tag with footer and an additonal trailing zero. */
 		if((ret2 = store_id3v2(fr, first4bytes, buf, length+footlen)) <= 0)
 			return ret2;
@@ -938,90 +1310,14 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 
 						if(tt != unknown)
 						{
-							int rva_mode = -1; /* mix / album */
-							unsigned long realsize = framesize;
-							unsigned char* realdata = tagdata+pos;
-							if((flags & UNSYNC_FLAG) || (fflags & UNSYNC_FFLAG))
+							int unsync = (flags & UNSYNC_FLAG) || (fflags & UNSYNC_FFLAG);
+							if(lazy_frame(fr, tt))
 							{
-								unsigned long ipos = 0;
-								unsigned long opos = 0;
-								debug("Id3v2: going to de-unsync the frame data");
-								/* de-unsync: FF00 -> FF; real FF00 is simply represented as FF0000 ... */
-								/* damn, that means I have to delete bytes from withing the data block... thus need temporal storage */
-								/* standard mandates that de-unsync should always be safe if flag is set */
-								realdata = (unsigned char*) malloc(framesize); /* will need <= bytes */
-								if(realdata == NULL)
-								{
-									if(NOQUIET) error("ID3v2: unable to allocate working buffer for de-unsync");
-									continue;
-								}
-								/* now going byte per byte through the data... */
-								realdata[0] = tagdata[pos];
-								opos = 1;
-								for(ipos = pos+1; ipos < pos+framesize; ++ipos)
-								{
-									if(!((tagdata[ipos] == 0) && (tagdata[ipos-1] == 0xff)))
-									{
-										realdata[opos++] = tagdata[ipos];
-									}
-								}
-								realsize = opos;
-								debug2("ID3v2: de-unsync made %lu out of %lu bytes", realsize, framesize);
+								if(tt != picture || (fr->p.flags & MPG123_PICTURE))
+									add_lazy(fr, tt, id, pos, framesize, unsync);
 							}
-							pos = 0; /* now at the beginning again... */
-							/* Avoid reading over boundary, even if there is a */
-							/* zero byte of padding for safety. */
-							if(realsize) switch(tt)
-							{
-								case comment:
-								case uslt:
-									process_comment(fr, tt, realdata, realsize, comment+1, id);
-								break;
-								case extra: /* perhaps foobar2000's work */
-									process_extra(fr, realdata, realsize, extra+1, id);
-								break;
-								case rva2: /* "the" RVA tag */
-								{
-									/* starts with null-terminated identification */
-									if(VERBOSE3) fprintf(stderr, "Note: RVA2 identification \"%s\"\n", realdata);
-									/* default: some individual value, mix mode */
-									rva_mode = 0;
-									if( !strncasecmp((char*)realdata, "album", 5)
-										 || !strncasecmp((char*)realdata, "audiophile", 10)
-										 || !strncasecmp((char*)realdata, "user", 4))
-									rva_mode = 1;
-									if(fr->rva.level[rva_mode] <= rva2+1)
-									{
-										pos += strlen((char*) realdata) + 1;
-										if(realdata[pos] == 1)
-										{
-											++pos;
-											/* only handle master channel */
-											debug("ID3v2: it is for the master channel");
-											/* two bytes adjustment, one byte for bits representing peak - n bytes, eh bits, for peak */
-											/* 16 bit signed integer = dB * 512  ... the double cast is needed to preserve the sign of negative values! */
-											fr->rva.gain[rva_mode] = (float) ( (((short)((signed char)realdata[pos])) << 8) | realdata[pos+1] ) / 512;
-											pos += 2;
-											if(VERBOSE3) fprintf(stderr, "Note: RVA value %fdB\n", fr->rva.gain[rva_mode]);
-											/* heh, the peak value is represented by a number of bits - but in what manner? Skipping that part */
-											fr->rva.peak[rva_mode] = 0;
-											fr->rva.level[rva_mode] = rva2+1;
-										}
-									}
-								}
-								break;
-								/* non-rva metainfo, simply store... */
-								case text:
-									process_text(fr, realdata, realsize, id);
-								break;
-								case picture:
-									if (fr->p.flags & MPG123_PICTURE)
-									process_picture(fr, realdata, realsize);
-
-									break;
-								default: if(NOQUIET) error1("ID3v2: unknown frame type %i", tt);
-							}
-							if((flags & UNSYNC_FLAG) || (fflags & UNSYNC_FFLAG)) free(realdata);
+							else
+								process_frame(fr, tt, id, tagdata+pos, framesize, unsync);
 						}
 						#undef BAD_FFLAGS
 						#undef PRES_TAG_FFLAG
@@ -1039,8 +1335,10 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 			}
 		}
 tagparse_cleanup:
+		if(ret > 0)
+			add_seen(fr, tagstart);
 		/* Get rid of stored raw data that should not be kept. */
-		if(!(fr->p.flags & MPG123_STORE_RAW_ID3))
+		if(!(fr->p.flags & MPG123_STORE_RAW_ID3) && !fr->id3v2_lazies)
 		{
 			free(fr->id3v2_raw);
 			fr->id3v2_raw = NULL;
@@ -1058,6 +1356,43 @@ tagparse_cleanup:
 
 #ifndef NO_ID3V2 /* Disabling all the rest... */
 
+/*
+	Length of the run at s where all bytes have none of the bits in mask set,
+	mask being given for the first sizeof(unsigned long) bytes. Looks at a
+	whole machine word at a time, for the plain ASCII text that most tags are
+	made of. The mask bytes repeat after two, so both ends of UTF-16 work.
+*/
+static size_t masked_span( const unsigned char *s, size_t l
+,	const unsigned char *mask, size_t step )
+{
+	unsigned long m;
+	size_t i = 0;
+
+	memcpy(&m, mask, sizeof(m));
+	for(; i+sizeof(m) <= l; i+=sizeof(m))
+	{
+		unsigned long w;
+		memcpy(&w, s+i, sizeof(w));
+		if(w & m)
+			break;
+	}
+	/* The rest, or the word with the first offending unit. */
+	for(; i+step <= l; i+=step)
+	{
+		if((s[i] & mask[0]) || (step > 1 && (s[i+1] & mask[1])))
+			break;
+	}
+	return i;
+}
+
+/* Number of leading bytes below 0x80. */
+static size_t ascii_span(const unsigned char *s, size_t l)
+{
+	unsigned char mask[sizeof(unsigned long)];
+	memset(mask, 0x80, sizeof(mask));
+	return masked_span(s, l, mask, 1);
+}
+
 static void convert_latin1(mpg123_string *sb, const unsigned char* s, size_t l, const int noquiet)
 {
 	size_t length = l;
@@ -1065,20 +1400,28 @@ static void convert_latin1(mpg123_string *sb, const unsigned char* s, size_t l,
 	unsigned char *p;
 	/* determine real length, a latin1 character can at most take 2  in UTF8 */
 	for(i=0; i<l; ++i)
-	if(s[i] >= 0x80) ++length;
+	{
+		i += ascii_span(s+i, l-i);
+		if(i < l) ++length;
+	}
 
 	debug1("UTF-8 length: %lu", (unsigned long)length);
 	/* one extra zero byte for paranoia */
-	if(!mpg123_resize_string(sb, length+1)){ mpg123_free_string(sb); return ; }
+	if(!mpg123_grow_string(sb, length+1)){ mpg123_free_string(sb); return ; }
 
 	p = (unsigned char*) sb->p; /* Signedness doesn't matter but it shows I thought about the non-issue */
 	for(i=0; i<l; ++i)
-	if(s[i] < 0x80){ *p = s[i]; ++p; }
-	else /* two-byte encoding */
 	{
-		*p     = 0xc0 | (s[i]>>6);
-		*(p+1) = 0x80 | (s[i] & 0x3f);
-		p+=2;
+		size_t n = ascii_span(s+i, l-i);
+		memcpy(p, s+i, n);
+		p += n;
+		i += n;
+		if(i < l) /* two-byte encoding */
+		{
+			*p     = 0xc0 | (s[i]>>6);
+			*(p+1) = 0x80 | (s[i] & 0x3f);
+			p+=2;
+		}
 	}
 
 	sb->p[length] = 0;
@@ -1135,6 +1478,7 @@ static void convert_utf16bom(mpg123_string *sb, const unsigned char* s, size_t l
 	size_t high = 0;
 	size_t low  = 1;
 	int bom_endian;
+	unsigned char mask[sizeof(unsigned long)];
 
 	debug1("convert_utf16 with length %lu", (unsigned long)l);
 
@@ -1148,11 +1492,20 @@ static void convert_utf16bom(mpg123_string *sb, const unsigned char* s, size_t l
 	}
 
 	n = (l/2)*2; /* number bytes that make up full pairs */
+	/* ASCII characters have a zero high byte and the top bit of the low byte unset. */
+	for(i=0; i<sizeof(mask); ++i)
+		mask[i] = (i%2 == high) ? 0xff : 0x80;
 
 	/* first: get length, check for errors -- stop at first one */
 	for(i=0; i < n; i+=2)
 	{
-		unsigned long point = ((unsigned long) s[i+high]<<8) + s[i+low];
+		unsigned long point;
+		size_t ascii = masked_span(s+i, n-i, mask, 2);
+		length += ascii/2;
+		i += ascii;
+		if(i >= n)
+			break;
+		point = ((unsigned long) s[i+high]<<8) + s[i+low];
 		if((point & 0xfc00) == 0xd800) /* lead surrogate */
 		{
 			unsigned short second = (i+3 < l) ? (s[i+2+high]<<8) + s[i+2+low] : 0;
@@ -1172,13 +1525,19 @@ static void convert_utf16bom(mpg123_string *sb, const unsigned char* s, size_t l
 		else length += UTF8LEN(point); /* 1,2 or 3 bytes */
 	}
 
-	if(!mpg123_resize_string(sb, length+1)){ mpg123_free_string(sb); return ; }
+	if(!mpg123_grow_string(sb, length+1)){ mpg123_free_string(sb); return ; }
 
 	/* Now really convert, skip checks as these have been done just before. */
 	p = (unsigned char*) sb->p; /* Signedness doesn't matter but it shows I thought about the non-issue */
 	for(i=0; i < n; i+=2)
 	{
-		unsigned long codepoint = ((unsigned long) s[i+high]<<8) + s[i+low];
+		unsigned long codepoint;
+		size_t ascii = masked_span(s+i, n-i, mask, 2);
+		for(; ascii; ascii-=2, i+=2)
+			*p++ = s[i+low];
+		if(i >= n)
+			break;
+		codepoint = ((unsigned long) s[i+high]<<8) + s[i+low];
 		if((codepoint & 0xfc00) == 0xd800) /* lead surrogate */
 		{
 			unsigned short second = (s[i+2+high]<<8) + s[i+2+low];
@@ -1205,15 +1564,15 @@ static void convert_utf16bom(mpg123_string *sb, const unsigned char* s, size_t l
 			*p++ = (unsigned char) (0x80 | (codepoint & 0x3f));
 		} /* ignore bigger ones (that are not possible here anyway) */
 	}
-	sb->p[sb->size-1] = 0; /* paranoia... */
-	sb->fill = sb->size;
+	sb->p[length] = 0; /* paranoia... */
+	sb->fill = length+1;
 }
 #undef UTF8LEN
 #undef FULLPOINT
 
 static void convert_utf8(mpg123_string *sb, const unsigned char* source, size_t len, const int noquiet)
 {
-	if(mpg123_resize_string(sb, len+1))
+	if(mpg123_grow_string(sb, len+1))
 	{
 		memcpy(sb->p, source, len);
 		sb->p[len] = 0;
@@ -29,11 +29,22 @@
 #  undef id3_link
 # endif
 # define id3_link(fr)
+# define id3_process_lazy(fr)
+# define id3_memory(fr) 0
 #else
 void init_id3(mpg123_handle *fr);
 void exit_id3(mpg123_handle *fr);
 void reset_id3(mpg123_handle *fr);
 void id3_link(mpg123_handle *fr);
+/* Process the frames left for later with MPG123_LAZY_ID3. */
+void id3_process_lazy(mpg123_handle *fr);
+/* TRUE if the tag has pictures, also ones left for later. */
+int id3_has_pictures(mpg123_handle *fr);
+/* Store the text of frame id (the last one) into sb, converting only that
+   frame if it was left for later. TRUE if there is such text. */
+int id3_text(mpg123_handle *fr, const char *id, mpg123_string *sb);
+/* Bytes held for the parsed tag: lists, string blocks and bookkeeping. */
+size_t id3_memory(mpg123_handle *fr);
 #endif
 int  parse_new_id3(mpg123_handle *fr, unsigned long first4bytes);
 /* Convert text from some ID3 encoding to UTf-8.
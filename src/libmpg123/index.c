@@ -54,11 +54,34 @@ void fi_exit(struct frame_index *fi)
 	fi_init(fi); /* Be prepared for further fun, still. */
 }
 
+/* Get the memory for an index that has been sized, but not used yet. */
+static int fi_alloc(struct frame_index *fi)
+{
+	if(fi->data == NULL && fi->size)
+	{
+		fi->data = malloc(fi->size*sizeof(off_t));
+		if(fi->data == NULL)
+		{
+			error("failed to allocate index!");
+			return -1;
+		}
+		debug2("allocated index of size %lu at %p", (unsigned long)fi->size, (void*)fi->data);
+	}
+	return 0;
+}
+
 int fi_resize(struct frame_index *fi, size_t newsize)
 {
 	off_t *newdata = NULL;
 	if(newsize == fi->size) return 0;
 
+	if(fi->data == NULL && !fi->fill)
+	{ /* Nothing to keep, the memory comes with the first entry. */
+		fi->size = newsize;
+		fi->next = fi_next(fi);
+		return 0;
+	}
+
 	if(newsize > 0 && newsize < fi->size)
 	{ /* When we reduce buffer size a bit, shrink stuff. */
 		while(fi->fill > newsize){ fi_shrink(fi); }
@@ -97,6 +120,8 @@ void fi_add(struct frame_index *fi, off_t pos)
 		if(fi->next != framenum) return;
 	}
 	/* When we are here, we want that frame. */
+	if(fi_alloc(fi))
+		return;
 	if(fi->fill < fi->size) /* safeguard for size=1, or just generally */
 	{
 		debug1("adding to index at %p", (void*)(fi->data+fi->fill));
@@ -113,6 +138,7 @@ int fi_set(struct frame_index *fi, off_t *offsets, off_t step, size_t fill)
 	fi->step = step;
 	if(offsets != NULL)
 	{
+		if(fi_alloc(fi)) return -1;
 		memcpy(fi->data, offsets, fill*sizeof(off_t));
 		fi->fill = fill;
 	}
@@ -134,3 +160,196 @@ void fi_reset(struct frame_index *fi)
 	fi->step = 1;
 	fi->next = fi_next(fi);
 }
+
+void ci_init(struct frame_cindex *ci, int enabled)
+{
+	ci->enabled = enabled;
+	ci->block = NULL;
+	ci->blocks = 0;
+	ci->code = NULL;
+	ci->size = 0;
+	ci_reset(ci);
+}
+
+void ci_exit(struct frame_cindex *ci)
+{
+	if(ci->block != NULL) free(ci->block);
+	if(ci->code != NULL) free(ci->code);
+	ci_init(ci, 0);
+}
+
+void ci_reset(struct frame_cindex *ci)
+{
+	ci->used = 0;
+	ci->fill = 0;
+	ci->last = 0;
+	ci->lastsize = 0;
+}
+
+void ci_add(struct frame_cindex *ci, off_t pos)
+{
+	size_t b = (size_t)(ci->fill/FI_BLOCK);
+	if(!ci->enabled || pos < ci->last)
+		return;
+	if(ci->fill % FI_BLOCK == 0)
+	{
+		if(b >= ci->blocks)
+		{
+			size_t newblocks = ci->blocks ? 2*ci->blocks : 64;
+			struct frame_cindex_block *nb = newblocks < ci->blocks
+			?	NULL
+			:	safe_realloc(ci->block, newblocks*sizeof(*nb));
+			if(nb == NULL)
+				goto ci_add_fail;
+			ci->block = nb;
+			ci->blocks = newblocks;
+		}
+		ci->block[b].pos  = pos;
+		ci->block[b].code = ci->used;
+		ci->lastsize = 0;
+	}
+	else
+	{
+		off_t diff = (pos - ci->last) - ci->lastsize;
+		/* Zigzag: small magnitudes of either sign give small numbers. */
+		uint64_t val = diff < 0
+		?	((uint64_t)(-(diff+1)) << 1) | 1
+		:	(uint64_t)diff << 1;
+		/* Room for the longest varint. */
+		if(ci->size - ci->used < 10)
+		{
+			size_t newsize = ci->size ? 2*ci->size : 4096;
+			unsigned char *nc = newsize < ci->size
+			?	NULL
+			:	safe_realloc(ci->code, newsize);
+			if(nc == NULL)
+				goto ci_add_fail;
+			ci->code = nc;
+			ci->size = newsize;
+		}
+		do
+		{
+			unsigned char c = val & 0x7f;
+			val >>= 7;
+			if(val)
+				c |= 0x80;
+			ci->code[ci->used++] = c;
+		} while(val);
+		ci->lastsize = pos - ci->last;
+	}
+	ci->last = pos;
+	++ci->fill;
+	return;
+ci_add_fail:
+	error("failed to grow compact index, dropping it");
+	ci_exit(ci);
+}
+
+off_t ci_find(struct frame_cindex *ci, off_t frame)
+{
+	off_t pos, size = 0;
+	size_t code;
+	int n;
+	if(!ci->enabled || frame < 0 || frame >= ci->fill)
+		return -1;
+	pos  = ci->block[frame/FI_BLOCK].pos;
+	code = ci->block[frame/FI_BLOCK].code;
+	for(n = (int)(frame % FI_BLOCK); n; --n)
+	{
+		uint64_t val = 0;
+		int shift = 0;
+		unsigned char c;
+		do
+		{
+			c = ci->code[code++];
+			val |= (uint64_t)(c & 0x7f) << shift;
+			shift += 7;
+		} while(c & 0x80);
+		size += (val & 1) ? -(off_t)(val >> 1) - 1 : (off_t)(val >> 1);
+		pos  += size;
+	}
+	return pos;
+}
+
+size_t ci_memory(struct frame_cindex *ci)
+{
+	return ci->blocks*sizeof(*ci->block) + ci->size;
+}
+
+void ri_init(struct frame_rindex *ri)
+{
+	ri->data = NULL;
+	ri->size = 0;
+	ri_reset(ri);
+}
+
+void ri_exit(struct frame_rindex *ri)
+{
+	if(ri->data != NULL) free(ri->data);
+	ri_init(ri);
+}
+
+int ri_resize(struct frame_rindex *ri, size_t size)
+{
+	if(size != ri->size)
+	{
+		ri_exit(ri);
+		if(size)
+		{
+			ri->data = size > SIZE_MAX/sizeof(off_t)
+			?	NULL
+			:	malloc(size*sizeof(off_t));
+			if(ri->data == NULL)
+			{
+				error("failed to allocate ring index!");
+				return -1;
+			}
+			ri->size = size;
+		}
+	}
+	ri_reset(ri);
+	return 0;
+}
+
+void ri_reset(struct frame_rindex *ri)
+{
+	ri->start = 0;
+	ri->fill = 0;
+	ri->first = 0;
+}
+
+void ri_add(struct frame_rindex *ri, off_t framenum, off_t pos)
+{
+	if(!ri->size)
+		return;
+	if(framenum != ri->first+(off_t)ri->fill)
+	{
+		ri_reset(ri);
+		ri->first = framenum;
+	}
+	if(ri->fill < ri->size)
+		ri->data[(ri->start+ri->fill++) % ri->size] = pos;
+	else
+	{
+		ri->data[ri->start] = pos;
+		ri->start = (ri->start+1) % ri->size;
+		++ri->first;
+	}
+}
+
+off_t ri_find(struct frame_rindex *ri, off_t frame)
+{
+	if(frame < ri->first || frame >= ri->first+(off_t)ri->fill)
+		return -1;
+	return ri->data[(ri->start+(size_t)(frame-ri->first)) % ri->size];
+}
+
+unsigned long fi_hash(unsigned long hash, const unsigned char *data, size_t size)
+{
+	size_t i;
+	if(!hash)
+		hash = 2166136261UL;
+	for(i=0; i<size; ++i)
+		hash = ((hash ^ data[i]) * 16777619UL) & 0xffffffffUL;
+	return hash;
+}
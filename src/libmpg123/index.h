@@ -56,4 +56,79 @@ int fi_set(struct frame_index *fi, off_t *offsets, off_t step, size_t fill);
 /* Empty the index (setting fill=0 and step=1), but keep current size. */
 void fi_reset(struct frame_index *fi);
 
+/*
+	The compact index keeps every frame position instead, for exact seeks in
+	long streams without the coarseness from shrinking. Each block of
+	FI_BLOCK frames has an absolute anchor, the following positions are
+	stored as differences of frame sizes, zigzag and varint coded. That is
+	about one byte per frame for constant and two for variable bitrate.
+*/
+#define FI_BLOCK 64
+
+struct frame_cindex_block
+{
+	off_t  pos;  /* position of the first frame in the block */
+	size_t code; /* start of the coded sizes for the following frames */
+};
+
+struct frame_cindex
+{
+	int enabled;
+	struct frame_cindex_block *block;
+	size_t blocks; /* allocated blocks */
+	unsigned char *code; /* coded size differences */
+	size_t size; /* allocated code bytes */
+	size_t used; /* used code bytes */
+	off_t fill; /* number of recorded frames, starting at frame 0 */
+	off_t last; /* position of the last recorded frame */
+	off_t lastsize; /* size prediction for the next frame in the block */
+};
+
+#define CI_NEXT(ci, framenum) ((ci).enabled && framenum == (ci).fill)
+
+/* Zero things, enabled or not. */
+void ci_init(struct frame_cindex *ci, int enabled);
+/* Deallocate and disable. */
+void ci_exit(struct frame_cindex *ci);
+/* Forget the recorded frames, keeping the memory. */
+void ci_reset(struct frame_cindex *ci);
+/* Append the position of frame number ci->fill. Running out of memory
+   disables the compact index. */
+void ci_add(struct frame_cindex *ci, off_t pos);
+/* Position of a recorded frame, -1 if the index does not go that far. */
+off_t ci_find(struct frame_cindex *ci, off_t frame);
+/* Bytes of allocated memory. */
+size_t ci_memory(struct frame_cindex *ci);
+
+/*
+	The ring index keeps the positions of only the last frames, for going
+	back a while in endless streams with fixed memory. When full, the oldest
+	position makes room for the newest one.
+*/
+struct frame_rindex
+{
+	off_t *data;
+	size_t size; /* capacity in frames, 0 when disabled */
+	size_t start; /* slot of the oldest frame */
+	size_t fill;
+	off_t first; /* number of the oldest frame */
+};
+
+#define RI_NEXT(ri, framenum) ((ri).size && framenum >= (ri).first+(off_t)(ri).fill)
+
+void ri_init(struct frame_rindex *ri);
+void ri_exit(struct frame_rindex *ri);
+/* Change capacity, forgetting the recorded frames. Return 0 on success. */
+int ri_resize(struct frame_rindex *ri, size_t size);
+void ri_reset(struct frame_rindex *ri);
+/* Append a frame position. A frame number beyond the next expected one
+   (after a seek) starts the ring anew from there. */
+void ri_add(struct frame_rindex *ri, off_t framenum, off_t pos);
+/* Position of a retained frame, -1 if it is not (or no longer) there. */
+off_t ri_find(struct frame_rindex *ri, off_t frame);
+
+/* Checksum (32 bit FNV-1a) of some bytes, continuing from a previous value
+   or starting anew with hash=0. Used to tell apart stored index data. */
+unsigned long fi_hash(unsigned long hash, const unsigned char *data, size_t size);
+
 #endif
@@ -10,6 +10,7 @@
 
 #include "mpg123lib_intern.h"
 #include "getbits.h"
+#include "crc.h"
 #include "debug.h"
 
 /*
@@ -115,134 +116,168 @@ static int I_step_one(unsigned int balloc[], unsigned int scale_index[2][SBLIMIT
 /* Something sane in place of undefined (-1)<<n. Well, not really. */
 #define MINUS_SHIFT(n) ( (int)(((unsigned int)-1)<<(n)) )
 
-static int I_step_two(real fraction[2][SBLIMIT],unsigned int balloc[2*SBLIMIT], unsigned int scale_index[2][SBLIMIT],mpg123_handle *fr)
+/*
+	Bit allocation and scale factors stay the same for the 12 sample groups
+	of a frame. Work out once what each subband needs: the bits to read, the
+	offset to make the sample signed and the scale. Unused subbands read no
+	bits and have a scale of zero, so that dequantization is a plain loop
+	over all subbands for the compiler to vectorize.
+*/
+struct I_alloc
 {
-	int i,n;
-	int smpb[2*SBLIMIT]; /* values: 0-65535 */
-	int *sample;
-	register unsigned int *ba;
-	register unsigned int *sca = (unsigned int *) scale_index;
-
-	if(fr->stereo == 2)
+	unsigned int needbits;
+	int bits[2][SBLIMIT];
+	int offset[2][SBLIMIT];
+	real scale[2][SBLIMIT];
+};
+
+static void I_prepare( struct I_alloc *al, unsigned int *ba
+,	unsigned int *sca, mpg123_handle *fr )
+{
+	int i, ch;
+	int n = 0;
+	int stereo = fr->stereo;
+	int jsbound = stereo == 2 ? fr->jsbound : SBLIMIT;
+
+	al->needbits = 0;
+	for(i=0;i<SBLIMIT;i++)
+	for(ch=0;ch<stereo;ch++)
 	{
-		unsigned int needbits = 0;
-		int jsbound = fr->jsbound;
-		register real *f0 = fraction[0];
-		register real *f1 = fraction[1];
-
-		ba = balloc;
-		for(sample=smpb,i=0;i<jsbound;i++)
+		/* Beyond jsbound, the channels share allocation and samples. */
+		int shared = i >= jsbound && ch;
+		if(!shared)
+			n = *ba++;
+		if(n)
 		{
-			if((n=*ba++))
-				needbits += n+1;
-			if((n=*ba++))
-				needbits += n+1;
+			al->offset[ch][i] = MINUS_SHIFT(n) + 1;
+			al->scale[ch][i]  = fr->muls[n+1][*sca++];
 		}
-		for(i=jsbound;i<SBLIMIT;i++) 
-			if((n = *ba++))
-				needbits += n+1;
-		NEED_BITS(fr, needbits)
-
-		ba = balloc;
-		for(sample=smpb,i=0;i<jsbound;i++)
+		else
 		{
-			if((n = *ba++)) *sample++ = getbits(fr, n+1);
-
-			if((n = *ba++)) *sample++ = getbits(fr, n+1);
+			al->offset[ch][i] = 0;
+			al->scale[ch][i]  = DOUBLE_TO_REAL(0.0);
 		}
-		for(i=jsbound;i<SBLIMIT;i++) 
-		if((n = *ba++))
-		*sample++ = getbits(fr, n+1);
+		al->bits[ch][i] = n && !shared ? n+1 : 0;
+		al->needbits += al->bits[ch][i];
+	}
+}
 
-		ba = balloc;
-		for(sample=smpb,i=0;i<jsbound;i++)
-		{
-			if((n=*ba++))
-			*f0++ = REAL_MUL_SCALE_LAYER12(DOUBLE_TO_REAL_15(MINUS_SHIFT(n) + (*sample++) + 1), fr->muls[n+1][*sca++]);
-			else *f0++ = DOUBLE_TO_REAL(0.0);
+/*
+	Groups of 8 are computed before they are stored, so that the compiler can
+	use vector registers without proving that f does not overlap the tables.
+	The limit is a multiple of 8 anyway (32, 16 or 8 subbands).
+*/
+static void I_dequant( real *f, int *smp, struct I_alloc *al, int ch
+,	mpg123_handle *fr )
+{
+	int i, k;
+	int *offset = al->offset[ch];
+	real *scale = al->scale[ch];
+	for(i=0;i<fr->down_sample_sblimit;i+=8)
+	{
+		real v[8];
+		for(k=0;k<8;k++)
+			v[k] = REAL_MUL_SCALE_LAYER12( DOUBLE_TO_REAL_15(smp[i+k] + offset[i+k])
+			,	scale[i+k] );
+		for(k=0;k<8;k++)
+			f[i+k] = v[k];
+	}
+	for(;i<SBLIMIT;i++)
+		f[i] = DOUBLE_TO_REAL(0.0);
+}
 
-			if((n=*ba++))
-			*f1++ = REAL_MUL_SCALE_LAYER12(DOUBLE_TO_REAL_15(MINUS_SHIFT(n) + (*sample++) + 1), fr->muls[n+1][*sca++]);
-			else *f1++ = DOUBLE_TO_REAL(0.0);
-		}
-		for(i=jsbound;i<SBLIMIT;i++)
+static int I_step_two(real *f0, real *f1, struct I_alloc *al, mpg123_handle *fr)
+{
+	int smp[2][SBLIMIT];
+	int i;
+
+	NEED_BITS(fr, al->needbits)
+	if(fr->stereo == 2)
+	{
+		int jsbound = fr->jsbound;
+		for(i=0;i<jsbound;i++)
 		{
-			if((n=*ba++))
-			{
-				real samp = DOUBLE_TO_REAL_15(MINUS_SHIFT(n) + (*sample++) + 1);
-				*f0++ = REAL_MUL_SCALE_LAYER12(samp, fr->muls[n+1][*sca++]);
-				*f1++ = REAL_MUL_SCALE_LAYER12(samp, fr->muls[n+1][*sca++]);
-			}
-			else *f0++ = *f1++ = DOUBLE_TO_REAL(0.0);
+			smp[0][i] = getbits(fr, al->bits[0][i]);
+			smp[1][i] = getbits(fr, al->bits[1][i]);
 		}
-		for(i=fr->down_sample_sblimit;i<32;i++)
-		fraction[0][i] = fraction[1][i] = 0.0;
+		for(i=jsbound;i<SBLIMIT;i++)
+			smp[0][i] = smp[1][i] = getbits(fr, al->bits[0][i]);
+		I_dequant(f1, smp[1], al, 1, fr);
 	}
 	else
 	{
-		unsigned int needbits = 0;
-		register real *f0 = fraction[0];
-
-		ba = balloc;
-		for(sample=smpb,i=0;i<SBLIMIT;i++)
-			if((n = *ba++))
-				needbits += n+1;
-		NEED_BITS(fr, needbits);
-
-		ba = balloc;
-		for(sample=smpb,i=0;i<SBLIMIT;i++)
-		if ((n = *ba++))
-		*sample++ = getbits(fr, n+1);
-
-
-		ba = balloc;
-		for(sample=smpb,i=0;i<SBLIMIT;i++)
-		{
-			if((n=*ba++))
-			*f0++ = REAL_MUL_SCALE_LAYER12(DOUBLE_TO_REAL_15(MINUS_SHIFT(n) + (*sample++) + 1), fr->muls[n+1][*sca++]);
-			else *f0++ = DOUBLE_TO_REAL(0.0);
-		}
-		for(i=fr->down_sample_sblimit;i<32;i++)
-		fraction[0][i] = DOUBLE_TO_REAL(0.0);
+		for(i=0;i<SBLIMIT;i++)
+			smp[0][i] = getbits(fr, al->bits[0][i]);
 	}
+	I_dequant(f0, smp[0], al, 0, fr);
 	return 0;
 }
 
 int do_layer1(mpg123_handle *fr)
 {
 	int clip=0;
-	int i,stereo = fr->stereo;
+	int i,j,stereo = fr->stereo;
 	unsigned int balloc[2*SBLIMIT];
 	unsigned int scale_index[2][SBLIMIT];
-	real (*fraction)[SBLIMIT] = fr->layer1.fraction; /* fraction[2][SBLIMIT] */
+	struct I_alloc al;
+	/* fraction[2][SCALE_BLOCK][SBLIMIT], all groups for one synth call */
+	real (*fraction)[SCALE_BLOCK][SBLIMIT] = fr->layer1.fraction;
 	int single = fr->single;
+	int mix = (stereo == 2 && single == SINGLE_MIX);
 
 	fr->jsbound = (fr->mode == MPG_MD_JOINT_STEREO) ? (fr->mode_ext<<2)+4 : 32;
 
-	if(stereo == 1 || single == SINGLE_MIX) /* I don't see mixing handled here */
+	/* Mixing happens on the subbands, into the left channel. */
+	if(stereo == 1 || single == SINGLE_MIX)
 	single = SINGLE_LEFT;
 
+	PROF_MARK(fr);
+	/* The checksum covers the bit allocation, concealed as silence. */
+	if(crc_mismatch( fr, stereo == 2
+	?	fr->jsbound*2*4 + (SBLIMIT-fr->jsbound)*4 : SBLIMIT*4 ))
+		return clip;
 	if(I_step_one(balloc,scale_index,fr))
 	{
 		if(NOQUIET)
 			error("Aborting layer I decoding after step one.");
 		return clip;
 	}
+	I_prepare(&al, balloc, (unsigned int *) scale_index, fr);
 
 	for(i=0;i<SCALE_BLOCK;i++)
 	{
-		if(I_step_two(fraction,balloc,scale_index,fr))
+		if(I_step_two(fraction[0][i], fraction[1][i], &al, fr))
 		{
 			if(NOQUIET)
 				error("Aborting layer I decoding after step two.");
-			return clip;
+			break;
 		}
-
-		if(single != SINGLE_STEREO)
-		clip += (fr->synth_mono)(fraction[single], fr);
-		else
-		clip += (fr->synth_stereo)(fraction[0], fraction[1], fr);
 	}
+	PROF_LAP(fr, prof_dequant);
+	/* Synthesize what has been decoded, also before an error. */
+	if(mix)
+		do_mono_mix(fraction[0][0], fraction[1][0], i);
+	if(single != SINGLE_STEREO)
+		frame_coeff_notify(fr, MPG123_COEFF_SUBBAND, 0, fraction[single][0], i*SBLIMIT);
+	else for(j=0; j<2; ++j)
+		frame_coeff_notify(fr, MPG123_COEFF_SUBBAND, j, fraction[j][0], i*SBLIMIT);
+	/* Only the coefficients wanted, the synth buffer offset moves on. */
+	if(fr->coeff_flags & MPG123_COEFF_NO_SYNTH)
+	{
+		fr->bo = (fr->bo - i) & 0xf;
+		return clip;
+	}
+	if(fr->have_gain)
+		do_gain( fr, fraction[single == SINGLE_STEREO ? 0 : single][0]
+		,	single == SINGLE_STEREO ? fraction[1][0] : NULL, i );
+	if(single != SINGLE_STEREO)
+	{
+		for(j=0;j<i;j++)
+			clip += (fr->synth_mono)(fraction[single][j], fr);
+	}
+	else if(i)
+		clip += SYNTH_STEREO_BLOCK(fr)(fraction[0][0], fraction[1][0], i, fr);
+	PROF_LAP(fr, prof_synth);
 
 	return clip;
 }
@@ -15,6 +15,7 @@
 #include "l2tables.h"
 #endif
 #include "getbits.h"
+#include "crc.h"
 
 #ifndef NO_LAYER12 /* Stuff  needed for layer I and II. */
 
@@ -181,6 +182,9 @@ static int II_step_one(unsigned int *bit_alloc,int *scale,mpg123_handle *fr)
 		for(i=sblimit;i;i--)
 		if(*bita++) *scfsi++ = (char) getbits_fast(fr, 2);
 	}
+	/* The checksum covers bit allocation and scale factor selection. */
+	if(crc_mismatch(fr, crc_bits_read(fr)))
+		return 1;
 
 	needbits = 0;
 	bita = bit_alloc;
@@ -227,6 +231,53 @@ static int II_step_one(unsigned int *bit_alloc,int *scale,mpg123_handle *fr)
 }
 
 
+/* Grouped codes by number of levels, each giving three indices into fr->muls. */
+static const int *const grp_table[10] =
+	{ 0,0,0,grp_3tab,0,grp_5tab,0,0,0,grp_9tab };
+
+/*
+	The three samples of an ungrouped allocation (up to 16 bits each) are
+	next to each other in the stream. With 64 bit registers, get them from
+	one fetch of seven bytes instead of three getbits() calls. That may look
+	at a few bytes past the frame body, which both bsspace and the in-place
+	bodies (BODY_SAFETY in readers.c) have room for.
+*/
+#if (defined SIZEOF_SIZE_T) && (SIZEOF_SIZE_T >= 8)
+static void II_get_three(mpg123_handle *fr, int k, int *v)
+{
+	uint64_t bits = 0;
+	int i;
+
+	fr->bits_avail -= 3*k;
+	if(fr->bits_avail < 0)
+	{
+		if(NOQUIET)
+			error2( "Tried to read %i bits with %li available."
+			,	3*k, fr->bits_avail+3*k );
+		v[0] = v[1] = v[2] = 0;
+		return;
+	}
+	for(i=0; i<7; ++i)
+		bits = bits<<8 | fr->wordpointer[i];
+	bits <<= 8+fr->bitindex;
+	v[0] = (int)(bits>>(64-k));
+	bits <<= k;
+	v[1] = (int)(bits>>(64-k));
+	bits <<= k;
+	v[2] = (int)(bits>>(64-k));
+	fr->bitindex += 3*k;
+	fr->wordpointer += fr->bitindex>>3;
+	fr->bitindex &= 7;
+}
+#else
+static void II_get_three(mpg123_handle *fr, int k, int *v)
+{
+	v[0] = (int)getbits(fr, k);
+	v[1] = (int)getbits(fr, k);
+	v[2] = (int)getbits(fr, k);
+}
+#endif
+
 static void II_step_two(unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int *scale,mpg123_handle *fr,int x1)
 {
 	int i,j,k,ba;
@@ -248,16 +299,17 @@ static void II_step_two(unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int
 				if( (d1=alloc2->d) < 0) 
 				{
 					real cm=fr->muls[k][scale[x1]];
-					fraction[j][0][i] = REAL_MUL_SCALE_LAYER12(DOUBLE_TO_REAL_15((int)getbits(fr, k) + d1), cm);
-					fraction[j][1][i] = REAL_MUL_SCALE_LAYER12(DOUBLE_TO_REAL_15((int)getbits(fr, k) + d1), cm);
-					fraction[j][2][i] = REAL_MUL_SCALE_LAYER12(DOUBLE_TO_REAL_15((int)getbits(fr, k) + d1), cm);
+					int v[3];
+					II_get_three(fr, k, v);
+					fraction[j][0][i] = REAL_MUL_SCALE_LAYER12(DOUBLE_TO_REAL_15(v[0] + d1), cm);
+					fraction[j][1][i] = REAL_MUL_SCALE_LAYER12(DOUBLE_TO_REAL_15(v[1] + d1), cm);
+					fraction[j][2][i] = REAL_MUL_SCALE_LAYER12(DOUBLE_TO_REAL_15(v[2] + d1), cm);
 				}        
 				else 
 				{
-					const int *table[] = { 0,0,0,grp_3tab,0,grp_5tab,0,0,0,grp_9tab };
 					unsigned int idx,*tab,m=scale[x1];
 					idx = (unsigned int) getbits(fr, k);
-					tab = (unsigned int *) (table[d1] + idx + idx + idx);
+					tab = (unsigned int *) (grp_table[d1] + idx + idx + idx);
 					fraction[j][0][i] = REAL_SCALE_LAYER12(fr->muls[*tab++][m]);
 					fraction[j][1][i] = REAL_SCALE_LAYER12(fr->muls[*tab++][m]);
 					fraction[j][2][i] = REAL_SCALE_LAYER12(fr->muls[*tab][m]);  
@@ -281,10 +333,12 @@ static void II_step_two(unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int
 			if( (d1=alloc2->d) < 0)
 			{
 				real cm;
+				int v[3];
+				II_get_three(fr, k, v);
 				cm=fr->muls[k][scale[x1+3]];
-				fraction[0][0][i] = DOUBLE_TO_REAL_15((int)getbits(fr, k) + d1);
-				fraction[0][1][i] = DOUBLE_TO_REAL_15((int)getbits(fr, k) + d1);
-				fraction[0][2][i] = DOUBLE_TO_REAL_15((int)getbits(fr, k) + d1);
+				fraction[0][0][i] = DOUBLE_TO_REAL_15(v[0] + d1);
+				fraction[0][1][i] = DOUBLE_TO_REAL_15(v[1] + d1);
+				fraction[0][2][i] = DOUBLE_TO_REAL_15(v[2] + d1);
 				fraction[1][0][i] = REAL_MUL_SCALE_LAYER12(fraction[0][0][i], cm);
 				fraction[1][1][i] = REAL_MUL_SCALE_LAYER12(fraction[0][1][i], cm);
 				fraction[1][2][i] = REAL_MUL_SCALE_LAYER12(fraction[0][2][i], cm);
@@ -295,11 +349,10 @@ static void II_step_two(unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int
 			}
 			else
 			{
-				const int *table[] = { 0,0,0,grp_3tab,0,grp_5tab,0,0,0,grp_9tab };
 				unsigned int idx,*tab,m1,m2;
 				m1 = scale[x1]; m2 = scale[x1+3];
 				idx = (unsigned int) getbits(fr, k);
-				tab = (unsigned int *) (table[d1] + idx + idx + idx);
+				tab = (unsigned int *) (grp_table[d1] + idx + idx + idx);
 				fraction[0][0][i] = REAL_SCALE_LAYER12(fr->muls[*tab][m1]); fraction[1][0][i] = REAL_SCALE_LAYER12(fr->muls[*tab++][m2]);
 				fraction[0][1][i] = REAL_SCALE_LAYER12(fr->muls[*tab][m1]); fraction[1][1][i] = REAL_SCALE_LAYER12(fr->muls[*tab++][m2]);
 				fraction[0][2][i] = REAL_SCALE_LAYER12(fr->muls[*tab][m1]); fraction[1][2][i] = REAL_SCALE_LAYER12(fr->muls[*tab][m2]);
@@ -377,6 +430,7 @@ int do_layer2(mpg123_handle *fr)
 	unsigned int bit_alloc[64];
 	int scale[192];
 	int single = fr->single;
+	int mix = (stereo == 2 && single == SINGLE_MIX);
 
 	II_select_table(fr);
 	fr->jsbound = (fr->mode == MPG_MD_JOINT_STEREO) ? (fr->mode_ext<<2)+4 : fr->II_sblimit;
@@ -387,13 +441,15 @@ int do_layer2(mpg123_handle *fr)
 		fr->jsbound=fr->II_sblimit;
 	}
 
-	/* TODO: What happens with mono mixing, actually? */
-	if(stereo == 1 || single == SINGLE_MIX) /* also, mix not really handled */
+	/* Mixing happens on the subbands, into the left channel. */
+	if(stereo == 1 || single == SINGLE_MIX)
 	single = SINGLE_LEFT;
 
-	if(II_step_one(bit_alloc, scale, fr))
+	PROF_MARK(fr);
+	/* Positive for a frame to conceal after a failed CRC check. */
+	if((i=II_step_one(bit_alloc, scale, fr)))
 	{
-		if(NOQUIET)
+		if(i < 0 && NOQUIET)
 			error("first step of layer I decoding failed");
 		return clip;
 	}
@@ -407,13 +463,30 @@ int do_layer2(mpg123_handle *fr)
 				error("missing bits in layer II step two");
 			return clip;
 		}
-		for(j=0;j<3;j++) 
+		PROF_LAP(fr, prof_dequant);
+		if(mix)
+			do_mono_mix(fraction[0][0], fraction[1][0], 3);
+		if(single != SINGLE_STEREO)
+			frame_coeff_notify(fr, MPG123_COEFF_SUBBAND, 0, fraction[single][0], 3*SBLIMIT);
+		else for(j=0; j<2; ++j)
+			frame_coeff_notify(fr, MPG123_COEFF_SUBBAND, j, fraction[j][0], 3*SBLIMIT);
+		/* Only the coefficients wanted, the synth buffer offset moves on. */
+		if(fr->coeff_flags & MPG123_COEFF_NO_SYNTH)
+		{
+			fr->bo = (fr->bo - 3) & 0xf;
+			continue;
+		}
+		if(fr->have_gain)
+			do_gain( fr, fraction[single == SINGLE_STEREO ? 0 : single][0]
+			,	single == SINGLE_STEREO ? fraction[1][0] : NULL, 3 );
+		if(single != SINGLE_STEREO)
 		{
-			if(single != SINGLE_STEREO)
+			for(j=0;j<3;j++) 
 			clip += (fr->synth_mono)(fraction[single][j], fr);
-			else
-			clip += (fr->synth_stereo)(fraction[0][j], fraction[1][j], fr);
 		}
+		else
+		clip += SYNTH_STEREO_BLOCK(fr)(fraction[0][0], fraction[1][0], 3, fr);
+		PROF_LAP(fr, prof_synth);
 	}
 
 	return clip;
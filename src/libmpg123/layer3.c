@@ -15,12 +15,16 @@
 */
 
 #include "mpg123lib_intern.h"
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
 #ifdef USE_NEW_HUFFTABLE
 #include "newhuffman.h"
 #else
 #include "huffman.h"
 #endif
 #include "getbits.h"
+#include "crc.h"
 #include "debug.h"
 
 
@@ -33,23 +37,44 @@
 #ifdef REAL_IS_FIXED
 #define NEW_DCT9
 #include "l3_integer_tables.h"
+#define POW43_SIZE 8207
+#define POW43(v) ispow[v]
 #else
 /* static one-time calculated tables... or so */
-static real ispow[8207];
+/* Only the escape codes (15 plus up to 13 linbits) reach beyond the first
+   16 entries of x^(4/3) and large values are rare, so the table covers the
+   common range in 4K (float) and the rest is computed with the same
+   expression, which gives identical results. The full table of 8207 values
+   only served to push the other hot tables out of the data cache. */
+#define POW43_SIZE 1024
+#define POW43(v) ((v) < POW43_SIZE ? ispow[v] \
+	: DOUBLE_TO_REAL_POW43(pow((double)(v),(double)4.0/3.0)))
+#define NEW_DCT9
+#ifdef BUILD_TABLES
+/* Computed at build time by calctables, read-only except for the windows. */
+#define TABLES_LAYER3
+#include "build_tables.h"
+#else
+static ALIGNED(64) real ispow[POW43_SIZE];
 static real aa_ca[8],aa_cs[8];
 static ALIGNED(16) real win[4][36];
 static ALIGNED(16) real win1[4][36];
 real COS9[9]; /* dct36_3dnow wants to use that */
-static real COS6_1,COS6_2;
+real COS6_1,COS6_2; /* dct36_quad_vector wants that, too */
 real tfcos36[9]; /* dct36_3dnow wants to use that */
 static real tfcos12[3];
-#define NEW_DCT9
 #ifdef NEW_DCT9
-static real cos9[3],cos18[3];
+real cos9[3],cos18[3]; /* dct36_quad_vector again */
 static real tan1_1[16],tan2_1[16],tan1_2[16],tan2_2[16];
 static real pow1_1[2][32],pow2_1[2][32],pow1_2[2][32],pow2_2[2][32];
 #endif
 #endif
+#endif
+
+#if !defined(BUILD_TABLES) && (!defined(REAL_IS_FIXED) || !defined(PRECALC_TABLES))
+#define TABLES_LAYER3
+#include "tables_impl.h"
+#endif
 
 /* Decoder state data, living on the stack of do_layer3. */
 
@@ -159,6 +184,16 @@ static int *mapend[9][3];
 static unsigned int n_slen2[512]; /* MPEG 2.0 slen for 'normal' mode */
 static unsigned int i_slen2[256]; /* MPEG 2.0 slen for intensity stereo */
 
+#ifdef USE_NEW_HUFFTABLE
+/* First level lookup of 8 bits for the big_values codes (continuing in the
+   radix-4 tables for longer ones) and of all 6 bits for the count1 codes,
+   built from the tables in newhuffman.h. */
+#define HUFF_FAST_BITS 8
+static short huff_fast[16][1<<HUFF_FAST_BITS];
+static const short *ht_fast[32];
+static unsigned char htc_fast[2][64];
+#endif
+
 /* Some helpers used in init_layer3 */
 
 #ifdef OPT_MMXORSSE
@@ -179,93 +214,73 @@ real init_layer3_gainpow2(mpg123_handle *fr, int i)
 }
 
 
-/* init tables for layer-3 ... specific with the downsampling... */
-void init_layer3(void)
+#ifdef USE_NEW_HUFFTABLE
+static void init_huffman_fast(void)
 {
-	int i,j,k,l;
-
-#if !defined(REAL_IS_FIXED) || !defined(PRECALC_TABLES)
-	for(i=0;i<8207;i++)
-	ispow[i] = DOUBLE_TO_REAL_POW43(pow((double)i,(double)4.0/3.0));
+	int i, t, n = 0;
 
-	for(i=0;i<8;i++)
+	for(t=0; t<32; ++t)
 	{
-		const double Ci[8] = {-0.6,-0.535,-0.33,-0.185,-0.095,-0.041,-0.0142,-0.0037};
-		double sq = sqrt(1.0+Ci[i]*Ci[i]);
-		aa_cs[i] = DOUBLE_TO_REAL(1.0/sq);
-		aa_ca[i] = DOUBLE_TO_REAL(Ci[i]/sq);
-	}
-
-	for(i=0;i<18;i++)
-	{
-		win[0][i]    = win[1][i]    =
-			DOUBLE_TO_REAL( 0.5*sin(M_PI/72.0 * (double)(2*(i+0) +1)) / cos(M_PI * (double)(2*(i+0) +19) / 72.0) );
-		win[0][i+18] = win[3][i+18] =
-			DOUBLE_TO_REAL( 0.5*sin(M_PI/72.0 * (double)(2*(i+18)+1)) / cos(M_PI * (double)(2*(i+18)+19) / 72.0) );
+		int prev;
+		/* Some tables are shared with differing linbits. */
+		for(prev=0; prev<t; ++prev)
+			if(ht[prev].table == ht[t].table)
+				break;
+		if(prev < t)
+		{
+			ht_fast[t] = ht_fast[prev];
+			continue;
+		}
+		for(i=0; i<(1<<HUFF_FAST_BITS); ++i)
+		{
+			/* Same walk as in III_dequantize_sample(), limited to two steps. */
+			const short *val = ht[t].table;
+			short y = val[i>>4];
+			if(y < 0)
+			{
+				val -= y;
+				y = val[i&0xf];
+				if(y < 0) /* Negative index of the table to continue with. */
+					y = -(short)(val - y - ht[t].table);
+				else
+					y += 4<<8;
+			}
+			huff_fast[n][i] = y;
+		}
+		ht_fast[t] = huff_fast[n++];
 	}
-	for(i=0;i<6;i++)
+	for(t=0; t<2; ++t)
+	for(i=0; i<64; ++i)
 	{
-		win[1][i+18] = DOUBLE_TO_REAL(0.5 / cos ( M_PI * (double) (2*(i+18)+19) / 72.0 ));
-		win[3][i+12] = DOUBLE_TO_REAL(0.5 / cos ( M_PI * (double) (2*(i+12)+19) / 72.0 ));
-		win[1][i+24] = DOUBLE_TO_REAL(0.5 * sin( M_PI / 24.0 * (double) (2*i+13) ) / cos ( M_PI * (double) (2*(i+24)+19) / 72.0 ));
-		win[1][i+30] = win[3][i] = DOUBLE_TO_REAL(0.0);
-		win[3][i+6 ] = DOUBLE_TO_REAL(0.5 * sin( M_PI / 24.0 * (double) (2*i+1 ) ) / cos ( M_PI * (double) (2*(i+6 )+19) / 72.0 ));
-	}
-
-	for(i=0;i<9;i++)
-	COS9[i] = DOUBLE_TO_REAL(cos( M_PI / 18.0 * (double) i));
-
-	for(i=0;i<9;i++)
-	tfcos36[i] = DOUBLE_TO_REAL(0.5 / cos ( M_PI * (double) (i*2+1) / 36.0 ));
-
-	for(i=0;i<3;i++)
-	tfcos12[i] = DOUBLE_TO_REAL(0.5 / cos ( M_PI * (double) (i*2+1) / 12.0 ));
-
-	COS6_1 = DOUBLE_TO_REAL(cos( M_PI / 6.0 * (double) 1));
-	COS6_2 = DOUBLE_TO_REAL(cos( M_PI / 6.0 * (double) 2));
+		const short *val = htc[t].table;
+		short a;
+		int bit = 5;
+		while((a=*val++)<0)
+		{
+			if((i>>bit) & 1) val -= a;
 
-#ifdef NEW_DCT9
-	cos9[0]  = DOUBLE_TO_REAL(cos(1.0*M_PI/9.0));
-	cos9[1]  = DOUBLE_TO_REAL(cos(5.0*M_PI/9.0));
-	cos9[2]  = DOUBLE_TO_REAL(cos(7.0*M_PI/9.0));
-	cos18[0] = DOUBLE_TO_REAL(cos(1.0*M_PI/18.0));
-	cos18[1] = DOUBLE_TO_REAL(cos(11.0*M_PI/18.0));
-	cos18[2] = DOUBLE_TO_REAL(cos(13.0*M_PI/18.0));
+			--bit;
+		}
+		/* code length and the four value bits */
+		htc_fast[t][i] = ((5-bit)<<4) | a;
+	}
+}
 #endif
 
-	for(i=0;i<12;i++)
-	{
-		win[2][i] = DOUBLE_TO_REAL(0.5 * sin( M_PI / 24.0 * (double) (2*i+1) ) / cos ( M_PI * (double) (2*i+7) / 24.0 ));
-	}
+/* init tables for layer-3 ... specific with the downsampling... */
+void init_layer3(void)
+{
+	int i,j,k,l;
 
-	for(i=0;i<16;i++)
-	{
-		double t = tan( (double) i * M_PI / 12.0 );
-		tan1_1[i] = DOUBLE_TO_REAL_15(t / (1.0+t));
-		tan2_1[i] = DOUBLE_TO_REAL_15(1.0 / (1.0 + t));
-		tan1_2[i] = DOUBLE_TO_REAL_15(M_SQRT2 * t / (1.0+t));
-		tan2_2[i] = DOUBLE_TO_REAL_15(M_SQRT2 / (1.0 + t));
-	}
+#ifdef USE_NEW_HUFFTABLE
+	init_huffman_fast();
+#endif
 
-	for(i=0;i<32;i++)
-	{
-		for(j=0;j<2;j++)
-		{
-			double base = pow(2.0,-0.25*(j+1.0));
-			double p1=1.0,p2=1.0;
-			if(i > 0)
-			{
-				if( i & 1 ) p1 = pow(base,(i+1.0)*0.5);
-				else p2 = pow(base,i*0.5);
-			}
-			pow1_1[j][i] = DOUBLE_TO_REAL_15(p1);
-			pow2_1[j][i] = DOUBLE_TO_REAL_15(p2);
-			pow1_2[j][i] = DOUBLE_TO_REAL_15(M_SQRT2 * p1);
-			pow2_2[j][i] = DOUBLE_TO_REAL_15(M_SQRT2 * p2);
-		}
-	}
+#if !defined(BUILD_TABLES) && (!defined(REAL_IS_FIXED) || !defined(PRECALC_TABLES))
+	calc_layer3_tables();
 #endif
 
+#ifndef BUILD_TABLES
 	for(j=0;j<4;j++)
 	{
 		const int len[4] = { 36,36,12,36 };
@@ -273,6 +288,7 @@ void init_layer3(void)
 
 		for(i=1;i<len[j];i+=2) win1[j][i] = - win[j][i];
 	}
+#endif
 
 	for(j=0;j<9;j++)
 	{
@@ -402,9 +418,21 @@ void init_layer3_stuff(mpg123_handle *fr, real (*gainpow2)(mpg123_handle *fr, in
 */
 
 /* read additional side information (for MPEG 1 and MPEG 2) */
+/* Keep track of the available data bytes for the bit reservoir.
+   CRC is included in ssize already. */
+static void III_reservoir_add(mpg123_handle *fr)
+{
+	fr->bitreservoir = fr->bitreservoir + fr->framesize - fr->ssize;
+
+	/* Limit the reservoir to the max for MPEG 1.0 or 2.x . */
+	if(fr->bitreservoir > (unsigned int) (fr->lsf == 0 ? 511 : 255))
+	fr->bitreservoir = (fr->lsf == 0 ? 511 : 255);
+}
+
 static int III_get_side_info(mpg123_handle *fr, struct III_sideinfo *si,int stereo, int ms_stereo,long sfreq,int single)
 {
 	int ch, gr;
+	struct bitcache bc;
 	int powdiff = (single == SINGLE_MIX) ? 4 : 0;
 
 	const int tabs[2][5] = { { 2,9,5,3,4 } , { 1,8,1,2,9 } };
@@ -450,25 +478,20 @@ static int III_get_side_info(mpg123_handle *fr, struct III_sideinfo *si,int ster
 		si->main_data_begin = getbits(fr, tab[1]);
 	}
 
-	/* Keep track of the available data bytes for the bit reservoir.
-	   CRC is included in ssize already. */
-	fr->bitreservoir = fr->bitreservoir + fr->framesize - fr->ssize;
-
-	/* Limit the reservoir to the max for MPEG 1.0 or 2.x . */
-	if(fr->bitreservoir > (unsigned int) (fr->lsf == 0 ? 511 : 255))
-	fr->bitreservoir = (fr->lsf == 0 ? 511 : 255);
+	III_reservoir_add(fr);
 
 	/* Now back into less commented territory. It's code. It works. */
 
+	bitcache_start(fr, &bc);
 	if (stereo == 1)
-	si->private_bits = getbits(fr, tab[2]);
+	si->private_bits = bitcache_get(fr, &bc, tab[2]);
 	else 
-	si->private_bits = getbits(fr, tab[3]);
+	si->private_bits = bitcache_get(fr, &bc, tab[3]);
 
 	if(!fr->lsf) for(ch=0; ch<stereo; ch++)
 	{
 		si->ch[ch].gr[0].scfsi = -1;
-		si->ch[ch].gr[1].scfsi = getbits(fr, 4);
+		si->ch[ch].gr[1].scfsi = bitcache_get(fr, &bc, 4);
 	}
 
 	for (gr=0; gr<tab[0]; gr++)
@@ -476,14 +499,14 @@ static int III_get_side_info(mpg123_handle *fr, struct III_sideinfo *si,int ster
 	{
 		register struct gr_info_s *gr_info = &(si->ch[ch].gr[gr]);
 		unsigned int qss;
-		gr_info->part2_3_length = getbits(fr, 12);
-		gr_info->big_values = getbits(fr, 9);
+		gr_info->part2_3_length = bitcache_get(fr, &bc, 12);
+		gr_info->big_values = bitcache_get(fr, &bc, 9);
 		if(gr_info->big_values > 288)
 		{
 			if(NOQUIET) error("big_values too large!");
 			gr_info->big_values = 288;
 		}
-		qss = getbits_fast(fr, 8);
+		qss = bitcache_get(fr, &bc, 8);
 		gr_info->pow2gain = fr->gainpow2+256 - qss + powdiff;
 		if(ms_stereo)
 			gr_info->pow2gain += 2;
@@ -491,7 +514,7 @@ static int III_get_side_info(mpg123_handle *fr, struct III_sideinfo *si,int ster
 		if(fr->pinfo)
 			fr->pinfo->qss[gr][ch] = qss;
 #endif
-		gr_info->scalefac_compress = getbits(fr, tab[4]);
+		gr_info->scalefac_compress = bitcache_get(fr, &bc, tab[4]);
 		if(gr_info->part2_3_length == 0)
 		{
 			if(gr_info->scalefac_compress > 0 && VERBOSE2)
@@ -501,13 +524,13 @@ static int III_get_side_info(mpg123_handle *fr, struct III_sideinfo *si,int ster
 		}
 
 		/* 22 bits for if/else block */
-		if(getbits(fr,1))
+		if(bitcache_get(fr, &bc, 1))
 		{ /* window switch flag  */
 			int i;
-			gr_info->block_type       = getbits_fast(fr, 2);
-			gr_info->mixed_block_flag = get1bit(fr);
-			gr_info->table_select[0]  = getbits_fast(fr, 5);
-			gr_info->table_select[1]  = getbits_fast(fr, 5);
+			gr_info->block_type       = bitcache_get(fr, &bc, 2);
+			gr_info->mixed_block_flag = bitcache_get(fr, &bc, 1);
+			gr_info->table_select[0]  = bitcache_get(fr, &bc, 5);
+			gr_info->table_select[1]  = bitcache_get(fr, &bc, 5);
 			/*
 				table_select[2] not needed, because there is no region2,
 				but to satisfy some verification tools we set it either.
@@ -515,7 +538,7 @@ static int III_get_side_info(mpg123_handle *fr, struct III_sideinfo *si,int ster
 			gr_info->table_select[2] = 0;
 			for(i=0;i<3;i++)
 			{
-				unsigned int sbg = (getbits_fast(fr, 3)<<3);
+				unsigned int sbg = (bitcache_get(fr, &bc, 3)<<3);
 				gr_info->full_gain[i] = gr_info->pow2gain + sbg;
 #ifndef NO_MOREINFO
 				if(fr->pinfo)
@@ -526,6 +549,7 @@ static int III_get_side_info(mpg123_handle *fr, struct III_sideinfo *si,int ster
 			if(gr_info->block_type == 0)
 			{
 				if(NOQUIET) error("Blocktype == 0 and window-switching == 1 not allowed.");
+				bitcache_end(fr, &bc);
 				return 1;
 			}
 
@@ -559,10 +583,10 @@ static int III_get_side_info(mpg123_handle *fr, struct III_sideinfo *si,int ster
 		{
 			int i,r0c,r1c;
 			for (i=0; i<3; i++)
-			gr_info->table_select[i] = getbits_fast(fr, 5);
+			gr_info->table_select[i] = bitcache_get(fr, &bc, 5);
 
-			r0c = getbits_fast(fr, 4); /* 0 .. 15 */
-			r1c = getbits_fast(fr, 3); /* 0 .. 7 */
+			r0c = bitcache_get(fr, &bc, 4); /* 0 .. 15 */
+			r1c = bitcache_get(fr, &bc, 3); /* 0 .. 7 */
 			gr_info->region1start = bandInfo[sfreq].longIdx[r0c+1] >> 1 ;
 
 			/* max(r0c+r1c+2) = 15+7+2 = 24 */
@@ -572,11 +596,12 @@ static int III_get_side_info(mpg123_handle *fr, struct III_sideinfo *si,int ster
 			gr_info->block_type = 0;
 			gr_info->mixed_block_flag = 0;
 		}
-		if(!fr->lsf) gr_info->preflag = get1bit(fr);
+		if(!fr->lsf) gr_info->preflag = bitcache_get(fr, &bc, 1);
 
-		gr_info->scalefac_scale = get1bit(fr);
-		gr_info->count1table_select = get1bit(fr);
+		gr_info->scalefac_scale = bitcache_get(fr, &bc, 1);
+		gr_info->count1table_select = bitcache_get(fr, &bc, 1);
 	}
+	bitcache_end(fr, &bc);
 	return 0;
 }
 
@@ -592,6 +617,7 @@ static int III_get_scale_factors_1(mpg123_handle *fr, int *scf,struct gr_info_s
 	int numbits;
 	int num0 = slen[0][gr_info->scalefac_compress];
 	int num1 = slen[1][gr_info->scalefac_compress];
+	struct bitcache bc;
 
 	if(gr_info->part2_3_length == 0)
 	{
@@ -609,17 +635,18 @@ static int III_get_scale_factors_1(mpg123_handle *fr, int *scf,struct gr_info_s
 		if(numbits > gr_info->part2_3_length)
 			return -1;
 
+		bitcache_start(fr, &bc);
 		if(gr_info->mixed_block_flag)
 		{
 			for (i=8;i;i--)
-			*scf++ = getbits_fast(fr, num0);
+			*scf++ = bitcache_get(fr, &bc, num0);
 
 			i = 9;
 		}
 
-		for(;i;i--) *scf++ = getbits_fast(fr, num0);
+		for(;i;i--) *scf++ = bitcache_get(fr, &bc, num0);
 
-		for(i = 18; i; i--) *scf++ = getbits_fast(fr, num1);
+		for(i = 18; i; i--) *scf++ = bitcache_get(fr, &bc, num1);
 
 		*scf++ = 0; *scf++ = 0; *scf++ = 0; /* short[13][0..2] = 0 */
 	}
@@ -634,9 +661,10 @@ static int III_get_scale_factors_1(mpg123_handle *fr, int *scf,struct gr_info_s
 			if(numbits > gr_info->part2_3_length)
 				return -1;
 
-			for(i=11;i;i--) *scf++ = getbits_fast(fr, num0);
+			bitcache_start(fr, &bc);
+			for(i=11;i;i--) *scf++ = bitcache_get(fr, &bc, num0);
 
-			for(i=10;i;i--) *scf++ = getbits_fast(fr, num1);
+			for(i=10;i;i--) *scf++ = bitcache_get(fr, &bc, num1);
 
 			*scf++ = 0;
 		}
@@ -649,27 +677,28 @@ static int III_get_scale_factors_1(mpg123_handle *fr, int *scf,struct gr_info_s
 			if(numbits > gr_info->part2_3_length)
 				return -1;
 
+			bitcache_start(fr, &bc);
 			if(!(scfsi & 0x8))
 			{
-				for (i=0;i<6;i++) *scf++ = getbits_fast(fr, num0);
+				for (i=0;i<6;i++) *scf++ = bitcache_get(fr, &bc, num0);
 			}
 			else scf += 6; 
 
 			if(!(scfsi & 0x4))
 			{
-				for (i=0;i<5;i++) *scf++ = getbits_fast(fr, num0);
+				for (i=0;i<5;i++) *scf++ = bitcache_get(fr, &bc, num0);
 			}
 			else scf += 5;
 
 			if(!(scfsi & 0x2))
 			{
-				for(i=0;i<5;i++) *scf++ = getbits_fast(fr, num1);
+				for(i=0;i<5;i++) *scf++ = bitcache_get(fr, &bc, num1);
 			}
 			else scf += 5;
 
 			if(!(scfsi & 0x1))
 			{
-				for (i=0;i<5;i++) *scf++ = getbits_fast(fr, num1);
+				for (i=0;i<5;i++) *scf++ = bitcache_get(fr, &bc, num1);
 			}
 			else scf += 5;
 
@@ -677,6 +706,7 @@ static int III_get_scale_factors_1(mpg123_handle *fr, int *scf,struct gr_info_s
 		}
 	}
 
+	bitcache_end(fr, &bc);
 	return numbits;
 }
 
@@ -686,6 +716,7 @@ static int III_get_scale_factors_2(mpg123_handle *fr, int *scf,struct gr_info_s
 	const unsigned char *pnt;
 	int i,j,n=0,numbits=0;
 	unsigned int slen, slen2;
+	struct bitcache bc;
 
 	const unsigned char stab[3][6][4] =
 	{
@@ -737,13 +768,14 @@ static int III_get_scale_factors_2(mpg123_handle *fr, int *scf,struct gr_info_s
 	if(numbits > gr_info->part2_3_length)
 		return -1;
 
+	bitcache_start(fr, &bc);
 	for(i=0;i<4;i++)
 	{
 		int num = slen & 0x7;
 		slen >>= 3;
 		if(num)
 		{
-			for(j=0;j<(int)(pnt[i]);j++) *scf++ = getbits_fast(fr, num);
+			for(j=0;j<(int)(pnt[i]);j++) *scf++ = bitcache_get(fr, &bc, num);
 		}
 		else
 		for(j=0;j<(int)(pnt[i]);j++) *scf++ = 0;
@@ -752,6 +784,7 @@ static int III_get_scale_factors_2(mpg123_handle *fr, int *scf,struct gr_info_s
 	n = (n << 1) + 1;
 	for(i=0;i<n;i++) *scf++ = 0;
 
+	bitcache_end(fr, &bc);
 	return numbits;
 }
 
@@ -777,22 +810,62 @@ static unsigned char pretab_choice[2][22] =
 #define MASK_UTYPE unsigned long
 #define MASK_TYPE MASK_STYPE
 #define MSB_MASK (mask < 0)
+#define MASK_MIN BITSHIFT
 #else
 /* This should be more proper: */
+#if (defined SIZEOF_SIZE_T) && (SIZEOF_SIZE_T >= 8)
+/* With 64 bit registers, refill only below 48 bits. That still covers
+   a whole pair of big values including linbits and sign bits (19+2*14). */
+#define MASK_STYPE int64_t
+#define MASK_UTYPE uint64_t
+#define MASK_PAIR
+#define MASK_MIN 48
+#else
 #define MASK_STYPE int32_t
 #define MASK_UTYPE uint32_t
+#define MASK_MIN BITSHIFT
+#endif
 #define MASK_TYPE  MASK_UTYPE
 #define MSB_MASK ((MASK_UTYPE)mask & (MASK_UTYPE)1<<(sizeof(MASK_TYPE)*8-1))
 #endif
 #define BITSHIFT ((sizeof(MASK_TYPE)-1)*8)
+/* Fill up with whole bytes. If the buffer is not about to run out, read
+   a full mask worth at once and keep only the bytes needed. */
 #define REFRESH_MASK \
-	while(num < BITSHIFT) { \
-		mask |= ((MASK_UTYPE)getbyte(fr))<<(BITSHIFT-num); \
-		num += 8; \
-		part2remain -= 8; }
+	if(num < MASK_MIN) \
+	{ \
+		if(fr->bits_avail >= (long)(8*sizeof(MASK_TYPE))) \
+		{ \
+			int bytes = (BITSHIFT-num+7)>>3; \
+			mask |= getmask(fr->wordpointer, bytes)>>num; \
+			fr->wordpointer += bytes; \
+			fr->bits_avail -= 8*bytes; \
+			num += 8*bytes; \
+			part2remain -= 8*bytes; \
+		} \
+		else while(num < BITSHIFT) { \
+			mask |= ((MASK_UTYPE)getbyte(fr))<<(BITSHIFT-num); \
+			num += 8; \
+			part2remain -= 8; } \
+	}
+/* Before reading linbits, unless the refresh for the pair did suffice. */
+#ifdef MASK_PAIR
+#define REFRESH_LINBITS
+#else
+#define REFRESH_LINBITS REFRESH_MASK
+#endif
 /* Complicated way of checking for msb value. This used to be (mask < 0). */
 
-static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],int *scf, struct gr_info_s *gr_info,int sfreq,int part2bits)
+/* The first bytes big-endian, the rest of the mask zero. The mask has
+   the size of the getbits.h cache word. */
+static inline MASK_UTYPE getmask(const unsigned char *wp, int bytes)
+{
+	return bitcache_load(wp) & ~(~(MASK_UTYPE)0 >> (8*bytes));
+}
+
+/* Long blocks stop decoding at sblimit subbands, skipping the rest of the
+   granule's bits. Lines above that are zero then. */
+static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],int *scf, struct gr_info_s *gr_info,int sfreq,int part2bits,int sblimit)
 {
 	int shift = 1 + gr_info->scalefac_scale;
 	real *xrpnt = (real *) xr;
@@ -883,6 +956,9 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 		{
 			int lp = l[i];
 			const struct newhuff *h = ht+gr_info->table_select[i];
+#ifdef USE_NEW_HUFFTABLE
+			const short *fast = ht_fast[gr_info->table_select[i]];
+#endif
 			for(;lp;lp--,mc--)
 			{
 				register MASK_STYPE x,y;
@@ -914,11 +990,18 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 					const short *val = h->table;
 					REFRESH_MASK;
 #ifdef USE_NEW_HUFFTABLE
-					while((y=val[(MASK_UTYPE)mask>>(BITSHIFT+4)])<0)
+					y = fast[(MASK_UTYPE)mask>>(BITSHIFT+8-HUFF_FAST_BITS)];
+					if(y < 0)
 					{
 						val -= y;
-						num -= 4;
-						mask <<= 4;
+						num -= HUFF_FAST_BITS;
+						mask <<= HUFF_FAST_BITS;
+						while((y=val[(MASK_UTYPE)mask>>(BITSHIFT+4)])<0)
+						{
+							val -= y;
+							num -= 4;
+							mask <<= 4;
+						}
 					}
 					num -= (y >> 8);
 					mask <<= (y >> 8);
@@ -940,12 +1023,12 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 				if(x == 15 && h->linbits)
 				{
 					max[lwin] = cb;
-					REFRESH_MASK;
+					REFRESH_LINBITS;
 					x += ((MASK_UTYPE) mask) >> (BITSHIFT+8-h->linbits);
 					num -= h->linbits+1;
 					mask <<= h->linbits;
-					if(MSB_MASK) *xrpnt = REAL_MUL_SCALE_LAYER3(-ispow[x], v, gainpow2_scale_idx);
-					else         *xrpnt = REAL_MUL_SCALE_LAYER3( ispow[x], v, gainpow2_scale_idx);
+					if(MSB_MASK) *xrpnt = REAL_MUL_SCALE_LAYER3(-POW43(x), v, gainpow2_scale_idx);
+					else         *xrpnt = REAL_MUL_SCALE_LAYER3( POW43(x), v, gainpow2_scale_idx);
 
 					mask <<= 1;
 				}
@@ -965,12 +1048,12 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 				if(y == 15 && h->linbits)
 				{
 					max[lwin] = cb;
-					REFRESH_MASK;
+					REFRESH_LINBITS;
 					y += ((MASK_UTYPE) mask) >> (BITSHIFT+8-h->linbits);
 					num -= h->linbits+1;
 					mask <<= h->linbits;
-					if(MSB_MASK) *xrpnt = REAL_MUL_SCALE_LAYER3(-ispow[y], v, gainpow2_scale_idx);
-					else         *xrpnt = REAL_MUL_SCALE_LAYER3( ispow[y], v, gainpow2_scale_idx);
+					if(MSB_MASK) *xrpnt = REAL_MUL_SCALE_LAYER3(-POW43(y), v, gainpow2_scale_idx);
+					else         *xrpnt = REAL_MUL_SCALE_LAYER3( POW43(y), v, gainpow2_scale_idx);
 
 					mask <<= 1;
 				}
@@ -991,21 +1074,31 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 
 		for(;l3 && (part2remain+num > 0);l3--)
 		{
-			const struct newhuff* h;
-			const short* val;
 			register short a;
 
-			h = htc+gr_info->count1table_select;
-			val = h->table;
-
 			REFRESH_MASK;
-			while((a=*val++)<0)
+#ifdef USE_NEW_HUFFTABLE
+			a = htc_fast[gr_info->count1table_select][(MASK_UTYPE)mask>>(BITSHIFT+2)];
+			num -= a >> 4;
+			mask <<= a >> 4;
+			a &= 0xf;
+#else
 			{
-				if(MSB_MASK) val -= a;
+				const struct newhuff* h;
+				const short* val;
+
+				h = htc+gr_info->count1table_select;
+				val = h->table;
+
+				while((a=*val++)<0)
+				{
+					if(MSB_MASK) val -= a;
 
-				num--;
-				mask <<= 1;
+					num--;
+					mask <<= 1;
+				}
 			}
+#endif
 			if(part2remain+num <= 0)
 			{
 				num -= part2remain+num;
@@ -1104,16 +1197,23 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 		int *m = map[sfreq][2];
 		register real v = 0.0;
 		int mc = 0;
+		/* Without a cut, the pairs and quads never start at the end. */
+		real *cutpnt = xrpnt + SSLIMIT*sblimit;
 
 		/* long hash table values */
 		for(i=0;i<3;i++)
 		{
 			int lp = l[i];
 			const struct newhuff *h = ht+gr_info->table_select[i];
+#ifdef USE_NEW_HUFFTABLE
+			const short *fast = ht_fast[gr_info->table_select[i]];
+#endif
 
 			for(;lp;lp--,mc--)
 			{
 				MASK_STYPE x,y;
+				if(xrpnt >= cutpnt)
+					goto long_cut;
 				if(!mc)
 				{
 					mc = *m++;
@@ -1134,11 +1234,18 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 					const short *val = h->table;
 					REFRESH_MASK;
 #ifdef USE_NEW_HUFFTABLE
-					while((y=val[(MASK_UTYPE)mask>>(BITSHIFT+4)])<0)
+					y = fast[(MASK_UTYPE)mask>>(BITSHIFT+8-HUFF_FAST_BITS)];
+					if(y < 0)
 					{
 						val -= y;
-						num -= 4;
-						mask <<= 4;
+						num -= HUFF_FAST_BITS;
+						mask <<= HUFF_FAST_BITS;
+						while((y=val[(MASK_UTYPE)mask>>(BITSHIFT+4)])<0)
+						{
+							val -= y;
+							num -= 4;
+							mask <<= 4;
+						}
 					}
 					num -= (y >> 8);
 					mask <<= (y >> 8);
@@ -1161,12 +1268,12 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 				if(x == 15 && h->linbits)
 				{
 					max = cb;
-					REFRESH_MASK;
+					REFRESH_LINBITS;
 					x += ((MASK_UTYPE) mask) >> (BITSHIFT+8-h->linbits);
 					num -= h->linbits+1;
 					mask <<= h->linbits;
-					if(MSB_MASK) *xrpnt++ = REAL_MUL_SCALE_LAYER3(-ispow[x], v, gainpow2_scale_idx);
-					else         *xrpnt++ = REAL_MUL_SCALE_LAYER3( ispow[x], v, gainpow2_scale_idx);
+					if(MSB_MASK) *xrpnt++ = REAL_MUL_SCALE_LAYER3(-POW43(x), v, gainpow2_scale_idx);
+					else         *xrpnt++ = REAL_MUL_SCALE_LAYER3( POW43(x), v, gainpow2_scale_idx);
 
 					mask <<= 1;
 				}
@@ -1185,12 +1292,12 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 				if(y == 15 && h->linbits)
 				{
 					max = cb;
-					REFRESH_MASK;
+					REFRESH_LINBITS;
 					y += ((MASK_UTYPE) mask) >> (BITSHIFT+8-h->linbits);
 					num -= h->linbits+1;
 					mask <<= h->linbits;
-					if(MSB_MASK) *xrpnt++ = REAL_MUL_SCALE_LAYER3(-ispow[y], v, gainpow2_scale_idx);
-					else         *xrpnt++ = REAL_MUL_SCALE_LAYER3( ispow[y], v, gainpow2_scale_idx);
+					if(MSB_MASK) *xrpnt++ = REAL_MUL_SCALE_LAYER3(-POW43(y), v, gainpow2_scale_idx);
+					else         *xrpnt++ = REAL_MUL_SCALE_LAYER3( POW43(y), v, gainpow2_scale_idx);
 
 					mask <<= 1;
 				}
@@ -1210,18 +1317,30 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 		/* short (count1table) values */
 		for(;l3 && (part2remain+num > 0);l3--)
 		{
-			const struct newhuff *h = htc+gr_info->count1table_select;
-			const short *val = h->table;
 			register short a;
 
+			if(xrpnt >= cutpnt)
+				break;
 			REFRESH_MASK;
-			while((a=*val++)<0)
+#ifdef USE_NEW_HUFFTABLE
+			a = htc_fast[gr_info->count1table_select][(MASK_UTYPE)mask>>(BITSHIFT+2)];
+			num -= a >> 4;
+			mask <<= a >> 4;
+			a &= 0xf;
+#else
 			{
-				if (MSB_MASK) val -= a;
+				const struct newhuff *h = htc+gr_info->count1table_select;
+				const short *val = h->table;
 
-				num--;
-				mask <<= 1;
+				while((a=*val++)<0)
+				{
+					if (MSB_MASK) val -= a;
+
+					num--;
+					mask <<= 1;
+				}
 			}
+#endif
 			if(part2remain+num <= 0)
 			{
 				num -= part2remain+num;
@@ -1267,6 +1386,7 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 			}
 		}
 
+long_cut:
 		gr_info->maxbandl = max+1;
 		gr_info->maxb = fr->longLimit[sfreq][gr_info->maxbandl];
 	}
@@ -1307,7 +1427,33 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 
 
 /* calculate real channel values for Joint-I-Stereo-mode */
-static void III_i_stereo(real xr_buf[2][SBLIMIT][SSLIMIT],int *scalefac, struct gr_info_s *gr_info,int sfreq,int ms_stereo,int lsf)
+/* Intensity stereo for a run of lines: both channels from the left one,
+   with the factors t[0] and t[1]. */
+void i_stereo_generic(real *xr0, real *xr1, const real *t, int count)
+{
+	int i;
+	for(i=0; i<count; ++i)
+	{
+		real v = xr0[i];
+		xr0[i] = REAL_MUL_15(v, t[0]);
+		xr1[i] = REAL_MUL_15(v, t[1]);
+	}
+}
+
+/* M/S stereo: sum and difference, the 1/sqrt(2) is in the gain already. */
+void ms_stereo_generic(real *xr0, real *xr1, int count)
+{
+	int i;
+	for(i=0; i<count; ++i)
+	{
+		real tmp0 = xr0[i];
+		real tmp1 = xr1[i];
+		xr0[i] = tmp0 + tmp1;
+		xr1[i] = tmp0 - tmp1;
+	}
+}
+
+static void III_i_stereo(real xr_buf[2][SBLIMIT][SSLIMIT],int *scalefac, struct gr_info_s *gr_info,int sfreq,int ms_stereo,int lsf, mpg123_handle *fr)
 {
 	real (*xr)[SBLIMIT*SSLIMIT] = (real (*)[SBLIMIT*SSLIMIT] ) xr_buf;
 	const struct bandInfoStruct *bi = &bandInfo[sfreq];
@@ -1424,16 +1570,11 @@ maybe still wrong??? (copy 12 to 13?) */
 				int is_p = scalefac[sfb]; /* scale: 0-15 */
 				if(is_p != 7)
 				{
-					real t1,t2;
-					t1 = tab1[is_p]; t2 = tab2[is_p];
-					for( ; sb > 0; sb--,idx++)
-					{
-						real v = xr[0][idx];
-						xr[0][idx] = REAL_MUL_15(v, t1);
-						xr[1][idx] = REAL_MUL_15(v, t2);
-					}
+					real t[2];
+					t[0] = tab1[is_p]; t[1] = tab2[is_p];
+					opt_i_stereo(fr)(xr[0]+idx, xr[1]+idx, t, sb);
 				}
-				else idx += sb;
+				idx += sb;
 			}
 		}     
 	} 
@@ -1450,36 +1591,46 @@ maybe still wrong??? (copy 12 to 13?) */
 			is_p = scalefac[sfb]; /* scale: 0-15 */
 			if(is_p != 7)
 			{
-				real t1,t2;
-				t1 = tab1[is_p]; t2 = tab2[is_p];
-				for( ; sb > 0; sb--,idx++)
-				{
-					 real v = xr[0][idx];
-					 xr[0][idx] = REAL_MUL_15(v, t1);
-					 xr[1][idx] = REAL_MUL_15(v, t2);
-				}
+				real t[2];
+				t[0] = tab1[is_p]; t[1] = tab2[is_p];
+				opt_i_stereo(fr)(xr[0]+idx, xr[1]+idx, t, sb);
 			}
-			else idx += sb;
+			idx += sb;
 		}
 
 		is_p = scalefac[20];
 		if(is_p != 7)
 		{  /* copy l-band 20 to l-band 21 */
-			int sb;
-			real t1 = tab1[is_p],t2 = tab2[is_p]; 
-
-			for( sb = bi->longDiff[21]; sb > 0; sb--,idx++ )
-			{
-				real v = xr[0][idx];
-				xr[0][idx] = REAL_MUL_15(v, t1);
-				xr[1][idx] = REAL_MUL_15(v, t2);
-			}
+			real t[2];
+			t[0] = tab1[is_p]; t[1] = tab2[is_p];
+			opt_i_stereo(fr)(xr[0]+idx, xr[1]+idx, t, bi->longDiff[21]);
 		}
 	}
 }
 
 
-static void III_antialias(real xr[SBLIMIT][SSLIMIT],struct gr_info_s *gr_info)
+/* 31 alias-reduction operations between each pair of sub-bands */
+/* with 8 butterflies between each pair, xr1 points to xr[1]     */
+void antialias(real *xr1, int sblim)
+{
+	int sb;
+
+	for(sb=sblim; sb; sb--,xr1+=10)
+	{
+		int ss;
+		const real *cs=aa_cs,*ca=aa_ca;
+		real *xr2 = xr1;
+
+		for(ss=7;ss>=0;ss--)
+		{ /* upper and lower butterfly inputs */
+			register real bu = *--xr2,bd = *xr1;
+			*xr2   = REAL_MUL(bu, *cs) - REAL_MUL(bd, *ca);
+			*xr1++ = REAL_MUL(bd, *cs++) + REAL_MUL(bu, *ca++);
+		}
+	}
+}
+
+static void III_antialias(real xr[SBLIMIT][SSLIMIT],struct gr_info_s *gr_info, mpg123_handle *fr)
 {
 	int sblim;
 
@@ -1491,27 +1642,7 @@ static void III_antialias(real xr[SBLIMIT][SSLIMIT],struct gr_info_s *gr_info)
 	}
 	else sblim = gr_info->maxb-1;
 
-	/* 31 alias-reduction operations between each pair of sub-bands */
-	/* with 8 butterflies between each pair                         */
-
-	{
-		int sb;
-		real *xr1=(real *) xr[1];
-
-		for(sb=sblim; sb; sb--,xr1+=10)
-		{
-			int ss;
-			real *cs=aa_cs,*ca=aa_ca;
-			real *xr2 = xr1;
-
-			for(ss=7;ss>=0;ss--)
-			{ /* upper and lower butterfly inputs */
-				register real bu = *--xr2,bd = *xr1;
-				*xr2   = REAL_MUL(bu, *cs) - REAL_MUL(bd, *ca);
-				*xr1++ = REAL_MUL(bd, *cs++) + REAL_MUL(bu, *ca++);
-			}
-		}
-	}
+	opt_antialias(fr)((real *) xr[1], sblim);
 }
 
 /* 
@@ -1971,6 +2102,30 @@ static void dct12(real *in,real *rawout1,real *rawout2,register real *wi,registe
 	}
 }
 
+/* Four subbands of short blocks, sb being even to get the window signs right. */
+void dct12_quad(real *in, real *rawout1, real *rawout2, real *ts)
+{
+	int i;
+	for(i=0; i<4; i+=2)
+	{
+		dct12(in+18*i,     rawout1+18*i,     rawout2+18*i,     win[2],  ts+i);
+		dct12(in+18*(i+1), rawout1+18*(i+1), rawout2+18*(i+1), win1[2], ts+i+1);
+	}
+}
+
+/* Subbands without data, just the overlap from last time to deliver. */
+void hybrid_tail(real *rawout1, real *rawout2, real *ts, int count)
+{
+	for(;count;count--,ts++)
+	{
+		int i;
+		for(i=0;i<SSLIMIT;i++)
+		{
+			ts[i*SBLIMIT] = *rawout1++;
+			*rawout2++ = DOUBLE_TO_REAL(0.0);
+		}
+	}
+}
 
 static void III_hybrid(real fsIn[SBLIMIT][SSLIMIT], real tsOut[SSLIMIT][SBLIMIT], int ch,struct gr_info_s *gr_info, mpg123_handle *fr)
 {
@@ -2001,6 +2156,8 @@ static void III_hybrid(real fsIn[SBLIMIT][SSLIMIT], real tsOut[SSLIMIT][SBLIMIT]
 	bt = gr_info->block_type;
 	if(bt == 2)
 	{
+		for(; sb+4<=gr_info->maxb; sb+=4,tspnt+=4,rawout1+=72,rawout2+=72)
+			opt_dct12_quad(fr)(fsIn[sb],rawout1,rawout2,tspnt);
 		for(; sb<gr_info->maxb; sb+=2,tspnt+=2,rawout1+=36,rawout2+=36)
 		{
 			dct12(fsIn[sb]  ,rawout1   ,rawout2   ,win[2] ,tspnt);
@@ -2009,6 +2166,11 @@ static void III_hybrid(real fsIn[SBLIMIT][SSLIMIT], real tsOut[SSLIMIT][SBLIMIT]
 	}
 	else
 	{
+#ifdef opt_dct36_quad
+		if(opt_has_dct36_quad(fr))
+			for(; sb+4<=gr_info->maxb; sb+=4,tspnt+=4,rawout1+=72,rawout2+=72)
+				opt_dct36_quad(fr)(fsIn[sb],rawout1,rawout2,win[bt],win1[bt],tspnt);
+#endif
 		for(; sb<gr_info->maxb; sb+=2,tspnt+=2,rawout1+=36,rawout2+=36)
 		{
 			opt_dct36(fr)(fsIn[sb],rawout1,rawout2,win[bt],tspnt);
@@ -2016,15 +2178,8 @@ static void III_hybrid(real fsIn[SBLIMIT][SSLIMIT], real tsOut[SSLIMIT][SBLIMIT]
 		}
 	}
 
-	for(;sb<SBLIMIT;sb++,tspnt++)
-	{
-		int i;
-		for(i=0;i<SSLIMIT;i++)
-		{
-			tspnt[i*SBLIMIT] = *rawout1++;
-			*rawout2++ = DOUBLE_TO_REAL(0.0);
-		}
-	}
+	/* sb is even here */
+	opt_hybrid_tail(fr)(rawout1,rawout2,tspnt,SBLIMIT-sb);
 }
 
 #ifndef NO_MOREINFO
@@ -2095,10 +2250,285 @@ static void fill_pinfo_side(mpg123_handle *fr, struct III_sideinfo *si, int gr,
 }
 #endif
 
+/*
+	MPG123_CONCEAL: the spectrum of the last good granule is kept and played
+	again, getting weaker each time, in place of granules that cannot be
+	decoded. Through the hybrid overlap, this fades from the previous sound
+	instead of breaking off to silence. Start and stop windows are replayed
+	as normal long ones, which fit into a series of repetitions.
+*/
+#define CONCEAL_DECAY 0.7 /* about -3 dB per granule */
+
+static void III_conceal_store( mpg123_handle *fr
+,	real xr[2][SBLIMIT][SSLIMIT], struct gr_info_s *gr_info[2], int stereo1 )
+{
+	int ch;
+	for(ch=0; ch<stereo1; ++ch)
+	{
+		memcpy(fr->layer3.conceal[ch], xr[ch], sizeof(real)*SBLIMIT*SSLIMIT);
+		fr->layer3.conceal_type[ch] = gr_info[ch]->block_type == 2 ? 2 : 0;
+		fr->layer3.conceal_mixed[ch] = gr_info[ch]->mixed_block_flag;
+		fr->layer3.conceal_maxb[ch] = gr_info[ch]->maxb;
+	}
+}
+
+static void III_conceal_fill( mpg123_handle *fr
+,	real xr[2][SBLIMIT][SSLIMIT], struct gr_info_s gr_info[2], int stereo1 )
+{
+	int ch;
+	for(ch=0; ch<stereo1; ++ch)
+	{
+		real *in = fr->layer3.conceal[ch][0];
+		real *out = xr[ch][0];
+		int i, n = fr->layer3.conceal_maxb[ch]*SSLIMIT;
+		for(i=0; i<n; ++i)
+			out[i] = in[i] = REAL_MUL(in[i], DOUBLE_TO_REAL(CONCEAL_DECAY));
+		gr_info[ch].block_type = fr->layer3.conceal_type[ch];
+		gr_info[ch].mixed_block_flag = fr->layer3.conceal_mixed[ch];
+		gr_info[ch].maxb = fr->layer3.conceal_maxb[ch];
+	}
+}
+
+/* Antialias, hybrid and synthesis of a granule: the part that needs no
+   bitstream and thus can run on the pipeline worker. */
+static int III_granule_synth( mpg123_handle *fr
+,	real (*hybridIn)[SBLIMIT][SSLIMIT], struct gr_info_s **gr_infos
+,	int stereo1, int single, int skip_synth, int worker )
+{
+	/*  hybridOut[2][SSLIMIT][SBLIMIT] */
+	real (*hybridOut)[SSLIMIT][SBLIMIT] = fr->layer3.hybrid_out;
+	int ch, ss, clip = 0;
+
+	for(ch=0;ch<stereo1;ch++)
+	{
+		III_antialias(hybridIn[ch],gr_infos[ch], fr);
+		III_hybrid(hybridIn[ch], hybridOut[ch], ch,gr_infos[ch], fr);
+		frame_coeff_notify( fr, MPG123_COEFF_SUBBAND, ch, hybridOut[ch][0]
+		,	SSLIMIT*SBLIMIT );
+	}
+#ifdef PROFILE_STAGES
+	if(!worker)
+		PROF_LAP(fr, prof_hybrid);
+#endif
+	if(fr->have_gain && !skip_synth)
+		do_gain( fr, hybridOut[0][0]
+		,	single == SINGLE_STEREO ? hybridOut[1][0] : NULL, SSLIMIT );
+
+#ifdef OPT_I486
+	if(single != SINGLE_STEREO || fr->af.encoding != MPG123_ENC_SIGNED_16 || fr->down_sample != 0)
+	{
+#endif
+	if(skip_synth)
+		fr->bo = (fr->bo - SSLIMIT) & 0xf;
+	else if(single != SINGLE_STEREO)
+	{
+		for(ss=0;ss<SSLIMIT;ss++)
+		clip += (fr->synth_mono)(hybridOut[0][ss], fr);
+	}
+	else /* All time slots of the granule in one go. */
+	clip += SYNTH_STEREO_BLOCK(fr)(hybridOut[0][0], hybridOut[1][0], SSLIMIT, fr);
+#ifdef OPT_I486
+	} else
+	{
+		/* Only stereo, 16 bits benefit from the 486 optimization. */
+		ss=0;
+		while(ss < SSLIMIT)
+		{
+			int n;
+			n=(fr->buffer.size - fr->buffer.fill) / (2*2*32);
+			if(n > (SSLIMIT-ss)) n=SSLIMIT-ss;
+
+			/* Clip counting makes no sense with this function. */
+			absynth_1to1_i486(hybridOut[0][ss], 0, fr, n);
+			absynth_1to1_i486(hybridOut[1][ss], 1, fr, n);
+			ss+=n;
+			fr->buffer.fill+=(2*2*32)*n;
+		}
+	}
+#endif
+#ifdef PROFILE_STAGES
+	if(!worker)
+		PROF_LAP(fr, prof_synth);
+#endif
+	return clip;
+}
+
+/* MPG123_SILENCE: Is this a granule of digital silence that needs no
+   filterbank? A zero spectrum (the hybrid reads no more than maxb
+   subbands, and two for mixed blocks) leaves the last overlap to be added in the hybrid. The second
+   such granule in a row adds a zero overlap and puts 18 slots of zeros into
+   the synth history, which only keeps 16. From the third on, hybrid and
+   synth state stay all zero and so does the output. */
+static int III_silent_granule( mpg123_handle *fr
+,	real (*hybridIn)[SBLIMIT][SSLIMIT], struct gr_info_s **gr_infos
+,	int stereo1 )
+{
+	int ch, i;
+	for(ch=0; ch<stereo1; ++ch)
+	{
+		real *xr = hybridIn[ch][0];
+		int n = gr_infos[ch]->mixed_block_flag && gr_infos[ch]->maxb < 2
+		?	2*SSLIMIT : gr_infos[ch]->maxb*SSLIMIT;
+		for(i=0; i<n; ++i)
+			if(xr[i] != DOUBLE_TO_REAL(0.0))
+			{
+				fr->layer3.silent_run = 0;
+				return FALSE;
+			}
+	}
+	return ++fr->layer3.silent_run > 2;
+}
+
+/* Step over a silent granule like the hybrid and synth would, writing the
+   zero samples they would produce. */
+static void III_granule_silence(mpg123_handle *fr, int stereo1)
+{
+	size_t bytes = decoder_synth_bytes(fr, (SBLIMIT*SSLIMIT)>>fr->down_sample);
+	int ch;
+	for(ch=0; ch<stereo1; ++ch)
+		fr->hybrid_blc[ch] = 1 - fr->hybrid_blc[ch];
+	fr->bo = (fr->bo - SSLIMIT) & 0xf;
+	memset(fr->buffer.data + fr->buffer.fill, frame_zero_byte(fr), bytes);
+	fr->buffer.fill += bytes;
+}
+
+#ifndef NO_THREADS
+/* MPG123_PIPELINE: A worker thread per handle takes the synthesis of the
+   first granule of a frame while the caller decodes the second one from
+   the bitstream. The output is complete when do_layer3() returns, as
+   always, so nothing else needs to know. Only one granule is in flight,
+   the handover is a single slot guarded by a mutex. */
+enum III_pipe_state { pipe_idle = 0, pipe_job, pipe_done, pipe_quit };
+
+struct III_pipe
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	mpg123_handle *fr;
+	enum III_pipe_state state;
+	real (*xr)[SBLIMIT][SSLIMIT];
+	struct gr_info_s *gr_infos[2];
+	int stereo1;
+	int single;
+	int clip;
+};
+
+static void *III_pipe_worker(void *arg)
+{
+	struct III_pipe *pipe = arg;
+	pthread_mutex_lock(&pipe->lock);
+	while(1)
+	{
+		while(pipe->state != pipe_job && pipe->state != pipe_quit)
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		if(pipe->state == pipe_quit)
+			break;
+		pthread_mutex_unlock(&pipe->lock);
+		pipe->clip = III_granule_synth( pipe->fr, pipe->xr, pipe->gr_infos
+		,	pipe->stereo1, pipe->single, FALSE, TRUE );
+		pthread_mutex_lock(&pipe->lock);
+		pipe->state = pipe_done;
+		pthread_cond_signal(&pipe->cond);
+	}
+	pthread_mutex_unlock(&pipe->lock);
+	return NULL;
+}
+
+/* Start the worker, 0 on success. */
+static int III_pipe_start(mpg123_handle *fr)
+{
+	struct III_pipe *pipe = malloc(sizeof(*pipe));
+	if(!pipe)
+		return -1;
+	pipe->fr = fr;
+	pipe->state = pipe_idle;
+	if(pthread_mutex_init(&pipe->lock, NULL))
+	{
+		free(pipe);
+		return -1;
+	}
+	if(pthread_cond_init(&pipe->cond, NULL))
+	{
+		pthread_mutex_destroy(&pipe->lock);
+		free(pipe);
+		return -1;
+	}
+	if(pthread_create(&pipe->thread, NULL, III_pipe_worker, pipe))
+	{
+		pthread_cond_destroy(&pipe->cond);
+		pthread_mutex_destroy(&pipe->lock);
+		free(pipe);
+		return -1;
+	}
+	fr->layer3.pipe = pipe;
+	return 0;
+}
+
+static void III_pipe_post( mpg123_handle *fr, real (*xr)[SBLIMIT][SSLIMIT]
+,	struct gr_info_s **gr_infos, int stereo1, int single )
+{
+	struct III_pipe *pipe = fr->layer3.pipe;
+	pthread_mutex_lock(&pipe->lock);
+	pipe->xr = xr;
+	pipe->gr_infos[0] = gr_infos[0];
+	pipe->gr_infos[1] = gr_infos[1];
+	pipe->stereo1 = stereo1;
+	pipe->single = single;
+	pipe->state = pipe_job;
+	pthread_cond_signal(&pipe->cond);
+	pthread_mutex_unlock(&pipe->lock);
+}
+
+/* Wait for the posted granule, returning its clip count. */
+static int III_pipe_wait(mpg123_handle *fr)
+{
+	struct III_pipe *pipe = fr->layer3.pipe;
+	pthread_mutex_lock(&pipe->lock);
+	while(pipe->state != pipe_done)
+		pthread_cond_wait(&pipe->cond, &pipe->lock);
+	pipe->state = pipe_idle;
+	pthread_mutex_unlock(&pipe->lock);
+	return pipe->clip;
+}
+#else
+#define III_pipe_post(fr, xr, gr_infos, stereo1, single)
+#define III_pipe_wait(fr) 0
+#endif
+
+void layer3_pipe_exit(mpg123_handle *fr)
+{
+#ifndef NO_THREADS
+	struct III_pipe *pipe = fr->layer3.pipe;
+	if(!pipe)
+		return;
+	pthread_mutex_lock(&pipe->lock);
+	pipe->state = pipe_quit;
+	pthread_cond_signal(&pipe->cond);
+	pthread_mutex_unlock(&pipe->lock);
+	pthread_join(pipe->thread, NULL);
+	pthread_cond_destroy(&pipe->cond);
+	pthread_mutex_destroy(&pipe->lock);
+	free(pipe);
+	fr->layer3.pipe = NULL;
+#endif
+}
+
+/* A granule that cannot be decoded ends the frame, or, with MPG123_CONCEAL,
+   gets replaced by the concealment, as all that follow in this frame. */
+#define III_DAMAGED \
+{ \
+	if(!(fr->p.flags & MPG123_CONCEAL)) \
+		break; \
+	conceal = TRUE; \
+	--gr; \
+	continue; \
+}
+
 /* And at the end... the main layer3 handler */
 int do_layer3(mpg123_handle *fr)
 {
-	int gr, ch, ss,clip=0;
+	int gr, ch, clip=0;
 	int scalefacs[2][39]; /* max 39 for short[13][3] mode, mixed: 38, long: 22 */
 	struct III_sideinfo sideinfo;
 	int stereo = fr->stereo;
@@ -2106,6 +2536,35 @@ int do_layer3(mpg123_handle *fr)
 	int ms_stereo,i_stereo;
 	int sfreq = fr->sampling_frequency;
 	int stereo1,granules;
+	/* Subbands the output has room for, the hybrid works on pairs. Intensity
+	   stereo needs all of the right channel to find where it starts. */
+	int sblimit = (fr->down_sample_sblimit+1) & ~1;
+	/* Frames decoded and discarded ahead of a seek target are there to fill
+	   the bit reservoir and the hybrid overlap. Synthesis only matters for
+	   the last one, as a granule rewrites all 16 slots of the synth history.
+	   Only the buffer offset has to move on as if we did synthesize. */
+	int skip_synth = fr->to_ignore && fr->num < fr->firstframe-1
+#ifdef OPT_DITHER
+	&&	fr->dithernoise == NULL
+#endif
+	;
+	/* With mpg123_coeff_callback(), maybe not even the hybrid is needed. */
+	int coeff_only = fr->coeff_flags & MPG123_COEFF_NO_SYNTH;
+	/* The rest of the frame is damaged, see III_DAMAGED. */
+	int conceal = FALSE;
+	struct gr_info_s conceal_info[2][2];
+	/* The first granule goes to the MPG123_PIPELINE worker. */
+	int piped = FALSE;
+	int posted = FALSE;
+	/* MPG123_SILENCE: skip the filterbank for digital silence, counting
+	   the granules that were. */
+	int silence = fr->p.silence && !skip_synth && !fr->coeff_flags
+	&&	!fr->batch && fr->down_sample != 3
+#ifdef OPT_I486
+	&&	(single != SINGLE_STEREO || fr->af.encoding != MPG123_ENC_SIGNED_16 || fr->down_sample != 0)
+#endif
+	;
+	int silent = 0;
 
 	if(stereo == 1)
 	{ /* stream is mono */
@@ -2125,29 +2584,70 @@ int do_layer3(mpg123_handle *fr)
 	else ms_stereo = i_stereo = 0;
 
 	granules = fr->lsf ? 1 : 2;
+	if(coeff_only)
+		skip_synth = TRUE;
+	/* Only count silence that all went through here. */
+	if(!silence)
+		fr->layer3.silent_run = 0;
+#ifndef NO_MOREINFO
+	/* The frame analyzer wants to see everything. */
+	if(fr->pinfo)
+		sblimit = SBLIMIT;
+#endif
+#ifndef NO_THREADS
+	/* Coefficient callbacks stay on the calling thread. Without the worker
+	   (failed to start), just decode in sequence. */
+	if( (fr->p.flags & MPG123_PIPELINE) && granules == 2 && !skip_synth
+	&&	!fr->coeff_flags
+	&&	(fr->layer3.pipe || !III_pipe_start(fr)) )
+		piped = TRUE;
+#endif
 
+	PROF_MARK(fr);
+	/* A corrupted side info is concealed. The main data of the frame still
+	   serves the bit reservoir of the following ones. */
+	if(crc_mismatch(fr, (fr->ssize-2)*8))
+	{
+		III_reservoir_add(fr);
+		conceal = TRUE;
+	}
 	/* quick hack to keep the music playing */
 	/* after having seen this nasty test file... */
-	if(III_get_side_info(fr, &sideinfo,stereo,ms_stereo,sfreq,single))
+	else if(III_get_side_info(fr, &sideinfo,stereo,ms_stereo,sfreq,single))
 	{
 		if(NOQUIET) error("bad frame - unable to get valid sideinfo");
-		return clip;
+		conceal = TRUE;
 	}
+	/* Without MPG123_CONCEAL, damaged frames are silence. */
+	if(conceal && !(fr->p.flags & MPG123_CONCEAL))
+		return clip;
 
-	set_pointer(fr, 1, sideinfo.main_data_begin);
-#ifndef NO_MOREINFO
-	if(fr->pinfo)
+	if(!conceal)
 	{
-		fr->pinfo->maindata = sideinfo.main_data_begin;
-		fr->pinfo->padding  = fr->padding;
-	}
+		set_pointer(fr, 1, sideinfo.main_data_begin);
+#ifndef NO_MOREINFO
+		if(fr->pinfo)
+		{
+			fr->pinfo->maindata = sideinfo.main_data_begin;
+			fr->pinfo->padding  = fr->padding;
+		}
 #endif
+	}
 	for(gr=0;gr<granules;gr++)
 	{
-		/*  hybridIn[2][SBLIMIT][SSLIMIT] */
-		real (*hybridIn)[SBLIMIT][SSLIMIT] = fr->layer3.hybrid_in;
-		/*  hybridOut[2][SSLIMIT][SBLIMIT] */
-		real (*hybridOut)[SSLIMIT][SBLIMIT] = fr->layer3.hybrid_out;
+		/*  hybridIn[2][SBLIMIT][SSLIMIT], the worker still reads the first */
+		real (*hybridIn)[SBLIMIT][SSLIMIT] = piped && gr
+		?	fr->layer3.hybrid_in2 : fr->layer3.hybrid_in;
+		/* The block setup for antialias and hybrid. */
+		struct gr_info_s *gr_infos[2];
+
+		if(conceal)
+		{
+			III_conceal_fill(fr, hybridIn, conceal_info[gr], stereo1);
+			gr_infos[0] = &conceal_info[gr][0];
+			gr_infos[1] = &conceal_info[gr][1];
+			goto granule_ready;
+		}
 
 		{
 			struct gr_info_s *gr_info = &(sideinfo.ch[0].gr[gr]);
@@ -2158,7 +2658,7 @@ int do_layer3(mpg123_handle *fr)
 					error2(
 						"part2_3_length (%u) too large for available bit count (%li)"
 					,	gr_info->part2_3_length, fr->bits_avail );
-				return clip;
+				III_DAMAGED
 			}
 			if(fr->lsf)
 			part2bits = III_get_scale_factors_2(fr, scalefacs[0],gr_info,0);
@@ -2169,7 +2669,7 @@ int do_layer3(mpg123_handle *fr)
 			{
 				if(VERBOSE2)
 					error("not enough bits for scale factors");
-				return clip;
+				III_DAMAGED
 			}
 
 #ifndef NO_MOREINFO
@@ -2182,18 +2682,19 @@ int do_layer3(mpg123_handle *fr)
 			}
 #endif
 
-			if(III_dequantize_sample(fr, hybridIn[0], scalefacs[0],gr_info,sfreq,part2bits))
+			if(III_dequantize_sample(fr, hybridIn[0], scalefacs[0],gr_info,sfreq,part2bits,sblimit))
 			{
 				if(NOQUIET)
 					error("dequantization failed!");
-				return clip;
+				III_DAMAGED
 			}
 			if(fr->bits_avail < 0)
 			{
 				if(NOQUIET)
 					error("bit deficit after dequant");
-				return clip;
+				III_DAMAGED
 			}
+			PROF_LAP(fr, prof_dequant);
 		}
 
 		if(stereo == 2)
@@ -2209,7 +2710,7 @@ int do_layer3(mpg123_handle *fr)
 			{
 				if(VERBOSE2)
 					error("not enough bits for scale factors");
-				return clip;
+				III_DAMAGED
 			}
 
 #ifndef NO_MOREINFO
@@ -2222,35 +2723,30 @@ int do_layer3(mpg123_handle *fr)
 			}
 #endif
 
-			if(III_dequantize_sample(fr, hybridIn[1],scalefacs[1],gr_info,sfreq,part2bits))
+			if(III_dequantize_sample( fr, hybridIn[1],scalefacs[1],gr_info,sfreq,part2bits
+			,	i_stereo ? SBLIMIT : sblimit ))
 			{
 				if(NOQUIET)
 					error("dequantization failed!");
-				return clip;
+				III_DAMAGED
 			}
 			if(fr->bits_avail < 0)
 			{
 				if(NOQUIET)
 					error("bit deficit after dequant");
-				return clip;
+				III_DAMAGED
 			}
+			PROF_LAP(fr, prof_dequant);
 
 			if(ms_stereo)
 			{
-				int i;
 				unsigned int maxb = sideinfo.ch[0].gr[gr].maxb;
 				if(sideinfo.ch[1].gr[gr].maxb > maxb) maxb = sideinfo.ch[1].gr[gr].maxb;
 
-				for(i=0;i<SSLIMIT*(int)maxb;i++)
-				{
-					real tmp0 = ((real *)hybridIn[0])[i];
-					real tmp1 = ((real *)hybridIn[1])[i];
-					((real *)hybridIn[0])[i] = tmp0 + tmp1;
-					((real *)hybridIn[1])[i] = tmp0 - tmp1;
-				}
+				opt_ms_stereo(fr)(hybridIn[0][0], hybridIn[1][0], SSLIMIT*(int)maxb);
 			}
 
-			if(i_stereo) III_i_stereo(hybridIn,scalefacs[1],gr_info,sfreq,ms_stereo,fr->lsf);
+			if(i_stereo) III_i_stereo(hybridIn,scalefacs[1],gr_info,sfreq,ms_stereo,fr->lsf,fr);
 
 			if(ms_stereo || i_stereo || (single == SINGLE_MIX) )
 			{
@@ -2279,52 +2775,61 @@ int do_layer3(mpg123_handle *fr)
 				}
 				break;
 			}
+			PROF_LAP(fr, prof_stereo);
 		}
 
 #ifndef NO_MOREINFO
 		if(fr->pinfo)
 			fill_pinfo_side(fr, &sideinfo, gr, stereo1);
 #endif
-
+		gr_infos[0] = &(sideinfo.ch[0].gr[gr]);
+		gr_infos[1] = &(sideinfo.ch[1].gr[gr]);
+		if(fr->p.flags & MPG123_CONCEAL)
+			III_conceal_store(fr, hybridIn, gr_infos, stereo1);
+granule_ready:
 		for(ch=0;ch<stereo1;ch++)
+			frame_coeff_notify( fr, MPG123_COEFF_MDCT, ch, hybridIn[ch][0]
+			,	SBLIMIT*SSLIMIT );
+		if(coeff_only && !(fr->coeff_flags & MPG123_COEFF_SUBBAND))
 		{
-			struct gr_info_s *gr_info = &(sideinfo.ch[ch].gr[gr]);
-			III_antialias(hybridIn[ch],gr_info);
-			III_hybrid(hybridIn[ch], hybridOut[ch], ch,gr_info, fr);
+			fr->bo = (fr->bo - SSLIMIT) & 0xf;
+			continue;
 		}
 
-#ifdef OPT_I486
-		if(single != SINGLE_STEREO || fr->af.encoding != MPG123_ENC_SIGNED_16 || fr->down_sample != 0)
+		if(silence && III_silent_granule(fr, hybridIn, gr_infos, stereo1))
 		{
-#endif
-		for(ss=0;ss<SSLIMIT;ss++)
+			if(posted)
+			{
+				clip += III_pipe_wait(fr);
+				posted = FALSE;
+				PROF_LAP(fr, prof_synth);
+			}
+			III_granule_silence(fr, stereo1);
+			++silent;
+			continue;
+		}
+		if(piped && !gr)
 		{
-			if(single != SINGLE_STEREO)
-			clip += (fr->synth_mono)(hybridOut[0][ss], fr);
-			else
-			clip += (fr->synth_stereo)(hybridOut[0][ss], hybridOut[1][ss], fr);
-
+			III_pipe_post(fr, hybridIn, gr_infos, stereo1, single);
+			posted = TRUE;
+			continue;
 		}
-#ifdef OPT_I486
-		} else
+		if(posted)
 		{
-			/* Only stereo, 16 bits benefit from the 486 optimization. */
-			ss=0;
-			while(ss < SSLIMIT)
-			{
-				int n;
-				n=(fr->buffer.size - fr->buffer.fill) / (2*2*32);
-				if(n > (SSLIMIT-ss)) n=SSLIMIT-ss;
-
-				/* Clip counting makes no sense with this function. */
-				absynth_1to1_i486(hybridOut[0][ss], 0, fr, n);
-				absynth_1to1_i486(hybridOut[1][ss], 1, fr, n);
-				ss+=n;
-				fr->buffer.fill+=(2*2*32)*n;
-			}
+			clip += III_pipe_wait(fr);
+			posted = FALSE;
+			PROF_LAP(fr, prof_synth);
 		}
-#endif
+		clip += III_granule_synth( fr, hybridIn, gr_infos, stereo1, single
+		,	skip_synth, FALSE );
 	}
-  
+	if(posted)
+	{
+		clip += III_pipe_wait(fr);
+		PROF_LAP(fr, prof_synth);
+	}
+	if(fr->p.silence == 2 && silent == granules)
+		fr->layer3.silent_frame = TRUE;
+
 	return clip;
 }
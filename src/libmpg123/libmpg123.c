@@ -7,6 +7,9 @@
 */
 
 #include "mpg123lib_intern.h"
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
 #include "icy2utf8.h"
 #include "debug.h"
 
@@ -15,17 +18,22 @@
 #define FORCE_ACCURATE
 #include "sample.h"
 #include "parse.h"
+#include "crc.h"
 
 #define SEEKFRAME(mh) ((mh)->ignoreframe < 0 ? 0 : (mh)->ignoreframe)
 
+/* The global tables are set up exactly once, by the first caller of
+   mpg123_init(), directly or via mpg123_new(). Others wait for that to
+   finish and then only look at the stored result. */
+static int init_result = MPG123_ERR;
+#ifndef NO_THREADS
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+#else
 static int initialized = 0;
+#endif
 
-int attribute_align_arg mpg123_init(void)
+static void init_tables(void)
 {
-	if((sizeof(short) != 2) || (sizeof(long) < 4)) return MPG123_BAD_TYPES;
-
-	if(initialized) return MPG123_OK; /* no need to initialize twice */
-
 #ifndef NO_LAYER12
 	init_layer12(); /* inits also shared tables with layer1 */
 #endif
@@ -33,18 +41,35 @@ int attribute_align_arg mpg123_init(void)
 	init_layer3();
 #endif
 	prepare_decode_tables();
+	init_crc();
 	check_decoders();
-	initialized = 1;
+	init_result = MPG123_OK;
 #if (defined REAL_IS_FLOAT) && (defined IEEE_FLOAT)
 	/* This is rather pointless but it eases my mind to check that we did
 	   not enable the special rounding on a VAX or something. */
 	if(12346 != REAL_TO_SHORT_ACCURATE(12345.67f))
 	{
 		error("Bad IEEE 754 rounding. Re-build libmpg123 properly.");
+		init_result = MPG123_ERR;
+	}
+#endif
+}
+
+int attribute_align_arg mpg123_init(void)
+{
+	if((sizeof(short) != 2) || (sizeof(long) < 4)) return MPG123_BAD_TYPES;
+
+#ifndef NO_THREADS
+	if(pthread_once(&init_once, init_tables))
 		return MPG123_ERR;
+#else
+	if(!initialized)
+	{
+		init_tables();
+		initialized = 1;
 	}
 #endif
-	return MPG123_OK;
+	return init_result;
 }
 
 void attribute_align_arg mpg123_exit(void)
@@ -53,6 +78,15 @@ void attribute_align_arg mpg123_exit(void)
 	/* Nope. This is dead space. */
 }
 
+int attribute_align_arg mpg123_allocator( void *(*r_alloc)(void *handle, size_t size)
+,	void *(*r_realloc)(void *handle, void *ptr, size_t size)
+,	void (*r_free)(void *handle, void *ptr), void *handle )
+{
+	return compat_allocator(r_alloc, r_realloc, r_free, handle)
+	?	MPG123_ERR_NULL
+	:	MPG123_OK;
+}
+
 /* create a new handle with specified decoder, decoder can be "", "auto" or NULL for auto-detection */
 mpg123_handle attribute_align_arg *mpg123_new(const char* decoder, int *error)
 {
@@ -65,7 +99,7 @@ mpg123_handle attribute_align_arg *mpg123_parnew(mpg123_pars *mp, const char* de
 	mpg123_handle *fr = NULL;
 	int err = MPG123_OK;
 
-	if(initialized) fr = (mpg123_handle*) malloc(sizeof(mpg123_handle));
+	if(mpg123_init() == MPG123_OK) fr = (mpg123_handle*) malloc(sizeof(mpg123_handle));
 	else err = MPG123_NOT_INITIALIZED;
 	if(fr != NULL)
 	{
@@ -134,7 +168,8 @@ int attribute_align_arg mpg123_param(mpg123_handle *mh, enum mpg123_parms key, l
 	else
 	{ /* Special treatment for some settings. */
 #ifdef FRAME_INDEX
-		if(key == MPG123_INDEX_SIZE)
+		if(  key == MPG123_INDEX_SIZE || key == MPG123_INDEX_COMPACT
+		  || key == MPG123_INDEX_RING || key == MPG123_FIXED_MEMORY )
 		{ /* Apply frame index size and grow property on the fly. */
 			r = frame_index_setup(mh);
 			if(r != MPG123_OK) mh->err = MPG123_INDEX_FAIL;
@@ -142,8 +177,8 @@ int attribute_align_arg mpg123_param(mpg123_handle *mh, enum mpg123_parms key, l
 #endif
 #ifndef NO_FEEDER
 		/* Feeder pool size is applied right away, reader will react to that. */
-		if(key == MPG123_FEEDPOOL || key == MPG123_FEEDBUFFER)
-		bc_poolsize(&mh->rdat.buffer, mh->p.feedpool, mh->p.feedbuffer);
+		if(key == MPG123_FEEDPOOL || key == MPG123_FEEDBUFFER || key == MPG123_FEEDPOOL_MAX)
+		bc_poolsize(&mh->rdat.buffer, mh->p.feedpool, mh->p.feedpool_max, mh->p.feedbuffer);
 #endif
 	}
 	return r;
@@ -258,6 +293,78 @@ int attribute_align_arg mpg123_par(mpg123_pars *mp, enum mpg123_parms key, long
 		case MPG123_FREEFORMAT_SIZE:
 			mp->freeformat_framesize = val;
 		break; 
+		case MPG123_PREFETCH:
+#ifndef NO_THREADS
+			if(val >= 0) mp->prefetch = val;
+			else ret = MPG123_BAD_VALUE;
+#else
+			if(val != 0) ret = MPG123_MISSING_FEATURE;
+#endif
+		break;
+		case MPG123_READ_BLOCK:
+			if(val >= 0) mp->read_block = val;
+			else ret = MPG123_BAD_VALUE;
+		break;
+		case MPG123_URING:
+#ifdef HAVE_IO_URING
+			if(val >= 0) mp->uring = val;
+			else ret = MPG123_BAD_VALUE;
+#else
+			if(val != 0) ret = MPG123_MISSING_FEATURE;
+#endif
+		break;
+		case MPG123_NONBLOCK:
+#ifndef NO_FEEDER
+			mp->nonblock = val ? 1 : 0;
+#else
+			if(val != 0) ret = MPG123_MISSING_FEATURE;
+#endif
+		break;
+		case MPG123_FIXED_MEMORY:
+			mp->fixed_memory = val ? 1 : 0;
+		break;
+		case MPG123_SCAN_THREADS:
+#ifndef NO_THREADS
+			if(val >= 0) mp->scan_threads = val;
+			else ret = MPG123_BAD_VALUE;
+#else
+			if(val > 1) ret = MPG123_MISSING_FEATURE;
+#endif
+		break;
+		case MPG123_SILENCE:
+			if(val >= 0 && val <= 2) mp->silence = val;
+			else ret = MPG123_BAD_VALUE;
+		break;
+		case MPG123_PEEK_END_LATER:
+			mp->peek_end_later = val ? 1 : 0;
+		break;
+		case MPG123_INDEX_COMPACT:
+#ifdef FRAME_INDEX
+			mp->index_compact = val ? 1 : 0;
+#else
+			ret = MPG123_NO_INDEX;
+#endif
+		break;
+		case MPG123_INDEX_RING:
+#ifdef FRAME_INDEX
+			if(val >= 0) mp->index_ring = val;
+			else ret = MPG123_BAD_VALUE;
+#else
+			ret = MPG123_NO_INDEX;
+#endif
+		break;
+		case MPG123_SEEK_CACHE:
+			if(val >= 0) mp->seek_cache = val;
+			else ret = MPG123_BAD_VALUE;
+		break;
+		case MPG123_FEEDPOOL_MAX:
+#ifndef NO_FEEDER
+			if(val >= 0) mp->feedpool_max = val;
+			else ret = MPG123_BAD_VALUE;
+#else
+			ret = MPG123_MISSING_FEATURE;
+#endif
+		break;
 		default:
 			ret = MPG123_BAD_PARAM;
 	}
@@ -350,6 +457,56 @@ int attribute_align_arg mpg123_getpar(mpg123_pars *mp, enum mpg123_parms key, lo
 		case MPG123_FREEFORMAT_SIZE:
 			*val = mp->freeformat_framesize;
 		break; 
+		case MPG123_PREFETCH:
+			*val = mp->prefetch;
+		break;
+		case MPG123_READ_BLOCK:
+			*val = mp->read_block;
+		break;
+		case MPG123_URING:
+			*val = mp->uring;
+		break;
+		case MPG123_NONBLOCK:
+			*val = mp->nonblock;
+		break;
+		case MPG123_FIXED_MEMORY:
+			*val = mp->fixed_memory;
+		break;
+		case MPG123_SCAN_THREADS:
+			*val = mp->scan_threads;
+		break;
+		case MPG123_SILENCE:
+			*val = mp->silence;
+		break;
+		case MPG123_PEEK_END_LATER:
+			*val = mp->peek_end_later;
+		break;
+		case MPG123_SEEK_CACHE:
+			*val = mp->seek_cache;
+		break;
+		case MPG123_FEEDPOOL_MAX:
+#ifndef NO_FEEDER
+			*val = mp->feedpool_max;
+#else
+			ret = MPG123_MISSING_FEATURE;
+#endif
+		break;
+		case MPG123_INDEX_COMPACT:
+			if(val)
+#ifdef FRAME_INDEX
+			*val = mp->index_compact;
+#else
+			*val = 0;
+#endif
+		break;
+		case MPG123_INDEX_RING:
+			if(val)
+#ifdef FRAME_INDEX
+			*val = mp->index_ring;
+#else
+			*val = 0;
+#endif
+		break;
 		default:
 			ret = MPG123_BAD_PARAM;
 	}
@@ -395,12 +552,75 @@ int attribute_align_arg mpg123_getstate(mpg123_handle *mh, enum mpg123_state key
 		case MPG123_ENC_DELAY:
 			theval = mh->enc_delay;
 		break;
+		case MPG123_CRC_ERRORS:
+			theval = mh->crc_errors;
+		break;
+		case MPG123_FEEDPOOL_HITS:
+		case MPG123_FEEDPOOL_MISSES:
+		case MPG123_FEEDPOOL_SIZE:
+#ifndef NO_FEEDER
+			theval = key == MPG123_FEEDPOOL_HITS
+			?	(long)mh->rdat.buffer.hits
+			:	key == MPG123_FEEDPOOL_MISSES
+			?	(long)mh->rdat.buffer.misses
+			:	(long)mh->rdat.buffer.pool_size;
+#else
+			mh->err = MPG123_MISSING_FEATURE;
+			ret = MPG123_ERR;
+#endif
+		break;
 		case MPG123_ENC_PADDING:
 			theval = mh->enc_padding;
 		break;
+		case MPG123_POLL_FD:
+			theval = reader_poll_fd(mh);
+		break;
 		case MPG123_DEC_DELAY:
 			theval = mh->lay == 3 ? GAPLESS_DELAY : -1;
 		break;
+		case MPG123_HANDLE_MEMORY:
+		case MPG123_MEMORY_DECODER:
+		case MPG123_MEMORY_OUTPUT:
+		case MPG123_MEMORY_INDEX:
+		case MPG123_MEMORY_FEED:
+		case MPG123_MEMORY_META:
+		{
+			/* The parts are in the order of enum frame_mem. */
+			size_t sval = key == MPG123_HANDLE_MEMORY
+			?	frame_memory(mh)
+			:	frame_memory_part(mh, key-MPG123_MEMORY_DECODER);
+			theval = (long)sval;
+			thefval = (double)sval;
+			if(theval < 0 || (size_t)theval != sval)
+			{
+				mh->err = MPG123_INT_OVERFLOW;
+				ret = MPG123_ERR;
+			}
+		}
+		break;
+		case MPG123_PROFILE_PARSE:
+		case MPG123_PROFILE_DEQUANT:
+		case MPG123_PROFILE_STEREO:
+		case MPG123_PROFILE_HYBRID:
+		case MPG123_PROFILE_SYNTH:
+		case MPG123_PROFILE_POSTPROCESS:
+#ifdef PROFILE_STAGES
+		{
+			/* The keys are in the order of enum prof_stage. */
+			uint64_t ns = mh->prof[key-MPG123_PROFILE_PARSE];
+			theval = (long)(ns/1000);
+			thefval = 1e-9*ns;
+			if(theval < 0 || (uint64_t)theval != ns/1000)
+			{
+				mh->err = MPG123_INT_OVERFLOW;
+				ret = MPG123_ERR;
+			}
+		}
+#else
+			mh->err = MPG123_MISSING_FEATURE;
+			ret = MPG123_ERR;
+#endif
+		break;
 		default:
 			mh->err = MPG123_BAD_KEY;
 			ret = MPG123_ERR;
@@ -417,6 +637,13 @@ int attribute_align_arg mpg123_eq(mpg123_handle *mh, enum mpg123_channels channe
 #ifndef NO_EQUALIZER
 	if(mh == NULL) return MPG123_BAD_HANDLE;
 	if(band < 0 || band > 31){ mh->err = MPG123_BAD_BAND; return MPG123_ERR; }
+	if(mh->equalizer == NULL)
+	{ /* Only handles that want an equalizer pay for it. */
+		int i;
+		mh->equalizer = malloc(sizeof(real)*2*32);
+		if(mh->equalizer == NULL){ mh->err = MPG123_OUT_OF_MEM; return MPG123_ERR; }
+		for(i=0; i < 32; ++i) mh->equalizer[0][i] = mh->equalizer[1][i] = DOUBLE_TO_REAL(1.0);
+	}
 	switch(channel)
 	{
 		case MPG123_LEFT|MPG123_RIGHT:
@@ -429,6 +656,8 @@ int attribute_align_arg mpg123_eq(mpg123_handle *mh, enum mpg123_channels channe
 			return MPG123_ERR;
 	}
 	mh->have_eq_settings = TRUE;
+	/* The synth history in snapshots is equalized. */
+	seekcache_clear(mh);
 #endif
 	return MPG123_OK;
 }
@@ -439,7 +668,13 @@ double attribute_align_arg mpg123_geteq(mpg123_handle *mh, enum mpg123_channels
 #ifndef NO_EQUALIZER
 
 	/* Handle this gracefully. When there is no band, it has no volume. */
-	if(mh != NULL && band > -1 && band < 32)
+	if(mh != NULL && mh->equalizer == NULL)
+	{
+		if(band > -1 && band < 32 && channel >= MPG123_LEFT
+		&& channel <= (MPG123_LEFT|MPG123_RIGHT))
+			ret = 1.;
+	}
+	else if(mh != NULL && band > -1 && band < 32)
 	switch(channel)
 	{
 		case MPG123_LEFT|MPG123_RIGHT:
@@ -513,10 +748,226 @@ int attribute_align_arg mpg123_replace_reader_handle( mpg123_handle *mh,
 	mpg123_close(mh);
 	mh->rdat.r_read_handle = r_read;
 	mh->rdat.r_lseek_handle = r_lseek;
+	mh->rdat.r_lseek_handle64 = NULL;
+	mh->rdat.cleanup_handle = cleanup;
+	return MPG123_OK;
+}
+
+/*
+	The same with 64 bit offsets, independent of the off_t of library and
+	application, so no wrapper in lfs_wrap.c needs to get in between.
+*/
+int attribute_align_arg mpg123_reader64( mpg123_handle *mh,
+                           ssize_t (*r_read) (void*, void *, size_t),
+                           int64_t (*r_lseek)(void*, int64_t, int),
+                           void    (*cleanup)(void*)  )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+
+	mpg123_close(mh);
+	mh->rdat.r_read_handle = r_read;
+	mh->rdat.r_lseek_handle = NULL;
+	mh->rdat.r_lseek_handle64 = r_lseek;
 	mh->rdat.cleanup_handle = cleanup;
 	return MPG123_OK;
 }
 
+int attribute_align_arg mpg123_open_handle64(mpg123_handle *mh, void *iohandle)
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+
+	mpg123_close(mh);
+	if(mh->rdat.r_read_handle == NULL)
+	{
+		mh->err = MPG123_BAD_CUSTOM_IO;
+		return MPG123_ERR;
+	}
+	return open_stream_handle(mh, iohandle);
+}
+
+static off_t track_length(mpg123_handle *mh);
+
+/* Output sample offset of the list entry open now. */
+#define list_offset(mh) ((mh)->list_count ? (mh)->list_start[(mh)->list_index] : 0)
+
+static void list_free(mpg123_handle *mh)
+{
+	size_t i;
+	if(mh->list != NULL)
+	{
+		for(i=0; i<mh->list_count; ++i)
+			free(mh->list[i]);
+		free(mh->list);
+	}
+	free(mh->list_start);
+	mh->list = NULL;
+	mh->list_start = NULL;
+	mh->list_count = 0;
+	mh->list_index = 0;
+	mh->list_range = -1;
+}
+
+/* Go over to list entry i. The file before is closed, but the decoder
+   and the output format stay, so there is only MPG123_NEW_FORMAT when
+   the format really changes. */
+static int list_open(mpg123_handle *mh, size_t i)
+{
+	if(mh->rd->close != NULL) mh->rd->close(mh);
+	frame_reset(mh);
+	mh->list_index = i;
+	return open_stream(mh, mh->list[i], -1);
+}
+
+/* Get the lengths of all list entries, from the first frame (Xing/LAME
+   info or estimate) or from a full scan. The application hears nothing
+   of this, and the format is left as it was. */
+static int list_lengths(mpg123_handle *mh, int scan)
+{
+	size_t count = mh->list_count;
+	void (*meta_callback)(void *, int) = mh->meta_callback;
+	struct audioformat af = mh->af;
+	int ret = MPG123_OK;
+	size_t i;
+
+	/* Each file by itself meanwhile. */
+	mh->list_count = 0;
+	mh->meta_callback = NULL;
+	for(i=0; i<count && ret == MPG123_OK; ++i)
+	{
+		off_t length = 0;
+		ret = list_open(mh, i);
+		if(ret == MPG123_OK && scan)
+			ret = mpg123_scan(mh);
+		if(ret == MPG123_OK && (length = mpg123_length(mh)) < 0)
+		{
+			/* No frames at all are fine, just nothing to play. */
+			if(length != MPG123_DONE)
+				ret = MPG123_ERR;
+			length = 0;
+		}
+		mh->list_start[i+1] = mh->list_start[i] + length;
+	}
+	mh->list_count = count;
+	mh->meta_callback = meta_callback;
+	mh->af = af;
+	return ret;
+}
+
+int attribute_align_arg mpg123_open_list( mpg123_handle *mh
+,	const char * const *paths, size_t count )
+{
+	size_t i;
+
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+
+	mpg123_close(mh);
+	if(paths == NULL || count < 1)
+	{
+		mh->err = MPG123_BAD_PARS;
+		return MPG123_ERR;
+	}
+	mh->list = malloc(sizeof(char*)*count);
+	mh->list_start = malloc(sizeof(off_t)*(count+1));
+	if(mh->list == NULL || mh->list_start == NULL)
+	{
+		free(mh->list);
+		mh->list = NULL;
+		list_free(mh);
+		mh->err = MPG123_OUT_OF_MEM;
+		return MPG123_ERR;
+	}
+	for(i=0; i<count; ++i)
+	{
+		if(paths[i] == NULL || (mh->list[i] = compat_strdup(paths[i])) == NULL)
+		{
+			mh->list_count = i;
+			list_free(mh);
+			mh->err = paths[i] == NULL ? MPG123_BAD_PARS : MPG123_OUT_OF_MEM;
+			return MPG123_ERR;
+		}
+	}
+	mh->list_count = count;
+	mh->list_start[0] = 0;
+	if(list_lengths(mh, FALSE) != MPG123_OK || list_open(mh, 0) != MPG123_OK)
+	{
+		mpg123_close(mh);
+		return MPG123_ERR;
+	}
+	return MPG123_OK;
+}
+
+int attribute_align_arg mpg123_list_index( mpg123_handle *mh
+,	size_t *index, int64_t *start )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(index != NULL)
+		*index = mh->list_index;
+	if(start != NULL)
+		*start = list_offset(mh);
+	return MPG123_OK;
+}
+
+/* At the end of a list entry, its length is known for sure. Correct the
+   start of the following ones. */
+static void list_end(mpg123_handle *mh)
+{
+	/* Without any frame, that is nothing. */
+	off_t length = mh->num < 0 ? 0 : track_length(mh);
+	size_t i;
+	if(length >= 0)
+	{
+		off_t diff = mh->list_start[mh->list_index] + length
+		-	mh->list_start[mh->list_index+1];
+		for(i=mh->list_index+1; i<=mh->list_count; ++i)
+			mh->list_start[i] += diff;
+	}
+}
+
+/* Offsets that do not fit into off_t are an error, results always fit. */
+#define OFF64_CHECK(mh, off) \
+	if((off_t)(off) != (off)) \
+	{ \
+		(mh)->err = MPG123_LFS_OVERFLOW; \
+		return MPG123_ERR; \
+	}
+
+int64_t attribute_align_arg mpg123_seek64(mpg123_handle *mh, int64_t sampleoff, int whence)
+{
+	if(mh == NULL) return MPG123_ERR;
+	OFF64_CHECK(mh, sampleoff)
+	return mpg123_seek(mh, (off_t)sampleoff, whence);
+}
+
+int64_t attribute_align_arg mpg123_seek_frame64(mpg123_handle *mh, int64_t frameoff, int whence)
+{
+	if(mh == NULL) return MPG123_ERR;
+	OFF64_CHECK(mh, frameoff)
+	return mpg123_seek_frame(mh, (off_t)frameoff, whence);
+}
+
+int64_t attribute_align_arg mpg123_tell64(mpg123_handle *mh)
+{
+	return mpg123_tell(mh);
+}
+
+int64_t attribute_align_arg mpg123_tellframe64(mpg123_handle *mh)
+{
+	return mpg123_tellframe(mh);
+}
+
+int64_t attribute_align_arg mpg123_framepos64(mpg123_handle *mh)
+{
+	return mpg123_framepos(mh);
+}
+
+int64_t attribute_align_arg mpg123_length64(mpg123_handle *mh)
+{
+	return mpg123_length(mh);
+}
+
+/* Only parsing with MPG123_META_ONLY, the decoder is never set up. */
+#define meta_only(mh) ((mh)->p.flags & MPG123_META_ONLY)
+
 /* Update decoding engine for
    a) a new choice of decoder
    b) a changed native format of the MPEG stream
@@ -533,14 +984,26 @@ int decode_update(mpg123_handle *mh)
 		mh->err = MPG123_BAD_DECODER_SETUP;
 		return MPG123_ERR;
 	}
+	if(meta_only(mh))
+	{
+		if(!(mh->p.flags & MPG123_QUIET)) error("No decoding with MPG123_META_ONLY.");
+
+		mh->err = MPG123_BAD_DECODER_SETUP;
+		return MPG123_ERR;
+	}
 
 	mh->state_flags |= FRAME_FRESH_DECODER;
+	seekcache_clear(mh);
 	native_rate = frame_freq(mh);
 
 	b = frame_output_format(mh); /* Select the new output format based on given constraints. */
 	if(b < 0) return MPG123_ERR;
 
-	if(b == 1) mh->new_format = 1; /* Store for later... */
+	if(b == 1)
+	{
+		mh->new_format = 1; /* Store for later... */
+		MPGPROBE3(new_format, mh->af.rate, mh->af.channels, mh->af.encoding);
+	}
 
 	debug3("updating decoder structure with native rate %li and af.rate %li (new format: %i)", native_rate, mh->af.rate, mh->new_format);
 	if(mh->af.rate == native_rate) mh->down_sample = 0;
@@ -611,10 +1074,18 @@ size_t attribute_align_arg mpg123_outblock(mpg123_handle *mh)
 static int get_next_frame(mpg123_handle *mh)
 {
 	int change = mh->decoder_change;
+	/* At the end of mpg123_range(), the next frame to decode would only be
+	   cut away. */
+	if(mh->range_end >= 0 && mh->num >= 0)
+	{
+		off_t next = mh->num+1 < mh->firstframe ? mh->firstframe : mh->num+1;
+		if(frame_outs(mh, next) >= mh->range_end)
+			return MPG123_DONE;
+	}
 	/* Ensure we got proper decoder for ignoring frames.
 	   Header can be changed from seeking around. But be careful: Only after at
 	   least one frame got read, decoder update makes sense. */
-	if(mh->header_change > 1 && mh->num >= 0)
+	if(mh->header_change > 1 && mh->num >= 0 && !meta_only(mh))
 	{
 		change = 1;
 		mh->header_change = 0;
@@ -637,11 +1108,19 @@ static int get_next_frame(mpg123_handle *mh)
 			if(mh->down_sample == 3) ntom_set_ntom(mh, mh->num+1);
 #endif
 			mh->to_ignore = mh->to_decode = FALSE;
+			seekcache_store(mh);
 		}
 		/* Read new frame data; possibly breaking out here for MPG123_NEED_MORE. */
 		debug("read frame");
 		mh->to_decode = FALSE;
+		/* A frame that MPG123_UPSPEED drops below is not even read. */
+		if( mh->p.doublespeed && ((mh->playnum+1) % mh->p.doublespeed)
+		&&	mh->num+1 >= mh->firstframe )
+			mh->state_flags |= FRAME_DROP_BODY;
+		PROF_MARK(mh);
 		b = read_frame(mh); /* That sets to_decode only if a full frame was read. */
+		PROF_LAP(mh, prof_parse);
+		mh->state_flags &= ~FRAME_DROP_BODY;
 		debug4("read of frame %li returned %i (to_decode=%i) at sample %li", (long)mh->num, b, mh->to_decode, (long)mpg123_tell(mh));
 		if(b == MPG123_NEED_MORE) return MPG123_NEED_MORE; /* need another call with data */
 		else if(b <= 0)
@@ -651,10 +1130,26 @@ static int get_next_frame(mpg123_handle *mh)
 			{ /* We simply reached the end. */
 				mh->track_frames = mh->num + 1;
 				debug("What about updating/checking gapless sample count here?");
+				if(mh->list_count)
+					list_end(mh);
+				/* Seamlessly on to the next list entry, unless mpg123_range()
+				   ends here already. */
+				if( mh->list_count && mh->list_index+1 < mh->list_count
+				&&	( mh->list_range < 0
+				||	mh->list_range > mh->list_start[mh->list_index+1] ) )
+				{
+					if(list_open(mh, mh->list_index+1) != MPG123_OK)
+						return MPG123_ERR;
+					change = 1;
+					continue;
+				}
 				return MPG123_DONE;
 			}
 			else return MPG123_ERR; /* Some real error. */
 		}
+		/* There is no decoder for ignoring frames. */
+		if(meta_only(mh))
+			mh->to_ignore = FALSE;
 		/* Now, there should be new data to decode ... and also possibly new stream properties */
 		if(mh->header_change > 1 || mh->decoder_change)
 		{
@@ -663,7 +1158,9 @@ static int get_next_frame(mpg123_handle *mh)
 			mh->header_change = 0;
 			/* Need to update decoder structure right away since frame might need to
 			   be decoded on next loop iteration for properly ignoring its output. */
-			if(decode_update(mh) < 0)
+			if(meta_only(mh))
+				mh->decoder_change = 1; /* Decoding attempts fail in decode_update(). */
+			else if(decode_update(mh) < 0)
 			return MPG123_ERR;
 		}
 		/* Now some accounting: Look at the numbers and decide if we want this frame. */
@@ -693,8 +1190,15 @@ static int get_next_frame(mpg123_handle *mh)
 			/* Prepare offsets for gapless decoding. */
 			debug1("preparing gapless stuff with native rate %li", frame_freq(mh));
 			frame_gapless_realinit(mh);
-			frame_set_frameseek(mh, mh->num);
+			if(!meta_only(mh))
+				frame_set_frameseek(mh, mh->num);
 #endif
+			/* The end of mpg123_range() over a list, in this entry. */
+			if(mh->list_count && mh->list_range >= 0)
+			{
+				off_t end = mh->list_range - list_offset(mh);
+				mh->range_end = SAMPLE_UNADJUST(mh, end > 0 ? end : 0);
+			}
 			mh->fresh = 0;
 #ifdef GAPLESS
 			/* Could this possibly happen? With a real big gapless offset... */
@@ -706,16 +1210,19 @@ static int get_next_frame(mpg123_handle *mh)
 	return MPG123_OK;
 }
 
-/* Assumption: A buffer full of zero samples can be constructed by repetition of this byte.
-   Oh, and it handles some format conversion.
-   Only to be used by decode_the_frame() ... */
-static int zero_byte(mpg123_handle *fr)
+/* Cut the freshly decoded frame at the end of mpg123_range(), then for
+   gapless decoding and the seek offset. */
+static void frame_cut(mpg123_handle *mh)
 {
-#ifndef NO_8BIT
-	return fr->af.encoding & MPG123_ENC_8 ? fr->conv16to8[0] : 0;
-#else
-	return 0; /* All normal signed formats have the zero here (even in byte form -- that may be an assumption for your funny machine...). */
-#endif
+	if(mh->range_end >= 0)
+	{
+		off_t avail = mh->range_end - frame_outs(mh, mh->num);
+		size_t bytes = avail > 0 ? (size_t)samples_to_bytes(mh, avail) : 0;
+		if(mh->buffer.fill > bytes)
+			mh->buffer.fill = bytes;
+	}
+	SEGMENT_CUT(mh);
+	FRAME_BUFFERCHECK(mh);
 }
 
 /*
@@ -725,7 +1232,26 @@ static int zero_byte(mpg123_handle *fr)
 static void decode_the_frame(mpg123_handle *fr)
 {
 	size_t needed_bytes = decoder_synth_bytes(fr, frame_expect_outsamples(fr));
+	MPGPROBE2(decode_start, (long long)fr->num, fr->lay);
+#ifndef NO_LAYER3
+	fr->layer3.silent_frame = FALSE;
+#endif
 	fr->clip += (fr->do_layer)(fr);
+#ifndef NO_LAYER3
+	/* MPG123_SILENCE 2: Nothing to show for a frame of digital silence.
+	   Frames decoded ahead of a seek target are not part of the stream. */
+	if(fr->layer3.silent_frame)
+	{
+		if( fr->silence_callback != NULL
+		&&	!(fr->to_ignore && fr->num < fr->firstframe) )
+			fr->silence_callback( fr->silence_handle
+			,	(int64_t)SAMPLE_ADJUST(fr, frame_outs(fr, fr->num))
+			,	(int64_t)frame_expect_outsamples(fr) );
+		fr->buffer.fill = 0;
+		MPGPROBE2(decode_end, (long long)fr->num, 0L);
+		return;
+	}
+#endif
 	/*fprintf(stderr, "frame %"OFF_P": got %"SIZE_P" / %"SIZE_P"\n", fr->num,(size_p)fr->buffer.fill, (size_p)needed_bytes);*/
 	/* There could be less data than promised.
 	   Also, then debugging, we look out for coding errors that could result in _more_ data than expected. */
@@ -735,7 +1261,9 @@ static void decode_the_frame(mpg123_handle *fr)
 #endif
 		if(fr->buffer.fill < needed_bytes)
 		{
-			if(VERBOSE2)
+			/* Frames without synthesis are silence on purpose. */
+			int broken = !(fr->coeff_flags & MPG123_COEFF_NO_SYNTH);
+			if(VERBOSE2 && broken)
 			fprintf(stderr, "Note: broken frame %li, filling up with %"SIZE_P" zeroes, from %"SIZE_P"\n", (long)fr->num, (size_p)(needed_bytes-fr->buffer.fill), (size_p)fr->buffer.fill);
 
 			/*
@@ -744,12 +1272,20 @@ static void decode_the_frame(mpg123_handle *fr)
 				but we have funny 8bit formats that have a different opinion on zero...
 				Unsigned 16 or 32 bit formats are handled later.
 			*/
-			memset( fr->buffer.data + fr->buffer.fill, zero_byte(fr), needed_bytes - fr->buffer.fill );
+			memset( fr->buffer.data + fr->buffer.fill, frame_zero_byte(fr), needed_bytes - fr->buffer.fill );
 
 			fr->buffer.fill = needed_bytes;
 #ifndef NO_NTOM
 			/* ntom_val will be wrong when the decoding wasn't carried out completely */
-			ntom_set_ntom(fr, fr->num+1);
+			if(broken)
+				ntom_set_ntom(fr, fr->num+1);
+			else if(fr->down_sample == 3)
+			{
+				/* Step over the frame like the synth does, without the loop over
+				   all frames before. */
+				unsigned long ntm = fr->ntom_val[0] + fr->spf*fr->ntom_step;
+				fr->ntom_val[0] = fr->ntom_val[1] = ntm % NTOM_MUL;
+			}
 #endif
 		}
 #ifdef DEBUG
@@ -760,7 +1296,10 @@ static void decode_the_frame(mpg123_handle *fr)
 		}
 	}
 #endif
+	PROF_MARK(fr);
 	postprocess_buffer(fr);
+	PROF_LAP(fr, prof_postprocess);
+	MPGPROBE2(decode_end, (long long)fr->num, (long)fr->buffer.fill);
 }
 
 /*
@@ -787,11 +1326,13 @@ int attribute_align_arg mpg123_framebyframe_decode(mpg123_handle *mh, off_t *num
 	if(!mh->to_decode) return MPG123_OK;
 
 	if(num != NULL) *num = mh->num;
+	if(mh->decoder_change && decode_update(mh) < 0)
+		return MPG123_ERR;
 	debug("decoding");
 	decode_the_frame(mh);
 	mh->to_decode = mh->to_ignore = FALSE;
 	mh->buffer.p = mh->buffer.data;
-	FRAME_BUFFERCHECK(mh);
+	frame_cut(mh);
 	*audio = mh->buffer.p;
 	*bytes = mh->buffer.fill;
 	return MPG123_OK;
@@ -873,7 +1414,7 @@ int attribute_align_arg mpg123_decode_frame(mpg123_handle *mh, off_t *num, unsig
 
 			mh->to_decode = mh->to_ignore = FALSE;
 			mh->buffer.p = mh->buffer.data;
-			FRAME_BUFFERCHECK(mh);
+			frame_cut(mh);
 			if(audio != NULL) *audio = mh->buffer.p;
 			if(bytes != NULL) *bytes = mh->buffer.fill;
 
@@ -888,9 +1429,310 @@ int attribute_align_arg mpg123_decode_frame(mpg123_handle *mh, off_t *num, unsig
 	}
 }
 
-int attribute_align_arg mpg123_read(mpg123_handle *mh, unsigned char *out, size_t size, size_t *done)
+int attribute_align_arg mpg123_decode_frames( mpg123_handle *mh
+,	unsigned char *outmemory, size_t outmemsize
+,	size_t *offsets, size_t maxframes, size_t *frames, size_t *done )
 {
-	return mpg123_decode(mh, NULL, 0, out, size, done);
+	return mpg123_decode_frames_ring( mh, outmemory, outmemsize, NULL, 0
+	,	offsets, maxframes, frames, done );
+}
+
+/* Decode the frame at hand right into the caller's memory, which holds at
+   least mh->outblock. Not being our own buffer, gapless cutting at the
+   beginning moves the data to its start. */
+static size_t decode_into(mpg123_handle *mh, unsigned char *mem, size_t size)
+{
+	struct outbuffer own = mh->buffer;
+	int own_buffer = mh->own_buffer;
+	size_t fill;
+
+	mh->buffer.data = mh->buffer.p = mem;
+	mh->buffer.size = size;
+	mh->buffer.fill = 0;
+	mh->own_buffer = FALSE;
+	decode_the_frame(mh);
+	frame_cut(mh);
+	fill = mh->buffer.fill;
+	mh->buffer = own;
+	mh->own_buffer = own_buffer;
+	return fill;
+}
+
+int attribute_align_arg mpg123_decode_frames_ring( mpg123_handle *mh
+,	unsigned char *seg1, size_t size1, unsigned char *seg2, size_t size2
+,	size_t *offsets, size_t maxframes, size_t *frames, size_t *done )
+{
+	size_t count = 0;
+	size_t mdone = 0;
+	int ret = MPG123_OK;
+
+	if(frames != NULL) *frames = 0;
+	if(done != NULL) *done = 0;
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(seg1 == NULL || (seg2 == NULL && size2)) return MPG123_ERR_NULL;
+	mh->buffer.fill = 0; /* always start fresh, as mpg123_decode_frame() */
+	while(count < maxframes)
+	{
+		if(!mh->to_decode)
+		{
+			/* Ignored frames from there still go to the internal buffer. */
+			int b = get_next_frame(mh);
+			if(b < 0){ ret = b; break; }
+			continue;
+		}
+		if(mh->new_format)
+		{
+			/* Tell only if the format of all delivered data is the old one. */
+			if(count == 0)
+			{
+				debug("notifiying new format");
+				mh->new_format = 0;
+				ret = MPG123_NEW_FORMAT;
+			}
+			break;
+		}
+		if(size1 + size2 - mdone < mh->outblock)
+		{
+			if(count == 0)
+				ret = MPG123_NO_SPACE;
+			break;
+		}
+		if(mh->decoder_change && decode_update(mh) < 0)
+		{
+			ret = MPG123_ERR;
+			break;
+		}
+		if(offsets != NULL) offsets[count] = mdone;
+		if(mdone >= size1)
+			mdone += decode_into(mh, seg2 + (mdone-size1), size1 + size2 - mdone);
+		else if(size1 - mdone >= mh->outblock)
+			mdone += decode_into(mh, seg1 + mdone, size1 - mdone);
+		else
+		{
+			/* Across the end of the first segment, via the own buffer. */
+			size_t piece;
+			decode_the_frame(mh);
+			mh->buffer.p = mh->buffer.data;
+			frame_cut(mh);
+			piece = size1 - mdone;
+			if(piece > mh->buffer.fill)
+				piece = mh->buffer.fill;
+			memcpy(seg1 + mdone, mh->buffer.p, piece);
+			memcpy(seg2, mh->buffer.p + piece, mh->buffer.fill - piece);
+			mdone += mh->buffer.fill;
+			mh->buffer.fill = 0;
+		}
+		++count;
+		mh->to_decode = mh->to_ignore = FALSE;
+	}
+	/* End of stream or input are reported on the next call that has nothing
+	   to deliver anymore. */
+	if(count > 0 && (ret == MPG123_DONE || ret == MPG123_NEED_MORE))
+		ret = MPG123_OK;
+	if(frames != NULL) *frames = count;
+	if(done != NULL) *done = mdone;
+	return ret;
+}
+
+/* Peak and sum of squares over some samples, at full scale 1. */
+static int envelope_scan( const unsigned char *audio, int enc, size_t values
+,	float *peak, double *sum )
+{
+	float p = *peak;
+	double s = *sum;
+	size_t i;
+
+#define ENVELOPE_LOOP(type, conv) \
+	{ \
+		const type *in = (const type*)audio; \
+		for(i=0; i<values; ++i) \
+		{ \
+			float v = (float)(conv); \
+			float a = v < 0 ? -v : v; \
+			if(a > p) p = a; \
+			s += (double)v*v; \
+		} \
+	}
+	switch(enc)
+	{
+		case MPG123_ENC_SIGNED_16:
+			ENVELOPE_LOOP(int16_t, in[i]*(1./32768))
+		break;
+		case MPG123_ENC_SIGNED_32:
+			ENVELOPE_LOOP(int32_t, in[i]*(1./2147483648.))
+		break;
+		case MPG123_ENC_FLOAT_32:
+			ENVELOPE_LOOP(float, in[i])
+		break;
+		case MPG123_ENC_FLOAT_64:
+			ENVELOPE_LOOP(double, in[i])
+		break;
+		case MPG123_ENC_SIGNED_8:
+			ENVELOPE_LOOP(signed char, in[i]*(1./128))
+		break;
+		case MPG123_ENC_UNSIGNED_8:
+			ENVELOPE_LOOP(unsigned char, ((int)in[i]-128)*(1./128))
+		break;
+		default:
+			return MPG123_BAD_OUTFORMAT;
+	}
+#undef ENVELOPE_LOOP
+	*peak = p;
+	*sum = s;
+	return MPG123_OK;
+}
+
+int attribute_align_arg mpg123_envelope( mpg123_handle *mh, size_t spp
+,	float *peak, float *rms, size_t points, size_t *done )
+{
+	size_t count = 0;
+	size_t fill = 0;   /* PCM frames in the current point */
+	size_t values = 0; /* samples in the current point */
+	float p = 0.f;
+	double sum = 0.;
+	int ret = MPG123_OK;
+
+	if(done != NULL) *done = 0;
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	while(count < points)
+	{
+		unsigned char *audio;
+		size_t bytes, frames, framesize, pos;
+		int err;
+
+		framesize = (size_t)mh->af.channels*mh->af.encsize;
+		/* Points end inside frames, stop before one that might not fit. */
+		if( spp && framesize && mh->outblock/framesize
+		>	(points-count)*spp - fill )
+		{
+			if(count == 0 && fill == 0)
+				ret = MPG123_NO_SPACE;
+			break;
+		}
+		err = mpg123_decode_frame(mh, NULL, &audio, &bytes);
+		if(err == MPG123_NEW_FORMAT)
+			continue;
+		if(err != MPG123_OK)
+		{
+			ret = err;
+			break;
+		}
+		framesize = (size_t)mh->af.channels*mh->af.encsize;
+		frames = bytes/framesize;
+		for(pos=0; pos<frames; )
+		{
+			size_t take = frames-pos;
+			if(spp && take > spp-fill)
+				take = spp-fill;
+			err = envelope_scan( audio+pos*framesize, mh->af.encoding
+			,	take*mh->af.channels, &p, &sum );
+			if(err != MPG123_OK)
+				return err;
+			pos += take;
+			fill += take;
+			values += take*mh->af.channels;
+			/* Without spp, a point for each MPEG frame. */
+			if(fill && (spp ? fill == spp : pos == frames))
+			{
+				if(peak != NULL) peak[count] = p;
+				if(rms != NULL) rms[count] = (float)sqrt(sum/values);
+				++count;
+				fill = values = 0;
+				p = 0.f;
+				sum = 0.;
+			}
+		}
+	}
+	/* The last point of a call may be short. */
+	if(fill)
+	{
+		if(peak != NULL) peak[count] = p;
+		if(rms != NULL) rms[count] = (float)sqrt(sum/values);
+		++count;
+	}
+	if(count > 0 && (ret == MPG123_DONE || ret == MPG123_NEED_MORE))
+		ret = MPG123_OK;
+	if(done != NULL) *done = count;
+	return ret;
+}
+
+/* Split interleaved samples into one buffer per channel.
+   Stereo with 16 or 32 bit samples is the common case worth its own loops. */
+static void deinterleave( void **planes, const unsigned char *in
+,	int channels, size_t sampsize, size_t samples )
+{
+	size_t i;
+	int c;
+
+	if(channels == 1)
+	{
+		memcpy(planes[0], in, samples*sampsize);
+		return;
+	}
+	if(channels == 2 && sampsize == 2)
+	{
+		const int16_t *src = (const int16_t*)in;
+		int16_t *l = planes[0];
+		int16_t *r = planes[1];
+		for(i=0; i<samples; ++i)
+		{
+			l[i] = src[2*i];
+			r[i] = src[2*i+1];
+		}
+		return;
+	}
+	if(channels == 2 && sampsize == 4)
+	{
+		const int32_t *src = (const int32_t*)in;
+		int32_t *l = planes[0];
+		int32_t *r = planes[1];
+		for(i=0; i<samples; ++i)
+		{
+			l[i] = src[2*i];
+			r[i] = src[2*i+1];
+		}
+		return;
+	}
+	for(i=0; i<samples; ++i)
+	for(c=0; c<channels; ++c)
+	{
+		memcpy((unsigned char*)planes[c]+i*sampsize, in, sampsize);
+		in += sampsize;
+	}
+}
+
+int attribute_align_arg mpg123_decode_frame_planar( mpg123_handle *mh
+,	void **planes, size_t plane_bytes, size_t *samples )
+{
+	unsigned char *audio = NULL;
+	size_t bytes = 0;
+	size_t framesize;
+	int c, ret;
+
+	if(samples != NULL) *samples = 0;
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(planes == NULL) return MPG123_ERR_NULL;
+	/* Each plane needs to hold its share of the largest frame. */
+	if(mh->outblock > plane_bytes*mh->af.channels) return MPG123_NO_SPACE;
+	for(c=0; c<mh->af.channels; ++c)
+		if(planes[c] == NULL)
+			return MPG123_ERR_NULL;
+	ret = mpg123_decode_frame(mh, NULL, &audio, &bytes);
+	if(ret != MPG123_OK || bytes == 0)
+		return ret;
+	framesize = (size_t)mh->af.channels*mh->af.encsize;
+	if(bytes > plane_bytes*mh->af.channels)
+		return MPG123_NO_SPACE;
+	deinterleave(planes, audio, mh->af.channels, mh->af.encsize, bytes/framesize);
+	/* The internal buffer has been consumed. */
+	mh->buffer.fill = 0;
+	if(samples != NULL) *samples = bytes/framesize;
+	return MPG123_OK;
+}
+
+int attribute_align_arg mpg123_read(mpg123_handle *mh, unsigned char *out, size_t size, size_t *done)
+{
+	return mpg123_decode(mh, NULL, 0, out, size, done);
 }
 
 int attribute_align_arg mpg123_feed(mpg123_handle *mh, const unsigned char *in, size_t size)
@@ -924,6 +1766,65 @@ int attribute_align_arg mpg123_feed(mpg123_handle *mh, const unsigned char *in,
 #endif
 }
 
+int attribute_align_arg mpg123_feed_borrow( mpg123_handle *mh
+,	const unsigned char *in, size_t size
+,	void (*release)(void *handle, const unsigned char *in), void *handle )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+#ifndef NO_FEEDER
+	if(in == NULL)
+	{
+		mh->err = MPG123_NULL_BUFFER;
+		return MPG123_ERR;
+	}
+	if(size == 0)
+		return MPG123_OK;
+	if((long)size < 0 || (size_t)(long)size != size)
+	{
+		mh->err = MPG123_ERR_READER;
+		return MPG123_ERR;
+	}
+	if(feed_borrow(mh, in, (long)size, release, handle) != 0)
+		return MPG123_ERR;
+	if(mh->err == MPG123_ERR_READER) mh->err = MPG123_OK;
+	return MPG123_OK;
+#else
+	mh->err = MPG123_MISSING_FEATURE;
+	return MPG123_ERR;
+#endif
+}
+
+int attribute_align_arg mpg123_feed_segment( mpg123_handle *mh
+,	long delay, long padding )
+{
+	off_t pos;
+	struct segment *seg;
+
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	pos = feed_end(mh);
+	if(pos < 0 || delay < -1 || padding < -1)
+	{
+		mh->err = MPG123_BAD_PARS;
+		return MPG123_ERR;
+	}
+	/* Nothing fed since the last one: It is just updated. */
+	if(!mh->segment_fill || mh->segment_queue[mh->segment_fill-1].pos != pos)
+	{
+		if(mh->segment_fill == SEGMENT_QUEUE)
+		{
+			mh->err = MPG123_BAD_PARS;
+			return MPG123_ERR;
+		}
+		++mh->segment_fill;
+	}
+	seg = &mh->segment_queue[mh->segment_fill-1];
+	seg->pos = pos;
+	seg->delay = delay;
+	seg->padding = padding;
+	seg->frames = -1;
+	return MPG123_OK;
+}
+
 /*
 	The old picture:
 	while(1) {
@@ -981,7 +1882,7 @@ int attribute_align_arg mpg123_decode(mpg123_handle *mh, const unsigned char *in
 			mh->to_decode = mh->to_ignore = FALSE;
 			mh->buffer.p = mh->buffer.data;
 			debug2("decoded frame %li, got %li samples in buffer", (long)mh->num, (long)(mh->buffer.fill / (samples_to_bytes(mh, 1))));
-			FRAME_BUFFERCHECK(mh);
+			frame_cut(mh);
 		}
 		if(mh->buffer.fill) /* Copy (part of) the decoded data to the caller's buffer. */
 		{
@@ -1083,6 +1984,12 @@ int attribute_align_arg mpg123_getformat2( mpg123_handle *mh
 	if(mh == NULL) return MPG123_BAD_HANDLE;
 	b = init_track(mh);
 	if(b < 0) return b;
+	/* The output format is never chosen. */
+	if(meta_only(mh))
+	{
+		mh->err = MPG123_BAD_DECODER_SETUP;
+		return MPG123_ERR;
+	}
 
 	if(rate != NULL) *rate = mh->af.rate;
 	if(channels != NULL) *channels = mh->af.channels;
@@ -1117,7 +2024,7 @@ off_t attribute_align_arg mpg123_timeframe(mpg123_handle *mh, double seconds)
 off_t attribute_align_arg mpg123_tell(mpg123_handle *mh)
 {
 	if(mh == NULL) return MPG123_ERR;
-	if(track_need_init(mh)) return 0;
+	if(track_need_init(mh)) return list_offset(mh);
 	/* Now we have all the info at hand. */
 	debug5("tell: %li/%i first %li buffer %lu; frame_outs=%li", (long)mh->num, mh->to_decode, (long)mh->firstframe, (unsigned long)mh->buffer.fill, (long)frame_outs(mh, mh->num));
 
@@ -1141,7 +2048,7 @@ off_t attribute_align_arg mpg123_tell(mpg123_handle *mh)
 		/* Substract padding and delay from the beginning. */
 		pos = SAMPLE_ADJUST(mh,pos);
 		/* Negative sample offsets are not right, less than nothing is still nothing. */
-		return pos>0 ? pos : 0;
+		return (pos>0 ? pos : 0) + list_offset(mh);
 	}
 }
 
@@ -1165,6 +2072,7 @@ static int do_the_seek(mpg123_handle *mh)
 {
 	int b;
 	off_t fnum = SEEKFRAME(mh);
+	MPGPROBE2(seek, (long long)mh->num, (long long)fnum);
 	mh->buffer.fill = 0;
 
 	/* If we are inside the ignoreframe - firstframe window, we may get away without actual seeking. */
@@ -1183,6 +2091,17 @@ static int do_the_seek(mpg123_handle *mh)
 		return MPG123_OK;
 	}
 
+	/* Been there before? Then resume from the stored decoder state. */
+	if(seekcache_restore(mh, mh->firstframe))
+	{
+#ifndef NO_NTOM
+		if(mh->down_sample == 3) ntom_set_ntom(mh, mh->firstframe);
+#endif
+		mh->to_decode = mh->to_ignore = FALSE;
+		mh->playnum = mh->num;
+		return 0;
+	}
+
 	/* OK, real seeking follows... clear buffers and go for it. */
 	frame_buffers_reset(mh);
 #ifndef NO_NTOM
@@ -1193,13 +2112,15 @@ static int do_the_seek(mpg123_handle *mh)
 	}
 #endif
 	b = mh->rd->seek_frame(mh, fnum);
-	if(mh->header_change > 1)
+	if(mh->header_change > 1 && !meta_only(mh))
 	{
 		if(decode_update(mh) < 0) return MPG123_ERR;
 		mh->header_change = 0;
 	}
 	debug1("seek_frame returned: %i", b);
 	if(b<0) return b;
+	/* Remember the state when arriving at the target. */
+	seekcache_pending(mh, mh->firstframe);
 	/* Only mh->to_ignore is TRUE. */
 	if(mh->num < mh->firstframe) mh->to_decode = FALSE;
 
@@ -1207,6 +2128,30 @@ static int do_the_seek(mpg123_handle *mh)
 	return 0;
 }
 
+/* Open the list entry for the sample offset *pos over all, which then
+   becomes the offset in there. */
+static int list_seek(mpg123_handle *mh, off_t *pos)
+{
+	size_t lo = 0;
+	size_t hi = mh->list_count;
+	int b;
+	/* The last entry starting at or before pos. */
+	while(hi-lo > 1)
+	{
+		size_t mid = lo + (hi-lo)/2;
+		if(mh->list_start[mid] <= *pos) lo = mid;
+		else hi = mid;
+	}
+	if(lo != mh->list_index)
+	{
+		if(list_open(mh, lo) != MPG123_OK)
+			return MPG123_ERR;
+		if((b=init_track(mh)) < 0) return b;
+	}
+	*pos -= mh->list_start[lo];
+	return MPG123_OK;
+}
+
 off_t attribute_align_arg mpg123_seek(mpg123_handle *mh, off_t sampleoff, int whence)
 {
 	int b;
@@ -1226,6 +2171,11 @@ off_t attribute_align_arg mpg123_seek(mpg123_handle *mh, off_t sampleoff, int wh
 		case SEEK_CUR: pos += sampleoff; break;
 		case SEEK_SET: pos  = sampleoff; break;
 		case SEEK_END:
+			if(mh->list_count)
+			{
+				pos = mh->list_start[mh->list_count] - sampleoff;
+				break;
+			}
 			/* When we do not know the end already, we can try to find it. */
 			if(mh->track_frames < 1 && (mh->rdat.flags & READER_SEEKABLE))
 			mpg123_scan(mh);
@@ -1242,6 +2192,7 @@ off_t attribute_align_arg mpg123_seek(mpg123_handle *mh, off_t sampleoff, int wh
 		default: mh->err = MPG123_BAD_WHENCE; return MPG123_ERR;
 	}
 	if(pos < 0) pos = 0;
+	if(mh->list_count && (b=list_seek(mh, &pos)) < 0) return b;
 	/* pos now holds the wanted sample offset in adjusted samples */
 	frame_set_seek(mh, SAMPLE_UNADJUST(mh,pos));
 	pos = do_the_seek(mh);
@@ -1250,6 +2201,26 @@ off_t attribute_align_arg mpg123_seek(mpg123_handle *mh, off_t sampleoff, int wh
 	return mpg123_tell(mh);
 }
 
+int attribute_align_arg mpg123_range(mpg123_handle *mh, int64_t start, int64_t end)
+{
+	int b;
+
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	OFF64_CHECK(mh, start)
+	OFF64_CHECK(mh, end)
+	if((b=init_track(mh)) < 0) return b;
+	if(start >= 0 && mpg123_seek(mh, (off_t)start, SEEK_SET) < 0)
+		return MPG123_ERR;
+	if(mh->list_count)
+	{
+		/* Also applied to the following entries on the way. */
+		mh->list_range = end < 0 ? -1 : (off_t)end;
+		end = end < 0 ? -1 : end > list_offset(mh) ? end - list_offset(mh) : 0;
+	}
+	mh->range_end = end < 0 ? -1 : SAMPLE_UNADJUST(mh, (off_t)end);
+	return MPG123_OK;
+}
+
 /*
 	A bit more tricky... libmpg123 does not do the seeking itself.
 	All it can do is to ignore frames until the wanted one is there.
@@ -1386,11 +2357,21 @@ off_t attribute_align_arg mpg123_framelength(mpg123_handle *mh)
 off_t attribute_align_arg mpg123_length(mpg123_handle *mh)
 {
 	int b;
-	off_t length;
 
 	if(mh == NULL) return MPG123_ERR;
 	b = init_track(mh);
 	if(b<0) return b;
+	/* All entries of a list together. */
+	if(mh->list_count)
+		return mh->list_start[mh->list_count];
+	return track_length(mh);
+}
+
+/* The length of the track open now, after init_track(). */
+static off_t track_length(mpg123_handle *mh)
+{
+	off_t length;
+
 	if(mh->track_samples > -1) length = mh->track_samples;
 	else if(mh->track_frames > 0) length = mh->track_frames*mh->spf;
 	else if(mh->rdat.filelen > 0) /* Let the case of 0 length just fall through. */
@@ -1419,6 +2400,17 @@ int attribute_align_arg mpg123_scan(mpg123_handle *mh)
 	off_t track_samples = 0;
 
 	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(mh->list_count)
+	{
+		/* Each entry of a list, then back to the same spot in the one
+		   open before. */
+		size_t index = mh->list_index;
+		off_t pos = mpg123_tell(mh) - list_offset(mh);
+		if(list_lengths(mh, TRUE) != MPG123_OK)
+			return MPG123_ERR;
+		return mpg123_seek(mh, mh->list_start[index]+pos, SEEK_SET) >= 0
+		?	MPG123_OK : MPG123_ERR;
+	}
 	if(!(mh->rdat.flags & READER_SEEKABLE)){ mh->err = MPG123_NO_SEEK; return MPG123_ERR; }
 	/* Scan through the _whole_ file, since the current position is no count but computed assuming constant samples per frame. */
 	/* Also, we can just keep the current buffer and seek settings. Just operate on input frames here. */
@@ -1438,11 +2430,25 @@ int attribute_align_arg mpg123_scan(mpg123_handle *mh)
 	debug("TODO: We should disable gapless code when encountering inconsistent mh->spf!");
 	debug("      ... at least unset MPG123_ACCURATE.");
 	/* Do not increment mh->track_frames in the loop as tha would confuse Frankenstein detection. */
+	/* Only headers are needed to count frames and fill the index. Each
+	   header found after skipping a body still has to pass the usual checks
+	   or cause a resync, so this counts the same frames as decoding would. */
+	mh->state_flags |= FRAME_SKIP_BODY;
+	b = mh->p.scan_threads > 1
+	?	scan_parallel(mh, &track_frames, &track_samples)
+	:	0;
+	if(b < 0)
+	{
+		mh->state_flags &= ~FRAME_SKIP_BODY;
+		return MPG123_ERR;
+	}
+	if(!b)
 	while(read_frame(mh) == 1)
 	{
 		++track_frames;
 		track_samples += mh->spf;
 	}
+	mh->state_flags &= ~FRAME_SKIP_BODY;
 	mh->track_frames = track_frames;
 	mh->track_samples = track_samples;
 	debug2("Scanning yielded %"OFF_P" track samples, %"OFF_P" frames.", (off_p)mh->track_samples, (off_p)mh->track_frames);
@@ -1459,6 +2465,15 @@ int attribute_align_arg mpg123_meta_check(mpg123_handle *mh)
 	else return 0;
 }
 
+int attribute_align_arg mpg123_meta_callback( mpg123_handle *mh
+,	void (*callback)(void *handle, int what), void *handle )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	mh->meta_callback = callback;
+	mh->meta_handle = handle;
+	return MPG123_OK;
+}
+
 void attribute_align_arg mpg123_meta_free(mpg123_handle *mh)
 {
 	if(mh == NULL) return;
@@ -1472,9 +2487,12 @@ int attribute_align_arg mpg123_id3(mpg123_handle *mh, mpg123_id3v1 **v1, mpg123_
 	if(v1 != NULL) *v1 = NULL;
 	if(v2 != NULL) *v2 = NULL;
 	if(mh == NULL) return MPG123_BAD_HANDLE;
+	/* An ID3v1 tag still to come with MPG123_PEEK_END_LATER. */
+	if(v1 != NULL && reader_tail(mh, 1) < 0) return MPG123_ERR;
 
 	if(mh->metaflags & MPG123_ID3)
 	{
+		id3_process_lazy(mh);
 		id3_link(mh);
 		if(v1 != NULL && mh->rdat.flags & READER_ID3TAG) *v1 = (mpg123_id3v1*) mh->id3buf;
 		if(v2 != NULL)
@@ -1490,12 +2508,42 @@ int attribute_align_arg mpg123_id3(mpg123_handle *mh, mpg123_id3v1 **v1, mpg123_
 	return MPG123_OK;
 }
 
+int attribute_align_arg mpg123_id3_text( mpg123_handle *mh
+,	const char *id, mpg123_string *sb )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(id == NULL || sb == NULL)
+	{
+		mh->err = MPG123_NULL_POINTER;
+		return MPG123_ERR;
+	}
+#ifndef NO_ID3V2
+	if(strlen(id) != 4)
+	{
+		mh->err = MPG123_BAD_KEY;
+		return MPG123_ERR;
+	}
+	if(!id3_text(mh, id, sb))
+	{
+		mpg123_free_string(sb);
+		mh->err = MPG123_BAD_KEY;
+		return MPG123_ERR;
+	}
+	return MPG123_OK;
+#else
+	mh->err = MPG123_MISSING_FEATURE;
+	return MPG123_ERR;
+#endif
+}
+
 int attribute_align_arg mpg123_id3_raw( mpg123_handle *mh
 ,	unsigned char **v1, size_t *v1_size
 ,	unsigned char **v2, size_t *v2_size )
 {
 	if(!mh)
 		return MPG123_ERR;
+	if((v1 != NULL || v1_size != NULL) && reader_tail(mh, 1) < 0)
+		return MPG123_ERR;
 	if(v1 != NULL)
 		*v1 = mh->id3buf[0] ? mh->id3buf : NULL;
 	if(v1_size != NULL)
@@ -1531,6 +2579,21 @@ int attribute_align_arg mpg123_icy(mpg123_handle *mh, char **icy_meta)
 #endif
 }
 
+int attribute_align_arg mpg123_icy_callback( mpg123_handle *mh
+,	void (*callback)(void *handle, const char *meta, size_t size)
+,	void *handle )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+#ifndef NO_ICY
+	mh->icy_callback = callback;
+	mh->icy_handle = handle;
+	return MPG123_OK;
+#else
+	mh->err = MPG123_MISSING_FEATURE;
+	return MPG123_ERR;
+#endif
+}
+
 char* attribute_align_arg mpg123_icy2utf8(const char* icy_text)
 {
 #ifndef NO_ICY
@@ -1644,6 +2707,255 @@ int attribute_align_arg mpg123_set_index(mpg123_handle *mh, off_t *offsets, off_
 #endif
 }
 
+#ifdef FRAME_INDEX
+/*
+	Stored index format: magic and version, the stream fingerprint, track
+	length, then the index with offsets as differences to the previous one,
+	all numbers as little endian base 128 varints. A 32 bit checksum over
+	everything before it closes the data.
+*/
+static const unsigned char index_magic[8] = { 'm','p','g','1','2','3','i','x' };
+#define INDEX_VERSION 1
+/* Fixed numbers after magic and version, see index_header(). */
+#define INDEX_FIELDS 10
+/* Largest value of the signed off_t. */
+#define INDEX_OFF_MAX (((uint64_t)1 << (8*sizeof(off_t)-1)) - 1)
+
+/* Append a varint (if there is room) and return the needed bytes. */
+static size_t put_varint(unsigned char *buf, size_t pos, size_t size, uint64_t val)
+{
+	size_t n = 0;
+	do
+	{
+		unsigned char b = val & 0x7f;
+		val >>= 7;
+		if(val)
+			b |= 0x80;
+		if(buf && pos+n < size)
+			buf[pos+n] = b;
+		++n;
+	} while(val);
+	return n;
+}
+
+/* Read a varint, returning 0 on overlong or truncated input. */
+static int get_varint(const unsigned char *buf, size_t size, size_t *pos, uint64_t *val)
+{
+	int shift;
+	*val = 0;
+	for(shift=0; shift<64 && *pos < size; shift+=7)
+	{
+		unsigned char b = buf[(*pos)++];
+		*val |= (uint64_t)(b & 0x7f) << shift;
+		if(!(b & 0x80))
+			return 1;
+	}
+	return 0;
+}
+
+/* The values describing the stream, counted in INDEX_FIELDS. Unknown (-1)
+   values are stored shifted by one to stay positive. */
+static void index_header(mpg123_handle *mh, uint64_t *field)
+{
+	field[0] = (uint64_t)(mh->rdat.filelen+1);
+	field[1] = (uint64_t)mh->audio_start;
+	field[2] = mh->firsthead;
+	field[3] = mh->audio_hash;
+	field[4] = (uint64_t)(mh->enc_delay+1);
+	field[5] = (uint64_t)(mh->enc_padding+1);
+	field[6] = (uint64_t)mh->track_frames;
+	field[7] = (uint64_t)(mh->track_samples+1);
+	field[8] = (uint64_t)mh->index.step;
+	field[9] = mh->index.fill;
+}
+#endif
+
+int attribute_align_arg mpg123_store_index( mpg123_handle *mh
+,	unsigned char *buf, size_t size, size_t *bytes )
+{
+#ifdef FRAME_INDEX
+	uint64_t field[INDEX_FIELDS];
+	unsigned long hash;
+	size_t pos = 0;
+	size_t i;
+	int b;
+#endif
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(bytes == NULL)
+	{
+		mh->err = MPG123_NULL_POINTER;
+		return MPG123_ERR;
+	}
+	*bytes = 0;
+#ifdef FRAME_INDEX
+	/* The fingerprint comes from the first frame. */
+	b = init_track(mh);
+	if(b < 0)
+		return b == MPG123_DONE ? MPG123_OK : MPG123_ERR;
+	if(mh->index.fill < 1)
+	{
+		mh->err = MPG123_INDEX_FAIL;
+		return MPG123_ERR;
+	}
+	index_header(mh, field);
+	if(buf != NULL && size >= sizeof(index_magic))
+		memcpy(buf, index_magic, sizeof(index_magic));
+	pos += sizeof(index_magic);
+	pos += put_varint(buf, pos, size, INDEX_VERSION);
+	for(i=0; i<INDEX_FIELDS; ++i)
+		pos += put_varint(buf, pos, size, field[i]);
+	for(i=0; i<mh->index.fill; ++i)
+		pos += put_varint( buf, pos, size
+		,	(uint64_t)(mh->index.data[i] - (i ? mh->index.data[i-1] : 0)) );
+	*bytes = pos+4;
+	/* Only the size was asked for. */
+	if(buf == NULL)
+		return MPG123_OK;
+	if(size < *bytes)
+	{
+		mh->err = MPG123_BAD_BUFFER;
+		return MPG123_ERR;
+	}
+	hash = fi_hash(0, buf, pos);
+	for(i=0; i<4; ++i)
+		buf[pos+i] = (hash >> (8*i)) & 0xff;
+	return MPG123_OK;
+#else
+	mh->err = MPG123_MISSING_FEATURE;
+	return MPG123_ERR;
+#endif
+}
+
+int attribute_align_arg mpg123_load_index( mpg123_handle *mh
+,	const unsigned char *buf, size_t size )
+{
+#ifdef FRAME_INDEX
+	uint64_t field[INDEX_FIELDS];
+	uint64_t want[INDEX_FIELDS];
+	uint64_t val;
+	unsigned long hash;
+	size_t pos, start, i;
+	off_t offset;
+	int b;
+#endif
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(buf == NULL)
+	{
+		mh->err = MPG123_NULL_POINTER;
+		return MPG123_ERR;
+	}
+#ifdef FRAME_INDEX
+	b = init_track(mh);
+	if(b < 0)
+		return b == MPG123_DONE ? MPG123_OK : MPG123_ERR;
+	if(  size < sizeof(index_magic)+4
+	  || memcmp(buf, index_magic, sizeof(index_magic)) )
+		goto load_index_bad;
+	size -= 4;
+	hash = (unsigned long)buf[size] | (unsigned long)buf[size+1]<<8
+	|	(unsigned long)buf[size+2]<<16 | (unsigned long)buf[size+3]<<24;
+	if(hash != fi_hash(0, buf, size))
+		goto load_index_bad;
+	pos = sizeof(index_magic);
+	if(!get_varint(buf, size, &pos, &val) || val != INDEX_VERSION)
+		goto load_index_bad;
+	for(i=0; i<INDEX_FIELDS; ++i)
+		if(!get_varint(buf, size, &pos, &field[i]))
+			goto load_index_bad;
+	/* The stream has to be the one the index was made from. Only the track
+	   length and the index itself are taken from the stored data. A feeder
+	   does not know the stream size, so an index stored from the file (or
+	   the other way round) only is checked by the remaining fingerprint. */
+	index_header(mh, want);
+	for(i=0; i<6; ++i)
+		if(  field[i] != want[i]
+		  && !(i == 0 && (field[0] <= 1 || want[0] <= 1)) )
+			goto load_index_bad;
+	if(  field[6] < 1 || field[6] > INDEX_OFF_MAX || field[7] > INDEX_OFF_MAX
+	  || field[8] < 1 || field[8] > INDEX_OFF_MAX || field[9] < 1
+	  || field[9] > SIZE_MAX/sizeof(off_t)
+	  || (field[9]-1) > (field[6]-1)/field[8] )
+		goto load_index_bad;
+	/* Check the offsets before touching the current index. */
+	start = pos;
+	offset = 0;
+	for(i=0; i<field[9]; ++i)
+	{
+		if(!get_varint(buf, size, &pos, &val) || val > INDEX_OFF_MAX-(uint64_t)offset)
+			goto load_index_bad;
+		offset += (off_t)val;
+		if((i && val == 0) || (mh->rdat.filelen > 0 && offset >= mh->rdat.filelen))
+			goto load_index_bad;
+	}
+	if(pos != size)
+		goto load_index_bad;
+	if(fi_set(&mh->index, NULL, (off_t)field[8], (size_t)field[9]) == -1)
+	{
+		mh->err = MPG123_OUT_OF_MEM;
+		return MPG123_ERR;
+	}
+	pos = start;
+	offset = 0;
+	for(i=0; i<field[9]; ++i)
+	{
+		get_varint(buf, size, &pos, &val);
+		offset += (off_t)val;
+		fi_add(&mh->index, offset);
+	}
+	mh->track_frames = (off_t)field[6];
+	mh->track_samples = (off_t)field[7]-1;
+	debug3("loaded index of %"SIZE_P" entries, %"OFF_P" frames, %"OFF_P" samples"
+	,	(size_p)mh->index.fill, (off_p)mh->track_frames, (off_p)mh->track_samples);
+#ifdef GAPLESS
+	if(mh->track_samples > 0 && (mh->p.flags & MPG123_GAPLESS))
+		frame_gapless_update(mh, mh->track_samples);
+#endif
+	return MPG123_OK;
+load_index_bad:
+	mh->err = MPG123_BAD_INDEX_DATA;
+	return MPG123_ERR;
+#else
+	mh->err = MPG123_MISSING_FEATURE;
+	return MPG123_ERR;
+#endif
+}
+
+int attribute_align_arg mpg123_snapshot( mpg123_handle *mh
+,	unsigned char *buf, size_t size, size_t *bytes )
+{
+	int b;
+
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(bytes == NULL)
+	{
+		mh->err = MPG123_NULL_POINTER;
+		return MPG123_ERR;
+	}
+	*bytes = 0;
+	b = init_track(mh);
+	if(b < 0)
+		return b == MPG123_DONE ? MPG123_OK : MPG123_ERR;
+	return snapshot_write(mh, buf, size, bytes);
+}
+
+int attribute_align_arg mpg123_restore( mpg123_handle *mh
+,	const unsigned char *buf, size_t size )
+{
+	int b;
+
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(buf == NULL)
+	{
+		mh->err = MPG123_NULL_POINTER;
+		return MPG123_ERR;
+	}
+	/* Decoder and gapless setup come with the first frame. */
+	b = init_track(mh);
+	if(b < 0)
+		return b == MPG123_DONE ? MPG123_OK : MPG123_ERR;
+	return snapshot_read(mh, buf, size);
+}
+
 int attribute_align_arg mpg123_close(mpg123_handle *mh)
 {
 	if(mh == NULL) return MPG123_BAD_HANDLE;
@@ -1659,6 +2971,7 @@ int attribute_align_arg mpg123_close(mpg123_handle *mh)
 	}
 	/* Always reset the frame buffers on close, so we cannot forget it in funky opening routines (wrappers, even). */
 	frame_reset(mh);
+	list_free(mh);
 	return MPG123_OK;
 }
 
@@ -1718,6 +3031,8 @@ static const char *mpg123_error[] =
 	,"Custom I/O obviously not prepared."
 	,"Overflow in LFS (large file support) conversion."
 	,"Overflow in integer conversion."
+	,"Stored frame index data is damaged or does not belong to this stream."
+	,"Decoder snapshot is damaged or does not match stream and decoder setup."
 };
 
 const char* attribute_align_arg mpg123_plain_strerror(int errcode)
@@ -11,7 +11,7 @@
 #define MPG123_H_INTERN
 
 #define MPG123_RATES 9
-#define MPG123_ENCODINGS 12
+#define MPG123_ENCODINGS 14
 
 #include "config.h" /* Load this before _anything_ */
 #include "intsym.h" /* Prefixing of internal symbols that still are public in a static lib. */
@@ -285,6 +285,7 @@ static inline int32_t scale_rounded(int32_t x, int shift)
 #include "decode.h"
 #include "parse.h"
 #include "frame.h"
+#include "tabshare.h"
 
 /* fr is a mpg123_handle* by convention here... */
 #define NOQUIET  (!(fr->p.flags & MPG123_QUIET))
@@ -28,6 +28,7 @@ static struct cpuflags cpu_flags;
 #define cpu_sse2(s)     1
 #define cpu_sse3(s)     1
 #define cpu_avx(s)      1
+#define cpu_avx512(s)   1
 #define cpu_neon(s)     1
 #endif
 
@@ -76,6 +77,84 @@ static int synth_stereo_wrap(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr
 	return clip;
 }
 
+/* The stereo synth over several time slots, SBLIMIT values apart. */
+static int synth_stereo_block_wrap(real *bandPtr_l, real *bandPtr_r, int count, mpg123_handle *fr)
+{
+	int clip = 0;
+	for(; count > 0; --count)
+	{
+		clip += (fr->synth_stereo)(bandPtr_l, bandPtr_r, fr);
+		bandPtr_l += SBLIMIT;
+		bandPtr_r += SBLIMIT;
+	}
+	return clip;
+}
+
+/* Optimized stereo synths come with a block variant that has the single
+   slot synth inlined. Anything else gets the generic loop. */
+static func_synth_stereo_block stereo_block(func_synth_stereo synth)
+{
+#ifdef OPT_AVX512
+#	ifndef NO_16BIT
+	if(synth == synth_1to1_stereo_avx512) return synth_1to1_stereo_avx512_block;
+#	endif
+#	ifndef NO_REAL
+	if(synth == synth_1to1_fltst_avx512) return synth_1to1_fltst_avx512_block;
+#	endif
+#	ifndef NO_32BIT
+	if(synth == synth_1to1_s32_stereo_avx512) return synth_1to1_s32_stereo_avx512_block;
+#	endif
+#endif
+#ifdef OPT_AVX
+#	ifndef NO_16BIT
+	if(synth == synth_1to1_stereo_avx) return synth_1to1_stereo_avx_block;
+#	endif
+#	ifndef NO_REAL
+	if(synth == synth_1to1_fltst_avx) return synth_1to1_fltst_avx_block;
+#	endif
+#	ifndef NO_32BIT
+	if(synth == synth_1to1_s32_stereo_avx) return synth_1to1_s32_stereo_avx_block;
+#	endif
+#endif
+#ifdef OPT_X86_64
+#	ifndef NO_16BIT
+	if(synth == synth_1to1_stereo_x86_64) return synth_1to1_stereo_x86_64_block;
+#	endif
+#	ifndef NO_REAL
+	if(synth == synth_1to1_real_stereo_x86_64) return synth_1to1_real_stereo_x86_64_block;
+#	endif
+#	ifndef NO_32BIT
+	if(synth == synth_1to1_s32_stereo_x86_64) return synth_1to1_s32_stereo_x86_64_block;
+#	endif
+#endif
+#ifdef OPT_NEON64
+#	ifndef NO_16BIT
+	if(synth == synth_1to1_stereo_neon64) return synth_1to1_stereo_neon64_block;
+#	endif
+#	ifndef NO_REAL
+	if(synth == synth_1to1_fltst_neon64) return synth_1to1_fltst_neon64_block;
+#		ifdef OPT_SVE
+	if(synth == synth_1to1_fltst_sve) return synth_1to1_fltst_sve_block;
+#		endif
+#	endif
+#	ifndef NO_32BIT
+	if(synth == synth_1to1_s32st_neon64) return synth_1to1_s32st_neon64_block;
+#	endif
+#endif
+#ifdef OPT_GENERIC_VECTOR
+#	ifndef NO_16BIT
+	if(synth == synth_1to1_stereo_vector) return synth_1to1_stereo_vector_block;
+#	endif
+#	ifndef NO_REAL
+	if(synth == synth_1to1_real_stereo_vector) return synth_1to1_real_stereo_vector_block;
+#	endif
+#	ifndef NO_32BIT
+	if(synth == synth_1to1_s32_stereo_vector) return synth_1to1_s32_stereo_vector_block;
+#	endif
+#endif
+	return synth_stereo_block_wrap;
+}
+
 static const struct synth_s synth_base =
 {
 	{ /* plain */
@@ -151,6 +230,7 @@ enum optcla decclass(const enum optdec type)
 		|| type == neon
 		|| type == neon64
 		|| type == avx
+		|| type == avx512
 	) ? mmxsse : normal;
 }
 
@@ -193,11 +273,41 @@ static int find_dectype(mpg123_handle *fr)
 	/* Direct and indirect usage, 1to1 stereo decoding.
 	   Concentrating on the plain stereo synth should be fine, mono stuff is derived. */
 	func_synth basic_synth = fr->synth;
+#if !defined(NO_NTOM) && !defined(REAL_IS_FIXED)
+	/* NtoM interpolates over the plain 1to1 synth (see synth_ntom.h), which
+	   needs its tables. Only 8 bit output is still done the old way. */
+	if(fr->down_sample == 3 && !(fr->af.dec_enc & MPG123_ENC_8))
+	basic_synth = fr->ntom_synth;
+#endif
 #ifndef NO_8BIT
 #ifndef NO_16BIT
 	if(basic_synth == synth_1to1_8bit_wrap)
 	basic_synth = fr->synths.plain[r_1to1][f_16]; /* That is what's really below the surface. */
 #endif
+#endif
+#ifndef NO_32BIT
+	if(basic_synth == synth_1to1_s24_wrap)
+	basic_synth = fr->synths.plain[r_1to1][f_32];
+#endif
+#if defined(OPT_DITHER) && !defined(NO_16BIT) && !defined(NO_REAL)
+	if(basic_synth == synth_1to1_dither_wrap)
+	basic_synth = fr->synths.plain[r_1to1][f_real];
+#endif
+#ifndef NO_DOWNSAMPLE
+#ifndef NO_16BIT
+	if(basic_synth == synth_2to1_pick || basic_synth == synth_4to1_pick)
+	basic_synth = fr->synths.plain[r_1to1][f_16];
+#endif
+#ifndef NO_SYNTH32
+#ifndef NO_REAL
+	if(basic_synth == synth_2to1_real_pick || basic_synth == synth_4to1_real_pick)
+	basic_synth = fr->synths.plain[r_1to1][f_real];
+#endif
+#ifndef NO_32BIT
+	if(basic_synth == synth_2to1_s32_pick || basic_synth == synth_4to1_s32_pick)
+	basic_synth = fr->synths.plain[r_1to1][f_32];
+#endif
+#endif
 #endif
 
 	if(FALSE) ; /* Just to initialize the else if ladder. */
@@ -250,6 +360,9 @@ static int find_dectype(mpg123_handle *fr)
 #ifdef OPT_AVX
 	else if(basic_synth == synth_1to1_avx) type = avx;
 #endif
+#ifdef OPT_AVX512
+	else if(basic_synth == synth_1to1_avx512) type = avx512;
+#endif
 #ifdef OPT_ARM
 	else if(basic_synth == synth_1to1_arm) type = arm;
 #endif
@@ -259,6 +372,9 @@ static int find_dectype(mpg123_handle *fr)
 #ifdef OPT_NEON64
 	else if(basic_synth == synth_1to1_neon64) type = neon64;
 #endif
+#ifdef OPT_GENERIC_VECTOR
+	else if(basic_synth == synth_1to1_vector) type = generic_vector;
+#endif
 #ifdef OPT_GENERIC_DITHER
 	else if(basic_synth == synth_1to1_dither) type = generic_dither;
 #endif
@@ -288,6 +404,9 @@ static int find_dectype(mpg123_handle *fr)
 #ifdef OPT_AVX
 	else if(basic_synth == synth_1to1_real_avx) type = avx;
 #endif
+#ifdef OPT_AVX512
+	else if(basic_synth == synth_1to1_real_avx512) type = avx512;
+#endif
 #ifdef OPT_ALTIVEC
 	else if(basic_synth == synth_1to1_real_altivec) type = altivec;
 #endif
@@ -297,6 +416,12 @@ static int find_dectype(mpg123_handle *fr)
 #ifdef OPT_NEON64
 	else if(basic_synth == synth_1to1_real_neon64) type = neon64;
 #endif
+#ifdef OPT_SVE
+	else if(basic_synth == synth_1to1_real_sve) type = neon64;
+#endif
+#ifdef OPT_GENERIC_VECTOR
+	else if(basic_synth == synth_1to1_real_vector) type = generic_vector;
+#endif
 
 #endif /* real */
 
@@ -313,6 +438,9 @@ static int find_dectype(mpg123_handle *fr)
 #ifdef OPT_AVX
 	else if(basic_synth == synth_1to1_s32_avx) type = avx;
 #endif
+#ifdef OPT_AVX512
+	else if(basic_synth == synth_1to1_s32_avx512) type = avx512;
+#endif
 #ifdef OPT_ALTIVEC
 	else if(basic_synth == synth_1to1_s32_altivec) type = altivec;
 #endif
@@ -322,6 +450,9 @@ static int find_dectype(mpg123_handle *fr)
 #ifdef OPT_NEON64
 	else if(basic_synth == synth_1to1_s32_neon64) type = neon64;
 #endif
+#ifdef OPT_GENERIC_VECTOR
+	else if(basic_synth == synth_1to1_s32_vector) type = generic_vector;
+#endif
 #endif /* 32bit */
 
 #endif /* any 32 bit synth */
@@ -359,11 +490,37 @@ static int find_dectype(mpg123_handle *fr)
 	}
 }
 
+/* Table functions only exist for the layers that are built in. */
+#ifndef NO_LAYER3
+#define L3_TABLE(f) f
+#else
+#define L3_TABLE(f) NULL
+#endif
+#ifndef NO_LAYER12
+#define L12_TABLE(f) f
+#else
+#define L12_TABLE(f) NULL
+#endif
+
+/* The layer tables depend on the decoder (and its table variant) and the
+   downsampling setup. Only when that changes, the work has to be done again. */
+static int tables_differ(mpg123_handle *fr, void (*make_tables)(mpg123_handle *))
+{
+	return fr->tables_scale < 0
+	||	fr->make_decode_tables != make_tables
+	||	fr->tables_type != fr->cpu_opts.type
+	||	fr->tables_sblimit != fr->down_sample_sblimit
+	||	fr->tables_down != fr->p.down_sample;
+}
+
 /* set synth functions for current frame, optimizations handled by opt_* macros */
 int set_synth_functions(mpg123_handle *fr)
 {
 	enum synth_resample resample = r_none;
 	enum synth_format basic_format = f_none; /* Default is always 16bit, or whatever. */
+#ifdef OPT_MMXORSSE
+	enum synth_format synth_format; /* What the synth below any wrapper produces. */
+#endif
 
 	/* Select the basic output format, different from 16bit: 8bit, real. */
 	if(FALSE){}
@@ -413,13 +570,84 @@ int set_synth_functions(mpg123_handle *fr)
 		return -1;
 	}
 
+#ifdef OPT_MULTI
+	if(fr->cpu_opts.tune)
+	{
+		const char *fastest = fastest_decoder(basic_format);
+		if(fastest != NULL && dectype(fastest) != fr->cpu_opts.type)
+		{
+			if(frame_cpu_opt(fr, fastest) != 1)
+			{
+				fr->err = MPG123_BAD_DECODER_SETUP;
+				return MPG123_ERR;
+			}
+			fr->cpu_opts.tune = 1;
+		}
+	}
+#endif
+
+#ifndef NO_32BIT
+	/* Signed 24 bit at the native rate is packed by synth wrappers, the
+	   rest goes through 32 bit and postprocessing. */
+	if(basic_format == f_32 && fr->af.encoding == MPG123_ENC_SIGNED_24)
+	{
+		fr->af.dec_enc = resample == r_1to1
+		?	MPG123_ENC_SIGNED_24
+		:	MPG123_ENC_SIGNED_32;
+		fr->af.dec_encsize = mpg123_encsize(fr->af.dec_enc);
+	}
+#endif
+
+#ifdef OPT_MMXORSSE
+	synth_format = basic_format;
+#endif
 	debug2("selecting synth: resample=%i format=%i", resample, basic_format);
 	/* Finally selecting the synth functions for stereo / mono. */
 	fr->synth = fr->synths.plain[resample][basic_format];
 	fr->synth_stereo = fr->synths.stereo[resample][basic_format];
+	fr->synth_stereo_block = stereo_block(fr->synth_stereo);
 	fr->synth_mono = fr->af.channels==2
 		? fr->synths.mono2stereo[resample][basic_format] /* Mono MPEG file decoded to stereo. */
 		: fr->synths.mono[resample][basic_format];       /* Mono MPEG file decoded to mono. */
+#ifndef NO_32BIT
+	if(fr->af.dec_enc == MPG123_ENC_SIGNED_24)
+	{
+		fr->synth_base_block = fr->synth_stereo_block;
+		fr->synth = synth_1to1_s24_wrap;
+		fr->synth_stereo = synth_1to1_s24_stereo_wrap;
+		fr->synth_stereo_block = synth_1to1_s24_stereo_block_wrap;
+		fr->synth_mono = fr->af.channels==2
+			? synth_1to1_s24_wrap_m2s
+			: synth_1to1_s24_wrap_mono;
+	}
+#endif
+#if defined(OPT_DITHER) && !defined(NO_16BIT) && !defined(NO_REAL)
+	/* Dither on top of the float synth, unless the decoder does it already. */
+	if(  fr->p.flags & MPG123_DITHER && basic_format == f_16 && resample == r_1to1
+	  && fr->cpu_opts.type != generic_dither && fr->cpu_opts.type != ifuenf_dither )
+	{
+		if(!frame_dither_init(fr))
+		{
+			fr->err = MPG123_OUT_OF_MEM;
+			return MPG123_ERR;
+		}
+#ifdef OPT_MMXORSSE
+		synth_format = f_real;
+#endif
+		fr->synth_base_block = stereo_block(fr->synths.stereo[r_1to1][f_real]);
+		fr->synth = synth_1to1_dither_wrap;
+		fr->synth_stereo = synth_1to1_dither_stereo_wrap;
+		fr->synth_stereo_block = synth_1to1_dither_stereo_block_wrap;
+		fr->synth_mono = fr->af.channels==2
+			? synth_1to1_dither_wrap_m2s
+			: synth_1to1_dither_wrap_mono;
+	}
+#endif
+#ifndef NO_NTOM
+	/* The ntom synths interpolate over what the plain synth of the chosen
+	   decoder produces, so they run with the same optimizations. */
+	fr->ntom_synth = fr->synths.plain[r_1to1][basic_format];
+#endif
 
 	if(find_dectype(fr) != MPG123_OK) /* Actually determine the currently active decoder breed. */
 	{
@@ -452,10 +680,10 @@ int set_synth_functions(mpg123_handle *fr)
 	   The real-decoding SSE for x86-64 uses normal tables! */
 	if(fr->cpu_opts.class == mmxsse
 #	ifndef NO_REAL
-	   && basic_format != f_real
+	   && synth_format != f_real
 #	endif
 #	ifndef NO_32BIT
-	   && basic_format != f_32
+	   && synth_format != f_32
 #	endif
 #	ifdef ACCURATE_ROUNDING
 	   && fr->cpu_opts.type != sse
@@ -464,33 +692,51 @@ int set_synth_functions(mpg123_handle *fr)
 	   && fr->cpu_opts.type != neon
 	   && fr->cpu_opts.type != neon64
 	   && fr->cpu_opts.type != avx
+#	endif
+#	ifdef OPT_AVX512
+	   /* The AVX-512 synths only exist in the float table variant. */
+	   && fr->cpu_opts.type != avx512
 #	endif
 	  )
 	{
-#ifndef NO_LAYER3
-		init_layer3_stuff(fr, init_layer3_gainpow2_mmx);
-#endif
-#ifndef NO_LAYER12
-		init_layer12_stuff(fr, init_layer12_table_mmx);
-#endif
-		fr->make_decode_tables = make_decode_tables_mmx;
+		if(tables_differ(fr, make_decode_tables_mmx))
+		{
+			if(tab_layer( fr, L3_TABLE(init_layer3_gainpow2_mmx)
+			,	L12_TABLE(init_layer12_table_mmx) ))
+				goto tables_fail;
+			fr->make_decode_tables = make_decode_tables_mmx;
+			fr->tables_scale = -1;
+		}
 	}
 	else
 #endif
 	{
-#ifndef NO_LAYER3
-		init_layer3_stuff(fr, init_layer3_gainpow2);
-#endif
-#ifndef NO_LAYER12
-		init_layer12_stuff(fr, init_layer12_table);
-#endif
-		fr->make_decode_tables = make_decode_tables;
+		if(tables_differ(fr, make_decode_tables))
+		{
+			if(tab_layer( fr, L3_TABLE(init_layer3_gainpow2)
+			,	L12_TABLE(init_layer12_table) ))
+				goto tables_fail;
+			fr->make_decode_tables = make_decode_tables;
+			fr->tables_scale = -1;
+		}
 	}
+	fr->tables_type = fr->cpu_opts.type;
+	fr->tables_sblimit = fr->down_sample_sblimit;
+	fr->tables_down = fr->p.down_sample;
 
-	/* We allocated the table buffers just now, so (re)create the tables. */
-	fr->make_decode_tables(fr);
-
+	/* (Re)create the tables, unless a previous track left the same ones. */
+	if(frame_decode_tables(fr) != 0)
+	{
+		fr->err = MPG123_NO_BUFFERS;
+		return MPG123_ERR;
+	}
 	return 0;
+
+tables_fail:
+	fr->tables_scale = -1;
+	fr->err = MPG123_NO_BUFFERS;
+	if(NOQUIET) error("Failed to set up layer tables!");
+	return MPG123_ERR;
 }
 
 int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
@@ -505,6 +751,10 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 
 	want_dec = dectype(cpu);
 	auto_choose = want_dec == autodec;
+#ifdef OPT_MULTI
+	/* The automatic choice stays until set_synth_functions() knows the format to time. */
+	fr->cpu_opts.tune = cpu != NULL && !strcasecmp(cpu, "fastest");
+#endif
 	/* Fill whole array of synth functions with generic code first. */
 	fr->synths = synth_base;
 
@@ -524,6 +774,16 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 #if (defined OPT_3DNOW_VINTAGE || defined OPT_3DNOWEXT_VINTAGE || defined OPT_SSE || defined OPT_X86_64 || defined OPT_AVX || defined OPT_NEON || defined OPT_NEON64)
 	fr->cpu_opts.the_dct36 = dct36;
 #endif
+#if (defined OPT_X86_64 || defined OPT_AVX || defined OPT_AVX512)
+	fr->cpu_opts.the_antialias = antialias;
+	fr->cpu_opts.the_dct12_quad = dct12_quad;
+	fr->cpu_opts.the_hybrid_tail = hybrid_tail;
+	fr->cpu_opts.the_i_stereo = i_stereo_generic;
+	fr->cpu_opts.the_ms_stereo = ms_stereo_generic;
+#endif
+#ifdef OPT_GENERIC_VECTOR
+	fr->cpu_opts.the_dct36_quad = NULL;
+#endif
 #endif
 #endif
 	/* covers any i386+ cpu; they actually differ only in the synth_1to1 function, mostly... */
@@ -734,6 +994,37 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 
 #endif /* OPT_X86 */
 
+#ifdef OPT_AVX512
+	if(!done && (auto_choose || want_dec == avx512) && cpu_avx512(cpu_flags))
+	{
+		chosen = "x86-64 (AVX-512)";
+		fr->cpu_opts.type = avx512;
+#ifdef OPT_MULTI
+#		ifndef NO_LAYER3
+		fr->cpu_opts.the_dct36 = dct36_avx;
+		fr->cpu_opts.the_antialias = antialias_x86_64;
+		fr->cpu_opts.the_dct12_quad = dct12_quad_x86_64;
+		fr->cpu_opts.the_hybrid_tail = hybrid_tail_x86_64;
+		fr->cpu_opts.the_i_stereo = i_stereo_x86_64;
+		fr->cpu_opts.the_ms_stereo = ms_stereo_x86_64;
+#		endif
+#endif
+#		ifndef NO_16BIT
+		fr->synths.plain[r_1to1][f_16] = synth_1to1_avx512;
+		fr->synths.stereo[r_1to1][f_16] = synth_1to1_stereo_avx512;
+#		endif
+#		ifndef NO_REAL
+		fr->synths.plain[r_1to1][f_real] = synth_1to1_real_avx512;
+		fr->synths.stereo[r_1to1][f_real] = synth_1to1_fltst_avx512;
+#		endif
+#		ifndef NO_32BIT
+		fr->synths.plain[r_1to1][f_32] = synth_1to1_s32_avx512;
+		fr->synths.stereo[r_1to1][f_32] = synth_1to1_s32_stereo_avx512;
+#		endif
+		done = 1;
+	}
+#endif
+
 #ifdef OPT_AVX
 	if(!done && (auto_choose || want_dec == avx) && cpu_avx(cpu_flags))
 	{
@@ -742,6 +1033,11 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 #ifdef OPT_MULTI
 #		ifndef NO_LAYER3
 		fr->cpu_opts.the_dct36 = dct36_avx;
+		fr->cpu_opts.the_antialias = antialias_x86_64;
+		fr->cpu_opts.the_dct12_quad = dct12_quad_x86_64;
+		fr->cpu_opts.the_hybrid_tail = hybrid_tail_x86_64;
+		fr->cpu_opts.the_i_stereo = i_stereo_x86_64;
+		fr->cpu_opts.the_ms_stereo = ms_stereo_x86_64;
 #		endif
 #endif
 #		ifndef NO_16BIT
@@ -768,6 +1064,11 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 #ifdef OPT_MULTI
 #		ifndef NO_LAYER3
 		fr->cpu_opts.the_dct36 = dct36_x86_64;
+		fr->cpu_opts.the_antialias = antialias_x86_64;
+		fr->cpu_opts.the_dct12_quad = dct12_quad_x86_64;
+		fr->cpu_opts.the_hybrid_tail = hybrid_tail_x86_64;
+		fr->cpu_opts.the_i_stereo = i_stereo_x86_64;
+		fr->cpu_opts.the_ms_stereo = ms_stereo_x86_64;
 #		endif
 #endif
 #		ifndef NO_16BIT
@@ -862,6 +1163,15 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 #		ifndef NO_REAL
 		fr->synths.plain[r_1to1][f_real] = synth_1to1_real_neon64;
 		fr->synths.stereo[r_1to1][f_real] = synth_1to1_fltst_neon64;
+#			ifdef OPT_SVE
+		/* Same dct64, with a synth that has one output sample per lane. */
+		if(cpu_sve(cpu_flags))
+		{
+			chosen = "NEON64 (SVE)";
+			fr->synths.plain[r_1to1][f_real] = synth_1to1_real_sve;
+			fr->synths.stereo[r_1to1][f_real] = synth_1to1_fltst_sve;
+		}
+#			endif
 #		endif
 #		ifndef NO_32BIT
 		fr->synths.plain[r_1to1][f_32] = synth_1to1_s32_neon64;
@@ -871,6 +1181,32 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 	}
 #	endif
 
+#	ifdef OPT_GENERIC_VECTOR
+	if(!done && (auto_choose || want_dec == generic_vector))
+	{
+		chosen = dn_generic_vector;
+		fr->cpu_opts.type = generic_vector;
+#ifdef OPT_MULTI
+#		ifndef NO_LAYER3
+		fr->cpu_opts.the_dct36_quad = dct36_quad_vector;
+#		endif
+#endif
+#		ifndef NO_16BIT
+		fr->synths.plain[r_1to1][f_16] = synth_1to1_vector;
+		fr->synths.stereo[r_1to1][f_16] = synth_1to1_stereo_vector;
+#		endif
+#		ifndef NO_REAL
+		fr->synths.plain[r_1to1][f_real] = synth_1to1_real_vector;
+		fr->synths.stereo[r_1to1][f_real] = synth_1to1_real_stereo_vector;
+#		endif
+#		ifndef NO_32BIT
+		fr->synths.plain[r_1to1][f_32] = synth_1to1_s32_vector;
+		fr->synths.stereo[r_1to1][f_32] = synth_1to1_s32_stereo_vector;
+#		endif
+		done = 1;
+	}
+#	endif
+
 #	ifdef OPT_GENERIC
 	if(!done && (auto_choose || want_dec == generic))
 	{
@@ -913,6 +1249,41 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 #	endif
 #	endif
 
+#	ifndef NO_DOWNSAMPLE
+	/* Decoders with their own stereo synth (the SIMD ones) are faster
+	   down-sampling by picking from their full synth than the scalar 2to1
+	   and 4to1 code. Mono output wraps over the plain ones. */
+#	ifndef NO_16BIT
+	if(fr->synths.stereo[r_1to1][f_16] != synth_base.stereo[r_1to1][f_16])
+	{
+		fr->synths.plain[r_2to1][f_16] = synth_2to1_pick;
+		fr->synths.stereo[r_2to1][f_16] = synth_2to1_stereo_pick;
+		fr->synths.plain[r_4to1][f_16] = synth_4to1_pick;
+		fr->synths.stereo[r_4to1][f_16] = synth_4to1_stereo_pick;
+	}
+#	endif
+#	ifndef NO_SYNTH32
+#	ifndef NO_REAL
+	if(fr->synths.stereo[r_1to1][f_real] != synth_base.stereo[r_1to1][f_real])
+	{
+		fr->synths.plain[r_2to1][f_real] = synth_2to1_real_pick;
+		fr->synths.stereo[r_2to1][f_real] = synth_2to1_real_stereo_pick;
+		fr->synths.plain[r_4to1][f_real] = synth_4to1_real_pick;
+		fr->synths.stereo[r_4to1][f_real] = synth_4to1_real_stereo_pick;
+	}
+#	endif
+#	ifndef NO_32BIT
+	if(fr->synths.stereo[r_1to1][f_32] != synth_base.stereo[r_1to1][f_32])
+	{
+		fr->synths.plain[r_2to1][f_32] = synth_2to1_s32_pick;
+		fr->synths.stereo[r_2to1][f_32] = synth_2to1_s32_stereo_pick;
+		fr->synths.plain[r_4to1][f_32] = synth_4to1_s32_pick;
+		fr->synths.stereo[r_4to1][f_32] = synth_4to1_s32_stereo_pick;
+	}
+#	endif
+#	endif
+#	endif
+
 #ifdef OPT_DITHER
 	if(done && dithered)
 	{
@@ -943,6 +1314,10 @@ enum optdec dectype(const char* decoder)
 	if(   (decoder == NULL)
 	   || (decoder[0] == 0) )
 	return autodec;
+#ifdef OPT_MULTI
+	if(!strcasecmp(decoder, "fastest"))
+	return autodec;
+#endif
 
 	for(dt=autodec; dt<nodec; ++dt)
 	if(!strcasecmp(decoder, decname[dt])) return dt;
@@ -991,6 +1366,9 @@ static const char *mpg123_supported_decoder_list[] =
 	#ifdef OPT_ALTIVEC
 	NULL,
 	#endif
+	#ifdef OPT_AVX512
+	NULL,
+	#endif
 	#ifdef OPT_AVX
 	NULL,
 	#endif
@@ -1006,6 +1384,9 @@ static const char *mpg123_supported_decoder_list[] =
 	#ifdef OPT_NEON64
 	NULL,
 	#endif
+	#ifdef OPT_GENERIC_VECTOR
+	NULL,
+	#endif
 	#ifdef OPT_GENERIC_FLOAT
 	NULL,
 	#endif
@@ -1057,6 +1438,9 @@ static const char *mpg123_decoder_list[] =
 	#ifdef OPT_ALTIVEC
 	dn_altivec,
 	#endif
+	#ifdef OPT_AVX512
+	dn_avx512,
+	#endif
 	#ifdef OPT_AVX
 	dn_avx,
 	#endif
@@ -1072,6 +1456,9 @@ static const char *mpg123_decoder_list[] =
 	#ifdef OPT_NEON64
 	dn_neon64,
 	#endif
+	#ifdef OPT_GENERIC_VECTOR
+	dn_generic_vector,
+	#endif
 	#ifdef OPT_GENERIC
 	dn_generic,
 	#endif
@@ -1136,6 +1523,9 @@ void check_decoders(void )
 #ifdef OPT_I386
 	*(d++) = dn_idrei;
 #endif
+#ifdef OPT_AVX512
+	if(cpu_avx512(cpu_flags)) *(d++) = dn_avx512;
+#endif
 #ifdef OPT_AVX
 	if(cpu_avx(cpu_flags)) *(d++) = dn_avx;
 #endif
@@ -1151,6 +1541,9 @@ void check_decoders(void )
 #ifdef OPT_NEON64
 	if(cpu_neon(cpu_flags)) *(d++) = dn_neon64;
 #endif
+#ifdef OPT_GENERIC_VECTOR
+	*(d++) = dn_generic_vector;
+#endif
 #ifdef OPT_GENERIC
 	*(d++) = dn_generic;
 #endif
@@ -1171,6 +1564,7 @@ const char attribute_align_arg **mpg123_decoders(void){ return mpg123_decoder_li
 const char attribute_align_arg **mpg123_supported_decoders(void)
 {
 #ifdef OPT_MULTI
+	mpg123_init(); /* The list is filled by check_decoders(). */
 	return mpg123_supported_decoder_list;
 #else
 	return mpg123_decoder_list;
@@ -24,6 +24,9 @@
 	OPT_ALTIVEC (Motorola/IBM PPC with AltiVec under MacOSX)
 	OPT_X86_64 (x86-64 / AMD64 / Intel 64)
 	OPT_AVX
+	OPT_AVX512 (only together with OPT_AVX)
+	OPT_SVE (only together with OPT_NEON64 in OPT_MULTI)
+	OPT_GENERIC_VECTOR (C with GCC/Clang vector extensions, for any target)
 
 	or you define OPT_MULTI and give a combination which makes sense (do not include i486, do not mix altivec and x86).
 
@@ -61,9 +64,11 @@ perl <<'EOT'
 ,['arm','ARM']
 ,['neon','NEON']
 ,['avx','AVX']
+,['avx512','AVX512']
 ,['dreidnow_vintage', '3DNow_vintage']
 ,['dreidnowext_vintage', '3DNowExt_vintage']
 ,['sse_vintage', 'SSE_vintage']
+,['generic_vector', 'generic_vector']
 ,['nodec', 'nodec']
 );
 
@@ -110,9 +115,11 @@ enum optdec
 	,neon
 	,neon64
 	,avx
+	,avx512
 	,dreidnow_vintage
 	,dreidnowext_vintage
 	,sse_vintage
+	,generic_vector
 	,nodec
 };
 #ifdef I_AM_OPTIMIZE
@@ -133,9 +140,11 @@ static const char dn_arm[] = "ARM";
 static const char dn_neon[] = "NEON";
 static const char dn_neon64[] = "NEON64";
 static const char dn_avx[] = "AVX";
+static const char dn_avx512[] = "AVX512";
 static const char dn_dreidnow_vintage[] = "3DNow_vintage";
 static const char dn_dreidnowext_vintage[] = "3DNowExt_vintage";
 static const char dn_sse_vintage[] = "SSE_vintage";
+static const char dn_generic_vector[] = "generic_vector";
 static const char dn_nodec[] = "nodec";
 static const char* decname[] =
 {
@@ -156,9 +165,11 @@ static const char* decname[] =
 	,dn_neon
 	,dn_neon64
 	,dn_avx
+	,dn_avx512
 	,dn_dreidnow_vintage
 	,dn_dreidnowext_vintage
 	,dn_sse_vintage
+	,dn_generic_vector
 	,dn_nodec
 };
 #endif
@@ -171,6 +182,9 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu);
 int set_synth_functions(mpg123_handle *fr);
 /*  - Parse decoder name and return numerical code. */
 enum optdec dectype(const char* decoder);
+/*  - Time the supported decoders for an output format (enum synth_format) and return the
+      name of the fastest, cached after the first time. NULL if not possible. See tune.c. */
+const char *fastest_decoder(int format);
 /*  - Return the default decoder type. */
 enum optdec defdec(void);
 /*  - Return the class of a decoder type (mmxsse or normal). */
@@ -194,7 +208,8 @@ enum optcla decclass(const enum optdec);
  || (defined OPT_3DNOW_VINTAGE) || (defined OPT_3DNOWEXT_VINTAGE) \
  || (defined OPT_SSE_VINTAGE) \
  || (defined OPT_NEON) || (defined OPT_NEON64) || (defined OPT_AVX) \
- || (defined OPT_GENERIC_DITHER)
+ || (defined OPT_AVX512) \
+ || (defined OPT_GENERIC_DITHER) || (defined OPT_GENERIC_VECTOR)
 #error "Bad decoder choice together with fixed point math!"
 #endif
 #endif
@@ -216,6 +231,14 @@ enum optcla decclass(const enum optdec);
 #endif
 #endif
 
+#ifdef OPT_GENERIC_VECTOR
+#ifndef OPT_MULTI
+#	define defopt generic_vector
+#	define opt_dct36_quad(fr) dct36_quad_vector
+#	define opt_has_dct36_quad(fr) 1
+#endif
+#endif
+
 /* i486 is special... always alone! */
 #ifdef OPT_I486
 #define OPT_X86
@@ -331,6 +354,11 @@ extern const int costab_mmxsse[];
 #ifndef OPT_MULTI
 #	define defopt x86_64
 #	define opt_dct36(fr) dct36_x86_64
+#	define opt_antialias(fr) antialias_x86_64
+#	define opt_dct12_quad(fr) dct12_quad_x86_64
+#	define opt_hybrid_tail(fr) hybrid_tail_x86_64
+#	define opt_i_stereo(fr) i_stereo_x86_64
+#	define opt_ms_stereo(fr) ms_stereo_x86_64
 #endif
 #endif
 
@@ -339,6 +367,19 @@ extern const int costab_mmxsse[];
 #ifndef OPT_MULTI
 #	define defopt avx
 #	define opt_dct36(fr) dct36_avx
+#	define opt_antialias(fr) antialias_x86_64
+#	define opt_dct12_quad(fr) dct12_quad_x86_64
+#	define opt_hybrid_tail(fr) hybrid_tail_x86_64
+#	define opt_i_stereo(fr) i_stereo_x86_64
+#	define opt_ms_stereo(fr) ms_stereo_x86_64
+#endif
+#endif
+
+#ifdef OPT_AVX512
+#define OPT_MMXORSSE
+#ifndef OPT_MULTI
+#	undef defopt
+#	define defopt avx512
 #endif
 #endif
 
@@ -377,15 +418,34 @@ void check_decoders(void);
 
 #	define defopt nodec
 
-#	if (defined OPT_3DNOW_VINTAGE || defined OPT_3DNOWEXT_VINTAGE || defined OPT_SSE || defined OPT_X86_64 || defined OPT_AVX || defined OPT_NEON || defined OPT_NEON64)
+#	if (defined OPT_3DNOW_VINTAGE || defined OPT_3DNOWEXT_VINTAGE || defined OPT_SSE || defined OPT_X86_64 || defined OPT_AVX || defined OPT_AVX512 || defined OPT_NEON || defined OPT_NEON64)
 #		define opt_dct36(fr) ((fr)->cpu_opts.the_dct36)
 #	endif
+#	if (defined OPT_X86_64 || defined OPT_AVX || defined OPT_AVX512)
+#		define opt_antialias(fr) ((fr)->cpu_opts.the_antialias)
+#		define opt_dct12_quad(fr) ((fr)->cpu_opts.the_dct12_quad)
+#		define opt_hybrid_tail(fr) ((fr)->cpu_opts.the_hybrid_tail)
+#		define opt_i_stereo(fr) ((fr)->cpu_opts.the_i_stereo)
+#		define opt_ms_stereo(fr) ((fr)->cpu_opts.the_ms_stereo)
+#	endif
+/* Only there with some decoders, NULL otherwise. */
+#	ifdef OPT_GENERIC_VECTOR
+#		define opt_dct36_quad(fr) ((fr)->cpu_opts.the_dct36_quad)
+#		define opt_has_dct36_quad(fr) ((fr)->cpu_opts.the_dct36_quad != NULL)
+#	endif
 
 #endif /* OPT_MULTI else */
 
 #	ifndef opt_dct36
 #		define opt_dct36(fr) dct36
 #	endif
+#	ifndef opt_antialias
+#		define opt_antialias(fr) antialias
+#		define opt_dct12_quad(fr) dct12_quad
+#		define opt_hybrid_tail(fr) hybrid_tail
+#		define opt_i_stereo(fr) i_stereo_generic
+#		define opt_ms_stereo(fr) ms_stereo_generic
+#	endif
 
 #endif /* MPG123_H_OPTIMIZE */
 
@@ -0,0 +1,646 @@
+/*
+	parallel: decode a whole file using multiple handles on worker threads
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The idea is simple: Scan the file once to get the frame index and the
+	exact (gapless) track length, then cut the output sample range into
+	pieces. Each piece gets its own handle with the parameters of the master
+	handle and a copy of the index, seeks to the start of its piece and
+	decodes until the piece is filled. The usual seek machinery takes care
+	of decoding MPG123_PREFRAMES worth of frames before the target to refill
+	the bit reservoir and the synth/overlap buffers, so the pieces fit
+	together sample-exactly.
+
+	The scan of a big file for mpg123_scan() works on byte ranges instead,
+	see scan_parallel() below.
+
+	Streams from custom I/O work the same when the client can duplicate the
+	I/O handle: Each worker (of the scan and of the decoding) reads through
+	a copy of its own, which is the way to have a remote resource fetched
+	in byte ranges over several connections at once.
+*/
+
+#include "mpg123lib_intern.h"
+#include "threads.h"
+#include <sys/stat.h>
+
+#include "debug.h"
+
+/* Do not bother with pieces smaller than this many frames. */
+#define MIN_CHUNK_FRAMES 16
+
+struct parallel_chunk
+{
+	mpg123_handle *master;
+	mpg123_handle *wh; /* worker handle */
+	const char *path; /* NULL for a copy of the I/O handle of the master */
+	off_t *index;
+	off_t step;
+	size_t fill;
+	long rate; /* output format of the master handle */
+	int channels;
+	int encoding;
+	off_t begin; /* first output sample */
+	unsigned char *out;
+	size_t want; /* bytes to decode */
+	size_t got;
+	int err;
+};
+
+static int chunk_error(struct parallel_chunk *c, int err)
+{
+	c->err = err;
+	if(c->wh)
+		mpg123_delete(c->wh);
+	c->wh = NULL;
+	return err;
+}
+
+/* Prepare the handle for one piece of output. This is done in the calling
+   thread, as decoder setup touches shared CPU detection state. */
+static int open_chunk(struct parallel_chunk *c)
+{
+	mpg123_handle *mh = c->master;
+	long rate;
+	int channels, encoding;
+	int err = MPG123_OK;
+
+	c->got = 0;
+	c->wh = mpg123_parnew(&mh->p, mpg123_current_decoder(mh), &err);
+	if(c->wh == NULL)
+		return chunk_error(c, err);
+	if(c->path == NULL)
+	{
+		void *io = mh->rdat.dup_handle(mh->rdat.iohandle);
+		if(io == NULL)
+			return chunk_error(c, MPG123_BAD_CUSTOM_IO);
+		/* The worker owns the copy, also when opening fails. */
+		if(mpg123_reader64( c->wh, mh->rdat.r_read_handle
+		,	mh->rdat.r_lseek_handle64, mh->rdat.cleanup_handle ) != MPG123_OK)
+		{
+			if(mh->rdat.cleanup_handle)
+				mh->rdat.cleanup_handle(io);
+			return chunk_error(c, mpg123_errcode(c->wh));
+		}
+		if(mpg123_open_handle64(c->wh, io) != MPG123_OK)
+			return chunk_error(c, mpg123_errcode(c->wh));
+	}
+	else if(mpg123_open(c->wh, c->path) != MPG123_OK)
+		return chunk_error(c, mpg123_errcode(c->wh));
+#ifdef FRAME_INDEX
+	if(c->fill && mpg123_set_index(c->wh, c->index, c->step, c->fill) != MPG123_OK)
+		return chunk_error(c, mpg123_errcode(c->wh));
+#endif
+	/* Also clears the new format flag, so that reading does not stop early. */
+	if(mpg123_getformat(c->wh, &rate, &channels, &encoding) != MPG123_OK)
+		return chunk_error(c, mpg123_errcode(c->wh));
+	if(rate != c->rate || channels != c->channels || encoding != c->encoding)
+		return chunk_error(c, MPG123_BAD_OUTFORMAT);
+	return MPG123_OK;
+}
+
+/* Decode one piece of output, returning MPG123_OK or an error code. */
+static int decode_chunk(struct parallel_chunk *c)
+{
+	int err;
+
+	if(c->wh == NULL)
+		return c->err;
+	if(mpg123_seek(c->wh, c->begin, SEEK_SET) < 0)
+		return chunk_error(c, mpg123_errcode(c->wh));
+	while(c->got < c->want)
+	{
+		size_t done = 0;
+		err = mpg123_read(c->wh, c->out+c->got, c->want-c->got, &done);
+		c->got += done;
+		if(err == MPG123_DONE)
+			break;
+		/* A format change in the middle of the stream cannot be represented
+		   in the single output buffer. */
+		if(err == MPG123_NEW_FORMAT)
+			return chunk_error(c, MPG123_BAD_OUTFORMAT);
+		if(err != MPG123_OK)
+			return chunk_error(c, mpg123_errcode(c->wh));
+	}
+	mpg123_delete(c->wh);
+	c->wh = NULL;
+	return c->err = MPG123_OK;
+}
+
+static void chunk_task(void *arg)
+{
+	decode_chunk((struct parallel_chunk*)arg);
+}
+
+/* The work after opening the stream on mh, path being NULL for custom I/O. */
+static int decode_parallel( mpg123_handle *mh
+,	const char *path, int threads, unsigned char **audio, size_t *bytes )
+{
+	struct parallel_chunk *chunks = NULL;
+	unsigned char *out = NULL;
+	off_t *index = NULL;
+	off_t step = 0;
+	size_t fill = 0;
+	off_t samples, per_chunk;
+	size_t framebytes, total, fillpos;
+	long rate;
+	int channels, encoding;
+	mpg123_threads *pool;
+	struct task_group group;
+	int count, i;
+	int ret = MPG123_OK;
+
+	if(  mpg123_scan(mh) != MPG123_OK
+	  || mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK )
+		return MPG123_ERR;
+	samples = mpg123_length(mh);
+	if(samples < 0)
+		return MPG123_ERR;
+	framebytes = (size_t)channels*mpg123_encsize(encoding);
+	total = (size_t)samples*framebytes;
+	if(  framebytes == 0 || (off_t)(size_t)samples != samples
+	  || (size_t)samples > SIZE_MAX/framebytes )
+	{
+		mh->err = MPG123_INT_OVERFLOW;
+		return MPG123_ERR;
+	}
+	if(total == 0)
+		return MPG123_OK;
+	/* More pieces than the pool runs at once would only add overlap. */
+	pool = threads_of(mh);
+	count = threads < threads_count(pool) ? threads : threads_count(pool);
+	if(mh->track_frames/MIN_CHUNK_FRAMES < count)
+		count = mh->track_frames > MIN_CHUNK_FRAMES
+		?	(int)(mh->track_frames/MIN_CHUNK_FRAMES)
+		:	1;
+	debug3("parallel decode of %"OFF_P" samples in %i chunks with %i threads",
+		(off_p)samples, count, threads_count(pool));
+#ifdef FRAME_INDEX
+	if(count > 1)
+	{
+		off_t *offsets;
+		if(mpg123_index(mh, &offsets, &step, &fill) != MPG123_OK)
+			return MPG123_ERR;
+		/* The master index must not change while workers copy it, so give
+		   them a private one. */
+		if(fill)
+		{
+			index = malloc(fill*sizeof(off_t));
+			if(index == NULL)
+			{
+				mh->err = MPG123_OUT_OF_MEM;
+				return MPG123_ERR;
+			}
+			memcpy(index, offsets, fill*sizeof(off_t));
+		}
+	}
+#endif
+	out = malloc(total);
+	chunks = calloc(count, sizeof(struct parallel_chunk));
+	if(out == NULL || chunks == NULL)
+	{
+		mh->err = MPG123_OUT_OF_MEM;
+		ret = MPG123_ERR;
+		goto parallel_end;
+	}
+	per_chunk = samples/count;
+	for(i=0; i<count; ++i)
+	{
+		off_t end = i == count-1 ? samples : (i+1)*per_chunk;
+		chunks[i].master   = mh;
+		chunks[i].path     = path;
+		chunks[i].index    = index;
+		chunks[i].step     = step;
+		chunks[i].fill     = fill;
+		chunks[i].rate     = rate;
+		chunks[i].channels = channels;
+		chunks[i].encoding = encoding;
+		chunks[i].begin    = i*per_chunk;
+		chunks[i].out      = out + (size_t)chunks[i].begin*framebytes;
+		chunks[i].want     = (size_t)(end-chunks[i].begin)*framebytes;
+		chunks[i].got      = 0;
+		chunks[i].err      = MPG123_OK;
+	}
+	for(i=0; i<count; ++i)
+		open_chunk(&chunks[i]);
+	/* The calling thread takes the first chunk itself. */
+	task_group_init(&group, pool);
+	for(i=1; i<count; ++i)
+		task_add(&group, chunk_task, &chunks[i]);
+	decode_chunk(&chunks[0]);
+	task_wait(&group);
+	/* Collect errors and close gaps of chunks that came up short (only the
+	   last one should do so, but one never knows with broken files). */
+	fillpos = 0;
+	for(i=0; i<count; ++i)
+	{
+		if(chunks[i].err != MPG123_OK)
+		{
+			if(!(mh->p.flags & MPG123_QUIET))
+				error2("parallel decode of chunk %i failed: %s", i
+				,	mpg123_plain_strerror(chunks[i].err));
+			mh->err = chunks[i].err;
+			ret = MPG123_ERR;
+			goto parallel_end;
+		}
+		if(chunks[i].out != out+fillpos)
+			memmove(out+fillpos, chunks[i].out, chunks[i].got);
+		fillpos += chunks[i].got;
+	}
+	*audio = out;
+	*bytes = fillpos;
+	out = NULL;
+
+parallel_end:
+	if(chunks)
+		for(i=0; i<count; ++i)
+			if(chunks[i].wh)
+				mpg123_delete(chunks[i].wh);
+	free(out);
+	free(chunks);
+	free(index);
+	return ret;
+}
+
+int attribute_align_arg mpg123_decode_parallel( mpg123_handle *mh
+,	const char *path, int threads, unsigned char **audio, size_t *bytes )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(path == NULL || audio == NULL || bytes == NULL || threads < 1)
+	{
+		mh->err = MPG123_BAD_PARS;
+		return MPG123_ERR;
+	}
+	*audio = NULL;
+	*bytes = 0;
+	/* Seeking does not follow sped up or slowed down playback. */
+	if(mh->p.doublespeed || mh->p.halfspeed)
+	{
+		mh->err = MPG123_BAD_PARS;
+		return MPG123_ERR;
+	}
+	if(mpg123_open(mh, path) != MPG123_OK)
+		return MPG123_ERR;
+	return decode_parallel(mh, path, threads, audio, bytes);
+}
+
+int attribute_align_arg mpg123_decode_parallel_handle( mpg123_handle *mh
+,	void *iohandle, void *(*dup_handle)(void *iohandle), int threads
+,	unsigned char **audio, size_t *bytes )
+{
+	int ret;
+
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(  dup_handle == NULL || audio == NULL || bytes == NULL || threads < 1
+	  || mh->p.doublespeed || mh->p.halfspeed )
+	{
+		mh->err = MPG123_BAD_PARS;
+		return MPG123_ERR;
+	}
+	*audio = NULL;
+	*bytes = 0;
+	/* Workers seek to their pieces. */
+	if(mh->rdat.r_read_handle == NULL || mh->rdat.r_lseek_handle64 == NULL)
+	{
+		mh->err = MPG123_BAD_CUSTOM_IO;
+		return MPG123_ERR;
+	}
+	if(mpg123_open_handle64(mh, iohandle) != MPG123_OK)
+		return MPG123_ERR;
+	mh->rdat.dup_handle = dup_handle;
+	ret = decode_parallel(mh, NULL, threads, audio, bytes);
+	mh->rdat.dup_handle = NULL;
+	return ret;
+}
+
+/*
+	The header scan in byte ranges: The master handle is at the first frame
+	and goes on through the first range itself, filling its index as usual.
+	Each other range gets a worker handle that reads the file from the start
+	of the range via pread() on the descriptor of the master, so nobody
+	moves the file offset of anyone else. With custom I/O, it reads through
+	its own copy of the I/O handle instead. The worker begins with the usual
+	search for a first header that is followed by a valid one, then records
+	where the frames are until it got one at or past the end of its range.
+	That frame has to be among the first frames the next worker found, which
+	ties the ranges into the very chain of frames that a sequential scan
+	follows. Any boundary that does not fit (a false sync, a broken frame
+	right there, an error) drops the whole thing for the sequential scan.
+*/
+
+#if !defined(NO_THREADS) && defined(HAVE_PREAD)
+
+/* Each range has at least that many bytes. */
+#define SCAN_RANGE_MIN (4*1024*1024)
+/* A worker has to catch up with the frames of the range before within
+   that many frames. */
+#define SCAN_MATCH 64
+
+struct scan_range
+{
+	mpg123_handle *wh; /* worker handle */
+	int fd;
+	void *io; /* copy of the I/O handle of the master, used instead of fd */
+	ssize_t (*io_read)(void *, void *, size_t);
+	int64_t (*io_seek)(void *, int64_t, int);
+	off_t iopos; /* where io is at, -1 for unknown */
+	off_t base; /* start of the range and of the stream the worker sees */
+	off_t end; /* the range ends before that, the stream at the file end */
+	off_t length; /* of the file */
+	off_t pos; /* read position of the worker, relative to base */
+	off_t first; /* first frame found */
+	off_t last;
+	uint32_t *delta; /* distances from each frame to the next one */
+	size_t size; /* allocated deltas */
+	size_t count; /* frames found, including the one past the end */
+	off_t before[SCAN_MATCH+1]; /* samples before each of the first frames */
+	off_t samples; /* in all frames */
+	int past; /* stopped at a frame at or past the end */
+	int err;
+};
+
+static ssize_t scan_read(void *handle, void *buf, size_t count)
+{
+	struct scan_range *r = handle;
+	ssize_t got;
+
+	if(r->io)
+	{
+		if(  r->iopos != r->base+r->pos
+		  && r->io_seek(r->io, r->base+r->pos, SEEK_SET) < 0 )
+			return -1;
+		r->iopos = -1;
+		if((got = r->io_read(r->io, buf, count)) >= 0)
+			r->iopos = r->base+r->pos+got;
+	}
+	else
+		got = pread(r->fd, buf, count, r->base+r->pos);
+	if(got > 0)
+		r->pos += got;
+	return got;
+}
+
+static int64_t scan_seek(void *handle, int64_t offset, int whence)
+{
+	struct scan_range *r = handle;
+	int64_t pos;
+
+	switch(whence)
+	{
+		case SEEK_SET: pos = offset; break;
+		case SEEK_CUR: pos = r->pos+offset; break;
+		case SEEK_END: pos = r->length-r->base+offset; break;
+		default: errno = EINVAL; return -1;
+	}
+	if(pos < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	r->pos = (off_t)pos;
+	return pos;
+}
+
+static int scan_add(struct scan_range *r, off_t pos, long spf)
+{
+	if(r->count <= SCAN_MATCH)
+		r->before[r->count] = r->samples;
+	if(r->count)
+	{
+		if(pos <= r->last || pos-r->last > UINT32_MAX)
+			return MPG123_ERR;
+		if(r->count > r->size)
+		{
+			size_t newsize = r->size ? 2*r->size : 4096;
+			uint32_t *nd = safe_realloc(r->delta, newsize*sizeof(*nd));
+			if(nd == NULL)
+				return MPG123_OUT_OF_MEM;
+			r->delta = nd;
+			r->size = newsize;
+		}
+		r->delta[r->count-1] = (uint32_t)(pos-r->last);
+	}
+	else
+		r->first = pos;
+	r->last = pos;
+	++r->count;
+	r->samples += spf;
+	return MPG123_OK;
+}
+
+static void scan_task(void *arg)
+{
+	struct scan_range *r = arg;
+	mpg123_handle *wh = r->wh;
+
+	/* Any other end than stopping past the range is the end of the track,
+	   as in the sequential scan. */
+	wh->state_flags |= FRAME_SKIP_BODY;
+	while(read_frame(wh) == 1)
+	{
+		off_t pos = r->base+wh->input_offset;
+		if((r->err = scan_add(r, pos, wh->spf)) != MPG123_OK)
+			return;
+		if(pos >= r->end)
+		{
+			r->past = TRUE;
+			return;
+		}
+	}
+}
+
+/* Enter a frame into the index of the master like read_frame() does. */
+static void scan_index(mpg123_handle *mh, off_t num, off_t pos)
+{
+#ifdef FRAME_INDEX
+	if(!(mh->state_flags & FRAME_ACCURATE))
+		return;
+	if(FI_NEXT(mh->index, num))
+		fi_add(&mh->index, pos);
+	if(CI_NEXT(mh->cindex, num))
+		ci_add(&mh->cindex, pos);
+	if(RI_NEXT(mh->rindex, num))
+		ri_add(&mh->rindex, num, pos);
+#endif
+}
+
+int scan_parallel(mpg123_handle *mh, off_t *frames, off_t *samples)
+{
+	struct scan_range *ranges = NULL;
+	mpg123_threads *pool = threads_of(mh);
+	struct task_group group;
+	mpg123_pars wp;
+	struct stat st;
+	void *io = NULL;
+	off_t length, start, span, next;
+	off_t frames0 = *frames;
+	off_t samples0 = *samples;
+	int count, i;
+	int ended = TRUE;
+	int ret = 0;
+
+	/* Only plain files behind a descriptor or custom I/O that can be
+	   duplicated, without anything changing the meaning of what
+	   read_frame() gives. */
+	if(  mh->rdat.filelen <= 0 || (mh->rdat.flags & READER_NONBLOCK)
+#ifndef NO_ICY
+	  || mh->p.icy_interval > 0
+#endif
+	  || mh->p.halfspeed || mh->p.doublespeed )
+		return 0;
+	if(mh->rdat.flags & READER_HANDLEIO)
+	{
+		if(  mh->rdat.dup_handle == NULL || mh->rdat.r_lseek_handle64 == NULL
+		  || mh->rdat.cleanup_handle == NULL )
+			return 0;
+		/* The total length, not the one without an ID3v1 tag, from a copy
+		   for the first worker, as the master must stay where it is. */
+		if((io = mh->rdat.dup_handle(mh->rdat.iohandle)) == NULL)
+			return 0;
+		if((length = (off_t)mh->rdat.r_lseek_handle64(io, 0, SEEK_END)) <= 0)
+		{
+			mh->rdat.cleanup_handle(io);
+			return 0;
+		}
+	}
+	else
+	{
+		if(  mh->rdat.filept < 0
+		  || mh->rdat.r_read != NULL || mh->rdat.r_lseek != NULL
+		  || fstat(mh->rdat.filept, &st) || !S_ISREG(st.st_mode) )
+			return 0;
+		length = st.st_size;
+	}
+	start = mh->input_offset;
+	count = mh->p.scan_threads;
+	if(threads_count(pool) < count)
+		count = threads_count(pool);
+	if(start >= 0 && (length-start)/SCAN_RANGE_MIN < count)
+		count = (int)((length-start)/SCAN_RANGE_MIN);
+	if(start < 0 || count < 2)
+	{
+		if(io)
+			mh->rdat.cleanup_handle(io);
+		return 0;
+	}
+	ranges = calloc(count, sizeof(*ranges));
+	if(ranges == NULL)
+	{
+		if(io)
+			mh->rdat.cleanup_handle(io);
+		return 0;
+	}
+	debug2("scanning %"OFF_P" bytes in %i ranges", (off_p)(length-start), count);
+	/* Workers set up here, as decoder setup touches shared CPU detection
+	   state. They need no index, no extra buffers and no chatter. */
+	wp = mh->p;
+	wp.flags |= MPG123_QUIET|MPG123_SKIP_ID3V2;
+	wp.index_size = 0;
+	wp.index_compact = 0;
+	wp.index_ring = 0;
+	wp.prefetch = 0;
+	wp.uring = 0;
+	wp.seek_cache = 0;
+	wp.fixed_memory = 0;
+	span = (length-start)/count;
+	for(i=1; i<count; ++i)
+	{
+		struct scan_range *r = &ranges[i];
+		int err = MPG123_OK;
+		r->fd = mh->rdat.filept;
+		r->base = start + i*span;
+		r->end = i == count-1 ? length : start + (i+1)*span;
+		r->length = length;
+		r->err = MPG123_ERR;
+		if(mh->rdat.flags & READER_HANDLEIO)
+		{
+			r->io = i == 1 ? io : mh->rdat.dup_handle(mh->rdat.iohandle);
+			r->io_read = mh->rdat.r_read_handle;
+			r->io_seek = mh->rdat.r_lseek_handle64;
+			r->iopos = -1;
+			if(r->io == NULL)
+				goto scan_end;
+		}
+		r->wh = mpg123_parnew(&wp, mpg123_current_decoder(mh), &err);
+		if(  r->wh == NULL
+		  || mpg123_reader64(r->wh, scan_read, scan_seek, NULL) != MPG123_OK
+		  || mpg123_open_handle64(r->wh, r) != MPG123_OK )
+			goto scan_end;
+		r->err = MPG123_OK;
+	}
+	task_group_init(&group, pool);
+	for(i=1; i<count; ++i)
+		task_add(&group, scan_task, &ranges[i]);
+	/* The master goes up to the first frame of the second range. */
+	while(read_frame(mh) == 1)
+	{
+		++*frames;
+		*samples += mh->spf;
+		if(mh->input_offset >= ranges[1].base)
+		{
+			ended = FALSE;
+			break;
+		}
+	}
+	next = mh->input_offset;
+	task_wait(&group);
+	/* Stitch the ranges together. */
+	for(i=1; i<count && !ended; ++i)
+	{
+		struct scan_range *r = &ranges[i];
+		off_t pos;
+		size_t k, j;
+
+		if(r->err != MPG123_OK || !r->count)
+			goto scan_end;
+		for(k=0, pos=r->first; pos != next; pos += r->delta[k++])
+			if(pos > next || k+1 >= r->count || k+1 >= SCAN_MATCH)
+			{
+				debug2("range %i does not continue at %"OFF_P, i, (off_p)next);
+				goto scan_end;
+			}
+		for(j=k+1; j<r->count; ++j)
+		{
+			pos += r->delta[j-1];
+			scan_index(mh, (*frames)++, pos);
+		}
+		*samples += r->samples - (k+1 < r->count ? r->before[k+1] : r->samples);
+		if(r->past)
+			next = pos;
+		else
+			ended = TRUE;
+	}
+	ret = 1;
+
+scan_end:
+	for(i=1; i<count; ++i)
+	{
+		if(ranges[i].wh)
+			mpg123_delete(ranges[i].wh);
+		if(ranges[i].io)
+			mh->rdat.cleanup_handle(ranges[i].io);
+		free(ranges[i].delta);
+	}
+	free(ranges);
+	/* Back to the first frame for the sequential scan. Index entries
+	   made so far are right and are not doubled by reading again. */
+	if(!ret)
+	{
+		*frames = frames0;
+		*samples = samples0;
+		if(mh->rd->seek_frame(mh, 0) < 0 || mh->num != 0)
+			ret = MPG123_ERR;
+	}
+	return ret;
+}
+
+#else
+
+int scan_parallel(mpg123_handle *mh, off_t *frames, off_t *samples)
+{
+	return 0;
+}
+
+#endif
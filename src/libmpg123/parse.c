@@ -129,6 +129,82 @@ static unsigned short bit_read_short(unsigned char *buf, int *offset)
 	return val;
 }
 
+/*
+	The Fraunhofer VBRI header sits 32 bytes after the frame header, regardless
+	of mode. After "VBRI" come version, delay and quality (16 bit each), stream
+	bytes and frames (32 bit), then number of TOC entries, a scale factor, the
+	size of an entry in bytes and frames per entry (16 bit each). Each TOC entry
+	times the scale is the byte size of a group of frames, starting after the
+	VBRI frame. These sizes are summed up into a table of exact positions.
+	Only with a usable table, the frame counts as info frame. Otherwise, it is
+	decoded like any other frame, as before.
+*/
+static int check_vbri_tag(mpg123_handle *fr)
+{
+	int off = 32;
+	unsigned long frames;
+	unsigned short entries, scale, esize, step;
+	off_t pos;
+	size_t i;
+
+	if(fr->framesize < off+26
+	||	fr->bsbuf[off] != 'V' || fr->bsbuf[off+1] != 'B'
+	||	fr->bsbuf[off+2] != 'R' || fr->bsbuf[off+3] != 'I' )
+		return 0;
+	if(VERBOSE2) fprintf(stderr, "Note: VBRI header detected\n");
+	off += 4+2+2+2+4; /* tag, version, delay, quality, bytes */
+	frames  = bit_read_long(fr->bsbuf, &off);
+	entries = bit_read_short(fr->bsbuf, &off);
+	scale   = bit_read_short(fr->bsbuf, &off);
+	esize   = bit_read_short(fr->bsbuf, &off);
+	step    = bit_read_short(fr->bsbuf, &off);
+	if( !entries || !step || esize < 1 || esize > 4
+	||	fr->framesize < off + entries*esize )
+		return 0;
+	frame_free_vbri(fr);
+	fr->vbri_toc = malloc(sizeof(off_t)*entries);
+	if(fr->vbri_toc == NULL)
+		return 0;
+	/* The first group starts right after this frame. */
+	pos = fr->audio_start + 4 + fr->framesize;
+	for(i=0; i<entries; ++i)
+	{
+		unsigned long size = 0;
+		int b;
+		if(fr->rdat.filelen > 0 && pos >= fr->rdat.filelen)
+			break;
+		fr->vbri_toc[i] = pos;
+		for(b=0; b<esize; ++b)
+			size = size<<8 | fr->bsbuf[off++];
+		if(!size)
+			break;
+		pos += (off_t)size*scale;
+	}
+	if(!i || (i < entries && !(fr->rdat.filelen > 0 && pos >= fr->rdat.filelen)))
+	{
+		/* A zero size cannot be right, do not trust any of it. */
+		if(NOQUIET) warning("Broken VBRI seek table, ignoring it.");
+		frame_free_vbri(fr);
+		return 0;
+	}
+	fr->vbri_fill = i;
+	fr->vbri_step = step;
+	fr->vbr = MPG123_VBR;
+	if(fr->p.flags & MPG123_IGNORE_STREAMLENGTH)
+	{
+		if(VERBOSE3) fprintf(stderr
+		,	"Note: Ignoring VBRI frames because of MPG123_IGNORE_STREAMLENGTH\n");
+	}
+	else
+	{
+		fr->track_frames = frames > TRACK_MAX_FRAMES ? 0 : (off_t) frames;
+		if(VERBOSE3) fprintf(stderr, "Note: VBRI: %lu frames\n", frames);
+	}
+	if(VERBOSE3) fprintf(stderr, "Note: VBRI: %lu seek points every %u frames\n"
+	,	(unsigned long)fr->vbri_fill, (unsigned)step);
+	return 1;
+}
+
 static int check_lame_tag(mpg123_handle *fr)
 {
 	int i;
@@ -146,6 +222,8 @@ static int check_lame_tag(mpg123_handle *fr)
 
 	if(fr->p.flags & MPG123_IGNORE_INFOFRAME) goto check_lame_tag_no;
 
+	if(check_vbri_tag(fr)) goto check_lame_tag_yes;
+
 	debug("do we have lame tag?");
 	/*
 		Note: CRC or not, that does not matter here.
@@ -422,11 +500,188 @@ check_lame_tag_yes:
 	/* switch buffer back ... */
 	fr->bsbuf = fr->bsspace[fr->bsnum]+512;
 	fr->bsnum = (fr->bsnum + 1) & 1;
+	fr->bstail_size = 0;
 	return 1;
 check_lame_tag_no:
 	return 0;
 }
 
+/* Enough of a frame body for the Xing/Info fields and the LAME data. */
+#define SEGMENT_PEEK (32+4+4+4+4+100+4+24)
+
+/* The header frame of a segment, only for the frame count and the encoder
+   delay and padding. Values given to mpg123_feed_segment() stay. */
+static int segment_info(mpg123_handle *fr, unsigned char *body, int size)
+{
+	struct segment *seg = &fr->segment_now;
+	int off = (fr->stereo == 2)
+	? (fr->lsf ? 17 : 32)
+	: (fr->lsf ? 9  : 17);
+	unsigned long flags;
+	off_t frames = -1;
+	int i;
+
+	if(fr->p.flags & MPG123_IGNORE_INFOFRAME)
+		return 0;
+	if(size >= 32+26 && !memcmp(body+32, "VBRI", 4))
+	{
+		int voff = 32+4+2+2+2+4;
+		frames = (off_t)bit_read_long(body, &voff);
+	}
+	else
+	{
+		if(size < off+8)
+			return 0;
+		for(i=2; i < off; ++i)
+			if(body[i] != 0)
+				return 0;
+		if(memcmp(body+off, "Info", 4) && memcmp(body+off, "Xing", 4))
+			return 0;
+		off += 4;
+		flags = bit_read_long(body, &off);
+		if(flags & 0x1) /* total bitstream frames */
+		{
+			if(size >= off+4)
+				frames = (off_t)bit_read_long(body, &off);
+			else
+				off += 4;
+		}
+		/* bytes, TOC, quality */
+		off += (flags & 0x2 ? 4 : 0) + (flags & 0x4 ? 100 : 0) + (flags & 0x8 ? 4 : 0);
+		if(size >= off+24 && body[off] != 0)
+		{
+			off += 21; /* encoder string, revision, lowpass, ReplayGain, flags, ABR */
+			if(seg->delay < 0)
+				seg->delay = ((long)body[off] << 4) | (body[off+1] >> 4);
+			if(seg->padding < 0)
+				seg->padding = (((long)body[off+1] << 8) | body[off+2]) & 0xfff;
+		}
+	}
+	if(!(fr->p.flags & MPG123_IGNORE_STREAMLENGTH) && frames <= TRACK_MAX_FRAMES)
+		seg->frames = frames;
+	if(VERBOSE2)
+		fprintf(stderr, "Note: Segment header: %"OFF_P" frames, delay %li, padding %li\n"
+		,	(off_p)seg->frames, seg->delay, seg->padding);
+	return 1;
+}
+
+#ifdef GAPLESS
+static void segment_add_cut(mpg123_handle *fr, off_t begin, off_t end)
+{
+	int n = fr->segment_cuts;
+	if(begin >= end)
+		return;
+	if(n && begin <= fr->segment_cut[n-1][1])
+	{
+		if(begin < fr->segment_cut[n-1][0])
+			fr->segment_cut[n-1][0] = begin;
+		if(end > fr->segment_cut[n-1][1])
+			fr->segment_cut[n-1][1] = end;
+		return;
+	}
+	if(n == SEGMENT_CUTS)
+	{
+		if(NOQUIET)
+			warning("too many pending segment cuts, keeping some samples");
+		return;
+	}
+	fr->segment_cut[n][0] = begin;
+	fr->segment_cut[n][1] = end;
+	++fr->segment_cuts;
+}
+#endif
+
+/* The frame after the segment header (or without one) is the first audio
+   of the segment. The decoder delay puts the samples of the segment there
+   and the padding of the one before just in front. */
+static void segment_begin(mpg123_handle *fr)
+{
+#ifdef GAPLESS
+	struct segment *seg = &fr->segment_now;
+	off_t base = (fr->num+1)*fr->spf;
+	off_t start = base + GAPLESS_DELAY;
+	int i;
+
+	if(!(fr->p.flags & MPG123_GAPLESS))
+		return;
+	/* A frame count that was too high for the previous segment does not
+	   cut into this one. */
+	for(i=0; i<fr->segment_cuts; ++i)
+	{
+		if(fr->segment_cut[i][0] >= start)
+		{
+			fr->segment_cuts = i;
+			break;
+		}
+		if(fr->segment_cut[i][1] > start)
+			fr->segment_cut[i][1] = start;
+	}
+	if(seg->delay >= 0)
+		segment_add_cut(fr, base ? start : 0, start + seg->delay);
+	if(seg->frames > 0 && seg->padding > 0)
+		segment_add_cut( fr, start + seg->frames*fr->spf - seg->padding
+		,	start + seg->frames*fr->spf );
+#endif
+}
+
+/* Before reading the body of the frame at framepos: Drop it if it is cut
+   off by the start of the next segment, else see if it starts the next
+   segment and if it is a header frame (skipped) or audio. */
+static int segment_boundary(mpg123_handle *fr, off_t framepos)
+{
+	unsigned char body[SEGMENT_PEEK];
+	ssize_t size;
+	off_t ret;
+
+	if(fr->segment_fill && fr->segment_queue[0].pos > framepos)
+	{
+		off_t next = fr->segment_queue[0].pos;
+		off_t pos  = framepos + 4;
+		if(next >= pos + fr->framesize)
+			return PARSE_GOOD;
+		if(VERBOSE2)
+			fprintf(stderr, "Note: Dropping frame cut off by segment end at %"OFF_P".\n"
+			,	(off_p)framepos);
+		/* Its main data is gone for the following frames. */
+		fr->bitreservoir = 0;
+		ret = next >= pos
+		?	fr->rd->skip_bytes(fr, next-pos)
+		:	fr->rd->back_bytes(fr, pos-next);
+		return ret < 0 ? (int)ret : PARSE_AGAIN;
+	}
+	if(fr->segment_fill)
+	{
+		/* Segments without any frame are just passed. */
+		int i = 0;
+		while(i+1 < fr->segment_fill && fr->segment_queue[i+1].pos <= framepos)
+			++i;
+		fr->segment_now = fr->segment_queue[i];
+		fr->segment_fill -= i+1;
+		memmove( fr->segment_queue, fr->segment_queue+i+1
+		,	sizeof(fr->segment_queue[0])*fr->segment_fill );
+		fr->segment_start = 1;
+	}
+	if(!fr->segment_start)
+		return PARSE_GOOD;
+	if(fr->lay == 3)
+	{
+		size = fr->framesize < SEGMENT_PEEK ? fr->framesize : SEGMENT_PEEK;
+		if((ret = fr->rd->fullread(fr, body, size)) != size)
+			return ret < 0 ? (int)ret : READER_ERROR;
+		if(segment_info(fr, body, (int)size))
+		{
+			if((ret = fr->rd->skip_bytes(fr, fr->framesize-size)) < 0)
+				return (int)ret;
+			return PARSE_AGAIN;
+		}
+		if(fr->rd->back_bytes(fr, size) < 0)
+			return READER_ERROR;
+	}
+	segment_begin(fr);
+	fr->segment_start = 0;
+	return PARSE_GOOD;
+}
+
 /* Just tell if the header is some mono. */
 static int header_mono(unsigned long newhead)
 {
@@ -440,6 +695,35 @@ static int head_compatible(unsigned long fred, unsigned long bret)
 		&&       header_mono(fred) == header_mono(bret)    );
 }
 
+/* Layer III main data of consecutive frames forms one stream, interrupted
+   by headers and side info. Instead of copying the bit reservoir in front of
+   each frame body in the other half of bsspace, place the body so that its
+   main data directly follows the main data of the last frame, as long as
+   that fits into the same half. The side info then covers the last bytes
+   of the old main data, which are kept aside and put back by set_pointer()
+   once the side info has been parsed. Returns the place for the body, NULL
+   for the usual flip to the other half. */
+static unsigned char *chain_body(mpg123_handle *fr)
+{
+	unsigned char *half;
+	unsigned char *end;
+
+	if( fr->lay != 3 || fr->fsizeold <= 0 || (fr->state_flags & FRAME_INPLACE)
+	||  fr->bsbuf < fr->bsspace[0]
+	||  fr->bsbuf >= fr->bsspace[0]+sizeof(fr->bsspace) )
+		return NULL;
+	half = fr->bsspace[fr->bsbuf >= fr->bsspace[1]];
+	end  = fr->bsbuf + fr->fsizeold;
+	if(end - fr->ssize + fr->framesize + 4 > half + sizeof(fr->bsspace[0]))
+		return NULL;
+	/* The last frame may not have been decoded. */
+	if(fr->bstail_size)
+		memcpy(fr->bsbuf, fr->bstail, fr->bstail_size);
+	memcpy(fr->bstail, end - fr->ssize, fr->ssize);
+	fr->bstail_size = fr->ssize;
+	return end - fr->ssize;
+}
+
 static void halfspeed_prepare(mpg123_handle *fr)
 {
 	/* save for repetition */
@@ -507,10 +791,16 @@ int read_frame(mpg123_handle *fr)
 	   when repeatedly headers are found that do not have valid followup headers. */
 	long headcount = 0;
 
-	fr->fsizeold=fr->framesize;       /* for Layer3 */
-
+	/* A repetition still has the same frame before it. */
 	if(halfspeed_do(fr) == 1) return 1;
 
+	/* The peek at the end left for later, once the first frame is out. */
+	if(fr->rdat.flags & READER_TAILPEEK && fr->num >= 0
+	&&	(ret = reader_tail(fr, 0)) < 0 )
+		return ret;
+
+	fr->fsizeold=fr->framesize;       /* for Layer3 */
+
 read_again:
 	/* In case we are looping to find a valid frame, discard any buffered data before the current position.
 	   This is essential to prevent endless looping, always going back to the beginning when feeder buffer is exhausted. */
@@ -555,21 +845,74 @@ init_resync:
 
 	/* if filepos is invalid, so is framepos */
 	framepos = fr->rd->tell(fr) - 4;
+	if(fr->segment_fill || fr->segment_start)
+	{
+		ret = segment_boundary(fr, framepos);
+		JUMP_CONCLUSION(ret);
+	}
 	/* flip/init buffer for Layer 3 */
 	{
 		unsigned char *newbuf = fr->bsspace[fr->bsnum]+512;
-		/* read main data into memory */
+		/* Scanning only needs the frame positions. Near the end, the body is
+		   read as usual to notice a truncated last frame. The first frame
+		   may be an info frame that is still to be parsed. A Layer III frame
+		   dropped by MPG123_UPSPEED still feeds the bit reservoir. */
+		off_t bodyend = framepos+4+fr->framesize;
+		int skip = ( (fr->state_flags & FRAME_SKIP_BODY)
+		||	((fr->state_flags & FRAME_DROP_BODY) && fr->lay != 3) )
+		&&	fr->firsthead && bodyend <= fr->rdat.filelen;
+		/* Layer I/II can work directly on input data that is in memory anyway
+		   (mapped file, feeder buffers). Layer III needs the room before the
+		   body for the bit reservoir. */
+		unsigned char *inbuf = fr->lay != 3 && !skip
+		?	inplace_frame_body(fr, fr->framesize)
+		:	NULL;
+		unsigned char *chain = skip || inbuf ? NULL : chain_body(fr);
 		debug2("read frame body of %i at %"OFF_P, fr->framesize, framepos+4);
-		if((ret=fr->rd->read_frame_body(fr,newbuf,fr->framesize))<0)
+		if(chain)
+			newbuf = chain;
+		else if(fr->bstail_size)
+		{
+			memcpy(fr->bsbuf, fr->bstail, fr->bstail_size);
+			fr->bstail_size = 0;
+		}
+		if(skip)
 		{
-			/* if failed: flip back */
+			if(fr->rd->skip_bytes(fr, fr->framesize) != bodyend)
+			{
+				ret = READER_ERROR;
+				goto read_frame_bad;
+			}
+		}
+		else if(inbuf)
+			newbuf = inbuf;
+		else
+		/* read main data into memory */
+		if((ret=fr->rd->read_frame_body(fr,newbuf,fr->framesize))<=0)
+		{
+			/* if failed or truncated at the end: flip back */
 			debug("need more?");
+			if(chain)
+			{
+				memcpy(chain, fr->bstail, fr->bstail_size);
+				fr->bstail_size = 0;
+			}
 			goto read_frame_bad;
 		}
-		fr->bsbufold = fr->bsbuf;
+		/* An in-place body may be gone by now, Layer III after Layer I/II
+		   just needs some memory to not get a meaningful bit reservoir from. */
+		fr->bsbufold = fr->state_flags & FRAME_INPLACE
+		?	fr->bsspace[(fr->bsnum+1)&1]+512
+		:	fr->bsbuf;
 		fr->bsbuf = newbuf;
+		if(inbuf)
+			fr->state_flags |= FRAME_INPLACE;
+		else
+			fr->state_flags &= ~FRAME_INPLACE;
+		/* Staying in the half, the next flip still goes to the other one. */
+		if(!chain)
+			fr->bsnum = (fr->bsnum + 1) & 1;
 	}
-	fr->bsnum = (fr->bsnum + 1) & 1;
 
 	if(!fr->firsthead)
 	{
@@ -589,6 +932,7 @@ init_resync:
 				fr->oldhead = 0;
 				goto read_again;
 			}
+			fr->audio_hash = fi_hash(0, fr->bsbuf, fr->framesize);
 			/* now adjust volume */
 			do_rva(fr);
 		}
@@ -631,6 +975,10 @@ init_resync:
 	   but only do so when we are sure that the frame number is accurate... */
 	if((fr->state_flags & FRAME_ACCURATE) && FI_NEXT(fr->index, fr->num))
 	fi_add(&fr->index, framepos);
+	if((fr->state_flags & FRAME_ACCURATE) && CI_NEXT(fr->cindex, fr->num))
+	ci_add(&fr->cindex, framepos);
+	if((fr->state_flags & FRAME_ACCURATE) && RI_NEXT(fr->rindex, fr->num))
+	ri_add(&fr->rindex, fr->num, framepos);
 #endif
 
 	if(fr->silent_resync > 0) --fr->silent_resync;
@@ -677,6 +1025,7 @@ init_resync:
 
 	fr->oldhead = newhead;
 
+	MPGPROBE3(frame_read, (long long)fr->num, (long long)framepos, fr->framesize);
 	return 1;
 read_frame_bad:
 	/* Also if we searched for valid data in vein, we can forget skipped data.
@@ -687,6 +1036,10 @@ read_frame_bad:
 	if(fr->err == MPG123_OK) fr->err = MPG123_ERR_READER;
 	fr->framesize = oldsize;
 	fr->halfphase = oldphase;
+	if(ret == MPG123_NEED_MORE)
+	{
+		MPGPROBE1(need_more, (long long)fr->rd->tell(fr));
+	}
 	/* That return code might be inherited from some feeder action, or reader error. */
 	return ret;
 }
@@ -742,12 +1095,24 @@ static int guess_freeformat_framesize(mpg123_handle *fr, unsigned long oldhead)
  */
 static int decode_header(mpg123_handle *fr,unsigned long newhead, int *freeformat_count)
 {
+	unsigned long cached = fr->headcache;
 #ifdef DEBUG /* Do not waste cycles checking the header twice all the time. */
 	if(!head_check(newhead))
 	{
 		error1("trying to decode obviously invalid header 0x%08lx", newhead);
 	}
 #endif
+	/* A stream mostly repeats the header, with only the padding changing.
+	   Everything but the frame size is still in place then. */
+	if( (newhead & ~(unsigned long)HDR_PADDING) == cached
+	&&  fr->headcache_size[HDR_PADDING_VAL(newhead)] >= 0 )
+	{
+		fr->padding   = HDR_PADDING_VAL(newhead);
+		fr->framesize = fr->headcache_size[fr->padding];
+		return PARSE_GOOD;
+	}
+	/* The fields are changed from here on, valid again on success. */
+	fr->headcache = 0;
 	/* For some reason, the layer and sampling freq settings used to be wrapped
 	   in a weird conditional including MPG123_NO_RESYNC. What was I thinking?
 	   This information has to be consistent. */
@@ -891,6 +1256,14 @@ static int decode_header(mpg123_handle *fr,unsigned long newhead, int *freeforma
 
 		return PARSE_BAD;
 	}
+	/* Free format sizes are not from the header alone. */
+	if(!fr->freeformat)
+	{
+		fr->headcache = newhead & ~(unsigned long)HDR_PADDING;
+		if(fr->headcache != cached)
+			fr->headcache_size[0] = fr->headcache_size[1] = -1;
+		fr->headcache_size[fr->padding] = fr->framesize;
+	}
 	return PARSE_GOOD;
 }
 
@@ -910,7 +1283,11 @@ void set_pointer(mpg123_handle *fr, int part2, long backstep)
 		if(part2)
 		{
 			fr->wordpointer = fr->bsbuf + fr->ssize - backstep;
-			if(backstep)
+			/* A chained body has the reservoir in front already, only the
+			   part under the side info is to be put back. */
+			if(fr->bstail_size)
+				memcpy(fr->bsbuf, fr->bstail, fr->bstail_size);
+			else if(backstep)
 				memcpy( fr->wordpointer, fr->bsbufold+fr->fsizeold-backstep
 				,	backstep );
 			fr->bits_avail = (long)(fr->framesize - fr->ssize + backstep)*8;
@@ -1095,7 +1472,13 @@ static int handle_id3v2(mpg123_handle *fr, unsigned long newhead)
 	ret = parse_new_id3(fr, newhead);
 	if     (ret < 0) return ret;
 #ifndef NO_ID3V2
-	else if(ret > 0){ debug("got ID3v2"); fr->metaflags  |= MPG123_NEW_ID3|MPG123_ID3; }
+	else if(ret > 0)
+	{
+		debug("got ID3v2");
+		fr->metaflags  |= MPG123_NEW_ID3|MPG123_ID3;
+		frame_meta_notify( fr, id3_has_pictures(fr)
+		?	MPG123_NEW_ID3|MPG123_NEW_PICTURE : MPG123_NEW_ID3 );
+	}
 	else debug("no useful ID3v2");
 #endif
 	return PARSE_AGAIN;
@@ -1162,6 +1545,106 @@ static int forget_head_shift(mpg123_handle *fr, unsigned long *newheadp, int for
 	return ret; /* No surprise here, error already triggered early return. */
 }
 
+/* Shift bytes into the header until head_check() likes it or the limit is hit
+   (check *count against it afterwards), counting the bytes in *count.
+   Returns TRUE or what the reader returned on end/error. With seekable or
+   buffered input, the bytes are read in blocks and searched for the 0xff of
+   the sync word with memchr() instead of going one read call per byte; the
+   bytes behind a candidate are pushed back. The bytewise shift remains for
+   the end of data and input that cannot go back. */
+#define SYNC_BLOCK 4096
+static int sync_shift( mpg123_handle *fr, unsigned long *newheadp
+,	long *count, long limit, unsigned int *forgetcount )
+{
+	int ret;
+	unsigned long newhead = *newheadp;
+	if(fr->rdat.flags & (READER_SEEKABLE|READER_BUFFERED)) for(;;)
+	{
+		unsigned char buf[SYNC_BLOCK];
+		ssize_t want = SYNC_BLOCK;
+		ssize_t got, i;
+		unsigned char *p;
+
+		if(limit >= 0)
+		{
+			if(*count+1 >= limit)
+			{
+				++(*count);
+				return TRUE;
+			}
+			if(limit - *count - 1 < want)
+				want = limit - *count - 1;
+		}
+		/* Forget at the same points as the bytewise shift. */
+		if(fr->rd->forget != NULL && FORGET_INTERVAL+1 - *forgetcount < want)
+			want = FORGET_INTERVAL+1 - *forgetcount;
+		/* Only what is there, a feeder would start over on missing data. */
+		if(fr->rdat.flags & READER_BUFFERED)
+		{
+			ssize_t there = fr->rdat.buffer.size - fr->rdat.buffer.pos;
+			if(there > 0 && there < want)
+				want = there;
+		}
+		if((got = fr->rd->fullread(fr, buf, want)) < 0)
+			return (int)got;
+		/* End of data: single steps. */
+		if(got < 4)
+		{
+			if(got > 0 && fr->rd->back_bytes(fr, got) < 0)
+				return READER_ERROR;
+			break;
+		}
+		/* The first headers still contain bytes from before. */
+		for(i=0; i<3; ++i)
+		{
+			newhead = ((newhead << 8) | buf[i]) & 0xffffffff;
+			if(head_check(newhead))
+				goto sync_shift_found;
+		}
+		/* Then all header bytes are in the block. */
+		while( (p = memchr(buf+i-3, 0xff, got-i))
+		&&     (i = p-buf+3) < got )
+		{
+			newhead = ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16)
+			|	((unsigned long) p[2] << 8) | p[3];
+			if(head_check(newhead))
+				goto sync_shift_found;
+			++i;
+		}
+		newhead = ((unsigned long) buf[got-4] << 24) | ((unsigned long) buf[got-3] << 16)
+		|	((unsigned long) buf[got-2] << 8) | buf[got-1];
+		i = got-1;
+sync_shift_found:
+		if(got-i-1 > 0 && fr->rd->back_bytes(fr, got-i-1) < 0)
+			return READER_ERROR;
+		*newheadp = newhead;
+		*count += i+1;
+		if((*forgetcount += i+1) > FORGET_INTERVAL)
+		{
+			*forgetcount = 0;
+			/* Same as forget_head_shift(), keeping the header bytes. */
+			if(fr->rd->forget != NULL && !fr->rd->back_bytes(fr, 4))
+			{
+				fr->rd->forget(fr);
+				fr->rd->back_bytes(fr, -4);
+			}
+		}
+		if(head_check(newhead))
+			return TRUE;
+	}
+	do
+	{
+		++(*count);
+		if(limit >= 0 && *count >= limit) break;
+
+		if(++(*forgetcount) > FORGET_INTERVAL) *forgetcount = 0;
+		ret = forget_head_shift(fr, &newhead, !*forgetcount);
+		*newheadp = newhead;
+		if(ret <= 0) return ret;
+	} while(!head_check(newhead));
+	return TRUE;
+}
+
 /* watch out for junk/tags on beginning of stream by invalid header */
 static int skip_junk(mpg123_handle *fr, unsigned long *newheadp, long *headcount)
 {
@@ -1213,13 +1696,10 @@ static int skip_junk(mpg123_handle *fr, unsigned long *newheadp, long *headcount
 
 	do
 	{
-		++(*headcount);
-		if(limit >= 0 && *headcount >= limit) break;				
+		if((ret=sync_shift(fr, &newhead, headcount, limit, &forgetcount))<=0) return ret;
+		if(limit >= 0 && *headcount >= limit) break;
 
-		if(++forgetcount > FORGET_INTERVAL) forgetcount = 0;
-		if((ret=forget_head_shift(fr, &newhead, !forgetcount))<=0) return ret;
-
-		if(head_check(newhead) && (ret=decode_header(fr, newhead, &freeformat_count))) break;
+		if((ret=decode_header(fr, newhead, &freeformat_count))) break;
 	} while(1);
 	if(ret<0) return ret;
 
@@ -1254,6 +1734,7 @@ static int wetwork(mpg123_handle *fr, unsigned long *newheadp)
 
 		fr->metaflags  |= MPG123_NEW_ID3|MPG123_ID3;
 		fr->rdat.flags |= READER_ID3TAG; /* that marks id3v1 */
+		frame_meta_notify(fr, MPG123_NEW_ID3);
 		if(VERBOSE3) fprintf(stderr,"Note: Skipped ID3v1 tag.\n");
 
 		return PARSE_AGAIN;
@@ -1290,23 +1771,18 @@ static int wetwork(mpg123_handle *fr, unsigned long *newheadp)
 
 		if(NOQUIET && fr->silent_resync == 0) fprintf(stderr, "Note: Trying to resync...\n");
 
-		do /* ... shift the header with additional single bytes until be found something that could be a header. */
+		/* ... shift the header with additional bytes until we found something that could be a header. */
+		if((ret=sync_shift(fr, &newhead, &try, limit, &forgetcount)) <= 0)
 		{
-			++try;
-			if(limit >= 0 && try >= limit) break;				
+			*newheadp = newhead;
+			if(NOQUIET) fprintf (stderr, "Note: Hit end of (available) data during resync.\n");
 
-			if(++forgetcount > FORGET_INTERVAL) forgetcount = 0;
-			if((ret=forget_head_shift(fr,&newhead,!forgetcount)) <= 0)
-			{
-				*newheadp = newhead;
-				if(NOQUIET) fprintf (stderr, "Note: Hit end of (available) data during resync.\n");
-
-				return ret ? ret : PARSE_END;
-			}
-			if(VERBOSE3) debug3("resync try %li at %"OFF_P", got newhead 0x%08lx", try, (off_p)fr->rd->tell(fr),  newhead);
-		} while(!head_check(newhead));
+			return ret ? ret : PARSE_END;
+		}
+		if(VERBOSE3) debug3("resync try %li at %"OFF_P", got newhead 0x%08lx", try, (off_p)fr->rd->tell(fr),  newhead);
 
 		*newheadp = newhead;
+		MPGPROBE2(resync, (long long)fr->rd->tell(fr), try);
 		if(NOQUIET && fr->silent_resync == 0) fprintf (stderr, "Note: Skipped %li bytes in input.\n", try);
 
 		/* Now we either got something that could be a header, or we gave up. */
@@ -0,0 +1,185 @@
+/*
+	pool: keep decoder handles around for reuse
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	A server decoding many short streams spends a good part of its time in
+	mpg123_new() and the first decode_update(): allocating synth buffers,
+	running the CPU detection and computing the decoding tables. The pool
+	keeps closed handles instead of deleting them. A released handle is
+	closed and gets the parameters of the pool back via frame_recycle(),
+	which resets all frame state but keeps buffers and tables, so the next
+	track with the same setup starts decoding right away.
+*/
+
+#include "mpg123lib_intern.h"
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
+
+#include "debug.h"
+
+struct mpg123_pool_struct
+{
+	mpg123_pars p; /* parameters for all handles */
+	char *decoder; /* the decoder the first handle settled on */
+	mpg123_handle **idle;
+	size_t fill;
+	size_t size; /* maximum number of idle handles */
+#ifndef NO_THREADS
+	pthread_mutex_t lock;
+#endif
+};
+
+static void pool_lock(mpg123_pool *pool)
+{
+#ifndef NO_THREADS
+	pthread_mutex_lock(&pool->lock);
+#endif
+}
+
+static void pool_unlock(mpg123_pool *pool)
+{
+#ifndef NO_THREADS
+	pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+static mpg123_handle *pool_handle(mpg123_pool *pool, int *error)
+{
+	return mpg123_parnew(&pool->p, pool->decoder, error);
+}
+
+mpg123_pool attribute_align_arg *mpg123_pool_new( mpg123_pars *mp
+,	const char *decoder, size_t size, int *error )
+{
+	mpg123_pool *pool;
+	mpg123_handle *mh;
+	const char *dec;
+	int err = MPG123_OK;
+
+	pool = malloc(sizeof(mpg123_pool));
+	if(pool == NULL)
+	{
+		if(error != NULL) *error = MPG123_OUT_OF_MEM;
+		return NULL;
+	}
+	if(mp == NULL) frame_default_pars(&pool->p);
+	else memcpy(&pool->p, mp, sizeof(mpg123_pars));
+	pool->decoder = NULL;
+	pool->idle = NULL;
+	pool->fill = 0;
+	pool->size = size;
+#ifndef NO_THREADS
+	if(pthread_mutex_init(&pool->lock, NULL))
+	{
+		free(pool);
+		if(error != NULL) *error = MPG123_ERR;
+		return NULL;
+	}
+#endif
+	/* The first handle does the decoder choice for all of them. */
+	mh = mpg123_parnew(&pool->p, decoder, &err);
+	if(mh != NULL)
+	{
+		dec = mpg123_current_decoder(mh);
+		pool->decoder = malloc(strlen(dec)+1);
+		if(pool->decoder != NULL)
+			strcpy(pool->decoder, dec);
+		if(size && pool->decoder != NULL)
+			pool->idle = malloc(sizeof(mpg123_handle*)*size);
+		if(pool->decoder == NULL || (size && pool->idle == NULL))
+			err = MPG123_OUT_OF_MEM;
+	}
+	if(err == MPG123_OK && size)
+	{
+		pool->idle[pool->fill++] = mh;
+		mh = NULL;
+		while(pool->fill < size)
+		{
+			mpg123_handle *ph = pool_handle(pool, &err);
+			if(ph == NULL)
+				break;
+			pool->idle[pool->fill++] = ph;
+		}
+	}
+	if(mh != NULL)
+		mpg123_delete(mh);
+	if(err != MPG123_OK)
+	{
+		mpg123_pool_delete(pool);
+		pool = NULL;
+	}
+	if(error != NULL) *error = err;
+	return pool;
+}
+
+mpg123_handle attribute_align_arg *mpg123_pool_acquire( mpg123_pool *pool
+,	int *error )
+{
+	mpg123_handle *mh = NULL;
+
+	if(pool == NULL)
+	{
+		if(error != NULL) *error = MPG123_BAD_HANDLE;
+		return NULL;
+	}
+	pool_lock(pool);
+	if(pool->fill)
+		mh = pool->idle[--pool->fill];
+	pool_unlock(pool);
+	if(mh != NULL)
+	{
+		if(error != NULL) *error = MPG123_OK;
+		return mh;
+	}
+	debug("pool empty, creating a fresh handle");
+	return pool_handle(pool, error);
+}
+
+void attribute_align_arg mpg123_pool_release( mpg123_pool *pool
+,	mpg123_handle *mh )
+{
+	if(mh == NULL)
+		return;
+	if(pool == NULL)
+	{
+		mpg123_delete(mh);
+		return;
+	}
+	mpg123_close(mh);
+	/* A handle that has been switched to another decoder or that uses a
+	   buffer of the former user is not what the next user asked for. */
+	if( strcmp(mpg123_current_decoder(mh), pool->decoder)
+	||	frame_recycle(mh, &pool->p) )
+	{
+		mpg123_delete(mh);
+		return;
+	}
+	pool_lock(pool);
+	if(pool->fill < pool->size)
+	{
+		pool->idle[pool->fill++] = mh;
+		mh = NULL;
+	}
+	pool_unlock(pool);
+	if(mh != NULL)
+		mpg123_delete(mh);
+}
+
+void attribute_align_arg mpg123_pool_delete(mpg123_pool *pool)
+{
+	if(pool == NULL)
+		return;
+	while(pool->fill)
+		mpg123_delete(pool->idle[--pool->fill]);
+	if(pool->idle != NULL)
+		free(pool->idle);
+	if(pool->decoder != NULL)
+		free(pool->decoder);
+#ifndef NO_THREADS
+	pthread_mutex_destroy(&pool->lock);
+#endif
+	free(pool);
+}
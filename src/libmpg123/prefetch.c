@@ -0,0 +1,316 @@
+/*
+	prefetch: read-ahead thread for slow storage
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	With MPG123_PREFETCH set, a worker thread keeps a ring buffer ahead of the
+	parser filled from the actual reader, in blocks of a quarter of the ring
+	size. The parser then only waits on storage when the ring runs dry.
+	Seeks pause the worker (waiting for a read in flight to finish), seek the
+	underlying stream with the offset corrected for what is buffered and
+	drop the ring. Forward skips within the ring are served from it.
+	With MPG123_PEEK_END_LATER, the worker also reads the last 128 bytes
+	(for ID3v1) once the first block is in, seeking there and back between
+	two blocks, so that the parser does not wait for that.
+*/
+
+#include "mpg123lib_intern.h"
+
+#ifndef NO_THREADS
+#include <pthread.h>
+
+#include "debug.h"
+
+struct prefetch
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	mpg123_handle *fr;
+	/* The actual reading and seeking. */
+	ssize_t (*read)(mpg123_handle *, void *, size_t);
+	off_t (*seek)(struct reader_data *, off_t, int);
+	unsigned char *ring;
+	size_t size;
+	size_t block;
+	size_t head; /* start of buffered data */
+	size_t fill;
+	int eof;
+	int err;    /* errno of a failed read */
+	int busy;   /* worker is inside a read */
+	int pause;  /* someone else touches the stream */
+	int quit;
+	int tail;   /* TAIL_* state of the peek at the end */
+	unsigned char tailbuf[128];
+};
+
+#define TAIL_NONE   0
+#define TAIL_WANTED 1
+#define TAIL_DONE   2
+#define TAIL_FAILED 3
+#define TAIL_LOST   4 /* could not seek back */
+
+/* The peek at the end, from the thread, not holding the lock. */
+static int tail_read(struct prefetch *pf)
+{
+	struct reader_data *rdat = &pf->fr->rdat;
+	off_t pos = pf->seek(rdat, 0, SEEK_CUR);
+	size_t got = 0;
+	int ret = TAIL_FAILED;
+
+	if(pos < 0)
+		return TAIL_FAILED;
+	if(pf->seek(rdat, -128, SEEK_END) >= 0)
+	{
+		while(got < sizeof(pf->tailbuf))
+		{
+			ssize_t n = pf->read(pf->fr, pf->tailbuf+got, sizeof(pf->tailbuf)-got);
+			if(n < 0 && errno == EINTR)
+				continue;
+			if(n <= 0)
+				break;
+			got += n;
+		}
+		if(got == sizeof(pf->tailbuf))
+			ret = TAIL_DONE;
+	}
+	if(pf->seek(rdat, pos, SEEK_SET) != pos)
+		ret = TAIL_LOST;
+	return ret;
+}
+
+static void *prefetch_thread(void *arg)
+{
+	struct prefetch *pf = arg;
+
+	pthread_mutex_lock(&pf->lock);
+	while(!pf->quit)
+	{
+		size_t tail, n;
+		ssize_t ret;
+
+		/* After the first block, the parser has something to work on. */
+		if( pf->tail == TAIL_WANTED && !pf->pause
+		&&	(pf->fill || pf->eof || pf->err) )
+		{
+			pf->busy = 1;
+			pthread_mutex_unlock(&pf->lock);
+			ret = tail_read(pf);
+			pthread_mutex_lock(&pf->lock);
+			pf->busy = 0;
+			if(ret == TAIL_LOST)
+			{
+				/* Nothing more from here, the stream is elsewhere. */
+				pf->err = errno ? errno : EIO;
+				pf->eof = 1;
+				ret = TAIL_FAILED;
+			}
+			pf->tail = (int)ret;
+			pthread_cond_broadcast(&pf->cond);
+			continue;
+		}
+		if(pf->pause || pf->eof || pf->err || pf->fill == pf->size)
+		{
+			pthread_cond_wait(&pf->cond, &pf->lock);
+			continue;
+		}
+		tail = (pf->head + pf->fill) % pf->size;
+		n = pf->size - pf->fill;
+		if(n > pf->size - tail)
+			n = pf->size - tail;
+		if(n > pf->block)
+			n = pf->block;
+		pf->busy = 1;
+		pthread_mutex_unlock(&pf->lock);
+		ret = pf->read(pf->fr, pf->ring+tail, n);
+		pthread_mutex_lock(&pf->lock);
+		pf->busy = 0;
+		if(ret > 0)
+			pf->fill += ret;
+		else if(ret == 0)
+			pf->eof = 1;
+		else if(errno != EINTR)
+			pf->err = errno ? errno : EIO;
+		pthread_cond_broadcast(&pf->cond);
+	}
+	pthread_mutex_unlock(&pf->lock);
+	return NULL;
+}
+
+/* Take up to count bytes out of the ring. Lock held. */
+static size_t ring_take(struct prefetch *pf, unsigned char *buf, size_t count)
+{
+	size_t got = 0;
+	if(count > pf->fill)
+		count = pf->fill;
+	while(got < count)
+	{
+		size_t n = count - got;
+		if(n > pf->size - pf->head)
+			n = pf->size - pf->head;
+		if(buf)
+			memcpy(buf+got, pf->ring+pf->head, n);
+		pf->head = (pf->head + n) % pf->size;
+		pf->fill -= n;
+		got += n;
+	}
+	return got;
+}
+
+int prefetch_start( mpg123_handle *fr
+,	off_t (*seek)(struct reader_data *, off_t, int) )
+{
+	struct prefetch *pf;
+
+	if(fr->p.prefetch <= 0 || fr->rdat.prefetch)
+		return 0;
+	pf = malloc(sizeof(*pf));
+	if(!pf)
+		return -1;
+	memset(pf, 0, sizeof(*pf));
+	pf->size  = fr->p.prefetch;
+	pf->block = pf->size/4 ? pf->size/4 : 1;
+	pf->ring  = malloc(pf->size);
+	pf->fr    = fr;
+	pf->read  = fr->rdat.fdread;
+	pf->seek  = seek;
+	pf->tail  = fr->rdat.flags & READER_TAILPEEK ? TAIL_WANTED : TAIL_NONE;
+	if(!pf->ring)
+	{
+		free(pf);
+		return -1;
+	}
+	if(pthread_mutex_init(&pf->lock, NULL))
+		goto start_fail;
+	if(pthread_cond_init(&pf->cond, NULL))
+	{
+		pthread_mutex_destroy(&pf->lock);
+		goto start_fail;
+	}
+	/* The thread reads the flags, settle them before. */
+	fr->rdat.prefetch = pf;
+	fr->rdat.fdread = prefetch_read;
+	fr->rdat.flags |= READER_PREFETCH;
+	if(pthread_create(&pf->thread, NULL, prefetch_thread, pf))
+	{
+		fr->rdat.prefetch = NULL;
+		fr->rdat.fdread = pf->read;
+		fr->rdat.flags &= ~READER_PREFETCH;
+		pthread_cond_destroy(&pf->cond);
+		pthread_mutex_destroy(&pf->lock);
+		goto start_fail;
+	}
+	debug2("prefetching %lu bytes in blocks of %lu"
+	,	(unsigned long)pf->size, (unsigned long)pf->block);
+	return 0;
+start_fail:
+	free(pf->ring);
+	free(pf);
+	return -1;
+}
+
+void prefetch_stop(mpg123_handle *fr)
+{
+	struct prefetch *pf = fr->rdat.prefetch;
+	if(!pf)
+		return;
+	pthread_mutex_lock(&pf->lock);
+	pf->quit = 1;
+	pthread_cond_broadcast(&pf->cond);
+	pthread_mutex_unlock(&pf->lock);
+	pthread_join(pf->thread, NULL);
+	pthread_cond_destroy(&pf->cond);
+	pthread_mutex_destroy(&pf->lock);
+	fr->rdat.fdread = pf->read;
+	fr->rdat.flags &= ~READER_PREFETCH;
+	fr->rdat.prefetch = NULL;
+	free(pf->ring);
+	free(pf);
+}
+
+ssize_t prefetch_read(mpg123_handle *fr, void *buf, size_t count)
+{
+	struct prefetch *pf = fr->rdat.prefetch;
+	ssize_t ret;
+
+	pthread_mutex_lock(&pf->lock);
+	while(!pf->fill && !pf->eof && !pf->err)
+		pthread_cond_wait(&pf->cond, &pf->lock);
+	if(pf->fill)
+		ret = ring_take(pf, buf, count);
+	else if(pf->err)
+	{
+		errno = pf->err;
+		/* Report it once, the next read may try again. */
+		pf->err = 0;
+		ret = -1;
+	}
+	else
+		ret = 0;
+	pthread_cond_broadcast(&pf->cond);
+	pthread_mutex_unlock(&pf->lock);
+	return ret;
+}
+
+int prefetch_tail(mpg123_handle *fr, unsigned char *buf, int wait)
+{
+	struct prefetch *pf = fr->rdat.prefetch;
+	int ret;
+
+	pthread_mutex_lock(&pf->lock);
+	while(wait && pf->tail == TAIL_WANTED)
+		pthread_cond_wait(&pf->cond, &pf->lock);
+	switch(pf->tail)
+	{
+		case TAIL_WANTED:
+			ret = 0;
+		break;
+		case TAIL_DONE:
+			memcpy(buf, pf->tailbuf, sizeof(pf->tailbuf));
+			ret = 1;
+		break;
+		default:
+			ret = -1;
+	}
+	pthread_mutex_unlock(&pf->lock);
+	return ret;
+}
+
+off_t prefetch_seek(struct reader_data *rdat, off_t offset, int whence)
+{
+	struct prefetch *pf = rdat->prefetch;
+	off_t ret;
+
+	pthread_mutex_lock(&pf->lock);
+	pf->pause = 1;
+	while(pf->busy)
+		pthread_cond_wait(&pf->cond, &pf->lock);
+	if(whence == SEEK_CUR && offset >= 0 && offset <= (off_t)pf->fill)
+	{
+		/* Stay inside the ring. */
+		ret = pf->seek(rdat, 0, SEEK_CUR);
+		if(ret >= 0)
+		{
+			ring_take(pf, NULL, offset);
+			ret -= pf->fill;
+		}
+	}
+	else
+	{
+		/* The stream is ahead of the reader by what is buffered. */
+		ret = pf->seek( rdat
+		,	whence == SEEK_CUR ? offset - (off_t)pf->fill : offset, whence );
+		if(ret >= 0)
+		{
+			pf->head = pf->fill = 0;
+			pf->eof = pf->err = 0;
+		}
+	}
+	pf->pause = 0;
+	pthread_cond_broadcast(&pf->cond);
+	pthread_mutex_unlock(&pf->lock);
+	return ret;
+}
+
+#endif
@@ -19,6 +19,10 @@ struct buffy
 	ssize_t size;
 	ssize_t realsize;
 	struct buffy *next;
+	/* Memory of the caller, given back via release (see mpg123_feed_borrow()). */
+	int borrowed;
+	void (*release)(void *handle, const unsigned char *data);
+	void *release_handle;
 };
 
 
@@ -37,16 +41,31 @@ struct bufferchain
 	size_t pool_fill;    /* That many buffers are there. */
 	/* A pool of buffers to re-use, if activated. It's a linked list that is worked on from the front. */
 	struct buffy *pool;
+	/* Adaptive pool: pool_size moves between these, following the peak of
+	   own buffers in use (not counting borrowed ones) with some delay. */
+	size_t pool_min;
+	size_t pool_max;
+	size_t used;         /* Own buffers in the chain right now. */
+	size_t peak;         /* Most of them in use during the current window. */
+	size_t window;       /* Allocations in the current window. */
+	unsigned long hits;   /* Allocations served from the pool ... */
+	unsigned long misses; /* ... and those that needed malloc(). */
+	/* MPG123_FEED_CONTIGUOUS: one buffer that is compacted and grown. */
+	int contiguous;
+	int pinned; /* A frame body is parsed in place, do not move memory. */
 };
 
 /* Call this before any buffer chain use (even bc_init()). */
-void bc_prepare(struct bufferchain *, size_t pool_size, size_t bufblock);
+void bc_prepare(struct bufferchain *, size_t pool_size, size_t pool_max, size_t bufblock);
 /* Free persistent data in the buffer chain, after bc_reset(). */
 void bc_cleanup(struct bufferchain *);
-/* Change pool size. This does not actually allocate/free anything on itself, just instructs later operations to free less / allocate more buffers. */
-void bc_poolsize(struct bufferchain *, size_t pool_size, size_t bufblock);
+/* Change pool size. This does not actually allocate/free anything on itself, just instructs later operations to free less / allocate more buffers.
+   With pool_max > pool_size, the pool adapts to usage in between. */
+void bc_poolsize(struct bufferchain *, size_t pool_size, size_t pool_max, size_t bufblock);
 /* Return available byte count in the buffer. */
 size_t bc_fill(struct bufferchain *bc);
+/* Return the memory held by buffers in use and in the pool. */
+size_t bc_memory(struct bufferchain *bc);
 
 #endif
 
@@ -67,8 +86,12 @@ struct reader_data
 	   They get picked if there's some iohandle set. */
 	ssize_t (*r_read_handle) (void *handle, void *buf, size_t count);
 	off_t   (*r_lseek_handle)(void *handle, off_t offset, int whence);
+	/* Alternative seeker with fixed 64 bit offsets, see mpg123_reader64(). */
+	int64_t (*r_lseek_handle64)(void *handle, int64_t offset, int whence);
 	/* An optional cleaner for the handle on closing the stream. */
 	void    (*cleanup_handle)(void *handle);
+	/* Copies of the handle for workers, see mpg123_decode_parallel_handle(). */
+	void   *(*dup_handle)(void *handle);
 	/* These two pointers are the actual workers (default map to POSIX read/lseek). */
 	ssize_t (*read) (int fd, void *buf, size_t count);
 	off_t   (*lseek)(int fd, off_t offset, int whence);
@@ -77,6 +100,24 @@ struct reader_data
 #ifndef NO_FEEDER
 	struct bufferchain buffer; /* Not dynamically allocated, these few struct bytes aren't worth the trouble. */
 #endif
+#ifdef HAVE_MMAP
+	/* The whole file mapped into memory, read position inside it. */
+	unsigned char *map;
+	off_t maplen;
+	off_t mappos;
+#endif
+#ifndef NO_THREADS
+	struct prefetch *prefetch; /* read-ahead thread, see prefetch.c */
+#endif
+#ifdef HAVE_IO_URING
+	struct uring *uring; /* asynchronous read-ahead, see uring.c */
+#endif
+	/* Block for buffering small reads, see MPG123_READ_BLOCK. */
+	unsigned char *block;
+	size_t blocksize;
+	size_t blockfill;
+	size_t blockpos;
+	off_t blockend;
 };
 
 /* start to use off_t to properly do LFS in future ... used to be long */
@@ -105,17 +146,76 @@ int open_stream_handle(mpg123_handle *, void *iohandle);
 int open_feed(mpg123_handle *);
 /* externally called function, returns 0 on success, -1 on error */
 int  feed_more(mpg123_handle *fr, const unsigned char *in, long count);
+/* Same, but keep the caller's buffer instead of copying, see mpg123_feed_borrow(). */
+int  feed_borrow( mpg123_handle *fr, const unsigned char *in, long count
+	, void (*release)(void *, const unsigned char *), void *handle );
 void feed_forget(mpg123_handle *fr);  /* forget the data that has been read (free some buffers) */
 off_t feed_set_pos(mpg123_handle *fr, off_t pos); /* Set position (inside available data if possible), return wanted byte offset of next feed. */
+/* READER_MORE (back at the start like a failed read) if the feeder does not
+   have bytes more data yet, else 0, also for any other reader. */
+int feed_need(mpg123_handle *fr, off_t bytes);
+/* Input offset after the data fed so far, -1 if this is no feeder. */
+off_t feed_end(mpg123_handle *fr);
 
 void open_bad(mpg123_handle *);
 
+/* The descriptor to wait on for more input, or -1. */
+int reader_poll_fd(mpg123_handle *);
+
+/* Take in the ID3v1 peek at the end left for later (MPG123_PEEK_END_LATER).
+   Without wait, only if the read-ahead thread got it already. Returns 0,
+   or READER_ERROR if the stream position is lost. */
+int reader_tail(mpg123_handle *fr, int wait);
+
+/* Return a pointer to the next size bytes directly in the input data
+   (file mapping or feeder buffers), advancing the position, or NULL if that
+   is not possible and the body has to be read the usual way. The data
+   stays valid until the next frame is read. */
+unsigned char *inplace_frame_body(mpg123_handle *, int size);
+
+#ifndef NO_THREADS
+/* Start the read-ahead thread with a ring of fr->p.prefetch bytes over the
+   current fdread and the given seek function, if that size is non-zero.
+   Returns 0 on success (or nothing to do), -1 on failure. */
+int prefetch_start( mpg123_handle *fr
+	, off_t (*seek)(struct reader_data *, off_t, int) );
+/* Stop the thread and drop the ring. */
+void prefetch_stop(mpg123_handle *fr);
+/* The fdread and seek while prefetching. */
+ssize_t prefetch_read(mpg123_handle *fr, void *buf, size_t count);
+off_t prefetch_seek(struct reader_data *rdat, off_t offset, int whence);
+/* The last 128 bytes that the thread peeked at, wanted if the stream has
+   READER_TAILPEEK on start: 1 if there, 0 if not yet (without wait), -1
+   if the peek failed. */
+int prefetch_tail(mpg123_handle *fr, unsigned char *buf, int wait);
+#endif
+
+#ifdef HAVE_IO_URING
+/* Read a plain file through an io_uring with fr->p.uring bytes in flight,
+   if that size is non-zero and the kernel supports it. Returns 0 on
+   success (or nothing to do), -1 on failure. */
+int uring_start(mpg123_handle *fr);
+void uring_stop(mpg123_handle *fr);
+/* The fdread and seek with the ring, and the descriptor to poll. */
+ssize_t uring_read(mpg123_handle *fr, void *buf, size_t count);
+off_t uring_seek(struct reader_data *rdat, off_t offset, int whence);
+int uring_fd(struct reader_data *rdat);
+#endif
+
 #define READER_FD_OPENED 0x1
 #define READER_ID3TAG    0x2
 #define READER_SEEKABLE  0x4
 #define READER_BUFFERED  0x8
 #define READER_NONBLOCK  0x20
 #define READER_HANDLEIO  0x40
+#define READER_MAPPED    0x80
+#define READER_PREFETCH  0x100
+#define READER_BLOCKED   0x200
+#define READER_URING     0x400
+/* Input that is not there yet is MPG123_NEED_MORE, see MPG123_NONBLOCK. */
+#define READER_NOWAIT    0x800
+/* The ID3v1 peek at the end is still to be done, see reader_tail(). */
+#define READER_TAILPEEK  0x1000
 
 #define READER_STREAM 0
 #define READER_ICY_STREAM 1
@@ -19,15 +19,24 @@
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
+/* ... but poll() has no limit on the descriptor number. */
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 #ifdef _MSC_VER
 #include <io.h>
 #endif
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include "compat.h"
+#include "mpeghead.h"
 #include "debug.h"
 
 static int default_init(mpg123_handle *fr);
 static off_t get_fileinfo(mpg123_handle *);
+static off_t get_filelen(mpg123_handle *);
 static ssize_t posix_read(int fd, void *buf, size_t count){ return read(fd, buf, count); }
 static off_t   posix_lseek(int fd, off_t offset, int whence){ return lseek(fd, offset, whence); }
 static off_t     nix_lseek(int fd, off_t offset, int whence){ return -1; }
@@ -35,8 +44,15 @@ static off_t     nix_lseek(int fd, off_t offset, int whence){ return -1; }
 static ssize_t plain_fullread(mpg123_handle *fr,unsigned char *buf, ssize_t count);
 
 /* Wrapper to decide between descriptor-based and external handle-based I/O. */
+static off_t raw_seek(struct reader_data *rdat, off_t offset, int whence);
 static off_t io_seek(struct reader_data *rdat, off_t offset, int whence);
 static ssize_t io_read(struct reader_data *rdat, void *buf, size_t count);
+static void block_start(struct reader_data *rdat, size_t size);
+static void block_stop(struct reader_data *rdat);
+
+/* Some extra bytes after the frame body are safe to touch for the bit
+   reader, even at the end of the input data. */
+#define BODY_SAFETY 8
 
 #ifndef NO_FEEDER
 /* Bufferchain methods. */
@@ -61,22 +77,44 @@ static ssize_t plain_read(mpg123_handle *fr, void *buf, size_t count)
 	return ret;
 }
 
+/* Network streams are taken in blocks of that size (unless MPG123_READ_BLOCK
+   says otherwise), so that there is one wait and one read for several small
+   reads of the parser, not one each. */
+#define TIMEOUT_BLOCK 16384
+
 #ifdef TIMEOUT_READ
 
 /* Wait for data becoming available, allowing soft-broken network connection to die
    This is needed for Shoutcast servers that have forgotten about us while connection was temporarily down. */
 static ssize_t timeout_read(mpg123_handle *fr, void *buf, size_t count)
 {
-	struct timeval tv;
 	ssize_t ret = 0;
-	fd_set fds;
-	tv.tv_sec = fr->rdat.timeout_sec;
-	tv.tv_usec = 0;
-	FD_ZERO(&fds);
-	FD_SET(fr->rdat.filept, &fds);
-	ret = select(fr->rdat.filept+1, &fds, NULL, NULL, &tv);
+	/* Data in the read block is there already. Without waiting
+	   (MPG123_NONBLOCK), the read itself tells if there is more. */
+	if(  (fr->rdat.flags & READER_NOWAIT)
+	  || (fr->rdat.flags & READER_BLOCKED && fr->rdat.blockpos < fr->rdat.blockfill) )
+		return io_read(&fr->rdat, buf, count);
+#ifdef HAVE_POLL_H
+	{
+		struct pollfd pfd;
+		pfd.fd = fr->rdat.filept;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		ret = poll(&pfd, 1, (int)(fr->rdat.timeout_sec*1000));
+	}
+#else
+	{
+		struct timeval tv;
+		fd_set fds;
+		tv.tv_sec = fr->rdat.timeout_sec;
+		tv.tv_usec = 0;
+		FD_ZERO(&fds);
+		FD_SET(fr->rdat.filept, &fds);
+		ret = select(fr->rdat.filept+1, &fds, NULL, NULL, &tv);
+	}
+#endif
 	/* This works only with "my" read function. Not user-replaced. */
-	if(ret > 0) ret = read(fr->rdat.filept, buf, count);
+	if(ret > 0) ret = io_read(&fr->rdat, buf, count);
 	else
 	{
 		ret=-1; /* no activity is the error */
@@ -86,7 +124,61 @@ static ssize_t timeout_read(mpg123_handle *fr, void *buf, size_t count)
 }
 #endif
 
+#ifdef EWOULDBLOCK
+#define WOULD_BLOCK(err) ((err) == EAGAIN || (err) == EWOULDBLOCK)
+#else
+#define WOULD_BLOCK(err) ((err) == EAGAIN)
+#endif
+
 #ifndef NO_ICY
+/* Hand the metadata to the callback right from the block, or keep a copy
+   for mpg123_icy(). */
+static void icy_meta(mpg123_handle *fr, const unsigned char *meta, size_t meta_size)
+{
+	char *meta_buff;
+
+	if(fr->icy_callback)
+	{
+		fr->icy_callback(fr->icy_handle, (const char*)meta, meta_size);
+		return;
+	}
+	if(fr->p.fixed_memory && fr->icy.data != NULL)
+		meta_buff = fr->icy.data; /* Big enough for any, see icy_fullread(). */
+	else
+		meta_buff = malloc(meta_size+1);
+	if(meta_buff == NULL)
+	{
+		if(NOQUIET) error1("cannot allocate memory for meta_buff (%lu bytes) ... skipping the metadata!", (unsigned long)meta_size);
+		return;
+	}
+	memcpy(meta_buff, meta, meta_size);
+	meta_buff[meta_size] = 0; /* string paranoia */
+	if(fr->icy.data && fr->icy.data != meta_buff) free(fr->icy.data);
+	fr->icy.data = meta_buff;
+	fr->metaflags |= MPG123_NEW_ICY;
+	debug2("icy-meta: %s size: %d bytes", fr->icy.data, (int)meta_size);
+	frame_meta_notify(fr, MPG123_NEW_ICY);
+}
+
+/* Move the rest of the block to its start and read what fits behind it,
+   in one call to the lower read. */
+static ssize_t icy_block_read(mpg123_handle *fr)
+{
+	size_t avail = fr->icy.blockfill - fr->icy.blockpos;
+	ssize_t ret;
+
+	if(avail && fr->icy.blockpos)
+		memmove(fr->icy.block, fr->icy.block+fr->icy.blockpos, avail);
+	fr->icy.blockpos = 0;
+	fr->icy.blockfill = avail;
+	ret = fr->rdat.fdread(fr, fr->icy.block+avail, ICY_BLOCK-avail);
+	if(ret < 0 && (fr->rdat.flags & READER_NOWAIT) && WOULD_BLOCK(errno))
+		return READER_MORE;
+	if(ret > 0)
+		fr->icy.blockfill += ret;
+	return ret;
+}
+
 /* stream based operation  with icy meta data*/
 static ssize_t icy_fullread(mpg123_handle *fr, unsigned char *buf, ssize_t count)
 {
@@ -104,91 +196,70 @@ static ssize_t icy_fullread(mpg123_handle *fr, unsigned char *buf, ssize_t count
 		2. We get false positives of EOF for either files that grew or
 		3. ... files that have ID3v1 tags in between (stream with intro).
 	*/
-
-	while(cnt < count)
+	if(fr->icy.block == NULL && !(fr->icy.block = malloc(ICY_BLOCK)))
+	{
+		if(NOQUIET) error("cannot allocate ICY block");
+		return READER_ERROR;
+	}
+	/* With MPG123_FIXED_MEMORY, all metadata goes into one buffer that
+	   exists before the first frame. */
+	if(fr->p.fixed_memory && fr->icy.data == NULL)
 	{
-		/* all icy code is inside this if block, everything else is the plain fullread we know */
-		/* debug1("read: %li left", (long) count-cnt); */
-		if(fr->icy.next < count-cnt)
+		if(!(fr->icy.data = malloc(ICY_META_MAX+1)))
 		{
-			unsigned char temp_buff;
-			size_t meta_size;
-			ssize_t cut_pos;
-
-			/* we are near icy-metaint boundary, read up to the boundary */
-			if(fr->icy.next > 0)
-			{
-				cut_pos = fr->icy.next;
-				ret = fr->rdat.fdread(fr,buf+cnt,cut_pos);
-				if(ret < 1)
-				{
-					if(ret == 0) break; /* Just EOF. */
-					if(NOQUIET) error("icy boundary read");
-
-					return READER_ERROR;
-				}
-
-				if(!(fr->rdat.flags & READER_BUFFERED)) fr->rdat.filepos += ret;
-				cnt += ret;
-				fr->icy.next -= ret;
-				if(fr->icy.next > 0)
-				{
-					debug1("another try... still %li left", (long)fr->icy.next);
-					continue;
-				}
-			}
-			/* now off to read icy data */
-
-			/* one byte icy-meta size (must be multiplied by 16 to get icy-meta length) */
-			
-			ret = fr->rdat.fdread(fr,&temp_buff,1); /* Getting one single byte hast to suceed. */
-			if(ret < 0){ if(NOQUIET) error("reading icy size"); return READER_ERROR; }
-			if(ret == 0) break;
+			if(NOQUIET) error("cannot allocate ICY metadata buffer");
+			return READER_ERROR;
+		}
+		fr->icy.data[0] = 0;
+	}
 
-			debug2("got meta-size byte: %u, at filepos %li", temp_buff, (long)fr->rdat.filepos );
-			if(!(fr->rdat.flags & READER_BUFFERED)) fr->rdat.filepos += ret; /* 1... */
+	while(cnt < count)
+	{
+		size_t avail = fr->icy.blockfill - fr->icy.blockpos;
+		unsigned char *data = fr->icy.block + fr->icy.blockpos;
+		size_t need;
 
-			if((meta_size = ((size_t) temp_buff) * 16))
-			{
-				/* we have got some metadata */
-				char *meta_buff;
-				/* TODO: Get rid of this malloc ... perhaps hooking into the reader buffer pool? */
-				meta_buff = malloc(meta_size+1);
-				if(meta_buff != NULL)
-				{
-					ssize_t left = meta_size;
-					while(left > 0)
-					{
-						ret = fr->rdat.fdread(fr,meta_buff+meta_size-left,left);
-						/* 0 is error here, too... there _must_ be the ICY data, the server promised! */
-						if(ret < 1){ if(NOQUIET) error("reading icy-meta"); return READER_ERROR; }
-						left -= ret;
-					}
-					meta_buff[meta_size] = 0; /* string paranoia */
-					if(!(fr->rdat.flags & READER_BUFFERED)) fr->rdat.filepos += ret;
-
-					if(fr->icy.data) free(fr->icy.data);
-					fr->icy.data = meta_buff;
-					fr->metaflags |= MPG123_NEW_ICY;
-					debug2("icy-meta: %s size: %d bytes", fr->icy.data, (int)meta_size);
-				}
-				else
-				{
-					if(NOQUIET) error1("cannot allocate memory for meta_buff (%lu bytes) ... trying to skip the metadata!", (unsigned long)meta_size);
-					fr->rd->skip_bytes(fr, meta_size);
-				}
-			}
-			fr->icy.next = fr->icy.interval;
+		if(!avail)
+		{
+			ret = icy_block_read(fr);
+			/* The block keeps what is there, parsing continues on the next call. */
+			if(ret == READER_MORE) return cnt ? cnt : READER_MORE;
+			if(ret < 0){ if(NOQUIET) error("icy block read"); return READER_ERROR; }
+			if(ret == 0) break; /* Just EOF. */
+			continue;
 		}
-		else
+		if(fr->icy.next > 0)
 		{
-			ret = plain_fullread(fr, buf+cnt, count-cnt);
-			if(ret < 0){ if(NOQUIET) error1("reading the rest of %li", (long)(count-cnt)); return READER_ERROR; }
-			if(ret == 0) break;
-
-			cnt += ret;
-			fr->icy.next -= ret;
+			/* Audio data up to the next metadata, copied out of the block. */
+			size_t n = avail;
+			if((off_t)n > fr->icy.next)
+				n = (size_t)fr->icy.next;
+			if((ssize_t)n > count-cnt)
+				n = (size_t)(count-cnt);
+			memcpy(buf+cnt, data, n);
+			fr->icy.blockpos += n;
+			fr->icy.next -= n;
+			cnt += n;
+			if(!(fr->rdat.flags & READER_BUFFERED)) fr->rdat.filepos += n;
+			continue;
+		}
+		/* one byte icy-meta size (must be multiplied by 16 to get icy-meta length),
+		   the whole metadata has to be in the block */
+		need = 1 + (size_t)data[0]*16;
+		if(avail < need)
+		{
+			ret = icy_block_read(fr);
+			if(ret == READER_MORE) return cnt ? cnt : READER_MORE;
+			/* 0 is error here, too... there _must_ be the ICY data, the server promised! */
+			if(ret < 1){ if(NOQUIET) error("reading icy-meta"); return READER_ERROR; }
+			continue;
 		}
+		debug2("got meta-size byte: %u, at filepos %li", data[0], (long)fr->rdat.filepos );
+		if(need > 1)
+			icy_meta(fr, data+1, need-1);
+		fr->icy.blockpos += need;
+		if(!(fr->rdat.flags & READER_BUFFERED)) fr->rdat.filepos += need;
+		fr->icy.next = fr->icy.interval;
 	}
 	/* debug1("done reading, got %li", (long)cnt); */
 	return cnt;
@@ -215,11 +286,14 @@ static ssize_t plain_fullread(mpg123_handle *fr,unsigned char *buf, ssize_t coun
 	while(cnt < count)
 	{
 		ret = fr->rdat.fdread(fr,buf+cnt,count-cnt);
+		if(ret < 0 && (fr->rdat.flags & READER_NOWAIT) && WOULD_BLOCK(errno))
+			return cnt ? cnt : READER_MORE;
 		if(ret < 0) return READER_ERROR;
 		if(ret == 0) break;
 		if(!(fr->rdat.flags & READER_BUFFERED)) fr->rdat.filepos += ret;
 		cnt += ret;
 	}
+	MPGPROBE3(read, (long long)fr->rdat.filepos, (long)count, (long)cnt);
 	return cnt;
 }
 
@@ -238,6 +312,21 @@ static off_t stream_lseek(mpg123_handle *fr, off_t pos, int whence)
 
 static void stream_close(mpg123_handle *fr)
 {
+#ifndef NO_THREADS
+	prefetch_stop(fr);
+#endif
+#ifdef HAVE_IO_URING
+	uring_stop(fr);
+#endif
+	block_stop(&fr->rdat);
+#ifdef HAVE_MMAP
+	if(fr->rdat.flags & READER_MAPPED)
+	{
+		munmap(fr->rdat.map, (size_t)fr->rdat.maplen);
+		fr->rdat.map = NULL;
+		fr->rdat.flags &= ~READER_MAPPED;
+	}
+#endif
 	if(fr->rdat.flags & READER_FD_OPENED) compat_close(fr->rdat.filept);
 
 	fr->rdat.filept = 0;
@@ -253,6 +342,56 @@ static void stream_close(mpg123_handle *fr)
 	}
 }
 
+/*
+	Jump via the VBRI table when it gets closer to newframe than the index
+	(or replaces a fuzzy guess). The frame at the table position is read to
+	verify that the table fits the stream; a table that does not is dropped.
+	Returns TRUE when positioned, FALSE when not used, -1 when the attempt
+	failed and left the stream somewhere else.
+*/
+static int vbri_jump(mpg123_handle *fr, off_t newframe, off_t preframe)
+{
+	off_t frame;
+	off_t pos = frame_vbri_find(fr, newframe, &frame);
+	int accurate = fr->state_flags & FRAME_ACCURATE;
+
+	if(pos < 0 || !(fr->rdat.flags & READER_SEEKABLE))
+		return FALSE;
+	if(accurate && frame <= preframe)
+		return FALSE;
+	if(fr->num < newframe && fr->num >= frame)
+		return FALSE;
+	debug2("VBRI jump to frame %"OFF_P" at %"OFF_P, (off_p)frame, (off_p)pos);
+	if(fr->rd->skip_bytes(fr, pos - fr->rd->tell(fr)) == pos)
+	{
+		unsigned char hbuf[4];
+		unsigned long head;
+		/* Do not let read_frame() resync from some random spot. */
+		if(fr->rd->fullread(fr, hbuf, 4) != 4 || fr->rd->skip_bytes(fr, -4) != pos)
+			goto vbri_jump_bad;
+		head = (unsigned long)hbuf[0]<<24 | (unsigned long)hbuf[1]<<16
+		|	(unsigned long)hbuf[2]<<8 | hbuf[3];
+		/* Without frame index, the first header has just been forgotten. */
+		if( (head & HDR_SYNC) != HDR_SYNC || (fr->firsthead
+		&&	(head & HDR_CMPMASK) != (fr->firsthead & HDR_CMPMASK)) )
+			goto vbri_jump_bad;
+		fr->num = frame-1;
+		/* Keep an unverified position out of the frame index. */
+		fr->state_flags &= ~FRAME_ACCURATE;
+		if(read_frame(fr) == 1 && fr->rd->tell(fr) == pos+4+fr->framesize)
+		{
+			fr->state_flags |= FRAME_ACCURATE;
+			fr->silent_resync = 0;
+			return TRUE;
+		}
+		fr->state_flags |= accurate;
+	}
+vbri_jump_bad:
+	if(NOQUIET) warning("VBRI seek table does not match the stream, ignoring it.");
+	frame_free_vbri(fr);
+	return -1;
+}
+
 static int stream_seek_frame(mpg123_handle *fr, off_t newframe)
 {
 	debug2("seek_frame to %"OFF_P" (from %"OFF_P")", (off_p)newframe, (off_p)fr->num);
@@ -268,11 +407,13 @@ static int stream_seek_frame(mpg123_handle *fr, off_t newframe)
 			We use skip_bytes, which handles seekable and non-seekable streams
 			(the latter only for positive offset, which we ensured before entering here).
 		*/
+		int vbri;
 		seek_to = frame_index_find(fr, newframe, &preframe);
+		vbri = vbri_jump(fr, newframe, preframe);
 		/* No need to seek to index position if we are closer already.
 		   But I am picky about fr->num == newframe, play safe by reading the frame again.
 		   If you think that's stupid, don't call a seek to the current frame. */
-		if(fr->num >= newframe || fr->num < preframe)
+		if(vbri < 0 || (!vbri && (fr->num >= newframe || fr->num < preframe)))
 		{
 			to_skip = seek_to - fr->rd->tell(fr);
 			if(fr->rd->skip_bytes(fr, to_skip) != seek_to)
@@ -283,9 +424,16 @@ static int stream_seek_frame(mpg123_handle *fr, off_t newframe)
 		}
 		while(fr->num < newframe)
 		{
+			/* Frames on the way only need their headers, except the last one
+			   before the target, which feeds the bit reservoir. */
+			if(fr->num+2 < newframe)
+				fr->state_flags |= FRAME_SKIP_BODY;
+			else
+				fr->state_flags &= ~FRAME_SKIP_BODY;
 			/* try to be non-fatal now... frameNum only gets advanced on success anyway */
 			if(!read_frame(fr)) break;
 		}
+		fr->state_flags &= ~FRAME_SKIP_BODY;
 		/* Now the wanted frame should be ready for decoding. */
 		debug1("arrived at %lu", (long unsigned)fr->num);
 
@@ -383,16 +531,17 @@ static int stream_back_bytes(mpg123_handle *fr, off_t bytes)
 }
 
 
-/* returns size on success... */
+/* Returns size on success, READER_MORE if the rest is not there yet
+   (feeder, MPG123_NONBLOCK), 0 if the stream ended before, else READER_ERROR. */
 static int generic_read_frame_body(mpg123_handle *fr,unsigned char *buf, int size)
 {
 	long l;
 
 	if((l=fr->rd->fullread(fr,buf,size)) != size)
 	{
-		long ll = l;
-		if(ll <= 0) ll = 0;
-		return READER_MORE;
+		if(l == READER_MORE) return READER_MORE;
+		/* A full read only falls short at the end, waiting longer does not help. */
+		return l < 0 ? READER_ERROR : 0;
 	}
 	return l;
 }
@@ -451,6 +600,20 @@ static off_t get_fileinfo(mpg123_handle *fr)
 	return len;
 }
 
+/* Only the length, the last 128 bytes come later in reader_tail(). */
+static off_t get_filelen(mpg123_handle *fr)
+{
+	off_t len;
+
+	if((len=io_seek(&fr->rdat,0,SEEK_END)) < 0)	return -1;
+
+	if(io_seek(&fr->rdat,0,SEEK_SET) < 0)	return -1;
+
+	if(len <= 0)	return -1;
+
+	return len;
+}
+
 #ifndef NO_FEEDER
 /* Methods for the buffer chain, mainly used for feed reader, but not just that. */
 
@@ -470,6 +633,9 @@ static struct buffy* buffy_new(size_t size, size_t minsize)
 	}
 	newbuf->size = 0;
 	newbuf->next = NULL;
+	newbuf->borrowed = 0;
+	newbuf->release = NULL;
+	newbuf->release_handle = NULL;
 	return newbuf;
 }
 
@@ -477,7 +643,10 @@ static void buffy_del(struct buffy* buf)
 {
 	if(buf)
 	{
-		free(buf->data);
+		if(!buf->borrowed)
+			free(buf->data);
+		else if(buf->release)
+			buf->release(buf->release_handle, buf->data);
 		free(buf);
 	}
 }
@@ -493,11 +662,15 @@ static void buffy_del_chain(struct buffy* buf)
 	}
 }
 
-void bc_prepare(struct bufferchain *bc, size_t pool_size, size_t bufblock)
+void bc_prepare(struct bufferchain *bc, size_t pool_size, size_t pool_max, size_t bufblock)
 {
-	bc_poolsize(bc, pool_size, bufblock);
+	bc->pool_size = 0;
+	bc_poolsize(bc, pool_size, pool_max, bufblock);
 	bc->pool = NULL;
 	bc->pool_fill = 0;
+	bc->used = bc->peak = bc->window = 0;
+	bc->hits = bc->misses = 0;
+	bc->contiguous = 0;
 	bc_init(bc); /* Ensure that members are zeroed for read-only use. */
 }
 
@@ -506,9 +679,26 @@ size_t bc_fill(struct bufferchain *bc)
 	return (size_t)(bc->size - bc->pos);
 }
 
-void bc_poolsize(struct bufferchain *bc, size_t pool_size, size_t bufblock)
+size_t bc_memory(struct bufferchain *bc)
+{
+	size_t bytes = 0;
+	struct buffy *b;
+	for(b = bc->first; b != NULL; b = b->next)
+		bytes += sizeof(struct buffy) + b->realsize;
+	for(b = bc->pool; b != NULL; b = b->next)
+		bytes += sizeof(struct buffy) + b->realsize;
+	return bytes;
+}
+
+void bc_poolsize(struct bufferchain *bc, size_t pool_size, size_t pool_max, size_t bufblock)
 {
-	bc->pool_size = pool_size;
+	bc->pool_min = pool_size;
+	bc->pool_max = pool_max > pool_size ? pool_max : pool_size;
+	/* An adaptive pool keeps the size it arrived at, within the new limits. */
+	if(bc->pool_size < bc->pool_min)
+		bc->pool_size = bc->pool_min;
+	if(bc->pool_size > bc->pool_max)
+		bc->pool_size = bc->pool_max;
 	bc->bufblock = bufblock;
 }
 
@@ -519,22 +709,55 @@ void bc_cleanup(struct bufferchain *bc)
 	bc->pool_fill = 0;
 }
 
+/* Allocations between decisions to shrink an adaptive pool. */
+#define BC_POOL_WINDOW 64
+
+/* Shrink an adaptive pool after a window of low usage. It grows right
+   away in bc_free(), but only gives back half of the unused part per
+   window, to not go back and forth with bursty input. */
+static void bc_adapt(struct bufferchain *bc)
+{
+	if(bc->peak < bc->pool_size)
+	{
+		size_t target = bc->peak > bc->pool_min ? bc->peak : bc->pool_min;
+		if(bc->pool_size > target)
+		{
+			bc->pool_size -= (bc->pool_size - target + 1)/2;
+			debug1("bc_adapt: pool size down to %"SIZE_P, (size_p)bc->pool_size);
+		}
+	}
+	bc->peak = bc->used;
+	bc->window = 0;
+}
+
 /* Fetch a buffer from the pool (if possible) or create one. */
 static struct buffy* bc_alloc(struct bufferchain *bc, size_t size)
 {
+	struct buffy *buf;
 	/* Easy route: Just try the first available buffer.
 	   Size does not matter, it's only a hint for creation of new buffers. */
 	if(bc->pool)
 	{
-		struct buffy *buf = bc->pool;
+		buf = bc->pool;
 		bc->pool = buf->next;
 		buf->next = NULL; /* That shall be set to a sensible value later. */
 		buf->size = 0;
 		--bc->pool_fill;
+		++bc->hits;
 		debug2("bc_alloc: picked %p from pool (fill now %"SIZE_P")", (void*)buf, (size_p)bc->pool_fill);
-		return buf;
 	}
-	else return buffy_new(size, bc->bufblock);
+	else
+	{
+		buf = buffy_new(size, bc->bufblock);
+		if(!buf)
+			return NULL;
+		++bc->misses;
+	}
+	if(++bc->used > bc->peak)
+		bc->peak = bc->used;
+	if(bc->pool_max > bc->pool_min && ++bc->window >= BC_POOL_WINDOW)
+		bc_adapt(bc);
+	return buf;
 }
 
 /* Either stuff the buffer back into the pool or free it for good. */
@@ -542,7 +765,19 @@ static void bc_free(struct bufferchain *bc, struct buffy* buf)
 {
 	if(!buf) return;
 
-	if(bc->pool_fill < bc->pool_size)
+	if(!buf->borrowed)
+	{
+		--bc->used;
+		/* An adaptive pool grows to keep what the peak usage needs. */
+		if( bc->pool_fill >= bc->pool_size && bc->pool_size < bc->pool_max
+		&&	bc->pool_size < bc->peak )
+		{
+			++bc->pool_size;
+			debug1("bc_free: pool size up to %"SIZE_P, (size_p)bc->pool_size);
+		}
+	}
+	/* Borrowed memory goes back to its owner right away. */
+	if(!buf->borrowed && bc->pool_fill < bc->pool_size)
 	{
 		buf->next = bc->pool;
 		bc->pool = buf;
@@ -589,6 +824,8 @@ static void bc_init(struct bufferchain *bc)
 	bc->pos   = 0;
 	bc->firstpos = 0;
 	bc->fileoff  = 0;
+	bc->used = 0;
+	bc->pinned = 0;
 }
 
 static void bc_reset(struct bufferchain *bc)
@@ -621,6 +858,39 @@ static int bc_append(struct bufferchain *bc, ssize_t size)
 	return 0;
 }
 
+/* Contiguous mode: make room for need more bytes in the single buffer by
+   dropping the forgotten data in front of it (usually less than a frame)
+   and growing it. This is not possible with borrowed memory, several
+   buffers (which only happens as fallback) or a frame body in use. */
+static int bc_make_room(struct bufferchain *bc, ssize_t need)
+{
+	struct buffy *b = bc->first;
+	if(b == NULL || b != bc->last || b->borrowed || bc->pinned)
+		return -1;
+	if(bc->firstpos > 0)
+	{
+		memmove(b->data, b->data+bc->firstpos, b->size-bc->firstpos);
+		b->size     -= bc->firstpos;
+		bc->size    -= bc->firstpos;
+		bc->pos     -= bc->firstpos;
+		bc->fileoff += bc->firstpos;
+		bc->firstpos = 0;
+	}
+	if(b->realsize - b->size < need)
+	{
+		ssize_t newsize = b->realsize*2 > b->size+need
+		?	b->realsize*2
+		:	b->size+need;
+		unsigned char *data = realloc(b->data, newsize);
+		if(data == NULL)
+			return -1;
+		debug2("bc_make_room: %"SSIZE_P" -> %"SSIZE_P" B", (ssize_p)b->realsize, (ssize_p)newsize);
+		b->data = data;
+		b->realsize = newsize;
+	}
+	return 0;
+}
+
 /* Append a new buffer and copy content to it. */
 static int bc_add(struct bufferchain *bc, const unsigned char *data, ssize_t size)
 {
@@ -631,6 +901,10 @@ static int bc_add(struct bufferchain *bc, const unsigned char *data, ssize_t siz
 
 	while(size > 0)
 	{
+		/* Keep everything in one piece, with the safety margin for bodies. */
+		if( bc->contiguous && bc->last != NULL
+		&&	bc->last->realsize - bc->last->size < size + BODY_SAFETY )
+			bc_make_room(bc, size + BODY_SAFETY);
 		/* Try to fill up the last buffer block. */
 		if(bc->last != NULL && bc->last->size < bc->last->realsize)
 		{
@@ -653,10 +927,45 @@ static int bc_add(struct bufferchain *bc, const unsigned char *data, ssize_t siz
 	return ret;
 }
 
+/* Append a buffy that uses the given memory without copying it.
+   There is no room for bc_add() to fill up in there. */
+static int bc_borrow( struct bufferchain *bc, const unsigned char *data
+,	ssize_t size, void (*release)(void *, const unsigned char *), void *handle )
+{
+	struct buffy *newbuf;
+	if(size < 1) return -1;
+
+	if(bc->contiguous)
+	{
+		int ret = bc_add(bc, data, size);
+		if(ret == 0 && release)
+			release(handle, data);
+		return ret;
+	}
+	newbuf = malloc(sizeof(struct buffy));
+	if(newbuf == NULL) return -2;
+	newbuf->data = (unsigned char*)data;
+	newbuf->size = size;
+	newbuf->realsize = 0; /* Not our memory. */
+	newbuf->next = NULL;
+	newbuf->borrowed = 1;
+	newbuf->release = release;
+	newbuf->release_handle = handle;
+
+	if(bc->last != NULL)  bc->last->next = newbuf;
+	else if(bc->first == NULL) bc->first = newbuf;
+
+	bc->last  = newbuf;
+	bc->size += size;
+	debug2("bc_borrow: new last buffer %p with %"SSIZE_P" B", (void*)bc->last, (ssize_p)size);
+	return 0;
+}
+
 /* Common handler for "You want more than I can give." situation. */
 static ssize_t bc_need_more(struct bufferchain *bc)
 {
 	debug3("hit end, back to beginning (%li - %li < %li)", (long)bc->size, (long)bc->pos, (long)bc->size);
+	MPGPROBE2(feed_more, (long)bc->size, (long)bc->pos);
 	/* go back to firstpos, undo the previous reads */
 	bc->pos = bc->firstpos;
 	return READER_MORE;
@@ -668,6 +977,8 @@ static ssize_t bc_give(struct bufferchain *bc, unsigned char *out, ssize_t size)
 	struct buffy *b = bc->first;
 	ssize_t gotcount = 0;
 	ssize_t offset = 0;
+	/* Reading on means that the last frame is done with. */
+	bc->pinned = 0;
 	if(bc->size - bc->pos < size) return bc_need_more(bc);
 
 	/* find the current buffer */
@@ -700,6 +1011,33 @@ static ssize_t bc_give(struct bufferchain *bc, unsigned char *out, ssize_t size)
 	return gotcount;
 }
 
+/* Give a pointer to the next size bytes if they are inside one buffy,
+   advancing position like bc_give(). */
+static unsigned char *bc_peek_body(struct bufferchain *bc, ssize_t size)
+{
+	struct buffy *b = bc->first;
+	ssize_t offset = 0;
+	ssize_t loff;
+
+	if(bc->size - bc->pos < size) return NULL;
+	while(b != NULL && (offset + b->size) <= bc->pos)
+	{
+		offset += b->size;
+		b = b->next;
+	}
+	if(b == NULL) return NULL;
+	loff = bc->pos - offset;
+	/* Own buffers are allocated beyond the fill, borrowed ones are not.
+	   A body that ends with the buffer would let bc_forget() drop it before
+	   the frame is decoded. */
+	if( loff + size >= b->size
+	||	loff + size + BODY_SAFETY > (b->borrowed ? b->size : b->realsize) )
+		return NULL;
+	bc->pos += size;
+	bc->pinned = 1;
+	return b->data+loff;
+}
+
 /* Skip some bytes and return the new position.
    The buffers are still there, just the read pointer is moved! */
 static ssize_t bc_skip(struct bufferchain *bc, ssize_t count)
@@ -749,6 +1087,8 @@ static void bc_forget(struct bufferchain *bc)
 static int feed_init(mpg123_handle *fr)
 {
 	bc_init(&fr->rdat.buffer);
+	fr->rdat.buffer.hits = fr->rdat.buffer.misses = 0;
+	fr->rdat.buffer.contiguous = (fr->p.flags & MPG123_FEED_CONTIGUOUS) ? 1 : 0;
 	bc_fill_pool(&fr->rdat.buffer);
 	fr->rdat.filelen = 0;
 	fr->rdat.filepos = 0;
@@ -756,6 +1096,17 @@ static int feed_init(mpg123_handle *fr)
 	return 0;
 }
 
+int feed_borrow( mpg123_handle *fr, const unsigned char *in, long count
+	, void (*release)(void *, const unsigned char *), void *handle )
+{
+	if(bc_borrow(&fr->rdat.buffer, in, count, release, handle) != 0)
+	{
+		if(NOQUIET) error("Failed to add borrowed buffer.");
+		return READER_ERROR;
+	}
+	return 0;
+}
+
 /* externally called function, returns 0 on success, -1 on error */
 int feed_more(mpg123_handle *fr, const unsigned char *in, long count)
 {
@@ -819,6 +1170,9 @@ off_t feed_set_pos(mpg123_handle *fr, off_t pos)
 	else
 	{ /* I expect to get the specific position on next feed. Forget what I have now. */
 		bc_reset(bc);
+		/* A frame body in there is gone, too. It would not fit to the
+		   next data anyway, so do not decode it as ignored frame. */
+		fr->to_decode = fr->to_ignore = FALSE;
 		bc->fileoff = pos;
 		debug1("feed_set_pos outside, buffer reset, next feed from %"OFF_P, (off_p)pos);
 		return pos; /* Next input from exactly that position. */
@@ -839,6 +1193,10 @@ static ssize_t buffered_fullread(mpg123_handle *fr, unsigned char *out, ssize_t
 		{
 			int ret;
 			ssize_t got = fr->rdat.fullread(fr, readbuf, sizeof(readbuf));
+			/* Nothing there for now, bc_give() below rewinds to the frame
+			   start and the parser comes back for it later. */
+			if(got == READER_MORE)
+				return bc_give(bc, out, count);
 			if(got < 0)
 			{
 				if(NOQUIET) error("buffer reading");
@@ -853,6 +1211,9 @@ static ssize_t buffered_fullread(mpg123_handle *fr, unsigned char *out, ssize_t
 			}
 
 			need -= got; /* May underflow here... */
+			/* Without waiting, a short read is no end, only no more for now. */
+			if(got && (fr->rdat.flags & READER_NOWAIT))
+				continue;
 			if(got < sizeof(readbuf)) /* That naturally catches got == 0, too. */
 			{
 				if(VERBOSE3) fprintf(stderr, "Note: Input data end.\n");
@@ -875,6 +1236,12 @@ int feed_more(mpg123_handle *fr, const unsigned char *in, long count)
 	fr->err = MPG123_MISSING_FEATURE;
 	return -1;
 }
+int feed_borrow( mpg123_handle *fr, const unsigned char *in, long count
+	, void (*release)(void *, const unsigned char *), void *handle )
+{
+	fr->err = MPG123_MISSING_FEATURE;
+	return -1;
+}
 off_t feed_set_pos(mpg123_handle *fr, off_t pos)
 {
 	fr->err = MPG123_MISSING_FEATURE;
@@ -1004,6 +1371,25 @@ static struct reader readers[] =
 #endif
 };
 
+int feed_need(mpg123_handle *fr, off_t bytes)
+{
+#ifndef NO_FEEDER
+	struct bufferchain *bc = &fr->rdat.buffer;
+	if(fr->rd == &readers[READER_FEED] && bc->size - bc->pos < bytes)
+		return (int)bc_need_more(bc);
+#endif
+	return 0;
+}
+
+off_t feed_end(mpg123_handle *fr)
+{
+#ifndef NO_FEEDER
+	if(fr->rd == &readers[READER_FEED])
+		return fr->rdat.buffer.fileoff + fr->rdat.buffer.size;
+#endif
+	return -1;
+}
+
 static struct reader bad_reader =
 {
 	bad_init,
@@ -1020,6 +1406,98 @@ static struct reader bad_reader =
 	NULL
 };
 
+#ifdef HAVE_MMAP
+/* Map the whole file if it is a plain one that we opened ourselves and
+   nobody wants to intercept the I/O. Failure just means normal reading. */
+static void map_file(mpg123_handle *fr)
+{
+	struct stat st;
+	void *map;
+
+	if(  !(fr->rdat.flags & READER_FD_OPENED) || (fr->rdat.flags & READER_NONBLOCK)
+	  || fr->rdat.r_read != NULL || fr->rdat.r_lseek != NULL
+	  || fr->rd != &readers[READER_STREAM] )
+		return;
+	if(fstat(fr->rdat.filept, &st) || !S_ISREG(st.st_mode) || st.st_size < 1)
+		return;
+	/* Large files on a small address space. */
+	if((off_t)(size_t)st.st_size != st.st_size)
+		return;
+	/* Private writable mapping, as mpg123_framedata() hands out write access
+	   to frame bodies that might point into it. */
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE
+	,	fr->rdat.filept, 0);
+	if(map == MAP_FAILED)
+	{
+		debug1("mmap failed: %s", strerror(errno));
+		return;
+	}
+#ifdef HAVE_MADVISE
+	madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+	fr->rdat.map    = map;
+	fr->rdat.maplen = st.st_size;
+	fr->rdat.mappos = 0;
+	fr->rdat.flags |= READER_MAPPED;
+	debug1("mapped %"OFF_P" bytes of input", (off_p)fr->rdat.maplen);
+}
+
+static ssize_t map_read(struct reader_data *rdat, void *buf, size_t count)
+{
+	off_t left = rdat->maplen - rdat->mappos;
+	if(left < 0)
+		left = 0;
+	if((off_t)count > left)
+		count = (size_t)left;
+	memcpy(buf, rdat->map+rdat->mappos, count);
+	rdat->mappos += count;
+	return (ssize_t)count;
+}
+
+static off_t map_seek(struct reader_data *rdat, off_t offset, int whence)
+{
+	off_t pos;
+	switch(whence)
+	{
+		case SEEK_SET: pos = offset; break;
+		case SEEK_CUR: pos = rdat->mappos + offset; break;
+		case SEEK_END: pos = rdat->maplen + offset; break;
+		default: return -1;
+	}
+	if(pos < 0)
+		return -1;
+	return (rdat->mappos = pos);
+}
+
+static unsigned char *map_frame_body(mpg123_handle *fr, int size)
+{
+	struct reader_data *rdat = &fr->rdat;
+	unsigned char *body;
+
+	if(!(rdat->flags & READER_MAPPED) || fr->rd != &readers[READER_STREAM])
+		return NULL;
+	if(rdat->mappos < 0 || size+BODY_SAFETY > rdat->maplen - rdat->mappos)
+		return NULL;
+	body = rdat->map + rdat->mappos;
+	rdat->mappos  += size;
+	rdat->filepos += size;
+	return body;
+}
+#endif
+
+unsigned char *inplace_frame_body(mpg123_handle *fr, int size)
+{
+#ifdef HAVE_MMAP
+	if(fr->rdat.flags & READER_MAPPED)
+		return map_frame_body(fr, size);
+#endif
+#ifndef NO_FEEDER
+	if(fr->rdat.flags & READER_BUFFERED)
+		return bc_peek_body(&fr->rdat.buffer, size);
+#endif
+	return NULL;
+}
+
 static int default_init(mpg123_handle *fr)
 {
 #ifdef TIMEOUT_READ
@@ -1048,8 +1526,21 @@ static int default_init(mpg123_handle *fr)
 	/* ICY streams of any sort shall not be seekable. */
 	if(fr->p.icy_interval > 0) fr->rdat.lseek = nix_lseek;
 #endif
+#ifdef HAVE_MMAP
+	if(fr->p.flags & MPG123_MMAP) map_file(fr);
+#endif
 
-	fr->rdat.filelen = fr->p.flags & MPG123_NO_PEEK_END ? -1 : get_fileinfo(fr);
+	if(fr->p.flags & MPG123_NO_PEEK_END)
+		fr->rdat.filelen = -1;
+	/* A mapped file has the end right there. */
+	else if(fr->p.peek_end_later && !(fr->rdat.flags & READER_MAPPED))
+	{
+		fr->rdat.filelen = get_filelen(fr);
+		if(fr->rdat.filelen >= 0)
+			fr->rdat.flags |= READER_TAILPEEK;
+	}
+	else
+		fr->rdat.filelen = get_fileinfo(fr);
 	fr->rdat.filepos = 0;
 	if(fr->p.flags & MPG123_FORCE_SEEKABLE)
 		fr->rdat.flags |= READER_SEEKABLE;
@@ -1065,10 +1556,15 @@ static int default_init(mpg123_handle *fr)
 		{
 			fr->rdat.flags |= READER_ID3TAG;
 			fr->metaflags  |= MPG123_NEW_ID3;
+			frame_meta_notify(fr, MPG123_NEW_ID3);
 		}
 	}
-	/* Switch reader to a buffered one, if allowed. */
-	else if(fr->p.flags & MPG123_SEEKBUFFER)
+	/* Switch reader to a buffered one, if allowed. Not waiting for input
+	   needs it also to take up a frame again when more is there. */
+	if(fr->p.nonblock && !(fr->rdat.flags & READER_MAPPED))
+		fr->rdat.flags = (fr->rdat.flags & ~READER_SEEKABLE) | READER_NOWAIT;
+	if(  (fr->rdat.flags & READER_NOWAIT)
+	  || (fr->rdat.filelen < 0 && (fr->p.flags & MPG123_SEEKBUFFER)) )
 	{
 #ifdef NO_FEEDER
 		error("Buffered readers not supported in this build.");
@@ -1094,13 +1590,104 @@ static int default_init(mpg123_handle *fr)
 		}
 		bc_init(&fr->rdat.buffer);
 		fr->rdat.filelen = 0; /* We carry the offset, but never know how big the stream is. */
-		fr->rdat.flags |= READER_BUFFERED;
+		fr->rdat.flags = (fr->rdat.flags & ~READER_TAILPEEK) | READER_BUFFERED;
 #endif /* NO_FEEDER */
 	}
+#ifndef NO_THREADS
+	/* Read-ahead only after the peek at the end, to start at the beginning.
+	   A mapped file has nothing to wait for. */
+	if( !(fr->rdat.flags & READER_MAPPED)
+	&&	prefetch_start(fr, raw_seek) )
+	{
+		if(NOQUIET) error("Cannot start read-ahead thread.");
+		fr->err = MPG123_OUT_OF_MEM;
+		return -1;
+	}
+#endif
+#ifdef HAVE_IO_URING
+	if(uring_start(fr))
+	{
+		if(NOQUIET) error("Cannot set up io_uring reading.");
+		fr->err = MPG123_OUT_OF_MEM;
+		return -1;
+	}
+#endif
+	/* The read-ahead reads in blocks already. */
+	if(  (fr->p.read_block > 0 || fr->rdat.flags & READER_NONBLOCK)
+	  && !(fr->rdat.flags & (READER_MAPPED|READER_PREFETCH|READER_URING)) )
+	{
+		block_start( &fr->rdat, fr->p.read_block > 0
+		?	(size_t)fr->p.read_block : TIMEOUT_BLOCK );
+		if(!(fr->rdat.flags & READER_BLOCKED))
+		{
+			if(NOQUIET) error("Cannot allocate read block.");
+			fr->err = MPG123_OUT_OF_MEM;
+			return -1;
+		}
+	}
 	return 0;
 }
 
 
+int reader_poll_fd(mpg123_handle *fr)
+{
+#ifdef HAVE_IO_URING
+	if(fr->rdat.flags & READER_URING)
+		return uring_fd(&fr->rdat);
+#endif
+	if(  fr->rd == NULL || fr->rd == &bad_reader
+	  || fr->rd == &readers[READER_FEED]
+	  || (fr->rdat.flags & (READER_HANDLEIO|READER_MAPPED)) )
+		return -1;
+	return fr->rdat.filept;
+}
+
+int reader_tail(mpg123_handle *fr, int wait)
+{
+	unsigned char tail[128];
+	int got;
+
+	if(!(fr->rdat.flags & READER_TAILPEEK))
+		return 0;
+#ifndef NO_THREADS
+	if(fr->rdat.flags & READER_PREFETCH)
+	{
+		if(!(got = prefetch_tail(fr, tail, wait)))
+			return 0;
+	}
+	else
+#endif
+	{
+		/* Between frames, back to where the parser is afterwards. */
+		off_t pos = fr->rdat.filepos;
+		got = io_seek(&fr->rdat, -128, SEEK_END) >= 0
+		&&	fr->rd->fullread(fr, tail, 128) == 128 ? 1 : -1;
+		if(io_seek(&fr->rdat, pos, SEEK_SET) != pos)
+		{
+			fr->rdat.flags &= ~READER_TAILPEEK;
+			fr->err = MPG123_LSEEK_FAILED;
+			return READER_ERROR;
+		}
+		fr->rdat.filepos = pos;
+	}
+	/* Off before the callback, which may well ask for the tag. */
+	fr->rdat.flags &= ~READER_TAILPEEK;
+	if(got > 0 && !strncmp((char*)tail, "TAG", 3))
+	{
+		if(fr->rdat.filelen > 128)
+			fr->rdat.filelen -= 128;
+		/* The parser may have met it at the end already. */
+		if(!(fr->rdat.flags & READER_ID3TAG))
+		{
+			memcpy(fr->id3buf, tail, 128);
+			fr->rdat.flags |= READER_ID3TAG;
+			fr->metaflags  |= MPG123_NEW_ID3;
+			frame_meta_notify(fr, MPG123_NEW_ID3);
+		}
+	}
+	return 0;
+}
+
 void open_bad(mpg123_handle *mh)
 {
 	debug("open_bad");
@@ -1150,6 +1737,7 @@ static int open_finish(mpg123_handle *fr)
 		debug("ICY reader");
 		fr->icy.interval = fr->p.icy_interval;
 		fr->icy.next = fr->icy.interval;
+		fr->icy.blockpos = fr->icy.blockfill = 0;
 		fr->rd = &readers[READER_ICY_STREAM];
 	}
 	else
@@ -1208,10 +1796,26 @@ int open_stream_handle(mpg123_handle *fr, void *iohandle)
 }
 
 /* Wrappers for actual reading/seeking... I'm full of wrappers here. */
-static off_t io_seek(struct reader_data *rdat, off_t offset, int whence)
+static off_t raw_seek(struct reader_data *rdat, off_t offset, int whence)
 {
+#ifdef HAVE_MMAP
+	if(rdat->flags & READER_MAPPED)
+		return map_seek(rdat, offset, whence);
+#endif
 	if(rdat->flags & READER_HANDLEIO)
 	{
+		if(rdat->r_lseek_handle64 != NULL)
+		{
+			int64_t ret = rdat->r_lseek_handle64(rdat->iohandle, offset, whence);
+			if(ret != (off_t)ret)
+			{
+#ifdef EOVERFLOW
+				errno = EOVERFLOW;
+#endif
+				return -1;
+			}
+			return (off_t)ret;
+		}
 		if(rdat->r_lseek_handle != NULL)
 		{
 			return rdat->r_lseek_handle(rdat->iohandle, offset, whence);
@@ -1222,8 +1826,12 @@ static off_t io_seek(struct reader_data *rdat, off_t offset, int whence)
 	return rdat->lseek(rdat->filept, offset, whence);
 }
 
-static ssize_t io_read(struct reader_data *rdat, void *buf, size_t count)
+static ssize_t raw_read(struct reader_data *rdat, void *buf, size_t count)
 {
+#ifdef HAVE_MMAP
+	if(rdat->flags & READER_MAPPED)
+		return map_read(rdat, buf, count);
+#endif
 	if(rdat->flags & READER_HANDLEIO)
 	{
 		if(rdat->r_read_handle != NULL)
@@ -1235,3 +1843,121 @@ static ssize_t io_read(struct reader_data *rdat, void *buf, size_t count)
 	else
 	return rdat->read(rdat->filept, buf, count);
 }
+
+/*
+	With MPG123_READ_BLOCK, the small reads of headers and frame bodies are
+	served from a block that is refilled with one big read. Seeks within the
+	block do not reach the I/O layer, either. blockend is the position
+	of the underlying I/O, after the block data, or -1 when unknown.
+*/
+static void block_start(struct reader_data *rdat, size_t size)
+{
+	rdat->block = size ? malloc(size) : NULL;
+	if(rdat->block == NULL)
+		return;
+	rdat->blocksize = size;
+	rdat->blockfill = rdat->blockpos = 0;
+	rdat->blockend = rdat->flags & READER_SEEKABLE
+	?	raw_seek(rdat, 0, SEEK_CUR)
+	:	-1;
+	rdat->flags |= READER_BLOCKED;
+}
+
+static void block_stop(struct reader_data *rdat)
+{
+	if(rdat->block != NULL)
+		free(rdat->block);
+	rdat->block = NULL;
+	rdat->flags &= ~READER_BLOCKED;
+}
+
+static ssize_t block_read(struct reader_data *rdat, unsigned char *buf, size_t count)
+{
+	size_t got = 0;
+	while(got < count)
+	{
+		size_t n = rdat->blockfill - rdat->blockpos;
+		ssize_t ret;
+		if(n)
+		{
+			if(n > count-got)
+				n = count-got;
+			memcpy(buf+got, rdat->block+rdat->blockpos, n);
+			rdat->blockpos += n;
+			got += n;
+			continue;
+		}
+		/* Do not wait for more than was there. */
+		if(got)
+			break;
+		/* Big reads go straight to the destination. */
+		if(count >= rdat->blocksize)
+		{
+			ret = raw_read(rdat, buf, count);
+			if(ret > 0 && rdat->blockend >= 0)
+				rdat->blockend += ret;
+			return ret;
+		}
+		ret = raw_read(rdat, rdat->block, rdat->blocksize);
+		if(ret <= 0)
+			return ret;
+		if(rdat->blockend >= 0)
+			rdat->blockend += ret;
+		rdat->blockfill = (size_t)ret;
+		rdat->blockpos = 0;
+	}
+	return (ssize_t)got;
+}
+
+static off_t block_seek(struct reader_data *rdat, off_t offset, int whence)
+{
+	off_t buffered = (off_t)(rdat->blockfill - rdat->blockpos);
+	off_t ret;
+	if(whence == SEEK_CUR)
+	{
+		if(rdat->blockend >= 0)
+		{
+			offset += rdat->blockend - buffered;
+			whence = SEEK_SET;
+		}
+		else
+			offset -= buffered;
+	}
+	if(  whence == SEEK_SET && rdat->blockend >= 0
+	  && offset >= rdat->blockend - (off_t)rdat->blockfill
+	  && offset <= rdat->blockend )
+	{
+		rdat->blockpos = rdat->blockfill - (size_t)(rdat->blockend - offset);
+		return offset;
+	}
+	/* A failed seek leaves the I/O position and so the block as it is. */
+	ret = raw_seek(rdat, offset, whence);
+	if(ret >= 0)
+	{
+		rdat->blockfill = rdat->blockpos = 0;
+		rdat->blockend = ret;
+	}
+	return ret;
+}
+
+static off_t io_seek(struct reader_data *rdat, off_t offset, int whence)
+{
+#ifndef NO_THREADS
+	if(rdat->flags & READER_PREFETCH)
+		return prefetch_seek(rdat, offset, whence);
+#endif
+#ifdef HAVE_IO_URING
+	if(rdat->flags & READER_URING)
+		return uring_seek(rdat, offset, whence);
+#endif
+	if(rdat->flags & READER_BLOCKED)
+		return block_seek(rdat, offset, whence);
+	return raw_seek(rdat, offset, whence);
+}
+
+static ssize_t io_read(struct reader_data *rdat, void *buf, size_t count)
+{
+	if(rdat->flags & READER_BLOCKED)
+		return block_read(rdat, buf, count);
+	return raw_read(rdat, buf, count);
+}
@@ -25,8 +25,10 @@ static inline int16_t idiv_signed_rounded(int32_t x, int shift)
 #  define REAL_TO_SHORT(x)      (idiv_signed_rounded(x, 15))
 /* No better code (yet).  */
 #  define REAL_TO_SHORT_ACCURATE(x) REAL_TO_SHORT(x)
-/* This is just here for completeness, it is not used! */
-# define REAL_TO_S32(x)        (x)
+/* Sums carry 15 bits below the 16 bit sample, one bit short of 32 bit. */
+#  define REAL_PLUS_S32         0x3fffffff
+#  define REAL_MINUS_S32        ( -0x3fffffff-1 )
+#  define REAL_TO_S32(x)        ((int32_t)(x)*2)
 #endif
 
 /* From now on for single precision float... double precision is a possible option once we added some bits. But, it would be rather insane. */
@@ -130,6 +132,14 @@ static inline int16_t ftoi16(float x)
 	-0x7fffffff-1 is the minimum 32 bit signed integer value expressed so that MSVC 
 	does not give a compile time warning.
 */
+#ifdef REAL_IS_FIXED
+#define WRITE_S32_SAMPLE(samples,sum,clip) \
+	{ \
+		if( (sum) > REAL_PLUS_S32 ){ *(samples) = 0x7fffffff; (clip)++; } \
+		else if( (sum) < REAL_MINUS_S32 ) { *(samples) = -0x7fffffff-1; (clip)++; } \
+		else { *(samples) = REAL_TO_S32(sum); } \
+	}
+#else
 #define WRITE_S32_SAMPLE(samples,sum,clip) \
 	{ \
 		real tmpsum = REAL_MUL((sum),S32_RESCALE); \
@@ -137,6 +147,7 @@ static inline int16_t ftoi16(float x)
 		else if( tmpsum < REAL_MINUS_S32 ) { *(samples) = -0x7fffffff-1; (clip)++; } \
 		else { *(samples) = REAL_TO_S32(tmpsum); } \
 	}
+#endif
 
 /* Produce an 8bit sample, via 16bit intermediate. */
 #define WRITE_8BIT_SAMPLE(samples,sum,clip) \
@@ -147,7 +158,11 @@ static inline int16_t ftoi16(float x)
 	else { write_8bit_tmp = REAL_TO_SHORT(sum); } \
 	*(samples) = fr->conv16to8[write_8bit_tmp>>AUSHIFT]; \
 }
-#ifndef REAL_IS_FIXED
+#ifdef REAL_IS_FIXED
+/* Float output at least needs no clipping, just the scale of the sums. */
+#define WRITE_REAL_SAMPLE(samples,sum,clip) \
+	*(samples) = ((float)1./(SHORT_SCALE*(float)(1<<15)))*(float)(sum)
+#else
 #define WRITE_REAL_SAMPLE(samples,sum,clip) *(samples) = ((real)1./SHORT_SCALE)*(sum)
 #endif
 
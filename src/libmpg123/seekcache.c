@@ -0,0 +1,580 @@
+/*
+	seekcache: decoder snapshots for repeated seeks and for the application
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	An accurate seek means jumping to an index position, stepping over
+	frames and decoding the preframes to fill the bit reservoir, the layer III
+	hybrid overlap and the synth history. With MPG123_SEEK_CACHE set, the
+	decoder state reached at the seek target is stored, keyed by frame
+	number, just before the target frame is read. A later seek to the same
+	frame restores it and positions the stream there, giving the same output
+	as the seek that stored it. The least recently used snapshot gets
+	replaced when the cache is full.
+
+	The snapshots are only valid for one decoder setup on one track; they are
+	dropped on decoder change, new track or equalizer change.
+
+	The same state goes out to the application with mpg123_snapshot(), as a
+	blob to hand to mpg123_restore() on this or another handle decoding the
+	same stream with the same setup.
+*/
+
+#include "mpg123lib_intern.h"
+
+#include "debug.h"
+
+struct seek_snapshot
+{
+	off_t frame; /* first frame to decode, -1 for an empty slot */
+	off_t pos;   /* stream offset of its header */
+	unsigned long used;
+	unsigned long oldhead;
+	int framesize; /* of the frame before */
+	int bsnum;
+	size_t bsoff;  /* bsbuf inside bsspace[half] */
+	int bshalf;
+	unsigned int bitreservoir;
+	int have_hybrid;
+	int hybrid_blc[2];
+	int bo;
+#ifdef OPT_I486
+	int i486bo[2];
+#endif
+#ifdef OPT_DITHER
+	int ditherindex;
+#endif
+#ifndef NO_NTOM
+	double ntom_prev[2];
+#endif
+	unsigned char bsspace[MAXFRAMESIZE+512+4];
+	real hybrid_block[2][2][SBLIMIT*SSLIMIT];
+	int rawbuffss; /* size of what raw points to */
+	unsigned char *raw;
+};
+
+struct seekcache
+{
+	struct seek_snapshot *snap;
+	size_t size;
+	unsigned long clock;
+	off_t pending; /* frame to store when reached, -1 for none */
+};
+
+/* Snapshots only make sense for plain seekable streams, the feeder has its
+   own way of seeking. */
+static int snapshot_usable(mpg123_handle *fr)
+{
+	return !fr->p.halfspeed
+	&&	(fr->rdat.flags & READER_SEEKABLE)
+	&&	!(fr->rdat.flags & READER_BUFFERED)
+	&&	!(fr->state_flags & FRAME_FRANKENSTEIN);
+}
+
+static int seekcache_usable(mpg123_handle *fr)
+{
+	return fr->p.seek_cache > 0 && snapshot_usable(fr);
+}
+
+static struct seekcache *seekcache_get(mpg123_handle *fr)
+{
+	struct seekcache *sc = fr->seekcache;
+	size_t i;
+
+	if(sc && sc->size == (size_t)fr->p.seek_cache)
+		return sc;
+	seekcache_free(fr);
+	sc = malloc(sizeof(*sc));
+	if(!sc)
+		return NULL;
+	sc->size = fr->p.seek_cache;
+	sc->snap = malloc(sizeof(*sc->snap)*sc->size);
+	if(!sc->snap)
+	{
+		free(sc);
+		return NULL;
+	}
+	for(i=0; i<sc->size; ++i)
+	{
+		sc->snap[i].frame = -1;
+		sc->snap[i].used = 0;
+		sc->snap[i].raw = NULL;
+		sc->snap[i].rawbuffss = 0;
+	}
+	sc->clock = 0;
+	sc->pending = -1;
+	fr->seekcache = sc;
+	return sc;
+}
+
+void seekcache_clear(mpg123_handle *fr)
+{
+	struct seekcache *sc = fr->seekcache;
+	size_t i;
+
+	if(!sc)
+		return;
+	for(i=0; i<sc->size; ++i)
+		sc->snap[i].frame = -1;
+	sc->pending = -1;
+}
+
+void seekcache_free(mpg123_handle *fr)
+{
+	struct seekcache *sc = fr->seekcache;
+	size_t i;
+
+	if(!sc)
+		return;
+	for(i=0; i<sc->size; ++i)
+		free(sc->snap[i].raw);
+	free(sc->snap);
+	free(sc);
+	fr->seekcache = NULL;
+}
+
+void seekcache_pending(mpg123_handle *fr, off_t frame)
+{
+	struct seekcache *sc;
+
+	if(!seekcache_usable(fr) || !(sc = seekcache_get(fr)))
+		return;
+	sc->pending = frame;
+}
+
+/* Copy the decoder state before frame fr->num+1 into s, the raw buffers
+   having been allocated already. With before set, frame fr->num has been
+   read but not decoded and the state before that one is taken. */
+static void snapshot_take(mpg123_handle *fr, struct seek_snapshot *s, int before)
+{
+	unsigned char *bs = before ? fr->bsbufold : fr->bsbuf;
+
+	s->frame = before ? fr->num : fr->num+1;
+	s->pos = before ? fr->input_offset : fr->rd->tell(fr);
+	s->oldhead = fr->oldhead;
+	s->framesize = before ? fr->fsizeold : fr->framesize;
+	s->bsnum = before ? (fr->bsnum+1)&1 : fr->bsnum;
+	/* Layer I/II may work on the input data directly, nothing to keep. */
+	if(bs < fr->bsspace[0] || bs >= fr->bsspace[0]+sizeof(fr->bsspace))
+		bs = fr->bsspace[0]+512;
+	s->bshalf = bs >= fr->bsspace[1];
+	s->bsoff = bs - fr->bsspace[s->bshalf];
+	memcpy(s->bsspace, fr->bsspace[s->bshalf], sizeof(s->bsspace));
+	/* The frame not decoded yet may still cover the end of the main data
+	   before it with its side info. */
+	if( before && fr->bstail_size && fr->bsbuf >= fr->bsspace[s->bshalf]
+	&&  fr->bsbuf < fr->bsspace[s->bshalf]+sizeof(s->bsspace) )
+		memcpy( s->bsspace + (fr->bsbuf - fr->bsspace[s->bshalf])
+		,	fr->bstail, fr->bstail_size );
+	s->bitreservoir = fr->bitreservoir;
+	s->hybrid_blc[0] = fr->hybrid_blc[0];
+	s->hybrid_blc[1] = fr->hybrid_blc[1];
+	s->have_hybrid = fr->hybrid_block != NULL;
+	if(s->have_hybrid)
+		memcpy(s->hybrid_block, fr->hybrid_block, sizeof(s->hybrid_block));
+	s->bo = fr->bo;
+#ifdef OPT_I486
+	s->i486bo[0] = fr->i486bo[0];
+	s->i486bo[1] = fr->i486bo[1];
+#endif
+#ifdef OPT_DITHER
+	s->ditherindex = fr->ditherindex;
+#endif
+#ifndef NO_NTOM
+	s->ntom_prev[0] = fr->ntom_prev[0];
+	s->ntom_prev[1] = fr->ntom_prev[1];
+#endif
+	if(fr->rawbuffss)
+		memcpy(s->raw, fr->rawbuffs, fr->rawbuffss);
+}
+
+/* Position the stream and put the state from s in place, FALSE if the
+   stream could not be positioned (leaving the state alone). */
+static int snapshot_apply(mpg123_handle *fr, struct seek_snapshot *s)
+{
+	if(fr->rd->skip_bytes(fr, s->pos - fr->rd->tell(fr)) != s->pos)
+		return FALSE;
+	fr->num = s->frame-1;
+	fr->oldhead = s->oldhead;
+	fr->framesize = s->framesize;
+	fr->bsnum = s->bsnum;
+	memcpy(fr->bsspace[s->bshalf], s->bsspace, sizeof(s->bsspace));
+	fr->bsbuf = fr->bsspace[s->bshalf] + s->bsoff;
+	fr->bsbufold = fr->bsbuf;
+	fr->bstail_size = 0;
+	fr->bitreservoir = s->bitreservoir;
+	fr->hybrid_blc[0] = s->hybrid_blc[0];
+	fr->hybrid_blc[1] = s->hybrid_blc[1];
+#ifndef NO_LAYER3
+	fr->layer3.silent_run = 0;
+#endif
+	if(s->have_hybrid)
+		memcpy(fr->hybrid_block, s->hybrid_block, sizeof(s->hybrid_block));
+	fr->bo = s->bo;
+#ifdef OPT_I486
+	fr->i486bo[0] = s->i486bo[0];
+	fr->i486bo[1] = s->i486bo[1];
+#endif
+#ifdef OPT_DITHER
+	fr->ditherindex = s->ditherindex;
+#endif
+#ifndef NO_NTOM
+	fr->ntom_prev[0] = s->ntom_prev[0];
+	fr->ntom_prev[1] = s->ntom_prev[1];
+#endif
+	if(s->rawbuffss)
+		memcpy(fr->rawbuffs, s->raw, s->rawbuffss);
+	fr->state_flags |= FRAME_ACCURATE;
+	return TRUE;
+}
+
+void seekcache_store(mpg123_handle *fr)
+{
+	struct seekcache *sc = fr->seekcache;
+	struct seek_snapshot *s;
+	off_t frame = fr->num+1;
+	size_t i;
+
+	if(!sc || sc->pending != frame)
+		return;
+	sc->pending = -1;
+	if( !seekcache_usable(fr) || !(fr->state_flags & FRAME_ACCURATE)
+	||	fr->bsbuf < fr->bsspace[0] || fr->bsbuf >= fr->bsspace[0]+sizeof(fr->bsspace) )
+		return;
+	/* A slot for this frame already, or the oldest one. */
+	s = sc->snap;
+	for(i=0; i<sc->size; ++i)
+	{
+		if(sc->snap[i].frame == frame)
+		{
+			s = sc->snap+i;
+			break;
+		}
+		if(sc->snap[i].used < s->used || sc->snap[i].frame < 0)
+			s = sc->snap+i;
+	}
+	if(s->rawbuffss != fr->rawbuffss)
+	{
+		free(s->raw);
+		s->rawbuffss = 0;
+		s->raw = fr->rawbuffss ? malloc(fr->rawbuffss) : NULL;
+		if(fr->rawbuffss && !s->raw)
+		{
+			s->frame = -1;
+			return;
+		}
+		s->rawbuffss = fr->rawbuffss;
+	}
+	snapshot_take(fr, s, FALSE);
+	s->used = ++sc->clock;
+	debug2("seek cache: stored frame %"OFF_P" at %"OFF_P, (off_p)frame, (off_p)s->pos);
+}
+
+int seekcache_restore(mpg123_handle *fr, off_t frame)
+{
+	struct seekcache *sc = fr->seekcache;
+	struct seek_snapshot *s = NULL;
+	size_t i;
+
+	if(!sc || !seekcache_usable(fr) || sc->size != (size_t)fr->p.seek_cache)
+		return FALSE;
+	for(i=0; i<sc->size; ++i)
+		if(sc->snap[i].frame == frame)
+			s = sc->snap+i;
+	if( !s || s->rawbuffss != fr->rawbuffss
+	||	s->have_hybrid != (fr->hybrid_block != NULL) )
+		return FALSE;
+	if(!snapshot_apply(fr, s))
+		return FALSE;
+	s->used = ++sc->clock;
+	sc->pending = -1;
+	debug2("seek cache: restored frame %"OFF_P" at %"OFF_P, (off_p)frame, (off_p)s->pos);
+	return TRUE;
+}
+
+/*
+	Snapshot blob format: magic, then SNAP_FIELDS numbers as 64 bit little
+	endian (negative ones in two's complement), then the memory blocks in
+	native representation: ntom history, the bitstream buffer half, the
+	hybrid overlap (if any), the synth buffers and the decoded output not
+	yet returned. A 32 bit checksum over everything before it closes the
+	data. This is for the same build on the same machine, not for archival.
+*/
+static const unsigned char snap_magic[8] = { 'm','p','g','1','2','3','s','n' };
+#define SNAP_VERSION 1
+/* The fields describing stream and decoder setup, they have to match. */
+#define SNAP_SETUP 15
+#define SNAP_FIELDS (SNAP_SETUP+23)
+
+static void snapshot_setup(mpg123_handle *fr, uint64_t *field)
+{
+	field[0]  = SNAP_VERSION;
+	field[1]  = (uint64_t)(fr->rdat.filelen+1);
+	field[2]  = (uint64_t)fr->audio_start;
+	field[3]  = fr->firsthead;
+	field[4]  = fr->audio_hash;
+	field[5]  = (uint64_t)fr->cpu_opts.type;
+	field[6]  = sizeof(real);
+	field[7]  = (uint64_t)fr->down_sample;
+	field[8]  = (uint64_t)fr->af.rate;
+	field[9]  = (uint64_t)fr->af.channels;
+	field[10] = (uint64_t)fr->af.encoding;
+	field[11] = (uint64_t)(fr->single+1);
+	field[12] = (uint64_t)fr->rawbuffss;
+	field[13] = fr->hybrid_block != NULL;
+	field[14] = (fr->p.flags & MPG123_GAPLESS) ? 1 : 0;
+}
+
+static size_t put_block(unsigned char *buf, size_t pos, size_t size
+,	const void *data, size_t len )
+{
+	if(buf && len && pos <= size && len <= size-pos)
+		memcpy(buf+pos, data, len);
+	return len;
+}
+
+static size_t put_u64(unsigned char *buf, size_t pos, size_t size, uint64_t val)
+{
+	unsigned char b[8];
+	int i;
+	for(i=0; i<8; ++i)
+		b[i] = (val >> (8*i)) & 0xff;
+	return put_block(buf, pos, size, b, 8);
+}
+
+static uint64_t get_u64(const unsigned char *buf)
+{
+	uint64_t val = 0;
+	int i;
+	for(i=0; i<8; ++i)
+		val |= (uint64_t)buf[i] << (8*i);
+	return val;
+}
+
+int snapshot_write( mpg123_handle *fr
+,	unsigned char *buf, size_t size, size_t *bytes )
+{
+	struct seek_snapshot *s;
+	uint64_t field[SNAP_FIELDS];
+	double ntom_prev[2] = { 0., 0. };
+	unsigned long hash;
+	size_t pos = 0;
+	size_t i;
+
+	if(!snapshot_usable(fr))
+	{
+		fr->err = MPG123_NO_SEEK;
+		return MPG123_ERR;
+	}
+	s = malloc(sizeof(*s));
+	if(s)
+		s->raw = fr->rawbuffss ? malloc(fr->rawbuffss) : NULL;
+	if(!s || (fr->rawbuffss && !s->raw))
+	{
+		free(s);
+		fr->err = MPG123_OUT_OF_MEM;
+		return MPG123_ERR;
+	}
+	s->rawbuffss = fr->rawbuffss;
+	snapshot_take(fr, s, fr->to_decode);
+	snapshot_setup(fr, field);
+	i = SNAP_SETUP;
+	field[i++] = (uint64_t)s->frame;
+	field[i++] = (uint64_t)s->pos;
+	field[i++] = s->oldhead;
+	field[i++] = (uint64_t)s->framesize;
+	field[i++] = (uint64_t)s->bsnum;
+	field[i++] = (uint64_t)s->bshalf;
+	field[i++] = s->bsoff;
+	field[i++] = s->bitreservoir;
+	field[i++] = (uint64_t)s->hybrid_blc[0];
+	field[i++] = (uint64_t)s->hybrid_blc[1];
+	field[i++] = (uint64_t)s->bo;
+#ifdef OPT_I486
+	field[i++] = (uint64_t)s->i486bo[0];
+	field[i++] = (uint64_t)s->i486bo[1];
+#else
+	field[i++] = 0;
+	field[i++] = 0;
+#endif
+#ifdef OPT_DITHER
+	field[i++] = (uint64_t)s->ditherindex;
+#else
+	field[i++] = 0;
+#endif
+#ifndef NO_NTOM
+	field[i++] = fr->ntom_val[0];
+	field[i++] = fr->ntom_val[1];
+	ntom_prev[0] = s->ntom_prev[0];
+	ntom_prev[1] = s->ntom_prev[1];
+#else
+	field[i++] = 0;
+	field[i++] = 0;
+#endif
+	field[i++] = (uint64_t)fr->firstframe;
+	field[i++] = (uint64_t)fr->firstoff;
+	field[i++] = (uint64_t)fr->lastframe;
+	field[i++] = (uint64_t)fr->lastoff;
+	field[i++] = (uint64_t)fr->ignoreframe;
+	/* Counted again when the frame is read anew. */
+	field[i++] = (uint64_t)(fr->playnum - (fr->to_decode ? 1 : 0));
+	field[i++] = fr->buffer.fill;
+
+	pos += put_block(buf, pos, size, snap_magic, sizeof(snap_magic));
+	for(i=0; i<SNAP_FIELDS; ++i)
+		pos += put_u64(buf, pos, size, field[i]);
+	pos += put_block(buf, pos, size, ntom_prev, sizeof(ntom_prev));
+	pos += put_block(buf, pos, size, s->bsspace, sizeof(s->bsspace));
+	if(s->have_hybrid)
+		pos += put_block(buf, pos, size, s->hybrid_block, sizeof(s->hybrid_block));
+	pos += put_block(buf, pos, size, s->raw, s->rawbuffss);
+	pos += put_block(buf, pos, size, fr->buffer.p, fr->buffer.fill);
+	free(s->raw);
+	free(s);
+	*bytes = pos+4;
+	/* Only the size was asked for. */
+	if(buf == NULL)
+		return MPG123_OK;
+	if(size < *bytes)
+	{
+		fr->err = MPG123_BAD_BUFFER;
+		return MPG123_ERR;
+	}
+	hash = fi_hash(0, buf, pos);
+	for(i=0; i<4; ++i)
+		buf[pos+i] = (hash >> (8*i)) & 0xff;
+	return MPG123_OK;
+}
+
+int snapshot_read(mpg123_handle *fr, const unsigned char *buf, size_t size)
+{
+	struct seek_snapshot *s = NULL;
+	uint64_t field[SNAP_FIELDS];
+	uint64_t want[SNAP_SETUP];
+	double ntom_prev[2];
+	unsigned long hash;
+	size_t pos, fill, i;
+
+	if(!snapshot_usable(fr))
+	{
+		fr->err = MPG123_NO_SEEK;
+		return MPG123_ERR;
+	}
+	if(  size < sizeof(snap_magic)+8*SNAP_FIELDS+sizeof(ntom_prev)+4
+	  || memcmp(buf, snap_magic, sizeof(snap_magic)) )
+		goto snapshot_bad;
+	size -= 4;
+	hash = (unsigned long)buf[size] | (unsigned long)buf[size+1]<<8
+	|	(unsigned long)buf[size+2]<<16 | (unsigned long)buf[size+3]<<24;
+	if(hash != fi_hash(0, buf, size))
+		goto snapshot_bad;
+	pos = sizeof(snap_magic);
+	for(i=0; i<SNAP_FIELDS; ++i, pos+=8)
+		field[i] = get_u64(buf+pos);
+	snapshot_setup(fr, want);
+	for(i=0; i<SNAP_SETUP; ++i)
+		if(field[i] != want[i])
+			goto snapshot_bad;
+	/* Everything that ends up in an index or pointer has to be sane. */
+	if(  field[SNAP_SETUP+3] > MAXFRAMESIZE || field[SNAP_SETUP+4] > 1
+	  || field[SNAP_SETUP+5] > 1
+	  || field[SNAP_SETUP+6] > sizeof(s->bsspace) - 4 - field[SNAP_SETUP+3]
+	  || field[SNAP_SETUP+7] > 511 || field[SNAP_SETUP+8] > 1
+	  || field[SNAP_SETUP+9] > 1 || field[SNAP_SETUP+10] > 15
+#ifdef OPT_I486
+	  || field[SNAP_SETUP+11] >= FIR_SIZE || field[SNAP_SETUP+12] >= FIR_SIZE
+#endif
+#ifdef OPT_DITHER
+	  || field[SNAP_SETUP+13] >= DITHERSIZE
+#endif
+	  || (int64_t)field[SNAP_SETUP] < 0 || (int64_t)field[SNAP_SETUP+1] < 0
+	  || (fr->rdat.filelen >= 0 && field[SNAP_SETUP+1] > (uint64_t)fr->rdat.filelen) )
+		goto snapshot_bad;
+	fill = (size_t)field[SNAP_FIELDS-1];
+	if( field[SNAP_FIELDS-1] > fr->buffer.size
+	||	size-pos != sizeof(ntom_prev)+sizeof(s->bsspace)
+		+	(field[13] ? sizeof(s->hybrid_block) : 0)
+		+	fr->rawbuffss + fill )
+		goto snapshot_bad;
+	s = malloc(sizeof(*s));
+	if(!s)
+	{
+		fr->err = MPG123_OUT_OF_MEM;
+		return MPG123_ERR;
+	}
+	s->have_hybrid = (int)field[13];
+	s->rawbuffss = fr->rawbuffss;
+	i = SNAP_SETUP;
+	s->frame = (off_t)(int64_t)field[i++];
+	s->pos = (off_t)(int64_t)field[i++];
+	s->oldhead = (unsigned long)field[i++];
+	s->framesize = (int)field[i++];
+	s->bsnum = (int)field[i++];
+	s->bshalf = (int)field[i++];
+	s->bsoff = (size_t)field[i++];
+	s->bitreservoir = (unsigned int)field[i++];
+	s->hybrid_blc[0] = (int)field[i++];
+	s->hybrid_blc[1] = (int)field[i++];
+	s->bo = (int)field[i++];
+#ifdef OPT_I486
+	s->i486bo[0] = (int)field[i++];
+	s->i486bo[1] = (int)field[i++];
+#else
+	i += 2;
+#endif
+#ifdef OPT_DITHER
+	s->ditherindex = (int)field[i++];
+#else
+	++i;
+#endif
+	memcpy(ntom_prev, buf+pos, sizeof(ntom_prev));
+	pos += sizeof(ntom_prev);
+#ifndef NO_NTOM
+	s->ntom_prev[0] = ntom_prev[0];
+	s->ntom_prev[1] = ntom_prev[1];
+#endif
+	memcpy(s->bsspace, buf+pos, sizeof(s->bsspace));
+	pos += sizeof(s->bsspace);
+	if(s->have_hybrid)
+	{
+		memcpy(s->hybrid_block, buf+pos, sizeof(s->hybrid_block));
+		pos += sizeof(s->hybrid_block);
+	}
+	/* The synth buffers are taken directly from the data. */
+	s->raw = (unsigned char*)buf+pos;
+	pos += fr->rawbuffss;
+	if(!snapshot_apply(fr, s))
+	{
+		free(s);
+		fr->err = MPG123_LSEEK_FAILED;
+		return MPG123_ERR;
+	}
+	free(s);
+	i = SNAP_SETUP+14;
+#ifndef NO_NTOM
+	fr->ntom_val[0] = (unsigned long)field[i++];
+	fr->ntom_val[1] = (unsigned long)field[i++];
+#else
+	i += 2;
+#endif
+	fr->firstframe  = (off_t)(int64_t)field[i++];
+	fr->firstoff    = (off_t)(int64_t)field[i++];
+	fr->lastframe   = (off_t)(int64_t)field[i++];
+	fr->lastoff     = (off_t)(int64_t)field[i++];
+	fr->ignoreframe = (off_t)(int64_t)field[i++];
+	fr->playnum     = (off_t)(int64_t)field[i++];
+	fr->buffer.p = fr->buffer.data;
+	fr->buffer.fill = fill;
+	if(fill)
+		memcpy(fr->buffer.data, buf+pos, fill);
+	fr->to_decode = fr->to_ignore = FALSE;
+	if(fr->seekcache)
+		fr->seekcache->pending = -1;
+	debug2("restored snapshot for frame %"OFF_P" at %"OFF_P
+	,	(off_p)(fr->num+1), (off_p)fr->rd->tell(fr));
+	return MPG123_OK;
+snapshot_bad:
+	fr->err = MPG123_BAD_SNAPSHOT;
+	return MPG123_ERR;
+}
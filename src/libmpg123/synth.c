@@ -7,7 +7,7 @@
 */
 
 #include "mpg123lib_intern.h"
-#ifdef OPT_GENERIC_DITHER
+#ifdef OPT_DITHER
 #define FORCE_ACCURATE
 #endif
 #include "sample.h"
@@ -31,8 +31,26 @@
 #include "synth.h"
 #undef SYNTH_NAME
 
+#ifdef SYNTH_DIRECT
+/* The only stereo synth of the minimal build, no pointers involved. */
+int synth_1to1_stereo_block(real *bandPtr_l, real *bandPtr_r, int count, mpg123_handle *fr)
+{
+	int clip = 0;
+	for(; count > 0; --count)
+	{
+		clip += synth_1to1(bandPtr_l, 0, fr, 0);
+		clip += synth_1to1(bandPtr_r, 1, fr, 1);
+		bandPtr_l += SBLIMIT;
+		bandPtr_r += SBLIMIT;
+	}
+	return clip;
+}
+
+#define SYNTH_NAME       synth_1to1
+#else
 /* Mono-related synths; they wrap over _some_ synth_1to1. */
 #define SYNTH_NAME       fr->synths.plain[r_1to1][f_16]
+#endif
 #define MONO_NAME        synth_1to1_mono
 #define MONO2STEREO_NAME synth_1to1_m2s
 #include "synth_mono.h"
@@ -59,6 +77,149 @@
 
 #endif
 
+#if defined(OPT_DITHER) && !defined(NO_REAL)
+/*
+	Dithered output for MPG123_DITHER: wrappers over the float synth of the
+	decoder, like the 8 bit ones over 16 bit. The noise is added while
+	converting to short, walking the table as the generic_dither synth does:
+	32 points per time slot, the same ones for both channels.
+*/
+
+/* A Layer III granule at once. */
+#define DITHER_BLOCKS SSLIMIT
+
+/* The noise for the next slot. */
+static float *dither_slot(mpg123_handle *fr)
+{
+	float *noise;
+	if(DITHERSIZE-fr->ditherindex < 32) fr->ditherindex = 0;
+	noise = fr->dithernoise + fr->ditherindex;
+	fr->ditherindex += 32;
+	return noise;
+}
+
+static int dither_short(short *out, int ostep, real *in, int istep, float *noise)
+{
+	int clip = 0;
+	int i;
+	for(i=0; i<32; ++i, out+=ostep, in+=istep)
+	{
+		real sum = *in * SHORT_SCALE + noise[i];
+		WRITE_SHORT_SAMPLE_ACCURATE(out, sum, clip);
+	}
+	return clip;
+}
+
+int synth_1to1_dither_wrap(real *bandPtr, int channel, mpg123_handle *fr, int final)
+{
+	real samples_tmp[64];
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+	int ret;
+
+	fr->buffer.data = (unsigned char*) samples_tmp;
+	fr->buffer.fill = 0;
+	ret = (fr->synths.plain[r_1to1][f_real])(bandPtr, channel, fr, 0);
+	fr->buffer.data = samples;
+
+	/* Back to the noise of the left channel. */
+	if(channel) fr->ditherindex -= 32;
+	ret += dither_short( (short*)(samples+pnt)+channel, 2
+	,	samples_tmp+channel, 2, dither_slot(fr) );
+	fr->buffer.fill = pnt + (final ? 64*sizeof(short) : 0);
+
+	return ret;
+}
+
+int synth_1to1_dither_wrap_mono(real *bandPtr, mpg123_handle *fr)
+{
+	real samples_tmp[64];
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+	int ret;
+
+	fr->buffer.data = (unsigned char*) samples_tmp;
+	fr->buffer.fill = 0;
+	ret = (fr->synths.plain[r_1to1][f_real])(bandPtr, 0, fr, 0);
+	fr->buffer.data = samples;
+
+	ret += dither_short((short*)(samples+pnt), 1, samples_tmp, 2, dither_slot(fr));
+	fr->buffer.fill = pnt + 32*sizeof(short);
+
+	return ret;
+}
+
+int synth_1to1_dither_wrap_m2s(real *bandPtr, mpg123_handle *fr)
+{
+	real samples_tmp[64];
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+	short *out;
+	int i, ret;
+
+	fr->buffer.data = (unsigned char*) samples_tmp;
+	fr->buffer.fill = 0;
+	ret = (fr->synths.plain[r_1to1][f_real])(bandPtr, 0, fr, 0);
+	fr->buffer.data = samples;
+
+	out = (short*)(samples+pnt);
+	ret += dither_short(out, 2, samples_tmp, 2, dither_slot(fr));
+	for(i=0; i<32; ++i, out+=2)
+		out[1] = out[0];
+	fr->buffer.fill = pnt + 64*sizeof(short);
+
+	return ret;
+}
+
+/* The block synth of the decoder (fr->synth_base_block) can be a generic
+   wrapper calling back into fr->synth or fr->synth_stereo, so those point
+   to the float synths meanwhile. */
+int synth_1to1_dither_stereo_block_wrap(real *bandPtr_l, real *bandPtr_r, int count, mpg123_handle *fr)
+{
+	real samples_tmp[DITHER_BLOCKS*64];
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+	func_synth synth = fr->synth;
+	func_synth_stereo synth_stereo = fr->synth_stereo;
+	int clip = 0;
+
+	fr->synth = fr->synths.plain[r_1to1][f_real];
+	fr->synth_stereo = fr->synths.stereo[r_1to1][f_real];
+	while(count > 0)
+	{
+		int blocks = count > DITHER_BLOCKS ? DITHER_BLOCKS : count;
+		int i;
+		fr->buffer.data = (unsigned char*) samples_tmp;
+		fr->buffer.fill = 0;
+		clip += (fr->synth_base_block)(bandPtr_l, bandPtr_r, blocks, fr);
+		for(i=0; i<blocks; ++i)
+		{
+			short *out = (short*)(samples+pnt);
+			float *noise = dither_slot(fr);
+			clip += dither_short(out,   2, samples_tmp+64*i,   2, noise);
+			clip += dither_short(out+1, 2, samples_tmp+64*i+1, 2, noise);
+			pnt += 64*sizeof(short);
+		}
+		bandPtr_l += blocks*SBLIMIT;
+		bandPtr_r += blocks*SBLIMIT;
+		count -= blocks;
+	}
+	fr->buffer.data = samples;
+	fr->buffer.fill = pnt;
+	fr->synth = synth;
+	fr->synth_stereo = synth_stereo;
+
+	return clip;
+}
+
+int synth_1to1_dither_stereo_wrap(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	return synth_1to1_dither_stereo_block_wrap(bandPtr_l, bandPtr_r, 1, fr);
+}
+
+#undef DITHER_BLOCKS
+#endif
+
 #ifdef OPT_X86
 /* The i386-specific C code, here as short variant, later 8bit and float. */
 #define NO_AUTOINCREMENT
@@ -446,6 +607,12 @@ int synth_1to1_stereo_x86_64(real *bandPtr_l,real *bandPtr_r, mpg123_handle *fr)
 	return clip;
 }
 #endif
+
+#define STEREO_NAME synth_1to1_stereo_x86_64
+#define STEREO_BLOCK_NAME synth_1to1_stereo_x86_64_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
 #endif
 
 #ifdef OPT_AVX
@@ -632,6 +799,111 @@ int synth_1to1_stereo_avx(real *bandPtr_l,real *bandPtr_r, mpg123_handle *fr)
 	return clip;
 }
 #endif
+
+#define STEREO_NAME synth_1to1_stereo_avx
+#define STEREO_BLOCK_NAME synth_1to1_stereo_avx_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
+#endif
+
+#ifdef OPT_AVX512
+/* Assembler routines. There is no fast integer variant: The AVX-512 decoder
+   always works on the float tables and rounds accurately. */
+int synth_1to1_x86_64_accurate_asm(real *window, real *b0, short *samples, int bo1);
+int synth_1to1_s_avx512_accurate_asm(real *window, real *b0l, real *b0r, short *samples, int bo1);
+void dct64_real_avx512(real *out0, real *out1, real *samples);
+/* Hull for C mpg123 API */
+int synth_1to1_avx512(real *bandPtr,int channel, mpg123_handle *fr, int final)
+{
+	short *samples = (short *) (fr->buffer.data+fr->buffer.fill);
+
+	real *b0, **buf;
+	int bo1;
+	int clip;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings) do_equalizer(bandPtr,channel,fr->equalizer);
+#endif
+	if(!channel)
+	{
+		fr->bo--;
+		fr->bo &= 0xf;
+		buf = fr->real_buffs[0];
+	}
+	else
+	{
+		samples++;
+		buf = fr->real_buffs[1];
+	}
+
+	if(fr->bo & 0x1)
+	{
+		b0 = buf[0];
+		bo1 = fr->bo;
+		dct64_real_avx512(buf[1]+((fr->bo+1)&0xf),buf[0]+fr->bo,bandPtr);
+	}
+	else
+	{
+		b0 = buf[1];
+		bo1 = fr->bo+1;
+		dct64_real_avx512(buf[0]+fr->bo,buf[1]+fr->bo+1,bandPtr);
+	}
+
+	clip = synth_1to1_x86_64_accurate_asm(fr->decwin, b0, samples, bo1);
+
+	if(final) fr->buffer.fill += 128;
+
+	return clip;
+}
+
+int synth_1to1_stereo_avx512(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	short *samples = (short *) (fr->buffer.data+fr->buffer.fill);
+
+	real *b0l, *b0r, **bufl, **bufr;
+	int bo1;
+	int clip;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings)
+	{
+		do_equalizer(bandPtr_l,0,fr->equalizer);
+		do_equalizer(bandPtr_r,1,fr->equalizer);
+	}
+#endif
+	fr->bo--;
+	fr->bo &= 0xf;
+	bufl = fr->real_buffs[0];
+	bufr = fr->real_buffs[1];
+
+	if(fr->bo & 0x1)
+	{
+		b0l = bufl[0];
+		b0r = bufr[0];
+		bo1 = fr->bo;
+		dct64_real_avx512(bufl[1]+((fr->bo+1)&0xf),bufl[0]+fr->bo,bandPtr_l);
+		dct64_real_avx512(bufr[1]+((fr->bo+1)&0xf),bufr[0]+fr->bo,bandPtr_r);
+	}
+	else
+	{
+		b0l = bufl[1];
+		b0r = bufr[1];
+		bo1 = fr->bo+1;
+		dct64_real_avx512(bufl[0]+fr->bo,bufl[1]+fr->bo+1,bandPtr_l);
+		dct64_real_avx512(bufr[0]+fr->bo,bufr[1]+fr->bo+1,bandPtr_r);
+	}
+
+	clip = synth_1to1_s_avx512_accurate_asm(fr->decwin, b0l, b0r, samples, bo1);
+
+	fr->buffer.fill += 128;
+
+	return clip;
+}
+
+#define STEREO_NAME synth_1to1_stereo_avx512
+#define STEREO_BLOCK_NAME synth_1to1_stereo_avx512_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
 #endif
 
 #ifdef OPT_ARM
@@ -1090,6 +1362,12 @@ int synth_1to1_stereo_neon64(real *bandPtr_l,real *bandPtr_r, mpg123_handle *fr)
 	return clip;
 }
 #endif
+
+#define STEREO_NAME synth_1to1_stereo_neon64
+#define STEREO_BLOCK_NAME synth_1to1_stereo_neon64_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
 #endif
 
 #ifndef NO_DOWNSAMPLE
@@ -1120,6 +1398,15 @@ int synth_1to1_stereo_neon64(real *bandPtr_l,real *bandPtr_r, mpg123_handle *fr)
 #undef MONO_NAME
 #undef MONO2STEREO_NAME
 
+/* Picking from the 1to1 synths of SIMD decoders. */
+#define BASE_FORMAT      f_16
+#define PICK_NAME        synth_2to1_pick
+#define STEREO_PICK_NAME synth_2to1_stereo_pick
+#include "synth_down.h"
+#undef BASE_FORMAT
+#undef PICK_NAME
+#undef STEREO_PICK_NAME
+
 #ifdef OPT_X86
 #define NO_AUTOINCREMENT
 #define SYNTH_NAME synth_2to1_i386
@@ -1157,6 +1444,15 @@ int synth_1to1_stereo_neon64(real *bandPtr_l,real *bandPtr_r, mpg123_handle *fr)
 #undef MONO_NAME
 #undef MONO2STEREO_NAME
 
+/* Picking from the 1to1 synths of SIMD decoders. */
+#define BASE_FORMAT      f_16
+#define PICK_NAME        synth_4to1_pick
+#define STEREO_PICK_NAME synth_4to1_stereo_pick
+#include "synth_down.h"
+#undef BASE_FORMAT
+#undef PICK_NAME
+#undef STEREO_PICK_NAME
+
 #ifdef OPT_X86
 #define NO_AUTOINCREMENT
 #define SYNTH_NAME synth_4to1_i386
@@ -1173,10 +1469,14 @@ int synth_1to1_stereo_neon64(real *bandPtr_l,real *bandPtr_r, mpg123_handle *fr)
 #ifndef NO_NTOM
 /*
 	Part 1d: ntom synth.
-	Same procedure as above... Just no extra play anymore, straight synth that uses the plain dct64.
+	Same procedure as above... Just no extra play anymore, interpolating over the 1to1 synth (see synth_ntom.h).
 */
 
 /* These are all in one header, there's no flexibility to gain. */
+#ifndef REAL_IS_FIXED
+/* Interpolation in floating point, fixed point stays with picking. */
+#define NTOM_LERP(x) ((SAMPLE_T)((x) < 0 ? (x)-0.5 : (x)+0.5))
+#endif
 #define SYNTH_NAME       synth_ntom
 #define MONO_NAME        synth_ntom_mono
 #define MONO2STEREO_NAME synth_ntom_m2s
@@ -1184,6 +1484,7 @@ int synth_1to1_stereo_neon64(real *bandPtr_l,real *bandPtr_r, mpg123_handle *fr)
 #undef SYNTH_NAME
 #undef MONO_NAME
 #undef MONO2STEREO_NAME
+#undef NTOM_LERP
 
 #endif
 
@@ -0,0 +1,26 @@
+/*
+	synth_block.h: stereo synth over a block of consecutive time slots
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	This header is used multiple times to create the block variants of the
+	optimized stereo synths. Define STEREO_NAME for the synth of one time slot
+	and STEREO_BLOCK_NAME for the function to create. The slots are expected
+	SBLIMIT values apart, as Layer II and III keep them.
+	Being in the same file as the single slot synth, the compiler can inline
+	it and spare the indirect call and part of the setup for each slot.
+*/
+
+int STEREO_BLOCK_NAME(real *bandPtr_l, real *bandPtr_r, int count, mpg123_handle *fr)
+{
+	int clip = 0;
+
+	for(; count > 0; --count)
+	{
+		clip += STEREO_NAME(bandPtr_l, bandPtr_r, fr);
+		bandPtr_l += SBLIMIT;
+		bandPtr_r += SBLIMIT;
+	}
+	return clip;
+}
@@ -0,0 +1,63 @@
+/*
+	synth_down.h: down-sampling by picking from the 1to1 synth
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	This header is used multiple times to create the 2to1 and 4to1 wrappers
+	over the optimized 1to1 synths of a decoder. The generic 2to1 and 4to1
+	synths of synth.h compute every second or fourth sum of the 1to1 windowing
+	and nothing else, so running the (SSE/AVX/NEON) 1to1 synth and keeping
+	every second or fourth sample gives the same output, only faster than the
+	scalar code. Define BLOCK (samples per slot and channel times two, as in
+	synth.h), SAMPLE_T, BASE_FORMAT (the f_* index of the 1to1 synths),
+	PICK_NAME and STEREO_PICK_NAME.
+	The clip count is that of all 1to1 samples, also the dropped ones.
+*/
+
+int PICK_NAME(real *bandPtr, int channel, mpg123_handle *fr, int final)
+{
+	SAMPLE_T samples_tmp[64];
+	SAMPLE_T *tmp1 = samples_tmp + channel;
+	SAMPLE_T *out;
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+	int i, ret;
+
+	fr->buffer.data = (unsigned char*) samples_tmp;
+	fr->buffer.fill = 0;
+	ret = (fr->synths.plain[r_1to1][BASE_FORMAT])(bandPtr, channel, fr, 0);
+	fr->buffer.data = samples;
+
+	out = (SAMPLE_T*)(samples+pnt) + channel;
+	for(i=0; i<BLOCK/2; ++i, out+=2, tmp1+=128/BLOCK)
+		*out = *tmp1;
+	fr->buffer.fill = pnt + (final ? BLOCK*sizeof(SAMPLE_T) : 0);
+
+	return ret;
+}
+
+int STEREO_PICK_NAME(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	SAMPLE_T samples_tmp[64];
+	SAMPLE_T *tmp1 = samples_tmp;
+	SAMPLE_T *out;
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+	int i, ret;
+
+	fr->buffer.data = (unsigned char*) samples_tmp;
+	fr->buffer.fill = 0;
+	ret = (fr->synths.stereo[r_1to1][BASE_FORMAT])(bandPtr_l, bandPtr_r, fr);
+	fr->buffer.data = samples;
+
+	out = (SAMPLE_T*)(samples+pnt);
+	for(i=0; i<BLOCK/2; ++i, out+=2, tmp1+=128/BLOCK)
+	{
+		out[0] = tmp1[0];
+		out[1] = tmp1[1];
+	}
+	fr->buffer.fill = pnt + BLOCK*sizeof(SAMPLE_T);
+
+	return ret;
+}
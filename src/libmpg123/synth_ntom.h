@@ -11,6 +11,14 @@
 	Well, this is very simple resampling... you may or may not like what you hear.
 	But it's cheap.
 	But still, we don't implement a non-autoincrement version of this one.
+
+	With NTOM_LERP(x) defined (rounding a double to SAMPLE_T), the synth does
+	not pick the nearest sample from its own generic code anymore. It runs
+	the plain 1to1 synth of the active decoder (fr->ntom_synth, with all its
+	SIMD goodness) and interpolates linearly between the input samples each
+	output falls between. Sample counts and ntom_val bookkeeping stay exactly
+	the same. That does not work for 8 bit encodings (alaw/ulaw aren't
+	linear), so those stay with picking samples.
 */
 
 /* Note: These mono functions would also work generically,
@@ -63,6 +71,57 @@ int MONO2STEREO_NAME(real *bandPtr, mpg123_handle *fr)
 }
 
 
+#ifdef NTOM_LERP
+int SYNTH_NAME(real *bandPtr,int channel, mpg123_handle *fr, int final)
+{
+	static const int step = 2;
+	SAMPLE_T *samples = (SAMPLE_T *) (fr->buffer.data + fr->buffer.fill);
+	SAMPLE_T samples_tmp[2*32];
+	unsigned char *data = fr->buffer.data;
+	size_t fill = fr->buffer.fill;
+	double prev, cur;
+	int clip;
+	int ntom;
+	int i;
+
+	if(!channel)
+		ntom = fr->ntom_val[1] = fr->ntom_val[0];
+	else
+	{
+		samples++;
+		ntom = fr->ntom_val[1];
+	}
+
+	/* Full rate synth into samples_tmp, interleaved with the same layout. */
+	fr->buffer.data = (unsigned char*) samples_tmp;
+	fr->buffer.fill = 0;
+	clip = (fr->ntom_synth)(bandPtr, channel, fr, 1);
+	fr->buffer.data = data;
+	fr->buffer.fill = fill;
+
+	prev = fr->ntom_prev[channel];
+	for(i=channel; i<2*32; i+=step)
+	{
+		cur = samples_tmp[i];
+		ntom += fr->ntom_step;
+		/* Each output lies (ntom-NTOM_MUL)/ntom_step in front of cur. */
+		while(ntom >= NTOM_MUL)
+		{
+			double w = (double)(ntom-NTOM_MUL)/fr->ntom_step;
+			*samples = NTOM_LERP(cur + w*(prev-cur));
+			samples += step;
+			ntom -= NTOM_MUL;
+		}
+		prev = cur;
+	}
+	fr->ntom_prev[channel] = prev;
+
+	fr->ntom_val[channel] = ntom;
+	if(final) fr->buffer.fill = ((unsigned char *) samples - fr->buffer.data - (channel ? sizeof(SAMPLE_T) : 0));
+
+	return clip;
+}
+#else
 int SYNTH_NAME(real *bandPtr,int channel, mpg123_handle *fr, int final)
 {
 	static const int step = 2;
@@ -210,4 +269,4 @@ int SYNTH_NAME(real *bandPtr,int channel, mpg123_handle *fr, int final)
 
 	return clip;
 }
-
+#endif
@@ -10,16 +10,18 @@
 #include "sample.h"
 #include "debug.h"
 
-#ifdef REAL_IS_FIXED
-#error "Do not build this file with fixed point math!"
-#else
 /* 
 	Part 3: All synth functions that produce float output.
 	What we need is just a special WRITE_SAMPLE. For the generic and i386 functions, that is.
 	The optimized synths would need to be changed internally to support float output.
+	With fixed point math, the integer sums are scaled to float on writing.
 */
 
+#ifdef REAL_IS_FIXED
+#define SAMPLE_T float
+#else
 #define SAMPLE_T real
+#endif
 #define WRITE_SAMPLE(samples,sum,clip) WRITE_REAL_SAMPLE(samples,sum,clip)
 
 /* Part 3a: All straight 1to1 decoding functions */
@@ -138,6 +140,12 @@ int synth_1to1_real_stereo_x86_64(real *bandPtr_l, real *bandPtr_r, mpg123_handl
 
 	return 0;
 }
+
+#define STEREO_NAME synth_1to1_real_stereo_x86_64
+#define STEREO_BLOCK_NAME synth_1to1_real_stereo_x86_64_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
 #endif
 
 #ifdef OPT_AVX
@@ -230,6 +238,110 @@ int synth_1to1_fltst_avx(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 
 	return 0;
 }
+
+#define STEREO_NAME synth_1to1_fltst_avx
+#define STEREO_BLOCK_NAME synth_1to1_fltst_avx_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
+#endif
+
+#ifdef OPT_AVX512
+/* Assembler routines. */
+#if !defined(OPT_X86_64) && !defined(OPT_AVX)
+int synth_1to1_real_x86_64_asm(real *window, real *b0, real *samples, int bo1);
+#endif
+int synth_1to1_real_s_avx512_asm(real *window, real *b0l, real *b0r, real *samples, int bo1);
+void dct64_real_avx512(real *out0, real *out1, real *samples);
+/* Hull for C mpg123 API */
+int synth_1to1_real_avx512(real *bandPtr,int channel, mpg123_handle *fr, int final)
+{
+	real *samples = (real *) (fr->buffer.data+fr->buffer.fill);
+
+	real *b0, **buf;
+	int bo1;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings) do_equalizer(bandPtr,channel,fr->equalizer);
+#endif
+	if(!channel)
+	{
+		fr->bo--;
+		fr->bo &= 0xf;
+		buf = fr->real_buffs[0];
+	}
+	else
+	{
+		samples++;
+		buf = fr->real_buffs[1];
+	}
+
+	if(fr->bo & 0x1)
+	{
+		b0 = buf[0];
+		bo1 = fr->bo;
+		dct64_real_avx512(buf[1]+((fr->bo+1)&0xf),buf[0]+fr->bo,bandPtr);
+	}
+	else
+	{
+		b0 = buf[1];
+		bo1 = fr->bo+1;
+		dct64_real_avx512(buf[0]+fr->bo,buf[1]+fr->bo+1,bandPtr);
+	}
+
+	synth_1to1_real_x86_64_asm(fr->decwin, b0, samples, bo1);
+
+	if(final) fr->buffer.fill += 256;
+
+	return 0;
+}
+
+int synth_1to1_fltst_avx512(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	real *samples = (real *) (fr->buffer.data+fr->buffer.fill);
+
+	real *b0l, *b0r, **bufl, **bufr;
+	int bo1;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings)
+	{
+		do_equalizer(bandPtr_l,0,fr->equalizer);
+		do_equalizer(bandPtr_r,1,fr->equalizer);
+	}
+#endif
+	fr->bo--;
+	fr->bo &= 0xf;
+	bufl = fr->real_buffs[0];
+	bufr = fr->real_buffs[1];
+
+	if(fr->bo & 0x1)
+	{
+		b0l = bufl[0];
+		b0r = bufr[0];
+		bo1 = fr->bo;
+		dct64_real_avx512(bufl[1]+((fr->bo+1)&0xf),bufl[0]+fr->bo,bandPtr_l);
+		dct64_real_avx512(bufr[1]+((fr->bo+1)&0xf),bufr[0]+fr->bo,bandPtr_r);
+	}
+	else
+	{
+		b0l = bufl[1];
+		b0r = bufr[1];
+		bo1 = fr->bo+1;
+		dct64_real_avx512(bufl[0]+fr->bo,bufl[1]+fr->bo+1,bandPtr_l);
+		dct64_real_avx512(bufr[0]+fr->bo,bufr[1]+fr->bo+1,bandPtr_r);
+	}
+
+	synth_1to1_real_s_avx512_asm(fr->decwin, b0l, b0r, samples, bo1);
+
+	fr->buffer.fill += 256;
+
+	return 0;
+}
+
+#define STEREO_NAME synth_1to1_fltst_avx512
+#define STEREO_BLOCK_NAME synth_1to1_fltst_avx512_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
 #endif
 
 #if defined(OPT_SSE) || defined(OPT_SSE_VINTAGE)
@@ -498,6 +610,106 @@ int synth_1to1_fltst_neon64(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 
 	return 0;
 }
+
+#define STEREO_NAME synth_1to1_fltst_neon64
+#define STEREO_BLOCK_NAME synth_1to1_fltst_neon64_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
+#endif
+
+#ifdef OPT_SVE
+/* Assembler routines, using dct64_real_neon64() for the NEON64 decoder. */
+int synth_1to1_real_sve_asm(real *window, real *b0, real *samples, int bo1);
+int synth_1to1_real_s_sve_asm(real *window, real *b0l, real *b0r, real *samples, int bo1);
+/* Hull for C mpg123 API */
+int synth_1to1_real_sve(real *bandPtr,int channel, mpg123_handle *fr, int final)
+{
+	real *samples = (real *) (fr->buffer.data+fr->buffer.fill);
+
+	real *b0, **buf;
+	int bo1;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings) do_equalizer(bandPtr,channel,fr->equalizer);
+#endif
+	if(!channel)
+	{
+		fr->bo--;
+		fr->bo &= 0xf;
+		buf = fr->real_buffs[0];
+	}
+	else
+	{
+		samples++;
+		buf = fr->real_buffs[1];
+	}
+
+	if(fr->bo & 0x1)
+	{
+		b0 = buf[0];
+		bo1 = fr->bo;
+		dct64_real_neon64(buf[1]+((fr->bo+1)&0xf),buf[0]+fr->bo,bandPtr);
+	}
+	else
+	{
+		b0 = buf[1];
+		bo1 = fr->bo+1;
+		dct64_real_neon64(buf[0]+fr->bo,buf[1]+fr->bo+1,bandPtr);
+	}
+
+	synth_1to1_real_sve_asm(fr->decwin, b0, samples, bo1);
+
+	if(final) fr->buffer.fill += 256;
+
+	return 0;
+}
+int synth_1to1_fltst_sve(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	real *samples = (real *) (fr->buffer.data+fr->buffer.fill);
+
+	real *b0l, *b0r, **bufl, **bufr;
+	int bo1;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings)
+	{
+		do_equalizer(bandPtr_l,0,fr->equalizer);
+		do_equalizer(bandPtr_r,1,fr->equalizer);
+	}
+#endif
+	fr->bo--;
+	fr->bo &= 0xf;
+	bufl = fr->real_buffs[0];
+	bufr = fr->real_buffs[1];
+
+	if(fr->bo & 0x1)
+	{
+		b0l = bufl[0];
+		b0r = bufr[0];
+		bo1 = fr->bo;
+		dct64_real_neon64(bufl[1]+((fr->bo+1)&0xf),bufl[0]+fr->bo,bandPtr_l);
+		dct64_real_neon64(bufr[1]+((fr->bo+1)&0xf),bufr[0]+fr->bo,bandPtr_r);
+	}
+	else
+	{
+		b0l = bufl[1];
+		b0r = bufr[1];
+		bo1 = fr->bo+1;
+		dct64_real_neon64(bufl[0]+fr->bo,bufl[1]+fr->bo+1,bandPtr_l);
+		dct64_real_neon64(bufr[0]+fr->bo,bufr[1]+fr->bo+1,bandPtr_r);
+	}
+
+	synth_1to1_real_s_sve_asm(fr->decwin, b0l, b0r, samples, bo1);
+
+	fr->buffer.fill += 256;
+
+	return 0;
+}
+
+#define STEREO_NAME synth_1to1_fltst_sve
+#define STEREO_BLOCK_NAME synth_1to1_fltst_sve_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
 #endif
 
 #ifndef NO_DOWNSAMPLE
@@ -520,6 +732,15 @@ int synth_1to1_fltst_neon64(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 #undef MONO_NAME
 #undef MONO2STEREO_NAME
 
+/* Picking from the 1to1 synths of SIMD decoders. */
+#define BASE_FORMAT      f_real
+#define PICK_NAME        synth_2to1_real_pick
+#define STEREO_PICK_NAME synth_2to1_real_stereo_pick
+#include "synth_down.h"
+#undef BASE_FORMAT
+#undef PICK_NAME
+#undef STEREO_PICK_NAME
+
 #ifdef OPT_X86
 #define NO_AUTOINCREMENT
 #define SYNTH_NAME synth_2to1_real_i386
@@ -549,6 +770,15 @@ int synth_1to1_fltst_neon64(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 #undef MONO_NAME
 #undef MONO2STEREO_NAME
 
+/* Picking from the 1to1 synths of SIMD decoders. */
+#define BASE_FORMAT      f_real
+#define PICK_NAME        synth_4to1_real_pick
+#define STEREO_PICK_NAME synth_4to1_real_stereo_pick
+#include "synth_down.h"
+#undef BASE_FORMAT
+#undef PICK_NAME
+#undef STEREO_PICK_NAME
+
 #ifdef OPT_X86
 #define NO_AUTOINCREMENT
 #define SYNTH_NAME synth_4to1_real_i386
@@ -565,10 +795,14 @@ int synth_1to1_fltst_neon64(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 #ifndef NO_NTOM
 /*
 	Part 3d: ntom synth.
-	Same procedure as above... Just no extra play anymore, straight synth that may use an optimized dct64.
+	Same procedure as above... Just no extra play anymore, interpolating over the 1to1 synth (see synth_ntom.h).
 */
 
 /* These are all in one header, there's no flexibility to gain. */
+#ifndef REAL_IS_FIXED
+/* Interpolation in floating point, fixed point stays with picking. */
+#define NTOM_LERP(x) ((real)(x))
+#endif
 #define SYNTH_NAME       synth_ntom_real
 #define MONO_NAME        synth_ntom_real_mono
 #define MONO2STEREO_NAME synth_ntom_real_m2s
@@ -576,10 +810,9 @@ int synth_1to1_fltst_neon64(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 #undef SYNTH_NAME
 #undef MONO_NAME
 #undef MONO2STEREO_NAME
+#undef NTOM_LERP
 
 #endif
 
 #undef SAMPLE_T
 #undef WRITE_SAMPLE
-
-#endif /* non-fixed type */
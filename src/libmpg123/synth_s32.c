@@ -10,9 +10,6 @@
 #include "sample.h"
 #include "debug.h"
 
-#ifdef REAL_IS_FIXED
-#error "Do not build this file with fixed point math!"
-#else
 /* 
 	Part 4: All synth functions that produce signed 32 bit output.
 	What we need is just a special WRITE_SAMPLE.
@@ -137,6 +134,12 @@ int synth_1to1_s32_stereo_x86_64(real *bandPtr_l, real *bandPtr_r, mpg123_handle
 
 	return clip;
 }
+
+#define STEREO_NAME synth_1to1_s32_stereo_x86_64
+#define STEREO_BLOCK_NAME synth_1to1_s32_stereo_x86_64_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
 #endif
 
 #ifdef OPT_AVX
@@ -232,6 +235,113 @@ int synth_1to1_s32_stereo_avx(real *bandPtr_l, real *bandPtr_r, mpg123_handle *f
 
 	return clip;
 }
+
+#define STEREO_NAME synth_1to1_s32_stereo_avx
+#define STEREO_BLOCK_NAME synth_1to1_s32_stereo_avx_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
+#endif
+
+#ifdef OPT_AVX512
+/* Assembler routines. */
+#if !defined(OPT_X86_64) && !defined(OPT_AVX)
+int synth_1to1_s32_x86_64_asm(real *window, real *b0, int32_t *samples, int bo1);
+#endif
+int synth_1to1_s32_s_avx512_asm(real *window, real *b0l, real *b0r, int32_t *samples, int bo1);
+void dct64_real_avx512(real *out0, real *out1, real *samples);
+/* Hull for C mpg123 API */
+int synth_1to1_s32_avx512(real *bandPtr,int channel, mpg123_handle *fr, int final)
+{
+	int32_t *samples = (int32_t *) (fr->buffer.data+fr->buffer.fill);
+
+	real *b0, **buf;
+	int bo1;
+	int clip;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings) do_equalizer(bandPtr,channel,fr->equalizer);
+#endif
+	if(!channel)
+	{
+		fr->bo--;
+		fr->bo &= 0xf;
+		buf = fr->real_buffs[0];
+	}
+	else
+	{
+		samples++;
+		buf = fr->real_buffs[1];
+	}
+
+	if(fr->bo & 0x1)
+	{
+		b0 = buf[0];
+		bo1 = fr->bo;
+		dct64_real_avx512(buf[1]+((fr->bo+1)&0xf),buf[0]+fr->bo,bandPtr);
+	}
+	else
+	{
+		b0 = buf[1];
+		bo1 = fr->bo+1;
+		dct64_real_avx512(buf[0]+fr->bo,buf[1]+fr->bo+1,bandPtr);
+	}
+
+	clip = synth_1to1_s32_x86_64_asm(fr->decwin, b0, samples, bo1);
+
+	if(final) fr->buffer.fill += 256;
+
+	return clip;
+}
+
+
+int synth_1to1_s32_stereo_avx512(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	int32_t *samples = (int32_t *) (fr->buffer.data+fr->buffer.fill);
+
+	real *b0l, *b0r, **bufl, **bufr;
+	int bo1;
+	int clip;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings)
+	{
+		do_equalizer(bandPtr_l,0,fr->equalizer);
+		do_equalizer(bandPtr_r,1,fr->equalizer);
+	}
+#endif
+	fr->bo--;
+	fr->bo &= 0xf;
+	bufl = fr->real_buffs[0];
+	bufr = fr->real_buffs[1];
+
+	if(fr->bo & 0x1)
+	{
+		b0l = bufl[0];
+		b0r = bufr[0];
+		bo1 = fr->bo;
+		dct64_real_avx512(bufl[1]+((fr->bo+1)&0xf),bufl[0]+fr->bo,bandPtr_l);
+		dct64_real_avx512(bufr[1]+((fr->bo+1)&0xf),bufr[0]+fr->bo,bandPtr_r);
+	}
+	else
+	{
+		b0l = bufl[1];
+		b0r = bufr[1];
+		bo1 = fr->bo+1;
+		dct64_real_avx512(bufl[0]+fr->bo,bufl[1]+fr->bo+1,bandPtr_l);
+		dct64_real_avx512(bufr[0]+fr->bo,bufr[1]+fr->bo+1,bandPtr_r);
+	}
+
+	clip = synth_1to1_s32_s_avx512_asm(fr->decwin, b0l, b0r, samples, bo1);
+
+	fr->buffer.fill += 256;
+
+	return clip;
+}
+
+#define STEREO_NAME synth_1to1_s32_stereo_avx512
+#define STEREO_BLOCK_NAME synth_1to1_s32_stereo_avx512_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
 #endif
 
 #if defined(OPT_SSE) || defined(OPT_SSE_VINTAGE)
@@ -509,6 +619,12 @@ int synth_1to1_s32st_neon64(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 
 	return clip;
 }
+
+#define STEREO_NAME synth_1to1_s32st_neon64
+#define STEREO_BLOCK_NAME synth_1to1_s32st_neon64_block
+#include "synth_block.h"
+#undef STEREO_BLOCK_NAME
+#undef STEREO_NAME
 #endif
 
 #undef BLOCK
@@ -533,6 +649,15 @@ int synth_1to1_s32st_neon64(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 #undef MONO_NAME
 #undef MONO2STEREO_NAME
 
+/* Picking from the 1to1 synths of SIMD decoders. */
+#define BASE_FORMAT      f_32
+#define PICK_NAME        synth_2to1_s32_pick
+#define STEREO_PICK_NAME synth_2to1_s32_stereo_pick
+#include "synth_down.h"
+#undef BASE_FORMAT
+#undef PICK_NAME
+#undef STEREO_PICK_NAME
+
 #ifdef OPT_X86
 #define NO_AUTOINCREMENT
 #define SYNTH_NAME synth_2to1_s32_i386
@@ -562,6 +687,15 @@ int synth_1to1_s32st_neon64(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 #undef MONO_NAME
 #undef MONO2STEREO_NAME
 
+/* Picking from the 1to1 synths of SIMD decoders. */
+#define BASE_FORMAT      f_32
+#define PICK_NAME        synth_4to1_s32_pick
+#define STEREO_PICK_NAME synth_4to1_s32_stereo_pick
+#include "synth_down.h"
+#undef BASE_FORMAT
+#undef PICK_NAME
+#undef STEREO_PICK_NAME
+
 #ifdef OPT_X86
 #define NO_AUTOINCREMENT
 #define SYNTH_NAME synth_4to1_s32_i386
@@ -578,10 +712,14 @@ int synth_1to1_s32st_neon64(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 #ifndef NO_NTOM
 /*
 	Part 4d: ntom synth.
-	Same procedure as above... Just no extra play anymore, straight synth that may use an optimized dct64.
+	Same procedure as above... Just no extra play anymore, interpolating over the 1to1 synth (see synth_ntom.h).
 */
 
 /* These are all in one header, there's no flexibility to gain. */
+#ifndef REAL_IS_FIXED
+/* Interpolation in floating point, fixed point stays with picking. */
+#define NTOM_LERP(x) ((SAMPLE_T)((x) < 0 ? (x)-0.5 : (x)+0.5))
+#endif
 #define SYNTH_NAME       synth_ntom_s32
 #define MONO_NAME        synth_ntom_s32_mono
 #define MONO2STEREO_NAME synth_ntom_s32_m2s
@@ -589,10 +727,130 @@ int synth_1to1_s32st_neon64(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
 #undef SYNTH_NAME
 #undef MONO_NAME
 #undef MONO2STEREO_NAME
+#undef NTOM_LERP
 
 #endif
 
+/*
+	Part 4e: Packed 24 bit output.
+	Wrappers over the possibly optimized 1to1 s32 synths. Those write into a
+	buffer on the stack, from where the samples get packed into the output
+	while still in cache. That replaces the pass of chop_fourth_byte() over
+	the whole output.
+*/
+
+/* A Layer III granule at once. */
+#define S24_BLOCKS SSLIMIT
+
+static void pack_s24(unsigned char *out, int32_t *in, int count, int step)
+{
+	int i;
+	for(i=0; i<count; ++i, out+=3, in+=step)
+		DROP4BYTE(out, (unsigned char*)in)
+}
+
+int synth_1to1_s24_wrap(real *bandPtr, int channel, mpg123_handle *fr, int final)
+{
+	int32_t samples_tmp[64];
+	int32_t *tmp1 = samples_tmp + channel;
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+	int i, ret;
+
+	fr->buffer.data = (unsigned char*) samples_tmp;
+	fr->buffer.fill = 0;
+	ret = (fr->synths.plain[r_1to1][f_32])(bandPtr, channel, fr, 0);
+	fr->buffer.data = samples;
+
+	samples += pnt + 3*channel;
+	for(i=0; i<32; ++i, samples+=6, tmp1+=2)
+		DROP4BYTE(samples, (unsigned char*)tmp1)
+	fr->buffer.fill = pnt + (final ? 64*3 : 0);
+
+	return ret;
+}
+
+int synth_1to1_s24_wrap_mono(real *bandPtr, mpg123_handle *fr)
+{
+	int32_t samples_tmp[64];
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+	int ret;
+
+	fr->buffer.data = (unsigned char*) samples_tmp;
+	fr->buffer.fill = 0;
+	ret = (fr->synths.plain[r_1to1][f_32])(bandPtr, 0, fr, 0);
+	fr->buffer.data = samples;
+
+	pack_s24(samples+pnt, samples_tmp, 32, 2);
+	fr->buffer.fill = pnt + 32*3;
+
+	return ret;
+}
+
+int synth_1to1_s24_wrap_m2s(real *bandPtr, mpg123_handle *fr)
+{
+	int32_t samples_tmp[64];
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+	int i, ret;
+
+	fr->buffer.data = (unsigned char*) samples_tmp;
+	fr->buffer.fill = 0;
+	ret = (fr->synths.plain[r_1to1][f_32])(bandPtr, 0, fr, 0);
+	fr->buffer.data = samples;
+
+	samples += pnt;
+	for(i=0; i<32; ++i, samples+=6)
+	{
+		DROP4BYTE(samples,   (unsigned char*)(samples_tmp+2*i))
+		DROP4BYTE(samples+3, (unsigned char*)(samples_tmp+2*i))
+	}
+	fr->buffer.fill = pnt + 64*3;
+
+	return ret;
+}
+
+/* The stereo block synth of the decoder (fr->synth_base_block) can be a
+   generic wrapper calling back into fr->synth or fr->synth_stereo, so
+   those point to the s32 synths meanwhile. */
+int synth_1to1_s24_stereo_block_wrap(real *bandPtr_l, real *bandPtr_r, int count, mpg123_handle *fr)
+{
+	int32_t samples_tmp[S24_BLOCKS*64];
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+	func_synth synth = fr->synth;
+	func_synth_stereo synth_stereo = fr->synth_stereo;
+	int clip = 0;
+
+	fr->synth = fr->synths.plain[r_1to1][f_32];
+	fr->synth_stereo = fr->synths.stereo[r_1to1][f_32];
+	while(count > 0)
+	{
+		int blocks = count > S24_BLOCKS ? S24_BLOCKS : count;
+		fr->buffer.data = (unsigned char*) samples_tmp;
+		fr->buffer.fill = 0;
+		clip += (fr->synth_base_block)(bandPtr_l, bandPtr_r, blocks, fr);
+		pack_s24(samples+pnt, samples_tmp, blocks*64, 1);
+		pnt += blocks*64*3;
+		bandPtr_l += blocks*SBLIMIT;
+		bandPtr_r += blocks*SBLIMIT;
+		count -= blocks;
+	}
+	fr->buffer.data = samples;
+	fr->buffer.fill = pnt;
+	fr->synth = synth;
+	fr->synth_stereo = synth_stereo;
+
+	return clip;
+}
+
+int synth_1to1_s24_stereo_wrap(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	return synth_1to1_s24_stereo_block_wrap(bandPtr_l, bandPtr_r, 1, fr);
+}
+
+#undef S24_BLOCKS
+
 #undef SAMPLE_T
 #undef WRITE_SAMPLE
-
-#endif /* non-fixed type */
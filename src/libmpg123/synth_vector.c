@@ -0,0 +1,152 @@
+/*
+	synth_vector: synth functions of the generic_vector decoder
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The windowing of synth.h, with the 16 products for each sample taken as
+	four vectors. Four samples at a time get their vector sums transposed
+	and added up, giving all of them in one vector. The order of additions
+	differs from the scalar code, so the sums differ in the last bits.
+	Mono output stays with the generic wrappers, down-sampling picks from
+	these synths (synth_down.h).
+*/
+
+#include "mpg123lib_intern.h"
+#include "sample.h"
+#include "vectors.h"
+#include "debug.h"
+
+/* 33 sums are computed, one more for full vectors. */
+#define VECTOR_SUMS 36
+
+/* Window and buffer, 16 values each. */
+static inline vreal dot16(const real *w, const real *b)
+{
+	return vload(w)   * vload(b)
+	+      vload(w+4)  * vload(b+4)
+	+      vload(w+8)  * vload(b+8)
+	+      vload(w+12) * vload(b+12);
+}
+
+/* The same, with the window running backwards from w. */
+static inline vreal dot16_rev(const real *w, const real *b)
+{
+	return vload_rev(w-4)  * vload(b)
+	+      vload_rev(w-8)  * vload(b+4)
+	+      vload_rev(w-12) * vload(b+8)
+	+      vload_rev(w-16) * vload(b+12);
+}
+
+/* { a0+a1+a2+a3, b0+..., c0+..., d0+... } and the same with alternating signs. */
+#define HSUM4(a, b, c, d, even, odd) \
+{ \
+	vreal u0_ = VSHUF((a), (b), 0, 4, 1, 5); \
+	vreal u1_ = VSHUF((a), (b), 2, 6, 3, 7); \
+	vreal u2_ = VSHUF((c), (d), 0, 4, 1, 5); \
+	vreal u3_ = VSHUF((c), (d), 2, 6, 3, 7); \
+	vreal s0_ = u0_ + u1_; \
+	vreal s1_ = u2_ + u3_; \
+	(even) = VSHUF(s0_, s1_, 0, 1, 4, 5); \
+	(odd)  = VSHUF(s0_, s1_, 2, 3, 6, 7); \
+}
+
+/* The 32 output sums of synth.h for one channel. */
+static void vector_window(real *decwin, real *b0, int bo1, real *sums)
+{
+	real *window = decwin + 16 - bo1;
+	int j;
+
+	for(j=0; j<16; j+=4)
+	{
+		vreal even, odd;
+		HSUM4( dot16(window+32*j,      b0+16*j)
+		,      dot16(window+32*(j+1),  b0+16*(j+1))
+		,      dot16(window+32*(j+2),  b0+16*(j+2))
+		,      dot16(window+32*(j+3),  b0+16*(j+3)), even, odd );
+		vstore(sums+j, even - odd);
+	}
+	{
+		/* Only the even taps for the middle one. */
+		vreal a = vload(window+512)   * vload(b0+256)
+		+         vload(window+512+4) * vload(b0+256+4)
+		+         vload(window+512+8) * vload(b0+256+8)
+		+         vload(window+512+12) * vload(b0+256+12);
+		sums[16] = a[0] + a[2];
+	}
+	/* The 16th of these reads valid data, but is not used. */
+	window = decwin + 496 + bo1;
+	b0 += 240;
+	for(j=0; j<16; j+=4)
+	{
+		vreal even, odd;
+		HSUM4( dot16_rev(window-32*j,     b0-16*j)
+		,      dot16_rev(window-32*(j+1), b0-16*(j+1))
+		,      dot16_rev(window-32*(j+2), b0-16*(j+2))
+		,      dot16_rev(window-32*(j+3), b0-16*(j+3)), even, odd );
+		vstore(sums+17+j, -(even + odd));
+	}
+}
+
+/* The DCT into the ring buffer of the channel, fr->bo being advanced already,
+   then the windowing. */
+static void vector_dct(mpg123_handle *fr, int channel, real *bandPtr, real *sums)
+{
+	real **buf = fr->real_buffs[channel];
+
+	if(fr->bo & 0x1)
+	{
+		dct64_vector(buf[1]+((fr->bo+1)&0xf),buf[0]+fr->bo,bandPtr);
+		vector_window(fr->decwin, buf[0], fr->bo, sums);
+	}
+	else
+	{
+		dct64_vector(buf[0]+fr->bo,buf[1]+fr->bo+1,bandPtr);
+		vector_window(fr->decwin, buf[1], fr->bo+1, sums);
+	}
+}
+
+#ifndef NO_16BIT
+#define SAMPLE_T short
+#define WRITE_SAMPLE(samples,sum,clip) WRITE_SHORT_SAMPLE(samples,sum,clip)
+#define SYNTH_NAME        synth_1to1_vector
+#define STEREO_NAME       synth_1to1_stereo_vector
+#define STEREO_BLOCK_NAME synth_1to1_stereo_vector_block
+#include "synth_vector.h"
+#include "synth_block.h"
+#undef SAMPLE_T
+#undef WRITE_SAMPLE
+#undef SYNTH_NAME
+#undef STEREO_NAME
+#undef STEREO_BLOCK_NAME
+#endif
+
+#ifndef NO_REAL
+#define SAMPLE_T real
+#define WRITE_SAMPLE(samples,sum,clip) WRITE_REAL_SAMPLE(samples,sum,clip)
+#define SYNTH_NAME        synth_1to1_real_vector
+#define STEREO_NAME       synth_1to1_real_stereo_vector
+#define STEREO_BLOCK_NAME synth_1to1_real_stereo_vector_block
+#include "synth_vector.h"
+#include "synth_block.h"
+#undef SAMPLE_T
+#undef WRITE_SAMPLE
+#undef SYNTH_NAME
+#undef STEREO_NAME
+#undef STEREO_BLOCK_NAME
+#endif
+
+#ifndef NO_32BIT
+#define SAMPLE_T int32_t
+#define WRITE_SAMPLE(samples,sum,clip) WRITE_S32_SAMPLE(samples,sum,clip)
+#define SYNTH_NAME        synth_1to1_s32_vector
+#define STEREO_NAME       synth_1to1_s32_stereo_vector
+#define STEREO_BLOCK_NAME synth_1to1_s32_stereo_vector_block
+#include "synth_vector.h"
+#include "synth_block.h"
+#undef SAMPLE_T
+#undef WRITE_SAMPLE
+#undef SYNTH_NAME
+#undef STEREO_NAME
+#undef STEREO_BLOCK_NAME
+#endif
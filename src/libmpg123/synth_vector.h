@@ -0,0 +1,67 @@
+/*
+	synth_vector.h: synth functions of the generic_vector decoder
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	This header is used multiple times by synth_vector.c to create the
+	variants for the output formats. Define SYNTH_NAME, STEREO_NAME,
+	SAMPLE_T and WRITE_SAMPLE. The windowing itself is vector_window()
+	from synth_vector.c; here the sums are only written out.
+*/
+
+int SYNTH_NAME(real *bandPtr, int channel, mpg123_handle *fr, int final)
+{
+	SAMPLE_T *samples = (SAMPLE_T *) (fr->buffer.data + fr->buffer.fill);
+	real sums[VECTOR_SUMS];
+	int clip = 0;
+	int i;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings) do_equalizer(bandPtr,channel,fr->equalizer);
+#endif
+	if(!channel)
+	{
+		fr->bo--;
+		fr->bo &= 0xf;
+	}
+	else
+		samples++;
+
+	vector_dct(fr, channel, bandPtr, sums);
+	for(i=0; i<32; ++i, samples+=2)
+		WRITE_SAMPLE(samples,sums[i],clip);
+
+	if(final) fr->buffer.fill += 64*sizeof(SAMPLE_T);
+
+	return clip;
+}
+
+int STEREO_NAME(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	SAMPLE_T *samples = (SAMPLE_T *) (fr->buffer.data + fr->buffer.fill);
+	real sums_l[VECTOR_SUMS];
+	real sums_r[VECTOR_SUMS];
+	int clip = 0;
+	int i;
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings)
+	{
+		do_equalizer(bandPtr_l,0,fr->equalizer);
+		do_equalizer(bandPtr_r,1,fr->equalizer);
+	}
+#endif
+	fr->bo--;
+	fr->bo &= 0xf;
+
+	vector_dct(fr, 0, bandPtr_l, sums_l);
+	vector_dct(fr, 1, bandPtr_r, sums_r);
+	for(i=0; i<32; ++i, samples+=2)
+	{
+		WRITE_SAMPLE(samples,sums_l[i],clip);
+		WRITE_SAMPLE(samples+1,sums_r[i],clip);
+	}
+
+	fr->buffer.fill += 64*sizeof(SAMPLE_T);
+
+	return clip;
+}
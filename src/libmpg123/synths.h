@@ -10,6 +10,8 @@
 typedef int (*func_synth)(real *,int, mpg123_handle *,int );
 typedef int (*func_synth_mono)(real *, mpg123_handle *);
 typedef int (*func_synth_stereo)(real *, real *, mpg123_handle *);
+/* Stereo synth over count time slots, SBLIMIT values apart. */
+typedef int (*func_synth_stereo_block)(real *, real *, int, mpg123_handle *);
 enum synth_channel  { c_plain=0, c_stereo, c_m2s, c_mono, c_limit };
 enum synth_resample
 {
@@ -10,7 +10,11 @@
 #include "debug.h"
 
 /* That altivec alignment part here should not hurt generic code, I hope */
-#ifdef OPT_ALTIVEC
+#ifdef BUILD_TABLES
+/* Computed at build time by calctables, read-only from the start. */
+#define TABLES_COS
+#include "build_tables.h"
+#elif defined(OPT_ALTIVEC)
 static ALIGNED(16) real cos64[16];
 static ALIGNED(16) real cos32[8];
 static ALIGNED(16) real cos16[4];
@@ -42,7 +46,12 @@ static real cos4[1] =
 static real cos64[16],cos32[8],cos16[4],cos8[2],cos4[1];
 #endif
 
-real *pnts[] = { cos64,cos32,cos16,cos8,cos4 };
+const real *pnts[] = { cos64,cos32,cos16,cos8,cos4 };
+
+#if !defined(BUILD_TABLES) && (!defined(REAL_IS_FIXED) || !defined(PRECALC_TABLES))
+#define TABLES_COS
+#include "tables_impl.h"
+#endif
 
 
 static long intwinbase[] = {
@@ -75,17 +84,9 @@ static long intwinbase[] = {
 
 void prepare_decode_tables()
 {
-#if !defined(REAL_IS_FIXED) || !defined(PRECALC_TABLES)
-  int i,k,kr,divv;
-  real *costab;
-
-  for(i=0;i<5;i++)
-  {
-    kr=0x10>>i; divv=0x40>>i;
-    costab = pnts[i];
-    for(k=0;k<kr;k++)
-      costab[k] = DOUBLE_TO_REAL(1.0 / (2.0 * cos(M_PI * ((double) k * 2.0 + 1.0) / (double) divv)));
-  }
+#if !defined(BUILD_TABLES) && (!defined(REAL_IS_FIXED) || !defined(PRECALC_TABLES))
+  real *costabs[5] = { cos64,cos32,cos16,cos8,cos4 };
+  calc_cos_tables(costabs);
 #endif
 }
 
@@ -178,7 +179,8 @@ static int32_t sat_mul32(int32_t a, int32_t b)
 }
 #endif
 
-void make_decode_tables(mpg123_handle *fr)
+/* The plain window of the generic synth for the given output scale. */
+void make_decwin(real *decwin, double scale)
 {
 	int i,j;
 	int idx = 0;
@@ -186,30 +188,19 @@ void make_decode_tables(mpg123_handle *fr)
 #ifdef REAL_IS_FIXED
 	real scaleval_long;
 #endif
-	/* Scale is always based on 1.0 . */
-	scaleval = -0.5*(fr->lastscale < 0 ? fr->p.outscale : fr->lastscale);
-	debug1("decode tables with scaleval %g", scaleval);
+	scaleval = -0.5*scale;
 #ifdef REAL_IS_FIXED
 	scaleval_long = DOUBLE_TO_REAL_15(scaleval);
 	debug1("decode table with fixed scaleval %li", (long)scaleval_long);
-	if(scaleval_long > 28618 || scaleval_long < -28618)
-	{
-		/* TODO: Limit the scaleval itself or limit the multiplication afterwards?
-		   The former basically disables significant amplification for fixed-point
-		   decoders, but avoids (possibly subtle) distortion. */
-		/* This would limit the amplification instead:
-		   scaleval_long = scaleval_long < 0 ? -28618 : 28618; */
-		if(NOQUIET) warning("Desired amplification may introduce distortion.");
-	}
 #endif
 	for(i=0,j=0;i<256;i++,j++,idx+=32)
 	{
 		if(idx < 512+16)
 #ifdef REAL_IS_FIXED
-		fr->decwin[idx+16] = fr->decwin[idx] =
+		decwin[idx+16] = decwin[idx] =
 			REAL_SCALE_WINDOW(sat_mul32(intwinbase[j],scaleval_long));
 #else
-		fr->decwin[idx+16] = fr->decwin[idx] = DOUBLE_TO_REAL((double) intwinbase[j] * scaleval);
+		decwin[idx+16] = decwin[idx] = DOUBLE_TO_REAL((double) intwinbase[j] * scaleval);
 #endif
 
 		if(i % 32 == 31)
@@ -226,10 +217,10 @@ void make_decode_tables(mpg123_handle *fr)
 	{
 		if(idx < 512+16)
 #ifdef REAL_IS_FIXED
-		fr->decwin[idx+16] = fr->decwin[idx] =
+		decwin[idx+16] = decwin[idx] =
 			REAL_SCALE_WINDOW(sat_mul32(intwinbase[j],scaleval_long));
 #else
-		fr->decwin[idx+16] = fr->decwin[idx] = DOUBLE_TO_REAL((double) intwinbase[j] * scaleval);
+		decwin[idx+16] = decwin[idx] = DOUBLE_TO_REAL((double) intwinbase[j] * scaleval);
 #endif
 
 		if(i % 32 == 31)
@@ -241,7 +232,32 @@ void make_decode_tables(mpg123_handle *fr)
 		scaleval = - scaleval;
 #endif
 	}
-#if defined(OPT_X86_64) || defined(OPT_ALTIVEC) || defined(OPT_SSE) || defined(OPT_SSE_VINTAGE) || defined(OPT_ARM) || defined(OPT_NEON) || defined(OPT_NEON64) || defined(OPT_AVX)
+}
+
+void make_decode_tables(mpg123_handle *fr)
+{
+#if defined(OPT_X86_64) || defined(OPT_ALTIVEC) || defined(OPT_SSE) || defined(OPT_SSE_VINTAGE) || defined(OPT_ARM) || defined(OPT_NEON) || defined(OPT_NEON64) || defined(OPT_AVX) || defined(OPT_AVX512)
+	int i;
+#endif
+	/* Scale is always based on 1.0 . */
+	double scale = fr->lastscale < 0 ? fr->p.outscale : fr->lastscale;
+	debug1("decode tables with scaleval %g", -0.5*scale);
+#ifdef REAL_IS_FIXED
+	{
+		real scaleval_long = DOUBLE_TO_REAL_15(-0.5*scale);
+		if(scaleval_long > 28618 || scaleval_long < -28618)
+		{
+			/* TODO: Limit the scaleval itself or limit the multiplication afterwards?
+			   The former basically disables significant amplification for fixed-point
+			   decoders, but avoids (possibly subtle) distortion. */
+			/* This would limit the amplification instead:
+			   scaleval_long = scaleval_long < 0 ? -28618 : 28618; */
+			if(NOQUIET) warning("Desired amplification may introduce distortion.");
+		}
+	}
+#endif
+	make_decwin(fr->decwin, scale);
+#if defined(OPT_X86_64) || defined(OPT_ALTIVEC) || defined(OPT_SSE) || defined(OPT_SSE_VINTAGE) || defined(OPT_ARM) || defined(OPT_NEON) || defined(OPT_NEON64) || defined(OPT_AVX) || defined(OPT_AVX512)
 	if(  fr->cpu_opts.type == x86_64
 	  || fr->cpu_opts.type == altivec
 	  || fr->cpu_opts.type == sse
@@ -249,7 +265,8 @@ void make_decode_tables(mpg123_handle *fr)
 	  || fr->cpu_opts.type == arm
 	  || fr->cpu_opts.type == neon
 	  || fr->cpu_opts.type == neon64
-	  || fr->cpu_opts.type == avx )
+	  || fr->cpu_opts.type == avx
+	  || fr->cpu_opts.type == avx512 )
 	{ /* for float SSE / AltiVec / ARM decoder */
 		for(i=512; i<512+32; i++)
 		{
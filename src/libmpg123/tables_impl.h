@@ -0,0 +1,119 @@
+/*
+	tables_impl.h: computing the constant floating point decoding tables
+
+	copyright 1995-2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+	initially written by Michael Hipp
+
+	This is included by tabinit.c and layer3.c to fill the tables in
+	mpg123_init() and by calctables.c to print them into build_tables.h
+	(--enable-build-tables), so that both ways give the same bits.
+	Define TABLES_COS for calc_cos_tables() and TABLES_LAYER3 for
+	calc_layer3_tables(), with the tables declared before.
+*/
+
+#ifdef TABLES_COS
+/* The cosines of the DCT64 stages: 16, 8, 4, 2 and 1 values. */
+static void calc_cos_tables(real *costabs[5])
+{
+	int i,k,kr,divv;
+	real *costab;
+
+	for(i=0;i<5;i++)
+	{
+		kr=0x10>>i; divv=0x40>>i;
+		costab = costabs[i];
+		for(k=0;k<kr;k++)
+			costab[k] = DOUBLE_TO_REAL(1.0 / (2.0 * cos(M_PI * ((double) k * 2.0 + 1.0) / (double) divv)));
+	}
+}
+#endif
+
+#ifdef TABLES_LAYER3
+/* ispow, aa_cs, aa_ca, win, COS9, COS6_1, COS6_2, tfcos36, tfcos12,
+   cos9, cos18 and the intensity stereo tables tan?_? and pow?_?. */
+static void calc_layer3_tables(void)
+{
+	int i,j;
+
+	for(i=0;i<POW43_SIZE;i++)
+	ispow[i] = DOUBLE_TO_REAL_POW43(pow((double)i,(double)4.0/3.0));
+
+	for(i=0;i<8;i++)
+	{
+		const double Ci[8] = {-0.6,-0.535,-0.33,-0.185,-0.095,-0.041,-0.0142,-0.0037};
+		double sq = sqrt(1.0+Ci[i]*Ci[i]);
+		aa_cs[i] = DOUBLE_TO_REAL(1.0/sq);
+		aa_ca[i] = DOUBLE_TO_REAL(Ci[i]/sq);
+	}
+
+	for(i=0;i<18;i++)
+	{
+		win[0][i]    = win[1][i]    =
+			DOUBLE_TO_REAL( 0.5*sin(M_PI/72.0 * (double)(2*(i+0) +1)) / cos(M_PI * (double)(2*(i+0) +19) / 72.0) );
+		win[0][i+18] = win[3][i+18] =
+			DOUBLE_TO_REAL( 0.5*sin(M_PI/72.0 * (double)(2*(i+18)+1)) / cos(M_PI * (double)(2*(i+18)+19) / 72.0) );
+	}
+	for(i=0;i<6;i++)
+	{
+		win[1][i+18] = DOUBLE_TO_REAL(0.5 / cos ( M_PI * (double) (2*(i+18)+19) / 72.0 ));
+		win[3][i+12] = DOUBLE_TO_REAL(0.5 / cos ( M_PI * (double) (2*(i+12)+19) / 72.0 ));
+		win[1][i+24] = DOUBLE_TO_REAL(0.5 * sin( M_PI / 24.0 * (double) (2*i+13) ) / cos ( M_PI * (double) (2*(i+24)+19) / 72.0 ));
+		win[1][i+30] = win[3][i] = DOUBLE_TO_REAL(0.0);
+		win[3][i+6 ] = DOUBLE_TO_REAL(0.5 * sin( M_PI / 24.0 * (double) (2*i+1 ) ) / cos ( M_PI * (double) (2*(i+6 )+19) / 72.0 ));
+	}
+
+	for(i=0;i<9;i++)
+	COS9[i] = DOUBLE_TO_REAL(cos( M_PI / 18.0 * (double) i));
+
+	for(i=0;i<9;i++)
+	tfcos36[i] = DOUBLE_TO_REAL(0.5 / cos ( M_PI * (double) (i*2+1) / 36.0 ));
+
+	for(i=0;i<3;i++)
+	tfcos12[i] = DOUBLE_TO_REAL(0.5 / cos ( M_PI * (double) (i*2+1) / 12.0 ));
+
+	COS6_1 = DOUBLE_TO_REAL(cos( M_PI / 6.0 * (double) 1));
+	COS6_2 = DOUBLE_TO_REAL(cos( M_PI / 6.0 * (double) 2));
+
+#ifdef NEW_DCT9
+	cos9[0]  = DOUBLE_TO_REAL(cos(1.0*M_PI/9.0));
+	cos9[1]  = DOUBLE_TO_REAL(cos(5.0*M_PI/9.0));
+	cos9[2]  = DOUBLE_TO_REAL(cos(7.0*M_PI/9.0));
+	cos18[0] = DOUBLE_TO_REAL(cos(1.0*M_PI/18.0));
+	cos18[1] = DOUBLE_TO_REAL(cos(11.0*M_PI/18.0));
+	cos18[2] = DOUBLE_TO_REAL(cos(13.0*M_PI/18.0));
+#endif
+
+	for(i=0;i<12;i++)
+	{
+		win[2][i] = DOUBLE_TO_REAL(0.5 * sin( M_PI / 24.0 * (double) (2*i+1) ) / cos ( M_PI * (double) (2*i+7) / 24.0 ));
+	}
+
+	for(i=0;i<16;i++)
+	{
+		double t = tan( (double) i * M_PI / 12.0 );
+		tan1_1[i] = DOUBLE_TO_REAL_15(t / (1.0+t));
+		tan2_1[i] = DOUBLE_TO_REAL_15(1.0 / (1.0 + t));
+		tan1_2[i] = DOUBLE_TO_REAL_15(M_SQRT2 * t / (1.0+t));
+		tan2_2[i] = DOUBLE_TO_REAL_15(M_SQRT2 / (1.0 + t));
+	}
+
+	for(i=0;i<32;i++)
+	{
+		for(j=0;j<2;j++)
+		{
+			double base = pow(2.0,-0.25*(j+1.0));
+			double p1=1.0,p2=1.0;
+			if(i > 0)
+			{
+				if( i & 1 ) p1 = pow(base,(i+1.0)*0.5);
+				else p2 = pow(base,i*0.5);
+			}
+			pow1_1[j][i] = DOUBLE_TO_REAL_15(p1);
+			pow2_1[j][i] = DOUBLE_TO_REAL_15(p2);
+			pow1_2[j][i] = DOUBLE_TO_REAL_15(M_SQRT2 * p1);
+			pow2_2[j][i] = DOUBLE_TO_REAL_15(M_SQRT2 * p2);
+		}
+	}
+}
+#endif
@@ -0,0 +1,306 @@
+/*
+	tabshare: decoding tables shared between handles
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The synth window and the layer I to III dequantization tables only depend
+	on the decoder, the output scale and the downsampling setup. Instead of
+	each handle carrying its own copy, they live in reference counted entries
+	on process-wide lists. The first handle that needs a certain combination
+	creates the entry, the last one letting go of it frees it again.
+	There is one entry per setup actually in use, so the lists stay short and
+	a linear search is good enough. Entries are only written to before they
+	are put on a list, so decoding reads from them without any locking.
+	A handle also keeps references to the last few entries it switched away
+	from, so that alternating output formats or scales do not recompute them.
+*/
+
+#include "mpg123lib_intern.h"
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
+
+#include "debug.h"
+
+struct tab_decwin
+{
+	struct tab_decwin *next;
+	size_t refs;
+	enum optdec type;
+	void (*make)(mpg123_handle *fr);
+	double scale;
+	unsigned char *raw; /* the block with all decwins */
+	real *decwin;
+#ifdef OPT_MMXORSSE
+	float *decwin_mmx;
+	float *decwins;
+#endif
+};
+
+struct tab_layer
+{
+	struct tab_layer *next;
+	size_t refs;
+	real (*gainpow2_func)(mpg123_handle *fr, int i);
+	real* (*table_func)(mpg123_handle *fr, real *table, int m);
+	int sblimit;
+	int down_sample;
+	int longLimit[9][23];
+	int shortLimit[9][14];
+	real gainpow2[256+118+4];
+	real muls[27][64];
+};
+
+static struct tab_decwin *decwin_list = NULL;
+static struct tab_layer *layer_list = NULL;
+
+#ifndef NO_THREADS
+static pthread_mutex_t tab_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void tab_lock(void)
+{
+#ifndef NO_THREADS
+	pthread_mutex_lock(&tab_mutex);
+#endif
+}
+
+static void tab_unlock(void)
+{
+#ifndef NO_THREADS
+	pthread_mutex_unlock(&tab_mutex);
+#endif
+}
+
+/* Everything below assumes the lock being held. */
+
+static void *align64(unsigned char *base)
+{
+	uintptr_t aoff = (uintptr_t)base % 64;
+	return aoff ? base+64-aoff : base;
+}
+
+static void decwin_set(mpg123_handle *fr, struct tab_decwin *t)
+{
+	fr->decwin_tab = t;
+	fr->decwin = t ? t->decwin : NULL;
+#ifdef OPT_MMXORSSE
+	fr->decwin_mmx = t ? t->decwin_mmx : NULL;
+	fr->decwins = t ? t->decwins : NULL;
+#endif
+}
+
+static void decwin_drop(struct tab_decwin *t)
+{
+	struct tab_decwin **tp;
+	if(t == NULL || --t->refs)
+		return;
+	for(tp = &decwin_list; *tp != t; tp = &(*tp)->next)
+		;
+	*tp = t->next;
+	debug1("freeing decwin for scale %g", t->scale);
+	free(t->raw);
+	free(t);
+}
+
+static struct tab_decwin *decwin_new(mpg123_handle *fr, double scale)
+{
+	struct tab_decwin *t;
+	/* All decwins are 512+32 values, the MMX ones want 32 byte alignment,
+	   which is ensured manually (64 bytes for matching cache lines). */
+	size_t size = (512+32)*sizeof(real) + 63;
+#ifdef OPT_MMXORSSE
+#ifdef OPT_MULTI
+	if(fr->cpu_opts.class == mmxsse)
+	{
+#endif
+		/* decwin_mmx will share, decwins will be appended ...
+		   (512+32)*4 == 2176 == 34*64, so one decwin block retains alignment */
+		if(size < (512+32)*4 + 63) size = (512+32)*4 + 63;
+		size += (512+32)*4;
+#ifdef OPT_MULTI
+	}
+#endif
+#endif
+#if defined(OPT_ALTIVEC) || defined(OPT_ARM)
+	/* sizeof(real) >= 4 ... yes, it could be 8, for example. */
+	size += 512*sizeof(real);
+#endif
+	t = malloc(sizeof(*t));
+	if(t == NULL)
+		return NULL;
+	t->raw = malloc(size);
+	if(t->raw == NULL)
+	{
+		free(t);
+		return NULL;
+	}
+	t->refs = 0;
+	t->type = fr->cpu_opts.type;
+	t->make = fr->make_decode_tables;
+	t->scale = scale;
+	t->decwin = align64(t->raw);
+#ifdef OPT_MMXORSSE
+	t->decwin_mmx = (float*)t->decwin;
+	t->decwins = t->decwin_mmx+512+32;
+#endif
+	/* The table functions work on the handle. */
+	decwin_set(fr, t);
+	fr->make_decode_tables(fr);
+	t->next = decwin_list;
+	decwin_list = t;
+	debug2("new decwin for decoder %i and scale %g", (int)t->type, scale);
+	return t;
+}
+
+/* Put the old current decwin in front of the kept ones and take the new one
+   out, as it is held as the current one now. The reference of the last
+   kept one is dropped if there is no more room. */
+static void decwin_keep( mpg123_handle *fr
+,	struct tab_decwin *old, struct tab_decwin *cur )
+{
+	int i;
+	struct tab_decwin *prev = old;
+
+	if(old == cur)
+	{
+		decwin_drop(old);
+		return;
+	}
+	for(i=0; i<TAB_KEEP && prev != cur; ++i)
+	{
+		struct tab_decwin *t = fr->decwin_keep[i];
+		fr->decwin_keep[i] = prev;
+		prev = t;
+	}
+	/* Either the new current one or the one falling off the end. */
+	decwin_drop(prev);
+}
+
+int tab_decwin(mpg123_handle *fr, double scale)
+{
+	struct tab_decwin *t;
+	struct tab_decwin *old = fr->decwin_tab;
+
+	tab_lock();
+	for(t = decwin_list; t != NULL; t = t->next)
+	{
+		if( t->type == fr->cpu_opts.type && t->make == fr->make_decode_tables
+		&&	t->scale == scale )
+			break;
+	}
+	if(t == NULL)
+		t = decwin_new(fr, scale);
+	if(t != NULL)
+	{
+		++t->refs;
+		decwin_keep(fr, old, t);
+	}
+	decwin_set(fr, t != NULL ? t : old);
+	tab_unlock();
+	return t != NULL ? 0 : -1;
+}
+
+static void layer_set(mpg123_handle *fr, struct tab_layer *t)
+{
+	fr->layer_tab = t;
+	fr->longLimit = t ? t->longLimit : NULL;
+	fr->shortLimit = t ? t->shortLimit : NULL;
+	fr->gainpow2 = t ? t->gainpow2 : NULL;
+	fr->muls = t ? t->muls : NULL;
+}
+
+static void layer_drop(struct tab_layer *t)
+{
+	struct tab_layer **tp;
+	if(t == NULL || --t->refs)
+		return;
+	for(tp = &layer_list; *tp != t; tp = &(*tp)->next)
+		;
+	*tp = t->next;
+	free(t);
+}
+
+/* Same as decwin_keep(). */
+static void layer_keep( mpg123_handle *fr
+,	struct tab_layer *old, struct tab_layer *cur )
+{
+	int i;
+	struct tab_layer *prev = old;
+
+	if(old == cur)
+	{
+		layer_drop(old);
+		return;
+	}
+	for(i=0; i<TAB_KEEP && prev != cur; ++i)
+	{
+		struct tab_layer *t = fr->layer_keep[i];
+		fr->layer_keep[i] = prev;
+		prev = t;
+	}
+	layer_drop(prev);
+}
+
+int tab_layer( mpg123_handle *fr, real (*gainpow2)(mpg123_handle *fr, int i)
+,	real* (*init_table)(mpg123_handle *fr, real *table, int m) )
+{
+	struct tab_layer *t;
+	struct tab_layer *old = fr->layer_tab;
+
+	tab_lock();
+	for(t = layer_list; t != NULL; t = t->next)
+	{
+		if( t->gainpow2_func == gainpow2 && t->table_func == init_table
+		&&	t->sblimit == fr->down_sample_sblimit
+		&&	t->down_sample == fr->p.down_sample )
+			break;
+	}
+	if(t == NULL && (t = malloc(sizeof(*t))) != NULL)
+	{
+		t->refs = 0;
+		t->gainpow2_func = gainpow2;
+		t->table_func = init_table;
+		t->sblimit = fr->down_sample_sblimit;
+		t->down_sample = fr->p.down_sample;
+		layer_set(fr, t);
+#ifndef NO_LAYER3
+		init_layer3_stuff(fr, gainpow2);
+#endif
+#ifndef NO_LAYER12
+		init_layer12_stuff(fr, init_table);
+#endif
+		t->next = layer_list;
+		layer_list = t;
+		debug1("new layer tables for sblimit %i", t->sblimit);
+	}
+	if(t != NULL)
+	{
+		++t->refs;
+		layer_keep(fr, old, t);
+	}
+	layer_set(fr, t != NULL ? t : old);
+	tab_unlock();
+	return t != NULL ? 0 : -1;
+}
+
+void tab_release(mpg123_handle *fr)
+{
+	int i;
+	if(fr->decwin_tab == NULL && fr->layer_tab == NULL)
+		return;
+	tab_lock();
+	decwin_drop(fr->decwin_tab);
+	decwin_set(fr, NULL);
+	layer_drop(fr->layer_tab);
+	layer_set(fr, NULL);
+	for(i=0; i<TAB_KEEP; ++i)
+	{
+		decwin_drop(fr->decwin_keep[i]);
+		fr->decwin_keep[i] = NULL;
+		layer_drop(fr->layer_keep[i]);
+		fr->layer_keep[i] = NULL;
+	}
+	tab_unlock();
+}
@@ -0,0 +1,33 @@
+#ifndef MPG123_H_TABSHARE
+#define MPG123_H_TABSHARE
+
+/*
+	tabshare: decoding tables shared between handles
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+/* The entries themselves are private to tabshare.c. */
+struct tab_decwin;
+struct tab_layer;
+
+/* Each handle holds on to this many tables it used before, besides the
+   current ones, so that a stream switching formats back and forth (or
+   volume going up and down again) finds them ready. */
+#define TAB_KEEP 3
+
+/* Point fr->decwin (and the MMX/SSE variants) to a synth window for the
+   given output scale, made by fr->make_decode_tables if no other handle
+   with the same decoder has it yet. Returns 0 on success, -1 if out of
+   memory, in which case the old tables are kept. */
+int tab_decwin(mpg123_handle *fr, double scale);
+/* Same for the layer tables: fr->gainpow2, fr->longLimit and fr->shortLimit
+   as made by init_layer3_stuff() and fr->muls as made by init_layer12_stuff()
+   with the given functions for the current downsampling setup. */
+int tab_layer( mpg123_handle *fr, real (*gainpow2)(mpg123_handle *fr, int i)
+,	real* (*init_table)(mpg123_handle *fr, real *table, int m) );
+/* Let go of any shared tables of this handle, including the kept ones. */
+void tab_release(mpg123_handle *fr);
+
+#endif
@@ -0,0 +1,418 @@
+/*
+	threads: a work-stealing pool of threads for the parallel features
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	mpg123_decode_parallel() and the parallel scan cut their work into
+	tasks for one pool instead of starting threads of their own, so that
+	they, nested in each other or going on for several handles at once,
+	share a fixed number of threads. Each worker has a queue of its own,
+	where the tasks added by the tasks it runs go. It takes the newest task
+	from there (the one with the data still in cache) and, when that is
+	empty, steals the oldest from the queue of tasks added from outside or
+	from the other workers. A thread waiting for a group of tasks runs
+	queued tasks meanwhile, so a task that waits for tasks does not take a
+	thread away. The waiting thread counts as one of the pool, which thus
+	starts one worker less than its size.
+
+	The queues share one lock, which is fine for tasks like decoding a
+	piece of a track. Instead of its own threads, a pool can hand tasks to
+	an executor of the application, which has to run them at some point.
+*/
+
+#include "mpg123lib_intern.h"
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
+#include "threads.h"
+
+#include "debug.h"
+
+/* When the number of CPUs is unknown. */
+#define DEFAULT_THREADS 2
+
+struct task
+{
+	void (*run)(void *arg);
+	void *arg;
+	struct task_group *group;
+};
+
+/* A ring of tasks, growing when full. */
+struct task_queue
+{
+	struct task *t;
+	size_t size;
+	size_t first;
+	size_t fill;
+	mpg123_threads *pool;
+};
+
+struct mpg123_threads_struct
+{
+	int count; /* tasks running at once, including a waiting thread */
+	int (*submit)(void *ctx, void (*task)(void *), void *arg);
+	void *ctx;
+#ifndef NO_THREADS
+	pthread_mutex_t lock;
+	pthread_cond_t wake; /* new tasks, finished tasks, the end */
+	pthread_key_t self; /* the queue of a worker thread */
+	pthread_t *tid;
+	int started;
+	struct task_queue *queue; /* [0] from outside, then the workers */
+	size_t queued; /* in all queues */
+	int quit;
+#endif
+};
+
+static int online_cpus(void)
+{
+	long n = -1;
+#if !defined(NO_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return n > 0 && n < INT_MAX ? (int)n : DEFAULT_THREADS;
+}
+
+#ifndef NO_THREADS
+
+static int queue_push(struct task_queue *q, struct task *t)
+{
+	if(q->fill == q->size)
+	{
+		size_t newsize = q->size ? 2*q->size : 16;
+		struct task *nt = malloc(newsize*sizeof(*nt));
+		size_t i;
+		if(nt == NULL)
+			return -1;
+		for(i=0; i<q->fill; ++i)
+			nt[i] = q->t[(q->first+i)%q->size];
+		free(q->t);
+		q->t = nt;
+		q->size = newsize;
+		q->first = 0;
+	}
+	q->t[(q->first+q->fill++)%q->size] = *t;
+	return 0;
+}
+
+/* Take a task with the pool locked: the newest of the own queue, else the
+   oldest of any other. */
+static int take(mpg123_threads *pool, struct task_queue *own, struct task *t)
+{
+	int i;
+
+	if(!pool->queued)
+		return 0;
+	if(own && own->fill)
+	{
+		*t = own->t[(own->first + --own->fill)%own->size];
+		--pool->queued;
+		return 1;
+	}
+	for(i=0; i<pool->count; ++i)
+	{
+		struct task_queue *q = &pool->queue[i];
+		if(q->fill)
+		{
+			*t = q->t[q->first];
+			q->first = (q->first+1)%q->size;
+			--q->fill;
+			--pool->queued;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Run a task taken with the pool locked, which it is again afterwards. */
+static void run_locked(mpg123_threads *pool, struct task *t)
+{
+	pthread_mutex_unlock(&pool->lock);
+	t->run(t->arg);
+	pthread_mutex_lock(&pool->lock);
+	--t->group->pending;
+	pthread_cond_broadcast(&pool->wake);
+}
+
+static void *worker(void *arg)
+{
+	struct task_queue *own = arg;
+	mpg123_threads *pool = own->pool;
+	struct task t;
+
+	pthread_setspecific(pool->self, own);
+	pthread_mutex_lock(&pool->lock);
+	while(!pool->quit)
+	{
+		if(take(pool, own, &t))
+			run_locked(pool, &t);
+		else
+			pthread_cond_wait(&pool->wake, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/* Tasks handed to the executor carry their group along. */
+static void executor_task(void *arg)
+{
+	struct task *t = arg;
+	mpg123_threads *pool = t->group->pool;
+
+	t->run(t->arg);
+	pthread_mutex_lock(&pool->lock);
+	--t->group->pending;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	free(t);
+}
+
+#endif
+
+static mpg123_threads *threads_new( int count
+,	int (*submit)(void *ctx, void (*task)(void *), void *arg), void *ctx
+,	int *error )
+{
+	mpg123_threads *pool = malloc(sizeof(*pool));
+	int err = MPG123_OK;
+
+	if(pool == NULL)
+	{
+		if(error != NULL) *error = MPG123_OUT_OF_MEM;
+		return NULL;
+	}
+	pool->count = count > 0 ? count : online_cpus();
+	pool->submit = submit;
+	pool->ctx = ctx;
+#ifdef NO_THREADS
+	/* Everything is done by the thread waiting for it. */
+	pool->count = 1;
+#else
+	pool->tid = NULL;
+	pool->started = 0;
+	pool->queued = 0;
+	pool->quit = 0;
+	pool->queue = submit ? NULL : calloc(pool->count, sizeof(*pool->queue));
+	if(!submit && pool->queue == NULL)
+	{
+		free(pool);
+		if(error != NULL) *error = MPG123_OUT_OF_MEM;
+		return NULL;
+	}
+	if(pthread_mutex_init(&pool->lock, NULL))
+	{
+		free(pool->queue);
+		free(pool);
+		if(error != NULL) *error = MPG123_ERR;
+		return NULL;
+	}
+	if(pthread_cond_init(&pool->wake, NULL))
+	{
+		pthread_mutex_destroy(&pool->lock);
+		free(pool->queue);
+		free(pool);
+		if(error != NULL) *error = MPG123_ERR;
+		return NULL;
+	}
+	if(!submit && pthread_key_create(&pool->self, NULL))
+	{
+		pthread_cond_destroy(&pool->wake);
+		pthread_mutex_destroy(&pool->lock);
+		free(pool->queue);
+		free(pool);
+		if(error != NULL) *error = MPG123_ERR;
+		return NULL;
+	}
+	if(!submit)
+	{
+		int i;
+		for(i=0; i<pool->count; ++i)
+			pool->queue[i].pool = pool;
+		if(pool->count > 1)
+		{
+			pool->tid = malloc(sizeof(pthread_t)*(pool->count-1));
+			if(pool->tid == NULL)
+				err = MPG123_OUT_OF_MEM;
+		}
+		/* The waiting thread works on queue 0 with the tasks from outside. */
+		for(i=1; err == MPG123_OK && i<pool->count; ++i)
+		{
+			if(pthread_create( &pool->tid[pool->started], NULL
+			,	worker, &pool->queue[i] ))
+				break;
+			++pool->started;
+		}
+		/* Less threads than asked for are still a working pool. */
+		if(err == MPG123_OK && pool->started+1 < pool->count)
+		{
+			debug2( "started only %d of %d workers"
+			,	pool->started, pool->count-1 );
+			pool->count = pool->started+1;
+		}
+		if(err != MPG123_OK)
+		{
+			mpg123_threads_delete(pool);
+			pool = NULL;
+		}
+	}
+#endif
+	if(error != NULL) *error = err;
+	return pool;
+}
+
+mpg123_threads attribute_align_arg *mpg123_threads_new(int count, int *error)
+{
+	return threads_new(count, NULL, NULL, error);
+}
+
+mpg123_threads attribute_align_arg *mpg123_threads_executor( int count
+,	int (*submit)(void *ctx, void (*task)(void *), void *arg), void *ctx
+,	int *error )
+{
+	if(submit == NULL)
+	{
+		if(error != NULL) *error = MPG123_BAD_PARS;
+		return NULL;
+	}
+	return threads_new(count, submit, ctx, error);
+}
+
+void attribute_align_arg mpg123_threads_delete(mpg123_threads *pool)
+{
+	if(pool == NULL)
+		return;
+#ifndef NO_THREADS
+	if(!pool->submit)
+	{
+		int i;
+		pthread_mutex_lock(&pool->lock);
+		pool->quit = 1;
+		pthread_cond_broadcast(&pool->wake);
+		pthread_mutex_unlock(&pool->lock);
+		for(i=0; i<pool->started; ++i)
+			pthread_join(pool->tid[i], NULL);
+		pthread_key_delete(pool->self);
+		for(i=0; i<pool->count; ++i)
+			free(pool->queue[i].t);
+		free(pool->queue);
+		free(pool->tid);
+	}
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+#endif
+	free(pool);
+}
+
+int attribute_align_arg mpg123_use_threads( mpg123_handle *mh
+,	mpg123_threads *pool )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	mh->threads = pool;
+	return MPG123_OK;
+}
+
+/* The default pool lives as long as the process. */
+static mpg123_threads *default_pool = NULL;
+#ifndef NO_THREADS
+static pthread_mutex_t default_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+mpg123_threads *threads_of(mpg123_handle *fr)
+{
+	mpg123_threads *pool;
+
+	if(fr->threads)
+		return fr->threads;
+#ifndef NO_THREADS
+	pthread_mutex_lock(&default_lock);
+#endif
+	if(default_pool == NULL)
+		default_pool = threads_new(0, NULL, NULL, NULL);
+	pool = default_pool;
+#ifndef NO_THREADS
+	pthread_mutex_unlock(&default_lock);
+#endif
+	return pool;
+}
+
+int threads_count(mpg123_threads *pool)
+{
+	return pool ? pool->count : 1;
+}
+
+void task_group_init(struct task_group *g, mpg123_threads *pool)
+{
+	g->pool = pool;
+	g->pending = 0;
+}
+
+void task_add(struct task_group *g, void (*task)(void *), void *arg)
+{
+#ifndef NO_THREADS
+	mpg123_threads *pool = g->pool;
+	struct task t;
+
+	t.run = task;
+	t.arg = arg;
+	t.group = g;
+	if(pool && pool->submit)
+	{
+		struct task *et = malloc(sizeof(*et));
+		if(et != NULL)
+		{
+			*et = t;
+			pthread_mutex_lock(&pool->lock);
+			++g->pending;
+			pthread_mutex_unlock(&pool->lock);
+			if(!pool->submit(pool->ctx, executor_task, et))
+				return;
+			/* Refused, so it is ours to run. */
+			executor_task(et);
+			return;
+		}
+	}
+	else if(pool && pool->started)
+	{
+		struct task_queue *q = pthread_getspecific(pool->self);
+		int queued;
+		pthread_mutex_lock(&pool->lock);
+		if(q == NULL)
+			q = &pool->queue[0];
+		queued = !queue_push(q, &t);
+		if(queued)
+		{
+			++g->pending;
+			++pool->queued;
+			pthread_cond_broadcast(&pool->wake);
+		}
+		pthread_mutex_unlock(&pool->lock);
+		if(queued)
+			return;
+	}
+#endif
+	task(arg);
+}
+
+void task_wait(struct task_group *g)
+{
+#ifndef NO_THREADS
+	mpg123_threads *pool = g->pool;
+	struct task_queue *own;
+	struct task t;
+
+	if(pool == NULL)
+		return;
+	own = pool->submit ? NULL : pthread_getspecific(pool->self);
+	pthread_mutex_lock(&pool->lock);
+	while(g->pending)
+	{
+		if(!pool->submit && take(pool, own, &t))
+			run_locked(pool, &t);
+		else
+			pthread_cond_wait(&pool->wake, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+#endif
+}
@@ -0,0 +1,32 @@
+#ifndef MPG123_H_THREADS
+#define MPG123_H_THREADS
+
+/*
+	threads: the pool of threads for the parallel features
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+/* Tasks that someone waits for together. */
+struct task_group
+{
+	mpg123_threads *pool;
+	size_t pending; /* tasks not finished yet, guarded by the pool */
+};
+
+/* The pool set via mpg123_use_threads(), else the default one of the
+   library (created on first use). NULL if that could not be created. */
+mpg123_threads *threads_of(mpg123_handle *fr);
+/* How many tasks can run at once (1 for a NULL pool). */
+int threads_count(mpg123_threads *pool);
+
+void task_group_init(struct task_group *g, mpg123_threads *pool);
+/* Run task(arg) as part of the group, right away in this thread if it
+   cannot be queued. */
+void task_add(struct task_group *g, void (*task)(void *), void *arg);
+/* Return when all tasks of the group are finished, running queued tasks
+   in the meantime. */
+void task_wait(struct task_group *g);
+
+#endif
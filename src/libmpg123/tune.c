@@ -0,0 +1,253 @@
+/*
+	tune: find the fastest decoder by timing them
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The fixed order of preference in frame_cpu_opt() is not always right:
+	AVX code can lose against SSE when the CPU clocks down for it, and an
+	old decoder may just be better tuned for some core. With the decoder
+	name "fastest", set_synth_functions() asks fastest_decoder() for the
+	output format at hand. That one decodes a synthetic Layer I stream
+	with each supported decoder on a private handle and remembers the
+	winner for the format, so the timing happens once per format and
+	process. Layer I keeps the work in the synth functions, which is what
+	most decoders differ in. Dithered decoders change the output and are
+	not considered.
+*/
+
+#include "mpg123lib_intern.h"
+#include <time.h>
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
+
+#include "debug.h"
+
+#if (defined OPT_MULTI) && !(defined NO_LAYER1) && !(defined NO_FEEDER)
+
+/* 44.1 kHz stereo at 384 kbit/s, 416 bytes with header. */
+#define TUNE_FRAMESIZE 416
+#define TUNE_FRAMES 16
+/* Minimum measuring time per round and the number of rounds. */
+#define TUNE_TICKS (CLOCKS_PER_SEC/100)
+#define TUNE_ROUNDS 3
+#define TUNE_MAXDEC 32
+
+static const char *fastest[f_limit];
+#ifndef NO_THREADS
+static pthread_mutex_t tune_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+struct bitwriter
+{
+	unsigned char *data;
+	size_t bit;
+};
+
+static void put_bits(struct bitwriter *bw, unsigned int val, int count)
+{
+	while(count--)
+	{
+		if(val & (1u<<count))
+			bw->data[bw->bit>>3] |= 0x80 >> (bw->bit & 7);
+		++bw->bit;
+	}
+}
+
+/* A frame with 3 bits for each sample in each subband and pseudo-random
+   scalefactors and samples. The all-ones sample code is not used. */
+static void synthetic_frame(unsigned char *frame, unsigned long *seed)
+{
+	struct bitwriter bw;
+	int sb, ch, s;
+
+	memset(frame, 0, TUNE_FRAMESIZE);
+	bw.data = frame;
+	bw.bit = 0;
+	put_bits(&bw, 0xffffc000, 32);
+	for(sb=0; sb<SBLIMIT; ++sb)
+		for(ch=0; ch<2; ++ch)
+			put_bits(&bw, 2, 4);
+	for(sb=0; sb<SBLIMIT; ++sb)
+		for(ch=0; ch<2; ++ch)
+		{
+			*seed = *seed * 1103515245UL + 12345UL;
+			put_bits(&bw, 8 + (*seed >> 16) % 40, 6);
+		}
+	for(s=0; s<12; ++s)
+		for(sb=0; sb<SBLIMIT; ++sb)
+			for(ch=0; ch<2; ++ch)
+			{
+				*seed = *seed * 1103515245UL + 12345UL;
+				put_bits(&bw, (*seed >> 16) % 7, 3);
+			}
+}
+
+static int tune_encoding(enum synth_format format)
+{
+	switch(format)
+	{
+#ifndef NO_8BIT
+		case f_8:    return MPG123_ENC_SIGNED_8;
+#endif
+#ifndef NO_REAL
+		case f_real:
+#ifdef REAL_IS_DOUBLE
+			return MPG123_ENC_FLOAT_64;
+#else
+			return MPG123_ENC_FLOAT_32;
+#endif
+#endif
+#ifndef NO_32BIT
+		case f_32:   return MPG123_ENC_SIGNED_32;
+#endif
+		default:     return MPG123_ENC_SIGNED_16;
+	}
+}
+
+static mpg123_handle *tune_handle(const char *decoder, int encoding)
+{
+	mpg123_handle *mh = mpg123_new(decoder, NULL);
+	if(mh == NULL)
+		return NULL;
+	if(  mpg123_param(mh, MPG123_FLAGS, MPG123_QUIET, 0.) != MPG123_OK
+	  || mpg123_format_none(mh) != MPG123_OK
+	  || mpg123_format(mh, 44100, MPG123_STEREO, encoding) != MPG123_OK
+	  || mpg123_open_feed(mh) != MPG123_OK )
+	{
+		mpg123_delete(mh);
+		return NULL;
+	}
+	return mh;
+}
+
+/* Feed and decode the stream once, returning the number of frames or -1. */
+static long tune_batch(mpg123_handle *mh, unsigned char *stream)
+{
+	long frames = 0;
+	off_t num;
+	unsigned char *audio;
+	size_t bytes;
+	int ret;
+
+	if(mpg123_feed(mh, stream, TUNE_FRAMES*TUNE_FRAMESIZE) != MPG123_OK)
+		return -1;
+	while((ret = mpg123_decode_frame(mh, &num, &audio, &bytes)) != MPG123_NEED_MORE)
+	{
+		if(ret == MPG123_OK)
+			++frames;
+		else if(ret != MPG123_NEW_FORMAT)
+			return -1;
+	}
+	return frames;
+}
+
+/* Time per frame in clock ticks, negative on error. */
+static double tune_measure(mpg123_handle *mh, unsigned char *stream)
+{
+	long frames = 0;
+	clock_t start = clock();
+	clock_t now;
+
+	do
+	{
+		long got = tune_batch(mh, stream);
+		if(got < 0)
+			return -1.;
+		frames += got;
+		now = clock();
+	} while(now - start < TUNE_TICKS || frames == 0);
+
+	return (double)(now - start)/frames;
+}
+
+static const char *find_fastest(enum synth_format format)
+{
+	const char **decoders = mpg123_supported_decoders();
+	int best = -1;
+	mpg123_handle *mh[TUNE_MAXDEC];
+	double cost[TUNE_MAXDEC];
+	unsigned char *stream;
+	unsigned long seed = 1;
+	int encoding = tune_encoding(format);
+	int count, i, round;
+
+	for(count=0; count<TUNE_MAXDEC && decoders[count] != NULL; ++count)
+		mh[count] = NULL;
+	stream = malloc(TUNE_FRAMES*TUNE_FRAMESIZE);
+	if(stream == NULL)
+		return NULL;
+	for(i=0; i<TUNE_FRAMES; ++i)
+		synthetic_frame(stream+i*TUNE_FRAMESIZE, &seed);
+
+	for(i=0; i<count; ++i)
+	{
+		enum optdec type = dectype(decoders[i]);
+		cost[i] = -1.;
+		if(type == generic_dither || type == ifuenf_dither)
+			continue;
+		mh[i] = tune_handle(decoders[i], encoding);
+		/* One batch to warm up caches and to get the format set up. */
+		if(mh[i] != NULL && tune_batch(mh[i], stream) < 0)
+		{
+			mpg123_delete(mh[i]);
+			mh[i] = NULL;
+		}
+	}
+	/* Interleaving the rounds evens out disturbances from outside. */
+	for(round=0; round<TUNE_ROUNDS; ++round)
+		for(i=0; i<count; ++i)
+		{
+			double c;
+			if(mh[i] == NULL)
+				continue;
+			c = tune_measure(mh[i], stream);
+			if(c < 0.)
+			{
+				mpg123_delete(mh[i]);
+				mh[i] = NULL;
+				cost[i] = -1.;
+			}
+			else if(cost[i] < 0. || c < cost[i])
+				cost[i] = c;
+		}
+	for(i=0; i<count; ++i)
+	{
+		if(mh[i] == NULL)
+			continue;
+		debug2("tune: %s %g", decoders[i], cost[i]);
+		if(best < 0 || cost[i] < cost[best])
+			best = i;
+		mpg123_delete(mh[i]);
+	}
+	free(stream);
+	return best < 0 ? NULL : decoders[best];
+}
+
+const char *fastest_decoder(int format)
+{
+	const char *dec;
+
+	if(format < 0 || format >= f_limit)
+		return NULL;
+#ifndef NO_THREADS
+	pthread_mutex_lock(&tune_lock);
+#endif
+	if(fastest[format] == NULL)
+		fastest[format] = find_fastest((enum synth_format)format);
+	dec = fastest[format];
+#ifndef NO_THREADS
+	pthread_mutex_unlock(&tune_lock);
+#endif
+	return dec;
+}
+
+#else
+
+const char *fastest_decoder(int format)
+{
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,370 @@
+/*
+	uring: asynchronous read-ahead via Linux io_uring
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	With MPG123_URING set, a regular file opened by mpg123_open() or
+	mpg123_open_fd() (without replaced reader functions) is read through an
+	io_uring with four requests of a quarter of that size in flight, at
+	consecutive offsets. The parser takes the data in order, handing each
+	consumed block back for the next read. With MPG123_NONBLOCK, a block
+	still in flight is reported as EAGAIN instead of waited for, so that
+	the decoder returns MPG123_NEED_MORE and the ring descriptor (see
+	MPG123_POLL_FD) can be polled for completions.
+
+	This talks to the kernel directly, without liburing. A seek waits for
+	the requests in flight and starts anew at the target.
+*/
+
+#include "mpg123lib_intern.h"
+
+#ifdef HAVE_IO_URING
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <errno.h>
+
+#include "debug.h"
+
+#define URING_SLOTS 4
+
+struct uring_slot
+{
+	unsigned char *data;
+	struct iovec iov;
+	off_t off;  /* file offset of the data */
+	size_t fill; /* bytes read */
+	size_t pos;  /* bytes consumed */
+	int pending;
+	int res;     /* read result, negative errno */
+};
+
+struct uring
+{
+	int fd; /* the ring */
+	int file;
+	ssize_t (*read)(mpg123_handle *, void *, size_t); /* the fdread before */
+	size_t block;
+	/* Mapped ring parts. */
+	void *sq_map, *cq_map;
+	size_t sq_maplen, cq_maplen;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	struct uring_slot slot[URING_SLOTS];
+	int head;     /* slot with the next data */
+	int pending;  /* requests in flight */
+	off_t next;   /* offset for the next request */
+	int eof;
+	int nowait;
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned complete, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, submit, complete, flags, NULL, 0);
+}
+
+static void uring_free(struct uring *ur)
+{
+	int i;
+	if(ur->sqes != NULL)
+		munmap(ur->sqes, ur->sqes_len);
+	if(ur->cq_map != NULL && ur->cq_map != ur->sq_map)
+		munmap(ur->cq_map, ur->cq_maplen);
+	if(ur->sq_map != NULL)
+		munmap(ur->sq_map, ur->sq_maplen);
+	if(ur->fd >= 0)
+		close(ur->fd);
+	for(i=0; i<URING_SLOTS; ++i)
+		if(ur->slot[i].data != NULL)
+			free(ur->slot[i].data);
+	free(ur);
+}
+
+/* Queue a read into the slot and tell the kernel. */
+static int uring_submit(struct uring *ur, int s)
+{
+	struct uring_slot *sl = &ur->slot[s];
+	unsigned tail = *ur->sq_tail;
+	unsigned idx = tail & *ur->sq_mask;
+	struct io_uring_sqe *sqe = &ur->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sl->iov.iov_base = sl->data;
+	sl->iov.iov_len  = ur->block;
+	sl->off  = ur->next;
+	sl->fill = sl->pos = 0;
+	sl->res  = 0;
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = ur->file;
+	sqe->off = (uint64_t)sl->off;
+	sqe->addr = (uint64_t)(uintptr_t)&sl->iov;
+	sqe->len = 1;
+	sqe->user_data = (uint64_t)s;
+	ur->sq_array[idx] = idx;
+	__atomic_store_n(ur->sq_tail, tail+1, __ATOMIC_RELEASE);
+	if(sys_enter(ur->fd, 1, 0, 0) != 1)
+		return -1;
+	sl->pending = 1;
+	++ur->pending;
+	ur->next += (off_t)ur->block;
+	return 0;
+}
+
+/* Collect completions, waiting for at least one if asked to. */
+static int uring_reap(struct uring *ur, int wait)
+{
+	unsigned head;
+	if(wait && ur->pending)
+	{
+		while(  __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE) == *ur->cq_head
+		     && sys_enter(ur->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 )
+			if(errno != EINTR)
+				return -1;
+	}
+	head = *ur->cq_head;
+	while(head != __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE))
+	{
+		struct io_uring_cqe *cqe = &ur->cqes[head & *ur->cq_mask];
+		struct uring_slot *sl;
+		if(cqe->user_data < URING_SLOTS)
+		{
+			sl = &ur->slot[cqe->user_data];
+			sl->res = cqe->res;
+			sl->fill = cqe->res > 0 ? (size_t)cqe->res : 0;
+			sl->pending = 0;
+			--ur->pending;
+		}
+		++head;
+	}
+	__atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Forget all data and start reading at the given offset. */
+static int uring_restart(struct uring *ur, off_t off)
+{
+	int i;
+	while(ur->pending)
+		if(uring_reap(ur, 1))
+			return -1;
+	ur->next = off;
+	ur->head = 0;
+	ur->eof  = 0;
+	for(i=0; i<URING_SLOTS; ++i)
+		if(uring_submit(ur, i))
+			return -1;
+	return 0;
+}
+
+int uring_start(mpg123_handle *fr)
+{
+	struct uring *ur;
+	struct io_uring_params p;
+	struct stat st;
+	int i;
+
+	if(  fr->p.uring <= 0 || fr->rdat.uring != NULL
+	  || (fr->rdat.flags & (READER_HANDLEIO|READER_MAPPED|READER_PREFETCH))
+	  || fr->rdat.r_read != NULL || fr->rdat.r_lseek != NULL )
+		return 0;
+	if(fstat(fr->rdat.filept, &st) || !S_ISREG(st.st_mode))
+		return 0;
+	ur = malloc(sizeof(*ur));
+	if(ur == NULL)
+		return -1;
+	memset(ur, 0, sizeof(*ur));
+	ur->fd    = -1;
+	ur->file  = fr->rdat.filept;
+	ur->block = fr->p.uring/URING_SLOTS ? fr->p.uring/URING_SLOTS : 1;
+	ur->nowait = fr->p.nonblock;
+	for(i=0; i<URING_SLOTS; ++i)
+		if((ur->slot[i].data = malloc(ur->block)) == NULL)
+		{
+			uring_free(ur);
+			return -1;
+		}
+	memset(&p, 0, sizeof(p));
+	ur->fd = sys_setup(URING_SLOTS, &p);
+	if(ur->fd < 0)
+	{
+		/* An old kernel or one that does not let us. Just read normally. */
+		debug1("io_uring_setup failed: %s", strerror(errno));
+		uring_free(ur);
+		return 0;
+	}
+	ur->sq_maplen = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+	ur->cq_maplen = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	if((p.features & IORING_FEAT_SINGLE_MMAP) && ur->cq_maplen > ur->sq_maplen)
+		ur->sq_maplen = ur->cq_maplen;
+	ur->sq_map = mmap( NULL, ur->sq_maplen, PROT_READ|PROT_WRITE
+	,	MAP_SHARED|MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING );
+	if(ur->sq_map == MAP_FAILED)
+		goto start_fail;
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+		ur->cq_map = ur->sq_map;
+	else
+	{
+		ur->cq_map = mmap( NULL, ur->cq_maplen, PROT_READ|PROT_WRITE
+		,	MAP_SHARED|MAP_POPULATE, ur->fd, IORING_OFF_CQ_RING );
+		if(ur->cq_map == MAP_FAILED)
+			goto start_fail;
+	}
+	ur->sqes_len = p.sq_entries*sizeof(struct io_uring_sqe);
+	ur->sqes = mmap( NULL, ur->sqes_len, PROT_READ|PROT_WRITE
+	,	MAP_SHARED|MAP_POPULATE, ur->fd, IORING_OFF_SQES );
+	if(ur->sqes == MAP_FAILED)
+		goto start_fail;
+	ur->sq_head  = (unsigned*)((char*)ur->sq_map + p.sq_off.head);
+	ur->sq_tail  = (unsigned*)((char*)ur->sq_map + p.sq_off.tail);
+	ur->sq_mask  = (unsigned*)((char*)ur->sq_map + p.sq_off.ring_mask);
+	ur->sq_array = (unsigned*)((char*)ur->sq_map + p.sq_off.array);
+	ur->cq_head  = (unsigned*)((char*)ur->cq_map + p.cq_off.head);
+	ur->cq_tail  = (unsigned*)((char*)ur->cq_map + p.cq_off.tail);
+	ur->cq_mask  = (unsigned*)((char*)ur->cq_map + p.cq_off.ring_mask);
+	ur->cqes = (struct io_uring_cqe*)((char*)ur->cq_map + p.cq_off.cqes);
+	if(uring_restart(ur, lseek(ur->file, 0, SEEK_CUR)))
+	{
+		/* Requests in flight would write into freed memory. */
+		while(ur->pending && !uring_reap(ur, 1)) {}
+		goto start_fail;
+	}
+	fr->rdat.uring = ur;
+	ur->read = fr->rdat.fdread;
+	fr->rdat.fdread = uring_read;
+	fr->rdat.flags |= READER_URING;
+	debug2("io_uring reading %i blocks of %lu", URING_SLOTS, (unsigned long)ur->block);
+	return 0;
+start_fail:
+	/* Mark the failed mappings as not there. */
+	if(ur->sq_map == MAP_FAILED) ur->sq_map = NULL;
+	if(ur->cq_map == MAP_FAILED) ur->cq_map = NULL;
+	if(ur->sqes == MAP_FAILED) ur->sqes = NULL;
+	uring_free(ur);
+	return 0;
+}
+
+void uring_stop(mpg123_handle *fr)
+{
+	struct uring *ur = fr->rdat.uring;
+	if(ur == NULL)
+		return;
+	while(ur->pending)
+		if(uring_reap(ur, 1))
+			break;
+	fr->rdat.uring = NULL;
+	fr->rdat.fdread = ur->read;
+	fr->rdat.flags &= ~READER_URING;
+	/* Requests still in flight after an error keep their buffers. */
+	if(!ur->pending)
+		uring_free(ur);
+}
+
+int uring_fd(struct reader_data *rdat)
+{
+	return rdat->uring != NULL ? rdat->uring->fd : -1;
+}
+
+ssize_t uring_read(mpg123_handle *fr, void *buf, size_t count)
+{
+	struct uring *ur = fr->rdat.uring;
+	size_t got = 0;
+
+	while(got < count)
+	{
+		struct uring_slot *sl = &ur->slot[ur->head];
+		size_t n;
+		if(sl->pending && uring_reap(ur, !ur->nowait && !got))
+			return got ? (ssize_t)got : -1;
+		if(sl->pending)
+		{
+			if(got)
+				break;
+			errno = EAGAIN;
+			return -1;
+		}
+		if(sl->res < 0)
+		{
+			errno = -sl->res;
+			/* Try again from there next time. */
+			if(got || uring_restart(ur, sl->off))
+				break;
+			return -1;
+		}
+		if(sl->fill == 0)
+		{
+			ur->eof = 1;
+			break;
+		}
+		n = sl->fill - sl->pos;
+		if(n > count-got)
+			n = count-got;
+		memcpy((unsigned char*)buf+got, sl->data+sl->pos, n);
+		sl->pos += n;
+		got += n;
+		if(sl->pos == sl->fill)
+		{
+			/* A short read that is not the end has a gap behind it. */
+			if(sl->fill < ur->block)
+			{
+				if(uring_restart(ur, sl->off+(off_t)sl->fill))
+					return got ? (ssize_t)got : -1;
+			}
+			else
+			{
+				if(uring_submit(ur, ur->head))
+					return got ? (ssize_t)got : -1;
+				ur->head = (ur->head+1) % URING_SLOTS;
+			}
+		}
+	}
+	return (ssize_t)got;
+}
+
+off_t uring_seek(struct reader_data *rdat, off_t offset, int whence)
+{
+	struct uring *ur = rdat->uring;
+	struct uring_slot *sl = &ur->slot[ur->head];
+	off_t cur = sl->off + (off_t)sl->pos;
+
+	switch(whence)
+	{
+		case SEEK_CUR: offset += cur; break;
+		case SEEK_SET: break;
+		case SEEK_END:
+			offset = lseek(ur->file, offset, SEEK_END);
+			if(offset < 0)
+				return -1;
+		break;
+		default:
+			errno = EINVAL;
+			return -1;
+	}
+	if(offset < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	/* Stay inside the current block. */
+	if(  !sl->pending && sl->res >= 0 && offset >= sl->off
+	  && offset < sl->off + (off_t)sl->fill )
+	{
+		sl->pos = (size_t)(offset - sl->off);
+		return offset;
+	}
+	if(uring_restart(ur, offset))
+		return -1;
+	return offset;
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+	vectors.h: real vectors of four for the generic_vector decoder
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Instead of assembly for each instruction set, the generic_vector decoder
+	uses the vector extensions of GCC and Clang. The compiler maps these to
+	whatever the target offers (SSE, NEON, AltiVec, RVV, WebAssembly SIMD)
+	or falls back to scalar code. Loads and stores go through memcpy() so
+	that no alignment is assumed.
+*/
+
+#ifndef MPG123_VECTORS_H
+#define MPG123_VECTORS_H
+
+#include "mpg123lib_intern.h"
+
+#ifndef REAL_IS_FLOAT
+#error "The vector code only works with single precision floating point."
+#endif
+
+typedef real vreal __attribute__((vector_size(4*sizeof(real))));
+typedef int32_t vint __attribute__((vector_size(4*sizeof(int32_t))));
+
+/* Lane selection out of the eight of a and b (0 to 3 from a, 4 to 7 from b). */
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12)
+#define VSHUF(a, b, i, j, k, l) __builtin_shufflevector((a), (b), i, j, k, l)
+#else
+#define VSHUF(a, b, i, j, k, l) __builtin_shuffle((a), (b), (vint){i, j, k, l})
+#endif
+#define VREV(a) VSHUF((a), (a), 3, 2, 1, 0)
+
+static inline vreal vload(const real *p)
+{
+	vreal v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/* p[3], p[2], p[1], p[0] */
+static inline vreal vload_rev(const real *p)
+{
+	vreal v = vload(p);
+	return VREV(v);
+}
+
+static inline void vstore(real *p, vreal v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline vreal vset(real x)
+{
+	vreal v = { x, x, x, x };
+	return v;
+}
+
+/* Element k of each of a, b, c, d, as the four vectors for k = 0 to 3. */
+#define VTRANSPOSE(a, b, c, d) \
+{ \
+	vreal t0_ = VSHUF((a), (b), 0, 4, 1, 5); \
+	vreal t1_ = VSHUF((a), (b), 2, 6, 3, 7); \
+	vreal t2_ = VSHUF((c), (d), 0, 4, 1, 5); \
+	vreal t3_ = VSHUF((c), (d), 2, 6, 3, 7); \
+	(a) = VSHUF(t0_, t2_, 0, 1, 4, 5); \
+	(b) = VSHUF(t0_, t2_, 2, 3, 6, 7); \
+	(c) = VSHUF(t1_, t3_, 0, 1, 4, 5); \
+	(d) = VSHUF(t1_, t3_, 2, 3, 6, 7); \
+}
+
+#endif
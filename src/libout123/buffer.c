@@ -29,12 +29,21 @@
 
 /* Needed for kill() from signal.h. */
 #define _POSIX_SOURCE
+/* CPU_SET() and friends for sched_setaffinity(). */
+#define _GNU_SOURCE
 
 #include "buffer.h"
 #include "out123_int.h"
 #include "xfermem.h"
 #include <errno.h>
+#include <string.h>
 #include "debug.h"
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
+#ifdef HAVE_MLOCKALL
+#include <sys/mman.h>
+#endif
 #ifdef HAVE_SYS_WAIT_H
 #include <sys/wait.h>
 #endif
@@ -55,6 +64,8 @@
 #define BUF_CMD_PARAM    XF_CMD_CUSTOM6
 #define BUF_CMD_NDRAIN   XF_CMD_CUSTOM7
 #define BUF_CMD_AUDIOFMT XF_CMD_CUSTOM8
+#define BUF_CMD_LATENCY  XF_CMD_CUSTOM9
+#define BUF_CMD_STATS    XF_CMD_CUSTOM10
 
 /* TODO: Dynamically allocate that to allow multiple instances. */
 int outburst = 32768;
@@ -72,6 +83,163 @@ static int read_record(out123_handle *ao
 ,	int who, void **buf, byte *prebuf, int *preoff, int presize, size_t *recsize);
 static int buffer_loop(out123_handle *ao);
 
+/* Apply OUT123_CPUMASK, OUT123_RTPRIO and the full memory lock to the
+   buffer, from within the new process or thread. Failures only are
+   reported, the buffer works without. */
+static void buffer_realtime(out123_handle *ao, int thread)
+{
+	if(ao->cpumask)
+	{
+#ifdef HAVE_SCHED_SETAFFINITY
+		cpu_set_t set;
+		unsigned int i;
+		CPU_ZERO(&set);
+		for(i=0; i<sizeof(ao->cpumask)*8; ++i)
+			if((unsigned long)ao->cpumask>>i & 1)
+				CPU_SET(i, &set);
+		/* On Linux, this is about the calling thread only. */
+		if(sched_setaffinity(0, sizeof(set), &set) && !AOQUIET)
+			error1("cannot set buffer CPU affinity: %s", strerror(errno));
+#else
+		if(!AOQUIET)
+			error("no support for setting buffer CPU affinity");
+#endif
+	}
+	if(ao->rtprio)
+	{
+#ifdef HAVE_SCHED_SETSCHEDULER
+		struct sched_param sp;
+		int policy = ao->rtprio > 0 ? SCHED_FIFO : SCHED_RR;
+		int err;
+		memset(&sp, 0, sizeof(sp));
+		sp.sched_priority = ao->rtprio > 0 ? ao->rtprio : -ao->rtprio;
+#ifndef NO_THREADS
+		if(thread)
+			err = pthread_setschedparam(pthread_self(), policy, &sp);
+		else
+#endif
+		err = sched_setscheduler(0, policy, &sp) ? errno : 0;
+		if(err && !AOQUIET)
+			error1("cannot get buffer real-time priority: %s", strerror(err));
+#else
+		if(!AOQUIET)
+			error("no support for buffer real-time priority");
+#endif
+	}
+#ifdef HAVE_MLOCKALL
+	if(!thread && (ao->flags & OUT123_BUFFER_LOCK)
+	&&	mlockall(MCL_CURRENT|MCL_FUTURE) && !AOQUIET)
+		error1("cannot lock buffer process memory: %s", strerror(errno));
+#endif
+}
+
+#ifndef NO_THREADS
+/* The buffer thread works on its own handle, just like the buffer process
+   works on its copy of the writer's handle. Only the xfermem is shared. */
+struct buffer_thread
+{
+	pthread_t id;
+	out123_handle *ao;
+	int ret;
+};
+
+static void *buffer_thread_main(void *arg)
+{
+	struct buffer_thread *bt = arg;
+	txfermem *xf = bt->ao->buffermem;
+
+	buffer_realtime(bt->ao, TRUE);
+	bt->ret = buffer_loop(bt->ao);
+	/* Do not leave the writer waiting for space that never comes, and
+	   let it see the closed channel like that of an exited process. */
+	xfermem_reader_moved(xf, FALSE);
+	xfermem_done_reader(xf);
+	/* Proper cleanup of output handle, including out123_close(). */
+	bt->ao->buffermem = NULL;
+	out123_del(bt->ao);
+	bt->ao = NULL;
+	return NULL;
+}
+
+static int buffer_thread_init(out123_handle *ao)
+{
+	struct buffer_thread *bt;
+
+	if(xfermem_init_threads(ao->buffermem))
+		return -1;
+	bt = malloc(sizeof(*bt));
+	if(!bt)
+		return -1;
+	bt->ret = 0;
+	bt->ao = out123_new();
+	if(!bt->ao || out123_param_from(bt->ao, ao))
+		goto buffer_thread_bad;
+	bt->ao->auxflags = ao->auxflags;
+	bt->ao->flags &= ~(OUT123_CONVERT|OUT123_DRIFT);
+	bt->ao->buffermem = ao->buffermem;
+	if(pthread_create(&bt->id, NULL, buffer_thread_main, bt))
+		goto buffer_thread_bad;
+	ao->buffer_thread = bt;
+	return 0;
+buffer_thread_bad:
+	if(bt->ao)
+	{
+		bt->ao->buffermem = NULL;
+		out123_del(bt->ao);
+	}
+	free(bt);
+	return -1;
+}
+
+static void buffer_thread_exit(out123_handle *ao)
+{
+	struct buffer_thread *bt = ao->buffer_thread;
+
+	debug("ending buffer thread");
+	buffer_stop(ao);
+	buffer_end(ao);
+	pthread_join(bt->id, NULL);
+	xfermem_done_writer(ao->buffermem);
+	xfermem_done(ao->buffermem);
+	ao->buffermem = NULL;
+	ao->buffer_thread = NULL;
+	if(bt->ret && !AOQUIET)
+		error1("Buffer thread isses arose, non-zero return value %i.", bt->ret);
+	free(bt);
+}
+#endif
+
+/* Wait for the greeting of a fresh buffer. */
+static int buffer_hello(out123_handle *ao)
+{
+	int cmd;
+	debug("waiting for inital pong from buffer");
+	if( (cmd=xfermem_getcmd(ao->buffermem->fd[XF_WRITER], TRUE))
+	    != XF_CMD_PONG )
+	{
+		if(!AOQUIET)
+			error2("Got %i instead of expected initial response %i."
+			,	cmd, XF_CMD_PONG);
+		return -1;
+	}
+	return 0;
+}
+
+/* Interrupt the buffer for a command to be handled right away. */
+static void buffer_interrupt(out123_handle *ao)
+{
+#ifndef NO_THREADS
+	if(ao->buffer_thread != NULL)
+	{
+		/* No signal to a thread, the process and its handlers are shared.
+		   The current device write is finished before the command. */
+		ao->buffermem->intflag = TRUE;
+		return;
+	}
+#endif
+	kill(ao->buffer_pid, SIGINT);
+}
+
 static void catch_child(void)
 {
 	/* Disabled for now. We do not really need that.
@@ -92,7 +260,33 @@ int buffer_init(out123_handle *ao, size_t bytes)
 #ifdef DONT_CATCH_SIGNALS
 #error I really need to catch signals here!
 #endif
-	xfermem_init(&ao->buffermem, bytes, 0, 0);
+	{
+		int mode = (ao->flags & OUT123_BUFFER_PREFAULT ? XF_PREFAULT : 0)
+		|	(ao->flags & OUT123_BUFFER_LOCK ? XF_LOCK : 0)
+		|	(ao->flags & OUT123_BUFFER_HUGE ? XF_HUGE : 0);
+		int failed = xfermem_init(&ao->buffermem, bytes, 0, 0, mode);
+		if((failed & XF_HUGE) && !AOQUIET)
+			error("cannot use huge pages for the buffer");
+		if((failed & XF_LOCK) && !AOQUIET)
+			error("cannot lock the buffer in memory");
+	}
+#ifndef NO_THREADS
+	if(ao->flags & OUT123_BUFFER_THREAD)
+	{
+		if(buffer_thread_init(ao))
+		{
+			if(!AOQUIET)
+				error("cannot start buffer thread!");
+			goto buffer_init_bad;
+		}
+		if(buffer_hello(ao))
+		{
+			buffer_exit(ao);
+			return -1;
+		}
+		return 0;
+	}
+#endif
 	/* Is catch_child() really useful? buffer_exit() does waitpid().
 	   And if buffer_exit() is not called, the main process might be
 	   killed off and not be able to run a signal handler anyway. */
@@ -114,6 +308,7 @@ int buffer_init(out123_handle *ao, size_t bytes)
 				is that there shouldn't be special stuff.
 			*/
 			ao->buffer_pid = -1;
+			buffer_realtime(ao, FALSE);
 			/* Not preparing audio output anymore, that comes later. */
 			xfermem_init_reader(ao->buffermem);
 			ret = buffer_loop(ao); /* Here the work happens. */
@@ -125,15 +320,11 @@ int buffer_init(out123_handle *ao, size_t bytes)
 		}
 		default: /* parent */
 		{
-			int cmd;
 			xfermem_init_writer(ao->buffermem);
-			debug("waiting for inital pong from buffer process");
-			if( (cmd=xfermem_getcmd(ao->buffermem->fd[XF_WRITER], TRUE))
-			    != XF_CMD_PONG )
+			if(buffer_hello(ao))
 			{
 				if(!AOQUIET)
-					error2("Got %i instead of expected initial response %i. Killing rogue buffer process."
-					,	cmd, XF_CMD_PONG);
+					error("Killing rogue buffer process.");
 				kill(ao->buffer_pid, SIGKILL);
 				buffer_exit(ao);
 				return -1;
@@ -155,6 +346,13 @@ buffer_init_bad:
 void buffer_exit(out123_handle *ao)
 {
 	int status = 0;
+#ifndef NO_THREADS
+	if(ao->buffer_thread != NULL)
+	{
+		buffer_thread_exit(ao);
+		return;
+	}
+#endif
 	if(ao->buffer_pid == -1) return;
 
 	debug("ending buffer");
@@ -356,7 +554,7 @@ BUFFER_SIMPLE_CONTROL(buffer_close, BUF_CMD_CLOSE)
 #define BUFFER_SIGNAL_CONTROL(name, cmd) \
 void name(out123_handle *ao) \
 { \
-	kill(ao->buffer_pid, SIGINT); \
+	buffer_interrupt(ao); \
 	xfermem_putcmd(ao->buffermem->fd[XF_WRITER], cmd); \
 	xfermem_getcmd(ao->buffermem->fd[XF_WRITER], TRUE); \
 }
@@ -391,6 +589,58 @@ void buffer_ndrain(out123_handle *ao, size_t bytes)
 	buffer_cmd_finish(ao);
 }
 
+int buffer_latency(out123_handle *ao, double *length, size_t *fill)
+{
+	int writerfd = ao->buffermem->fd[XF_WRITER];
+
+	if(xfermem_putcmd(writerfd, BUF_CMD_LATENCY) != 1)
+	{
+		ao->errcode = OUT123_BUFFER_ERROR;
+		return -1;
+	}
+	if(buffer_cmd_finish(ao))
+		return -1;
+	if(
+		!GOOD_READVAL(writerfd, *length)
+	||	!GOOD_READVAL(writerfd, *fill)
+	){
+		ao->errcode = OUT123_BUFFER_ERROR;
+		return -1;
+	}
+	return 0;
+}
+
+int buffer_stats(out123_handle *ao)
+{
+	int writerfd = ao->buffermem->fd[XF_WRITER];
+
+	if(xfermem_putcmd(writerfd, BUF_CMD_STATS) != 1)
+	{
+		ao->errcode = OUT123_BUFFER_ERROR;
+		return -1;
+	}
+	if(buffer_cmd_finish(ao))
+		return -1;
+	if(!GOOD_READVAL(writerfd, ao->stats))
+	{
+		ao->errcode = OUT123_BUFFER_ERROR;
+		return -1;
+	}
+	return 0;
+}
+
+static void buffer_write_error(out123_handle *ao, int ret)
+{
+	if(!AOQUIET)
+		error1("writing to buffer memory failed (%i)", ret);
+	if(ret == XF_CMD_ERROR)
+	{
+		/* Buffer tells me that it has an error waiting. */
+		if(!GOOD_READVAL(ao->buffermem->fd[XF_WRITER], ao->errcode))
+			ao->errcode = OUT123_BUFFER_ERROR;
+	}
+}
+
 /* The workhorse: Send data to the buffer with some synchronization and even
    error checking. */
 size_t buffer_write(out123_handle *ao, void *buffer, size_t bytes)
@@ -411,14 +661,7 @@ size_t buffer_write(out123_handle *ao, void *buffer, size_t bytes)
 		,	(char*)buffer+written, count_piece);
 		if(ret)
 		{
-			if(!AOQUIET)
-				error1("writing to buffer memory failed (%i)", ret);
-			if(ret == XF_CMD_ERROR)
-			{
-				/* Buffer tells me that it has an error waiting. */
-				if(!GOOD_READVAL(ao->buffermem->fd[XF_WRITER], ao->errcode))
-					ao->errcode = OUT123_BUFFER_ERROR;
-			}
+			buffer_write_error(ao, ret);
 			return 0;
 		}
 		bytes   -= count_piece;
@@ -427,6 +670,38 @@ size_t buffer_write(out123_handle *ao, void *buffer, size_t bytes)
 	return written;
 }
 
+int buffer_begin_write(out123_handle *ao, void **region, size_t *bytes)
+{
+	txfermem *xf = ao->buffermem;
+	/* Not more than one piece of buffer_write(). */
+	size_t max_piece = xf->size / 2;
+	int ret;
+
+	if(*bytes > max_piece)
+		*bytes = max_piece - max_piece % ao->framesize;
+	if((ret = xfermem_reserve(xf, *bytes)))
+	{
+		buffer_write_error(ao, ret);
+		return -1;
+	}
+	/* Only this side moves freeindex, the reader keeps off the free space. */
+	if(xf->size - xf->freeindex < *bytes)
+		return 1;
+	*region = xf->data + xf->freeindex;
+	return 0;
+}
+
+size_t buffer_commit_write(out123_handle *ao, size_t bytes)
+{
+	int ret = xfermem_advance(ao->buffermem, bytes);
+	if(ret)
+	{
+		buffer_write_error(ao, ret);
+		return 0;
+	}
+	return bytes;
+}
+
 
 /*
 	Code for the buffer process itself.
@@ -449,23 +724,33 @@ buffer loop:
 
 /*
 	Fill buffer to that value when starting playback from stopped state or after
-	experiencing a serious underrun.
-	One might also define intermediate preload to recover from underruns. Earlier
-	code used 1/8 of the buffer.
+	experiencing a serious underrun. The latter can have an own, usually lower,
+	level (OUT123_REFILLTIME) to get sound back quickly while a drawn-out
+	network hiccup does not make it stutter at every arriving packet.
+	Earlier code used 1/8 of the buffer there.
 */
-static size_t preload_size(out123_handle *ao)
+size_t buffer_preload(out123_handle *ao, size_t byterate, int refill)
 {
 	size_t preload = 0;
 	txfermem *xf = ao->buffermem;
+	double seconds = refill && ao->refill_time > 0.
+	?	ao->refill_time
+	:	ao->preload_time;
 	/* Fill configured part of buffer on first run before starting to play.
 	 * Live mp3 streams constantly approach buffer underrun otherwise. [dk]
 	 */
-	if(ao->preload > 0.)     preload = (size_t)(ao->preload*xf->size);
+	if(seconds > 0.)         preload = (size_t)(seconds*byterate);
+	else if(ao->preload > 0.) preload = (size_t)(ao->preload*xf->size);
 	if(preload > xf->size/2) preload = xf->size/2;
 
 	return preload;
 }
 
+static size_t preload_size(out123_handle *ao, int refill)
+{
+	return buffer_preload(ao, (size_t)ao->rate*ao->framesize, refill);
+}
+
 /* Play one piece of audio from the buffer after settling preload etc.
    On error, the device is closed and this naturally stops playback
    as that depends on ao->state == play_live. 
@@ -601,37 +886,62 @@ int buffer_loop(out123_handle *ao)
 	txfermem *xf = ao->buffermem;
 	int my_fd = xf->fd[XF_READER];
 	int preloading = FALSE;
+	int refilling = FALSE; /* preloading after an underrun */
 	int draining = FALSE;
 	/* The buffer loop maintains a playback state that can differ from
 	   the underlying device's. During prebuffering, the device is paused,
 	   but we are playing (as soon as enough data is there, the device is,
 	   too). */
 	enum playstate mystate = ao->state;
+	volatile int *intp = &intflag;
 
 	ao->flags &= ~OUT123_KEEP_PLAYING; /* No need for that here. */
+	/* The writer side caches the formats, a refresh there has to reach
+	   the device. */
+	ao->fmtcache_on = 0;
+	fmtcache_clear(ao);
+#ifndef NO_THREADS
+	if(xf->threaded)
+		intp = &xf->intflag;
+	else
+#endif
 	/* Be prepared to use SIGINT for communication. */
 	catchsignal (SIGINT, catch_interrupt);
 	/* sigprocmask (SIG_SETMASK, oldsigset, NULL); */
 	/* Say hello to the writer. */
 	xfermem_putcmd(my_fd, XF_CMD_PONG);
 
-	debug1("buffer with preload %g", ao->preload);
+	debug3( "buffer with preload %g, %g s, refill %g s"
+	,	ao->preload, ao->preload_time, ao->refill_time );
 	while(1)
 	{
+		/* Nothing to play while draining, so wait for the writer instead of
+		   spinning, which would starve it with a real-time buffer. */
+		int idle = FALSE;
 		/* If a device is opened and playing, it is our first duty to keep it playing. */
 		if(mystate == play_live)
 		{
 			size_t bytes = xfermem_get_usedspace(xf);
 			debug4( "Play or preload? Got %"SIZE_P" B / %"SIZE_P" B (%i,%i)."
-			,	(size_p)bytes, (size_p)preload_size(ao), preloading, draining );
+			,	(size_p)bytes, (size_p)preload_size(ao, refilling)
+			,	preloading, draining );
 			if(preloading)
-				preloading = (bytes < preload_size(ao));
+				preloading = (bytes < preload_size(ao, refilling));
 			if(!preloading)
 			{
 				if(!draining && bytes < outburst)
-					preloading = TRUE;
+				{
+					preloading = refilling = TRUE;
+					++ao->stats.buffer_underruns;
+					AOPROBE2(buffer_underrun, (long)bytes, ao->stats.buffer_underruns);
+				}
+				else if(bytes < ao->framesize)
+					idle = TRUE;
 				else
 				{
+					if( !draining && (ao->stats.buffer_minfill < 0
+					||	bytes < (size_t)ao->stats.buffer_minfill) )
+						ao->stats.buffer_minfill = (long)bytes;
 					buffer_play(ao, bytes);
 					mystate = ao->state; /* Maybe changed, must be in sync now. */
 				}
@@ -642,7 +952,7 @@ int buffer_loop(out123_handle *ao)
 		}
 		/* Now always check for a pending command, in a blocking way if there is
 		   no playback. */
-		debug2("Buffer cmd? (Interruped: %i) (mystate=%i)", intflag, (int)mystate);
+		debug2("Buffer cmd? (Interruped: %i) (mystate=%i)", *intp, (int)mystate);
 		/*
 			The writer only ever signals before sending a command and also waiting
 			for a response. So, the right place to reset the flag is any time
@@ -659,8 +969,14 @@ int buffer_loop(out123_handle *ao)
 			int cmdcount;
 			int i;
 
+#ifndef NO_THREADS
+			/* Let a waiting writer thread know about free space (or that
+			   it is not going to get any). */
+			if(xf->threaded)
+				xfermem_reader_moved(xf, mystate == play_live && !preloading);
+#endif
 			cmdcount = xfermem_getcmds( my_fd
-			,	(preloading || intflag || (mystate != play_live))
+			,	(preloading || idle || *intp || (mystate != play_live))
 			,	cmd
 			,	sizeof(cmd) );
 			if(cmdcount < 0)
@@ -691,7 +1007,7 @@ int buffer_loop(out123_handle *ao)
 					draining = FALSE;
 				break;
 				case XF_CMD_PING:
-					intflag = FALSE;
+					*intp = FALSE;
 					/* Expecting ping-pong only while playing! Otherwise, the writer
 					   could get stuck waiting for free space forever. */
 					if(mystate == play_live)
@@ -706,7 +1022,7 @@ int buffer_loop(out123_handle *ao)
 					}
 				break;
 				case BUF_CMD_PARAM:
-					intflag = FALSE;
+					*intp = FALSE;
 					/* If that does not work, communication is broken anyway and
 					   writer will notice soon enough. */
 					read_parameters(ao, XF_READER, cmd, &i, cmdcount);
@@ -719,7 +1035,7 @@ int buffer_loop(out123_handle *ao)
 					char *device  = NULL;
 					int success;
 
-					intflag = FALSE;
+					*intp = FALSE;
 					success = (
 						!read_record( ao, XF_READER, (void**)&driver
 						,	cmd, &i, cmdcount, NULL )
@@ -750,7 +1066,7 @@ int buffer_loop(out123_handle *ao)
 				}
 				break;
 				case BUF_CMD_CLOSE:
-					intflag = FALSE;
+					*intp = FALSE;
 					out123_close(ao);
 					draining = FALSE;
 					mystate = ao->state;
@@ -760,7 +1076,7 @@ int buffer_loop(out123_handle *ao)
 				{
 					int encodings;
 
-					intflag = FALSE;
+					*intp = FALSE;
 					if(
 						!GOOD_READVAL_BUF(my_fd, ao->channels)
 					||	!GOOD_READVAL_BUF(my_fd, ao->rate)
@@ -833,7 +1149,7 @@ int buffer_loop(out123_handle *ao)
 				}
 				break;
 				case BUF_CMD_START:
-					intflag = FALSE;
+					*intp = FALSE;
 					draining = FALSE;
 					if(
 						!GOOD_READVAL_BUF(my_fd, ao->format)
@@ -846,6 +1162,7 @@ int buffer_loop(out123_handle *ao)
 						out123_pause(ao); /* Be nice, start only on buffer_play(). */
 						mystate = play_live;
 						preloading = TRUE;
+						refilling = FALSE;
 						xfermem_putcmd(my_fd, XF_CMD_OK);
 					}
 					else
@@ -857,7 +1174,7 @@ int buffer_loop(out123_handle *ao)
 					}
 				break;
 				case BUF_CMD_STOP:
-					intflag = FALSE;
+					*intp = FALSE;
 					if(mystate == play_live)
 					{ /* Drain is implied! */
 						size_t bytes;
@@ -870,7 +1187,7 @@ int buffer_loop(out123_handle *ao)
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 				break;
 				case XF_CMD_CONTINUE:
-					intflag = FALSE;
+					*intp = FALSE;
 					debug("continuing");
 					mystate = play_live; /* We'll get errors reported later if that is not right. */
 					preloading = FALSE; /* It should continue without delay. */
@@ -878,13 +1195,13 @@ int buffer_loop(out123_handle *ao)
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 				break;
 				case XF_CMD_IGNLOW:
-					intflag = FALSE;
+					*intp = FALSE;
 					preloading = FALSE;
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 				break;
 				case XF_CMD_DRAIN:
 					debug("buffer drain");
-					intflag = FALSE;
+					*intp = FALSE;
 					if(mystate == play_live)
 					{
 						size_t bytes;
@@ -905,7 +1222,7 @@ int buffer_loop(out123_handle *ao)
 					size_t oldfill;
 
 					debug("buffer ndrain");
-					intflag = FALSE;
+					*intp = FALSE;
 					/* Expect further calls to ndrain, avoid prebuffering. */
 					draining = TRUE;
 					preloading = FALSE;
@@ -939,21 +1256,50 @@ int buffer_loop(out123_handle *ao)
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 				}
 				break;
+				case BUF_CMD_LATENCY:
+				{
+					double length;
+					size_t fill;
+
+					*intp = FALSE;
+					if(!out123_latency(ao, &length, &fill))
+					{
+						xfermem_putcmd(my_fd, XF_CMD_OK);
+						if(
+							!GOOD_WRITEVAL(my_fd, length)
+						||	!GOOD_WRITEVAL(my_fd, fill)
+						)
+							return 2;
+					}
+					else
+					{
+						xfermem_putcmd(my_fd, XF_CMD_ERROR);
+						if(!GOOD_WRITEVAL(my_fd, ao->errcode))
+							return 2;
+					}
+				}
+				break;
+				case BUF_CMD_STATS:
+					*intp = FALSE;
+					xfermem_putcmd(my_fd, XF_CMD_OK);
+					if(!GOOD_WRITEVAL(my_fd, ao->stats))
+						return 2;
+				break;
 				case XF_CMD_TERMINATE:
-					intflag = FALSE;
+					*intp = FALSE;
 					/* Will that response always reach the writer? Well, at worst,
 					   it's an ignored error on xfermem_getcmd(). */
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 					return 0;
 				case XF_CMD_PAUSE:
-					intflag = FALSE;
+					*intp = FALSE;
 					draining = FALSE;
 					out123_pause(ao);
 					mystate = ao->state;
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 				break;
 				case XF_CMD_DROP:
-					intflag = FALSE;
+					*intp = FALSE;
 					draining = FALSE;
 					xf->readindex = xf->freeindex;
 					out123_drop(ao);
@@ -966,9 +1312,9 @@ int buffer_loop(out123_handle *ao)
 #undef GOOD_READVAL_BUF
 			}
 		} /* Ensure that an interrupt-giving command has been received. */
-		while(intflag);
-		if(intflag && !AOQUIET)
+		while(*intp);
+		if(*intp && !AOQUIET)
 			error("buffer: The intflag should not be set anymore.");
-		intflag = FALSE; /* Any possible harm by _not_ ensuring that the flag is cleared here? */
+		*intp = FALSE; /* Any possible harm by _not_ ensuring that the flag is cleared here? */
 	}
 }
@@ -32,6 +32,9 @@ int buffer_formats( out123_handle *ao, const long *rates, int ratecount
                   , struct mpg123_fmt **fmtlist );
 int buffer_start(out123_handle *ao);
 void buffer_ndrain(out123_handle *ao, size_t bytes);
+int buffer_latency(out123_handle *ao, double *length, size_t *fill);
+/* Fetch the buffer's statistics into ao->stats. */
+int buffer_stats(out123_handle *ao);
 
 /* Simple messages to be deal with after playback. */
 
@@ -50,6 +53,18 @@ void buffer_drop(out123_handle *ao);
 
 /* The actual work: Hand over audio data. */
 size_t buffer_write(out123_handle *ao, void *buffer, size_t bytes);
+/* Or write it right into the buffer memory, for out123_play_begin(). This
+   waits for free space and returns 0 with the region for at most *bytes
+   (updated), 1 if the free space wraps around before that (use
+   buffer_write() then), -1 on error. */
+int buffer_begin_write(out123_handle *ao, void **region, size_t *bytes);
+/* Hand over the bytes written to the region, returns their count. */
+size_t buffer_commit_write(out123_handle *ao, size_t bytes);
+
+/* Buffer fill in bytes before playback starts (refill == 0) or resumes after
+   an underrun (refill != 0), for data of byterate bytes per second.
+   Zero if no preload is configured. */
+size_t buffer_preload(out123_handle *ao, size_t byterate, int refill);
 
 /* Thin wrapper over xfermem giving the current buffer fill. */
 size_t buffer_fill(out123_handle *ao);
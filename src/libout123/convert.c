@@ -0,0 +1,448 @@
+/*
+	convert: on-the-fly format conversion for out123_play()
+
+	copyright 2020 by the mpg123 project
+	                  - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	With OUT123_CONVERT, out123_start() does not insist on the device
+	taking the given format. It looks for the closest one the device
+	supports, in the order of encoding, channel count and sampling rate,
+	and out123_play() sends the data through libsyn123 on the way: to
+	float, mixing of channels, resampling, then to the device encoding.
+	Each step is skipped when there is nothing to do. All work buffers are
+	allocated at the start, playback itself does not allocate anything.
+
+	The buffer (process or thread) only ever sees the converted data.
+
+	With OUT123_DRIFT, the resampler is there also for equal rates and
+	its ratio gets skewed slightly to keep the buffer fill at a target
+	level. Clock drift between data source and device shows as a slowly
+	wandering fill. Averaged over a second, the fill error steers the
+	skew proportionally, correcting it within about a minute. That is a
+	gentle first order loop that keeps latency bounded, with a small
+	remaining offset of fill proportional to the drift.
+*/
+
+#include "out123_int.h"
+#include "convert.h"
+#include "syn123.h"
+#ifndef NOXFERMEM
+#include "buffer.h"
+#endif
+
+#include "debug.h"
+
+/* Client PCM frames converted in one go. */
+#define CONV_BLOCK 1024
+
+/* Drift compensation: measurement window and time constant of the
+   correction in seconds, limit of the ratio deviation. */
+#define DRIFT_WINDOW  1.
+#define DRIFT_TIME    60.
+#define DRIFT_MAXSKEW 0.001
+
+struct out123_conv
+{
+	/* What out123_start() got and out123_play() gets. */
+	long rate;
+	int channels;
+	int encoding;
+	int framesize;
+	syn123_handle *sh; /* resampler if rates differ */
+	double *mixmatrix; /* if channel counts differ */
+	float *fin;  /* client channels */
+	float *fmix; /* device channels */
+	float *fres; /* resampled */
+	unsigned char *out; /* device encoding */
+	size_t resblock; /* room for output frames of one block */
+	/* Drift compensation, if drift is set. */
+	int drift;
+	int armed;       /* buffer reached the target once */
+	double target;   /* buffer fill to keep, in bytes */
+	double fillsum;  /* for the average over the window */
+	size_t fillcount;
+	size_t since;    /* client frames in the window */
+};
+
+/* Preference for the device encoding, losing as little as possible. */
+static const int conv_encs[] =
+{
+	MPG123_ENC_FLOAT_32
+,	MPG123_ENC_SIGNED_32
+,	MPG123_ENC_SIGNED_24
+,	MPG123_ENC_SIGNED_16
+,	MPG123_ENC_FLOAT_64
+,	MPG123_ENC_UNSIGNED_32
+,	MPG123_ENC_UNSIGNED_24
+,	MPG123_ENC_UNSIGNED_16
+,	MPG123_ENC_SIGNED_8
+,	MPG123_ENC_UNSIGNED_8
+,	MPG123_ENC_ULAW_8
+,	MPG123_ENC_ALAW_8
+};
+
+/* Rates to try when the given one does not work, ascending. */
+static const long conv_rates[] =
+{
+	8000, 11025, 16000, 22050, 32000, 44100, 48000
+,	88200, 96000, 176400, 192000
+};
+
+#define CONV_COUNT(a) (sizeof(a)/sizeof(*(a)))
+
+static int best_enc(int encs, int encoding)
+{
+	size_t i;
+	if((encs & encoding) == encoding)
+		return encoding;
+	for(i=0; i<CONV_COUNT(conv_encs); ++i)
+		if((encs & conv_encs[i]) == conv_encs[i])
+			return conv_encs[i];
+	return 0;
+}
+
+/* Try the channel counts for one rate, the given one, then stereo and mono. */
+static int try_rate( out123_handle *ao, long rate, int channels, int encoding
+,	int *dev_channels )
+{
+	int chlist[3];
+	int chcount = 0;
+	int i;
+
+	chlist[chcount++] = channels;
+	if(channels != 2)
+		chlist[chcount++] = 2;
+	if(channels != 1)
+		chlist[chcount++] = 1;
+	for(i=0; i<chcount; ++i)
+	{
+		int encs = out123_encodings(ao, rate, chlist[i]);
+		int enc = encs > 0 ? best_enc(encs, encoding) : 0;
+		if(enc)
+		{
+			*dev_channels = chlist[i];
+			return enc;
+		}
+	}
+	return 0;
+}
+
+/* Downmix averages the input channels that map to one output channel,
+   upmix repeats them. Mono to stereo and back are the usual cases. */
+static void make_mixmatrix(double *mm, int dch, int cch)
+{
+	int i, j;
+	for(i=0; i<dch; ++i)
+	{
+		int count = 0;
+		for(j=0; j<cch; ++j)
+		{
+			int hit = dch <= cch ? (j % dch == i) : (i % cch == j);
+			mm[i*cch+j] = hit ? 1. : 0.;
+			count += hit;
+		}
+		for(j=0; j<cch; ++j)
+			mm[i*cch+j] /= count;
+	}
+}
+
+void conv_free(out123_handle *ao)
+{
+	if(!ao->conv)
+		return;
+	if(ao->conv->sh)
+		syn123_del(ao->conv->sh);
+	free(ao->conv);
+	ao->conv = NULL;
+}
+
+static void drift_reset(struct out123_conv *cv)
+{
+	cv->armed = 0;
+	cv->fillsum = 0.;
+	cv->fillcount = 0;
+	cv->since = 0;
+}
+
+int conv_setup( out123_handle *ao, int drift
+,	long *rate, int *channels, int *encoding )
+{
+	struct out123_conv *cv;
+	long drate = *rate;
+	int dch = 0;
+	int denc;
+	size_t ri;
+	size_t cbytes, resblock, mixsize, insize, mixbufsize, resbufsize;
+	int dsize = 0;
+
+	conv_free(ao);
+	if(*rate < 1 || *channels < 1 || out123_encsize(*encoding) < 1)
+		return OUT123_ARG_ERROR;
+	if(!(ao->flags & OUT123_CONVERT))
+	{
+		/* Only here for drift compensation. */
+		dch  = *channels;
+		denc = *encoding;
+	}
+	else
+		denc = try_rate(ao, drate, *channels, *encoding, &dch);
+	/* Rather go up to the nearest higher rate than down. */
+	for(ri=0; !denc && ri<CONV_COUNT(conv_rates); ++ri)
+		if(conv_rates[ri] > *rate)
+			denc = try_rate(ao, drate=conv_rates[ri], *channels, *encoding, &dch);
+	for(ri=CONV_COUNT(conv_rates); !denc && ri-->0;)
+		if(conv_rates[ri] < *rate)
+			denc = try_rate(ao, drate=conv_rates[ri], *channels, *encoding, &dch);
+	if(!denc)
+	{
+		/* Let the normal start fail with the original format. */
+		if(!AOQUIET)
+			error("no device format to convert to");
+		return OUT123_OK;
+	}
+	if(drate == *rate && dch == *channels && denc == *encoding && !drift)
+		return OUT123_OK;
+	if(AOVERBOSE(2))
+		fprintf( stderr, "Note: converting %li Hz %i ch %s to %li Hz %i ch %s\n"
+		,	*rate, *channels, out123_enc_name(*encoding)
+		,	drate, dch, out123_enc_name(denc) );
+
+	resblock = drate == *rate && !drift
+	?	CONV_BLOCK
+	:	(size_t)((double)CONV_BLOCK*drate/ *rate*(1.+DRIFT_MAXSKEW)) + 2;
+	resblock += resblock % 2; /* Keep 8 byte alignment after the floats. */
+	dsize = out123_encsize(denc);
+	mixsize = dch == *channels ? 0 : sizeof(double)*dch**channels;
+	insize = *encoding == MPG123_ENC_FLOAT_32
+	?	0 : sizeof(float)*CONV_BLOCK**channels;
+	mixbufsize = sizeof(float)*CONV_BLOCK*dch;
+	resbufsize = drate == *rate && !drift ? 0 : sizeof(float)*resblock*dch;
+	/* Doubles first for alignment, the float arrays keep it. */
+	cbytes = sizeof(*cv) + mixsize + insize + mixbufsize + resbufsize
+	+	resblock*dch*dsize;
+	cv = malloc(cbytes);
+	if(!cv)
+		return OUT123_DOOM;
+	cv->rate = *rate;
+	cv->channels = *channels;
+	cv->encoding = *encoding;
+	cv->framesize = out123_encsize(*encoding)**channels;
+	cv->sh = NULL;
+	cv->resblock = resblock;
+	cv->drift = drift;
+	cv->target = 0.;
+	drift_reset(cv);
+#ifndef NOXFERMEM
+	/* Where the buffer starts playing, at most half of it. */
+	if(drift)
+	{
+		cv->target = buffer_preload(ao, (size_t)drate*dch*dsize, 0);
+		if(cv->target <= 0.)
+			cv->target = ao->buffermem->size/2;
+	}
+#endif
+	cv->mixmatrix = mixsize ? (double*)(cv+1) : NULL;
+	cv->fin  = insize ? (float*)((char*)(cv+1)+mixsize) : NULL;
+	cv->fmix = (float*)((char*)(cv+1)+mixsize+insize);
+	cv->fres = resbufsize ? cv->fmix + CONV_BLOCK*dch : NULL;
+	cv->out  = (unsigned char*)(cv->fmix + CONV_BLOCK*dch)
+	+	resbufsize;
+	if(cv->mixmatrix)
+		make_mixmatrix(cv->mixmatrix, dch, *channels);
+	if(drate != *rate || drift)
+	{
+		int err = SYN123_OK;
+		cv->sh = syn123_new(drate, dch, MPG123_ENC_FLOAT_32, 0, &err);
+		if(!err)
+			err = syn123_setup_resample( cv->sh, *rate, drate, dch
+			,	SYN123_RESAMPLE_SINC );
+		/* Prepare the skewing before playback, that allocates. */
+		if(!err && drift)
+			err = syn123_resample_skew(cv->sh, 0.);
+		if(err)
+		{
+			if(!AOQUIET)
+				error1("cannot set up resampler: %s", syn123_strerror(err));
+			if(cv->sh)
+				syn123_del(cv->sh);
+			free(cv);
+			return OUT123_ARG_ERROR;
+		}
+	}
+	ao->conv = cv;
+	*rate = drate;
+	*channels = dch;
+	*encoding = denc;
+	return OUT123_OK;
+}
+
+/* Resample and convert device channels in float, then play.
+   Returns zero if everything got played. */
+static int conv_out(out123_handle *ao, float *fbuf, size_t frames)
+{
+	struct out123_conv *cv = ao->conv;
+	size_t bytes;
+	void *out;
+
+	if(cv->sh)
+	{
+		frames = syn123_resample(cv->sh, cv->fres, fbuf, frames);
+		fbuf = cv->fres;
+	}
+	if(!frames)
+		return 0;
+	if(ao->format == MPG123_ENC_FLOAT_32)
+	{
+		out = fbuf;
+		bytes = frames*ao->framesize;
+	}
+	else
+	{
+		if(syn123_conv( cv->out, ao->format, cv->resblock*ao->framesize
+		,	fbuf, MPG123_ENC_FLOAT_32, frames*ao->channels*sizeof(float)
+		,	&bytes, NULL ))
+		{
+			ao->errcode = OUT123_DEV_PLAY;
+			return -1;
+		}
+		out = cv->out;
+	}
+	return play_device(ao, out, bytes) == bytes ? 0 : -1;
+}
+
+/* Track the buffer fill and adjust the resampling ratio once per window. */
+static void drift_measure(out123_handle *ao, size_t frames)
+{
+#ifndef NOXFERMEM
+	struct out123_conv *cv = ao->conv;
+	double fill = (double)buffer_fill(ao);
+	double err, skew;
+
+	if(!cv->armed)
+	{
+		/* Nothing to steer while still filling up. */
+		if(fill < cv->target)
+			return;
+		cv->armed = 1;
+	}
+	cv->fillsum += fill;
+	cv->fillcount++;
+	cv->since += frames;
+	if(cv->since < DRIFT_WINDOW*cv->rate)
+		return;
+	/* Fill error in seconds, more data queued needs fewer samples out. */
+	err = (cv->fillsum/cv->fillcount - cv->target)
+	/	((double)ao->framesize*ao->rate);
+	skew = -err/DRIFT_TIME;
+	if(skew > DRIFT_MAXSKEW)
+		skew = DRIFT_MAXSKEW;
+	if(skew < -DRIFT_MAXSKEW)
+		skew = -DRIFT_MAXSKEW;
+	debug2("drift: fill error %g s, skew %g", err, skew);
+	syn123_resample_skew(cv->sh, skew);
+	cv->fillsum = 0.;
+	cv->fillcount = 0;
+	cv->since = 0;
+#endif
+}
+
+size_t conv_play(out123_handle *ao, unsigned char *bytes, size_t count)
+{
+	struct out123_conv *cv = ao->conv;
+	size_t frames = count/cv->framesize;
+	size_t sum = 0;
+
+	if(cv->drift)
+		drift_measure(ao, frames);
+
+	while(frames)
+	{
+		size_t block = frames < CONV_BLOCK ? frames : CONV_BLOCK;
+		float *fbuf = (float*)bytes;
+		if(cv->fin)
+		{
+			if(syn123_conv( cv->fin, MPG123_ENC_FLOAT_32
+			,	sizeof(float)*CONV_BLOCK*cv->channels
+			,	bytes, cv->encoding, block*cv->framesize, NULL, NULL ))
+			{
+				ao->errcode = OUT123_DEV_PLAY;
+				break;
+			}
+			fbuf = cv->fin;
+		}
+		if(cv->mixmatrix)
+		{
+			memset(cv->fmix, 0, sizeof(float)*block*ao->channels);
+			syn123_mix( cv->fmix, MPG123_ENC_FLOAT_32, ao->channels
+			,	fbuf, MPG123_ENC_FLOAT_32, cv->channels
+			,	cv->mixmatrix, block, 0, NULL );
+			fbuf = cv->fmix;
+		}
+		if(conv_out(ao, fbuf, block))
+			break;
+		bytes  += block*cv->framesize;
+		sum    += block*cv->framesize;
+		frames -= block;
+	}
+	return sum;
+}
+
+void conv_flush(out123_handle *ao)
+{
+	struct out123_conv *cv = ao->conv;
+	size_t frames;
+
+	if(!cv || !cv->sh)
+		return;
+	frames = syn123_resample_latency(cv->sh);
+	memset(cv->fmix, 0, sizeof(float)*CONV_BLOCK*ao->channels);
+	while(frames)
+	{
+		size_t block = frames < CONV_BLOCK ? frames : CONV_BLOCK;
+		if(conv_out(ao, cv->fmix, block))
+			break;
+		frames -= block;
+	}
+	conv_reset(ao);
+}
+
+void conv_reset(out123_handle *ao)
+{
+	struct out123_conv *cv = ao->conv;
+
+	if(cv && cv->sh)
+	{
+		syn123_setup_resample( cv->sh, cv->rate, ao->rate, ao->channels
+		,	SYN123_RESAMPLE_SINC );
+		if(cv->drift)
+		{
+			syn123_resample_skew(cv->sh, 0.);
+			drift_reset(cv);
+		}
+	}
+}
+
+size_t conv_client_bytes(out123_handle *ao, size_t device_bytes)
+{
+	struct out123_conv *cv = ao->conv;
+	size_t frames;
+
+	if(!cv || !ao->framesize)
+		return device_bytes;
+	frames = device_bytes/ao->framesize;
+	if(cv->sh)
+		frames = (size_t)((double)frames*cv->rate/ao->rate);
+	return frames*cv->framesize;
+}
+
+void conv_client_format( out123_handle *ao
+,	long *rate, int *channels, int *encoding, int *framesize )
+{
+	struct out123_conv *cv = ao->conv;
+
+	*rate      = cv ? cv->rate      : ao->rate;
+	*channels  = cv ? cv->channels  : ao->channels;
+	*encoding  = cv ? cv->encoding  : ao->format;
+	*framesize = cv ? cv->framesize : ao->framesize;
+}
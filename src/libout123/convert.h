@@ -0,0 +1,32 @@
+#ifndef _MPG123_H_CONVERT
+#define _MPG123_H_CONVERT
+/*
+	convert: on-the-fly format conversion for out123_play()
+
+	copyright 2020 by the mpg123 project
+	                  - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "out123_int.h"
+
+/* Find a device format for the one given (OUT123_CONVERT set) and prepare
+   conversion if they differ. The arguments are replaced by the device
+   format. With drift set, there is always a resampler to compensate clock
+   drift against the buffer fill. Returns OUT123_OK or an error code. */
+int    conv_setup( out123_handle *ao, int drift
+,	long *rate, int *channels, int *encoding );
+void   conv_free(out123_handle *ao);
+/* Convert and play client data, returning the client bytes consumed.
+   The data in device format goes to play_device(). */
+size_t conv_play(out123_handle *ao, unsigned char *bytes, size_t count);
+/* Push out what the resampler still holds. */
+void   conv_flush(out123_handle *ao);
+/* Forget about the resampler history. */
+void   conv_reset(out123_handle *ao);
+/* Client view of data in device format. */
+size_t conv_client_bytes(out123_handle *ao, size_t device_bytes);
+void   conv_client_format( out123_handle *ao
+,	long *rate, int *channels, int *encoding, int *framesize );
+
+#endif
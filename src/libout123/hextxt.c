@@ -12,9 +12,13 @@
 
 	Hex mode supports all possible integer encodings (where I am resonably
 	sure that endianess is defined). For text output, printing floats is
-	no problem. Printout of high channel counts as well as 24 bit numbers
-	is probably rather slow as individual numbers are pushed into a fprintf
-	call each.
+	no problem.
+
+	Numbers are not pushed through fprintf one by one anymore, that cost a
+	full core for multichannel output at high rates. Hex digits and decimal
+	digit pairs come from tables, the text collects in a buffer handed to
+	fwrite() in large blocks. Only floats still use snprintf() for the
+	exact %e formatting, into the same buffer.
 */
 
 #include "out123_int.h"
@@ -51,6 +55,34 @@ int txt_formats(out123_handle *ao)
 	|	MPG123_ENC_FLOAT_64;
 }
 
+/* Output buffer, if OUT123_FILEBUFFER does not ask for more. */
+#define HEXTXT_BUFFER 65536
+/* Enough for one sample as text, "-2147483648" or "%e" of any double,
+   plus separator. */
+#define SAMPLE_TEXT 32
+
+struct hextxt
+{
+	FILE *fp;
+	char *buf;
+	size_t size;
+	size_t fill;
+};
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static const char digitpairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
 static FILE* open_file(const char *path)
 {
 	if(!path || !strcmp("-",path) || !strcmp("",path))
@@ -59,6 +91,44 @@ static FILE* open_file(const char *path)
 		return compat_fopen(path, "w");
 }
 
+static int open_hextxt(out123_handle *ao)
+{
+	struct hextxt *ht = malloc(sizeof(*ht));
+	if(!ht)
+	{
+		if(!AOQUIET)
+			error("out of memory");
+		return -1;
+	}
+	ht->size = ao->file_buffer > HEXTXT_BUFFER ? ao->file_buffer : HEXTXT_BUFFER;
+	ht->fill = 0;
+	ht->buf  = malloc(ht->size);
+	ht->fp   = ht->buf ? open_file(ao->device) : NULL;
+	if(!ht->fp)
+	{
+		if(!AOQUIET)
+			error1("cannot open output: %s", ht->buf ? strerror(errno) : "out of memory");
+		free(ht->buf);
+		free(ht);
+		return -1;
+	}
+	ao->userptr = ht;
+	return 0;
+}
+
+/* Hand the collected text to stdio, keeping it if that fails. */
+static int flush_text(out123_handle *ao, struct hextxt *ht)
+{
+	if(ht->fill && fwrite(ht->buf, 1, ht->fill, ht->fp) != ht->fill)
+	{
+		if(!AOQUIET)
+			error1("writing failed: %s", strerror(errno));
+		return -1;
+	}
+	ht->fill = 0;
+	return 0;
+}
+
 /* Hex output defaults to what FhG compliance files used. */
 int hex_open(out123_handle *ao)
 {
@@ -70,8 +140,7 @@ int hex_open(out123_handle *ao)
 		return 0;
 	}
 
-	ao->userptr = open_file(ao->device);
-	return ao->userptr ? 0 : -1;
+	return open_hextxt(ao);
 }
 
 /* Text output defaults to the usual, CD-like format. */
@@ -85,183 +154,232 @@ int txt_open(out123_handle *ao)
 		return 0;
 	}
 
-	ao->userptr = open_file(ao->device);
-	return ao->userptr ? 0 : -1;
+	return open_hextxt(ao);
 }
 
 int hextxt_close(out123_handle *ao)
 {
+	int ret = 0;
 	if(ao && ao->userptr)
 	{
-		FILE *fp = ao->userptr;
+		struct hextxt *ht = ao->userptr;
 		ao->userptr = NULL;
-		if(fp != stdout && compat_fclose(fp))
+		if(flush_text(ao, ht))
+			ret = -1;
+		if(ht->fp != stdout && compat_fclose(ht->fp))
 		{
 			if(!AOQUIET)
 				error1("problem closing the output: %s\n", strerror(errno));
-			return -1;
+			ret = -1;
 		}
+		free(ht->buf);
+		free(ht);
 	}
-	return 0;
+	return ret;
 }
 
 int hex_write(out123_handle *ao, unsigned char *buf, int len)
 {
-	FILE *fp;
-	int i, block, samples;
+	struct hextxt *ht;
+	int i, b, block, samples;
+	char *p, *end;
 
 	if(!ao || !ao->userptr)
 		return -1;
-	fp = ao->userptr;
+	ht = ao->userptr;
 
 	block = out123_encsize(ao->format);
 	samples = len/block;
+	/* Nothing to print for wider (float) encodings. */
+	if(block > 4)
+		return samples*block;
+	p   = ht->buf + ht->fill;
+	end = ht->buf + ht->size - SAMPLE_TEXT;
 	for(i=0; i<samples; ++i)
 	{
 		unsigned char *s = &buf[i*block];
+		if(p > end)
+		{
+			ht->fill = p - ht->buf;
+			if(flush_text(ao, ht))
+				return i*block;
+			p = ht->buf;
+		}
 		/* Printout always big-endian, beginning with the highest byte. */
-		switch(block)
+		for(b=0; b<block; ++b)
 		{
 #ifdef WORDS_BIGENDIAN
-			case 1:
-				fprintf(fp, "%02x\n", s[0]);
-			break;
-			case 2:
-				fprintf(fp, "%02x%02x\n", s[0], s[1]);
-			break;
-			case 3:
-				fprintf(fp, "%02x%02x%02x\n", s[0], s[1], s[2]);
-			break;
-			case 4:
-				fprintf(fp, "%02x%02x%02x%02x\n", s[0], s[1], s[2], s[3]);
-			break;
+			unsigned char byte = s[b];
 #else
-			case 1:
-				fprintf(fp, "%02x\n", s[0]);
-			break;
-			case 2:
-				fprintf(fp, "%02x%02x\n", s[1], s[0]);
-			break;
-			case 3:
-				fprintf(fp, "%02x%02x%02x\n", s[2], s[1], s[0]);
-			break;
-			case 4:
-				fprintf(fp, "%02x%02x%02x%02x\n", s[3], s[2], s[1], s[0]);
-			break;
+			unsigned char byte = s[block-1-b];
 #endif
+			*p++ = hexdigits[byte>>4];
+			*p++ = hexdigits[byte&0xf];
 		}
+		*p++ = '\n';
 	}
+	ht->fill = p - ht->buf;
 	return i*block;
 }
 
+/* Decimal digits, two at a time, from the back. */
+static char *put_unsigned(char *p, uint32_t val)
+{
+	char digits[10];
+	char *d = digits + sizeof(digits);
+	size_t n;
+
+	while(val >= 100)
+	{
+		uint32_t pair = val % 100;
+		val /= 100;
+		d -= 2;
+		d[0] = digitpairs[2*pair];
+		d[1] = digitpairs[2*pair+1];
+	}
+	if(val >= 10)
+	{
+		d -= 2;
+		d[0] = digitpairs[2*val];
+		d[1] = digitpairs[2*val+1];
+	}
+	else
+		*--d = '0' + val;
+	n = digits + sizeof(digits) - d;
+	memcpy(p, d, n);
+	return p + n;
+}
+
+static char *put_signed(char *p, int32_t val)
+{
+	if(val < 0)
+	{
+		*p++ = '-';
+		return put_unsigned(p, (uint32_t)0 - (uint32_t)val);
+	}
+	return put_unsigned(p, (uint32_t)val);
+}
+
+/* Stored as 24 bits in native order, sign extended by the shift. */
+static uint32_t get24(const unsigned char *s)
+{
+#ifdef WORDS_BIGENDIAN
+	return ((uint32_t)s[0]<<24) | ((uint32_t)s[1]<<16) | ((uint32_t)s[2]<<8);
+#else
+	return ((uint32_t)s[2]<<24) | ((uint32_t)s[1]<<16) | ((uint32_t)s[0]<<8);
+#endif
+}
+
 int txt_write(out123_handle *ao, unsigned char *buf, int len)
 {
-	FILE *fp;
-	int i, block, frames;
+	struct hextxt *ht;
+	int i, c, block, frames;
+	size_t room;
+	char *p;
 
 	if(!ao || !ao->userptr)
 		return -1;
-	fp = ao->userptr;
+	ht = ao->userptr;
 
 	block = ao->framesize;
 	frames = len/block;
+	switch(ao->format)
+	{
+		case MPG123_ENC_SIGNED_8:
+		case MPG123_ENC_UNSIGNED_8:
+		case MPG123_ENC_SIGNED_16:
+		case MPG123_ENC_UNSIGNED_16:
+		case MPG123_ENC_SIGNED_24:
+		case MPG123_ENC_UNSIGNED_24:
+		case MPG123_ENC_SIGNED_32:
+		case MPG123_ENC_UNSIGNED_32:
+		case MPG123_ENC_FLOAT_32:
+		case MPG123_ENC_FLOAT_64:
+		break;
+		default:
+			/* Nothing to print for the others. */
+			return frames*block;
+	}
+	/* Whole frames in the buffer, at least one. */
+	room = (size_t)ao->channels*SAMPLE_TEXT;
+	if(room > ht->size)
+	{
+		char *nbuf = realloc(ht->buf, room);
+		if(!nbuf)
+		{
+			if(!AOQUIET)
+				error("out of memory");
+			return -1;
+		}
+		ht->buf  = nbuf;
+		ht->size = room;
+	}
+	p = ht->buf + ht->fill;
 
 	for(i=0; i<frames; ++i)
 	{
 		void *f = &buf[i*block];
-		switch(ao->format)
+		if((size_t)(ht->buf + ht->size - p) < room)
 		{
-#define CHANPRINT(type, ptype, fmt) \
-	{ \
-		type *ff = f; \
-		switch(ao->channels) \
-		{ \
-			case 1: \
-				fprintf(fp, fmt"\n", (ptype)ff[0]); \
-			break; \
-			case 2: \
-				fprintf(fp, fmt"\t"fmt"\n", (ptype)ff[0], (ptype)ff[1]); \
-			break; \
-			default: \
-			{ \
-				int c; \
-				for(c=0; c<ao->channels; ++c) \
-					fprintf(fp, "%s"fmt, c ? "\t" : "", (ptype)ff[c]); \
-				fprintf(fp, "\n"); \
-			} \
-		} \
-	}
-/* Am I to paranoid about dancing around the type system? */
-#ifdef WORDS_BIGENDIAN
-#define CHANPRINT24(type, ptype, fmt) \
-	{ \
-		unsigned char *ff = f; \
-		for(c=0; c<ao->channels; ++c) \
-		{ \
-			uint32_t tmp = 0; \
-			tmp |= ((uint32_t)(*(ff++))) << 24; \
-			tmp |= ((uint32_t)(*(ff++))) << 16; \
-			tmp |= ((uint32_t)(*(ff++))) << 8; \
-			fprintf(fp, "%s"fmt, c ? "\t" : "", (ptype)(*((type*)&tmp)/256)); \
-		} \
-		fprintf(fp, "\n"); \
-	}
-#else
-#define CHANPRINT24(type, ptype, fmt) \
-	{ \
-		unsigned char *ff = f; \
-		int c; \
-		for(c=0; c<ao->channels; ++c) \
-		{ \
-			uint32_t tmp = 0; \
-			tmp |= ((uint32_t)(*(ff++))) << 8; \
-			tmp |= ((uint32_t)(*(ff++))) << 16; \
-			tmp |= ((uint32_t)(*(ff++))) << 24; \
-			fprintf(fp, "%s"fmt, c ? "\t" : "", (ptype)(*((type*)&tmp)/256)); \
-		} \
-		fprintf(fp, "\n"); \
-	}
-#endif
-			case MPG123_ENC_SIGNED_8:
-				CHANPRINT(char, int, "%d")
-			break;
-			case MPG123_ENC_UNSIGNED_8:
-				CHANPRINT(unsigned char, int, "%u")
-			break;
-			case MPG123_ENC_SIGNED_16:
-				CHANPRINT(int16_t, int, "%d")
-			break;
-			case MPG123_ENC_UNSIGNED_16:
-				CHANPRINT(uint16_t, unsigned int, "%u")
-			break;
-			case MPG123_ENC_SIGNED_24:
-				CHANPRINT24(int32_t, long, "%ld")
-			break;
-			case MPG123_ENC_UNSIGNED_24:
-				CHANPRINT24(uint32_t, unsigned long, "%ld")
-			break;
-			case MPG123_ENC_SIGNED_32:
-				CHANPRINT(int32_t, long, "%ld")
-			break;
-			case MPG123_ENC_UNSIGNED_32:
-				CHANPRINT(uint32_t, unsigned long, "%lu")
-			break;
-			case MPG123_ENC_FLOAT_32:
-				CHANPRINT(float, double, "%e")
-			break;
-			case MPG123_ENC_FLOAT_64:
-				CHANPRINT(double, double, "%e")
-			break;
+			ht->fill = p - ht->buf;
+			if(flush_text(ao, ht))
+				return i*block;
+			p = ht->buf;
+		}
+		for(c=0; c<ao->channels; ++c)
+		{
+			if(c)
+				*p++ = '\t';
+			switch(ao->format)
+			{
+				case MPG123_ENC_SIGNED_8:
+					p = put_signed(p, ((signed char*)f)[c]);
+				break;
+				case MPG123_ENC_UNSIGNED_8:
+					p = put_unsigned(p, ((unsigned char*)f)[c]);
+				break;
+				case MPG123_ENC_SIGNED_16:
+					p = put_signed(p, ((int16_t*)f)[c]);
+				break;
+				case MPG123_ENC_UNSIGNED_16:
+					p = put_unsigned(p, ((uint16_t*)f)[c]);
+				break;
+				case MPG123_ENC_SIGNED_24:
+				{
+					uint32_t tmp = get24((unsigned char*)f+3*c);
+					p = put_signed(p, *((int32_t*)&tmp)/256);
+				}
+				break;
+				case MPG123_ENC_UNSIGNED_24:
+					p = put_unsigned(p, get24((unsigned char*)f+3*c)>>8);
+				break;
+				case MPG123_ENC_SIGNED_32:
+					p = put_signed(p, ((int32_t*)f)[c]);
+				break;
+				case MPG123_ENC_UNSIGNED_32:
+					p = put_unsigned(p, ((uint32_t*)f)[c]);
+				break;
+				case MPG123_ENC_FLOAT_32:
+					p += snprintf(p, SAMPLE_TEXT, "%e", (double)((float*)f)[c]);
+				break;
+				case MPG123_ENC_FLOAT_64:
+					p += snprintf(p, SAMPLE_TEXT, "%e", ((double*)f)[c]);
+				break;
+			}
 		}
+		*p++ = '\n';
 	}
+	ht->fill = p - ht->buf;
 	return i*block;
 }
 
 /* Draining is flushing to disk. Words do suck at times. */
 void hextxt_drain(out123_handle *ao)
 {
+	struct hextxt *ht;
 	if(!ao || !ao->userptr)
 		return;
-	if(fflush(ao->userptr) && !AOQUIET)
+	ht = ao->userptr;
+	if(!flush_text(ao, ht) && fflush(ht->fp) && !AOQUIET)
 		error1("flushing failed: %s\n", strerror(errno));
 }
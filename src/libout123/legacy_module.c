@@ -1,49 +1,79 @@
 /*
 	legacy_module.c: dummy interface to modular code loader for legacy build system
 
-	copyright 2008 by the mpg123 project - free software under the terms of the LGPL 2.1
+	copyright 2008-2020 by the mpg123 project - free software under the terms of the LGPL 2.1
 	see COPYING and AUTHORS files in distribution or http://mpg123.org
 	initially written by Nicholas J Humfrey
+
+	Without dynamic loading, the output modules are compiled in. That is
+	either the single default module or, with --enable-modules=builtin,
+	all detected ones. The latter are renamed to
+	mpg123_output_module_info_<name> by the build system and listed in
+	BUILTIN_OUTPUT_MODULES from configure, so they can live side by side.
+	Resolving a driver name then is a lookup in the table below, without
+	touching the file system.
 */
 
 #include "out123_int.h"
 #include "debug.h"
 
+#ifdef BUILTIN_OUTPUT_MODULES
+
+#define BUILTIN_MODULE(name) extern mpg123_module_t mpg123_output_module_info_##name;
+BUILTIN_OUTPUT_MODULES
+#undef BUILTIN_MODULE
+
+#define BUILTIN_MODULE(name) &mpg123_output_module_info_##name,
+static mpg123_module_t *const output_modules[] =
+{
+	BUILTIN_OUTPUT_MODULES
+	NULL
+};
+#undef BUILTIN_MODULE
+
+#else
+
 /* A single module is staticly compiled in for each type */
 extern mpg123_module_t mpg123_output_module_info;
 /* extern mpg123_module_t mpg123_input_module_info; */
 
+static mpg123_module_t *const output_modules[] =
+{
+	&mpg123_output_module_info
+,	NULL
+};
+
+#endif
 
 /* Open a module */
 mpg123_module_t*
 open_module(const char* type, const char* name, int verbose, const char *bindir)
 {
 	mpg123_module_t *mod = NULL;
-	
+	int i;
+
 	/* Select the module info structure, based on the desired type */
-	if (strcmp(type, "output")==0) {
-		mod = &mpg123_output_module_info;
-/*
-	} else if (strcmp(type, "input")==0) {
-		mod = &mpg123_input_module_info;
-*/
-	} else {
+	if (strcmp(type, "output")!=0) {
 		if(verbose >= 0)
 			error1("Unable to open module type '%s'.", type);
 		return NULL;
 	}
-	
-	/* Check the module compiled in is the module requested */
-	if (strcmp(name, mod->name)!=0) {
+
+	/* Check the modules compiled in for the one requested */
+	for(i=0; output_modules[i]; ++i)
+		if(!strcmp(name, output_modules[i]->name))
+			mod = output_modules[i];
+	if(!mod) {
 		if(verbose >= 0)
 		{
 			error1("Unable to open requested module '%s'.", name);
-			error1("The only available statically compiled module is '%s'."
-			,	mod->name);
+			if(!output_modules[1])
+				error1("The only available statically compiled module is '%s'."
+				,	output_modules[0]->name);
 		}
 		return NULL;
 	}
-	
+
 	/* Debugging info */
 	debug1("Details of static module type '%s':", type);
 	debug1("  api_version=%d", mod->api_version);
@@ -59,7 +89,7 @@ open_module(const char* type, const char* name, int verbose, const char *bindir)
 void close_module(mpg123_module_t* module, int verbose)
 {
 	debug("close_module()");
-	
+
 	/* Module was never really 'loaded', so nothing to do here. */
 }
 
@@ -67,30 +97,36 @@ void close_module(mpg123_module_t* module, int verbose)
 int list_modules(const char *type, char ***names, char ***descr, int verbose
 ,	const char *bindir)
 {
-	debug("list_modules()" );
+	int count = 0;
+	int i;
 
-	*names = NULL;
-	*descr = NULL;
+	debug("list_modules()" );
 
-	if(
-		(*names=malloc(sizeof(char*)))
-	&&	!((*names)[0]=NULL) /* for safe cleanup */
-	&&	((*names)[0]=compat_strdup(mpg123_output_module_info.name))
-	&&	(*descr=malloc(sizeof(char*)))
-	&&	!((*descr)[0]=NULL) /* for safe cleanup */
-	&& ((*descr)[0]=compat_strdup(mpg123_output_module_info.description))
-	)
-		return 1;
-	else
+	while(output_modules[count])
+		++count;
+	*names = malloc(sizeof(char*)*count);
+	*descr = malloc(sizeof(char*)*count);
+	if(*names && *descr)
 	{
-		if(*names)
-			free((*names)[0]);
-		free(*names);
-		if(*descr)
-			free((*descr)[0]);
-		free(*descr);
-		return -1;
+		for(i=0; i<count; ++i)
+			(*names)[i] = (*descr)[i] = NULL; /* for safe cleanup */
+		for(i=0; i<count; ++i)
+			if(
+				!((*names)[i]=compat_strdup(output_modules[i]->name))
+			||	!((*descr)[i]=compat_strdup(output_modules[i]->description))
+			)
+				break;
+		if(i == count)
+			return count;
+		for(i=0; i<count; ++i)
+		{
+			free((*names)[i]);
+			free((*descr)[i]);
+		}
 	}
+	free(*names);
+	free(*descr);
+	*names = NULL;
+	*descr = NULL;
+	return -1;
 }
-
-
@@ -9,10 +9,17 @@
 #include "out123_int.h"
 #include "wav.h"
 #include "hextxt.h"
+#include "tee.h"
+#include "convert.h"
+#include "pull.h"
 #ifndef NOXFERMEM
 #include "buffer.h"
 static int have_buffer(out123_handle *ao)
 {
+#ifndef NO_THREADS
+	if(ao->buffer_thread != NULL)
+		return 1;
+#endif
 	return (ao->buffer_pid != -1);
 }
 #endif
@@ -28,6 +35,26 @@ static int have_buffer(out123_handle *ao)
 
 static const char *default_name = "out123";
 
+/* Time of a device write for OUT123_WRITE_MAX, in seconds. */
+static double write_clock(void)
+{
+#ifdef HAVE_SYS_TIME_H
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+#else
+	return 0.;
+#endif
+}
+
+static void write_done(out123_handle *ao, double start, size_t bytes)
+{
+	double took = write_clock()-start;
+	if(took > ao->stats.write_max)
+		ao->stats.write_max = took;
+	AOPROBE2(write, (long)bytes, (long)(took*1e6));
+}
+
 static int modverbose(out123_handle *ao, int final)
 {
 	debug3("modverbose: %x %x %x"
@@ -49,25 +76,69 @@ static void out123_clear_module(out123_handle *ao)
 	ao->drain = NULL;
 	ao->close = NULL;
 	ao->deinit = NULL;
+	ao->delay = NULL;
+	ao->begin_write = NULL;
+	ao->commit_write = NULL;
 
 	ao->module = NULL;
 	ao->userptr = NULL;
 	ao->fn = -1;
 	/* The default is live output devices, files are the special case. */
 	ao->propflags = OUT123_PROP_LIVE;
+	ao->probed = 0;
 }
 
 /* Ensure that real name is not leaked, needs to be freed before any call to
    ao->open(ao). One might free it on closing already, but it might be sensible
-   to keep it around, might still be the same after re-opening. */
+   to keep it around, might still be the same after re-opening.
+   The module only points to its own string, the copy is ours, from our
+   allocator (the module may have its own). */
 static int aoopen(out123_handle *ao)
 {
+	int ret;
 	if(ao->realname)
 	{
 		free(ao->realname);
 		ao->realname = NULL;
 	}
-	return ao->open(ao);
+	ret = ao->open(ao);
+	if(ao->realname)
+		ao->realname = compat_strdup(ao->realname);
+	return ret;
+}
+
+/* The successful probe in out123_open() leaves the device open in query
+   mode, as the format query usually follows right away. Opening a sound
+   server connection or ALSA configuration once less is noticeable at
+   startup. */
+static int query_open(out123_handle *ao)
+{
+	if(ao->probed)
+	{
+		ao->probed = 0;
+		return 0;
+	}
+	return aoopen(ao);
+}
+
+/* Anything else than a format query closes that device first. */
+static void probe_done(out123_handle *ao)
+{
+	if(ao->probed)
+	{
+		ao->probed = 0;
+		if(ao->close(ao) && !AOQUIET)
+			error("trouble closing device");
+	}
+}
+
+int attribute_align_arg out123_allocator( void *(*r_alloc)(void *handle, size_t size)
+,	void *(*r_realloc)(void *handle, void *ptr, size_t size)
+,	void (*r_free)(void *handle, void *ptr), void *handle )
+{
+	return compat_allocator(r_alloc, r_realloc, r_free, handle)
+	?	OUT123_ARG_ERROR
+	:	OUT123_OK;
 }
 
 out123_handle* attribute_align_arg out123_new(void)
@@ -81,6 +152,9 @@ out123_handle* attribute_align_arg out123_new(void)
 	ao->buffer_fd[0] = -1;
 	ao->buffer_fd[1] = -1;
 	ao->buffermem = NULL;
+#ifndef NO_THREADS
+	ao->buffer_thread = NULL;
+#endif
 #endif
 
 	out123_clear_module(ao);
@@ -98,9 +172,34 @@ out123_handle* attribute_align_arg out123_new(void)
 	ao->state = play_dead;
 	ao->auxflags = 0;
 	ao->preload = 0.;
+	ao->preload_time = 0.;
+	ao->refill_time = 0.;
 	ao->verbose = 0;
 	ao->device_buffer = 0.;
+	ao->device_period = 0.;
+	ao->device_length = 0.;
+	ao->file_buffer = 0;
+	ao->file_length = 0;
+	ao->rtprio = 0;
+	ao->cpumask = 0;
+	memset(&ao->stats, 0, sizeof(ao->stats));
+	ao->stats.buffer_minfill = -1;
 	ao->bindir = NULL;
+	ao->conv = NULL;
+	ao->play_begun = 0;
+	ao->play_size = 0;
+	ao->playbuf = NULL;
+	ao->playbuf_size = 0;
+	ao->fill = NULL;
+	ao->filldata = NULL;
+	ao->fill_device = 0;
+	ao->fill_native = 0;
+	ao->pulling = 0;
+	ao->feeder = NULL;
+	ao->fmtcache_on = 1;
+	ao->fmtcache = NULL;
+	ao->fmtcache_fill = 0;
+	ao->fmtcache_size = 0;
 	return ao;
 }
 
@@ -118,6 +217,10 @@ void attribute_align_arg out123_del(out123_handle *ao)
 		free(ao->name);
 	if(ao->bindir)
 		free(ao->bindir);
+	conv_free(ao);
+	fmtcache_clear(ao);
+	if(ao->playbuf)
+		free(ao->playbuf);
 	free(ao);
 }
 
@@ -141,6 +244,7 @@ static const char *const errstring[] =
 ,	"unknown parameter code"
 ,	"attempt to set read-only parameter"
 ,	"invalid out123 handle"
+,	"not supported by driver"
 };
 
 const char* attribute_align_arg out123_strerror(out123_handle *ao)
@@ -213,6 +317,9 @@ out123_param( out123_handle *ao, enum out123_parms code
 	switch(code)
 	{
 		case OUT123_FLAGS:
+			/* Native formats are different ones. */
+			if((ao->flags ^ (int)value) & OUT123_NATIVE)
+				fmtcache_clear(ao);
 			ao->flags = (int)value;
 		break;
 		case OUT123_PRELOAD:
@@ -227,7 +334,37 @@ out123_param( out123_handle *ao, enum out123_parms code
 		case OUT123_DEVICEBUFFER:
 			ao->device_buffer = fvalue;
 		break;
+		case OUT123_DEVICEPERIOD:
+			ao->device_period = fvalue;
+		break;
+		case OUT123_FILEBUFFER:
+			ao->file_buffer = value;
+		break;
+		case OUT123_FILELENGTH:
+			ao->file_length = value;
+		break;
+		case OUT123_PRELOADTIME:
+			ao->preload_time = fvalue;
+		break;
+		case OUT123_REFILLTIME:
+			ao->refill_time = fvalue;
+		break;
+		case OUT123_RTPRIO:
+			ao->rtprio = (int)value;
+		break;
+		case OUT123_CPUMASK:
+			ao->cpumask = value;
+		break;
+		case OUT123_FORMAT_CACHE:
+			ao->fmtcache_on = value ? 1 : 0;
+			fmtcache_clear(ao);
+		break;
 		case OUT123_PROPFLAGS:
+		case OUT123_UNDERRUNS:
+		case OUT123_XRUN_RECOVERY:
+		case OUT123_WRITE_MAX:
+		case OUT123_BUFFER_UNDERRUNS:
+		case OUT123_BUFFER_MINFILL:
 			ao->errcode = OUT123_SET_RO_PARAM;
 			ret = OUT123_ERR;
 		break;
@@ -271,6 +408,12 @@ out123_getparam( out123_handle *ao, enum out123_parms code
 		return OUT123_ERR;
 	ao->errcode = 0;
 
+#ifndef NOXFERMEM
+	/* The buffer does the device writing and keeps the statistics. */
+	if( have_buffer(ao) && code >= OUT123_UNDERRUNS
+	&&	code <= OUT123_BUFFER_MINFILL && buffer_stats(ao) )
+		return OUT123_ERR;
+#endif
 	switch(code)
 	{
 		case OUT123_FLAGS:
@@ -288,9 +431,48 @@ out123_getparam( out123_handle *ao, enum out123_parms code
 		case OUT123_DEVICEBUFFER:
 			fvalue = ao->device_buffer;
 		break;
+		case OUT123_DEVICEPERIOD:
+			fvalue = ao->device_period;
+		break;
+		case OUT123_FILEBUFFER:
+			value = ao->file_buffer;
+		break;
+		case OUT123_FILELENGTH:
+			value = ao->file_length;
+		break;
+		case OUT123_PRELOADTIME:
+			fvalue = ao->preload_time;
+		break;
+		case OUT123_REFILLTIME:
+			fvalue = ao->refill_time;
+		break;
+		case OUT123_RTPRIO:
+			value = ao->rtprio;
+		break;
+		case OUT123_CPUMASK:
+			value = ao->cpumask;
+		break;
+		case OUT123_FORMAT_CACHE:
+			value = ao->fmtcache_on;
+		break;
 		case OUT123_PROPFLAGS:
 			value = ao->propflags;
 		break;
+		case OUT123_UNDERRUNS:
+			value = ao->stats.underruns;
+		break;
+		case OUT123_XRUN_RECOVERY:
+			fvalue = ao->stats.xrun_max;
+		break;
+		case OUT123_WRITE_MAX:
+			fvalue = ao->stats.write_max;
+		break;
+		case OUT123_BUFFER_UNDERRUNS:
+			value = ao->stats.buffer_underruns;
+		break;
+		case OUT123_BUFFER_MINFILL:
+			value = ao->stats.buffer_minfill;
+		break;
 		case OUT123_NAME:
 			svalue = ao->realname ? ao->realname : ao->name;
 		break;
@@ -319,8 +501,15 @@ out123_param_from(out123_handle *ao, out123_handle* from_ao)
 
 	ao->flags     = from_ao->flags;
 	ao->preload   = from_ao->preload;
+	ao->preload_time = from_ao->preload_time;
+	ao->refill_time = from_ao->refill_time;
 	ao->gain      = from_ao->gain;
 	ao->device_buffer = from_ao->device_buffer;
+	ao->device_period = from_ao->device_period;
+	ao->file_buffer = from_ao->file_buffer;
+	ao->file_length = from_ao->file_length;
+	ao->rtprio = from_ao->rtprio;
+	ao->cpumask = from_ao->cpumask;
 	ao->verbose   = from_ao->verbose;
 	if(ao->name)
 		free(ao->name);
@@ -334,18 +523,26 @@ out123_param_from(out123_handle *ao, out123_handle* from_ao)
 
 #ifndef NOXFERMEM
 /* Serialization of tunable parameters to communicate them between
-   main process and buffer. Make sure these two stay in sync ... */
+   main process and buffer. Make sure these two stay in sync ...
+   Property flags are not among them, they come from the driver on each
+   side and the writer's copy would mark a non-live file output as live. */
 
 int write_parameters(out123_handle *ao, int who)
 {
 	int fd = ao->buffermem->fd[who];
+	/* The buffer only ever sees converted data. */
+	int flags = ao->flags & ~(OUT123_CONVERT|OUT123_DRIFT);
 	if(
-		GOOD_WRITEVAL(fd, ao->flags)
+		GOOD_WRITEVAL(fd, flags)
 	&&	GOOD_WRITEVAL(fd, ao->preload)
+	&&	GOOD_WRITEVAL(fd, ao->preload_time)
+	&&	GOOD_WRITEVAL(fd, ao->refill_time)
 	&&	GOOD_WRITEVAL(fd, ao->gain)
 	&&	GOOD_WRITEVAL(fd, ao->device_buffer)
+	&&	GOOD_WRITEVAL(fd, ao->device_period)
+	&&	GOOD_WRITEVAL(fd, ao->file_buffer)
+	&&	GOOD_WRITEVAL(fd, ao->file_length)
 	&&	GOOD_WRITEVAL(fd, ao->verbose)
-	&&	GOOD_WRITEVAL(fd, ao->propflags)
 	&& !xfer_write_string(ao, who, ao->name)
 	&& !xfer_write_string(ao, who, ao->bindir)
 	)
@@ -363,10 +560,14 @@ int read_parameters(out123_handle *ao
 	if(
 		GOOD_READVAL_BUF(fd, ao->flags)
 	&&	GOOD_READVAL_BUF(fd, ao->preload)
+	&&	GOOD_READVAL_BUF(fd, ao->preload_time)
+	&&	GOOD_READVAL_BUF(fd, ao->refill_time)
 	&&	GOOD_READVAL_BUF(fd, ao->gain)
 	&&	GOOD_READVAL_BUF(fd, ao->device_buffer)
+	&&	GOOD_READVAL_BUF(fd, ao->device_period)
+	&&	GOOD_READVAL_BUF(fd, ao->file_buffer)
+	&&	GOOD_READVAL_BUF(fd, ao->file_length)
 	&&	GOOD_READVAL_BUF(fd, ao->verbose)
-	&&	GOOD_READVAL_BUF(fd, ao->propflags)
 	&& !xfer_read_string(ao, who, &ao->name)
 	&& !xfer_read_string(ao, who, &ao->bindir)
 	)
@@ -473,8 +674,11 @@ void attribute_align_arg out123_close(out123_handle *ao)
 		return;
 	ao->errcode = 0;
 
-	out123_drain(ao);
+	/* Pulled data does not end by itself. */
+	if(!ao->pulling)
+		out123_drain(ao);
 	out123_stop(ao);
+	conv_free(ao);
 
 #ifndef NOXFERMEM
 	if(have_buffer(ao))
@@ -482,6 +686,7 @@ void attribute_align_arg out123_close(out123_handle *ao)
 	else
 #endif
 	{
+		probe_done(ao);
 		if(ao->deinit)
 			ao->deinit(ao);
 		if(ao->module)
@@ -490,6 +695,7 @@ void attribute_align_arg out123_close(out123_handle *ao)
 		out123_clear_module(ao);
 	}
 
+	fmtcache_clear(ao);
 	/* These copies exist in addition to the ones for the buffer. */
 	if(ao->driver)
 		free(ao->driver);
@@ -517,6 +723,22 @@ out123_start(out123_handle *ao, long rate, int channels, int encoding)
 	debug("out123_start() continuing");
 	if(ao->state != play_stopped)
 		return out123_seterr(ao, OUT123_NO_DRIVER);
+	probe_done(ao);
+
+	/* Possibly play something else than what we get. */
+	conv_free(ao);
+	if(ao->flags & (OUT123_CONVERT|OUT123_DRIFT))
+	{
+		int drift = 0;
+		int err;
+#ifndef NOXFERMEM
+		drift = (ao->flags & OUT123_DRIFT) && have_buffer(ao);
+#endif
+		err = conv_setup(ao, drift, &rate, &channels, &encoding);
+		if(err)
+			return out123_seterr(ao, err);
+		ao->errcode = 0;
+	}
 
 	/* Stored right away as parameters for ao->open() and also for reference.
 	   framesize needed for out123_play(). */
@@ -524,33 +746,64 @@ out123_start(out123_handle *ao, long rate, int channels, int encoding)
 	ao->channels  = channels;
 	ao->format    = encoding;
 	ao->framesize = out123_encsize(encoding)*channels;
+	ao->device_length = 0.;
+	ao->fill_device = 0;
+	ao->fill_native = 0;
 
 #ifndef NOXFERMEM
 	if(have_buffer(ao))
 	{
-		if(!buffer_start(ao))
+		if(buffer_start(ao))
 		{
-			ao->state = play_live;
-			return OUT123_OK;
-		}
-		else
+			fmtcache_clear(ao);
 			return OUT123_ERR;
+		}
 	}
 	else
 #endif
 	{
+		pull_prepare(ao);
 		if(aoopen(ao) < 0)
+		{
+			/* What was probed did not hold, maybe the device changed. */
+			fmtcache_clear(ao);
 			return out123_seterr(ao, OUT123_DEV_OPEN);
-		ao->state = play_live;
-		return OUT123_OK;
+		}
+	}
+	ao->state = play_live;
+	/* The driver pulls by itself or we need the feeder thread. */
+	if(ao->fill)
+	{
+		int err = pull_start(ao);
+		if(err)
+		{
+			out123_stop(ao);
+			return out123_seterr(ao, err);
+		}
 	}
+	return OUT123_OK;
+}
+
+int attribute_align_arg
+out123_set_fill(out123_handle *ao, out123_fill_func fill, void *userdata)
+{
+	debug3( "[%ld]out123_set_fill(%p, %p)", (long)getpid()
+	,	(void*)ao, userdata );
+	if(!ao)
+		return OUT123_ERR;
+	ao->errcode = 0;
+	if(ao->pulling)
+		return out123_seterr(ao, OUT123_ARG_ERROR);
+	ao->fill = fill;
+	ao->filldata = userdata;
+	return OUT123_OK;
 }
 
 void attribute_align_arg out123_pause(out123_handle *ao)
 {
 	debug3( "[%ld]out123_pause(%p) %i", (long)getpid()
 	,	(void*)ao, ao ? (int)ao->state : -1 );
-	if(ao && ao->state == play_live)
+	if(ao && ao->state == play_live && !ao->pulling)
 	{
 #ifndef NOXFERMEM
 		if(have_buffer(ao)){ debug("pause with buffer"); buffer_pause(ao); }
@@ -598,6 +851,11 @@ void attribute_align_arg out123_stop(out123_handle *ao)
 	ao->errcode = 0;
 	if(!(ao->state == play_paused || ao->state == play_live))
 		return;
+	if(ao->pulling)
+		pull_stop(ao);
+	/* The resampler still holds a bit of what should be heard. */
+	if(ao->conv && ao->state == play_live)
+		conv_flush(ao);
 #ifndef NOXFERMEM
 	if(have_buffer(ao))
 		buffer_stop(ao);
@@ -612,12 +870,44 @@ void attribute_align_arg out123_stop(out123_handle *ao)
 	ao->state = play_stopped;
 }
 
-size_t attribute_align_arg
-out123_play(out123_handle *ao, void *bytes, size_t count)
+/* Play data in device format, to the buffer or directly. */
+size_t play_device(out123_handle *ao, void *bytes, size_t count)
 {
 	size_t sum = 0;
 	int written;
 
+#ifndef NOXFERMEM
+	if(have_buffer(ao))
+		return buffer_write(ao, bytes, count);
+	else
+#endif
+	do /* Playback in a loop to be able to continue after interruptions. */
+	{
+		double start = write_clock();
+		errno = 0;
+		written = ao->write(ao, (unsigned char*)bytes+sum, (int)count);
+		write_done(ao, start, count);
+		debug4( "written: %d errno: %i (%s), keep_on=%d"
+		,	written, errno, strerror(errno)
+		,	ao->flags & OUT123_KEEP_PLAYING );
+		if(written >= 0){ sum+=written; count -= written; }
+		else if(errno != EINTR)
+		{
+			ao->errcode = OUT123_DEV_PLAY;
+			if(!AOQUIET)
+				error1("Error in writing audio (%s?)!", strerror(errno));
+			/* If written < 0, this is a serious issue ending this playback round. */
+			break;
+		}
+	} while(count && ao->flags & OUT123_KEEP_PLAYING);
+	return sum;
+}
+
+size_t attribute_align_arg
+out123_play(out123_handle *ao, void *bytes, size_t count)
+{
+	size_t sum;
+
 	debug5( "[%ld]out123_play(%p, %p, %"SIZE_P") (%i)", (long)getpid()
 	,	(void*)ao, bytes, (size_p)count, ao ? (int)ao->state : -1 );
 	if(!ao)
@@ -634,37 +924,165 @@ out123_play(out123_handle *ao, void *bytes, size_t count)
 			return 0;
 		}
 	}
+	/* Only the feeder thread plays while pulling. */
+	if(ao->pulling && !pull_feeder(ao))
+	{
+		ao->errcode = OUT123_ARG_ERROR;
+		return 0;
+	}
 
+	if(ao->conv)
+		return conv_play(ao, bytes, count);
 	/* Ensure that we are writing whole PCM frames. */
 	count -= count % ao->framesize;
 	if(!count) return 0;
 
+	sum = play_device(ao, bytes, count);
+
+	debug3( "out123_play(%p, %p, ...) = %"SIZE_P
+	,	(void*)ao, bytes, (size_p)sum );
+	return sum;
+}
+
+/* Staging buffer size without a desired one, in frames. */
+#define PLAY_BEGIN_FRAMES 4096
+
+int attribute_align_arg
+out123_play_begin(out123_handle *ao, void **buffer, size_t *bytes)
+{
+	long rate;
+	int channels, encoding, framesize;
+	size_t count;
+
+	debug3( "[%ld]out123_play_begin(%p, %"SIZE_P")", (long)getpid()
+	,	(void*)ao, bytes ? (size_p)*bytes : 0 );
+	if(!ao)
+		return OUT123_ERR;
+	ao->errcode = 0;
+	ao->play_begun = 0;
+	if(!buffer || !bytes)
+		return out123_seterr(ao, OUT123_ARG_ERROR);
+	/* Same as out123_play(): continue if paused. */
+	if(ao->state != play_live)
+	{
+		if(ao->state == play_paused)
+			out123_continue(ao);
+		if(ao->state != play_live)
+			return out123_seterr(ao, OUT123_NOT_LIVE);
+	}
+	conv_client_format(ao, &rate, &channels, &encoding, &framesize);
+	count = *bytes ? *bytes : (size_t)PLAY_BEGIN_FRAMES*framesize;
+	count -= count % framesize;
+	if(!count)
+		return out123_seterr(ao, OUT123_ARG_ERROR);
+	/* The device buffer itself if nothing is in between. */
+	if(
 #ifndef NOXFERMEM
-	if(have_buffer(ao))
-		return buffer_write(ao, bytes, count);
-	else
+	   !have_buffer(ao) &&
 #endif
-	do /* Playback in a loop to be able to continue after interruptions. */
+	   !ao->conv && ao->begin_write )
 	{
-		errno = 0;
-		written = ao->write(ao, (unsigned char*)bytes, (int)count);
-		debug4( "written: %d errno: %i (%s), keep_on=%d"
-		,	written, errno, strerror(errno)
-		,	ao->flags & OUT123_KEEP_PLAYING );
-		if(written >= 0){ sum+=written; count -= written; }
-		else if(errno != EINTR)
+		void *region;
+		size_t size = count;
+		/* Waiting for device space happens here. */
+		double start = write_clock();
+		int ret = ao->begin_write(ao, &region, &size);
+		write_done(ao, start, size);
+		if(ret < 0)
 		{
-			ao->errcode = OUT123_DEV_PLAY;
 			if(!AOQUIET)
-				error1("Error in writing audio (%s?)!", strerror(errno));
-			/* If written < 0, this is a serious issue ending this playback round. */
-			break;
+				error("Error getting device buffer region.");
+			return out123_seterr(ao, OUT123_DEV_PLAY);
 		}
-	} while(count && ao->flags & OUT123_KEEP_PLAYING);
+		if(ret == 0 && size)
+		{
+			ao->play_begun = 2;
+			ao->play_size = size;
+			*buffer = region;
+			*bytes = size;
+			return OUT123_OK;
+		}
+	}
+#ifndef NOXFERMEM
+	/* Or the memory of the buffer. */
+	if(have_buffer(ao) && !ao->conv)
+	{
+		void *region;
+		size_t size = count;
+		int ret = buffer_begin_write(ao, &region, &size);
+		if(ret < 0)
+			return out123_seterr( ao, ao->errcode
+			?	ao->errcode : OUT123_BUFFER_ERROR );
+		if(ret == 0)
+		{
+			ao->play_begun = 3;
+			ao->play_size = size;
+			*buffer = region;
+			*bytes = size;
+			return OUT123_OK;
+		}
+	}
+#endif
+	/* Otherwise, out123_play_commit() plays from our own buffer. */
+	if(ao->playbuf_size < count)
+	{
+		void *newbuf = realloc(ao->playbuf, count);
+		if(!newbuf)
+			return out123_seterr(ao, OUT123_DOOM);
+		ao->playbuf = newbuf;
+		ao->playbuf_size = count;
+	}
+	ao->play_begun = 1;
+	ao->play_size = count;
+	*buffer = ao->playbuf;
+	*bytes = count;
+	return OUT123_OK;
+}
 
-	debug3( "out123_play(%p, %p, ...) = %"SIZE_P
-	,	(void*)ao, bytes, (size_p)sum );
-	return sum;
+size_t attribute_align_arg
+out123_play_commit(out123_handle *ao, size_t bytes)
+{
+	int begun;
+	double start;
+	int err;
+
+	debug3( "[%ld]out123_play_commit(%p, %"SIZE_P")", (long)getpid()
+	,	(void*)ao, (size_p)bytes );
+	if(!ao)
+		return 0;
+	ao->errcode = 0;
+	begun = ao->play_begun;
+	ao->play_begun = 0;
+	if(!begun)
+	{
+		out123_seterr(ao, OUT123_ARG_ERROR);
+		return 0;
+	}
+	if(bytes > ao->play_size)
+		bytes = ao->play_size;
+	if(begun == 1)
+		return out123_play(ao, ao->playbuf, bytes);
+	if(ao->state != play_live)
+	{
+		out123_seterr(ao, OUT123_NOT_LIVE);
+		return 0;
+	}
+	bytes -= bytes % ao->framesize;
+#ifndef NOXFERMEM
+	if(begun == 3)
+		return buffer_commit_write(ao, bytes);
+#endif
+	start = write_clock();
+	err = ao->commit_write(ao, bytes);
+	write_done(ao, start, bytes);
+	if(err)
+	{
+		if(!AOQUIET)
+			error("Error committing device buffer region.");
+		out123_seterr(ao, OUT123_DEV_PLAY);
+		return 0;
+	}
+	return bytes;
 }
 
 /* Drop means to flush it down. Quickly. */
@@ -674,6 +1092,7 @@ void attribute_align_arg out123_drop(out123_handle *ao)
 	if(!ao)
 		return;
 	ao->errcode = 0;
+	conv_reset(ao);
 #ifndef NOXFERMEM
 	if(have_buffer(ao))
 		buffer_drop(ao);
@@ -700,6 +1119,8 @@ void attribute_align_arg out123_drain(out123_handle *ao)
 		if(ao->state != play_live)
 			return;
 	}
+	if(ao->pulling)
+		pull_finish(ao);
 #ifndef NOXFERMEM
 	if(have_buffer(ao))
 		buffer_drain(ao);
@@ -726,6 +1147,8 @@ void attribute_align_arg out123_ndrain(out123_handle *ao, size_t bytes)
 		if(ao->state != play_live)
 			return;
 	}
+	if(ao->pulling)
+		pull_finish(ao);
 #ifndef NOXFERMEM
 	if(have_buffer(ao))
 		buffer_ndrain(ao, bytes);
@@ -795,6 +1218,17 @@ static int open_fake_module(out123_handle *ao, const char *driver)
 		ao->close = raw_close;
 	}
 	else
+	if(!strcmp("rawidx", driver))
+	{
+		ao->propflags &= ~OUT123_PROP_LIVE;
+		ao->open  = rawidx_open;
+		ao->get_formats = raw_formats;
+		ao->write = rawidx_write;
+		ao->flush = builtin_nothing;
+		ao->drain = wav_drain;
+		ao->close = rawidx_close;
+	}
+	else
 	if(!strcmp("wav", driver))
 	{
 		ao->propflags &= ~OUT123_PROP_LIVE;
@@ -866,6 +1300,12 @@ static void check_output_module( out123_handle *ao
 		fprintf( stderr, "Trying output module: %s, device: %s\n"
 		,	name, ao->device ? ao->device : "<nil>" );
 
+	/* Several outputs at once, no module of that name to look for. */
+	if(strchr(name, '+'))
+	{
+		tee_init(ao, name);
+		return;
+	}
 	/* Use internal code. */
 	if(open_fake_module(ao, name) == OUT123_OK)
 		return;
@@ -897,8 +1337,8 @@ static void check_output_module( out123_handle *ao
 		ao->format = -1;
 		result = aoopen(ao);
 		debug1("ao->open() = %i", result);
-		if(result >= 0) /* Opening worked, close again. */
-			ao->close(ao);
+		if(result >= 0) /* Opening worked, keep it for the format query. */
+			ao->probed = 1;
 		else if(ao->deinit)
 			ao->deinit(ao); /* Failed, ensure that cleanup after init_output() occurs. */
 	}
@@ -957,6 +1397,8 @@ out123_drivers(out123_handle *ao, char ***names, char ***descr)
 	if(
 		stringlists_add( &tmpnames, &tmpdescr
 		,	"raw", "raw headerless stream (builtin)", &count )
+	||	stringlists_add( &tmpnames, &tmpdescr
+		,	"rawidx", "raw PCM in chunks with index file (builtin)", &count )
 	||	stringlists_add( &tmpnames, &tmpdescr
 		,	"cdr", "compact disc digital audio stream (builtin)", &count )
 	||	stringlists_add( &tmpnames, &tmpdescr
@@ -1012,6 +1454,112 @@ out123_driver_info(out123_handle *ao, char **driver, char **device)
 	return OUT123_OK;
 }
 
+/* The format cache: a plain list, as there are only a few dozen
+   combinations of rate and channels to try. */
+
+void fmtcache_clear(out123_handle *ao)
+{
+	if(ao->fmtcache)
+		free(ao->fmtcache);
+	ao->fmtcache = NULL;
+	ao->fmtcache_fill = 0;
+	ao->fmtcache_size = 0;
+}
+
+/* Index of the entry for rate and channels, -1 if not cached. */
+static int fmtcache_find(out123_handle *ao, long rate, int channels)
+{
+	int i;
+	for(i=1; i<ao->fmtcache_fill; ++i)
+		if(ao->fmtcache[i].rate == rate && ao->fmtcache[i].channels == channels)
+			return i;
+	return -1;
+}
+
+/* Store a probed entry, index 0 for the default format.
+   Running out of memory just means not caching. */
+static void fmtcache_put(out123_handle *ao, int index, const struct mpg123_fmt *fmt)
+{
+	if(!ao->fmtcache_on)
+		return;
+	if(!ao->fmtcache)
+	{
+		if(!(ao->fmtcache = malloc(sizeof(*ao->fmtcache)*16)))
+			return;
+		ao->fmtcache_size = 16;
+		ao->fmtcache_fill = 1;
+		ao->fmtcache[0].rate = 0;
+	}
+	if(index)
+	{
+		index = fmtcache_find(ao, fmt->rate, fmt->channels);
+		if(index < 0)
+		{
+			if(ao->fmtcache_fill == ao->fmtcache_size)
+			{
+				struct mpg123_fmt *nc = realloc( ao->fmtcache
+				,	sizeof(*nc)*ao->fmtcache_size*2 );
+				if(!nc)
+					return;
+				ao->fmtcache = nc;
+				ao->fmtcache_size *= 2;
+			}
+			index = ao->fmtcache_fill++;
+		}
+	}
+	ao->fmtcache[index] = *fmt;
+}
+
+static void fmtcache_put_encodings( out123_handle *ao, long rate
+,	int channels, int encodings )
+{
+	struct mpg123_fmt fmt;
+	fmt.rate = rate;
+	fmt.channels = channels;
+	fmt.encoding = encodings;
+	fmtcache_put(ao, 1, &fmt);
+}
+
+/* The full answer to out123_formats() from the cache, or -1 if anything
+   is missing there. */
+static int fmtcache_formats( out123_handle *ao, const long *rates
+,	int ratecount, int minchannels, int maxchannels
+,	struct mpg123_fmt **fmtlist )
+{
+	struct mpg123_fmt *fmts;
+	int ri, ch;
+	int fi = 0;
+	int fmtcount = 1;
+	if(!ao->fmtcache_on || !ao->fmtcache_fill || !ao->fmtcache[0].rate)
+		return -1;
+	if(ratecount > 0)
+		fmtcount += ratecount*(maxchannels-minchannels+1);
+	for(ri=0; ri<ratecount; ++ri)
+	for(ch=minchannels; ch<=maxchannels; ++ch)
+		if(fmtcache_find(ao, rates[ri], ch) < 0)
+			return -1;
+	if(!(fmts = malloc(sizeof(*fmts)*fmtcount)))
+		return -1;
+	fmts[0] = ao->fmtcache[0];
+	for(ri=0; ri<ratecount; ++ri)
+	for(ch=minchannels; ch<=maxchannels; ++ch)
+		fmts[++fi] = ao->fmtcache[fmtcache_find(ao, rates[ri], ch)];
+	*fmtlist = fmts;
+	return fmtcount;
+}
+
+static void fmtcache_put_formats( out123_handle *ao
+,	const struct mpg123_fmt *fmts, int fmtcount )
+{
+	int fi;
+	if(fmtcount < 1)
+		return;
+	fmtcache_put(ao, 0, fmts);
+	for(fi=1; fi<fmtcount; ++fi)
+		if(fmts[fi].encoding >= 0)
+			fmtcache_put(ao, fi, fmts+fi);
+}
+
 int attribute_align_arg
 out123_encodings(out123_handle *ao, long rate, int channels)
 {
@@ -1026,11 +1574,22 @@ out123_encodings(out123_handle *ao, long rate, int channels)
 	if(ao->state != play_stopped)
 		return out123_seterr(ao, OUT123_NO_DRIVER);
 
+	if(ao->fmtcache_on)
+	{
+		int fi = fmtcache_find(ao, rate, channels);
+		if(fi > 0)
+			return ao->fmtcache[fi].encoding;
+	}
 	ao->channels = channels;
 	ao->rate     = rate;
 #ifndef NOXFERMEM
 	if(have_buffer(ao))
-		return buffer_encodings(ao);
+	{
+		int enc = buffer_encodings(ao);
+		if(enc >= 0)
+			fmtcache_put_encodings(ao, rate, channels, enc);
+		return enc;
+	}
 	else
 #endif
 	{
@@ -1038,8 +1597,9 @@ out123_encodings(out123_handle *ao, long rate, int channels)
 		/* This tells outputs to choose a fitting format so that ao->open() succeeds
 		   They possibly set a sample rate and channel count they like best.
 		   We should add API to retrieve those defaults, too. */
-		ao->format   = -1;
-		if(aoopen(ao) >= 0)
+		if(!ao->probed)
+			ao->format = -1;
+		if(query_open(ao) >= 0)
 		{
 			/* Need to reset those since the choose-your-format open
 			   call might have changed them. */
@@ -1047,6 +1607,8 @@ out123_encodings(out123_handle *ao, long rate, int channels)
 			ao->rate     = rate;
 			enc = ao->get_formats(ao);
 			ao->close(ao);
+			if(enc >= 0)
+				fmtcache_put_encodings(ao, rate, channels, enc);
 			return enc;
 		}
 		else
@@ -1084,19 +1646,33 @@ out123_formats( out123_handle *ao, const long *rates, int ratecount
 		return out123_seterr(ao, OUT123_ARG_ERROR);
 	*fmtlist = NULL; /* Initialize so free(fmtlist) is always allowed. */
 
+	{
+		int fmtcount = fmtcache_formats( ao, rates, ratecount
+		,	minchannels, maxchannels, fmtlist );
+		if(fmtcount > 0)
+			return fmtcount;
+	}
 #ifndef NOXFERMEM
 	if(have_buffer(ao))
-		return buffer_formats( ao, rates, ratecount
-		                     , minchannels, maxchannels, fmtlist );
+	{
+		int fmtcount = buffer_formats( ao, rates, ratecount
+		,	minchannels, maxchannels, fmtlist );
+		if(fmtcount > 0)
+			fmtcache_put_formats(ao, *fmtlist, fmtcount);
+		return fmtcount;
+	}
 	else
 #endif
 	{
 		/* This tells outputs to choose a fitting format so that ao->open()
-		   succeeds. */
-		ao->format   = -1;
-		ao->rate     = -1;
-		ao->channels = -1;
-		if(aoopen(ao) >= 0)
+		   succeeds. A device still open from probing did so already. */
+		if(!ao->probed)
+		{
+			ao->format   = -1;
+			ao->rate     = -1;
+			ao->channels = -1;
+		}
+		if(query_open(ao) >= 0)
 		{
 			struct mpg123_fmt *fmts;
 			int ri, ch;
@@ -1135,6 +1711,7 @@ out123_formats( out123_handle *ao, const long *rates, int ratecount
 			}
 			ao->close(ao);
 
+			fmtcache_put_formats(ao, fmts, fmtcount);
 			*fmtlist = fmts;
 			return fmtcount;
 		}
@@ -1155,7 +1732,7 @@ size_t attribute_align_arg out123_buffered(out123_handle *ao)
 #ifndef NOXFERMEM
 	if(have_buffer(ao))
 	{
-		size_t fill = buffer_fill(ao);
+		size_t fill = conv_client_bytes(ao, buffer_fill(ao));
 		debug2("out123_buffered(%p) = %"SIZE_P, (void*)ao, (size_p)fill);
 		return fill;
 	}
@@ -1164,23 +1741,63 @@ size_t attribute_align_arg out123_buffered(out123_handle *ao)
 		return 0;
 }
 
+int attribute_align_arg out123_latency( out123_handle *ao
+,	double *device_buffer, size_t *device_fill )
+{
+	double length;
+	size_t fill = 0;
+
+	debug2("[%ld]out123_latency(%p)", (long)getpid(), (void*)ao);
+	if(!ao)
+		return OUT123_ERR;
+	ao->errcode = 0;
+	if(!(ao->state == play_paused || ao->state == play_live))
+		return out123_seterr(ao, OUT123_NOT_LIVE);
+#ifndef NOXFERMEM
+	if(have_buffer(ao))
+	{
+		if(buffer_latency(ao, &length, &fill))
+			return OUT123_ERR;
+	}
+	else
+#endif
+	{
+		/* A paused sensitive output is closed, nothing queued then. */
+		if(!ao->delay)
+			return out123_seterr(ao, OUT123_NOT_SUPPORTED);
+		length = ao->device_length;
+		if( !(ao->state == play_paused && SENSITIVE_OUTPUT(ao))
+		&&	ao->delay(ao, &fill) )
+			return out123_seterr(ao, OUT123_NOT_SUPPORTED);
+	}
+	if(device_buffer)
+		*device_buffer = length;
+	if(device_fill)
+		*device_fill = conv_client_bytes(ao, fill);
+	return OUT123_OK;
+}
+
 int attribute_align_arg out123_getformat( out123_handle *ao
 ,	long *rate, int *channels, int *encoding, int *framesize )
 {
+	long crate;
+	int cchannels, cencoding, cframesize;
+
 	if(!ao)
 		return OUT123_ERR;
 
 	if(!(ao->state == play_paused || ao->state == play_live))
 		return out123_seterr(ao, OUT123_NOT_LIVE);
 
+	conv_client_format(ao, &crate, &cchannels, &cencoding, &cframesize);
 	if(rate)
-		*rate = ao->rate;
+		*rate = crate;
 	if(channels)
-		*channels = ao->channels;
+		*channels = cchannels;
 	if(encoding)
-		*encoding = ao->format;
+		*encoding = cencoding;
 	if(framesize)
-		*framesize = ao->framesize;
+		*framesize = cframesize;
 	return OUT123_OK;
 }
 
@@ -1201,6 +1818,8 @@ static const struct enc_desc encdesc[] =
 ,	{ MPG123_ENC_UNSIGNED_24, "unsigned 24 bit", "u24"  }
 ,	{ MPG123_ENC_FLOAT_32,    "float (32 bit)",  "f32"  }
 ,	{ MPG123_ENC_FLOAT_64,    "float (64 bit)",  "f64"  }
+,	{ MPG123_ENC_FLOAT_16,    "float (16 bit)",  "f16"  }
+,	{ MPG123_ENC_BFLOAT_16,   "bfloat (16 bit)", "bf16" }
 ,	{ MPG123_ENC_SIGNED_8,    "signed 8 bit",    "s8"   }
 ,	{ MPG123_ENC_UNSIGNED_8,  "unsigned 8 bit",  "u8"   }
 ,	{ MPG123_ENC_ULAW_8,      "mu-law (8 bit)",  "ulaw" }
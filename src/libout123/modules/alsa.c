@@ -57,6 +57,16 @@ static const struct {
 };
 #define NUM_FORMATS (sizeof format_map / sizeof format_map[0])
 
+/* The PCM with the way we write to it. */
+struct alsa_dev
+{
+	snd_pcm_t *pcm;
+	int mmap; /* mmap access, for out123_play_begin() */
+	snd_pcm_uframes_t offset; /* region from begin_write_alsa() */
+};
+
+#define PCM(ao) (((struct alsa_dev*)(ao)->userptr)->pcm)
+
 
 static int rates_match(long int desired, unsigned int actual)
 {
@@ -66,12 +76,15 @@ static int rates_match(long int desired, unsigned int actual)
 
 static int initialize_device(out123_handle *ao)
 {
+	struct alsa_dev *dev=(struct alsa_dev*)ao->userptr;
 	snd_pcm_hw_params_t *hw=NULL;
 	snd_pcm_sw_params_t *sw=NULL;
+	snd_pcm_access_mask_t *access=NULL;
+	snd_pcm_access_t chosen;
 	snd_pcm_uframes_t buffer_size;
 	snd_pcm_uframes_t period_size;
 	snd_pcm_format_t format;
-	snd_pcm_t *pcm=(snd_pcm_t*)ao->userptr;
+	snd_pcm_t *pcm=dev->pcm;
 	unsigned int rate;
 	int i;
 
@@ -80,7 +93,13 @@ static int initialize_device(out123_handle *ao)
 		if(!AOQUIET) error("initialize_device(): no configuration available");
 		return -1;
 	}
-	if (snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
+	/* Any interleaved access, ALSA picks mmap first if available. That
+	   enables out123_play_begin() with direct access to the device buffer. */
+	snd_pcm_access_mask_alloca(&access);
+	snd_pcm_access_mask_none(access);
+	snd_pcm_access_mask_set(access, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+	snd_pcm_access_mask_set(access, SND_PCM_ACCESS_RW_INTERLEAVED);
+	if (snd_pcm_hw_params_set_access_mask(pcm, hw, access) < 0) {
 		if(!AOQUIET) error("initialize_device(): device does not support interleaved access");
 		return -1;
 	}
@@ -96,6 +115,10 @@ static int initialize_device(out123_handle *ao)
 		errno = EINVAL;
 		return -1;
 	}
+	if ((ao->flags & OUT123_NATIVE) && snd_pcm_hw_params_set_rate_resample(pcm, hw, 0) < 0) {
+		if(!AOQUIET) error("initialize_device(): cannot disable resampling");
+		return -1;
+	}
 	if (snd_pcm_hw_params_set_format(pcm, hw, format) < 0) {
 		if(!AOQUIET) error1("initialize_device(): cannot set format %s", snd_pcm_format_name(format));
 		return -1;
@@ -111,7 +134,9 @@ static int initialize_device(out123_handle *ao)
 	}
 	if (!rates_match(ao->rate, rate)) {
 		if(!AOQUIET) error2("initialize_device(): rate %ld not available, using %u", ao->rate, rate);
-		/* return -1; */
+		/* Not playing at a wrong speed when we promised native formats. */
+		if (ao->flags & OUT123_NATIVE)
+			return -1;
 	}
 	buffer_size = rate * BUFFER_LENGTH;
 	if (snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer_size) < 0) {
@@ -119,7 +144,11 @@ static int initialize_device(out123_handle *ao)
 		return -1;
 	}
 	debug1("buffer_size=%lu", (unsigned long)buffer_size);
-	period_size = buffer_size / 3; /* 3 periods is so much more common. */
+	period_size = ao->device_period > 0.
+	?	rate * ao->device_period
+	:	buffer_size / 3; /* 3 periods is so much more common. */
+	if(period_size < 1)
+		period_size = 1;
 	if (snd_pcm_hw_params_set_period_size_near(pcm, hw, &period_size, NULL) < 0) {
 		if(!AOQUIET) error("initialize_device(): cannot set period size");
 		return -1;
@@ -129,6 +158,12 @@ static int initialize_device(out123_handle *ao)
 		if(!AOQUIET) error("initialize_device(): cannot set hw params");
 		return -1;
 	}
+	/* What we actually got, for out123_latency(). */
+	if (snd_pcm_hw_params_get_buffer_size(hw, &buffer_size) == 0)
+		ao->device_length = (double)buffer_size/rate;
+	dev->mmap = snd_pcm_hw_params_get_access(hw, &chosen) == 0
+	&&	chosen == SND_PCM_ACCESS_MMAP_INTERLEAVED;
+	debug1("mmap access: %i", dev->mmap);
 
 	snd_pcm_sw_params_alloca(&sw);
 	if (snd_pcm_sw_params_current(pcm, sw) < 0) {
@@ -170,6 +205,8 @@ static int open_alsa(out123_handle *ao)
 {
 	const char *pcm_name;
 	snd_pcm_t *pcm=NULL;
+	struct alsa_dev *dev;
+	int mode = 0;
 	debug1("open_alsa with %p", ao->userptr);
 
 #ifndef DEBUG
@@ -177,11 +214,25 @@ static int open_alsa(out123_handle *ao)
 #endif
 
 	pcm_name = ao->device ? ao->device : "default";
-	if (snd_pcm_open(&pcm, pcm_name, SND_PCM_STREAM_PLAYBACK, 0) < 0) {
+	/* Keep the plug layer from inserting converters, exposing what the
+	   hardware has. */
+	if (ao->flags & OUT123_NATIVE)
+		mode = SND_PCM_NO_AUTO_RESAMPLE|SND_PCM_NO_AUTO_CHANNELS|SND_PCM_NO_AUTO_FORMAT;
+	if (snd_pcm_open(&pcm, pcm_name, SND_PCM_STREAM_PLAYBACK, mode) < 0) {
 		if(!AOQUIET) error1("cannot open device %s", pcm_name);
 		return -1;
 	}
-	ao->userptr = pcm;
+	dev = malloc(sizeof(*dev));
+	if(!dev)
+	{
+		snd_pcm_close(pcm);
+		if(!AOQUIET) error("out of memory");
+		return -1;
+	}
+	dev->pcm = pcm;
+	dev->mmap = 0;
+	dev->offset = 0;
+	ao->userptr = dev;
 	if (ao->format != -1) {
 		/* we're going to play: initalize sample format */
 		return initialize_device(ao);
@@ -194,7 +245,7 @@ static int open_alsa(out123_handle *ao)
 
 static int get_formats_alsa(out123_handle *ao)
 {
-	snd_pcm_t *pcm=(snd_pcm_t*)ao->userptr;
+	snd_pcm_t *pcm=PCM(ao);
 	snd_pcm_hw_params_t *hw;
 	unsigned int rate;
 	int supported_formats, i;
@@ -206,6 +257,8 @@ static int get_formats_alsa(out123_handle *ao)
 	}
 	if (snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED) < 0)
 		return -1;
+	if ((ao->flags & OUT123_NATIVE) && snd_pcm_hw_params_set_rate_resample(pcm, hw, 0) < 0)
+		return -1;
 	if (snd_pcm_hw_params_set_channels(pcm, hw, ao->channels) < 0)
 		return 0;
 	rate = ao->rate;
@@ -221,17 +274,41 @@ static int get_formats_alsa(out123_handle *ao)
 	return supported_formats;
 }
 
+/* snd_pcm_recover() with accounting of underruns for OUT123_UNDERRUNS and
+   OUT123_XRUN_RECOVERY. */
+static int recover_alsa(out123_handle *ao, snd_pcm_t *pcm, int err)
+{
+	struct timeval start, end;
+	int ret;
+
+	gettimeofday(&start, NULL);
+	ret = snd_pcm_recover(pcm, err, 0);
+	gettimeofday(&end, NULL);
+	if(err == -EPIPE)
+	{
+		double took = (end.tv_sec-start.tv_sec) + 1e-6*(end.tv_usec-start.tv_usec);
+		++ao->stats.underruns;
+		if(took > ao->stats.xrun_max)
+			ao->stats.xrun_max = took;
+		AOPROBE2(xrun, ao->stats.underruns, (long)(took*1e6));
+	}
+	return ret;
+}
+
 static int write_alsa(out123_handle *ao, unsigned char *buf, int bytes)
 {
-	snd_pcm_t *pcm=(snd_pcm_t*)ao->userptr;
+	struct alsa_dev *dev=(struct alsa_dev*)ao->userptr;
+	snd_pcm_t *pcm=dev->pcm;
 	snd_pcm_uframes_t frames;
 	snd_pcm_sframes_t written;
 
 	frames = snd_pcm_bytes_to_frames(pcm, bytes);
 	while
 	( /* Try to write, recover if error, try again if recovery successful. */
-		(written = snd_pcm_writei(pcm, buf, frames)) < 0
-		&& snd_pcm_recover(pcm, (int)written, 0) == 0
+		(written = dev->mmap
+		?	snd_pcm_mmap_writei(pcm, buf, frames)
+		:	snd_pcm_writei(pcm, buf, frames)) < 0
+		&& recover_alsa(ao, pcm, (int)written) == 0
 	)
 	{
 		debug2("recovered from alsa issue %i while trying to write %lu frames", (int)written, (unsigned long)frames);
@@ -244,9 +321,86 @@ static int write_alsa(out123_handle *ao, unsigned char *buf, int bytes)
 	else return snd_pcm_frames_to_bytes(pcm, written);
 }
 
+/* Wait for free space in the device buffer and hand out the first
+   contiguous part of it. */
+static int begin_write_alsa(out123_handle *ao, void **buf, size_t *bytes)
+{
+	struct alsa_dev *dev=(struct alsa_dev*)ao->userptr;
+	snd_pcm_t *pcm=dev->pcm;
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t frames;
+	snd_pcm_sframes_t avail;
+	int err;
+
+	if(!dev->mmap)
+		return 1;
+	while((avail = snd_pcm_avail_update(pcm)) < 1)
+	{
+		if(avail < 0)
+			err = (int)avail;
+		/* A full buffer that did not start yet needs a kick. */
+		else if(snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED)
+			err = snd_pcm_start(pcm);
+		else if((err = snd_pcm_wait(pcm, -1)) > 0)
+			err = 0;
+		if(err < 0 && recover_alsa(ao, pcm, err) < 0)
+		{
+			error1("Fatal problem with alsa output, error %i.", err);
+			return -1;
+		}
+	}
+	frames = snd_pcm_bytes_to_frames(pcm, *bytes);
+	if(frames > (snd_pcm_uframes_t)avail)
+		frames = avail;
+	while((err = snd_pcm_mmap_begin(pcm, &areas, &dev->offset, &frames)) < 0)
+	{
+		if(recover_alsa(ao, pcm, err) < 0)
+		{
+			error1("Fatal problem with alsa output, error %i.", err);
+			return -1;
+		}
+	}
+	/* Interleaved: all channels start at the first one's address. */
+	*buf = (char*)areas[0].addr + (areas[0].first + dev->offset*areas[0].step)/8;
+	*bytes = snd_pcm_frames_to_bytes(pcm, frames);
+	return 0;
+}
+
+static int commit_write_alsa(out123_handle *ao, size_t bytes)
+{
+	struct alsa_dev *dev=(struct alsa_dev*)ao->userptr;
+	snd_pcm_t *pcm=dev->pcm;
+	snd_pcm_uframes_t frames = snd_pcm_bytes_to_frames(pcm, bytes);
+	snd_pcm_sframes_t committed;
+
+	committed = snd_pcm_mmap_commit(pcm, dev->offset, frames);
+	if(committed < 0 || (snd_pcm_uframes_t)committed != frames)
+	{
+		/* An underrun in between loses the region, but not the device. */
+		recover_alsa(ao, pcm, committed < 0 ? (int)committed : -EPIPE);
+		return -1;
+	}
+	/* Direct access does not trigger the start threshold. */
+	if(snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED)
+		snd_pcm_start(pcm);
+	return 0;
+}
+
+static int delay_alsa(out123_handle *ao, size_t *bytes)
+{
+	snd_pcm_t *pcm=ao->userptr ? PCM(ao) : NULL;
+	snd_pcm_sframes_t frames;
+
+	if(!pcm || snd_pcm_delay(pcm, &frames) < 0)
+		return -1;
+	/* Negative in case of an underrun. */
+	*bytes = frames > 0 ? snd_pcm_frames_to_bytes(pcm, frames) : 0;
+	return 0;
+}
+
 static void flush_alsa(out123_handle *ao)
 {
-	snd_pcm_t *pcm=(snd_pcm_t*)ao->userptr;
+	snd_pcm_t *pcm=PCM(ao);
 
 	/* is this the optimal solution? - we should figure out what we really whant from this function */
 
@@ -259,18 +413,20 @@ debug("alsa flush done");
 
 static void drain_alsa(out123_handle *ao)
 {
-	snd_pcm_t *pcm=(snd_pcm_t*)ao->userptr;
+	snd_pcm_t *pcm=PCM(ao);
 	debug1("drain_alsa with %p", ao->userptr);
 	snd_pcm_drain(pcm);
 }
 
 static int close_alsa(out123_handle *ao)
 {
-	snd_pcm_t *pcm=(snd_pcm_t*)ao->userptr;
+	struct alsa_dev *dev=(struct alsa_dev*)ao->userptr;
 	debug1("close_alsa with %p", ao->userptr);
-	if(pcm != NULL) /* be really generous for being called without any device opening */
+	if(dev != NULL) /* be really generous for being called without any device opening */
 	{
+		snd_pcm_t *pcm=dev->pcm;
 		ao->userptr = NULL; /* Should alsa do this or the module wrapper? */
+		free(dev);
 		return snd_pcm_close(pcm);
 	}
 	else return 0;
@@ -287,6 +443,9 @@ static int init_alsa(out123_handle* ao)
 	ao->write = write_alsa;
 	ao->get_formats = get_formats_alsa;
 	ao->close = close_alsa;
+	ao->delay = delay_alsa;
+	ao->begin_write = begin_write_alsa;
+	ao->commit_write = commit_write_alsa;
 
 	/* Success */
 	return 0;
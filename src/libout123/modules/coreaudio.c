@@ -1,11 +1,19 @@
 /*
 	coreaudio: audio output on MacOS X
 
-	copyright ?-2016 by the mpg123 project - free software under the terms of the GPL 2
+	copyright ?-2026 by the mpg123 project - free software under the terms of the GPL 2
 	see COPYING and AUTHORS files in distribution or http://mpg123.org
 	initially written by Guillaume Outters
 	modified by Nicholas J Humfrey to use SFIFO code
 	modified by Taihei Monma to use AudioUnit and AudioConverter APIs
+
+	The output unit takes our PCM as it is in its render callback, which
+	copies it from a lock-free ring buffer (or gets it from the fill
+	callback when pulling). There is no AudioConverter in between on our
+	side, 32 bit float is what the unit works with anyway. The callback
+	never waits, missing data is played as silence. The positions in the
+	ring count PCM frames and only grow, the writer owns one and the
+	callback the other.
 */
 
 
@@ -40,12 +48,11 @@
 #endif
 #include <AudioUnit/AudioUnit.h>
 #include <AudioToolbox/AudioToolbox.h>
+#if !TARGET_OS_IPHONE
+#include <CoreAudio/CoreAudio.h>
+#endif
 #include <errno.h>
 
-/* Including the sfifo code locally, to avoid module linkage issues. */
-#define SFIFO_STATIC
-#include "sfifo.c"
-
 #include "debug.h"
 
 /* Duration of the ring buffer in seconds.
@@ -54,118 +61,195 @@
    hardware that actually allows such large buffers. */
 #define FIFO_DURATION (ao->device_buffer > 0. ? ao->device_buffer : 0.2)
 
+#define LOAD(var)         __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define STORE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELEASE)
+
 
 typedef struct mpg123_coreaudio
 {
-	AudioConverterRef converter;
 	AudioUnit outputUnit;
 	int open;
 	char play;
-	int channels;
-	int bps;
-	int play_done;
-	int decode_done;
-
-	/* Convertion buffer */
-	unsigned char * buffer;
-	size_t buffer_size;
-	
-	/* Ring buffer */
-	sfifo_t fifo;
-
+	int framesize;
+	long rate;
+	UInt32 period; /* IO buffer size of the device in PCM frames */
+
+	/* Ring buffer, positions in PCM frames wrapping with size_t */
+	unsigned char *rb;
+	size_t rb_frames; /* power of two */
+	size_t rb_read;
+	size_t rb_write;
+	size_t rb_discard; /* flush: position the callback skips to */
+
+	/* Pull mode: fill() called in the render callback. */
+	out123_fill_func pull;
+	void *pulldata;
+	int pull_done;
 } mpg123_coreaudio_t;
 
 
-
-static OSStatus playProc(AudioConverterRef inAudioConverter,
-						 UInt32 *ioNumberDataPackets,
-                         AudioBufferList *outOutputData,
-                         AudioStreamPacketDescription **outDataPacketDescription,
-                         void* inClientData)
+/* Copy what the ring has into dst, in up to two pieces around the wrap. */
+static size_t ring_read(mpg123_coreaudio_t *ca, unsigned char *dst, size_t frames)
 {
-	out123_handle *ao = (out123_handle*)inClientData;
-	mpg123_coreaudio_t *ca = (mpg123_coreaudio_t *)ao->userptr;
-	long n;
+	size_t read = ca->rb_read;
+	size_t write = LOAD(ca->rb_write);
+	size_t discard = LOAD(ca->rb_discard);
+	size_t pos, first;
+
+	if(discard != read && discard-read <= write-read)
+		read = discard;
+	if(frames > write-read)
+		frames = write-read;
+	pos = read & (ca->rb_frames-1);
+	first = ca->rb_frames-pos < frames ? ca->rb_frames-pos : frames;
+	memcpy(dst, ca->rb+pos*ca->framesize, first*ca->framesize);
+	memcpy( dst+first*ca->framesize, ca->rb
+	,	(frames-first)*ca->framesize );
+	STORE(ca->rb_read, read+frames);
+	return frames;
+}
 
-	/* This is not actually a loop. See the early break. */
-	for(n = 0; n < outOutputData->mNumberBuffers; n++)
-	{
-		unsigned int wanted = *ioNumberDataPackets * ca->channels * ca->bps;
-		unsigned char *dest;
-		unsigned int read;
-		int avail;
+/* The counterpart for the writer, up to the ring size ahead. */
+static size_t ring_write(mpg123_coreaudio_t *ca, const unsigned char *src, size_t frames)
+{
+	size_t write = ca->rb_write;
+	size_t space = ca->rb_frames - (write-LOAD(ca->rb_read));
+	size_t pos = write & (ca->rb_frames-1);
+	size_t first;
+
+	if(frames > space)
+		frames = space;
+	first = ca->rb_frames-pos < frames ? ca->rb_frames-pos : frames;
+	memcpy(ca->rb+pos*ca->framesize, src, first*ca->framesize);
+	memcpy( ca->rb, src+first*ca->framesize
+	,	(frames-first)*ca->framesize );
+	STORE(ca->rb_write, write+frames);
+	return frames;
+}
 
-		/* Any buffer count > 1 would wreck havoc with this code. */
-		if(n > 0)
-			break;
+static size_t pull_data(mpg123_coreaudio_t *ca, unsigned char *dst, size_t bytes)
+{
+	size_t got = 0;
 
-		if(ca->buffer_size < wanted) {
-			debug1("Allocating %d byte sample conversion buffer", wanted);
-			ca->buffer = realloc( ca->buffer, wanted);
-			ca->buffer_size = wanted;
-		}
-		dest = ca->buffer;
-		if(!dest)
-			return -1;
+	while(!ca->pull_done && got < bytes)
+	{
+		size_t n = ca->pull(ca->pulldata, dst+got, bytes-got);
+		if(!n)
+			ca->pull_done = 1;
+		got += n > bytes-got ? bytes-got : n;
+	}
+	return got;
+}
 
-		/* Only play if we have data left */
-		while((avail=sfifo_used( &ca->fifo )) < wanted && !ca->decode_done)
-		{
-			int ms = (wanted-avail)/ao->framesize*1000/ao->rate;
-			debug3("waiting for more input, %d ms missing (%i < %u)"
-			,	ms, avail, wanted);
-			usleep(ms*100); /* Wait for 1/10th of the missing duration. Might want to adjust. */
-		}
-		if(avail > wanted)
-			avail = wanted;
-		else if(ca->decode_done)
-			ca->play_done = 1;
-
-		/* Read audio from FIFO to CoreAudio's buffer */
-		read = sfifo_read(&ca->fifo, dest, avail);
-		
-		if(read!=avail)
-			warning2("Error reading from the ring buffer (avail=%u, read=%u).\n", avail, read);
-		
-		outOutputData->mBuffers[n].mDataByteSize = read;
-		outOutputData->mBuffers[n].mData = dest;
+/* Interleaved data, so one buffer, filled right where the unit wants it. */
+static OSStatus renderProc( void *inRefCon, AudioUnitRenderActionFlags *inActionFlags
+,	const AudioTimeStamp *inTimeStamp, UInt32 inBusNumber
+,	UInt32 inNumFrames, AudioBufferList *ioData )
+{
+	mpg123_coreaudio_t *ca = (mpg123_coreaudio_t *)inRefCon;
+	unsigned char *dest = ioData->mBuffers[0].mData;
+	size_t bytes = (size_t)inNumFrames*ca->framesize;
+	size_t got;
+
+	if(bytes > ioData->mBuffers[0].mDataByteSize)
+		bytes = ioData->mBuffers[0].mDataByteSize - ioData->mBuffers[0].mDataByteSize % ca->framesize;
+	if(ca->pull)
+		got = pull_data(ca, dest, bytes);
+	else
+		got = ring_read(ca, dest, bytes/ca->framesize)*ca->framesize;
+	if(got < bytes)
+	{
+		debug1("filling up %"SIZE_P" bytes with zeros", (size_p)(bytes-got));
+		memset(dest+got, 0, bytes-got);
 	}
-	
-	return noErr; 
+	if(!got)
+		*inActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+	ioData->mBuffers[0].mDataByteSize = bytes;
+	return noErr;
 }
 
-static OSStatus convertProc(void *inRefCon, AudioUnitRenderActionFlags *inActionFlags,
-                            const AudioTimeStamp *inTimeStamp, UInt32 inBusNumber,
-                            UInt32 inNumFrames, AudioBufferList *ioData)
+/* Ask for the IO buffer size from OUT123_DEVICEPERIOD and see what we got. */
+static void setup_period(out123_handle *ao, mpg123_coreaudio_t *ca)
 {
-	AudioStreamPacketDescription* outPacketDescription = NULL;
-	out123_handle *ao = (out123_handle*)inRefCon;
-	mpg123_coreaudio_t *ca = (mpg123_coreaudio_t *)ao->userptr;
-	OSStatus err= noErr;
-	
-	err = AudioConverterFillComplexBuffer(ca->converter, playProc, inRefCon, &inNumFrames, ioData, outPacketDescription);
-	
-	return err;
+	UInt32 size = sizeof(ca->period);
+
+	ca->period = 0;
+#if !TARGET_OS_IPHONE
+	if(ao->device_period > 0.)
+	{
+		UInt32 frames = (UInt32)(ao->device_period*ao->rate+0.5);
+		if(frames < 1)
+			frames = 1;
+		if( AudioUnitSetProperty( ca->outputUnit, kAudioDevicePropertyBufferFrameSize
+		,	kAudioUnitScope_Global, 0, &frames, sizeof(frames) ) && !AOQUIET )
+			warning1("cannot set IO buffer size of %lu frames", (unsigned long)frames);
+	}
+	if(AudioUnitGetProperty( ca->outputUnit, kAudioDevicePropertyBufferFrameSize
+	,	kAudioUnitScope_Global, 0, &ca->period, &size ))
+		ca->period = 0;
+#endif
+	debug1("IO buffer size %lu", (unsigned long)ca->period);
 }
 
+static int close_coreaudio(out123_handle *ao);
+
 static int open_coreaudio(out123_handle *ao)
 {
 	mpg123_coreaudio_t* ca = (mpg123_coreaudio_t*)ao->userptr;
-	UInt32 size;
 	MPG123_AUDIOCOMPONENTDESCRIPTION desc;
 	MPG123_AUDIOCOMPONENT comp;
 	AudioStreamBasicDescription inFormat;
-	AudioStreamBasicDescription outFormat;
 	AURenderCallbackStruct  renderCallback;
-	Boolean outWritable;
-	
+	int bps;
+
 	/* Initialize our environment */
+	ca->open = 0;
 	ca->play = 0;
-	ca->buffer = NULL;
-	ca->buffer_size = 0;
-	ca->play_done = 0;
-	ca->decode_done = 0;
-	
+	ca->rb = NULL;
+	ca->rb_frames = 0;
+	ca->rb_read = ca->rb_write = ca->rb_discard = 0;
+	ca->pull = ao->fill_device ? ao->fill : NULL;
+	ca->pulldata = ao->filldata;
+	ca->pull_done = 0;
+
+	/* Specify the input PCM format, which the unit accepts as it is. */
+	switch(ao->format)
+	{
+		case -1: /* Query mode, just see if there is a unit. */
+			bps = 0;
+			break;
+		case MPG123_ENC_SIGNED_16:
+			bps = 2;
+			break;
+		case MPG123_ENC_SIGNED_8:
+		case MPG123_ENC_UNSIGNED_8:
+			bps = 1;
+			break;
+		case MPG123_ENC_SIGNED_32:
+		case MPG123_ENC_FLOAT_32:
+			bps = 4;
+			break;
+		default:
+			if(!AOQUIET)
+				error1("unsupported encoding 0x%x", ao->format);
+			return -1;
+	}
+	memset(&inFormat, 0, sizeof(inFormat));
+	inFormat.mSampleRate = ao->rate;
+	inFormat.mChannelsPerFrame = ao->channels;
+	inFormat.mFormatID = kAudioFormatLinearPCM;
+	inFormat.mFormatFlags = kAudioFormatFlagsNativeEndian | kLinearPCMFormatFlagIsPacked;
+	if(ao->format == MPG123_ENC_FLOAT_32)
+		inFormat.mFormatFlags |= kLinearPCMFormatFlagIsFloat;
+	else if(ao->format != MPG123_ENC_UNSIGNED_8)
+		inFormat.mFormatFlags |= kLinearPCMFormatFlagIsSignedInteger;
+	inFormat.mBitsPerChannel = bps << 3;
+	inFormat.mBytesPerPacket = bps*inFormat.mChannelsPerFrame;
+	inFormat.mFramesPerPacket = 1;
+	inFormat.mBytesPerFrame = bps*inFormat.mChannelsPerFrame;
+	ca->framesize = inFormat.mBytesPerFrame;
+	ca->rate = ao->rate;
+
 	/* Get the default audio output unit */
 	desc.componentType = kAudioUnitType_Output;
 #if TARGET_OS_IPHONE
@@ -190,107 +274,81 @@ static int open_coreaudio(out123_handle *ao)
 			error("AudioComponentInstanceNew failed");
 		return (-1);
 	}
-	
-	if(AudioUnitInitialize(ca->outputUnit))
-	{
-		if(!AOQUIET)
-			error("AudioUnitInitialize failed");
-		return (-1);
-	}
-	
-	/* Specify the output PCM format */
-	AudioUnitGetPropertyInfo(ca->outputUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &size, &outWritable);
-	if(AudioUnitGetProperty(ca->outputUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &outFormat, &size))
-	{
-		if(!AOQUIET)
-			error("AudioUnitGetProperty(kAudioUnitProperty_StreamFormat) failed");
-		return (-1);
-	}
-	
-	if(AudioUnitSetProperty(ca->outputUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &outFormat, size))
+	ca->open = 1;
+	/* Formats are fixed here, nothing more to set up for querying them. */
+	if(!bps || ao->rate <= 0 || ao->channels <= 0)
+		return 0;
+
+	if(AudioUnitSetProperty(ca->outputUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &inFormat, sizeof(inFormat)))
 	{
 		if(!AOQUIET)
 			error("AudioUnitSetProperty(kAudioUnitProperty_StreamFormat) failed");
+		close_coreaudio(ao);
 		return (-1);
 	}
-	
-	/* Specify the input PCM format */
-	ca->channels = ao->channels;
-	inFormat.mSampleRate = ao->rate;
-	inFormat.mChannelsPerFrame = ao->channels;
-	inFormat.mFormatID = kAudioFormatLinearPCM;
-#ifdef _BIG_ENDIAN
-	inFormat.mFormatFlags = kLinearPCMFormatFlagIsPacked | kLinearPCMFormatFlagIsBigEndian;
-#else
-	inFormat.mFormatFlags = kLinearPCMFormatFlagIsPacked;
-#endif
-	
-	switch(ao->format)
+#if !TARGET_OS_IPHONE
+	/* Mono on the first two device channels. */
+	if(ao->channels == 1)
 	{
-		case MPG123_ENC_SIGNED_16:
-			inFormat.mFormatFlags |= kLinearPCMFormatFlagIsSignedInteger;
-			ca->bps = 2;
-			break;
-		case MPG123_ENC_SIGNED_8:
-			inFormat.mFormatFlags |= kLinearPCMFormatFlagIsSignedInteger;
-			ca->bps = 1;
-			break;
-		case MPG123_ENC_UNSIGNED_8:
-			ca->bps = 1;
-			break;
-		case MPG123_ENC_SIGNED_32:
-			inFormat.mFormatFlags |= kLinearPCMFormatFlagIsSignedInteger;
-			ca->bps = 4;
-			break;
-		case MPG123_ENC_FLOAT_32:
-			inFormat.mFormatFlags |= kLinearPCMFormatFlagIsFloat;
-			ca->bps = 4;
-			break;
+		SInt32 channelMap[2] = { 0, 0 };
+		if(AudioUnitSetProperty(ca->outputUnit, kAudioOutputUnitProperty_ChannelMap, kAudioUnitScope_Input, 0, channelMap, sizeof(channelMap)) && !AOQUIET)
+			warning("AudioUnitSetProperty(kAudioOutputUnitProperty_ChannelMap) failed");
 	}
-	
-	inFormat.mBitsPerChannel = ca->bps << 3;
-	inFormat.mBytesPerPacket = ca->bps*inFormat.mChannelsPerFrame;
-	inFormat.mFramesPerPacket = 1;
-	inFormat.mBytesPerFrame = ca->bps*inFormat.mChannelsPerFrame;
-	
+#endif
+	setup_period(ao, ca);
+
 	/* Add our callback - but don't start it yet */
 	memset(&renderCallback, 0, sizeof(AURenderCallbackStruct));
-	renderCallback.inputProc = convertProc;
-	renderCallback.inputProcRefCon = ao;
+	renderCallback.inputProc = renderProc;
+	renderCallback.inputProcRefCon = ca;
 	if(AudioUnitSetProperty(ca->outputUnit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0, &renderCallback, sizeof(AURenderCallbackStruct)))
 	{
 		if(!AOQUIET)
 			error("AudioUnitSetProperty(kAudioUnitProperty_SetRenderCallback) failed");
+		close_coreaudio(ao);
 		return(-1);
 	}
-	
-	
-	/* Open an audio I/O stream and create converter */
-	if (ao->rate > 0 && ao->channels >0 ) {
-		int ringbuffer_len;
 
-		if(AudioConverterNew(&inFormat, &outFormat, &(ca->converter)))
+	/* The ring buffer, at least two IO buffers. */
+	{
+		size_t frames = (size_t)(ao->rate * FIFO_DURATION);
+		ca->rb_frames = 1;
+		while(ca->rb_frames < frames || ca->rb_frames < 2*(size_t)ca->period)
+			ca->rb_frames *= 2;
+	}
+	debug2( "Allocating ring buffer of %"SIZE_P" frames (%f seconds)"
+	,	(size_p)ca->rb_frames, (float)FIFO_DURATION );
+	if(!ca->pull && !(ca->rb = malloc(ca->rb_frames*ca->framesize)))
+	{
+		if(!AOQUIET)
+			error("failed to allocate ring buffer");
+		close_coreaudio(ao);
+		return -1;
+	}
+	ao->device_length = (double)((ca->pull ? 0 : ca->rb_frames) + ca->period)
+	/	ao->rate;
+
+	if(AudioUnitInitialize(ca->outputUnit))
+	{
+		if(!AOQUIET)
+			error("AudioUnitInitialize failed");
+		close_coreaudio(ao);
+		return (-1);
+	}
+
+	/* Pulling, there is nothing to wait for. */
+	ao->fill_native = ca->pull != NULL;
+	if(ca->pull)
+	{
+		if(AudioOutputUnitStart(ca->outputUnit))
 		{
 			if(!AOQUIET)
-				error("AudioConverterNew failed");
-			return(-1);
-		}
-		if(ao->channels == 1) {
-			SInt32 channelMap[2] = { 0, 0 };
-			if(AudioConverterSetProperty(ca->converter, kAudioConverterChannelMap, sizeof(channelMap), channelMap))
-			{
-				if(!AOQUIET)
-					error("AudioConverterSetProperty(kAudioConverterChannelMap) failed");
-				return(-1);
-			}
+				error("AudioOutputUnitStart failed");
+			close_coreaudio(ao);
+			return -1;
 		}
-		
-		/* Initialise FIFO */
-		ringbuffer_len = ao->rate * FIFO_DURATION * ca->bps * ao->channels;
-		debug2( "Allocating %d byte ring-buffer (%f seconds)", ringbuffer_len, (float)FIFO_DURATION);
-		sfifo_init( &ca->fifo, ringbuffer_len );
+		ca->play = 1;
 	}
-	
 	return(0);
 }
 
@@ -299,84 +357,109 @@ static int get_formats_coreaudio(out123_handle *ao)
 	return MPG123_ENC_SIGNED_16|MPG123_ENC_SIGNED_8|MPG123_ENC_UNSIGNED_8|MPG123_ENC_SIGNED_32|MPG123_ENC_FLOAT_32;
 }
 
+static int start_coreaudio(out123_handle *ao, mpg123_coreaudio_t *ca)
+{
+	if(!ca->play)
+	{
+		if(AudioOutputUnitStart(ca->outputUnit))
+		{
+			if(!AOQUIET)
+				error("AudioOutputUnitStart failed");
+			return(-1);
+		}
+		ca->play = 1;
+	}
+	return 0;
+}
+
 static int write_coreaudio(out123_handle *ao, unsigned char *buf, int len)
 {
 	mpg123_coreaudio_t* ca = (mpg123_coreaudio_t*)ao->userptr;
-	int len_remain = len;
+	size_t frames_remain;
 
-	/* Some busy waiting, but feed what is possible. */
-	while(len_remain) /* Note: input len is multiple of framesize! */
+	if(!ca->rb)
+		return -1;
+	frames_remain = len/ca->framesize;
+	/* Some waiting, but feed what is possible. */
+	while(frames_remain)
 	{
-		int block = sfifo_space(&ca->fifo);
-		block -= block % ao->framesize;
-		if(block > len_remain)
-			block = len_remain;
-		if(block)
-		{
-			sfifo_write(&ca->fifo, buf, block);
-			len_remain -= block;
-			buf += block;
-			/* Start playback now that we have something to play */
-			if(!ca->play && (sfifo_used(&ca->fifo) > (sfifo_size(&ca->fifo)/2)))
-			{
-				if(AudioOutputUnitStart(ca->outputUnit))
-				{
-					if(!AOQUIET)
-						error("AudioOutputUnitStart failed");
-					return(-1);
-				}
-				ca->play = 1;
-			}
-		}
+		size_t block = ring_write(ca, buf, frames_remain);
+		frames_remain -= block;
+		buf += block*ca->framesize;
+		/* Start playback now that we have something to play */
+		if( !ca->play && ca->rb_write-LOAD(ca->rb_read) > ca->rb_frames/2
+		&&  start_coreaudio(ao, ca) )
+			return -1;
 		/* If there is no room, then sleep for a bit, but not too long. */
-		if(len_remain)
+		if(frames_remain)
 			usleep( (0.1*FIFO_DURATION) * 1000000 );
 	}
 
 	return len;
 }
 
-static int close_coreaudio(out123_handle *ao)
+static int delay_coreaudio(out123_handle *ao, size_t *bytes)
 {
 	mpg123_coreaudio_t* ca = (mpg123_coreaudio_t*)ao->userptr;
 
-	if (ca) {
-		ca->decode_done = 1;
-		while(!ca->play_done && ca->play)
+	if(!ca || !ca->open)
+		return -1;
+	*bytes = ( (ca->rb ? ca->rb_write-LOAD(ca->rb_read) : 0) + ca->period )
+	*	ca->framesize;
+	return 0;
+}
+
+static void drain_coreaudio(out123_handle *ao)
+{
+	mpg123_coreaudio_t* ca = (mpg123_coreaudio_t*)ao->userptr;
+
+	if(!ca || !ca->open)
+		return;
+	if(ca->pull)
+	{
+		while(!LOAD(ca->pull_done))
 			usleep((0.1*FIFO_DURATION)*1000000);
+		return;
+	}
+	if(ca->rb_write != LOAD(ca->rb_read) && start_coreaudio(ao, ca))
+		return;
+	while(ca->rb_write != LOAD(ca->rb_read))
+		usleep((0.1*FIFO_DURATION)*1000000);
+}
+
+static int close_coreaudio(out123_handle *ao)
+{
+	mpg123_coreaudio_t* ca = (mpg123_coreaudio_t*)ao->userptr;
+
+	if (ca && ca->open) {
+		/* Still play what is there, as always. */
+		if(!ca->pull)
+			drain_coreaudio(ao);
 		/* No matter the error code, we want to close it (by brute force if necessary) */
 		AudioOutputUnitStop(ca->outputUnit);
 		AudioUnitUninitialize(ca->outputUnit);
 		MPG123_AUDIOCOMPONENTINSTANCEDISPOSE(ca->outputUnit);
-		AudioConverterDispose(ca->converter);
-	
-	    /* Free the ring buffer */
-		sfifo_close( &ca->fifo );
-		
-		/* Free the conversion buffer */
-		if (ca->buffer) {
-			free( ca->buffer );
-			ca->buffer = NULL;
-		}
-		
+		ca->open = 0;
+		ca->play = 0;
+	}
+	/* Free the ring buffer */
+	if(ca && ca->rb)
+	{
+		free(ca->rb);
+		ca->rb = NULL;
 	}
 	
 	return 0;
 }
 
+/* The writer may not touch the read position, the callback skips to
+   what was written up to now. */
 static void flush_coreaudio(out123_handle *ao)
 {
 	mpg123_coreaudio_t* ca = (mpg123_coreaudio_t*)ao->userptr;
 
-	/* Flush AudioConverter's buffer */
-	if(AudioConverterReset(ca->converter))
-	{
-		if(!AOQUIET)
-			error("AudioConverterReset failed");
-	}
-	
-	/* Empty out the ring buffer */
-	sfifo_flush( &ca->fifo );	
+	if(ca->rb)
+		STORE(ca->rb_discard, ca->rb_write);
 }
 
 static int deinit_coreaudio(out123_handle* ao)
@@ -402,6 +485,8 @@ static int init_coreaudio(out123_handle* ao)
 	ao->get_formats = get_formats_coreaudio;
 	ao->close = close_coreaudio;
 	ao->deinit = deinit_coreaudio;
+	ao->drain = drain_coreaudio;
+	ao->delay = delay_coreaudio;
 
 	/* Allocate memory for data structure */
 	ao->userptr = malloc( sizeof( mpg123_coreaudio_t ) );
@@ -1,7 +1,7 @@
 /*
 	jack: audio output via JACK Audio Connection Kit
 
-	copyright 2006-2016 by the mpg123 project - free software under the terms of the LGPL 2.1
+	copyright 2006-2026 by the mpg123 project - free software under the terms of the LGPL 2.1
 	see COPYING and AUTHORS files in distribution or http://mpg123.org
 	initially written by Nicholas J. Humfrey
 
@@ -12,6 +12,14 @@
 
 	Damn. I'm wary of he semaphore. I'm sure I constructed a deadlock there.
 	There's always a deadlock. --ThOr
+
+	The ringbuffer is our own now: interleaved 32 bit floats as the decoder
+	delivers them, deinterleaved straight from there into the port buffers.
+	Everything the process callback touches is allocated on open, it only
+	moves the read position and posts the semaphore. The positions count
+	PCM frames and only grow, the writer owns one and the callback the
+	other. The ring has room for periods up to JACK_MAX_PERIOD,
+	a change of the server's buffer size only moves the fill limit.
 */
 
 #include "out123_int.h"
@@ -19,7 +27,6 @@
 #include <math.h>
 
 #include <jack/jack.h>
-#include <jack/ringbuffer.h>
 /* Using some pthread to provide synchronization between process callback
    and writer part. The JACK API is not meant for this. Libpthread is
    pulled in as libjack dependency anyway. */
@@ -28,19 +35,35 @@
 
 #include "debug.h"
 
+/* Largest server period the ring is prepared for without reallocation. */
+#define JACK_MAX_PERIOD 8192
+
+#define LOAD(var)         __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define STORE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELEASE)
+
 typedef struct {
 	int alive;
 	sem_t sem; /* semaphore to avoid busy waiting */
 	int channels;
-	int encoding;
 	int framesize;
 	jack_default_audio_sample_t **ports_buf;
 	jack_port_t **ports;
-	jack_ringbuffer_t *rb;
-	size_t rb_size; /* in bytes */
+	float *rb;
+	size_t rb_frames;    /* capacity, power of two */
+	size_t rb_want;      /* fill wanted from OUT123_DEVICEBUFFER */
+	size_t rb_limit;     /* fill allowed for the writer, in PCM frames */
+	size_t rb_read;      /* positions in PCM frames, wrapping with size_t */
+	size_t rb_write;
+	size_t rb_discard;   /* flush: position the callback skips to */
 	jack_client_t *client;
 	char *procbuf;
 	size_t procbuf_frames; /* in PCM frames */
+	size_t period;
+	/* Pull mode: fill() called in the process callback instead of
+	   reading the ringbuffer. */
+	out123_fill_func fill;
+	void *filldata;
+	int fill_done;
 } jack_handle_t, *jack_handle_ptr;
 
 static jack_handle_t* alloc_jack_handle(out123_handle *ao)
@@ -52,7 +75,6 @@ static jack_handle_t* alloc_jack_handle(out123_handle *ao)
 	if (!handle)
 		return NULL;
 	handle->channels = ao->channels;
-	handle->encoding = ao->format;
 	handle->framesize = ao->framesize;
 	handle->rb = NULL;
 	handle->ports_buf = malloc( sizeof(jack_default_audio_sample_t*)
@@ -84,8 +106,17 @@ static jack_handle_t* alloc_jack_handle(out123_handle *ao)
 	handle->alive = 0;
 	handle->client = NULL;
 	handle->procbuf = NULL;
-	handle->rb_size = 0;
+	handle->rb_frames = 0;
+	handle->rb_want = 0;
+	handle->rb_limit = 0;
+	handle->rb_read = 0;
+	handle->rb_write = 0;
+	handle->rb_discard = 0;
 	handle->procbuf_frames = 0;
+	handle->period = 0;
+	handle->fill = ao->fill_device ? ao->fill : NULL;
+	handle->filldata = ao->filldata;
+	handle->fill_done = 0;
 
 	return handle;
 }
@@ -108,11 +139,11 @@ static void free_jack_handle( jack_handle_t* handle )
 	}
 	if(handle->ports_buf)
 		free(handle->ports_buf);
-	/* Free up the ring buffer for channel*/
-	if(handle->rb)
-		jack_ringbuffer_free(handle->rb);
+	/* The client first, so that no callback uses the buffers anymore. */
 	if (handle->client)
 		jack_client_close(handle->client);
+	if(handle->rb)
+		free(handle->rb);
 	if (handle->procbuf)
 		free(handle->procbuf);
 	sem_destroy(&handle->sem);
@@ -120,72 +151,146 @@ static void free_jack_handle( jack_handle_t* handle )
 }
 
 
+/* Spread frames of interleaved input over the port buffers, starting at
+   offset in them. */
+static void deinterleave( jack_handle_t *handle, const float *src
+,	size_t offset, size_t frames )
+{
+	int c;
+	size_t n;
+	if(handle->channels == 1)
+	{
+		memcpy(handle->ports_buf[0]+offset, src, sizeof(float)*frames);
+		return;
+	}
+	for(c=0; c<handle->channels; ++c)
+	{
+		jack_default_audio_sample_t *dst = handle->ports_buf[c]+offset;
+		const float *in = src+c;
+		for(n=0; n<frames; ++n)
+			dst[n] = in[n*handle->channels];
+	}
+}
+
+static void zero_ports(jack_handle_t *handle, size_t offset, size_t frames)
+{
+	int c;
+	for(c=0; c<handle->channels; ++c)
+		bzero(handle->ports_buf[c]+offset, sizeof(float)*frames);
+}
+
+/* Get a piece of interleaved data from the application, filling up
+   with zeros after it ran out. */
+static void fill_piece(jack_handle_t* handle, char *buf, size_t piece)
+{
+	size_t bytes = piece*handle->framesize;
+	size_t got = 0;
+
+	while(!handle->fill_done && got < bytes)
+	{
+		size_t n = handle->fill(handle->filldata, buf+got, bytes-got);
+		if(!n)
+			handle->fill_done = 1;
+		got += n > bytes-got ? bytes-got : n;
+	}
+	if(got < bytes)
+		bzero(buf+got, bytes-got);
+}
+
+/* Pull mode: one piece of the period after the other via procbuf, or
+   right into the port for mono. */
+static void process_fill(jack_handle_t *handle, size_t nframes)
+{
+	size_t done = 0;
+	if(handle->channels == 1)
+	{
+		fill_piece(handle, (char*)handle->ports_buf[0], nframes);
+		return;
+	}
+	while(done < nframes)
+	{
+		size_t piece = nframes-done > handle->procbuf_frames
+		?	handle->procbuf_frames
+		:	nframes-done;
+		fill_piece(handle, handle->procbuf, piece);
+		deinterleave(handle, (float*)handle->procbuf, done, piece);
+		done += piece;
+	}
+}
+
+/* Push mode: what the ring has, in up to two pieces around the wrap,
+   and silence for the rest. */
+static void process_ring(jack_handle_t *handle, size_t nframes)
+{
+	size_t read = handle->rb_read;
+	size_t write = LOAD(handle->rb_write);
+	size_t discard = LOAD(handle->rb_discard);
+	size_t avail, got, pos;
+
+	if(discard != read && discard-read <= write-read)
+		read = discard;
+	avail = write-read;
+	got = avail < nframes ? avail : nframes;
+	pos = read & (handle->rb_frames-1);
+	if(pos+got > handle->rb_frames)
+	{
+		size_t first = handle->rb_frames-pos;
+		deinterleave(handle, handle->rb+pos*handle->channels, 0, first);
+		deinterleave(handle, handle->rb, first, got-first);
+	}
+	else
+		deinterleave(handle, handle->rb+pos*handle->channels, 0, got);
+	if(got < nframes)
+	{
+		debug("filling up with zeros");
+		zero_ports(handle, got, nframes-got);
+	}
+	STORE(handle->rb_read, read+got);
+}
+
 static int process_callback( jack_nframes_t nframes, void *arg )
 {
 	int c;
 	jack_handle_t* handle = (jack_handle_t*)arg;
-	size_t to_read = nframes;
 
 	for(c=0; c<handle->channels; ++c)
 		handle->ports_buf[c] =
 			jack_port_get_buffer(handle->ports[c], nframes);
+	if(handle->fill)
+		process_fill(handle, nframes);
+	else
+		process_ring(handle, nframes);
+	/* Give the writer a hint about the time passed. */
+	sem_post(&handle->sem);
+	/* Success*/
+	return 0;
+}
 
-	/* One ringbuffer to rule them all, getting interleaved data piecewise
-	   and appending to non-interleaved buffers. */
-	while(to_read)
+/* The server changed the period. This does not run concurrently with the
+   process callback and may allocate. */
+static int buffer_size_callback(jack_nframes_t nframes, void *arg)
+{
+	jack_handle_t* handle = (jack_handle_t*)arg;
+	size_t limit = handle->rb_want;
+
+	debug1("JACK buffer size now %lu", (unsigned long)nframes);
+	if(limit < 2*(size_t)nframes)
+		limit = 2*(size_t)nframes;
+	if(limit > handle->rb_frames)
+		limit = handle->rb_frames;
+	STORE(handle->rb_limit, limit);
+	STORE(handle->period, (size_t)nframes);
+	/* Pulling copes with a smaller procbuf piece by piece, but one piece
+	   per period is nicer. */
+	if(handle->fill && nframes > handle->procbuf_frames)
 	{
-		/* Need to read into temporary storage, then deinterleave to JACK
-		   buffers. */
-		size_t got_piece;
-		size_t avail_piece;
-		size_t piece = to_read > handle->procbuf_frames
-		?	handle->procbuf_frames
-		:	to_read;
-		/* Ensure we get only full PCM frames by checking available byte count
-		   and reducing expectation. */
-		avail_piece = jack_ringbuffer_read_space(handle->rb)/handle->framesize;
-		got_piece = jack_ringbuffer_read( handle->rb
-		,	handle->procbuf, (avail_piece > piece ? piece : avail_piece)
-		*	handle->framesize ) / handle->framesize;
-		debug2( "fetched %"SIZE_P" frames from ringbuffer (wanted %"SIZE_P")"
-		,	(size_p)got_piece, (size_p)piece );
-		/* If this is the last piece, fill up, not time to wait. */
-		if(to_read > piece)
-			piece = got_piece; /* We got further loop cycle(s) to get the rest. */
-		else
-		{
-			if(piece > got_piece)
-			{
-				debug("filling up with zeros");
-				bzero( handle->procbuf+got_piece*handle->framesize
-				,	(piece-got_piece)*handle->framesize );
-			}
-		}
-		/* Now extract the pieces for the channels. */
-		for (c=0; c < handle->channels; ++c)
+		char *nbuf = realloc(handle->procbuf, (size_t)nframes*handle->framesize);
+		if(nbuf)
 		{
-			size_t n;
-			jack_default_audio_sample_t *dst = handle->ports_buf[c];
-			if(handle->encoding == MPG123_ENC_FLOAT_32)
-			{
-				float* src = (float*)handle->procbuf;
-				for(n=0; n<piece; ++n)
-					*(dst++) = src[(n*handle->channels)+c];
-			}
-			else /* MPG123_ENC_FLOAT_64 */
-			{
-				double* src = (double*)handle->procbuf;
-				for(n=0; n<piece; ++n)
-					*(dst++) = src[(n*handle->channels)+c];
-			}
-			/* Store output buffer offset. */
-			handle->ports_buf[c] = dst;
+			handle->procbuf = nbuf;
+			handle->procbuf_frames = nframes;
 		}
-		/* Give the writer a hint about the time passed. */
-		sem_post(&handle->sem);
-		to_read -= piece;
 	}
-	/* Success*/
 	return 0;
 }
 
@@ -350,21 +455,40 @@ static int connect_jack_ports(out123_handle *ao
 	return 1;
 }
 
+static int delay_jack(out123_handle *ao, size_t *bytes)
+{
+	jack_handle_t *handle = (jack_handle_t*)ao->userptr;
+
+	if(!handle || !handle->alive || !handle->rb)
+		return -1;
+	*bytes = ( handle->rb_write-LOAD(handle->rb_read)
+	+	LOAD(handle->period) ) * handle->framesize;
+	return 0;
+}
+
 static void drain_jack(out123_handle *ao)
 {
 	jack_handle_t *handle = (jack_handle_t*)ao->userptr;
 
 	debug("drain_jack().");
 
+	if(!handle)
+		return;
 	do errno = 0;
 	while(sem_trywait(&handle->sem) == 0 || errno == EINTR);
-	/* For some reason, a single byte is reserved by JACK?! */
-	while(  handle && handle->alive && handle->rb
-	     && jack_ringbuffer_write_space(handle->rb)+1 < handle->rb_size )
+	/* Pulling, the data is out when the application has no more. */
+	if(handle->fill)
 	{
-		debug2( "JACK close wait %"SIZE_P" < %"SIZE_P"\n"
-		,	(size_p)jack_ringbuffer_write_space(handle->rb)
-		,	(size_p)handle->rb_size );
+		while(handle->alive && !handle->fill_done)
+			sem_wait(&handle->sem);
+		return;
+	}
+	while( handle->alive && handle->rb
+	&&     LOAD(handle->rb_read) != handle->rb_write )
+	{
+		debug2( "JACK close wait %"SIZE_P" of %"SIZE_P"\n"
+		,	(size_p)(handle->rb_write-LOAD(handle->rb_read))
+		,	(size_p)handle->rb_frames );
 		sem_wait(&handle->sem);
 	}
 }
@@ -412,10 +536,10 @@ static int open_jack(out123_handle *ao)
 		/* Really need a framesize defined for callback. */
 		ao->framesize = 2*4;
 	}
-	else if(!(ao->format & MPG123_ENC_FLOAT))
+	else if(ao->format != MPG123_ENC_FLOAT_32)
 	{
 		if(!AOQUIET)
-			error("JACK only wants float!");
+			error("JACK only wants 32 bit float!");
 		return -1;
 	}
 
@@ -423,6 +547,7 @@ static int open_jack(out123_handle *ao)
 	if((handle = alloc_jack_handle(ao)) == NULL)
 		return -1;
 	ao->userptr = (void*)handle;
+	ao->fill_native = handle->fill != NULL;
 
 	/* Register with Jack*/
 	if((handle->client = jack_client_open(ao->name, jopt, &jstat)) == 0)
@@ -478,19 +603,29 @@ static int open_jack(out123_handle *ao)
 	}
 
 	/* Use device_buffer parameter for ring buffer, but ensure that two
-	   JACK buffers fit in there. We do not support that buffer increasing
-	   later on. */
-	handle->rb_size = (size_t)( ao->device_buffer
+	   JACK buffers fit in there. The period is the JACK buffer size, that is
+	   up to the server, not us. The ring has room for the largest period
+	   to come, only the fill limit follows the actual one. */
+	handle->rb_want = (size_t)( ao->device_buffer
 	*	jack_get_sample_rate(handle->client)
 	+	0.5 ); /* PCM frames */
-	handle->procbuf_frames = jack_get_buffer_size(handle->client);
-	if(handle->rb_size < 2*handle->procbuf_frames)
-		handle->rb_size = 2*handle->procbuf_frames;
-	debug1("JACK ringbuffer for %"SIZE_P" PCM frames", (size_p)handle->rb_size);
-	/* Convert to bytes. */
-	handle->rb_size *= handle->framesize;
-	handle->rb = jack_ringbuffer_create(handle->rb_size);
+	handle->period = handle->procbuf_frames
+	=	jack_get_buffer_size(handle->client);
+	handle->rb_frames = 1;
+	while( handle->rb_frames < handle->rb_want
+	||     handle->rb_frames < 2*JACK_MAX_PERIOD
+	||     handle->rb_frames < 2*handle->period )
+		handle->rb_frames *= 2;
+	handle->rb_limit = handle->rb_want < 2*handle->period
+	?	2*handle->period
+	:	handle->rb_want;
+	debug2( "JACK ringbuffer for %"SIZE_P" of %"SIZE_P" PCM frames"
+	,	(size_p)handle->rb_limit, (size_p)handle->rb_frames );
+	handle->rb = malloc(handle->rb_frames*handle->framesize);
 	handle->procbuf = malloc(handle->procbuf_frames*handle->framesize);
+	/* Ring buffer plus the period the server is working on. */
+	ao->device_length = (double)(handle->rb_limit + handle->period)
+	/	jack_get_sample_rate(handle->client);
 	if(!handle->rb || !handle->procbuf)
 	{
 		if(!AOQUIET)
@@ -501,6 +636,8 @@ static int open_jack(out123_handle *ao)
 
 	/* Set the callbacks*/
 	jack_set_process_callback(handle->client, process_callback, (void*)handle);
+	jack_set_buffer_size_callback( handle->client, buffer_size_callback
+	,	(void*)handle );
 	jack_on_shutdown(handle->client, shutdown_callback, (void*)handle);
 	handle->alive = 1;
 	/* Activate client*/
@@ -522,13 +659,13 @@ static int open_jack(out123_handle *ao)
 	}
 
 	debug("Jack open successful.\n");
-	ao->realname = compat_strdup(realname);
+	ao->realname = realname; /* The library takes a copy. */
 	return 0;
 }
 
 
-/* Jack prefers floats, I actually assume it does _only_ float/double
-   (as it is nowadays)! */
+/* JACK ports carry 32 bit floats, taking exactly that keeps any
+   conversion out of the way. */
 static int get_formats_jack(out123_handle *ao)
 {
 	jack_handle_t *handle = (jack_handle_t*)ao->userptr;
@@ -536,26 +673,47 @@ static int get_formats_jack(out123_handle *ao)
 	if(jack_get_sample_rate(handle->client) != (jack_nframes_t)ao->rate)
 		return 0;
 	else
-		return MPG123_ENC_FLOAT_32|MPG123_ENC_FLOAT_64;
+		return MPG123_ENC_FLOAT_32;
+}
+
+/* Copy whole PCM frames into the ring, up to the limit ahead of the
+   process callback. */
+static size_t ring_write(jack_handle_t *handle, const float *src, size_t frames)
+{
+	size_t write = handle->rb_write;
+	size_t fill = write-LOAD(handle->rb_read);
+	size_t limit = LOAD(handle->rb_limit);
+	size_t space = limit > fill ? limit-fill : 0;
+	size_t pos = write & (handle->rb_frames-1);
+	size_t first;
+
+	if(frames > space)
+		frames = space;
+	first = handle->rb_frames-pos < frames ? handle->rb_frames-pos : frames;
+	memcpy( handle->rb+pos*handle->channels, src
+	,	sizeof(float)*first*handle->channels );
+	memcpy( handle->rb, src+first*handle->channels
+	,	sizeof(float)*(frames-first)*handle->channels );
+	STORE(handle->rb_write, write+frames);
+	return frames;
 }
 
 static int write_jack(out123_handle *ao, unsigned char *buf, int len)
 {
 	jack_handle_t *handle = (jack_handle_t*)ao->userptr;
-	size_t bytes_left;
+	size_t frames_left;
 	unsigned int strike = 0;
 
-	bytes_left = len;
-	while(bytes_left && handle->alive)
+	frames_left = len/handle->framesize;
+	while(frames_left && handle->alive)
 	{
 		size_t piece;
 
 		debug("writing to ringbuffer");
-		/* No help: piece1 = jack_ringbuffer_write_space(handle->rb); */
-		piece = jack_ringbuffer_write(handle->rb, (char*)buf, bytes_left);
-		debug1("wrote %"SIZE_P" B", (size_p)piece);
-		buf += piece;
-		bytes_left -= piece;
+		piece = ring_write(handle, (float*)buf, frames_left);
+		debug1("wrote %"SIZE_P" frames", (size_p)piece);
+		buf += piece*handle->framesize;
+		frames_left -= piece;
 		/* Allow nothing being written some times, but not too often. 
 		   Don't know how often in a row that would be supposed to happen. */
 		if(!piece)
@@ -578,14 +736,15 @@ static int write_jack(out123_handle *ao, unsigned char *buf, int len)
 			strike = 0;
 	}
 
-	return len-bytes_left;
+	return (int)((len/handle->framesize - frames_left)*handle->framesize);
 }
 
+/* The writer may not touch the read position, the callback skips to
+   what was written up to now. */
 static void flush_jack(out123_handle *ao)
 {
 	jack_handle_t *handle = (jack_handle_t*)ao->userptr;
-	/* Reset the ring buffers*/
-	jack_ringbuffer_reset(handle->rb);
+	STORE(handle->rb_discard, handle->rb_write);
 }
 
 static int init_jack(out123_handle* ao)
@@ -599,6 +758,7 @@ static int init_jack(out123_handle* ao)
 	ao->write = write_jack;
 	ao->get_formats = get_formats_jack;
 	ao->close = close_jack;
+	ao->delay = delay_jack;
 	ao->propflags |= OUT123_PROP_PERSISTENT;
 	/* Success */
 	return 0;
@@ -184,6 +184,14 @@ static int open_oss(out123_handle *ao)
 		close(ao->fn);
 		return -1;
 	}
+#ifdef SNDCTL_DSP_GETOSPACE
+	if(ao->format != -1 && ao->rate > 0 && ao->framesize > 0) {
+		audio_buf_info info;
+		if(ioctl(ao->fn, SNDCTL_DSP_GETOSPACE, &info) == 0)
+			ao->device_length = (double)info.fragstotal*info.fragsize
+			/	ao->framesize/ao->rate;
+	}
+#endif
 	
 	if(ao->gain >= 0) {
 		int e,mask;
@@ -281,6 +289,17 @@ static int close_oss(out123_handle *ao)
 	return 0;
 }
 
+#ifdef SNDCTL_DSP_GETODELAY
+static int delay_oss(out123_handle *ao, size_t *bytes)
+{
+	int odelay;
+	if(ao->fn < 0 || ioctl(ao->fn, SNDCTL_DSP_GETODELAY, &odelay) < 0)
+		return -1;
+	*bytes = odelay > 0 ? odelay : 0;
+	return 0;
+}
+#endif
+
 static void flush_oss(out123_handle *ao)
 {
 }
@@ -298,6 +317,9 @@ static int init_oss(out123_handle* ao)
 	ao->write = write_oss;
 	ao->get_formats = get_formats_oss;
 	ao->close = close_oss;
+#ifdef SNDCTL_DSP_GETODELAY
+	ao->delay = delay_oss;
+#endif
 	
 	/* Success */
 	return 0;
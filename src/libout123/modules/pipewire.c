@@ -0,0 +1,464 @@
+/*
+	pipewire: audio output via PipeWire
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	A playback stream on its own thread loop. The writer fills a ring
+	buffer and blocks on the loop when it is full; the process callback
+	moves data from there into the buffers the graph hands out and wakes
+	the writer. OUT123_DEVICEPERIOD is passed on as node latency, letting
+	the graph choose a small quantum for us, OUT123_DEVICEBUFFER sizes our
+	ring buffer. The stream takes all common encodings, float included,
+	and PipeWire converts to what the hardware wants.
+
+	In pull mode (out123_set_fill()), the process callback asks the
+	application instead of the ring buffer.
+*/
+
+#include "out123_int.h"
+
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+
+#include "debug.h"
+
+/* Ring buffer size in seconds. */
+#define BUFFER_LENGTH (ao->device_buffer > 0. ? ao->device_buffer : 0.2)
+
+static const struct {
+	enum spa_audio_format pw;
+	int mpg123;
+} format_map[] = {
+	{ SPA_AUDIO_FORMAT_S16,  MPG123_ENC_SIGNED_16   },
+	{ SPA_AUDIO_FORMAT_U16,  MPG123_ENC_UNSIGNED_16 },
+	{ SPA_AUDIO_FORMAT_U8,   MPG123_ENC_UNSIGNED_8  },
+	{ SPA_AUDIO_FORMAT_S8,   MPG123_ENC_SIGNED_8    },
+	{ SPA_AUDIO_FORMAT_ALAW, MPG123_ENC_ALAW_8      },
+	{ SPA_AUDIO_FORMAT_ULAW, MPG123_ENC_ULAW_8      },
+	{ SPA_AUDIO_FORMAT_S32,  MPG123_ENC_SIGNED_32   },
+	{ SPA_AUDIO_FORMAT_U32,  MPG123_ENC_UNSIGNED_32 },
+	{ SPA_AUDIO_FORMAT_S24,  MPG123_ENC_SIGNED_24   },
+	{ SPA_AUDIO_FORMAT_U24,  MPG123_ENC_UNSIGNED_24 },
+	{ SPA_AUDIO_FORMAT_F32,  MPG123_ENC_FLOAT_32    },
+	{ SPA_AUDIO_FORMAT_F64,  MPG123_ENC_FLOAT_64    }
+};
+#define NUM_FORMATS (sizeof format_map / sizeof format_map[0])
+
+struct pipewire_out
+{
+	struct pw_thread_loop *loop;
+	struct pw_context *context;
+	struct pw_core *core;
+	struct pw_stream *stream;
+	struct spa_hook listener;
+	int ready;   /* stream negotiated */
+	int failed;  /* stream error, writes give up */
+	int drained;
+	int framesize;
+	/* Ring buffer of interleaved PCM frames. */
+	unsigned char *ring;
+	size_t size;
+	size_t readpos;
+	size_t fill;
+	/* Pull mode. */
+	out123_fill_func pull;
+	void *pulldata;
+	int pull_done;
+};
+
+/* All from the loop thread, with the lock held. */
+
+static void on_state_changed( void *data, enum pw_stream_state old
+,	enum pw_stream_state state, const char *error )
+{
+	struct pipewire_out *po = data;
+
+	debug2("stream state %s (%s)", pw_stream_state_as_string(state)
+	,	error ? error : "");
+	if(state == PW_STREAM_STATE_ERROR || state == PW_STREAM_STATE_UNCONNECTED)
+		po->failed = 1;
+	if(state == PW_STREAM_STATE_PAUSED || state == PW_STREAM_STATE_STREAMING)
+		po->ready = 1;
+	pw_thread_loop_signal(po->loop, 0);
+}
+
+static size_t ring_read(struct pipewire_out *po, unsigned char *dst, size_t bytes)
+{
+	size_t first;
+
+	if(bytes > po->fill)
+		bytes = po->fill;
+	first = po->size - po->readpos;
+	if(first > bytes)
+		first = bytes;
+	memcpy(dst, po->ring+po->readpos, first);
+	memcpy(dst+first, po->ring, bytes-first);
+	po->readpos = (po->readpos+bytes) % po->size;
+	po->fill -= bytes;
+	return bytes;
+}
+
+static size_t pull_data(struct pipewire_out *po, unsigned char *dst, size_t bytes)
+{
+	size_t got = 0;
+
+	while(!po->pull_done && got < bytes)
+	{
+		size_t n = po->pull(po->pulldata, dst+got, bytes-got);
+		if(!n)
+			po->pull_done = 1;
+		got += n > bytes-got ? bytes-got : n;
+	}
+	return got - got % po->framesize;
+}
+
+static void on_process(void *data)
+{
+	struct pipewire_out *po = data;
+	struct pw_buffer *b;
+	struct spa_data *d;
+	size_t bytes;
+
+	if(!(b = pw_stream_dequeue_buffer(po->stream)))
+		return;
+	d = &b->buffer->datas[0];
+	bytes = 0;
+	if(d->data)
+	{
+		bytes = d->maxsize - d->maxsize % po->framesize;
+#if PW_CHECK_VERSION(0,3,49)
+		/* Only what the graph needs for this cycle, for low latency. */
+		if(b->requested && b->requested*po->framesize < bytes)
+			bytes = b->requested*po->framesize;
+#endif
+		bytes = po->pull
+		?	pull_data(po, d->data, bytes)
+		:	ring_read(po, d->data, bytes);
+		d->chunk->offset = 0;
+		d->chunk->stride = po->framesize;
+		d->chunk->size = bytes;
+	}
+	pw_stream_queue_buffer(po->stream, b);
+	pw_thread_loop_signal(po->loop, 0);
+}
+
+static void on_drained(void *data)
+{
+	struct pipewire_out *po = data;
+
+	po->drained = 1;
+	pw_thread_loop_signal(po->loop, 0);
+}
+
+static const struct pw_stream_events stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_state_changed,
+	.process = on_process,
+	.drained = on_drained
+};
+
+static void free_pipewire(struct pipewire_out *po)
+{
+	if(po->loop)
+		pw_thread_loop_stop(po->loop);
+	if(po->stream)
+		pw_stream_destroy(po->stream);
+	if(po->core)
+		pw_core_disconnect(po->core);
+	if(po->context)
+		pw_context_destroy(po->context);
+	if(po->loop)
+		pw_thread_loop_destroy(po->loop);
+	if(po->ring)
+		free(po->ring);
+	free(po);
+	pw_deinit();
+}
+
+static int connect_stream(out123_handle *ao, struct pipewire_out *po)
+{
+	struct pw_properties *props;
+	unsigned char podbuf[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(podbuf, sizeof(podbuf));
+	const struct spa_pod *params[1];
+	struct spa_audio_info_raw info;
+	size_t frames;
+	int i;
+
+	memset(&info, 0, sizeof(info));
+	info.format = SPA_AUDIO_FORMAT_UNKNOWN;
+	for(i=0; i<NUM_FORMATS; ++i)
+		if(format_map[i].mpg123 == ao->format)
+			info.format = format_map[i].pw;
+	if(info.format == SPA_AUDIO_FORMAT_UNKNOWN)
+	{
+		if(!AOQUIET)
+			error1("Unsupported audio format: 0x%x", ao->format);
+		return -1;
+	}
+	info.rate = ao->rate;
+	info.channels = ao->channels;
+	if(ao->channels == 1)
+		info.position[0] = SPA_AUDIO_CHANNEL_MONO;
+	else if(ao->channels == 2)
+	{
+		info.position[0] = SPA_AUDIO_CHANNEL_FL;
+		info.position[1] = SPA_AUDIO_CHANNEL_FR;
+	}
+	else
+		info.flags = SPA_AUDIO_FLAG_UNPOSITIONED;
+	params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &info);
+
+	po->framesize = ao->framesize;
+	frames = (size_t)(BUFFER_LENGTH*ao->rate);
+	if(frames < 1)
+		frames = 1;
+	po->size = frames*ao->framesize;
+	if(!(po->ring = malloc(po->size)))
+	{
+		if(!AOQUIET)
+			error("out of memory");
+		return -1;
+	}
+	/* Whatever is not in the ring buffer, the graph has for one cycle. */
+	ao->device_length = (double)frames/ao->rate + ao->device_period;
+
+	props = pw_properties_new( PW_KEY_MEDIA_TYPE, "Audio"
+	,	PW_KEY_MEDIA_CATEGORY, "Playback", PW_KEY_MEDIA_ROLE, "Music"
+	,	PW_KEY_APP_NAME, ao->name, NULL );
+	if(!props)
+		return -1;
+	if(ao->device)
+#ifdef PW_KEY_TARGET_OBJECT
+		pw_properties_set(props, PW_KEY_TARGET_OBJECT, ao->device);
+#else
+		pw_properties_set(props, PW_KEY_NODE_TARGET, ao->device);
+#endif
+	if(ao->device_period > 0.)
+	{
+		unsigned int quantum = (unsigned int)(ao->device_period*ao->rate);
+		pw_properties_setf( props, PW_KEY_NODE_LATENCY, "%u/%ld"
+		,	quantum > 0 ? quantum : 1, ao->rate );
+	}
+	po->stream = pw_stream_new(po->core, "via out123", props);
+	if(!po->stream)
+	{
+		if(!AOQUIET)
+			error("cannot create PipeWire stream");
+		return -1;
+	}
+	pw_stream_add_listener(po->stream, &po->listener, &stream_events, po);
+	if(pw_stream_connect( po->stream, PW_DIRECTION_OUTPUT, PW_ID_ANY
+	,	PW_STREAM_FLAG_AUTOCONNECT|PW_STREAM_FLAG_MAP_BUFFERS
+	,	params, 1 ) < 0)
+	{
+		if(!AOQUIET)
+			error("cannot connect PipeWire stream");
+		return -1;
+	}
+	/* Wait for format negotiation to finish. */
+	while(!po->ready && !po->failed)
+		pw_thread_loop_wait(po->loop);
+	if(po->failed)
+	{
+		if(!AOQUIET)
+			error("PipeWire stream failed");
+		return -1;
+	}
+	return 0;
+}
+
+static int open_pipewire(out123_handle *ao)
+{
+	struct pipewire_out *po;
+	int ret = 0;
+
+	if(ao->userptr)
+	{
+		if(!AOQUIET)
+			error("PipeWire output is already open.");
+		return -1;
+	}
+	pw_init(NULL, NULL);
+	po = malloc(sizeof(*po));
+	if(!po)
+	{
+		pw_deinit();
+		return -1;
+	}
+	memset(po, 0, sizeof(*po));
+	po->pull = ao->fill_device ? ao->fill : NULL;
+	po->pulldata = ao->filldata;
+	po->loop = pw_thread_loop_new("out123", NULL);
+	if(po->loop)
+		po->context = pw_context_new(pw_thread_loop_get_loop(po->loop), NULL, 0);
+	if(!po->context || pw_thread_loop_start(po->loop) < 0)
+	{
+		if(!AOQUIET)
+			error("cannot set up PipeWire loop");
+		free_pipewire(po);
+		return -1;
+	}
+	pw_thread_loop_lock(po->loop);
+	/* Connecting tells if there is a server at all, also for queries. */
+	po->core = pw_context_connect(po->context, NULL, 0);
+	if(!po->core)
+	{
+		if(!AOQUIET)
+			error("cannot connect to PipeWire");
+		ret = -1;
+	}
+	else if(ao->format != -1)
+		ret = connect_stream(ao, po);
+	pw_thread_loop_unlock(po->loop);
+	if(ret)
+	{
+		free_pipewire(po);
+		return -1;
+	}
+	ao->userptr = po;
+	ao->fill_native = po->pull != NULL;
+	return 0;
+}
+
+/* The stream converts anything to what the graph runs. */
+static int get_formats_pipewire(out123_handle *ao)
+{
+	int formats = 0;
+	int i;
+
+	for(i=0; i<NUM_FORMATS; ++i)
+		formats |= format_map[i].mpg123;
+	return formats;
+}
+
+static int write_pipewire(out123_handle *ao, unsigned char *buf, int len)
+{
+	struct pipewire_out *po = ao->userptr;
+	size_t written = 0;
+
+	pw_thread_loop_lock(po->loop);
+	while(written < (size_t)len && !po->failed)
+	{
+		size_t writepos = (po->readpos+po->fill) % po->size;
+		size_t piece = po->size - po->fill;
+		if(!piece)
+		{
+			pw_thread_loop_wait(po->loop);
+			continue;
+		}
+		if(piece > po->size - writepos)
+			piece = po->size - writepos;
+		if(piece > (size_t)len - written)
+			piece = (size_t)len - written;
+		memcpy(po->ring+writepos, buf+written, piece);
+		po->fill += piece;
+		written += piece;
+	}
+	pw_thread_loop_unlock(po->loop);
+	if(po->failed)
+	{
+		if(!AOQUIET)
+			error("PipeWire stream failed");
+		return -1;
+	}
+	return (int)written;
+}
+
+/* Our ring buffer plus what the stream and graph hold. */
+static int delay_pipewire(out123_handle *ao, size_t *bytes)
+{
+	struct pipewire_out *po = ao->userptr;
+	struct pw_time t;
+	size_t frames;
+
+	if(!po || !po->stream)
+		return -1;
+	pw_thread_loop_lock(po->loop);
+	frames = po->fill/po->framesize;
+	if(pw_stream_get_time(po->stream, &t) == 0 && t.rate.denom)
+	{
+		frames += t.queued/po->framesize;
+		if(t.delay > 0)
+			frames += (size_t)( (double)t.delay*t.rate.num/t.rate.denom
+			*	ao->rate );
+	}
+	pw_thread_loop_unlock(po->loop);
+	*bytes = frames*po->framesize;
+	return 0;
+}
+
+static void flush_pipewire(out123_handle *ao)
+{
+	struct pipewire_out *po = ao->userptr;
+
+	if(!po || !po->stream)
+		return;
+	pw_thread_loop_lock(po->loop);
+	po->fill = 0;
+	po->readpos = 0;
+	pw_stream_flush(po->stream, 0);
+	pw_thread_loop_unlock(po->loop);
+}
+
+static void drain_pipewire(out123_handle *ao)
+{
+	struct pipewire_out *po = ao->userptr;
+
+	if(!po || !po->stream)
+		return;
+	pw_thread_loop_lock(po->loop);
+	/* First our buffer (or the application) runs out, then the graph. */
+	while(!po->failed && (po->pull ? !po->pull_done : po->fill > 0))
+		pw_thread_loop_wait(po->loop);
+	po->drained = 0;
+	if(!po->failed && pw_stream_flush(po->stream, 1) == 0)
+		while(!po->drained && !po->failed)
+			if(pw_thread_loop_timed_wait(po->loop, 2))
+				break;
+	pw_thread_loop_unlock(po->loop);
+}
+
+static int close_pipewire(out123_handle *ao)
+{
+	struct pipewire_out *po = ao->userptr;
+
+	if(po)
+	{
+		free_pipewire(po);
+		ao->userptr = NULL;
+	}
+	return 0;
+}
+
+static int init_pipewire(out123_handle* ao)
+{
+	if (ao==NULL) return -1;
+
+	/* Set callbacks */
+	ao->open = open_pipewire;
+	ao->flush = flush_pipewire;
+	ao->drain = drain_pipewire;
+	ao->write = write_pipewire;
+	ao->get_formats = get_formats_pipewire;
+	ao->close = close_pipewire;
+	ao->delay = delay_pipewire;
+
+	/* Success */
+	return 0;
+}
+
+
+/*
+	Module information data structure
+*/
+mpg123_module_t mpg123_output_module_info = {
+	/* api_version */	MPG123_MODULE_API_VERSION,
+	/* name */			"pipewire",
+	/* description */	"Output audio using PipeWire.",
+	/* revision */		"$Rev:$",
+	/* handle */		NULL,
+
+	/* init_output */	init_pipewire,
+};
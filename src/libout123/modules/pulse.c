@@ -22,6 +22,8 @@ static int open_pulse(out123_handle *ao)
 	int err;
 	pa_simple* pas = NULL;
 	pa_sample_spec ss;
+	pa_buffer_attr attr;
+	pa_buffer_attr *attrp = NULL;
 	/* Check if already open ? */
 	if (ao->userptr) {
 		if(!AOQUIET)
@@ -87,6 +89,24 @@ static int open_pulse(out123_handle *ao)
 		break;
 	}
 
+	/* Only ask for specific buffering if told so. The simple API does not
+	   tell what the server made of it, so the request is what we report. */
+	ao->device_length = 0.;
+	if(ao->device_buffer > 0. || ao->device_period > 0.)
+	{
+		attr.maxlength = (uint32_t)-1;
+		attr.tlength = ao->device_buffer > 0.
+		?	pa_usec_to_bytes((pa_usec_t)(ao->device_buffer*1000000), &ss)
+		:	(uint32_t)-1;
+		attr.prebuf = (uint32_t)-1;
+		attr.minreq = ao->device_period > 0.
+		?	pa_usec_to_bytes((pa_usec_t)(ao->device_period*1000000), &ss)
+		:	(uint32_t)-1;
+		attr.fragsize = (uint32_t)-1;
+		attrp = &attr;
+		if(ao->device_buffer > 0.)
+			ao->device_length = ao->device_buffer;
+	}
 
 	/* Perform the open */
 	pas = pa_simple_new(
@@ -97,7 +117,7 @@ static int open_pulse(out123_handle *ao)
 			"via out123",		/* Description of our stream */
 			&ss,				/* Our sample format */
 			NULL,				/* Use default channel map */
-			NULL,				/* Use default buffering attributes */
+			attrp,				/* Default buffering unless configured */
 			&err				/* Error result code */
 	);
 
@@ -150,6 +170,25 @@ static int close_pulse(out123_handle *ao)
 	return 0;
 }
 
+static int delay_pulse(out123_handle *ao, size_t *bytes)
+{
+	pa_simple *pas = (pa_simple*)ao->userptr;
+	pa_usec_t usec;
+	int err;
+
+	if(!pas)
+		return -1;
+	usec = pa_simple_get_latency(pas, &err);
+	if(usec == (pa_usec_t)-1)
+	{
+		if(!AOQUIET)
+			error1("Failed to get latency: %s", pa_strerror(err));
+		return -1;
+	}
+	*bytes = (size_t)((double)usec/1000000*ao->rate)*ao->framesize;
+	return 0;
+}
+
 static void flush_pulse(out123_handle *ao)
 {
 	pa_simple *pas = (pa_simple*)ao->userptr;
@@ -173,6 +212,7 @@ static int init_pulse(out123_handle* ao)
 	ao->write = write_pulse;
 	ao->get_formats = get_formats_pulse;
 	ao->close = close_pulse;
+	ao->delay = delay_pulse;
 
 	/* Success */
 	return 0;
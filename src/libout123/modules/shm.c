@@ -0,0 +1,403 @@
+/*
+	shm: audio output into a POSIX shared memory ring buffer
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	This hands decoded audio to another process on the same host without
+	copying through the kernel as a pipe does. The device name is the name
+	of the shared memory object (default /mpg123). Each out123 session
+	(open until close, so one audio format) creates a fresh object under
+	that name, which is unlinked again at closing. A consumer that still
+	has it mapped reads the remaining data and then opens the name again
+	for the next session.
+
+	Layout of the object, all fields in native byte order:
+
+	offset 0: struct shm_ring (see below)
+	offset data_offset (one page): the ring of size bytes, a power of two
+
+	Writer and reader count bytes in write_pos and read_pos, which only
+	ever grow (wrapping at 2^32). Data is at data_offset + pos%size, the
+	fill is write_pos - read_pos, computed in 32 bit unsigned arithmetic.
+	The header is complete once magic is set. Only the writer changes the
+	fields marked [W], only the reader those marked [R].
+
+	Signaling uses Linux futexes on the position words: Before sleeping,
+	a side sets its *_waits flag, checks the position again and waits on
+	it (FUTEX_WAIT, not private, as the memory is shared). After moving
+	its own position, a side wakes the other if that one's flag is set.
+	The writer also wakes the reader when changing state. A reader hence:
+
+	- shm_open(name, O_RDWR), mmap, wait for magic == SHM_MAGIC;
+	- set reader_pid to its pid;
+	- read [read_pos, write_pos) from the ring, then advance read_pos and
+	  wake the writer if writer_waits;
+	- when empty, sleep as described on write_pos;
+	- when empty and state == SHM_END, unmap and start over.
+
+	The writer blocks on a full ring, as on a pipe. Draining waits for the
+	reader only while reader_pid is set. Flushing has no effect, as the
+	reader owns the read position.
+*/
+
+#include "out123_int.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
+#include "debug.h"
+
+#define SHM_MAGIC   0x4d333231 /* "123M" in little endian */
+#define SHM_VERSION 1
+#define SHM_OPEN    1
+#define SHM_END     2
+
+struct shm_ring
+{
+	uint32_t magic;       /* SHM_MAGIC once the header is complete */
+	uint32_t version;     /* SHM_VERSION */
+	uint32_t data_offset; /* start of the ring from the start of the object */
+	uint32_t size;        /* bytes in the ring, a power of two */
+	int32_t rate;
+	int32_t channels;
+	int32_t encoding;     /* MPG123_ENC_* */
+	int32_t framesize;    /* bytes per PCM frame */
+	volatile uint32_t state;        /* [W] SHM_OPEN or SHM_END */
+	volatile uint32_t write_pos;    /* [W] bytes ever written */
+	volatile uint32_t read_pos;     /* [R] bytes ever consumed */
+	volatile uint32_t writer_waits; /* [W] nonzero: wake on read_pos */
+	volatile uint32_t reader_waits; /* [R] nonzero: wake on write_pos */
+	volatile int32_t reader_pid;    /* [R] nonzero while a reader is attached */
+};
+
+struct shm_out
+{
+	char *name;
+	struct shm_ring *ring;
+	unsigned char *data;
+	size_t mapsize;
+};
+
+#define SHM_PAGE 4096
+/* Wakeups are not missed, but waking up to look again now and then keeps
+   the writer responsive to signals and vanished readers. */
+#define SHM_WAIT_NS 100000000L
+
+static int futex_wait(volatile uint32_t *addr, uint32_t val)
+{
+	struct timespec ts;
+	ts.tv_sec  = 0;
+	ts.tv_nsec = SHM_WAIT_NS;
+	return syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static void futex_wake(volatile uint32_t *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static size_t ring_fill(struct shm_ring *ring)
+{
+	return (uint32_t)(ring->write_pos - ring->read_pos);
+}
+
+/* Wait until the reader moved from the read position seen.
+   Returns -1 when interrupted by a signal. */
+static int wait_reader(struct shm_ring *ring, uint32_t seen)
+{
+	int ret = 0;
+	ring->writer_waits = 1;
+	__sync_synchronize();
+	if(ring->read_pos == seen && futex_wait(&ring->read_pos, seen) && errno == EINTR)
+		ret = -1;
+	ring->writer_waits = 0;
+	return ret;
+}
+
+static void moved_writer(struct shm_ring *ring)
+{
+	__sync_synchronize();
+	if(ring->reader_waits)
+		futex_wake(&ring->write_pos);
+}
+
+static int shm_drop(out123_handle *ao)
+{
+	struct shm_out *so = ao->userptr;
+	int ret = 0;
+
+	if(so->ring)
+	{
+		so->ring->state = SHM_END;
+		moved_writer(so->ring);
+		if(munmap(so->ring, so->mapsize))
+			ret = -1;
+		so->ring = NULL;
+		so->data = NULL;
+	}
+	if(so->name)
+	{
+		shm_unlink(so->name);
+		free(so->name);
+		so->name = NULL;
+	}
+	return ret;
+}
+
+static int open_shm(out123_handle *ao)
+{
+	struct shm_out *so = ao->userptr;
+	const char *dev = ao->device ? ao->device : "/mpg123";
+	double seconds;
+	size_t bytes, size;
+	struct shm_ring *ring;
+	int fd;
+
+	if(ao->format < 0)
+	{
+		ao->rate     = 44100;
+		ao->channels = 2;
+		ao->format   = MPG123_ENC_SIGNED_16;
+		return 0;
+	}
+
+	/* The object name needs to start with a slash. */
+	so->name = malloc(strlen(dev)+2);
+	if(!so->name)
+	{
+		ao->errcode = OUT123_DOOM;
+		return -1;
+	}
+	sprintf(so->name, "%s%s", dev[0] == '/' ? "" : "/", dev);
+
+	seconds = ao->device_buffer > 0. ? ao->device_buffer : 0.5;
+	bytes = (size_t)(seconds*ao->rate)*ao->framesize;
+	for(size = SHM_PAGE; size < bytes && size < ((size_t)1<<30); size *= 2)
+		;
+	so->mapsize = SHM_PAGE + size;
+
+	/* A stale object from a crashed writer is replaced. */
+	shm_unlink(so->name);
+	fd = shm_open(so->name, O_RDWR|O_CREAT|O_EXCL, 0600);
+	if(fd < 0)
+	{
+		if(!AOQUIET)
+			error2("cannot create shared memory %s: %s", so->name, strerror(errno));
+		goto open_shm_bad;
+	}
+	if(ftruncate(fd, so->mapsize))
+	{
+		if(!AOQUIET)
+			error1("cannot size shared memory: %s", strerror(errno));
+		close(fd);
+		goto open_shm_bad;
+	}
+	ring = mmap(NULL, so->mapsize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ring == MAP_FAILED)
+	{
+		if(!AOQUIET)
+			error1("cannot map shared memory: %s", strerror(errno));
+		goto open_shm_bad;
+	}
+	so->ring = ring;
+	so->data = (unsigned char*)ring + SHM_PAGE;
+
+	/* Fresh pages are zero, only the non-zero fields need setting. */
+	ring->version     = SHM_VERSION;
+	ring->data_offset = SHM_PAGE;
+	ring->size        = size;
+	ring->rate        = ao->rate;
+	ring->channels    = ao->channels;
+	ring->encoding    = ao->format;
+	ring->framesize   = ao->framesize;
+	ring->state       = SHM_OPEN;
+	__sync_synchronize();
+	ring->magic       = SHM_MAGIC;
+	ao->device_length = (double)size/ao->framesize/ao->rate;
+	if(AOVERBOSE(1))
+		fprintf( stderr, "Shared memory %s with %"SIZE_P" bytes ring\n"
+		,	so->name, (size_p)size );
+	return 0;
+
+open_shm_bad:
+	shm_drop(ao);
+	return -1;
+}
+
+static int get_formats_shm(out123_handle *ao)
+{
+	return MPG123_ENC_ANY;
+}
+
+/* The contiguous free region behind the write position. */
+static size_t free_region(struct shm_out *so, unsigned char **region)
+{
+	struct shm_ring *ring = so->ring;
+	size_t off  = ring->write_pos & (ring->size-1);
+	size_t room = ring->size - ring_fill(ring);
+	if(room > ring->size - off)
+		room = ring->size - off;
+	*region = so->data + off;
+	return room;
+}
+
+static void advance(struct shm_out *so, size_t bytes)
+{
+	__sync_synchronize(); /* Data before position. */
+	so->ring->write_pos += (uint32_t)bytes;
+	moved_writer(so->ring);
+}
+
+static int write_shm(out123_handle *ao, unsigned char *buf, int len)
+{
+	struct shm_out *so = ao->userptr;
+	int done = 0;
+
+	if(!so->ring)
+		return -1;
+	while(done < len)
+	{
+		unsigned char *region;
+		size_t room = free_region(so, &region);
+		if(!room)
+		{
+			/* Return what we got, the caller loops and we will wait then. */
+			if(done)
+				break;
+			if(wait_reader(so->ring, so->ring->read_pos))
+				return 0;
+			continue;
+		}
+		if(room > (size_t)(len-done))
+			room = len-done;
+		memcpy(region, buf+done, room);
+		advance(so, room);
+		done += (int)room;
+	}
+	return done;
+}
+
+/* The decoder writing straight into the ring. */
+static int begin_write_shm(out123_handle *ao, void **buf, size_t *bytes)
+{
+	struct shm_out *so = ao->userptr;
+	unsigned char *region;
+	size_t room;
+
+	if(!so->ring)
+		return -1;
+	room = free_region(so, &region);
+	room -= room % ao->framesize;
+	if(!room)
+		return 1;
+	if(*bytes && room > *bytes)
+		room = *bytes;
+	*buf   = region;
+	*bytes = room;
+	return 0;
+}
+
+static int commit_write_shm(out123_handle *ao, size_t bytes)
+{
+	struct shm_out *so = ao->userptr;
+
+	if(!so->ring)
+		return -1;
+	advance(so, bytes);
+	return 0;
+}
+
+static int delay_shm(out123_handle *ao, size_t *bytes)
+{
+	struct shm_out *so = ao->userptr;
+
+	if(!so->ring)
+		return -1;
+	*bytes = ring_fill(so->ring);
+	return 0;
+}
+
+static void flush_shm(out123_handle *ao)
+{
+	debug("flush_shm(): not possible, the reader owns the read position");
+}
+
+static void drain_shm(out123_handle *ao)
+{
+	struct shm_out *so = ao->userptr;
+	struct shm_ring *ring = so->ring;
+
+	if(!ring)
+		return;
+	while(ring->reader_pid && ring_fill(ring))
+		if(wait_reader(ring, ring->read_pos))
+			break;
+}
+
+static int close_shm(out123_handle *ao)
+{
+	debug("close_shm()");
+	return shm_drop(ao);
+}
+
+static int deinit_shm(out123_handle *ao)
+{
+	if(ao->userptr)
+	{
+		shm_drop(ao);
+		free(ao->userptr);
+		ao->userptr = NULL;
+	}
+	return 0;
+}
+
+static int init_shm(out123_handle* ao)
+{
+	struct shm_out *so;
+
+	if(ao==NULL) return -1;
+
+	so = malloc(sizeof(*so));
+	if(!so)
+	{
+		ao->errcode = OUT123_DOOM;
+		return -1;
+	}
+	so->name = NULL;
+	so->ring = NULL;
+	so->data = NULL;
+	so->mapsize = 0;
+	ao->userptr = so;
+
+	/* Set callbacks */
+	ao->open = open_shm;
+	ao->flush = flush_shm;
+	ao->drain = drain_shm;
+	ao->write = write_shm;
+	ao->get_formats = get_formats_shm;
+	ao->close = close_shm;
+	ao->deinit = deinit_shm;
+	ao->delay = delay_shm;
+	ao->begin_write = begin_write_shm;
+	ao->commit_write = commit_write_shm;
+	/* A pause just leaves the reader without new data. */
+	ao->propflags |= OUT123_PROP_PERSISTENT;
+
+	/* Success */
+	return 0;
+}
+
+/*
+	Module information data structure
+*/
+mpg123_module_t mpg123_output_module_info = {
+	/* api_version */	MPG123_MODULE_API_VERSION,
+	/* name */			"shm",
+	/* description */	"Output into a POSIX shared memory ring buffer for local consumers.",
+	/* revision */		"$Rev:$",
+	/* handle */		NULL,
+
+	/* init_output */	init_shm,
+};
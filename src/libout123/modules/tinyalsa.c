@@ -1,7 +1,7 @@
 /*
 	tinyalsa: sound output with TINY Advanced Linux Sound Architecture
 
-	copyright 2006-8 by the mpg123 project - free software under the terms of the LGPL 2.1
+	copyright 2006-2026 by the mpg123 project - free software under the terms of the LGPL 2.1
 	see COPYING and AUTHORS files in distribution or http://mpg123.org
 
 	initially written by Jarno Lehtinen <lehtinen@sci.fi>
@@ -15,6 +15,10 @@
 #include "debug.h"
 
 
+/* Defaults that pcm_write() always used, 1024 frames in 4 periods. */
+#define DEFAULT_PERIOD 1024
+#define DEFAULT_PERIODS 4
+
 typedef struct
 {
 	struct pcm *pcm;
@@ -23,30 +27,68 @@ typedef struct
 
 	unsigned int device;
 	unsigned int card;
+	int mmap;    /* opened with PCM_MMAP, for out123_play_begin() */
+	int started; /* pcm_start() done since prepare */
+	unsigned int offset; /* region from begin_write_tinyalsa() */
 } mpg123_tinyalsa_t;
 
 
+/* Periods from OUT123_DEVICEPERIOD and OUT123_DEVICEBUFFER. */
+static void setup_periods(out123_handle *ao, struct pcm_config *config)
+{
+	unsigned int period = ao->device_period > 0.
+	?	(unsigned int)(ao->rate*ao->device_period+0.5)
+	:	DEFAULT_PERIOD;
+	unsigned int count = DEFAULT_PERIODS;
+	if(period < 16)
+		period = 16;
+	if(ao->device_buffer > 0.)
+		count = (unsigned int)((ao->rate*ao->device_buffer)/period+0.5);
+	if(count < 2)
+		count = 2;
+	config->period_size = period;
+	config->period_count = count;
+}
+
 static int initialize_device(out123_handle *ao)
 {
 	mpg123_tinyalsa_t* ta = (mpg123_tinyalsa_t*)ao->userptr;
 
 	ta->config.channels = ao->channels;
 	ta->config.rate = ao->rate;
-    	ta->config.period_size = 1024;
-    	ta->config.period_count = 4;
-       	ta->config.format = PCM_FORMAT_S16_LE;
-    	ta->config.start_threshold = 0;
-    	ta->config.stop_threshold = 0;
+	setup_periods(ao, &ta->config);
+	ta->config.format = PCM_FORMAT_S16_LE;
+	/* Start as soon as the first period is there, wake up once per period. */
+	ta->config.start_threshold = ta->config.period_size;
+	ta->config.stop_threshold = 0;
 	ta->config.silence_threshold = 0;
+	ta->config.avail_min = ta->config.period_size;
+	ta->started = 0;
 
-	ta->pcm = pcm_open(ta->card, ta->device, PCM_OUT, &ta->config);
+	/* Direct access to the device buffer if the driver offers it. */
+	ta->mmap = 1;
+	ta->pcm = pcm_open(ta->card, ta->device, PCM_OUT|PCM_MMAP, &ta->config);
+	if (!ta->pcm || !pcm_is_ready(ta->pcm))
+	{
+		debug1("no mmap: %s", ta->pcm ? pcm_get_error(ta->pcm) : "<nil>");
+		if(ta->pcm)
+			pcm_close(ta->pcm);
+		ta->mmap = 0;
+		ta->pcm = pcm_open(ta->card, ta->device, PCM_OUT, &ta->config);
+	}
 	if (!ta->pcm || !pcm_is_ready(ta->pcm))
 	{
 		if(!AOQUIET)
 			error3( "(open) Unable to open card %u PCM device %u (%s)\n"
 			,	ta->card, ta->device, pcm_get_error(ta->pcm) );
+		if(ta->pcm)
+			pcm_close(ta->pcm);
+		ta->pcm = NULL;
 		return -1;
 	}
+	debug3( "period %u x %u, mmap %i", ta->config.period_size
+	,	ta->config.period_count, ta->mmap );
+	ao->device_length = (double)pcm_get_buffer_size(ta->pcm)/ao->rate;
 
 	return 0;
 }
@@ -54,20 +96,21 @@ static int initialize_device(out123_handle *ao)
 
 static int open_tinyalsa(out123_handle *ao)
 {
-        debug("open_tinyalsa()");
+	debug("open_tinyalsa()");
 
 	mpg123_tinyalsa_t* ta = (mpg123_tinyalsa_t*)ao->userptr;
 
-        if (ao->format != -1)
+	ta->pcm = NULL;
+	if (ao->format != -1)
 	{
-                /* we're going to play: initalize sample format */
-                return initialize_device(ao);
-        }
+		/* we're going to play: initalize sample format */
+		return initialize_device(ao);
+	}
 	else
 	{
-                /* query mode; sample format will be set for each query */
-                return 0;
-        }
+		/* query mode; sample format will be set for each query */
+		return 0;
+	}
 }
 
 
@@ -88,22 +131,125 @@ static int get_formats_tinyalsa(out123_handle *ao)
 }
 
 
+/* After an underrun, the device needs to be prepared and started again. */
+static int recover_tinyalsa(out123_handle *ao, int err)
+{
+	mpg123_tinyalsa_t* ta = (mpg123_tinyalsa_t*)ao->userptr;
+
+	if(err != -EPIPE)
+		return -1;
+	++ao->stats.underruns;
+	ta->started = 0;
+	return pcm_prepare(ta->pcm);
+}
+
 static int write_tinyalsa(out123_handle *ao, unsigned char *buf, int bytes)
 {
 	mpg123_tinyalsa_t* ta = (mpg123_tinyalsa_t*)ao->userptr;
 
 	if (ta->pcm)
 	{
-		if(pcm_write(ta->pcm, buf, bytes))
+		int err;
+		while( (err = ta->mmap
+		?	pcm_mmap_write(ta->pcm, buf, bytes)
+		:	pcm_write(ta->pcm, buf, bytes)) < 0
+		&&	recover_tinyalsa(ao, err) == 0 )
+			debug1("recovered from error %i", err);
+		if(err < 0)
 		{
 			if(!AOQUIET)
 				error("Error playing sample\n");
 			return -1;
 		}
+		ta->started = 1;
 	}
 	return bytes;
 }
 
+/* Wait for free space in the device buffer and hand out the first
+   contiguous part of it. */
+static int begin_write_tinyalsa(out123_handle *ao, void **buf, size_t *bytes)
+{
+	mpg123_tinyalsa_t* ta = (mpg123_tinyalsa_t*)ao->userptr;
+	void *areas;
+	unsigned int frames;
+	int avail;
+	int err;
+
+	if(!ta->pcm || !ta->mmap)
+		return 1;
+	while((avail = pcm_mmap_avail(ta->pcm)) < 1)
+	{
+		if(avail < 0)
+			err = avail;
+		/* A full buffer that did not start yet needs a kick. */
+		else if(!ta->started)
+		{
+			err = pcm_start(ta->pcm);
+			ta->started = 1;
+		}
+		else if((err = pcm_wait(ta->pcm, -1)) > 0)
+			err = 0;
+		if(err < 0 && recover_tinyalsa(ao, err) < 0)
+		{
+			if(!AOQUIET)
+				error1("Fatal problem with tinyalsa output, error %i.", err);
+			return -1;
+		}
+	}
+	frames = pcm_bytes_to_frames(ta->pcm, *bytes);
+	if(frames > (unsigned int)avail)
+		frames = avail;
+	if((err = pcm_mmap_begin(ta->pcm, &areas, &ta->offset, &frames)) < 0)
+	{
+		if(!AOQUIET)
+			error1("Fatal problem with tinyalsa output, error %i.", err);
+		return -1;
+	}
+	*buf = (char*)areas + pcm_frames_to_bytes(ta->pcm, ta->offset);
+	*bytes = pcm_frames_to_bytes(ta->pcm, frames);
+	return 0;
+}
+
+static int commit_write_tinyalsa(out123_handle *ao, size_t bytes)
+{
+	mpg123_tinyalsa_t* ta = (mpg123_tinyalsa_t*)ao->userptr;
+	unsigned int frames = pcm_bytes_to_frames(ta->pcm, bytes);
+	int committed;
+
+	committed = pcm_mmap_commit(ta->pcm, ta->offset, frames);
+	if(committed < 0 || (unsigned int)committed != frames)
+	{
+		/* An underrun in between loses the region, but not the device. */
+		recover_tinyalsa(ao, committed < 0 ? committed : -EPIPE);
+		return -1;
+	}
+	/* Direct access does not trigger the start threshold, start with the
+	   first period for low latency. */
+	if( !ta->started && pcm_mmap_avail(ta->pcm) >= 0
+	&&  pcm_get_buffer_size(ta->pcm) - (unsigned int)pcm_mmap_avail(ta->pcm)
+	    >= ta->config.start_threshold )
+	{
+		pcm_start(ta->pcm);
+		ta->started = 1;
+	}
+	return 0;
+}
+
+static int delay_tinyalsa(out123_handle *ao, size_t *bytes)
+{
+	mpg123_tinyalsa_t* ta = (mpg123_tinyalsa_t*)ao->userptr;
+	unsigned int avail;
+	struct timespec tstamp;
+
+	if(!ta || !ta->pcm || pcm_get_htimestamp(ta->pcm, &avail, &tstamp))
+		return -1;
+	if(avail > pcm_get_buffer_size(ta->pcm))
+		avail = pcm_get_buffer_size(ta->pcm);
+	*bytes = pcm_frames_to_bytes(ta->pcm, pcm_get_buffer_size(ta->pcm)-avail);
+	return 0;
+}
+
 
 static void flush_tinyalsa(out123_handle *ao)
 {
@@ -120,6 +266,7 @@ static int close_tinyalsa(out123_handle *ao)
 	if (ta->pcm)
 	{
 		pcm_close(ta->pcm);
+		ta->pcm = NULL;
 	}
 
 	return 0;
@@ -156,6 +303,9 @@ static int init_tinyalsa(out123_handle* ao)
 	ao->get_formats = get_formats_tinyalsa;
 	ao->close = close_tinyalsa;
 	ao->deinit = deinit_tinyalsa;
+	ao->delay = delay_tinyalsa;
+	ao->begin_write = begin_write_tinyalsa;
+	ao->commit_write = commit_write_tinyalsa;
 
 	/* Allocate memory for data structure */
 	ao->userptr = malloc( sizeof( mpg123_tinyalsa_t ) );
@@ -5,11 +5,17 @@
 	see COPYING and AUTHORS files in distribution or http://mpg123.org
 
 	based on win32.c
+
+	Exclusive mode with event-driven buffer exchange. The period is
+	negotiated from OUT123_DEVICEPERIOD within the limits of the device,
+	formats are handed over as WAVEFORMATEXTENSIBLE so that float and
+	24/32 bit integer reach the hardware without conversion.
 */
 #define _WIN32_WINNT 0x601
 #define COBJMACROS 1
 #include "out123_int.h"
 #include <initguid.h>
+#include <mmreg.h>
 #include <audioclient.h>
 #include <mmdeviceapi.h>
 #include <avrt.h>
@@ -48,16 +54,20 @@ MPG123_DEFINE_IID(IAudioRenderClient, f294acfc, 3146, 4483, a7, bf, ad, dc, a7,
 #define mpg123_IID_IAudioRenderClient IID_IAudioRenderClient
 #endif
 
+/* Subformats for WAVEFORMATEXTENSIBLE, defined here to avoid ksmedia.h. */
+static const GUID mpg123_KSDATAFORMAT_SUBTYPE_PCM =
+{ 0x00000001, 0x0000, 0x0010, {0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71} };
+static const GUID mpg123_KSDATAFORMAT_SUBTYPE_IEEE_FLOAT =
+{ 0x00000003, 0x0000, 0x0010, {0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71} };
+
 /* Push mode does not work right yet, noisy audio, probably something to do with timing and buffers */
 #define WASAPI_EVENT_MODE 1
 #ifdef WASAPI_EVENT_MODE
 #define Init_Flag AUDCLNT_STREAMFLAGS_EVENTCALLBACK
-#define MOD_STRING "Experimental Audio output for Windows (wasapi event mode)."
-#define BUFFER_TIME 20000000.0
+#define MOD_STRING "Audio output for Windows (wasapi exclusive event mode)."
 #else
 #define Init_Flag 0
 #define MOD_STRING "Experimental Audio output for Windows (wasapi push mode)."
-#define BUFFER_TIME 640000000.0
 #endif
 
 static int init_win32(out123_handle* ao);
@@ -102,6 +112,9 @@ typedef struct _wasapi_state_struct {
   DWORD framesize;
 } wasapi_state_struct;
 
+static int write_init(out123_handle *ao);
+static int close_win32(out123_handle *ao);
+
 /* setup endpoints */
 static int open_win32(out123_handle *ao){
   HRESULT hr = 0;
@@ -129,153 +142,145 @@ static int open_win32(out123_handle *ao){
   debug("IMMDeviceActivator_Activate");
   EXIT_ON_ERROR(hr)
 
+  /* Set up the stream right away to know the latency after out123_start(). */
+  if(ao->format != -1 && write_init(ao))
+    goto Exit;
   return 0;
   Exit:
   debug2("%s failed with %lx", __FUNCTION__, hr);
-  return 1;
+  close_win32(ao);
+  return -1;
 }
 
-/*
-  typedef struct tWAVEFORMATEX {
-    WORD wFormatTag;
-    WORD nChannels;
-    DWORD nSamplesPerSec;
-    DWORD nAvgBytesPerSec;
-    WORD nBlockAlign;
-    WORD wBitsPerSample;
-    WORD cbSize;
-
-  } WAVEFORMATEX;
-*/
+/* Encodings in the order of preference, 8 bit PCM is unsigned. */
+static const int wasapi_encodings[] = {
+  MPG123_ENC_SIGNED_16, MPG123_ENC_FLOAT_32, MPG123_ENC_SIGNED_32,
+  MPG123_ENC_SIGNED_24, MPG123_ENC_UNSIGNED_8
+};
+#define NUM_ENCODINGS (sizeof(wasapi_encodings)/sizeof(wasapi_encodings[0]))
 
-static int formats_generator(const out123_handle * const ao, const int waveformat, WAVEFORMATEX *const format){
-  DWORD bytes_per_sample = 0;
-  WORD tag = WAVE_FORMAT_PCM;
+/* Exclusive mode wants the extensible format for anything beyond 16 bit stereo. */
+static int formats_generator(const out123_handle * const ao, const int waveformat, WAVEFORMATEXTENSIBLE *const format){
+  WORD bytes_per_sample = MPG123_SAMPLESIZE(waveformat);
   debug1("%s",__FUNCTION__);
-  int ret = waveformat;
+  memset(format, 0, sizeof(*format));
   switch(waveformat){
-    case MPG123_ENC_SIGNED_8:
-      bytes_per_sample = 1;
-      break;
     case MPG123_ENC_FLOAT_32:
-      tag = WAVE_FORMAT_IEEE_FLOAT;
-    case MPG123_ENC_SIGNED_32:
-      bytes_per_sample = 4;
+      format->SubFormat = mpg123_KSDATAFORMAT_SUBTYPE_IEEE_FLOAT;
       break;
+    case MPG123_ENC_UNSIGNED_8:
     case MPG123_ENC_SIGNED_16:
-      bytes_per_sample = 2;
-      break;
     case MPG123_ENC_SIGNED_24:
-      bytes_per_sample = 3;
+    case MPG123_ENC_SIGNED_32:
+      format->SubFormat = mpg123_KSDATAFORMAT_SUBTYPE_PCM;
       break;
     default:
       debug1("uh oh unknown %d",waveformat);
-      ret = 0;
-      break;
+      return 0;
   }
-  format->wFormatTag = tag;
-  format->nChannels = ao->channels;
-  format->nSamplesPerSec = ao->rate;
-  format->nAvgBytesPerSec = ao->channels * bytes_per_sample * ao->rate;
-  format->nBlockAlign = ao->channels * bytes_per_sample;
-  format->wBitsPerSample = bytes_per_sample * 8;
-  format->cbSize = 0;
-  return ret;
+  format->Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+  format->Format.nChannels = ao->channels;
+  format->Format.nSamplesPerSec = ao->rate;
+  format->Format.nAvgBytesPerSec = ao->channels * bytes_per_sample * ao->rate;
+  format->Format.nBlockAlign = ao->channels * bytes_per_sample;
+  format->Format.wBitsPerSample = bytes_per_sample * 8;
+  format->Format.cbSize = sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+  format->Samples.wValidBitsPerSample = bytes_per_sample * 8;
+  if(ao->channels == 1)
+    format->dwChannelMask = SPEAKER_FRONT_CENTER;
+  else if(ao->channels == 2)
+    format->dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
+  return waveformat;
 }
 
 /* check supported formats */
 static int get_formats_win32(out123_handle *ao){
-  /* PLEASE check with write_init and write_win32 buffer size calculation in case it is able to support something other than 16bit */
   HRESULT hr;
   int ret = 0;
+  size_t i;
   debug1("%s",__FUNCTION__);
 
   if(!ao || !ao->userptr) return -1;
   wasapi_state_struct *state = (wasapi_state_struct *) ao->userptr;
   debug2("channels %d, rate %ld",ao->channels, ao->rate);
 
-  WAVEFORMATEX wf;
-
-   if(ao->format & MPG123_ENC_SIGNED_8){
-      formats_generator(ao,MPG123_ENC_SIGNED_8,&wf);
-      if((hr = IAudioClient_IsFormatSupported(state->pAudioClient,AUDCLNT_SHAREMODE_EXCLUSIVE, &wf, NULL)) == S_OK)
-      ret |= MPG123_ENC_SIGNED_8;
-      if(hr == AUDCLNT_E_UNSUPPORTED_FORMAT) debug1("MPG123_ENC_SIGNED_8 %ld not supported", ao->rate);
-   }
-
-   if(ao->format & MPG123_ENC_SIGNED_16){
-      formats_generator(ao,MPG123_ENC_SIGNED_16,&wf);
-      if((hr = IAudioClient_IsFormatSupported(state->pAudioClient,AUDCLNT_SHAREMODE_EXCLUSIVE, &wf, NULL)) == S_OK)
-      ret |= MPG123_ENC_SIGNED_16;
-      if(hr == AUDCLNT_E_UNSUPPORTED_FORMAT) debug1("MPG123_ENC_SIGNED_16 %ld not supported", ao->rate);
-   }
-
-   if(ao->format & MPG123_ENC_SIGNED_32){
-      formats_generator(ao,MPG123_ENC_SIGNED_32,&wf);
-      if((hr = IAudioClient_IsFormatSupported(state->pAudioClient,AUDCLNT_SHAREMODE_EXCLUSIVE, &wf, NULL)) == S_OK)
-      ret |= MPG123_ENC_SIGNED_32;
-      if(hr == AUDCLNT_E_UNSUPPORTED_FORMAT) debug1("MPG123_ENC_SIGNED_32 %ld not supported", ao->rate);
-   }
-
-   if(ao->format & MPG123_ENC_FLOAT_32){
-      formats_generator(ao,MPG123_ENC_FLOAT_32,&wf);
-      if((hr = IAudioClient_IsFormatSupported(state->pAudioClient,AUDCLNT_SHAREMODE_EXCLUSIVE, &wf, NULL)) == S_OK)
-      ret |= MPG123_ENC_FLOAT_32;
-      if(hr == AUDCLNT_E_UNSUPPORTED_FORMAT) debug1("MPG123_ENC_FLOAT_32 %ld not supported", ao->rate);
-   }
-
-   if(ao->format & MPG123_ENC_SIGNED_24){
-      formats_generator(ao,MPG123_ENC_SIGNED_24,&wf);
-      if((hr = IAudioClient_IsFormatSupported(state->pAudioClient,AUDCLNT_SHAREMODE_EXCLUSIVE, &wf, NULL)) == S_OK)
-      ret |= MPG123_ENC_SIGNED_24;
-      if(hr == AUDCLNT_E_UNSUPPORTED_FORMAT) debug1("MPG123_ENC_SIGNED_24 %ld not supported", ao->rate);
-   }
-
-  return ret; /* afaik only 16bit 44.1kHz/48kHz has been known to work */
+  WAVEFORMATEXTENSIBLE wf;
+
+  for(i=0; i<NUM_ENCODINGS; ++i){
+    if(!(ao->format & wasapi_encodings[i]))
+      continue;
+    formats_generator(ao,wasapi_encodings[i],&wf);
+    if((hr = IAudioClient_IsFormatSupported(state->pAudioClient,AUDCLNT_SHAREMODE_EXCLUSIVE, (WAVEFORMATEX*)&wf, NULL)) == S_OK)
+      ret |= wasapi_encodings[i];
+    if(hr == AUDCLNT_E_UNSUPPORTED_FORMAT) debug2("encoding 0x%x %ld not supported", wasapi_encodings[i], ao->rate);
+  }
+
+  return ret;
 }
 
-/* setup with agreed on format, for now only MPG123_ENC_SIGNED_16 */
-static int write_init(out123_handle *ao){
+/* Initialize the client with a period as close to OUT123_DEVICEPERIOD as the device allows. */
+static HRESULT init_client(out123_handle *ao, wasapi_state_struct *state, WAVEFORMATEXTENSIBLE *wf){
+  REFERENCE_TIME def_period, min_period;
   HRESULT hr;
-  double offset = 0.5;
-
-  debug1("%s",__FUNCTION__);
-  if(!ao || !ao->userptr) return -1;
-  wasapi_state_struct *state = (wasapi_state_struct *) ao->userptr;
 
-  WAVEFORMATEX s16;
-  formats_generator(ao,ao->format,&s16);
-  state->framesize = s16.nBlockAlign;
-  debug1("block size %ld", state->framesize);
-  /* cargo cult code */
-  hr = IAudioClient_GetDevicePeriod(state->pAudioClient,NULL, &state->hnsRequestedDuration);
-  debug("IAudioClient_GetDevicePeriod OK");
-  reinit:
+  hr = IAudioClient_GetDevicePeriod(state->pAudioClient, &def_period, &min_period);
+  EXIT_ON_ERROR(hr)
+  debug2("device period default %I64d, minimum %I64d", def_period, min_period);
+  state->hnsRequestedDuration = def_period;
+  if(ao->device_period > 0.){
+    state->hnsRequestedDuration = (REFERENCE_TIME)(ao->device_period*REFTIMES_PER_SEC+0.5);
+    if(state->hnsRequestedDuration < min_period)
+      state->hnsRequestedDuration = min_period;
+  }
+  /* In event mode, buffer duration and periodicity have to be equal. */
   hr = IAudioClient_Initialize(state->pAudioClient,
                        AUDCLNT_SHAREMODE_EXCLUSIVE,
                        Init_Flag,
                        state->hnsRequestedDuration,
                        state->hnsRequestedDuration,
-                       &s16,
+                       (WAVEFORMATEX*)wf,
                        NULL);
-  debug("IAudioClient_Initialize OK");
-  /* something about buffer sizes on Win7, fixme might loop forever */
+  debug("IAudioClient_Initialize");
   if (hr == AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED){
-    if (offset > 10.0) goto Exit; /* is 10 enough to break out of the loop?*/
+    /* Retry once with the next aligned size the device offered. */
     debug("AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED");
-    IAudioClient_GetBufferSize(state->pAudioClient,&state->bufferFrameCount);
-    /* double buffered */
-	state->hnsRequestedDuration = (REFERENCE_TIME)((BUFFER_TIME / s16.nSamplesPerSec * state->bufferFrameCount) + offset);
-    offset += 0.5;
-	IAudioClient_Release(state->pAudioClient);
-	state->pAudioClient = NULL;
-	hr = IMMDeviceActivator_Activate(state->pDevice,
+    hr = IAudioClient_GetBufferSize(state->pAudioClient,&state->bufferFrameCount);
+    EXIT_ON_ERROR(hr)
+    state->hnsRequestedDuration = (REFERENCE_TIME)((double)REFTIMES_PER_SEC / wf->Format.nSamplesPerSec * state->bufferFrameCount + 0.5);
+    IAudioClient_Release(state->pAudioClient);
+    state->pAudioClient = NULL;
+    hr = IMMDeviceActivator_Activate(state->pDevice,
                   &mpg123_IID_IAudioClient, CLSCTX_ALL,
                   NULL, (void**)&state->pAudioClient);
     debug("IMMDeviceActivator_Activate");
-    goto reinit;
+    EXIT_ON_ERROR(hr)
+    hr = IAudioClient_Initialize(state->pAudioClient,
+                       AUDCLNT_SHAREMODE_EXCLUSIVE,
+                       Init_Flag,
+                       state->hnsRequestedDuration,
+                       state->hnsRequestedDuration,
+                       (WAVEFORMATEX*)wf,
+                       NULL);
+    debug("IAudioClient_Initialize");
   }
-  EXIT_ON_ERROR(hr)
+  Exit:
+  return hr;
+}
+
+/* setup with agreed on format */
+static int write_init(out123_handle *ao){
+  HRESULT hr;
+  REFERENCE_TIME latency = 0;
+
+  debug1("%s",__FUNCTION__);
+  if(!ao || !ao->userptr) return -1;
+  wasapi_state_struct *state = (wasapi_state_struct *) ao->userptr;
+
+  WAVEFORMATEXTENSIBLE wf;
+  if(!formats_generator(ao,ao->format,&wf)) return -1;
+  state->framesize = wf.Format.nBlockAlign;
+  debug1("block size %ld", state->framesize);
+  hr = init_client(ao, state, &wf);
   EXIT_ON_ERROR(hr)
   hr = IAudioClient_GetService(state->pAudioClient,
                         &mpg123_IID_IAudioRenderClient,
@@ -292,6 +297,11 @@ static int write_init(out123_handle *ao){
   hr = IAudioClient_GetBufferSize(state->pAudioClient,&state->bufferFrameCount);
   debug("IAudioClient_GetBufferSize OK");
   EXIT_ON_ERROR(hr)
+  /* One buffer with us, one with the device, plus what the stream adds. */
+  IAudioClient_GetStreamLatency(state->pAudioClient, &latency);
+  ao->device_length = 2.*state->bufferFrameCount/ao->rate
+  + (double)latency/REFTIMES_PER_SEC;
+  debug2("buffer %u frames, latency %g s", state->bufferFrameCount, ao->device_length);
   return 0;
 Exit:
   debug2("%s failed with %lx", __FUNCTION__, hr);
@@ -305,7 +315,8 @@ static HRESULT play_init(out123_handle *ao){
   wasapi_state_struct *state = (wasapi_state_struct *) ao->userptr;
   if(!state->is_playing){
     debug1("%s",__FUNCTION__);
-    state->hTask = AvSetMmThreadCharacteristicsW(L"Pro Audio", &state->taskIndex);
+    if(!state->hTask)
+      state->hTask = AvSetMmThreadCharacteristicsW(L"Pro Audio", &state->taskIndex);
     hr = IAudioClient_Start(state->pAudioClient);
     state->is_playing = 1;
     debug("IAudioClient_Start");
@@ -325,7 +336,7 @@ static int write_win32(out123_handle *ao, unsigned char *buf, int len){
   if(!ao || !ao->userptr) return -1;
   wasapi_state_struct *state = (wasapi_state_struct *) ao->userptr;
   if(!len) return 0;
-  if(!state->pRenderClient) write_init(ao);
+  if(!state->pRenderClient && write_init(ao)) return -1;
   size_t frames_in = len/state->framesize; /* Frames in buf, is framesize even correct? */
   debug("mode entered");
 #ifdef WASAPI_EVENT_MODE
@@ -444,16 +455,34 @@ static void flush_win32(out123_handle *ao){
   wasapi_state_struct *state = (wasapi_state_struct *) ao->userptr;
   HRESULT hr;
   if(!state->pAudioClient) return;
-  state->pData = NULL;
+  if(state->pData){
+    /* Give back the acquired buffer empty. */
+    IAudioRenderClient_ReleaseBuffer(state->pRenderClient, 0, 0);
+    state->pData = NULL;
+  }
+  state->pData_off = 0;
+  state->is_playing = 0;
   hr = IAudioClient_Stop(state->pAudioClient);
   EXIT_ON_ERROR(hr)
-  IAudioClient_Reset(state->pAudioClient);
+  hr = IAudioClient_Reset(state->pAudioClient);
   EXIT_ON_ERROR(hr)
   return;
   Exit:
   debug2("%s IAudioClient_Stop with %lx", __FUNCTION__, hr);
 }
 
+/* Queued in the device plus what sits in the current unreleased buffer. */
+static int delay_win32(out123_handle *ao, size_t *bytes){
+  UINT32 padding = 0;
+  if(!ao || !ao->userptr) return -1;
+  wasapi_state_struct *state = (wasapi_state_struct *) ao->userptr;
+  if(!state->pAudioClient || !state->pRenderClient) return -1;
+  if(FAILED(IAudioClient_GetCurrentPadding(state->pAudioClient, &padding)))
+    return -1;
+  *bytes = ((size_t)padding + state->pData_off)*state->framesize;
+  return 0;
+}
+
 static int close_win32(out123_handle *ao)
 {
   debug1("%s",__FUNCTION__);
@@ -474,6 +503,7 @@ static int close_win32(out123_handle *ao)
   if(state->hTask) AvRevertMmThreadCharacteristics(state->hTask);
   if(state->pEnumerator) IMMDeviceEnumerator_Release(state->pEnumerator);
   if(state->pDevice) IMMDevice_Release(state->pDevice);
+  if(state->hEvent) CloseHandle(state->hEvent);
   CoUninitialize();
   free(state);
   ao->userptr = NULL;
@@ -490,6 +520,7 @@ static int init_win32(out123_handle* ao){
 	ao->write = write_win32;
 	ao->get_formats = get_formats_win32;
 	ao->close = close_win32;
+	ao->delay = delay_win32;
     ao->userptr = NULL;
 
 	/* Success */
@@ -47,6 +47,19 @@ enum playstate
 ,	play_live     /* playing right now */
 };
 
+struct out123_conv;
+struct out123_feeder;
+
+/* Glitch statistics behind OUT123_UNDERRUNS and friends. */
+struct out123_stats
+{
+	long underruns;        /* device xruns the driver recovered from */
+	double xrun_max;       /* longest of those recoveries, seconds */
+	double write_max;      /* longest device write, seconds */
+	long buffer_underruns; /* buffer ran empty during playback */
+	long buffer_minfill;   /* lowest buffer fill while playing, -1 for none */
+};
+
 struct out123_struct
 {
 	enum out123_error errcode;
@@ -56,6 +69,10 @@ struct out123_struct
 	int buffer_pid;
 	int buffer_fd[2];
 	txfermem *buffermem;
+#ifndef NO_THREADS
+	/* Alternatively, a thread with its own handle (OUT123_BUFFER_THREAD). */
+	struct buffer_thread *buffer_thread;
+#endif
 #endif
 
 	int fn;			/* filenumber */
@@ -69,12 +86,18 @@ struct out123_struct
 	void (*drain)(out123_handle *);
 	int (*close)(out123_handle *);
 	int (*deinit)(out123_handle *);
+	/* Optional: bytes queued in the device, 0 on success. */
+	int (*delay)(out123_handle *, size_t *);
+	/* Optional: writable region in the device buffer and handing it over,
+	   0 on success, -1 on error, 1 if not possible now (use write). */
+	int (*begin_write)(out123_handle *, void **, size_t *);
+	int (*commit_write)(out123_handle *, size_t);
 	
 	/* the loaded that has set the above */
 	mpg123_module_t *module;
 
 	char *name;	    /* optional name of this instance */
-	char *realname; /* name possibly changed by backend */
+	char *realname; /* name possibly changed by backend, our copy */
 	char *driver;	/* driver (module) name */
 	char *device;	/* device name */
 	int   flags;	/* some bits; namely headphone/speaker/line */
@@ -86,13 +109,51 @@ struct out123_struct
 	enum playstate state; /* ... */
 	int auxflags;	/* For now just one: quiet mode (for probing). */
 	int propflags;	/* Property flags, set by driver. */
+	int probed;	/* Device still open in query mode from out123_open(). */
 	double preload;	/* buffer fraction to preload before play */
+	double preload_time; /* seconds to preload, overriding the fraction */
+	double refill_time; /* seconds to preload again after an underrun */
 	int verbose;	/* verbosity to stderr */
 	double device_buffer; /* device buffer in seconds */
+	double device_period; /* device period in seconds */
+	double device_length; /* actual device buffer in seconds, set by driver */
+	long file_buffer; /* stdio buffer bytes for file output */
+	long file_length; /* expected PCM frames for file output */
+	int rtprio; /* buffer scheduling: >0 SCHED_FIFO, <0 SCHED_RR priority */
+	long cpumask; /* buffer CPU affinity, 0 for inherited */
+	struct out123_stats stats; /* counted where the device is written */
 	char *bindir;	/* OUT123_BINDIR */
+	struct out123_conv *conv; /* OUT123_CONVERT, if the device format differs */
+	int play_begun; /* region from out123_play_begin(): 0 none, 1 staging, 2 device, 3 buffer */
+	size_t play_size; /* size of that region */
+	void *playbuf;  /* staging buffer for out123_play_begin() */
+	size_t playbuf_size;
+	out123_fill_func fill; /* pull mode, see out123_set_fill() */
+	void *filldata;
+	/* Set before ao->open() if fill() delivers the device format. A driver
+	   that then calls fill() from its own thread sets fill_native. */
+	int fill_device;
+	int fill_native;
+	int pulling; /* started with fill(), natively or with the feeder */
+	struct out123_feeder *feeder; /* thread calling fill() otherwise */
+	/* OUT123_FORMAT_CACHE: encodings probed for the open device, the first
+	   entry for the default format (rate 0 if not known yet). */
+	int fmtcache_on;
+	struct mpg123_fmt *fmtcache;
+	int fmtcache_fill;
+	int fmtcache_size;
 /* TODO int intflag;   ... is it really useful/necessary from the outside? */
 };
 
+/* Optional USDT probes (configure --enable-usdt) for tracing glitches
+   with perf, bpftrace or SystemTap. */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define AOPROBE2(name, a, b) DTRACE_PROBE2(libout123, name, a, b)
+#else
+#define AOPROBE2(name, a, b)
+#endif
+
 /* Lazy. */
 #define AOQUIET ((ao->auxflags | ao->flags) & OUT123_QUIET)
 #define AOVERBOSE(v) (!AOQUIET && ao->verbose >= (v))
@@ -107,9 +168,13 @@ struct audio_format_name {
 	char *sname;
 };
 
+/* out123_play() without conversion. */
+size_t play_device(out123_handle *ao, void *bytes, size_t count);
 int write_parameters(out123_handle *ao, int fd);
 int read_parameters(out123_handle *ao
 ,	int fd, byte *prebuf, int *preoff, int presize);
+/* Forget the probed formats (OUT123_FORMAT_CACHE). */
+void fmtcache_clear(out123_handle *ao);
 
 #endif
 
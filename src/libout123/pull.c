@@ -0,0 +1,186 @@
+/*
+	pull: callback-driven playback (out123_set_fill())
+
+	copyright 2020 by the mpg123 project
+	                  - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	With a fill callback registered, out123_start() hands the production
+	of audio to the device side. Drivers that run their own processing
+	thread (JACK) call fill() from there for each period, without any
+	ring buffer in between, so the latency is what the server has. They
+	only get that chance if fill() delivers the device format, that is,
+	without OUT123_CONVERT kicking in and without the buffer.
+
+	Everything else gets a feeder thread that asks fill() for a block and
+	plays it through out123_play(), conversion and buffer included. That
+	is no lower latency than pushing, but the same interface everywhere.
+*/
+
+#include "out123_int.h"
+#include "pull.h"
+#include "convert.h"
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
+
+#include "debug.h"
+
+/* Client PCM frames requested by the feeder thread in one go. */
+#define PULL_BLOCK 1024
+
+#ifndef NO_THREADS
+struct out123_feeder
+{
+	pthread_t id;
+	pthread_mutex_t lock;
+	pthread_t self; /* id as seen by the thread */
+	int running;
+	int stop;
+	unsigned char *buf;
+	size_t bufsize;
+};
+
+static int feeder_stopped(struct out123_feeder *fd)
+{
+	int stop;
+	pthread_mutex_lock(&fd->lock);
+	stop = fd->stop;
+	pthread_mutex_unlock(&fd->lock);
+	return stop;
+}
+
+static void *feeder_main(void *arg)
+{
+	out123_handle *ao = arg;
+	struct out123_feeder *fd = ao->feeder;
+
+	/* The id from pthread_create() might not be stored yet. */
+	pthread_mutex_lock(&fd->lock);
+	fd->self = pthread_self();
+	fd->running = 1;
+	pthread_mutex_unlock(&fd->lock);
+	while(!feeder_stopped(fd))
+	{
+		size_t got = ao->fill(ao->filldata, fd->buf, fd->bufsize);
+		debug1("feeder got %"SIZE_P" bytes", (size_p)got);
+		if(!got)
+			break;
+		if(got > fd->bufsize)
+			got = fd->bufsize;
+		if(!out123_play(ao, fd->buf, got) && ao->errcode)
+		{
+			if(!AOQUIET)
+				error1("feeder thread ends on playback error: %s"
+				,	out123_strerror(ao));
+			break;
+		}
+	}
+	return NULL;
+}
+#endif
+
+void pull_prepare(out123_handle *ao)
+{
+	ao->fill_device = ao->fill && !ao->conv;
+}
+
+int pull_start(out123_handle *ao)
+{
+	ao->pulling = ao->fill != NULL;
+	if(!ao->fill || ao->fill_native)
+		return OUT123_OK;
+#ifdef NO_THREADS
+	ao->pulling = 0;
+	return OUT123_NOT_SUPPORTED;
+#else
+	{
+		long rate;
+		int channels, encoding, framesize;
+		struct out123_feeder *fd = malloc(sizeof(*fd));
+
+		if(!fd)
+			return OUT123_DOOM;
+		conv_client_format(ao, &rate, &channels, &encoding, &framesize);
+		fd->stop = 0;
+		fd->running = 0;
+		fd->bufsize = (size_t)PULL_BLOCK*framesize;
+		fd->buf = malloc(fd->bufsize);
+		if(!fd->buf || pthread_mutex_init(&fd->lock, NULL))
+		{
+			if(fd->buf)
+				free(fd->buf);
+			free(fd);
+			ao->pulling = 0;
+			return OUT123_DOOM;
+		}
+		ao->feeder = fd;
+		if(pthread_create(&fd->id, NULL, feeder_main, ao))
+		{
+			ao->feeder = NULL;
+			pthread_mutex_destroy(&fd->lock);
+			free(fd->buf);
+			free(fd);
+			ao->pulling = 0;
+			return OUT123_ERR;
+		}
+		return OUT123_OK;
+	}
+#endif
+}
+
+#ifndef NO_THREADS
+static void feeder_end(out123_handle *ao, int stop)
+{
+	struct out123_feeder *fd = ao->feeder;
+
+	if(!fd)
+		return;
+	if(stop)
+	{
+		pthread_mutex_lock(&fd->lock);
+		fd->stop = 1;
+		pthread_mutex_unlock(&fd->lock);
+	}
+	pthread_join(fd->id, NULL);
+	pthread_mutex_destroy(&fd->lock);
+	free(fd->buf);
+	free(fd);
+	ao->feeder = NULL;
+}
+#endif
+
+int pull_feeder(out123_handle *ao)
+{
+#ifndef NO_THREADS
+	struct out123_feeder *fd = ao->feeder;
+	int ret;
+
+	if(!fd)
+		return 0;
+	pthread_mutex_lock(&fd->lock);
+	ret = fd->running && pthread_equal(pthread_self(), fd->self);
+	pthread_mutex_unlock(&fd->lock);
+	return ret;
+#else
+	return 0;
+#endif
+}
+
+void pull_stop(out123_handle *ao)
+{
+#ifndef NO_THREADS
+	feeder_end(ao, 1);
+#endif
+	ao->pulling = 0;
+}
+
+void pull_finish(out123_handle *ao)
+{
+#ifndef NO_THREADS
+	feeder_end(ao, 0);
+#endif
+	ao->pulling = 0;
+	/* Re-opening after the implied pause shall not pull again. */
+	ao->fill_device = 0;
+}
@@ -0,0 +1,26 @@
+#ifndef _MPG123_H_PULL
+#define _MPG123_H_PULL
+/*
+	pull: callback-driven playback (out123_set_fill())
+
+	copyright 2020 by the mpg123 project
+	                  - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "out123_int.h"
+
+/* Decide before ao->open() if the driver may call fill() itself. */
+void pull_prepare(out123_handle *ao);
+/* After opening: start the feeder thread if the driver does not pull.
+   Returns OUT123_OK or an error code. */
+int  pull_start(out123_handle *ao);
+/* TRUE if called from the feeder thread. */
+int  pull_feeder(out123_handle *ao);
+/* End the feeder thread right away (out123_stop()). */
+void pull_stop(out123_handle *ao);
+/* Wait for the feeder thread to run out of data (out123_drain()),
+   the driver waits for its own pulling in ao->drain(). */
+void pull_finish(out123_handle *ao);
+
+#endif
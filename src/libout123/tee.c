@@ -0,0 +1,267 @@
+/*
+	tee: fan-out of playback to several outputs
+
+	copyright 2020 by the mpg123 project
+	                  - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Driver names joined by '+' (alsa+wav) open all of them, each with the
+	device at the same position of the device string, also joined by
+	'+' (default+out.wav; missing or empty entries mean the default).
+	Each output is a full out123 handle of its own. The first one is the
+	primary output that is played to directly and paces things. The
+	others get a buffer thread each, so out123_play() only copies the
+	data into their buffers and a slow file on disk does not hold up the
+	sound card. Formats are those that all outputs support.
+*/
+
+#include "out123_int.h"
+#include "tee.h"
+#include "debug.h"
+
+/* Buffer for each secondary output, some seconds of CD audio to cover
+   hiccups of disks. */
+#define TEE_BUFFER (4*1024*1024)
+
+struct tee
+{
+	int count;
+	out123_handle **outs;
+};
+
+static int tee_open(out123_handle *ao)
+{
+	struct tee *tee = ao->userptr;
+	int i;
+
+	if(ao->format < 0)
+	{
+		/* Query mode: The primary output suggests the default format. */
+		struct mpg123_fmt *fmts = NULL;
+		if(  out123_formats(tee->outs[0], NULL, 0, 1, 1, &fmts) >= 0
+		&&   fmts[0].encoding > 0 )
+		{
+			ao->rate     = fmts[0].rate;
+			ao->channels = fmts[0].channels;
+			ao->format   = fmts[0].encoding;
+		}
+		else
+		{
+			ao->rate     = 44100;
+			ao->channels = 2;
+			ao->format   = MPG123_ENC_SIGNED_16;
+		}
+		free(fmts);
+		return 0;
+	}
+	for(i=0; i<tee->count; ++i)
+	{
+		if(out123_start(tee->outs[i], ao->rate, ao->channels, ao->format))
+		{
+			if(!AOQUIET)
+				error2( "cannot start output %i: %s", i+1
+				,	out123_strerror(tee->outs[i]) );
+			while(i--)
+				out123_stop(tee->outs[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int tee_formats(out123_handle *ao)
+{
+	struct tee *tee = ao->userptr;
+	int encodings = MPG123_ENC_ANY;
+	int i;
+
+	for(i=0; i<tee->count && encodings; ++i)
+	{
+		struct mpg123_fmt *fmts = NULL;
+		if(out123_formats( tee->outs[i], &ao->rate, 1
+		,	ao->channels, ao->channels, &fmts ) < 0)
+			encodings = 0;
+		else
+			encodings &= fmts[1].encoding;
+		free(fmts);
+	}
+	return encodings;
+}
+
+static int tee_write(out123_handle *ao, unsigned char *buf, int len)
+{
+	struct tee *tee = ao->userptr;
+	size_t played;
+	int i;
+
+	/* The others get exactly what the primary took. */
+	played = out123_play(tee->outs[0], buf, len);
+	if(!played && len)
+		return -1;
+	for(i=1; i<tee->count; ++i)
+		if(out123_play(tee->outs[i], buf, played) < played && !AOQUIET)
+			error2( "output %i: %s", i+1
+			,	out123_strerror(tee->outs[i]) );
+	return (int)played;
+}
+
+static void tee_flush(out123_handle *ao)
+{
+	struct tee *tee = ao->userptr;
+	int i;
+
+	for(i=0; i<tee->count; ++i)
+		out123_drop(tee->outs[i]);
+}
+
+static void tee_drain(out123_handle *ao)
+{
+	struct tee *tee = ao->userptr;
+	int i;
+
+	for(i=0; i<tee->count; ++i)
+		out123_drain(tee->outs[i]);
+}
+
+static int tee_delay(out123_handle *ao, size_t *bytes)
+{
+	struct tee *tee = ao->userptr;
+
+	return out123_latency(tee->outs[0], NULL, bytes) ? -1 : 0;
+}
+
+static int tee_close(out123_handle *ao)
+{
+	struct tee *tee = ao->userptr;
+	int i;
+
+	for(i=0; i<tee->count; ++i)
+		out123_stop(tee->outs[i]);
+	return 0;
+}
+
+static int tee_deinit(out123_handle *ao)
+{
+	struct tee *tee = ao->userptr;
+	int i;
+
+	if(!tee)
+		return 0;
+	for(i=0; i<tee->count; ++i)
+		out123_del(tee->outs[i]);
+	free(tee->outs);
+	free(tee);
+	ao->userptr = NULL;
+	return 0;
+}
+
+/* Split off the next name separated by '+', NULL for empty ones. */
+static char* next_name(char **list)
+{
+	char *name = *list;
+	char *plus;
+
+	if(!name)
+		return NULL;
+	if((plus = strchr(name, '+')))
+	{
+		*plus = 0;
+		*list = plus+1;
+	}
+	else
+		*list = NULL;
+	return *name ? name : NULL;
+}
+
+static int tee_add(out123_handle *ao, struct tee *tee
+,	const char *driver, const char *device)
+{
+	out123_handle *out = out123_new();
+	int primary = !tee->count;
+
+	if(!out)
+		return OUT123_DOOM;
+	tee->outs[tee->count++] = out;
+	out123_param_from(out, ao);
+	/* Conversion and drift are the business of the tee handle itself. */
+	out->flags &= ~(OUT123_CONVERT|OUT123_DRIFT);
+	out->flags |= OUT123_KEEP_PLAYING | (primary ? 0 : OUT123_BUFFER_THREAD);
+	if(!primary && out123_set_buffer(out, TEE_BUFFER))
+		return out123_errcode(out);
+	if(out123_open(out, driver, device))
+	{
+		if(!AOQUIET)
+			error3( "cannot open output %s with device %s: %s", driver
+			,	device ? device : "<default>", out123_strerror(out) );
+		return out123_errcode(out) ? out123_errcode(out) : OUT123_BAD_DRIVER;
+	}
+	return OUT123_OK;
+}
+
+int tee_init(out123_handle *ao, const char *drivers)
+{
+	struct tee *tee = NULL;
+	char *drvlist = NULL;
+	char *devlist = NULL;
+	char *drvpos, *devpos;
+	const char *c;
+	long propflags = 0;
+	int count = 1;
+	int err = OUT123_OK;
+
+	for(c = drivers; *c; ++c)
+		if(*c == '+')
+			++count;
+	if(  !(tee = malloc(sizeof(*tee)))
+	||   !(tee->outs = malloc(sizeof(*tee->outs)*count))
+	||   !(drvlist = compat_strdup(drivers))
+	||   (ao->device && !(devlist = compat_strdup(ao->device))) )
+	{
+		if(tee)
+			free(tee->outs);
+		free(tee);
+		free(drvlist);
+		ao->errcode = OUT123_DOOM;
+		return OUT123_ERR;
+	}
+	tee->count = 0;
+	ao->userptr = tee;
+
+	drvpos = drvlist;
+	devpos = devlist;
+	while(drvpos && !err)
+	{
+		char *driver = next_name(&drvpos);
+		char *device = next_name(&devpos);
+		if(!driver)
+		{
+			if(!AOQUIET)
+				error1("empty driver name in %s", drivers);
+			err = OUT123_BAD_DRIVER_NAME;
+		}
+		else
+			err = tee_add(ao, tee, driver, device);
+	}
+	free(devlist);
+	free(drvlist);
+	if(err)
+	{
+		tee_deinit(ao);
+		ao->errcode = err;
+		return OUT123_ERR;
+	}
+
+	/* Pausing must not close and reopen the outputs, as that would start
+	   the recording anew. A paused sound card just runs out of data. */
+	out123_getparam_int(tee->outs[0], OUT123_PROPFLAGS, &propflags);
+	ao->propflags = (int)propflags | OUT123_PROP_PERSISTENT;
+	ao->open  = tee_open;
+	ao->get_formats = tee_formats;
+	ao->write = tee_write;
+	ao->flush = tee_flush;
+	ao->drain = tee_drain;
+	ao->delay = tee_delay;
+	ao->close = tee_close;
+	ao->deinit = tee_deinit;
+	return OUT123_OK;
+}
@@ -0,0 +1,17 @@
+#ifndef _MPG123_H_TEE
+#define _MPG123_H_TEE
+/*
+	tee: fan-out of playback to several outputs
+
+	copyright 2020 by the mpg123 project
+	                  - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "out123_int.h"
+
+/* Set up the tee for driver names joined by '+', with ao->device holding
+   the devices joined the same way. Returns OUT123_OK or OUT123_ERR. */
+int tee_init(out123_handle *ao, const char *drivers);
+
+#endif
@@ -76,6 +76,16 @@ struct wavdata
 	*/
 	void *the_header;
 	size_t the_header_size;
+	/* Own stdio buffer from OUT123_FILEBUFFER, freed after closing. */
+	void *iobuf;
+	/* Data bytes expected from OUT123_FILELENGTH, 0 if unknown. If that is
+	   what arrives, the header written in front is final. */
+	long claimed;
+	/* Bytes preallocated from OUT123_FILELENGTH, cut back at closing. */
+	long prealloc;
+	/* Chunked raw output: index file name and bytes in current chunk. */
+	char *idxname;
+	long chunk_fill;
 };
 
 static struct wavdata* wavdata_new(void)
@@ -90,6 +100,11 @@ static struct wavdata* wavdata_new(void)
 		wdat->floatwav = 0;
 		wdat->the_header = NULL;
 		wdat->the_header_size = 0;
+		wdat->iobuf = NULL;
+		wdat->claimed = 0;
+		wdat->prealloc = 0;
+		wdat->idxname = NULL;
+		wdat->chunk_fill = 0;
 	}
 	return wdat;
 }
@@ -101,6 +116,10 @@ static void wavdata_del(struct wavdata *wdat)
 		compat_fclose(wdat->wavfp);
 	if(wdat->the_header)
 		free(wdat->the_header);
+	if(wdat->iobuf)
+		free(wdat->iobuf);
+	if(wdat->idxname)
+		free(wdat->idxname);
 	free(wdat);
 }
 
@@ -161,12 +180,45 @@ static int testEndian(void)
   return ret;
 }
 
+/* Bulk writing to disk: A bigger stdio buffer means fewer, larger write()
+   calls than out123_play() hands in, and reserving the expected size up
+   front keeps the file from being fragmented while it grows. Both only
+   for named files, as stdout is not ours to close (and free the buffer). */
+static void setup_file(out123_handle *ao, struct wavdata *wdat)
+{
+	if(ao->file_buffer > 0)
+	{
+		wdat->iobuf = malloc(ao->file_buffer);
+		if(  wdat->iobuf
+		&&   setvbuf(wdat->wavfp, wdat->iobuf, _IOFBF, ao->file_buffer) )
+		{
+			free(wdat->iobuf);
+			wdat->iobuf = NULL;
+		}
+		if(!wdat->iobuf && !AOQUIET)
+			warning1("cannot set up file buffer of %li bytes", ao->file_buffer);
+	}
+#if defined(HAVE_POSIX_FALLOCATE) && defined(HAVE_FTRUNCATE)
+	if(wdat->claimed > 0)
+	{
+		long bytes = (long)wdat->the_header_size + wdat->claimed;
+		/* Only a hint, failure (no support in the filesystem) is fine. */
+		if(!posix_fallocate(fileno(wdat->wavfp), 0, bytes))
+			wdat->prealloc = bytes;
+		else if(AOVERBOSE(2))
+			fprintf(stderr, "Note: cannot preallocate %li bytes\n", bytes);
+	}
+#endif
+}
+
 /* return: 0 is good, -1 is bad */
-static int open_file(struct wavdata *wdat, char *filename)
+static int open_file(out123_handle *ao, struct wavdata *wdat, char *filename)
 {
 	debug2("open_file(%p, %s)", (void*)wdat, filename ? filename : "<nil>");
 	if(!wdat)
 		return -1;
+	if(ao->file_length > 0)
+		wdat->claimed = ao->file_length*out123_encsize(ao->format)*ao->channels;
 	if(!filename || !strcmp("-",filename) || !strcmp("", filename))
 	{
 		wdat->wavfp = stdout;
@@ -184,8 +236,8 @@ static int open_file(struct wavdata *wdat, char *filename)
 		wdat->wavfp = compat_fopen(filename, "wb");
 		if(!wdat->wavfp)
 			return -1;
-		else
-			return 0;
+		setup_file(ao, wdat);
+		return 0;
 	}
 }
 
@@ -199,6 +251,15 @@ static int close_file(out123_handle *ao)
 
 	if(wdat->wavfp != NULL && wdat->wavfp != stdout)
 	{
+#if defined(HAVE_POSIX_FALLOCATE) && defined(HAVE_FTRUNCATE)
+		/* Drop what was reserved but not written. */
+		if(  wdat->prealloc > 0
+		&&   !fflush(wdat->wavfp)
+		&&   ftruncate( fileno(wdat->wavfp)
+		     ,	(long)wdat->the_header_size + wdat->datalen )
+		&&   !AOQUIET )
+			error1("cannot truncate the audio file: %s", strerror(errno));
+#endif
 		if(compat_fclose(wdat->wavfp))
 		{
 			if(!AOQUIET)
@@ -214,6 +275,53 @@ static int close_file(out123_handle *ao)
 	return ret;
 }
 
+/* Fill in the sizes for datalen bytes of audio, already on opening when
+   the length is known, to be checked at closing. */
+static void wav_header_sizes(struct wavdata *wdat, long datalen)
+{
+	if(wdat->floatwav)
+	{
+		struct riff_float *floathead = wdat->the_header;
+		long2littleendian(datalen
+		,	floathead->WAVE.data.datalen
+		,	sizeof(floathead->WAVE.data.datalen));
+		long2littleendian(datalen+sizeof(floathead->WAVE)
+		,	floathead->WAVElen
+		,	sizeof(floathead->WAVElen));
+		long2littleendian( datalen
+		/	(
+				from_little(floathead->WAVE.fmt.Channels,2)
+			*	from_little(floathead->WAVE.fmt.BitsPerSample,2)/8
+			)
+		,	floathead->WAVE.fact.samplelen
+		,	sizeof(floathead->WAVE.fact.samplelen) );
+	}
+	else
+	{
+		struct riff *inthead = wdat->the_header;
+		long2littleendian(datalen, inthead->WAVE.data.datalen
+		,	sizeof(inthead->WAVE.data.datalen));
+		long2littleendian(datalen+sizeof(inthead->WAVE), inthead->WAVElen
+		,	sizeof(inthead->WAVElen));
+	}
+}
+
+/* If the header written in front already is right, there is no need to go
+   back. That also makes streaming to a pipe give a proper file. */
+static int header_final(out123_handle *ao)
+{
+	struct wavdata *wdat = ao->userptr;
+
+	if(wdat->claimed <= 0)
+		return 0;
+	if(wdat->datalen == wdat->claimed)
+		return 1;
+	if(AOVERBOSE(2))
+		fprintf( stderr, "Note: expected %li bytes of audio, got %li\n"
+		,	wdat->claimed, wdat->datalen );
+	return 0;
+}
+
 /* return: 0 is good, -1 is bad */
 static int write_header(out123_handle *ao)
 {
@@ -293,14 +401,15 @@ int au_open(out123_handle *ao)
 			goto au_open_bad;
 	}
 
-	long2bigendian(0xffffffff,auhead->datalen,sizeof(auhead->datalen));
 	long2bigendian(ao->rate,auhead->rate,sizeof(auhead->rate));
 	long2bigendian(ao->channels,auhead->channels,sizeof(auhead->channels));
 
-	if(open_file(wdat, ao->device) < 0)
+	if(open_file(ao, wdat, ao->device) < 0)
 		goto au_open_bad;
 
 	wdat->datalen = 0;
+	long2bigendian( wdat->claimed > 0 ? wdat->claimed : 0xffffffff
+	,	auhead->datalen, sizeof(auhead->datalen) );
 
 	ao->userptr = wdat;
 	return 0;
@@ -347,7 +456,7 @@ int cdr_open(out123_handle *ao)
 
 	wdat->flipendian = !testEndian(); /* big end */
 
-	if(open_file(wdat, ao->device) < 0)
+	if(open_file(ao, wdat, ao->device) < 0)
 	{
 		if(!AOQUIET)
 			error("cannot open file for writing");
@@ -381,7 +490,7 @@ int raw_open(out123_handle *ao)
 		goto raw_open_bad;
 	}
 
-	if(open_file(wdat, ao->device) < 0)
+	if(open_file(ao, wdat, ao->device) < 0)
 		goto raw_open_bad;
 
 	ao->userptr = wdat;
@@ -392,6 +501,139 @@ raw_open_bad:
 	return -1;
 }
 
+/* Raw PCM in chunks of RAWIDX_CHUNK bytes, each holding whole frames and
+   starting on a page boundary, with zero padding for frame sizes that do
+   not divide the chunk size. A text index next to it (name.idx) lists
+   the format and for each chunk the offset in the file, the first frame
+   and the number of frames. A cache can mmap decoded audio and seek in
+   it without decoding again. */
+#define RAWIDX_CHUNK 65536
+
+int rawidx_open(out123_handle *ao)
+{
+	struct wavdata *wdat;
+
+	if(ao->format < 0)
+	{
+		ao->rate = 44100;
+		ao->channels = 2;
+		ao->format = MPG123_ENC_SIGNED_16;
+		return 0;
+	}
+
+	if(!ao->device || !strcmp("-", ao->device) || !strcmp("", ao->device))
+	{
+		if(!AOQUIET)
+			error("chunked raw output needs a file name for the index");
+		return -1;
+	}
+	if(out123_encsize(ao->format)*ao->channels > RAWIDX_CHUNK)
+	{
+		if(!AOQUIET)
+			error("frame size too large for chunked raw output");
+		return -1;
+	}
+
+	if(  !(wdat = wavdata_new())
+	||   !(wdat->idxname = malloc(strlen(ao->device)+5)) )
+	{
+		ao->errcode = OUT123_DOOM;
+		goto rawidx_open_bad;
+	}
+	sprintf(wdat->idxname, "%s.idx", ao->device);
+
+	if(open_file(ao, wdat, ao->device) < 0)
+		goto rawidx_open_bad;
+
+	ao->userptr = wdat;
+	return 0;
+rawidx_open_bad:
+	if(wdat)
+		wavdata_del(wdat);
+	return -1;
+}
+
+int rawidx_write(out123_handle *ao, unsigned char *buf, int len)
+{
+	struct wavdata *wdat = ao->userptr;
+	long payload = RAWIDX_CHUNK/ao->framesize*ao->framesize;
+	int done = 0;
+
+	if(!wdat || !wdat->wavfp)
+		return 0;
+
+	while(done < len)
+	{
+		size_t piece = len-done;
+		size_t got;
+		if(piece > (size_t)(payload - wdat->chunk_fill))
+			piece = payload - wdat->chunk_fill;
+		got = fwrite(buf+done, 1, piece, wdat->wavfp);
+		done += (int)got;
+		wdat->chunk_fill += (long)got;
+		wdat->datalen    += (long)got;
+		if(got < piece)
+			return done ? done : -1;
+		if(wdat->chunk_fill == payload)
+		{
+			long pad;
+			for(pad = RAWIDX_CHUNK-payload; pad > 0; --pad)
+				if(putc(0, wdat->wavfp) == EOF)
+					return done ? done : -1;
+			wdat->chunk_fill = 0;
+		}
+	}
+	return done;
+}
+
+int rawidx_close(out123_handle *ao)
+{
+	struct wavdata *wdat = ao->userptr;
+	const char *encname;
+	long perchunk, frames, first;
+	FILE *idx;
+
+	if(!wdat) /* Special case: Opened only for format query. */
+		return 0;
+
+	if(!wdat->wavfp)
+		return -1;
+
+	if(fflush(wdat->wavfp))
+	{
+		if(!AOQUIET)
+			error1("cannot flush raw stream: %s", strerror(errno));
+		close_file(ao);
+		return -1;
+	}
+	perchunk = RAWIDX_CHUNK/ao->framesize;
+	frames   = wdat->datalen/ao->framesize;
+	encname  = out123_enc_name(ao->format);
+	if(!(idx = compat_fopen(wdat->idxname, "w")))
+	{
+		if(!AOQUIET)
+			error2("cannot open index %s: %s", wdat->idxname, strerror(errno));
+		close_file(ao);
+		return -1;
+	}
+	fprintf( idx, "out123 chunked raw PCM\n"
+		"rate %li\nchannels %i\nencoding %s\nframesize %i\n"
+		"chunksize %i\nframes %li\n"
+	,	ao->rate, ao->channels, encname ? encname : "???", ao->framesize
+	,	RAWIDX_CHUNK, frames );
+	for(first = 0; first < frames; first += perchunk)
+		fprintf( idx, "%li %li %li\n", first/perchunk*RAWIDX_CHUNK, first
+		,	frames-first < perchunk ? frames-first : perchunk );
+	if(compat_fclose(idx))
+	{
+		if(!AOQUIET)
+			error2("cannot write index %s: %s", wdat->idxname, strerror(errno));
+		close_file(ao);
+		return -1;
+	}
+	return close_file(ao);
+}
+
 int wav_open(out123_handle *ao)
 {
 	int bps;
@@ -504,24 +746,10 @@ int wav_open(out123_handle *ao)
 		,	sizeof(inthead->WAVE.fmt.BlockAlign) );
 	}
 
-	if(open_file(wdat, ao->device) < 0)
+	if(open_file(ao, wdat, ao->device) < 0)
 		goto wav_open_bad;
 
-	if(wdat->floatwav)
-	{
-		long2littleendian(wdat->datalen, floathead->WAVE.data.datalen
-		,	sizeof(floathead->WAVE.data.datalen));
-		long2littleendian(wdat->datalen+sizeof(floathead->WAVE)
-		,	floathead->WAVElen, sizeof(floathead->WAVElen));
-	}
-	else
-	{
-		long2littleendian(wdat->datalen, inthead->WAVE.data.datalen
-		,	sizeof(inthead->WAVE.data.datalen));
-		long2littleendian( wdat->datalen+sizeof(inthead->WAVE)
-		,	inthead->WAVElen
-		,	sizeof(inthead->WAVElen) );
-	}
+	wav_header_sizes(wdat, wdat->claimed);
 
 	wdat->bytes_per_sample = bps>>3;
 
@@ -623,33 +851,11 @@ int wav_close(out123_handle *ao)
 			error1("cannot flush WAV stream: %s", strerror(errno));
 		return close_file(ao);
 	}
+	if(header_final(ao))
+		return close_file(ao);
 	if(fseek(wdat->wavfp, 0L, SEEK_SET) >= 0)
 	{
-		if(wdat->floatwav)
-		{
-			struct riff_float *floathead = wdat->the_header;
-			long2littleendian(wdat->datalen
-			,	floathead->WAVE.data.datalen
-			,	sizeof(floathead->WAVE.data.datalen));
-			long2littleendian(wdat->datalen+sizeof(floathead->WAVE)
-			,	floathead->WAVElen
-			,	sizeof(floathead->WAVElen));
-			long2littleendian( wdat->datalen
-			/	(
-					from_little(floathead->WAVE.fmt.Channels,2)
-				*	from_little(floathead->WAVE.fmt.BitsPerSample,2)/8
-				)
-			,	floathead->WAVE.fact.samplelen
-			,	sizeof(floathead->WAVE.fact.samplelen) );
-		}
-		else
-		{
-			struct riff *inthead = wdat->the_header;
-			long2littleendian(wdat->datalen, inthead->WAVE.data.datalen
-			,	sizeof(inthead->WAVE.data.datalen));
-			long2littleendian(wdat->datalen+sizeof(inthead->WAVE), inthead->WAVElen
-			,	sizeof(inthead->WAVElen));
-		}
+		wav_header_sizes(wdat, wdat->datalen);
 		/* Always (over)writing the header here; also for stdout, when
 		   fseek worked, this overwrite works. */
 		write_header(ao);
@@ -677,6 +883,8 @@ int au_close(out123_handle *ao)
 			error1("cannot flush WAV stream: %s", strerror(errno));
 		return close_file(ao);
 	}
+	if(header_final(ao))
+		return close_file(ao);
 	if(fseek(wdat->wavfp, 0L, SEEK_SET) >= 0)
 	{
 		struct auhead *auhead = wdat->the_header;
@@ -18,11 +18,14 @@
 int au_open(out123_handle *);
 int cdr_open(out123_handle *);
 int raw_open(out123_handle *);
+int rawidx_open(out123_handle *);
 int wav_open(out123_handle *);
 int wav_write(out123_handle *, unsigned char *buf, int len);
+int rawidx_write(out123_handle *, unsigned char *buf, int len);
 int wav_close(out123_handle *);
 int au_close(out123_handle *);
 int raw_close(out123_handle *);
+int rawidx_close(out123_handle *);
 int cdr_formats(out123_handle *);
 int au_formats(out123_handle *);
 int raw_formats(out123_handle *);
@@ -30,11 +30,32 @@
 #define MAP_ANON MAP_ANONYMOUS
 #endif
 
-void xfermem_init (txfermem **xf, size_t bufsize, size_t msize, size_t skipbuf)
+/* Size that huge mappings are rounded up to, the common one. */
+#define XF_HUGEPAGE (2*1024*1024)
+
+int xfermem_init (txfermem **xf, size_t bufsize, size_t msize, size_t skipbuf, int mode)
 {
 	size_t regsize = bufsize + msize + skipbuf + sizeof(txfermem);
+	int failed = 0;
 
 #ifdef HAVE_MMAP
+	*xf = NULL;
+#  if defined(MAP_ANON) && defined(MAP_HUGETLB)
+	if(mode & XF_HUGE)
+	{
+		size_t hugesize = (regsize+XF_HUGEPAGE-1)/XF_HUGEPAGE*XF_HUGEPAGE;
+		void *region = mmap(0, hugesize, PROT_READ | PROT_WRITE,
+			MAP_ANON | MAP_SHARED | MAP_HUGETLB, -1, 0);
+		if(region != MAP_FAILED)
+		{
+			*xf = region;
+			regsize = hugesize;
+			mode &= ~XF_HUGE;
+		}
+	}
+#  endif
+	if(!*xf)
+	{
 #  ifdef MAP_ANON
 	if ((*xf = (txfermem *) mmap(0, regsize, PROT_READ | PROT_WRITE,
 			MAP_ANON | MAP_SHARED, -1, 0)) == (txfermem *) -1) {
@@ -53,6 +74,12 @@ void xfermem_init (txfermem **xf, size_t bufsize, size_t msize, size_t skipbuf)
 		exit (1);
 	}
 	close (devzero);
+#  endif
+	}
+	/* No reserved huge pages, but maybe transparent ones. */
+#  if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+	if((mode & XF_HUGE) && !madvise((void*)*xf, regsize, MADV_HUGEPAGE))
+		mode &= ~XF_HUGE;
 #  endif
 #else
 	struct shmid_ds shmemds;
@@ -72,6 +99,25 @@ void xfermem_init (txfermem **xf, size_t bufsize, size_t msize, size_t skipbuf)
 		exit (1);
 	}
 #endif
+	failed |= mode & XF_HUGE;
+	/* Locking faults the pages in, too. */
+	if(mode & XF_LOCK)
+	{
+#ifdef HAVE_MLOCK
+		if(mlock((void*)*xf, regsize))
+#endif
+		{
+			failed |= XF_LOCK;
+			mode |= XF_PREFAULT;
+		}
+	}
+	if((mode & (XF_PREFAULT|XF_LOCK)) == XF_PREFAULT)
+	{
+		volatile char *page = (volatile char*)*xf;
+		size_t i;
+		for(i=0; i<regsize; i+=4096)
+			page[i] = 0;
+	}
 	if (socketpair(AF_UNIX, SOCK_STREAM, 0, (*xf)->fd) < 0) {
 		perror ("socketpair()");
 		xfermem_done (*xf);
@@ -82,17 +128,67 @@ void xfermem_init (txfermem **xf, size_t bufsize, size_t msize, size_t skipbuf)
 	(*xf)->metadata = ((char *) *xf) + sizeof(txfermem);
 	(*xf)->size = bufsize;
 	(*xf)->metasize = msize + skipbuf;
+	(*xf)->mapsize = regsize;
+#ifndef NO_THREADS
+	(*xf)->threaded = FALSE;
+#endif
+	return failed;
 }
 
+#ifndef NO_THREADS
+int xfermem_init_threads(txfermem *xf)
+{
+	if(pthread_mutex_init(&xf->lock, NULL))
+		return -1;
+	if(pthread_cond_init(&xf->moved, NULL))
+	{
+		pthread_mutex_destroy(&xf->lock);
+		return -1;
+	}
+	xf->intflag = FALSE;
+	xf->reader_live = FALSE;
+	xf->threaded = TRUE;
+	return 0;
+}
+
+void xfermem_reader_moved(txfermem *xf, int live)
+{
+	pthread_mutex_lock(&xf->lock);
+	xf->reader_live = live;
+	pthread_cond_broadcast(&xf->moved);
+	pthread_mutex_unlock(&xf->lock);
+}
+
+/* Wait for the reader to free enough space, as long as it is consuming
+   data at all. Returns TRUE if there is enough space now. */
+static int xfermem_wait_space(txfermem *xf, size_t bytes)
+{
+	int ret;
+	pthread_mutex_lock(&xf->lock);
+	while(xfermem_get_freespace(xf) < bytes && xf->reader_live)
+		pthread_cond_wait(&xf->moved, &xf->lock);
+	ret = xfermem_get_freespace(xf) >= bytes;
+	pthread_mutex_unlock(&xf->lock);
+	return ret;
+}
+#endif
+
 void xfermem_done (txfermem *xf)
 {
 	if(!xf)
 		return;
+#ifndef NO_THREADS
+	if(xf->threaded)
+	{
+		pthread_cond_destroy(&xf->moved);
+		pthread_mutex_destroy(&xf->lock);
+	}
+#endif
 #ifdef HAVE_MMAP
 	/* Here was a cast to (caddr_t) ... why? Was this needed for SunOS?
 	   Casting to (void*) should silence compilers in case of funny
 	   prototype for munmap(). */
-	munmap ( (void*)xf, xf->size + xf->metasize + sizeof(txfermem));
+	munmap ( (void*)xf, xf->mapsize);
 #else
 	if (shmdt((void *) xf) == -1) {
 		perror ("shmdt()");
@@ -269,20 +365,47 @@ int xfermem_writer_block(txfermem *xf)
 	return (result == XF_CMD_PONG) ? 0 : result;
 }
 
-/* Return: 0 on success, -1 on communication error, > 0 for
-   error on buffer side, some special return code from buffer to be
-   evaluated. */
-int xfermem_write(txfermem *xf, void *buffer, size_t bytes)
+int xfermem_reserve(txfermem *xf, size_t bytes)
 {
-	if(buffer == NULL || bytes < 1) return 0;
-
 	/* You weren't so braindead not allocating enough space at all, right? */
 	while (xfermem_get_freespace(xf) < bytes)
 	{
-		int cmd = xfermem_writer_block(xf);
+		int cmd;
+#ifndef NO_THREADS
+		/* A reader thread tells us without a round trip over the socket.
+		   Only when it stopped consuming, a ping gets the reason. */
+		if(xf->threaded && xfermem_wait_space(xf, bytes))
+			break;
+#endif
+		cmd = xfermem_writer_block(xf);
 		if(cmd) /* Non-successful wait. */
 			return cmd;
 	}
+	return 0;
+}
+
+int xfermem_advance(txfermem *xf, size_t bytes)
+{
+	if(bytes < 1) return 0;
+	/* Advance the free space pointer, including the wrap. */
+	xf->freeindex = (xf->freeindex + bytes) % xf->size;
+	/* Always notify the buffer process. */
+	debug("write waking");
+	return xfermem_putcmd(xf->fd[XF_WRITER], XF_CMD_DATA) < 0
+	?	-1
+	:	0;
+}
+
+/* Return: 0 on success, -1 on communication error, > 0 for
+   error on buffer side, some special return code from buffer to be
+   evaluated. */
+int xfermem_write(txfermem *xf, void *buffer, size_t bytes)
+{
+	int ret;
+	if(buffer == NULL || bytes < 1) return 0;
+
+	if((ret = xfermem_reserve(xf, bytes)))
+		return ret;
 	/* Now we have enough space. copy the memory, possibly with the wrap. */
 	if(xf->size - xf->freeindex >= bytes)
 	{	/* one block of free memory */
@@ -294,11 +417,5 @@ int xfermem_write(txfermem *xf, void *buffer, size_t bytes)
 		memcpy(xf->data+xf->freeindex, buffer, endblock);
 		memcpy(xf->data, (char*)buffer + endblock, bytes-endblock);
 	}
-	/* Advance the free space pointer, including the wrap. */
-	xf->freeindex = (xf->freeindex + bytes) % xf->size;
-	/* Always notify the buffer process. */
-	debug("write waking");
-	return xfermem_putcmd(xf->fd[XF_WRITER], XF_CMD_DATA) < 0
-	?	-1
-	:	0;
+	return xfermem_advance(xf, bytes);
 }
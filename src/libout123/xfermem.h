@@ -21,6 +21,9 @@
 #define _XFERMEM_H_
 
 #include "compat.h"
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
 
 typedef struct {
 	size_t freeindex;	/* [W] next free index */
@@ -30,6 +33,16 @@ typedef struct {
 	char *metadata;
 	size_t size;
 	size_t metasize;
+	size_t mapsize; /* the whole region, possibly rounded up to huge pages */
+#ifndef NO_THREADS
+	/* Only used with reader and writer being threads of the same process,
+	   after xfermem_init_threads(). */
+	int threaded;
+	volatile int intflag; /* [W] set before interrupting commands */
+	int reader_live;      /* [R] reader is consuming data */
+	pthread_mutex_t lock;
+	pthread_cond_t moved; /* reader freed space or changed reader_live */
+#endif
 } txfermem;
 /*
  *   [W] -- May be written to by the writing process only!
@@ -37,7 +50,13 @@ typedef struct {
  *   All other entries are initialized once.
  */
 
-void xfermem_init (txfermem **xf, size_t bufsize, size_t msize, size_t skipbuf);
+/* Ways to set up the memory for xfermem_init(). */
+#define XF_PREFAULT 1 /* touch all pages right away */
+#define XF_LOCK     2 /* keep them in RAM with mlock() (implies prefaulting) */
+#define XF_HUGE     4 /* back them with huge pages */
+
+/* Returns the mode bits that could not be honoured, the buffer works anyway. */
+int xfermem_init (txfermem **xf, size_t bufsize, size_t msize, size_t skipbuf, int mode);
 void xfermem_init_writer (txfermem *xf);
 void xfermem_init_reader (txfermem *xf);
 
@@ -67,6 +86,8 @@ enum xf_cmd_code
 ,	XF_CMD_CUSTOM6   /**< Some custom command to be filled with meaning. */
 ,	XF_CMD_CUSTOM7   /**< Some custom command to be filled with meaning. */
 ,	XF_CMD_CUSTOM8   /**< Some custom command to be filled with meaning. */
+,	XF_CMD_CUSTOM9   /**< Some custom command to be filled with meaning. */
+,	XF_CMD_CUSTOM10  /**< Some custom command to be filled with meaning. */
 };
 
 #define XF_WRITER 0
@@ -77,8 +98,22 @@ int xfermem_putcmd(int fd, byte cmd);
 int xfermem_writer_block(txfermem *xf);
 /* returns TRUE for being interrupted */
 int xfermem_write(txfermem *xf, void *buffer, size_t bytes);
+/* The two halves of xfermem_write() for a writer that fills the memory at
+   freeindex itself: waiting for the given free space (same return values)
+   and handing over what got written there. */
+int xfermem_reserve(txfermem *xf, size_t bytes);
+int xfermem_advance(txfermem *xf, size_t bytes);
 
 void xfermem_done (txfermem *xf);
+
+#ifndef NO_THREADS
+/* Prepare wakeups between threads instead of processes. Returns 0 on
+   success. */
+int xfermem_init_threads(txfermem *xf);
+/* Reader: tell the writer about consumed data and if more is to come,
+   to be called regularily by a threaded reader. */
+void xfermem_reader_moved(txfermem *xf, int live);
+#endif
 #define xfermem_done_writer xfermem_init_reader
 #define xfermem_done_reader xfermem_init_writer
 
@@ -0,0 +1,296 @@
+/*
+	filter: libsyn123 streaming IIR filters
+
+	copyright 2020 by the mpg123 project
+	licensed under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	A cascade of biquads (transposed direct form II) with the state of each
+	channel kept in the handle, so a stream can be filtered in pieces. The
+	recursion runs along the time, but the channels are independent: with
+	compiler vector extensions, four channels are filtered at once, one
+	frame after the other. Each stage goes over a block of frames before
+	the next one, keeping its state in registers.
+
+	Coefficients for single sections follow the Audio EQ Cookbook by
+	Robert Bristow-Johnson. The lowpass setup stacks them to a Butterworth
+	filter of the desired order, for bandlimiting before decimation.
+*/
+
+#define NO_SMAX
+#define NO_GROW_BUF
+#include "syn123_int.h"
+#include "debug.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Frames filtered by each stage in one go.
+enum { filterblock = 256 };
+// Channels in one vector.
+enum { lanes = 4 };
+
+struct filter_data
+{
+	int channels;
+	int groups;   // channels in groups of lanes
+	int stages;
+	float *coef;  // b0, b1, b2, a1, a2 for each stage
+	float *state; // 2*lanes values for each group in each stage
+};
+
+int attribute_align_arg
+syn123_biquad( double *coef, int type, long rate, double freq
+,	double q, double gain )
+{
+	if(!coef)
+		return SYN123_BAD_BUF;
+	if(rate < 1)
+		return SYN123_BAD_FMT;
+	if(!(freq > 0. && freq < 0.5*rate) || !(q > 0.))
+		return SYN123_BAD_FREQ;
+	double w  = 2.*M_PI*freq/rate;
+	double cw = cos(w);
+	double alpha = sin(w)/(2.*q);
+	double A  = pow(10., gain/40.);
+	double sA = 2.*sqrt(A)*alpha;
+	double b0, b1, b2, a0, a1, a2;
+	switch(type)
+	{
+		case SYN123_LOWPASS:
+			b0 = b2 = (1.-cw)/2.;
+			b1 = 1.-cw;
+			a0 = 1.+alpha; a1 = -2.*cw; a2 = 1.-alpha;
+		break;
+		case SYN123_HIGHPASS:
+			b0 = b2 = (1.+cw)/2.;
+			b1 = -(1.+cw);
+			a0 = 1.+alpha; a1 = -2.*cw; a2 = 1.-alpha;
+		break;
+		case SYN123_BANDPASS:
+			b0 = alpha; b1 = 0.; b2 = -alpha;
+			a0 = 1.+alpha; a1 = -2.*cw; a2 = 1.-alpha;
+		break;
+		case SYN123_PEAK:
+			b0 = 1.+alpha*A; b1 = -2.*cw; b2 = 1.-alpha*A;
+			a0 = 1.+alpha/A; a1 = -2.*cw; a2 = 1.-alpha/A;
+		break;
+		case SYN123_LOWSHELF:
+			b0 =    A*((A+1.)-(A-1.)*cw+sA);
+			b1 = 2.*A*((A-1.)-(A+1.)*cw);
+			b2 =    A*((A+1.)-(A-1.)*cw-sA);
+			a0 =       (A+1.)+(A-1.)*cw+sA;
+			a1 =   -2.*((A-1.)+(A+1.)*cw);
+			a2 =       (A+1.)+(A-1.)*cw-sA;
+		break;
+		case SYN123_HIGHSHELF:
+			b0 =    A*((A+1.)+(A-1.)*cw+sA);
+			b1 =-2.*A*((A-1.)+(A+1.)*cw);
+			b2 =    A*((A+1.)+(A-1.)*cw-sA);
+			a0 =       (A+1.)-(A-1.)*cw+sA;
+			a1 =    2.*((A-1.)-(A+1.)*cw);
+			a2 =       (A+1.)-(A-1.)*cw-sA;
+		break;
+		default:
+			return SYN123_BAD_FMT;
+	}
+	coef[0] = b0/a0;
+	coef[1] = b1/a0;
+	coef[2] = b2/a0;
+	coef[3] = a1/a0;
+	coef[4] = a2/a0;
+	return SYN123_OK;
+}
+
+int attribute_align_arg
+syn123_setup_filter( syn123_handle *sh, int channels, int stages
+,	const double *coef )
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(sh->fd)
+		free(sh->fd);
+	sh->fd = NULL;
+	if(channels < 1 || stages < 1)
+		return SYN123_BAD_FMT;
+	if(!coef)
+		return SYN123_BAD_BUF;
+	int groups = (channels+lanes-1)/lanes;
+	struct filter_data *fd = malloc( sizeof(*fd)
+	+	sizeof(float)*((size_t)stages*5 + (size_t)stages*groups*2*lanes) );
+	if(!fd)
+		return SYN123_DOOM;
+	fd->channels = channels;
+	fd->groups = groups;
+	fd->stages = stages;
+	fd->coef = (float*)(fd+1);
+	fd->state = fd->coef + stages*5;
+	for(int i=0; i<stages*5; ++i)
+		fd->coef[i] = (float)coef[i];
+	sh->fd = fd;
+	syn123_reset_filter(sh);
+	return SYN123_OK;
+}
+
+int attribute_align_arg
+syn123_setup_lowpass( syn123_handle *sh, int channels, long rate
+,	double freq, int order )
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(order < 1 || order > 2*SYN123_FILTER_STAGES)
+		return SYN123_BAD_FMT;
+	double coef[5*SYN123_FILTER_STAGES];
+	int stages = 0;
+	// Pairs of poles on the Butterworth circle, with their Q.
+	for(int k=0; k<order/2; ++k, ++stages)
+	{
+		double q = 1./(2.*sin((2.*k+1.)*M_PI/(2.*order)));
+		int err = syn123_biquad(coef+5*stages, SYN123_LOWPASS, rate, freq, q, 0.);
+		if(err)
+			return err;
+	}
+	// The real pole of odd orders as first order section.
+	if(order % 2)
+	{
+		if(rate < 1)
+			return SYN123_BAD_FMT;
+		if(!(freq > 0. && freq < 0.5*rate))
+			return SYN123_BAD_FREQ;
+		double K = tan(M_PI*freq/rate);
+		double *c = coef+5*stages++;
+		c[0] = c[1] = K/(1.+K);
+		c[2] = 0.;
+		c[3] = (K-1.)/(K+1.);
+		c[4] = 0.;
+	}
+	return syn123_setup_filter(sh, channels, stages, coef);
+}
+
+void attribute_align_arg
+syn123_reset_filter(syn123_handle *sh)
+{
+	if(!sh || !sh->fd)
+		return;
+	struct filter_data *fd = sh->fd;
+	for(size_t i=0; i<(size_t)fd->stages*fd->groups*2*lanes; ++i)
+		fd->state[i] = 0.;
+}
+
+#ifdef HAVE_GCC_VECTORS
+typedef float filter_vf __attribute__((vector_size(lanes*sizeof(float))));
+
+// One stage over a block of frames for a group of n<=lanes channels.
+static void biquad_group( const float *c, float *state, float *buf
+,	int n, int channels, size_t frames )
+{
+	filter_vf b0 = {c[0], c[0], c[0], c[0]};
+	filter_vf b1 = {c[1], c[1], c[1], c[1]};
+	filter_vf b2 = {c[2], c[2], c[2], c[2]};
+	filter_vf a1 = {c[3], c[3], c[3], c[3]};
+	filter_vf a2 = {c[4], c[4], c[4], c[4]};
+	filter_vf s1, s2;
+	memcpy(&s1, state, sizeof(s1));
+	memcpy(&s2, state+lanes, sizeof(s2));
+	for(size_t i=0; i<frames; ++i, buf+=channels)
+	{
+		filter_vf x = {0., 0., 0., 0.};
+		memcpy(&x, buf, n*sizeof(float));
+		filter_vf y = b0*x + s1;
+		s1 = b1*x - a1*y + s2;
+		s2 = b2*x - a2*y;
+		memcpy(buf, &y, n*sizeof(float));
+	}
+	memcpy(state, &s1, sizeof(s1));
+	memcpy(state+lanes, &s2, sizeof(s2));
+}
+#else
+static void biquad_group( const float *c, float *state, float *buf
+,	int n, int channels, size_t frames )
+{
+	for(int ch=0; ch<n; ++ch)
+	{
+		float s1 = state[ch];
+		float s2 = state[lanes+ch];
+		float *p = buf+ch;
+		for(size_t i=0; i<frames; ++i, p+=channels)
+		{
+			float x = *p;
+			float y = c[0]*x + s1;
+			s1 = c[1]*x - c[3]*y + s2;
+			s2 = c[2]*x - c[4]*y;
+			*p = y;
+		}
+		state[ch] = s1;
+		state[lanes+ch] = s2;
+	}
+}
+#endif
+
+static void filter_float(struct filter_data *fd, float *buf, size_t samples)
+{
+	while(samples)
+	{
+		size_t block = smin(samples, filterblock);
+		for(int s=0; s<fd->stages; ++s)
+			for(int g=0; g<fd->groups; ++g)
+			{
+				int n = fd->channels - g*lanes;
+				biquad_group( fd->coef+5*s, fd->state+(s*fd->groups+g)*2*lanes
+				,	buf+g*lanes, n < lanes ? n : lanes, fd->channels, block );
+			}
+		buf += block*fd->channels;
+		samples -= block;
+	}
+}
+
+int attribute_align_arg
+syn123_filter( syn123_handle *sh, void* buf, int encoding, size_t samples )
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(!sh->fd)
+		return SYN123_BAD_FMT;
+	if(!buf)
+		return SYN123_BAD_BUF;
+	struct filter_data *fd = sh->fd;
+	if(encoding == MPG123_ENC_FLOAT_32)
+	{
+		filter_float(fd, buf, samples);
+		return SYN123_OK;
+	}
+	// Everything else goes through float in the work buffer.
+	char *cbuf = buf;
+	int inframe = MPG123_SAMPLESIZE(encoding)*fd->channels;
+	int mixframe = sizeof(float)*fd->channels;
+	if(!inframe)
+		return SYN123_BAD_ENC;
+	int mbufblock = sizeof(sh->workbuf)/mixframe;
+	if(mbufblock < 1)
+		return SYN123_BAD_CONV;
+	while(samples)
+	{
+		int block = (int)smin(samples, mbufblock);
+		int err = syn123_conv(
+			sh->workbuf, MPG123_ENC_FLOAT_32, sizeof(sh->workbuf)
+		,	cbuf, encoding, inframe*block
+		,	NULL, NULL );
+		if(!err)
+		{
+			filter_float(fd, (float*)sh->workbuf, block);
+			err = syn123_conv(
+				cbuf, encoding, inframe*block
+			,	sh->workbuf, MPG123_ENC_FLOAT_32, mixframe*block
+			,	NULL, NULL );
+		}
+		if(err)
+		{
+			mdebug("conv error: %i", err);
+			return SYN123_BAD_CONV;
+		}
+		cbuf += block*inframe;
+		samples -= block;
+	}
+	return SYN123_OK;
+}
@@ -30,6 +30,14 @@
  * u-law, A-law and linear PCM conversions.
  */
 
+/*
+ * October 14, 2026:
+ * Encoding without the segment search and branches, taking segment and
+ * quantization bits from the exponent and mantissa of a float, so that
+ * conversion loops over blocks get vectorized. Decoding by table lookup.
+ * Same results as before for all input values.
+ */
+
 /*
  * January 28, 2018:
  * Stripped out the direct tables again and made things static for
@@ -50,29 +58,15 @@
  *
  */
  
-static const unsigned char sign_bit = 0x80; /* Sign bit for a A-law byte. */
-static const unsigned char quant_mask = 0xf; /* Quantization field mask. */
-static const unsigned char seg_shift = 4; /* Left shift for segment number. */
-static const unsigned char seg_mask = 0x70; /* Segment field mask. */
-
-static int16_t seg_aend[8] = {
-	0x01F, 0x03F, 0x07F, 0x0FF,
-	0x1FF, 0x3FF, 0x7FF, 0xFFF
-};
-static int16_t seg_uend[8] = {
-	0x03F, 0x07F, 0x0FF, 0x01FF,
-	0x3FF, 0x7FF, 0xFFF, 0x1FFF
-};
-
-static int search(int16_t val, int16_t *table, int size)
+/* Biased exponent and the top 4 mantissa bits of a float holding the
+ * integer x >= 0: the position of the leading one and the 4 bits after it.
+ */
+static int32_t g711_expmant(int32_t x)
 {
-	int i;
-
-	for (i = 0; i < size; i++) {
-		if (val <= *table++)
-			return (i);
-	}
-	return (size);
+	float f = (float)x;
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return (int32_t)(bits >> 19);
 }
 
 /*
@@ -96,65 +90,63 @@ static int search(int16_t val, int16_t *table, int size)
  */
 static unsigned char linear2alaw(int16_t pcm_val)
 {
-	int16_t mask;
-	int seg;
-	int aval; /* int is comfortable, even if bigger than needed */
-
-	pcm_val = pcm_val >> 3;
-
-	if (pcm_val >= 0) {
-		mask = 0xD5;		/* sign (7th) bit = 1 */
-	} else {
-		mask = 0x55;		/* sign bit = 0 */
-		pcm_val = -pcm_val - 1;
-	}
-
-	/* Convert the scaled magnitude to segment number. */
-	seg = search(pcm_val, seg_aend, 8);
-
-	/* Combine the sign, segment, and quantization bits. */
-
-	if (seg >= 8)		/* out of range, return maximum value. */
-		return (unsigned char)(0x7F ^ mask);
-	else {
-		aval = seg << seg_shift;
-		if (seg < 2)
-			aval |= (pcm_val >> 1) & quant_mask;
-		else
-			aval |= (pcm_val >> seg) & quant_mask;
-		return (unsigned char)(aval ^ mask);
-	}
+	int32_t v = pcm_val >> 3;
+	int32_t mask = v >= 0 ? 0xD5 : 0x55; /* sign (7th) bit = 1 */
+	int32_t mag = v >= 0 ? v : -v - 1;    /* 0 to 0xFFF */
+	/* The exponent of 0x20 to 0xFFF is 5 to 11 for segments 1 to 7,
+	 * segment 0 is linear like segment 1, in steps of 2. */
+	int32_t aval = g711_expmant(mag) - ((127+4)<<4);
+	aval = mag < 0x20 ? mag >> 1 : aval;
+	return (unsigned char)(aval ^ mask);
 }
 
+static const int16_t alaw_tab[256] =
+{
+	 -5504, -5248, -6016, -5760, -4480, -4224, -4992, -4736,
+	 -7552, -7296, -8064, -7808, -6528, -6272, -7040, -6784,
+	 -2752, -2624, -3008, -2880, -2240, -2112, -2496, -2368,
+	 -3776, -3648, -4032, -3904, -3264, -3136, -3520, -3392,
+	-22016,-20992,-24064,-23040,-17920,-16896,-19968,-18944,
+	-30208,-29184,-32256,-31232,-26112,-25088,-28160,-27136,
+	-11008,-10496,-12032,-11520, -8960, -8448, -9984, -9472,
+	-15104,-14592,-16128,-15616,-13056,-12544,-14080,-13568,
+	  -344,  -328,  -376,  -360,  -280,  -264,  -312,  -296,
+	  -472,  -456,  -504,  -488,  -408,  -392,  -440,  -424,
+	   -88,   -72,  -120,  -104,   -24,    -8,   -56,   -40,
+	  -216,  -200,  -248,  -232,  -152,  -136,  -184,  -168,
+	 -1376, -1312, -1504, -1440, -1120, -1056, -1248, -1184,
+	 -1888, -1824, -2016, -1952, -1632, -1568, -1760, -1696,
+	  -688,  -656,  -752,  -720,  -560,  -528,  -624,  -592,
+	  -944,  -912, -1008,  -976,  -816,  -784,  -880,  -848,
+	  5504,  5248,  6016,  5760,  4480,  4224,  4992,  4736,
+	  7552,  7296,  8064,  7808,  6528,  6272,  7040,  6784,
+	  2752,  2624,  3008,  2880,  2240,  2112,  2496,  2368,
+	  3776,  3648,  4032,  3904,  3264,  3136,  3520,  3392,
+	 22016, 20992, 24064, 23040, 17920, 16896, 19968, 18944,
+	 30208, 29184, 32256, 31232, 26112, 25088, 28160, 27136,
+	 11008, 10496, 12032, 11520,  8960,  8448,  9984,  9472,
+	 15104, 14592, 16128, 15616, 13056, 12544, 14080, 13568,
+	   344,   328,   376,   360,   280,   264,   312,   296,
+	   472,   456,   504,   488,   408,   392,   440,   424,
+	    88,    72,   120,   104,    24,     8,    56,    40,
+	   216,   200,   248,   232,   152,   136,   184,   168,
+	  1376,  1312,  1504,  1440,  1120,  1056,  1248,  1184,
+	  1888,  1824,  2016,  1952,  1632,  1568,  1760,  1696,
+	   688,   656,   752,   720,   560,   528,   624,   592,
+	   944,   912,  1008,   976,   816,   784,   880,   848
+};
+
 /*
  * alaw2linear() - Convert an A-law value to 16-bit linear PCM
  *
  */
-int16_t alaw2linear(unsigned char a_val)
+static int16_t alaw2linear(unsigned char a_val)
 {
-	int16_t t;
-	int seg;
-
-	a_val ^= 0x55;
-
-	t = (a_val & quant_mask) << 4;
-	seg = (a_val & seg_mask) >> seg_shift;
-	switch (seg) {
-	case 0:
-		t += 8;
-		break;
-	case 1:
-		t += 0x108;
-		break;
-	default:
-		t += 0x108;
-		t <<= seg - 1;
-	}
-	return ((a_val & sign_bit) ? t : -t);
+	return alaw_tab[a_val];
 }
 
-static const int16_t bias = 0x84; /* Bias for linear code. */
-static const int16_t clip = 8159;
+static const int32_t bias = 0x84; /* Bias for linear code. */
+static const int32_t clip = 8159;
 
 /*
  * linear2ulaw() - Convert a linear PCM value to u-law
@@ -187,59 +179,62 @@ static const int16_t clip = 8159;
  */
 static unsigned char linear2ulaw(int16_t pcm_val)
 {
-	int16_t mask;
-	int seg;
-	int uval;
-
 	/* Get the sign and the magnitude of the value. */
-	pcm_val = pcm_val >> 2;
-	if (pcm_val < 0) {
-		pcm_val = -pcm_val;
-		mask = 0x7F;
-	} else {
-		mask = 0xFF;
-	}
-        if ( pcm_val > clip ) pcm_val = clip;		/* clip the magnitude */
-	pcm_val += (bias >> 2);
-
-	/* Convert the scaled magnitude to segment number. */
-	seg = search(pcm_val, seg_uend, 8);
-
-	/*
-	 * Combine the sign, segment, quantization bits;
-	 * and complement the code word.
-	 */
-	if (seg >= 8)		/* out of range, return maximum value. */
-		return (unsigned char)(0x7F ^ mask);
-	else {
-		uval = (seg << 4) | ((pcm_val >> (seg + 1)) & 0xF);
-		return (unsigned char)(uval ^ mask);
-	}
-
+	int32_t v = pcm_val >> 2;
+	int32_t mask = v < 0 ? 0x7F : 0xFF;
+	int32_t mag = v < 0 ? -v : v;
+	/* Clip the magnitude and bias it to 0x21 to 0x2000, exponent 5 to 13
+	 * for segments 0 to 8, the last one being out of range (maximum). */
+	mag = (mag > clip ? clip : mag) + (bias >> 2);
+	int32_t uval = g711_expmant(mag) - ((127+5)<<4);
+	uval = uval > 0x7F ? 0x7F : uval;
+	/* Combine and complement the code word. */
+	return (unsigned char)(uval ^ mask);
 }
 
+static const int16_t ulaw_tab[256] =
+{
+	-32124,-31100,-30076,-29052,-28028,-27004,-25980,-24956,
+	-23932,-22908,-21884,-20860,-19836,-18812,-17788,-16764,
+	-15996,-15484,-14972,-14460,-13948,-13436,-12924,-12412,
+	-11900,-11388,-10876,-10364, -9852, -9340, -8828, -8316,
+	 -7932, -7676, -7420, -7164, -6908, -6652, -6396, -6140,
+	 -5884, -5628, -5372, -5116, -4860, -4604, -4348, -4092,
+	 -3900, -3772, -3644, -3516, -3388, -3260, -3132, -3004,
+	 -2876, -2748, -2620, -2492, -2364, -2236, -2108, -1980,
+	 -1884, -1820, -1756, -1692, -1628, -1564, -1500, -1436,
+	 -1372, -1308, -1244, -1180, -1116, -1052,  -988,  -924,
+	  -876,  -844,  -812,  -780,  -748,  -716,  -684,  -652,
+	  -620,  -588,  -556,  -524,  -492,  -460,  -428,  -396,
+	  -372,  -356,  -340,  -324,  -308,  -292,  -276,  -260,
+	  -244,  -228,  -212,  -196,  -180,  -164,  -148,  -132,
+	  -120,  -112,  -104,   -96,   -88,   -80,   -72,   -64,
+	   -56,   -48,   -40,   -32,   -24,   -16,    -8,     0,
+	 32124, 31100, 30076, 29052, 28028, 27004, 25980, 24956,
+	 23932, 22908, 21884, 20860, 19836, 18812, 17788, 16764,
+	 15996, 15484, 14972, 14460, 13948, 13436, 12924, 12412,
+	 11900, 11388, 10876, 10364,  9852,  9340,  8828,  8316,
+	  7932,  7676,  7420,  7164,  6908,  6652,  6396,  6140,
+	  5884,  5628,  5372,  5116,  4860,  4604,  4348,  4092,
+	  3900,  3772,  3644,  3516,  3388,  3260,  3132,  3004,
+	  2876,  2748,  2620,  2492,  2364,  2236,  2108,  1980,
+	  1884,  1820,  1756,  1692,  1628,  1564,  1500,  1436,
+	  1372,  1308,  1244,  1180,  1116,  1052,   988,   924,
+	   876,   844,   812,   780,   748,   716,   684,   652,
+	   620,   588,   556,   524,   492,   460,   428,   396,
+	   372,   356,   340,   324,   308,   292,   276,   260,
+	   244,   228,   212,   196,   180,   164,   148,   132,
+	   120,   112,   104,    96,    88,    80,    72,    64,
+	    56,    48,    40,    32,    24,    16,     8,     0
+};
+
 /*
  * ulaw2linear() - Convert a u-law value to 16-bit linear PCM
  *
- * First, a biased linear code is derived from the code word. An unbiased
- * output can then be obtained by subtracting 33 from the biased code.
- *
  * Note that this function expects to be passed the complement of the
  * original code word. This is in keeping with ISDN conventions.
  */
 static int16_t ulaw2linear(unsigned char u_val)
 {
-	int t;
-
-	/* Complement to obtain normal u-law value. */
-	u_val = ~u_val;
-
-	/*
-	 * Extract and bias the quantization bits. Then
-	 * shift up by the segment number and subtract out the bias.
-	 */
-	t = ((u_val & quant_mask) << 3) + bias;
-	t <<= (u_val & seg_mask) >> seg_shift;
-
-	return ((u_val & sign_bit) ? (bias - t) : (t - bias));
+	return ulaw_tab[u_val];
 }
@@ -46,6 +46,13 @@ static double phasefrac(double p)
 	return p-floor(p);
 }
 
+/* the same for |p| < 2^31 */
+static double phasefrac32(double p)
+{
+	double t = (int32_t)p;
+	return p - (t > p ? t-1 : t);
+}
+
 /*
 	Given a set of wave frequencies, compute an approximate common
 	period for the combined signal. Invalid frequencies are set to
@@ -186,19 +193,36 @@ static double wave_shot(double p)
 	return p*p*exp(-100*p)/5.41341132946451e-05;
 }
 
+// Inner loops of fixed length, like the sample conversions. The compiler
+// vectorizes those without runtime checks, including calls to sin() and
+// exp() if the C library offers vector variants (glibc with -ffast-math).
+// The wave functions above are written with selections only for that.
+
+#define WAVE_BLOCKS(count, code) \
+{ \
+	int pi_ = 0; \
+	for(; pi_+waveblock <= (count); pi_ += waveblock) \
+		for(int j_=0; j_<waveblock; ++j_) \
+		{ \
+			int pi = pi_+j_; \
+			code; \
+		} \
+	for(int pi=pi_; pi<(count); ++pi) \
+		code; \
+}
+
 // Actual wave worker function, to be used to give up to
 // bufblock samples in one go. This takes a vector of phases
 // and multiplies the resulting amplitudes into the output buffer.
-static void evaluate_wave( double outbuf[bufblock], int samples
-,	enum syn123_wave_id id, double phase[bufblock] )
+static void evaluate_wave( double * MPG123_RESTRICT outbuf, int samples
+,	enum syn123_wave_id id, const double * MPG123_RESTRICT phase )
 {
 	// Ensuring that the inner loop is inside the switch.
 	// Compilers might be smart enough, but it is not hard
 	// to write it down the right way from the beginning.
 	#define PHASE phase[pi]
 	#define PI_LOOP( code ) \
-		for(int pi=0; pi<samples; ++pi) \
-			outbuf[pi] *= code;
+		WAVE_BLOCKS(samples, outbuf[pi] *= code)
 	switch(id)
 	{
 		case SYN123_WAVE_NONE:
@@ -287,6 +311,14 @@ const char* syn123_strerror(int errcode)
 			return "Invalid sweep curve given.";
 		case SYN123_OVERFLOW:
 			return "An integer overflow occured.";
+		case SYN123_BAD_RESAMPLE:
+			return "Invalid resampling method or ratio.";
+		case SYN123_NO_DATA:
+			return "Not enough data.";
+		case SYN123_BAD_SPEED:
+			return "Invalid time stretch speed.";
+		case SYN123_BAD_DITHER:
+			return "Invalid dither choice.";
 		default:
 			return "unkown error";
 	}
@@ -299,12 +331,16 @@ const char* syn123_strerror(int errcode)
 // task from actually evaluating the wave functions.
 // The code is actually smaller and better abstracted that way.
 
-static void add_some_wave( double outbuf[bufblock], int samples
+static void add_some_wave( double * MPG123_RESTRICT outbuf, int samples
 ,	enum syn123_wave_id id, double pps, double phase
-,	double workbuf[bufblock] )
+,	double * MPG123_RESTRICT workbuf )
 {
-	for(int pi=0; pi<samples; ++pi)
-		workbuf[pi] = phasefrac(pi*pps+phase);
+	// floor() is no vector instruction everywhere, conversion to 32 bit
+	// integer is. The phase is in [0,1), so this covers sane frequencies.
+	if(fabs(pps)*samples < 1e9)
+		WAVE_BLOCKS(samples, workbuf[pi] = phasefrac32(pi*pps+phase))
+	else
+		WAVE_BLOCKS(samples, workbuf[pi] = phasefrac(pi*pps+phase))
 	evaluate_wave(outbuf, samples, id, workbuf);
 }
 
@@ -381,10 +417,10 @@ static void wave_generator(syn123_handle *sh, int samples)
 
 /* Build internal table, allocate external table, convert to that one, */
 /* adjusting sample storage format and channel count. */
-int attribute_align_arg
-syn123_setup_waves( syn123_handle *sh, size_t count
+/* Without table, only the wave generator is set up. */
+static int setup_waves( syn123_handle *sh, size_t count
 ,	int *id, double *freq, double *phase, int *backwards
-,	size_t *common_period )
+,	size_t *common_period, int table )
 {
 	int ret = SYN123_OK;
 
@@ -414,7 +450,7 @@ syn123_setup_waves( syn123_handle *sh, size_t count
 	sh->wave_count = count;
 	sh->generator = wave_generator;
 
-	if(sh->maxbuf)
+	if(table && sh->maxbuf)
 	{
 		// 1. Determine buffer size to use.
 		size_t samplesize = MPG123_SAMPLESIZE(sh->fmt.encoding);
@@ -466,6 +502,23 @@ setup_wave_end:
 	return ret;
 }
 
+int attribute_align_arg
+syn123_setup_waves( syn123_handle *sh, size_t count
+,	int *id, double *freq, double *phase, int *backwards
+,	size_t *common_period )
+{
+	return setup_waves( sh, count, id, freq, phase, backwards
+	,	common_period, TRUE );
+}
+
+int attribute_align_arg
+syn123_setup_waves_direct( syn123_handle *sh, size_t count
+,	int *id, double *freq, double *phase, int *backwards )
+{
+	return setup_waves( sh, count, id, freq, phase, backwards
+	,	NULL, FALSE );
+}
+
 // Given time normalized to the sweep duration, return the
 // current frequency.
 
@@ -494,10 +547,29 @@ static double sweep_phase_square(double t, double f1, double f2)
 	return f1*t+t*t*t*(1./3)*(f2-f1);
 }
 
+// The exponential sweep without exp() for each sample: The frequency
+// at sample j of a block is the one at the block start times the
+// precomputed growth[j]. Each block starts from a fresh exp(), so errors
+// do not accumulate over the sweep.
 // Be sure to only call if f2-f1 has some minimal value.
-static double sweep_phase_exp(double t, double logf1, double logf2)
+static void sweep_phase_exp_blocks( struct syn123_sweep *sw
+,	double * MPG123_RESTRICT buf, size_t start, int count )
 {
-	return 1./(logf2-logf1) * (exp(logf1 + t*(logf2-logf1)) - exp(logf1));
+	double scale = 1./(sw->f2-sw->f1);
+	double offset = scale*exp(sw->f1);
+	int b = 0;
+	for(; b+waveblock <= count; b += waveblock)
+	{
+		double anchor = scale*exp(sw->f1+(double)(start+b)/sw->d*(sw->f2-sw->f1));
+		for(int j=0; j<waveblock; ++j)
+			buf[b+j] = anchor*sw->growth[j] - offset;
+	}
+	if(b < count)
+	{
+		double anchor = scale*exp(sw->f1+(double)(start+b)/sw->d*(sw->f2-sw->f1));
+		for(int j=0; j<count-b; ++j)
+			buf[b+j] = anchor*sw->growth[j] - offset;
+	}
 }
 
 // Return phases after given offset of samples from now, including
@@ -522,31 +594,33 @@ static void sweep_phase( syn123_handle *sh, size_t off
 		int sweep_s = pos <= sw->d
 		?	(int)smin(sw->d+1 - pos, count)
 		:	0;
-		// normalized time here to reduce code redundancy
-		for(int i=0; i<sweep_s; ++i)
-			buf[boff+i] = (double)pos++/sw->d;
 		// actual phase computation, with inner loops for auto-vectorization
+		size_t start = pos;
+		pos += sweep_s;
 		switch(sw->id)
 		{
 			case SYN123_SWEEP_LINEAR:
 				for(int i=0; i<sweep_s; ++i)
-					buf[boff+i] = sweep_phase_linear(buf[boff+i], sw->f1, sw->f2);
+					buf[boff+i] = sweep_phase_linear( (double)(start+i)/sw->d
+					,	sw->f1, sw->f2 );
 			break;
 			case SYN123_SWEEP_SQUARE:
 				for(int i=0; i<sweep_s; ++i)
-					buf[boff+i] = sweep_phase_square(buf[boff+i], sw->f1, sw->f2);
+					buf[boff+i] = sweep_phase_square( (double)(start+i)/sw->d
+					,	sw->f1, sw->f2 );
 			break;
 			case SYN123_SWEEP_EXP:
-				for(int i=0; i<sweep_s; ++i)
-					buf[boff+i] = sweep_phase_exp(buf[boff+i], sw->f1, sw->f2);
+				sweep_phase_exp_blocks(sw, buf+boff, start, sweep_s);
 			break;
 			default:
 				for(int i=0; i<sweep_s; ++i)
 					buf[boff+i] = 0;
 		}
 		// scaling from normalized time to sampled proper time
+		double timescale = (double)sw->d/sh->fmt.rate;
 		for(int i=0; i<sweep_s; ++i)
-			buf[boff++] *= (double)sw->d/sh->fmt.rate;
+			buf[boff+i] *= timescale;
+		boff += sweep_s;
 		count -= sweep_s;
 		// 2. Fill phases for post sweep phase, if reached.
 		if(pos > sw->d)
@@ -563,12 +637,12 @@ static void sweep_phase( syn123_handle *sh, size_t off
 			pos = 0;
 	}
 	// Turn all phases into fractions and invert if going backwards.
-	if(sw->wave.backwards)
-		for(int i=0; i<boff; ++i)
-			buf[i] = phasefrac(-buf[i]-sw->wave.phase);
+	double sign = sw->wave.backwards ? -1. : 1.;
+	double phase = sign*sw->wave.phase;
+	if(sw->fracint)
+		WAVE_BLOCKS(boff, buf[pi] = phasefrac32(sign*buf[pi]+phase))
 	else
-		for(int i=0; i<boff; ++i)
-			buf[i] = phasefrac(buf[i]+sw->wave.phase);
+		WAVE_BLOCKS(boff, buf[pi] = phasefrac(sign*buf[pi]+phase))
 }
 
 static void sweep_generator(syn123_handle *sh, int samples)
@@ -635,11 +709,17 @@ syn123_setup_sweep( syn123_handle* sh
 	sw->wave.freq = sw->f2; // We'll use that later for continuation.
 	sw->wave.phase = phase; // Beginning phase offset, not updated.
 	sw->id = sweep_id;
+	// The phase grows no faster than with the higher frequency, plus
+	// less than a period after the sweep.
+	sw->fracint = fabs(phase) + 1.
+	+	(double)duration/sh->fmt.rate*(sw->f1 > sw->f2 ? sw->f1 : sw->f2) < 1e9;
 	// Store the logarithms for exponential sweep.
 	if(sweep_id == SYN123_SWEEP_EXP)
 	{
 		sw->f1 = log(sw->f1);
 		sw->f2 = log(sw->f2);
+		for(int j=0; j<waveblock; ++j)
+			sw->growth[j] = exp((double)j/duration*(sw->f2-sw->f1));
 	}
 	sw->i = 0;
 	sw->d = duration;
@@ -736,6 +816,16 @@ setup_sweep_end:
 	return ret;
 }
 
+int attribute_align_arg
+syn123_allocator( void *(*r_alloc)(void *handle, size_t size)
+,	void *(*r_realloc)(void *handle, void *ptr, size_t size)
+,	void (*r_free)(void *handle, void *ptr), void *handle )
+{
+	return compat_allocator(r_alloc, r_realloc, r_free, handle)
+	?	SYN123_BAD_HANDLE
+	:	SYN123_OK;
+}
+
 syn123_handle* attribute_align_arg
 syn123_new(long rate, int channels, int encoding
 ,	size_t maxbuf, int *err)
@@ -769,6 +859,14 @@ syn123_new(long rate, int channels, int encoding
 	sh->wave_count = 0;
 	sh->waves = NULL;
 	sh->handle = NULL;
+	sh->rd = NULL;
+	sh->ld = NULL;
+	sh->md = NULL;
+	sh->fd = NULL;
+	sh->sd = NULL;
+	sh->cd = NULL;
+	sh->dd = NULL;
+	sh->pd = NULL;
 	syn123_setup_silence(sh);
 
 syn123_new_end:
@@ -790,9 +888,50 @@ syn123_del(syn123_handle* sh)
 	syn123_setup_silence(sh);
 	if(sh->buf)
 		free(sh->buf);
+	if(sh->rd)
+		free(sh->rd);
+	if(sh->ld)
+		free(sh->ld);
+	if(sh->md)
+		free(sh->md);
+	if(sh->fd)
+		free(sh->fd);
+	if(sh->sd)
+		free(sh->sd);
+	if(sh->cd)
+		free(sh->cd);
+	if(sh->dd)
+		free(sh->dd);
+	if(sh->pd)
+		free(sh->pd);
 	free(sh);
 }
 
+// Conversion of generated samples to float or double and replication to
+// all channels in one pass.
+#define MONO2MANY_FUNC(type) \
+static void mono2many_##type( type * MPG123_RESTRICT dst \
+,	const double * MPG123_RESTRICT src, int channels, int samples ) \
+{ \
+	switch(channels) \
+	{ \
+		case 2: \
+			for(int i=0; i<samples; ++i) \
+				dst[2*i] = dst[2*i+1] = (type)src[i]; \
+		break; \
+		default: \
+			for(int i=0; i<samples; ++i) \
+			{ \
+				type v = (type)src[i]; \
+				for(int c=0; c<channels; ++c) \
+					dst[i*channels+c] = v; \
+			} \
+	} \
+}
+
+MONO2MANY_FUNC(float)
+MONO2MANY_FUNC(double)
+
 // Copy from period buffer or generate on the fly.
 size_t attribute_align_arg
 syn123_read( syn123_handle *sh, void *dest, size_t dest_bytes )
@@ -825,6 +964,8 @@ syn123_read( syn123_handle *sh, void *dest, size_t dest_bytes )
 	}
 	else // Compute directly, employing the work buffers.
 	{
+		int encoding = sh->fmt.encoding;
+		int channels = sh->fmt.channels;
 		while(dest_samples)
 		{
 			int block = (int)smin(dest_samples, bufblock);
@@ -835,20 +976,30 @@ syn123_read( syn123_handle *sh, void *dest, size_t dest_bytes )
 			// TODO for the future: Compute only in single precision if
 			// it is enough.
 			sh->generator(sh, block);
-			// Convert to external format, mono. We are abusing workbuf[0] here,
-			// because it is big enough.
-			int err = syn123_conv(
-				sh->workbuf[0], sh->fmt.encoding, sizeof(sh->workbuf[0])
-			,	sh->workbuf[1], MPG123_ENC_FLOAT_64, sizeof(double)*block
-			,	NULL, NULL );
-			if(err)
+			// Floating point is converted while spreading over the channels.
+			if(encoding == MPG123_ENC_FLOAT_64)
+				mono2many_double((double*)cdest, sh->workbuf[1], channels, block);
+			else if(encoding == MPG123_ENC_FLOAT_32 && channels > 1)
+				mono2many_float((float*)cdest, sh->workbuf[1], channels, block);
+			else
 			{
-				debug1("conv error: %i", err);
-				break;
+				// Convert to external format, mono. Directly into the output
+				// for a single channel, otherwise we are abusing workbuf[0]
+				// here, because it is big enough.
+				void *convbuf = channels > 1 ? (void*)sh->workbuf[0] : (void*)cdest;
+				int err = syn123_conv(
+					convbuf, encoding, channels > 1 ? sizeof(sh->workbuf[0]) : framesize*block
+				,	sh->workbuf[1], MPG123_ENC_FLOAT_64, sizeof(double)*block
+				,	NULL, NULL );
+				if(err)
+				{
+					debug1("conv error: %i", err);
+					break;
+				}
+				if(channels > 1)
+					syn123_mono2many( cdest, sh->workbuf[0]
+					,	channels, samplesize, block );
 			}
-//debug2("buf[1][0]=%f buf[0][0]=%f", sh->workbuf[1][0], *(float*)(&sh->workbuf[0][0]));
-			syn123_mono2many( cdest, sh->workbuf[0]
-			,	sh->fmt.channels, samplesize, block );
 			cdest += framesize*block;
 			dest_samples -= block;
 			extracted += block;
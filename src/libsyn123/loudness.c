@@ -0,0 +1,249 @@
+/*
+	loudness: libsyn123 peak and loudness measurement
+
+	copyright 2020 by the mpg123 project
+	licensed under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Integrated loudness after ITU-R BS.1770 / EBU R128, which is also what
+	ReplayGain 2.0 is based on. Each channel goes through the K-weighting
+	filter (a high shelf and a high pass biquad, coefficients computed for
+	the actual rate). The mean square of the filtered signal is summed over
+	100 ms steps, giving the 400 ms gating blocks with 75% overlap. Blocks
+	below -70 LUFS are dropped, the others go into a histogram of 0.1 LU
+	bins that also keeps the sum of block energies. At the end, the
+	relative gate of -10 LU below the mean is applied on those bins.
+
+	The filters are recursive, so they run along the time for each
+	channel. Squares, sums and the peak search are plain loops over
+	contiguous floats for the compiler to vectorize.
+*/
+
+#define NO_SMAX
+#define NO_GROW_BUF
+#include "syn123_int.h"
+#include "debug.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Histogram range and resolution in LUFS.
+#define HIST_MIN -70.
+#define HIST_MAX  10.
+enum { histbins = 800 };
+// The blocks consist of that many steps.
+enum { blocksteps = 4 };
+
+struct biquad
+{
+	double b0, b1, b2, a1, a2;
+};
+
+struct loudness_data
+{
+	int channels;
+	struct biquad shelf;
+	struct biquad pass;
+	double *state;   // channels times 4 values (transposed form II)
+	size_t steplen;  // samples in 100 ms
+	size_t stepfill; // samples in current step
+	double step;     // energy sum of current step
+	double steps[blocksteps]; // the last steps
+	size_t stepcount; // steps done
+	float peak;
+	double *energy;   // sum of block energies for each bin
+	uint64_t *count;  // blocks in each bin
+};
+
+// K-weighting filter, as given in BS.1770 for 48 kHz and derived for
+// other rates the same way as the reference does.
+static void kweight(struct loudness_data *ld, long rate)
+{
+	double f0 = 1681.974450955533;
+	double G  = 3.999843853973347;
+	double Q  = 0.7071752369554196;
+	double K  = tan(M_PI*f0/rate);
+	double Vh = pow(10., G/20.);
+	double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1. + K/Q + K*K;
+	ld->shelf.b0 = (Vh + Vb*K/Q + K*K)/a0;
+	ld->shelf.b1 = 2.*(K*K - Vh)/a0;
+	ld->shelf.b2 = (Vh - Vb*K/Q + K*K)/a0;
+	ld->shelf.a1 = 2.*(K*K - 1.)/a0;
+	ld->shelf.a2 = (1. - K/Q + K*K)/a0;
+	f0 = 38.13547087602444;
+	Q  = 0.5003270373238773;
+	K  = tan(M_PI*f0/rate);
+	a0 = 1. + K/Q + K*K;
+	ld->pass.b0 = 1.;
+	ld->pass.b1 = -2.;
+	ld->pass.b2 = 1.;
+	ld->pass.a1 = 2.*(K*K - 1.)/a0;
+	ld->pass.a2 = (1. - K/Q + K*K)/a0;
+}
+
+static double energy2lufs(double energy)
+{
+	return -0.691 + 10.*log10(energy);
+}
+
+int attribute_align_arg
+syn123_setup_loudness(syn123_handle *sh, long rate, int channels)
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(sh->ld)
+		free(sh->ld);
+	sh->ld = NULL;
+	// The filters need some room below Nyquist.
+	if(rate < 8000 || channels < 1)
+		return SYN123_BAD_FMT;
+	struct loudness_data *ld = malloc( sizeof(*ld)
+	+	histbins*(sizeof(double)+sizeof(uint64_t))
+	+	channels*4*sizeof(double) );
+	if(!ld)
+		return SYN123_DOOM;
+	ld->channels = channels;
+	kweight(ld, rate);
+	ld->energy = (double*)(ld+1);
+	ld->count = (uint64_t*)(ld->energy+histbins);
+	ld->state = (double*)(ld->count+histbins);
+	for(size_t i=0; i<histbins; ++i)
+	{
+		ld->energy[i] = 0.;
+		ld->count[i] = 0;
+	}
+	for(size_t i=0; i<channels*4; ++i)
+		ld->state[i] = 0.;
+	ld->steplen = (rate+5)/10;
+	ld->stepfill = 0;
+	ld->step = 0.;
+	ld->stepcount = 0;
+	ld->peak = 0.;
+	sh->ld = ld;
+	return SYN123_OK;
+}
+
+// One step of 100 ms is complete, maybe also a block.
+static void finish_step(struct loudness_data *ld)
+{
+	ld->steps[ld->stepcount++ % blocksteps] = ld->step;
+	ld->step = 0.;
+	ld->stepfill = 0;
+	if(ld->stepcount < blocksteps)
+		return;
+	double sum = 0.;
+	for(int i=0; i<blocksteps; ++i)
+		sum += ld->steps[i];
+	double energy = sum/(blocksteps*ld->steplen);
+	if(energy <= 0.)
+		return;
+	double lufs = energy2lufs(energy);
+	if(lufs < HIST_MIN)
+		return;
+	size_t bin = lufs >= HIST_MAX
+	?	histbins-1
+	:	(size_t)((lufs-HIST_MIN)*histbins/(HIST_MAX-HIST_MIN));
+	ld->energy[bin] += energy;
+	ld->count[bin]++;
+}
+
+// Filter some samples of one channel, returning the sum of squares.
+static double filter_channel( struct loudness_data *ld, double *s
+,	const float *src, size_t samples )
+{
+	int channels = ld->channels;
+	struct biquad f = ld->shelf;
+	struct biquad g = ld->pass;
+	double s0 = s[0], s1 = s[1], s2 = s[2], s3 = s[3];
+	double sum = 0.;
+	for(size_t i=0; i<samples; ++i)
+	{
+		double x = src[i*channels];
+		double y = f.b0*x + s0;
+		s0 = f.b1*x - f.a1*y + s1;
+		s1 = f.b2*x - f.a2*y;
+		double z = g.b0*y + s2;
+		s2 = g.b1*y - g.a1*z + s3;
+		s3 = g.b2*y - g.a2*z;
+		sum += z*z;
+	}
+	// Do not let silence decay into denormals.
+	if(fabs(s0) < 1e-30) s0 = 0.;
+	if(fabs(s1) < 1e-30) s1 = 0.;
+	if(fabs(s2) < 1e-30) s2 = 0.;
+	if(fabs(s3) < 1e-30) s3 = 0.;
+	s[0] = s0; s[1] = s1; s[2] = s2; s[3] = s3;
+	return sum;
+}
+
+int attribute_align_arg
+syn123_loudness(syn123_handle *sh, const float *src, size_t samples)
+{
+	if(!sh || !sh->ld)
+		return SYN123_BAD_HANDLE;
+	if(!src && samples)
+		return SYN123_BAD_BUF;
+	struct loudness_data *ld = sh->ld;
+	int channels = ld->channels;
+	while(samples)
+	{
+		size_t block = smin(samples, ld->steplen - ld->stepfill);
+		float peak = ld->peak;
+		for(size_t i=0; i<block*channels; ++i)
+		{
+			float a = src[i] < 0 ? -src[i] : src[i];
+			peak = a > peak ? a : peak;
+		}
+		ld->peak = peak;
+		for(int c=0; c<channels; ++c)
+			ld->step += filter_channel(ld, ld->state+4*c, src+c, block);
+		src += block*channels;
+		samples -= block;
+		ld->stepfill += block;
+		if(ld->stepfill == ld->steplen)
+			finish_step(ld);
+	}
+	return SYN123_OK;
+}
+
+int attribute_align_arg
+syn123_loudness_result(syn123_handle *sh, double *lufs, double *peak)
+{
+	if(!sh || !sh->ld)
+		return SYN123_BAD_HANDLE;
+	struct loudness_data *ld = sh->ld;
+	if(peak)
+		*peak = ld->peak;
+	double sum = 0.;
+	uint64_t count = 0;
+	for(size_t i=0; i<histbins; ++i)
+	{
+		sum   += ld->energy[i];
+		count += ld->count[i];
+	}
+	if(!count)
+		return SYN123_NO_DATA;
+	// Relative gate 10 LU below the mean of what passed the absolute one.
+	double gate = energy2lufs(sum/count) - 10.;
+	size_t first = gate <= HIST_MIN
+	?	0
+	:	(size_t)((gate-HIST_MIN)*histbins/(HIST_MAX-HIST_MIN));
+	if(first >= histbins)
+		first = histbins-1;
+	sum = 0.;
+	count = 0;
+	for(size_t i=first; i<histbins; ++i)
+	{
+		sum   += ld->energy[i];
+		count += ld->count[i];
+	}
+	if(!count)
+		return SYN123_NO_DATA;
+	debug3( "loudness: %g LUFS from %lu blocks, gate at %g"
+	,	energy2lufs(sum/count), (unsigned long)count, gate );
+	if(lufs)
+		*lufs = energy2lufs(sum/count);
+	return SYN123_OK;
+}
@@ -172,3 +172,117 @@ setup_pink_end:
 	return ret;
 }
 
+// The same for many channels at once, each with its own generator state.
+// All channels share the index, so the same row is replaced in each of
+// them for a sample and the update is a loop over channels that the
+// compiler can vectorize, the channels padded to whole vectors.
+
+enum { pink_lanes = 8 };
+
+struct pink_data
+{
+	int channels;
+	int lanes;     // channels rounded up to whole vectors
+	int rows;
+	int index;
+	int mask;
+	float scalar;
+	uint32_t *seed; // lanes
+	int32_t *sum;   // lanes
+	int32_t *row;   // rows*lanes
+	float *out;     // lanes, one PCM frame
+};
+
+int attribute_align_arg
+syn123_setup_multipink( syn123_handle *sh, int channels, int rows
+,	unsigned long seed )
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(sh->pd)
+		free(sh->pd);
+	sh->pd = NULL;
+	if(channels < 1)
+		return SYN123_BAD_FMT;
+	if(rows < 1)
+		rows = 22;
+	if(rows > PINK_MAX_RANDOM_ROWS)
+		rows = PINK_MAX_RANDOM_ROWS;
+	int lanes = (channels+pink_lanes-1)/pink_lanes*pink_lanes;
+	struct pink_data *pd = malloc( sizeof(*pd)
+	+	sizeof(uint32_t)*lanes + sizeof(int32_t)*lanes*(rows+1)
+	+	sizeof(float)*lanes );
+	if(!pd)
+		return SYN123_DOOM;
+	pd->channels = channels;
+	pd->lanes = lanes;
+	pd->rows = rows;
+	pd->index = 0;
+	pd->mask = (1<<rows) - 1;
+	pd->scalar = 1.0f / ((rows + 1) * (1<<(PINK_RANDOM_BITS-1)));
+	pd->seed = (uint32_t*)(pd+1);
+	pd->sum = (int32_t*)(pd->seed+lanes);
+	pd->row = pd->sum + lanes;
+	pd->out = (float*)(pd->row+rows*lanes);
+	// The first channel starts like syn123_setup_pink() for seed zero, the
+	// others from scrambled offsets, never zero.
+	uint32_t base = seed ? (uint32_t)seed : 22222;
+	for(int c=0; c<lanes; ++c)
+	{
+		uint32_t s = base + 0x9e3779b9u*(uint32_t)c;
+		if(c)
+		{
+			s ^= s>>16;
+			s *= 0x85ebca6bu;
+			s ^= s>>13;
+			s *= 0xc2b2ae35u;
+			s ^= s>>16;
+		}
+		pd->seed[c] = s ? s : 22222;
+		pd->sum[c] = 0;
+	}
+	for(int i=0; i<rows*lanes; ++i)
+		pd->row[i] = 0;
+	sh->pd = pd;
+	return SYN123_OK;
+}
+
+int attribute_align_arg
+syn123_multipink(syn123_handle *sh, float *dst, size_t samples)
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(!sh->pd)
+		return SYN123_BAD_FMT;
+	if(!dst)
+		return SYN123_BAD_BUF;
+	struct pink_data *pd = sh->pd;
+	int lanes = pd->lanes;
+	uint32_t * MPG123_RESTRICT seed = pd->seed;
+	int32_t * MPG123_RESTRICT sum = pd->sum;
+	float * MPG123_RESTRICT out = pd->out;
+	for(size_t i=0; i<samples; ++i)
+	{
+		pd->index = (pd->index + 1) & pd->mask;
+		if(pd->index != 0)
+		{
+			int zeros = 0;
+			for(int n = pd->index; !(n & 1); n >>= 1)
+				++zeros;
+			int32_t * MPG123_RESTRICT row = pd->row + zeros*lanes;
+			for(int c=0; c<lanes; ++c)
+			{
+				int32_t r = GenerateRandomNumber(&seed[c]) >> PINK_RANDOM_SHIFT;
+				sum[c] += r - row[c];
+				row[c] = r;
+			}
+		}
+		for(int c=0; c<lanes; ++c)
+		{
+			out[c] = pd->scalar * (sum[c] + (GenerateRandomNumber(&seed[c]) >> PINK_RANDOM_SHIFT));
+		}
+		memcpy(dst, out, sizeof(float)*pd->channels);
+		dst += pd->channels;
+	}
+	return SYN123_OK;
+}
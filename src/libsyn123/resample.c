@@ -0,0 +1,362 @@
+/*
+	resample: libsyn123 streaming resampler
+
+	copyright 2020 by the mpg123 project
+	licensed under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	A polyphase FIR for the rational ratio of the two rates. With
+	outrate/inrate = L/M (reduced), the output samples fall on only L
+	distinct positions between two input samples. For each of these
+	phases, there is a precomputed row of filter coefficients (a
+	Kaiser-windowed sinc for SYN123_RESAMPLE_SINC, the trivial kernels
+	for linear interpolation and drop/repeat). If L is too large for
+	that, a table of fixed phases is used, with linear interpolation of
+	the results from the two neighbouring rows.
+
+	The input is deinterleaved into one buffer per channel that keeps
+	the history the filter needs, so each output is one dot product of
+	contiguous floats. The rows are padded to multiples of 8 taps, which
+	the compiler turns into SIMD code. Each output depends on half the
+	filter length of input samples ahead of it; that is the latency.
+
+	For drift compensation, syn123_resample_skew() changes the step per
+	output sample on the fly. A fine grid of positions (switching to the
+	interpolated table) lets that step follow small deviations from the
+	nominal ratio without losing the filter state.
+*/
+
+#define NO_SMAX
+#define NO_GROW_BUF
+#include "syn123_int.h"
+#include "debug.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Maximum number of phases in a coefficient table.
+enum { maxphases = 256 };
+// Taps in the sinc filter for upsampling, times the ratio for downsampling.
+enum { sinctaps = 64 };
+// Multiple of coefficients to work on in one go.
+enum { tapblock = 8 };
+// Input frames that are deinterleaved in one go.
+enum { inblock = bufblock };
+// Ratios beyond this would need silly filter lengths.
+enum { maxratio = 1024 };
+// Positions between input samples at least for skewed ratios.
+enum { skewphases = 1<<24 };
+// Largest relative deviation from the nominal ratio.
+static const double maxskew = 0.01;
+
+struct resample_data
+{
+	int channels;
+	uint64_t L; // step for each input sample
+	uint64_t M; // step for each output sample
+	uint64_t Mbase; // M without skew
+	int method;
+	double cutoff;
+	uint64_t phase; // position between input samples, 0 <= phase < L
+	size_t phases; // rows in table (plus one if interpolating)
+	int interpolate; // TRUE if phases < L
+	size_t taps; // filter length
+	size_t ntaps; // padded length of one row
+	size_t history; // input samples before the current one
+	size_t ahead; // input samples after the current one
+	size_t bufsize; // size of each channel buffer
+	size_t fill; // samples in channel buffers
+	size_t pos;  // current input sample in channel buffers
+	float *coeff; // (phases+interpolate) rows of ntaps
+	float *buf;   // channels buffers of bufsize
+};
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+	while(b)
+	{
+		uint64_t c = a % b;
+		a = b;
+		b = c;
+	}
+	return a;
+}
+
+// Modified Bessel function of first kind, order zero.
+static double bessel_i0(double x)
+{
+	double sum = 1.;
+	double term = 1.;
+	for(int k=1; k<50; ++k)
+	{
+		term *= (x/(2*k))*(x/(2*k));
+		sum += term;
+		if(term < 1e-12*sum)
+			break;
+	}
+	return sum;
+}
+
+// Fill one row of coefficients for output at position t (0 <= t <= 1)
+// after the current input sample. Tap k reads the input sample at
+// offset k-taps/2+1 from the current one.
+static void compute_row( float *row, int method, size_t taps, size_t ntaps
+,	double t, double cutoff )
+{
+	float *h = row + (ntaps-taps);
+	double sum = 0.;
+	double half = taps/2;
+	double beta = 8.;
+	double i0beta = bessel_i0(beta);
+
+	for(size_t k=0; k<ntaps-taps; ++k)
+		row[k] = 0.;
+	for(size_t k=0; k<taps; ++k)
+	{
+		double tau = (double)k - half + 1 - t;
+		double val;
+		switch(method)
+		{
+			case SYN123_RESAMPLE_DROP:
+				val = (k == (t < 0.5 ? 0 : 1)) ? 1. : 0.;
+			break;
+			case SYN123_RESAMPLE_LINEAR:
+				val = 1. - fabs(tau);
+			break;
+			default:
+			{
+				double x = 2*cutoff*tau;
+				double w = tau/half;
+				val = fabs(x) < 1e-9 ? 1. : sin(M_PI*x)/(M_PI*x);
+				val *= w*w < 1.
+				?	bessel_i0(beta*sqrt(1.-w*w))/i0beta
+				:	0.;
+			}
+		}
+		if(val < 0. && method != SYN123_RESAMPLE_SINC)
+			val = 0.;
+		h[k] = val;
+		sum += val;
+	}
+	// Unity gain for DC in each phase.
+	for(size_t k=0; k<taps; ++k)
+		h[k] /= sum;
+}
+
+int attribute_align_arg
+syn123_setup_resample( syn123_handle *sh, long inrate, long outrate
+,	int channels, int method )
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(sh->rd)
+		free(sh->rd);
+	sh->rd = NULL;
+	if(inrate < 1 || outrate < 1 || channels < 1)
+		return SYN123_BAD_FMT;
+	if( method != SYN123_RESAMPLE_DROP && method != SYN123_RESAMPLE_LINEAR
+	&&	method != SYN123_RESAMPLE_SINC )
+		return SYN123_BAD_RESAMPLE;
+	if(inrate/outrate >= maxratio || outrate/inrate >= maxratio)
+		return SYN123_BAD_RESAMPLE;
+
+	uint64_t g = gcd(inrate, outrate);
+	uint64_t L = outrate/g;
+	uint64_t M = inrate/g;
+	size_t taps = 2;
+	double cutoff = 0.5;
+	if(method == SYN123_RESAMPLE_SINC)
+	{
+		// The transition band of the window is about 0.08, centered
+		// below the lower Nyquist frequency.
+		double ratio = M > L ? (double)M/L : 1.;
+		taps = (size_t)ceil(sinctaps*ratio);
+		taps += taps % 2;
+		cutoff = 0.5/ratio - 0.04/ratio;
+	}
+	size_t ntaps = (taps+tapblock-1)/tapblock*tapblock;
+	int interpolate = L > maxphases;
+	size_t phases = interpolate ? maxphases : L;
+	size_t rows = phases + interpolate;
+	size_t history = taps/2 - 1 + (ntaps-taps);
+	size_t ahead = taps/2;
+	// Room for a block of input and the step over input samples until
+	// the next output, with some extra for a skewed step.
+	size_t bufsize = history + ahead + inblock + M/L + M/L/64 + 2;
+	// No overflow worries with the limited ratio.
+	struct resample_data *rd = malloc( sizeof(*rd)
+	+	(rows*ntaps + channels*bufsize)*sizeof(float) );
+	if(!rd)
+		return SYN123_DOOM;
+	rd->channels = channels;
+	rd->L = L;
+	rd->M = M;
+	rd->Mbase = M;
+	rd->method = method;
+	rd->cutoff = cutoff;
+	rd->phase = 0;
+	rd->phases = phases;
+	rd->interpolate = interpolate;
+	rd->taps = taps;
+	rd->ntaps = ntaps;
+	rd->history = history;
+	rd->ahead = ahead;
+	rd->bufsize = bufsize;
+	rd->coeff = (float*)(rd+1);
+	rd->buf = rd->coeff + rows*ntaps;
+	for(size_t r=0; r<rows; ++r)
+		compute_row( rd->coeff+r*ntaps, method, taps, ntaps
+		,	(double)r/phases, cutoff );
+	// Silence before the first sample.
+	rd->fill = rd->pos = history;
+	for(size_t i=0; i<channels*bufsize; ++i)
+		rd->buf[i] = 0.;
+	debug5( "resample %ld -> %ld: L=%lu M=%lu taps=%lu"
+	,	inrate, outrate, (unsigned long)L, (unsigned long)M
+	,	(unsigned long)taps );
+	sh->rd = rd;
+	return SYN123_OK;
+}
+
+int attribute_align_arg
+syn123_resample_skew(syn123_handle *sh, double skew)
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(!sh->rd || !(fabs(skew) <= maxskew))
+		return SYN123_BAD_RESAMPLE;
+	struct resample_data *rd = sh->rd;
+	if(rd->L < skewphases)
+	{
+		if(!rd->interpolate)
+		{
+			// The exact table only has the positions of the nominal ratio.
+			size_t rows = maxphases + 1;
+			struct resample_data *nrd = malloc( sizeof(*nrd)
+			+	(rows*rd->ntaps + rd->channels*rd->bufsize)*sizeof(float) );
+			if(!nrd)
+				return SYN123_DOOM;
+			*nrd = *rd;
+			nrd->phases = maxphases;
+			nrd->interpolate = 1;
+			nrd->coeff = (float*)(nrd+1);
+			nrd->buf = nrd->coeff + rows*nrd->ntaps;
+			for(size_t r=0; r<rows; ++r)
+				compute_row( nrd->coeff+r*nrd->ntaps, nrd->method, nrd->taps
+				,	nrd->ntaps, (double)r/nrd->phases, nrd->cutoff );
+			memcpy( nrd->buf, rd->buf
+			,	sizeof(float)*rd->channels*rd->bufsize );
+			free(rd);
+			sh->rd = rd = nrd;
+		}
+		uint64_t f = (skewphases + rd->L - 1)/rd->L;
+		rd->L     *= f;
+		rd->Mbase *= f;
+		rd->phase *= f;
+	}
+	rd->M = (uint64_t)((double)rd->Mbase/(1.+skew)+0.5);
+	mdebug("resample skew %g: L=%lu M=%lu", skew
+	,	(unsigned long)rd->L, (unsigned long)rd->M);
+	return SYN123_OK;
+}
+
+size_t attribute_align_arg
+syn123_resample_latency(syn123_handle *sh)
+{
+	return (sh && sh->rd) ? sh->rd->ahead : 0;
+}
+
+size_t attribute_align_arg
+syn123_resample_count(syn123_handle *sh, size_t samples)
+{
+	if(!sh || !sh->rd)
+		return 0;
+	struct resample_data *rd = sh->rd;
+	if(rd->fill + samples <= rd->ahead)
+		return 0;
+	uint64_t start = (uint64_t)rd->pos*rd->L + rd->phase;
+	uint64_t end = ((uint64_t)rd->fill + samples - rd->ahead)*rd->L;
+	return end > start ? (end-start+rd->M-1)/rd->M : 0;
+}
+
+static float dot(const float * MPG123_RESTRICT a, const float * MPG123_RESTRICT b
+,	size_t n)
+{
+	float acc[tapblock] = { 0. };
+	for(size_t i=0; i<n; i+=tapblock)
+		for(int j=0; j<tapblock; ++j)
+			acc[j] += a[i+j]*b[i+j];
+	float sum = 0.;
+	for(int j=0; j<tapblock; ++j)
+		sum += acc[j];
+	return sum;
+}
+
+size_t attribute_align_arg
+syn123_resample( syn123_handle *sh, float * MPG123_RESTRICT dst
+,	float * MPG123_RESTRICT src, size_t samples )
+{
+	if(!sh || !sh->rd || !dst || !src)
+		return 0;
+	struct resample_data *rd = sh->rd;
+	int channels = rd->channels;
+	size_t ntaps = rd->ntaps;
+	size_t outs = 0;
+
+	while(samples)
+	{
+		size_t block = smin(samples, rd->bufsize - rd->fill);
+		for(int c=0; c<channels; ++c)
+		{
+			float *buf = rd->buf + c*rd->bufsize + rd->fill;
+			for(size_t i=0; i<block; ++i)
+				buf[i] = src[i*channels+c];
+		}
+		src += block*channels;
+		samples -= block;
+		rd->fill += block;
+		while(rd->pos + rd->ahead < rd->fill)
+		{
+			size_t start = rd->pos - rd->history;
+			if(rd->interpolate)
+			{
+				uint64_t p = rd->phase*rd->phases;
+				const float *row = rd->coeff + (p/rd->L)*ntaps;
+				float frac = (float)(p % rd->L)/rd->L;
+				for(int c=0; c<channels; ++c)
+				{
+					const float *in = rd->buf + c*rd->bufsize + start;
+					float y0 = dot(row, in, ntaps);
+					float y1 = dot(row+ntaps, in, ntaps);
+					*dst++ = y0 + frac*(y1-y0);
+				}
+			}
+			else
+			{
+				const float *row = rd->coeff + rd->phase*ntaps;
+				for(int c=0; c<channels; ++c)
+					*dst++ = dot(row, rd->buf + c*rd->bufsize + start, ntaps);
+			}
+			++outs;
+			rd->phase += rd->M;
+			rd->pos += rd->phase / rd->L;
+			rd->phase %= rd->L;
+		}
+		// Keep only what is needed for the next outputs. When downsampling
+		// with a short filter, the next one might be beyond all we got.
+		size_t drop = smin(rd->pos - rd->history, rd->fill);
+		size_t keep = rd->fill - drop;
+		if(drop)
+		{
+			for(int c=0; c<channels; ++c)
+			{
+				float *buf = rd->buf + c*rd->bufsize;
+				memmove(buf, buf+drop, keep*sizeof(float));
+			}
+			rd->fill -= drop;
+			rd->pos  -= drop;
+		}
+	}
+	return outs;
+}
@@ -24,6 +24,8 @@
 /* Conversions between native byte order encodings. */
 
 #include "g711_impl.h"
+#define FLOAT16_DECODE
+#include "float16_impl.h"
 
 /* Some trivial conversion functions. No need for another library. */
 
@@ -32,29 +34,18 @@
 // We have symmetric signals with +/- 2^(n-1)-1 in mind, nevertheless
 // clipping the negative side at -2^(n-1) for lossless conversion of
 // any input in integer encoding.
-// There might be possible optimizations. We hope for some auto-vectorization.
-// And also, nowadays, CPUs can do so much while they wait for memory ...
+// This is written without branches (just selections) so that the
+// conversion loops below get auto-vectorized. The result is the same
+// as with the plain if/else of rounding and clipping.
 #define CONV(name, ftype, type, maxval) \
 static type name(ftype d) \
 { \
-	type imax = maxval; \
-	if(isnan(d)) \
-		d = 0.; \
-	d *= imax; \
-	if(d>=0) \
-	{ \
-		d += 0.5; \
-		return d > imax \
-		?	imax \
-		:	(type)d; \
-	} \
-	else \
-	{ \
-		d -= 0.5; \
-		return d < (-imax-1) \
-		?	(-imax-1) \
-		:	(type)d; \
-	} \
+	ftype imax = maxval; \
+	d = isnan(d) ? 0. : d*imax; \
+	d += d >= 0 ? 0.5 : -0.5; \
+	d = d > imax ? imax : d; \
+	d = d < -imax-1 ? -imax-1 : d; \
+	return (type)d; \
 }
 
 /* If there is an actual 24 bit integer with cleared last byte, */
@@ -89,36 +80,323 @@ static double u32_d(uint32_t u)     { return s32_d(CONV_US32(u));   }
 static float alaw_f(unsigned char n){ return s16_f(alaw2linear(n)); }
 static float ulaw_f(unsigned char n){ return s16_f(ulaw2linear(n)); }
 
+/* 3. Directly between 16 and 32 bit, same as going via float. */
+
+static int32_t s16_s32(int16_t n) { return d_s32(s16_f(n));         }
+static int16_t s32_s16(int32_t n) { return f_s16((float)s32_d(n));  }
+
+// The common conversions as loops over fixed blocks. The compiler
+// can vectorize an inner loop with known count without any runtime
+// checks, the rest is handled one by one.
+enum { convblock = 64 };
+
+#define BLOCKCONV(name, dtype, stype, func) \
+static void name( dtype * MPG123_RESTRICT dst \
+,	const stype * MPG123_RESTRICT src, size_t samples ) \
+{ \
+	for(; samples >= convblock; samples -= convblock) \
+	{ \
+		for(int i=0; i<convblock; ++i) \
+			dst[i] = func(src[i]); \
+		dst += convblock; \
+		src += convblock; \
+	} \
+	for(size_t i=0; i<samples; ++i) \
+		dst[i] = func(src[i]); \
+}
+
+BLOCKCONV(conv_float_s16,  int16_t, float,   f_s16)
+BLOCKCONV(conv_double_s16, int16_t, double,  f_s16)
+BLOCKCONV(conv_float_s32,  int32_t, float,   d_s32)
+BLOCKCONV(conv_double_s32, int32_t, double,  d_s32)
+BLOCKCONV(conv_s16_float,  float,   int16_t, s16_f)
+BLOCKCONV(conv_s16_double, double,  int16_t, s16_f)
+BLOCKCONV(conv_s32_float,  float,   int32_t, s32_d)
+BLOCKCONV(conv_s32_double, double,  int32_t, s32_d)
+BLOCKCONV(conv_s16_s32,    int32_t, int16_t, s16_s32)
+BLOCKCONV(conv_s32_s16,    int16_t, int32_t, s32_s16)
+// 16 bit floats keep the scale, double goes through single precision.
+BLOCKCONV(conv_float_f16,   uint16_t, float,    float_to_half)
+BLOCKCONV(conv_double_f16,  uint16_t, double,   float_to_half)
+BLOCKCONV(conv_float_bf16,  uint16_t, float,    float_to_bfloat)
+BLOCKCONV(conv_double_bf16, uint16_t, double,   float_to_bfloat)
+BLOCKCONV(conv_f16_float,   float,    uint16_t, half_to_float)
+BLOCKCONV(conv_f16_double,  double,   uint16_t, half_to_float)
+BLOCKCONV(conv_bf16_float,  float,    uint16_t, bfloat_to_float)
+BLOCKCONV(conv_bf16_double, double,   uint16_t, bfloat_to_float)
+// G.711 encoding works without branches, decoding by table.
+BLOCKCONV(conv_float_ulaw,  unsigned char, float,  f_ulaw)
+BLOCKCONV(conv_double_ulaw, unsigned char, double, f_ulaw)
+BLOCKCONV(conv_float_alaw,  unsigned char, float,  f_alaw)
+BLOCKCONV(conv_double_alaw, unsigned char, double, f_alaw)
+BLOCKCONV(conv_s16_ulaw,    unsigned char, int16_t, linear2ulaw)
+BLOCKCONV(conv_s16_alaw,    unsigned char, int16_t, linear2alaw)
+BLOCKCONV(conv_ulaw_float,  float,   unsigned char, ulaw_f)
+BLOCKCONV(conv_ulaw_double, double,  unsigned char, ulaw_f)
+BLOCKCONV(conv_alaw_float,  float,   unsigned char, alaw_f)
+BLOCKCONV(conv_alaw_double, double,  unsigned char, alaw_f)
+BLOCKCONV(conv_ulaw_s16,    int16_t, unsigned char, ulaw2linear)
+BLOCKCONV(conv_alaw_s16,    int16_t, unsigned char, alaw2linear)
+
+// 24 bit goes over a block of 32 bit values.
+#define BLOCKCONV_TO24(name, stype, conv32) \
+static void name(char *dst, const stype *src, size_t samples) \
+{ \
+	union { int32_t i[convblock]; char c[convblock][4]; } tmp; \
+	while(samples) \
+	{ \
+		size_t block = smin(samples, convblock); \
+		conv32(tmp.i, src, block); \
+		for(size_t i=0; i<block; ++i, dst+=3) \
+			DROP4BYTE(dst, tmp.c[i]); \
+		src += block; \
+		samples -= block; \
+	} \
+}
+
+#define BLOCKCONV_FROM24(name, dtype, conv32) \
+static void name(dtype *dst, const char *src, size_t samples) \
+{ \
+	int32_t tmp[convblock]; \
+	while(samples) \
+	{ \
+		size_t block = smin(samples, convblock); \
+		size_t i = 0; \
+		for(; i<block; ++i, src+=3) \
+		{ \
+			char c[4]; \
+			ADD4BYTE(c, src); \
+			memcpy(tmp+i, c, 4); \
+		} \
+		/* The rest of a short last block is not used, but defined. */ \
+		for(; i<convblock; ++i) \
+			tmp[i] = 0; \
+		conv32(dst, tmp, block); \
+		dst += block; \
+		samples -= block; \
+	} \
+}
+
+BLOCKCONV_TO24(conv_float_s24,    float,  conv_float_s32)
+BLOCKCONV_TO24(conv_double_s24,   double, conv_double_s32)
+BLOCKCONV_FROM24(conv_s24_float,  float,  conv_s32_float)
+BLOCKCONV_FROM24(conv_s24_double, double, conv_s32_double)
+
+// Clipping without branches. With compiler vector extensions, the
+// comparisons give masks that select the result and are summed up as
+// count, 16 bytes at a time. The rest, or all without vectors, uses the
+// same selections in scalar code.
+
+// NaN detection on the bits, as the usual checks are optimized away with
+// -ffast-math (part of the default CFLAGS).
+static inline int nan_float(float x)
+{
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return (bits & 0x7fffffffUL) > 0x7f800000UL;
+}
+
+static inline int nan_double(double x)
+{
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return (bits & 0x7fffffffffffffffULL) > 0x7ff0000000000000ULL;
+}
+
+#define HARD_CLIP(type, x, count) \
+{ \
+	type v = x; \
+	int nan = nan_##type(v); \
+	int hi = v > 1.0; \
+	int lo = v < -1.0; \
+	v = hi ? 1.0 : v; \
+	v = lo ? -1.0 : v; \
+	x = nan ? 0.0 : v; \
+	count += nan | hi | lo; \
+}
+
+// Both curves are computed for each sample and the right one selected.
+// The unused one may be inf, which does not matter. Infinite input is
+// limited first, as -ffast-math may rearrange the curve to inf/inf.
+#define SOFT_CLIP(type, x, count) \
+{ \
+	type v = x; \
+	int nan = nan_##type(v); \
+	int hi = v > h; \
+	int lo = v < l; \
+	type c = v >  1e30 ?  1e30 : v; \
+	c      = c < -1e30 ? -1e30 : c; \
+	type up   =  1. - ww/(w21+c); \
+	type down = -1. + ww/(w21-c); \
+	v = hi ? up : v; \
+	v = lo ? down : v; \
+	x = nan ? 0. : v; \
+	count += nan | hi | lo; \
+}
+
+#define SOFT_CLIP_PARAM(type) \
+	type w = width; \
+	type ww = w*w; \
+	type w21 = 2*w-1.; \
+	type h = 1.-w; \
+	type l = -1+w;
+
+#ifdef HAVE_GCC_VECTORS
+typedef float   clip_vf  __attribute__((vector_size(16)));
+typedef int32_t clip_vfm __attribute__((vector_size(16)));
+typedef double  clip_vd  __attribute__((vector_size(16)));
+typedef int64_t clip_vdm __attribute__((vector_size(16)));
+
+// The same NaN check on the bits of all lanes.
+#define VNAN_clip_vfm(v) \
+	(((clip_vfm)(v) & 0x7fffffff) > 0x7f800000)
+#define VNAN_clip_vdm(v) \
+	(((clip_vdm)(v) & 0x7fffffffffffffffLL) > 0x7ff0000000000000LL)
+
+static inline clip_vf vf_set(float x){ return (clip_vf){x, x, x, x}; }
+static inline clip_vd vd_set(double x){ return (clip_vd){x, x}; }
+
+// Select a where mask m is set, b otherwise.
+#define VSEL(vtype, mtype, m, a, b) \
+	(vtype)(((mtype)(a) & (m)) | ((mtype)(b) & ~(m)))
+
+// The vector loop over p[0] to p[n-1], advancing p and n to the rest.
+// The clip operation sets v and the mask m of clipped values.
+#define CLIP_VECTORS(type, vtype, mtype, vclip) \
+{ \
+	const size_t lanes = sizeof(vtype)/sizeof(type); \
+	mtype vcount = (mtype){0}; \
+	for(; n >= lanes; n -= lanes, p += lanes) \
+	{ \
+		vtype v; \
+		mtype m; \
+		memcpy(&v, p, sizeof(v)); \
+		vclip(vtype, mtype, v, m) \
+		vcount -= m; \
+		memcpy(p, &v, sizeof(v)); \
+	} \
+	for(size_t i=0; i<lanes; ++i) \
+		clipped += vcount[i]; \
+}
+
+// These need the vector one, the soft curve also vh, vl, vww, vw21, vbig.
+#define VHARD_CLIP(vtype, mtype, v, m) \
+{ \
+	mtype nan = VNAN_##mtype(v); \
+	mtype hi = v > one; \
+	mtype lo = v < -one; \
+	v = VSEL(vtype, mtype, hi, one, v); \
+	v = VSEL(vtype, mtype, lo, -one, v); \
+	v = (vtype)((mtype)v & ~nan); \
+	m = nan | hi | lo; \
+}
+
+#define VSOFT_CLIP(vtype, mtype, v, m) \
+{ \
+	mtype nan = VNAN_##mtype(v); \
+	mtype hi = v > vh; \
+	mtype lo = v < vl; \
+	vtype c = VSEL(vtype, mtype, v > vbig, vbig, v); \
+	c = VSEL(vtype, mtype, c < -vbig, -vbig, c); \
+	vtype up   = one - vww/(vw21+c); \
+	vtype down = vww/(vw21-c) - one; \
+	v = VSEL(vtype, mtype, hi, up, v); \
+	v = VSEL(vtype, mtype, lo, down, v); \
+	v = (vtype)((mtype)v & ~nan); \
+	m = nan | hi | lo; \
+}
+
+#define SOFT_CLIP_VPARAM(vtype, vset) \
+	vtype one = vset(1.); \
+	vtype vh = vset(h); \
+	vtype vl = vset(l); \
+	vtype vww = vset(ww); \
+	vtype vw21 = vset(w21); \
+	vtype vbig = vset(1e30);
+#endif
+
+static size_t hard_clip_float(float *p, size_t n)
+{
+	size_t clipped = 0;
+#ifdef HAVE_GCC_VECTORS
+	clip_vf one = vf_set(1.);
+	CLIP_VECTORS(float, clip_vf, clip_vfm, VHARD_CLIP)
+#endif
+	for(size_t i=0; i<n; ++i)
+		HARD_CLIP(float, p[i], clipped)
+	return clipped;
+}
+
+static size_t hard_clip_double(double *p, size_t n)
+{
+	size_t clipped = 0;
+#ifdef HAVE_GCC_VECTORS
+	clip_vd one = vd_set(1.);
+	CLIP_VECTORS(double, clip_vd, clip_vdm, VHARD_CLIP)
+#endif
+	for(size_t i=0; i<n; ++i)
+		HARD_CLIP(double, p[i], clipped)
+	return clipped;
+}
+
+static size_t soft_clip_float(float *p, size_t n, double width)
+{
+	size_t clipped = 0;
+	SOFT_CLIP_PARAM(float)
+#ifdef HAVE_GCC_VECTORS
+	SOFT_CLIP_VPARAM(clip_vf, vf_set)
+	CLIP_VECTORS(float, clip_vf, clip_vfm, VSOFT_CLIP)
+#endif
+	for(size_t i=0; i<n; ++i)
+		SOFT_CLIP(float, p[i], clipped)
+	return clipped;
+}
+
+static size_t soft_clip_double(double *p, size_t n, double width)
+{
+	size_t clipped = 0;
+	SOFT_CLIP_PARAM(double)
+#ifdef HAVE_GCC_VECTORS
+	SOFT_CLIP_VPARAM(clip_vd, vd_set)
+	CLIP_VECTORS(double, clip_vd, clip_vdm, VSOFT_CLIP)
+#endif
+	for(size_t i=0; i<n; ++i)
+		SOFT_CLIP(double, p[i], clipped)
+	return clipped;
+}
+
 size_t attribute_align_arg
 syn123_clip(void *buf, int encoding, size_t samples)
 {
 	if(!buf)
 		return 0;
 
-	size_t clipped = 0;
-	#define CLIPCODE(type) \
-	{ \
-		type *p = buf; \
-		for(size_t i=0; i<samples; ++i) \
-			if(isnan(p[i]))     { p[i] =  0.0; ++clipped; } \
-			else if(p[i] < -1.0){ p[i] = -1.0; ++clipped; } \
-			else if(p[i] > +1.0){ p[i] = +1.0; ++clipped; } \
-	}
 	switch(encoding)
 	{
 		case MPG123_ENC_FLOAT_32:
-			CLIPCODE(float)
-		break;
+			return hard_clip_float(buf, samples);
 		case MPG123_ENC_FLOAT_64:
-			CLIPCODE(double)
-		break;
+			return hard_clip_double(buf, samples);
 	}
-	#undef CLIPCODE
-	return clipped;
+	return 0;
+}
+
+// Integers go through float (double for 32 bit) in blocks on the stack.
+#define SOFT_CLIP_INT(itype, ftype, to_float, from_float) \
+{ \
+	itype *ip = buf; \
+	ftype fbuf[convblock]; \
+	while(samples) \
+	{ \
+		size_t block = smin(samples, convblock); \
+		to_float(fbuf, ip, block); \
+		clipped += soft_clip_##ftype(fbuf, block, width); \
+		from_float(ip, fbuf, block); \
+		ip += block; \
+		samples -= block; \
+	} \
 }
 
-// TODO: Also do that for integer encodings. At least there is
-// some smoothing to get from this even for already clipped material.
 size_t attribute_align_arg
 syn123_soft_clip(void *buf, int encoding, size_t samples, double width)
 {
@@ -126,31 +404,21 @@ syn123_soft_clip(void *buf, int encoding, size_t samples, double width)
 		return 0;
 
 	size_t clipped = 0;
-	#define CLIPCODE(type) \
-	{ \
-		type w = width; \
-		type ww = w*w; \
-		type w21 = 2*w-1.; \
-		type h = 1.-w; \
-		type l = -1+w; \
-		type *p = buf; \
-		for(size_t i=0; i<samples; ++i) \
-		{ \
-			if(isnan(p[i])){   p[i] = 0.;                  ++clipped; } \
-			else if(p[i] > h){ p[i] =  1. - ww/(w21+p[i]); ++clipped; } \
-			else if(p[i] < l){ p[i] = -1. + ww/(w21-p[i]); ++clipped; } \
-		} \
-	}
 	switch(encoding)
 	{
 		case MPG123_ENC_FLOAT_32:
-			CLIPCODE(float)
+			clipped = soft_clip_float(buf, samples, width);
 		break;
 		case MPG123_ENC_FLOAT_64:
-			CLIPCODE(double)
+			clipped = soft_clip_double(buf, samples, width);
+		break;
+		case MPG123_ENC_SIGNED_16:
+			SOFT_CLIP_INT(int16_t, float, conv_s16_float, conv_float_s16)
+		break;
+		case MPG123_ENC_SIGNED_32:
+			SOFT_CLIP_INT(int32_t, double, conv_s32_double, conv_double_s32)
 		break;
 	}
-	#undef CLIPCODE
 	return clipped;
 }
 
@@ -162,32 +430,23 @@ syn123_soft_clip(void *buf, int encoding, size_t samples, double width)
 switch(dst_enc) \
 { \
 	case MPG123_ENC_SIGNED_16: \
-		for(; tsrc!=tend; ++tsrc, tdest+=2) \
-			*(int16_t*)tdest = f_s16(*tsrc); \
+		conv_##type##_s16((void*)tdest, tsrc, samples); \
 	break; \
 	case MPG123_ENC_SIGNED_32: \
-		for(; tsrc!=tend; ++tsrc, tdest+=4) \
-			*(int32_t*)tdest = d_s32(*tsrc); \
+		conv_##type##_s32((void*)tdest, tsrc, samples); \
 	break; \
 	case MPG123_ENC_SIGNED_24: \
-		for(; tsrc!=tend; ++tsrc, tdest+=3) \
-		{ \
-			union { int32_t i; char c[4]; } tmp; \
-			tmp.i = d_s32(*tsrc); \
-			DROP4BYTE(tdest, tmp.c); \
-		} \
+		conv_##type##_s24(tdest, tsrc, samples); \
 	break; \
 	case MPG123_ENC_SIGNED_8: \
 		for(; tsrc!=tend; ++tsrc, tdest+=1) \
 			*(int8_t*)tdest = f_s8(*tsrc); \
 	break; \
 	case MPG123_ENC_ULAW_8: \
-		for(; tsrc!=tend; ++tsrc, tdest+=1) \
-			*(unsigned char*)tdest = f_ulaw(*tsrc); \
+		conv_##type##_ulaw((void*)tdest, tsrc, samples); \
 	break; \
 	case MPG123_ENC_ALAW_8: \
-		for(; tsrc!=tend; ++tsrc, tdest+=1) \
-			*(unsigned char*)tdest = f_alaw(*tsrc); \
+		conv_##type##_alaw((void*)tdest, tsrc, samples); \
 	break; \
 	case MPG123_ENC_UNSIGNED_8: \
 		for(; tsrc!=tend; ++tsrc, tdest+=1) \
@@ -217,6 +476,12 @@ switch(dst_enc) \
 		for(; tsrc!=tend; ++tsrc, tdest+=8) \
 			*(double*)tdest = *tsrc; \
 	break; \
+	case MPG123_ENC_FLOAT_16: \
+		conv_##type##_f16((void*)tdest, tsrc, samples); \
+	break; \
+	case MPG123_ENC_BFLOAT_16: \
+		conv_##type##_bf16((void*)tdest, tsrc, samples); \
+	break; \
 	default: \
 		return SYN123_BAD_CONV; \
 }}
@@ -226,32 +491,23 @@ switch(dst_enc) \
 switch(src_enc) \
 { \
 	case MPG123_ENC_SIGNED_16: \
-		for(; tdest!=tend; ++tdest, tsrc+=2) \
-			*tdest = s16_f(*(int16_t*)tsrc); \
+		conv_s16_##type(tdest, (void*)tsrc, samples); \
 	break; \
 	case MPG123_ENC_SIGNED_32: \
-		for(; tdest!=tend; ++tdest, tsrc+=4) \
-			*tdest = s32_d(*(int32_t*)tsrc); \
+		conv_s32_##type(tdest, (void*)tsrc, samples); \
 	break; \
 	case MPG123_ENC_SIGNED_24: \
-		for(; tdest!=tend; ++tdest, tsrc+=3) \
-		{ \
-			union { int32_t i; char c[4]; } tmp; \
-			ADD4BYTE(tmp.c, tsrc); \
-			*tdest = s32_d(tmp.i); \
-		} \
+		conv_s24_##type(tdest, tsrc, samples); \
 	break; \
 	case MPG123_ENC_SIGNED_8: \
 		for(; tdest!=tend; ++tdest, tsrc+=1) \
 			*tdest = s8_f(*(int8_t*)tsrc); \
 	break; \
 	case MPG123_ENC_ULAW_8: \
-		for(; tdest!=tend; ++tdest, tsrc+=1) \
-			*tdest = ulaw_f(*(unsigned char*)tsrc); \
+		conv_ulaw_##type(tdest, (void*)tsrc, samples); \
 	break; \
 	case MPG123_ENC_ALAW_8: \
-		for(; tdest!=tend; ++tdest, tsrc+=1) \
-			*tdest = alaw_f(*(unsigned char*)tsrc); \
+		conv_alaw_##type(tdest, (void*)tsrc, samples); \
 	break; \
 	case MPG123_ENC_UNSIGNED_8: \
 		for(; tdest!=tend; ++tdest, tsrc+=1) \
@@ -281,6 +537,12 @@ switch(src_enc) \
 		for(; tdest!=tend; ++tdest, tsrc+=4) \
 			*tdest = *(double*)tsrc; \
 	break; \
+	case MPG123_ENC_FLOAT_16: \
+		conv_f16_##type(tdest, (void*)tsrc, samples); \
+	break; \
+	case MPG123_ENC_BFLOAT_16: \
+		conv_bf16_##type(tdest, (void*)tsrc, samples); \
+	break; \
 	default: \
 		return SYN123_BAD_CONV; \
 }}
@@ -299,6 +561,238 @@ syn123_mixenc(int src_enc, int dst_enc)
 		:	MPG123_ENC_FLOAT_32;	
 }
 
+// The 16 bit floats meet the other encodings via single precision, in
+// blocks on the stack, not needing a handle.
+static int conv_via_float( char *dst, int dst_enc, char *src, int src_enc
+,	size_t samples )
+{
+	float tmp[bufblock];
+	size_t srcframe = MPG123_SAMPLESIZE(src_enc);
+	size_t dstframe = MPG123_SAMPLESIZE(dst_enc);
+	while(samples)
+	{
+		size_t block = smin(samples, bufblock);
+		int err = syn123_conv( tmp, MPG123_ENC_FLOAT_32, sizeof(tmp)
+		,	src, src_enc, srcframe*block, NULL, NULL );
+		if(!err)
+			err = syn123_conv( dst, dst_enc, dstframe*block
+			,	tmp, MPG123_ENC_FLOAT_32, sizeof(float)*block, NULL, NULL );
+		if(err)
+			return err;
+		dst += dstframe*block;
+		src += srcframe*block;
+		samples -= block;
+	}
+	return SYN123_OK;
+}
+
+// Dither noise from independent xorshift generators, one for each value
+// of a block, so that the compiler can vectorize the lot. Flat TPDF noise
+// is the sum of two uniform values, the highpass variant the difference
+// of uniform values for consecutive samples of the same channel. Both are
+// triangular over +/- one LSB, the latter pushing the noise power up
+// towards half the sampling rate, whatever that is.
+
+struct dither_data
+{
+	int depth; // bits, outputs of that and less get dithered
+	int shaped; // highpass
+	int channels;
+	uint32_t seed[convblock];
+	float *hist; // channels+convblock uniform values for shaping
+};
+
+static void dither_uniform(uint32_t * MPG123_RESTRICT seed, float * MPG123_RESTRICT u)
+{
+	for(int i=0; i<convblock; ++i)
+	{
+		uint32_t s = seed[i];
+		s ^= s<<13;
+		s ^= s>>17;
+		s ^= s<<5;
+		seed[i] = s;
+		u[i] = (float)(s>>8)*(1.f/16777216.f);
+	}
+}
+
+// Noise in units of the LSB for up to convblock samples.
+static void dither_noise(struct dither_data *dd, float *noise, size_t n)
+{
+	if(dd->shaped)
+	{
+		float *h = dd->hist;
+		int c = dd->channels;
+		dither_uniform(dd->seed, h+c);
+		for(size_t i=0; i<n; ++i)
+			noise[i] = h[c+i] - h[i];
+		memmove(h, h+n, sizeof(float)*c);
+	} else
+	{
+		float u[convblock];
+		dither_uniform(dd->seed, noise);
+		dither_uniform(dd->seed, u);
+		for(size_t i=0; i<n; ++i)
+			noise[i] += u[i] - 1.f;
+	}
+}
+
+// Bits of integer output to dither for, zero for anything else.
+static int dither_bits(int enc)
+{
+	if( enc & MPG123_ENC_FLOAT || enc == MPG123_ENC_ULAW_8
+	||  enc == MPG123_ENC_ALAW_8 )
+		return 0;
+	return 8*MPG123_SAMPLESIZE(enc);
+}
+
+// Does the conversion lose enough resolution to dither?
+static int dither_needed(syn123_handle *sh, int dst_enc, int src_enc)
+{
+	if(!sh || !sh->dd)
+		return FALSE;
+	int bits = dither_bits(dst_enc);
+	return bits && bits <= sh->dd->depth
+	&&	(src_enc & MPG123_ENC_FLOAT || 8*MPG123_SAMPLESIZE(src_enc) > bits);
+}
+
+// The main case of reduction to 16 bit with the noise added on the fly.
+#define DITHERCONV(name, stype) \
+static void name( int16_t * MPG123_RESTRICT dst \
+,	const stype * MPG123_RESTRICT src, size_t samples, struct dither_data *dd ) \
+{ \
+	float noise[convblock]; \
+	const stype lsb = 1./32767.; \
+	while(samples) \
+	{ \
+		size_t n = smin(samples, convblock); \
+		dither_noise(dd, noise, n); \
+		if(n == convblock) \
+			for(int i=0; i<convblock; ++i) \
+				dst[i] = f_s16(src[i] + lsb*noise[i]); \
+		else \
+			for(size_t i=0; i<n; ++i) \
+				dst[i] = f_s16(src[i] + lsb*noise[i]); \
+		dst += n; \
+		src += n; \
+		samples -= n; \
+	} \
+}
+
+DITHERCONV(conv_float_s16_dither,  float)
+DITHERCONV(conv_double_s16_dither, double)
+
+#define DITHER_ADD(type, from) \
+{ \
+	type *t = (type*)tmp; \
+	const type *s = from; \
+	const type lsb = 1./((INT32_C(1)<<(bits-1))-1); \
+	for(size_t j=0; j<block; j+=convblock) \
+	{ \
+		size_t n = smin(convblock, block-j); \
+		dither_noise(dd, noise, n); \
+		for(size_t i=0; i<n; ++i) \
+			t[j+i] = s[j+i] + lsb*noise[i]; \
+	} \
+}
+
+// Anything else gets the noise added to a block in floating point
+// before the plain conversion, integer input going to double first.
+static int dither_conv( char *dst, int dst_enc, char *src, int src_enc
+,	size_t samples, struct dither_data *dd )
+{
+	if(dst_enc == MPG123_ENC_SIGNED_16 && src_enc == MPG123_ENC_FLOAT_32)
+	{
+		conv_float_s16_dither((void*)dst, (void*)src, samples, dd);
+		return SYN123_OK;
+	}
+	if(dst_enc == MPG123_ENC_SIGNED_16 && src_enc == MPG123_ENC_FLOAT_64)
+	{
+		conv_double_s16_dither((void*)dst, (void*)src, samples, dd);
+		return SYN123_OK;
+	}
+	double tmp[bufblock];
+	float noise[convblock];
+	int bits = dither_bits(dst_enc);
+	int mixenc = src_enc == MPG123_ENC_FLOAT_32
+	?	MPG123_ENC_FLOAT_32
+	:	MPG123_ENC_FLOAT_64;
+	size_t srcframe = MPG123_SAMPLESIZE(src_enc);
+	size_t dstframe = MPG123_SAMPLESIZE(dst_enc);
+	while(samples)
+	{
+		size_t block = smin(samples, bufblock);
+		int err = SYN123_OK;
+		if(src_enc == MPG123_ENC_FLOAT_32)
+			DITHER_ADD(float, (float*)src)
+		else if(src_enc == MPG123_ENC_FLOAT_64)
+			DITHER_ADD(double, (double*)src)
+		else
+		{
+			err = syn123_conv( tmp, MPG123_ENC_FLOAT_64, sizeof(tmp)
+			,	src, src_enc, srcframe*block, NULL, NULL );
+			if(!err)
+				DITHER_ADD(double, tmp)
+		}
+		if(!err)
+			err = syn123_conv( dst, dst_enc, dstframe*block
+			,	tmp, mixenc, MPG123_SAMPLESIZE(mixenc)*block, NULL, NULL );
+		if(err)
+			return err;
+		dst += dstframe*block;
+		src += srcframe*block;
+		samples -= block;
+	}
+	return SYN123_OK;
+}
+
+int attribute_align_arg
+syn123_setup_dither(syn123_handle *sh, int dither, int channels)
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(sh->dd)
+		free(sh->dd);
+	sh->dd = NULL;
+	int depth, shaped;
+	switch(dither)
+	{
+		case SYN123_DITHER_NONE:
+			return SYN123_OK;
+		case SYN123_DITHER_TPDF_16BIT:    depth = 16; shaped = FALSE; break;
+		case SYN123_DITHER_TPDF_24BIT:    depth = 24; shaped = FALSE; break;
+		case SYN123_DITHER_HP_TPDF_16BIT: depth = 16; shaped = TRUE;  break;
+		case SYN123_DITHER_HP_TPDF_24BIT: depth = 24; shaped = TRUE;  break;
+		default:
+			return SYN123_BAD_DITHER;
+	}
+	if(channels < 1)
+		return SYN123_BAD_FMT;
+	struct dither_data *dd = malloc( sizeof(*dd)
+	+	sizeof(float)*((size_t)channels+convblock) );
+	if(!dd)
+		return SYN123_DOOM;
+	dd->depth = depth;
+	dd->shaped = shaped;
+	dd->channels = channels;
+	dd->hist = (float*)(dd+1);
+	// Scrambled lane numbers as seeds, never zero, and a few rounds to
+	// get rid of what is left of their similarity.
+	for(int i=0; i<convblock; ++i)
+	{
+		uint32_t s = 0x9e3779b9u*(uint32_t)(i+1);
+		s ^= s>>16;
+		s *= 0x85ebca6bu;
+		s ^= s>>13;
+		dd->seed[i] = s ? s : 2463534242u;
+	}
+	for(int i=0; i<4; ++i)
+		dither_uniform(dd->seed, dd->hist);
+	for(int i=0; i<channels; ++i)
+		dd->hist[i] = 0.5f;
+	sh->dd = dd;
+	return SYN123_OK;
+}
+
 int attribute_align_arg
 syn123_conv( void * MPG123_RESTRICT dst, int dst_enc, size_t dst_size
 ,	void * MPG123_RESTRICT src, int src_enc, size_t src_bytes
@@ -321,24 +815,41 @@ syn123_conv( void * MPG123_RESTRICT dst, int dst_enc, size_t dst_size
 		return SYN123_BAD_SIZE;
 	if(src_enc == dst_enc)
 		memcpy(dst, src, samples*dstframe);
-	else if(src_enc & MPG123_ENC_FLOAT)
+	else if(dither_needed(sh, dst_enc, src_enc))
 	{
-		if(src_enc == MPG123_ENC_FLOAT_64)
-			FROM_FLT(double)
-		else if(src_enc == MPG123_ENC_FLOAT_32)
-			FROM_FLT(float)
-		else
-			return SYN123_BAD_CONV;
+		int err = dither_conv(dst, dst_enc, src, src_enc, samples, sh->dd);
+		if(err)
+			return err;
 	}
-	else if(dst_enc & MPG123_ENC_FLOAT)
+	else if(src_enc == MPG123_ENC_FLOAT_64)
+		FROM_FLT(double)
+	else if(src_enc == MPG123_ENC_FLOAT_32)
+		FROM_FLT(float)
+	else if(dst_enc == MPG123_ENC_FLOAT_64)
+		TO_FLT(double)
+	else if(dst_enc == MPG123_ENC_FLOAT_32)
+		TO_FLT(float)
+	else if((src_enc|dst_enc) & (MPG123_ENC_FLOAT_16|MPG123_ENC_BFLOAT_16))
 	{
-		if(dst_enc == MPG123_ENC_FLOAT_64)
-			TO_FLT(double)
-		else if(dst_enc == MPG123_ENC_FLOAT_32)
-			TO_FLT(float)
-		else
-			return SYN123_BAD_CONV;
+		int err = conv_via_float(dst, dst_enc, src, src_enc, samples);
+		if(err)
+			return err;
 	}
+	else if((src_enc|dst_enc) & MPG123_ENC_FLOAT)
+		return SYN123_BAD_CONV;
+	else if(src_enc == MPG123_ENC_SIGNED_16 && dst_enc == MPG123_ENC_SIGNED_32)
+		conv_s16_s32(dst, src, samples);
+	else if(src_enc == MPG123_ENC_SIGNED_32 && dst_enc == MPG123_ENC_SIGNED_16)
+		conv_s32_s16(dst, src, samples);
+	// G.711 is defined on 16 bit integers, no need to go via float.
+	else if(src_enc == MPG123_ENC_SIGNED_16 && dst_enc == MPG123_ENC_ULAW_8)
+		conv_s16_ulaw(dst, src, samples);
+	else if(src_enc == MPG123_ENC_SIGNED_16 && dst_enc == MPG123_ENC_ALAW_8)
+		conv_s16_alaw(dst, src, samples);
+	else if(src_enc == MPG123_ENC_ULAW_8 && dst_enc == MPG123_ENC_SIGNED_16)
+		conv_ulaw_s16(dst, src, samples);
+	else if(src_enc == MPG123_ENC_ALAW_8 && dst_enc == MPG123_ENC_SIGNED_16)
+		conv_alaw_s16(dst, src, samples);
 	else if(sh)
 	{
 		char *cdst = dst;
@@ -415,12 +926,127 @@ syn123_conv( void * MPG123_RESTRICT dst, int dst_enc, size_t dst_size
 	} \
 }
 
+#ifndef SYN123_NO_CASES
+// Sample sizes of 2, 4 and 8 bytes with 2, 4, 6 or 8 channels move as
+// integers, each sample with a memcpy() that is a plain (unaligned) load
+// or store. With fixed channel count and channel pointers in locals, the
+// compiler vectorizes the loops over samples with shuffles.
+#define TYPEDMULTIPLY(name, type, channels) \
+static void name(char * MPG123_RESTRICT dst, const char * MPG123_RESTRICT src \
+,	size_t count) \
+{ \
+	for(size_t i=0; i<count; ++i) \
+	{ \
+		type v; \
+		memcpy(&v, src+i*sizeof(type), sizeof(type)); \
+		for(int j=0; j<channels; ++j) \
+			memcpy(dst+(i*channels+j)*sizeof(type), &v, sizeof(type)); \
+	} \
+}
+
+#define TYPEDINTERLEAVE(name, type, channels) \
+static void name(char * MPG123_RESTRICT dst, void ** MPG123_RESTRICT src \
+,	size_t count) \
+{ \
+	const char *s[channels]; \
+	for(int j=0; j<channels; ++j) \
+		s[j] = src[j]; \
+	for(size_t i=0; i<count; ++i) \
+		for(int j=0; j<channels; ++j) \
+			memcpy( dst+(i*channels+j)*sizeof(type), s[j]+i*sizeof(type) \
+			,	sizeof(type) ); \
+}
+
+// The channel buffers could overlap as far as the compiler knows, so
+// deinterleaving fills one at a time from a block of the input.
+#define TYPEDDEINTERLEAVE(name, type, channels) \
+static void name##_plane( char * MPG123_RESTRICT d \
+,	const char * MPG123_RESTRICT s, size_t count ) \
+{ \
+	for(size_t i=0; i<count; ++i) \
+		memcpy(d+i*sizeof(type), s+i*channels*sizeof(type), sizeof(type)); \
+} \
+static void name(void ** MPG123_RESTRICT dst, const char * MPG123_RESTRICT src \
+,	size_t count) \
+{ \
+	for(size_t i=0; i<count; i+=bufblock) \
+	{ \
+		size_t block = smin(count-i, bufblock); \
+		for(int j=0; j<channels; ++j) \
+			name##_plane( (char*)dst[j]+i*sizeof(type) \
+			,	src+(i*channels+j)*sizeof(type), block ); \
+	} \
+}
+
+#define TYPEDCHANNELS(kind, type, bits) \
+TYPED##kind(kind##_##bits##_2, type, 2) \
+TYPED##kind(kind##_##bits##_4, type, 4) \
+TYPED##kind(kind##_##bits##_6, type, 6) \
+TYPED##kind(kind##_##bits##_8, type, 8)
+
+#define TYPEDSIZES(kind) \
+TYPEDCHANNELS(kind, uint16_t, 16) \
+TYPEDCHANNELS(kind, uint32_t, 32) \
+TYPEDCHANNELS(kind, uint64_t, 64)
+
+TYPEDSIZES(MULTIPLY)
+TYPEDSIZES(INTERLEAVE)
+TYPEDSIZES(DEINTERLEAVE)
+
+// Pick the one for the channels and sample size, return TRUE if there is.
+#define TYPEDCASE(kind, channels, samplesize, dst, src, count) \
+switch(samplesize*16+channels) \
+{ \
+	case 2*16+2: kind##_16_2(dst, src, count); return TRUE; \
+	case 2*16+4: kind##_16_4(dst, src, count); return TRUE; \
+	case 2*16+6: kind##_16_6(dst, src, count); return TRUE; \
+	case 2*16+8: kind##_16_8(dst, src, count); return TRUE; \
+	case 4*16+2: kind##_32_2(dst, src, count); return TRUE; \
+	case 4*16+4: kind##_32_4(dst, src, count); return TRUE; \
+	case 4*16+6: kind##_32_6(dst, src, count); return TRUE; \
+	case 4*16+8: kind##_32_8(dst, src, count); return TRUE; \
+	case 8*16+2: kind##_64_2(dst, src, count); return TRUE; \
+	case 8*16+4: kind##_64_4(dst, src, count); return TRUE; \
+	case 8*16+6: kind##_64_6(dst, src, count); return TRUE; \
+	case 8*16+8: kind##_64_8(dst, src, count); return TRUE; \
+} \
+return FALSE;
+
+static int typed_multiply( void * MPG123_RESTRICT dst, void * MPG123_RESTRICT src
+,	int channels, size_t samplesize, size_t samplecount )
+{
+	if(channels > 8 || samplesize > 8)
+		return FALSE;
+	TYPEDCASE(MULTIPLY, channels, samplesize, dst, src, samplecount)
+}
+
+static int typed_interleave( void * MPG123_RESTRICT dst
+,	void ** MPG123_RESTRICT src, int channels, size_t samplesize
+,	size_t samplecount )
+{
+	if(channels > 8 || samplesize > 8)
+		return FALSE;
+	TYPEDCASE(INTERLEAVE, channels, samplesize, dst, src, samplecount)
+}
+
+static int typed_deinterleave( void ** MPG123_RESTRICT dst
+,	void * MPG123_RESTRICT src, int channels, size_t samplesize
+,	size_t samplecount )
+{
+	if(channels > 8 || samplesize > 8)
+		return FALSE;
+	TYPEDCASE(DEINTERLEAVE, channels, samplesize, dst, src, samplecount)
+}
+#endif
+
 /* Special case of multiplying a mono stream. */
 void attribute_align_arg
 syn123_mono2many( void * MPG123_RESTRICT dst, void * MPG123_RESTRICT src
 , int channels, size_t samplesize, size_t samplecount )
 {
 #ifndef SYN123_NO_CASES
+	if(typed_multiply(dst, src, channels, samplesize, samplecount))
+		return;
 	switch(channels)
 	{
 		case 1:
@@ -476,11 +1102,13 @@ void attribute_align_arg
 syn123_interleave(void * MPG123_RESTRICT dst, void ** MPG123_RESTRICT src
 ,	int channels, size_t samplesize, size_t samplecount)
 {
-#ifndef SYN123_NO_CASEs
+#ifndef SYN123_NO_CASES
+	if(typed_interleave(dst, src, channels, samplesize, samplecount))
+		return;
 	switch(channels)
 	{
 		case 1:
-			memcpy(dst, src, samplesize*samplecount);
+			memcpy(dst, src[0], samplesize*samplecount);
 		break;
 		case 2:
 			switch(samplesize)
@@ -533,6 +1161,8 @@ syn123_deinterleave(void ** MPG123_RESTRICT dst, void * MPG123_RESTRICT src
 ,	int channels, size_t samplesize, size_t samplecount)
 {
 #ifndef SYN123_NO_CASES
+	if(typed_deinterleave(dst, src, channels, samplesize, samplecount))
+		return;
 	switch(channels)
 	{
 		case 1:
@@ -639,12 +1269,300 @@ syn123_deinterleave(void ** MPG123_RESTRICT dst, void * MPG123_RESTRICT src
 	MIX_CODE(type, src_channels, dst_channels)
 #endif
 
+// Prepared mixing of float data for the common channel setups. The
+// matrix is converted to float once and, for the shapes with a kernel,
+// arranged as coefficient vectors for a block of PCM frames that fills
+// whole vectors on both sides. The source vectors are shuffled to have
+// the input sample for each output position. That is used by
+// syn123_mixer() with the matrix stored in the handle and also by
+// syn123_mix() for float data, preparing the few coefficients on the
+// stack.
+
+enum mix_shape
+{
+	mix_generic = 0
+,	mix_1to2
+,	mix_2to1
+,	mix_2to6
+,	mix_2to8
+};
+
+// The biggest matrix with a kernel is 2 to 8 channels.
+enum { mix_kernel_coefs = 16, mix_vector_coefs = 32 };
+
+struct mix_data
+{
+	int dst_channels;
+	int src_channels;
+	enum mix_shape shape;
+	float coef[mix_vector_coefs]; // vectors of factors, by shape
+	float *matrix; // (dst_channels,src_channels), after the struct
+};
+
+static enum mix_shape mix_shape(int dst_channels, int src_channels)
+{
+	if(src_channels == 1 && dst_channels == 2)
+		return mix_1to2;
+	if(src_channels == 2) switch(dst_channels)
+	{
+		case 1: return mix_2to1;
+		case 6: return mix_2to6;
+		case 8: return mix_2to8;
+	}
+	return mix_generic;
+}
+
+// Fill in the float matrix and the coefficient vectors, md->matrix
+// pointing to storage for dst_channels*src_channels values.
+static void mix_prepare( struct mix_data *md, int dst_channels
+,	int src_channels, const double *mixmatrix )
+{
+	float *c = md->coef;
+	md->dst_channels = dst_channels;
+	md->src_channels = src_channels;
+	md->shape = mix_shape(dst_channels, src_channels);
+	for(int i=0; i<dst_channels*src_channels; ++i)
+		md->matrix[i] = (float)mixmatrix[i];
+#define M(dc,sc) md->matrix[SYN123_IOFF(dc,sc,src_channels)]
+	switch(md->shape)
+	{
+		case mix_1to2: // frames 0 to 3 of one vector as x0 x0 x1 x1, x2 x2 x3 x3
+			for(int i=0; i<4; ++i)
+				c[i] = M(i%2,0);
+		break;
+		case mix_2to1: // left and right of four frames
+			for(int i=0; i<4; ++i)
+			{
+				c[i]   = M(0,0);
+				c[4+i] = M(0,1);
+			}
+		break;
+		case mix_2to6:
+		case mix_2to8: // two frames make 12 or 16 outputs
+			for(int i=0; i<2*dst_channels; ++i)
+			{
+				int v = i/4;
+				c[8*v+i%4]   = M(i%dst_channels,0);
+				c[8*v+4+i%4] = M(i%dst_channels,1);
+			}
+		break;
+		default:
+		break;
+	}
+#undef M
+}
+
+#define MIX_TAIL(scc,dcc) \
+	for(size_t i=0; i<samples; ++i) \
+		for(int dc=0; dc<dcc; ++dc) \
+		{ \
+			float sum = 0; \
+			for(int sc=0; sc<scc; ++sc) \
+				sum += matrix[SYN123_IOFF(dc,sc,scc)] * src[SYN123_IOFF(i,sc,scc)]; \
+			if(silence) \
+				dst[SYN123_IOFF(i,dc,dcc)] = sum; \
+			else \
+				dst[SYN123_IOFF(i,dc,dcc)] += sum; \
+		}
+
+#ifdef HAVE_GCC_VECTORS
+typedef float mix_vf __attribute__((vector_size(16)));
+typedef int32_t mix_vi __attribute__((vector_size(16)));
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12)
+#define MIX_SHUF(a, b, i, j, k, l) __builtin_shufflevector((a), (b), i, j, k, l)
+#else
+#define MIX_SHUF(a, b, i, j, k, l) __builtin_shuffle((a), (b), (mix_vi){i, j, k, l})
+#endif
+
+static inline mix_vf mix_load(const float *p)
+{
+	mix_vf v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void mix_store(float *p, mix_vf v, int silence)
+{
+	if(!silence)
+		v += mix_load(p);
+	memcpy(p, &v, sizeof(v));
+}
+
+// Each kernel works on whole blocks and returns the frames done.
+static inline size_t mix_kernel_1to2( float * MPG123_RESTRICT dst
+,	const float * MPG123_RESTRICT src, const float *c, size_t samples
+,	int silence )
+{
+	mix_vf m = mix_load(c);
+	size_t blocks = samples/4;
+	for(size_t b=0; b<blocks; ++b, src+=4, dst+=8)
+	{
+		mix_vf x = mix_load(src);
+		mix_store(dst,   MIX_SHUF(x, x, 0, 0, 1, 1)*m, silence);
+		mix_store(dst+4, MIX_SHUF(x, x, 2, 2, 3, 3)*m, silence);
+	}
+	return 4*blocks;
+}
+
+static inline size_t mix_kernel_2to1( float * MPG123_RESTRICT dst
+,	const float * MPG123_RESTRICT src, const float *c, size_t samples
+,	int silence )
+{
+	mix_vf ml = mix_load(c);
+	mix_vf mr = mix_load(c+4);
+	size_t blocks = samples/4;
+	for(size_t b=0; b<blocks; ++b, src+=8, dst+=4)
+	{
+		mix_vf x = mix_load(src);
+		mix_vf y = mix_load(src+4);
+		mix_store( dst, MIX_SHUF(x, y, 0, 2, 4, 6)*ml
+		+	MIX_SHUF(x, y, 1, 3, 5, 7)*mr, silence );
+	}
+	return 4*blocks;
+}
+
+static inline size_t mix_kernel_2to6( float * MPG123_RESTRICT dst
+,	const float * MPG123_RESTRICT src, const float *c, size_t samples
+,	int silence )
+{
+	mix_vf ml0 = mix_load(c),    mr0 = mix_load(c+4);
+	mix_vf ml1 = mix_load(c+8),  mr1 = mix_load(c+12);
+	mix_vf ml2 = mix_load(c+16), mr2 = mix_load(c+20);
+	size_t blocks = samples/2;
+	for(size_t b=0; b<blocks; ++b, src+=4, dst+=12)
+	{
+		mix_vf x = mix_load(src);
+		mix_store( dst, MIX_SHUF(x, x, 0, 0, 0, 0)*ml0
+		+	MIX_SHUF(x, x, 1, 1, 1, 1)*mr0, silence );
+		mix_store( dst+4, MIX_SHUF(x, x, 0, 0, 2, 2)*ml1
+		+	MIX_SHUF(x, x, 1, 1, 3, 3)*mr1, silence );
+		mix_store( dst+8, MIX_SHUF(x, x, 2, 2, 2, 2)*ml2
+		+	MIX_SHUF(x, x, 3, 3, 3, 3)*mr2, silence );
+	}
+	return 2*blocks;
+}
+
+static inline size_t mix_kernel_2to8( float * MPG123_RESTRICT dst
+,	const float * MPG123_RESTRICT src, const float *c, size_t samples
+,	int silence )
+{
+	mix_vf ml0 = mix_load(c),    mr0 = mix_load(c+4);
+	mix_vf ml1 = mix_load(c+8),  mr1 = mix_load(c+12);
+	size_t blocks = samples/2;
+	for(size_t b=0; b<blocks; ++b, src+=4, dst+=16)
+	{
+		mix_vf x = mix_load(src);
+		mix_vf l = MIX_SHUF(x, x, 0, 0, 0, 0);
+		mix_vf r = MIX_SHUF(x, x, 1, 1, 1, 1);
+		mix_store(dst,   l*ml0 + r*mr0, silence);
+		mix_store(dst+4, l*ml1 + r*mr1, silence);
+		l = MIX_SHUF(x, x, 2, 2, 2, 2);
+		r = MIX_SHUF(x, x, 3, 3, 3, 3);
+		mix_store(dst+8,  l*ml0 + r*mr0, silence);
+		mix_store(dst+12, l*ml1 + r*mr1, silence);
+	}
+	return 2*blocks;
+}
+
+#define MIX_KERNEL(name, scc, dcc) \
+	{ \
+		size_t done = silence \
+		?	name(dst, src, md->coef, samples, 1) \
+		:	name(dst, src, md->coef, samples, 0); \
+		dst += done*dcc; \
+		src += done*scc; \
+		samples -= done; \
+	} \
+	MIX_TAIL(scc,dcc)
+#else
+#define MIX_KERNEL(name, scc, dcc) \
+	MIX_TAIL(scc,dcc)
+#endif
+
+static void mix_prepared( struct mix_data *md, float * MPG123_RESTRICT dst
+,	const float * MPG123_RESTRICT src, size_t samples, int silence )
+{
+	const float *matrix = md->matrix;
+	debug1("mix_prepared shape %i", md->shape);
+	switch(md->shape)
+	{
+		case mix_1to2:
+			MIX_KERNEL(mix_kernel_1to2, 1, 2)
+		break;
+		case mix_2to1:
+			MIX_KERNEL(mix_kernel_2to1, 2, 1)
+		break;
+		case mix_2to6:
+			MIX_KERNEL(mix_kernel_2to6, 2, 6)
+		break;
+		case mix_2to8:
+			MIX_KERNEL(mix_kernel_2to8, 2, 8)
+		break;
+		default:
+		{
+			// The plain mixing code, just without the conversions of factors.
+			const float *mixmatrix = matrix;
+			int src_channels = md->src_channels;
+			int dst_channels = md->dst_channels;
+			if(silence)
+				memset(dst, 0, sizeof(float)*dst_channels*samples);
+			SYN123_MIX_FUNC(float)
+		}
+	}
+}
+
+int attribute_align_arg
+syn123_setup_mix( syn123_handle *sh, int dst_channels, int src_channels
+,	const double *mixmatrix )
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(sh->md)
+		free(sh->md);
+	sh->md = NULL;
+	if(src_channels < 1 || dst_channels < 1)
+		return SYN123_BAD_FMT;
+	if(!mixmatrix)
+		return SYN123_BAD_BUF;
+	struct mix_data *md = malloc( sizeof(*md)
+	+	sizeof(float)*(size_t)dst_channels*src_channels );
+	if(!md)
+		return SYN123_DOOM;
+	md->matrix = (float*)(md+1);
+	mix_prepare(md, dst_channels, src_channels, mixmatrix);
+	sh->md = md;
+	return SYN123_OK;
+}
+
+int attribute_align_arg
+syn123_mixer( syn123_handle *sh, float * MPG123_RESTRICT dst
+,	const float * MPG123_RESTRICT src, size_t samples, int silence )
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(!sh->md)
+		return SYN123_BAD_FMT;
+	if(!dst || !src)
+		return SYN123_BAD_BUF;
+	mix_prepared(sh->md, dst, src, samples, silence);
+	return SYN123_OK;
+}
+
 static void syn123_mix_f32( float * MPG123_RESTRICT dst, int dst_channels
 ,	float * MPG123_RESTRICT src, int src_channels
 ,	const double * MPG123_RESTRICT mixmatrix
 ,	size_t samples )
 {
 	debug("syn123_mix_f32");
+	if(mix_shape(dst_channels, src_channels) != mix_generic)
+	{
+		struct mix_data md;
+		float matrix[mix_kernel_coefs];
+		md.matrix = matrix;
+		mix_prepare(&md, dst_channels, src_channels, mixmatrix);
+		mix_prepared(&md, dst, src, samples, 0);
+		return;
+	}
 	SYN123_MIX_FUNC(float)
 }
 
@@ -743,6 +1661,269 @@ syn123_mix( void * MPG123_RESTRICT dst, int dst_enc, int dst_channels
 	}
 }
 
+// The processing chain: conversion to float, any number of mixing,
+// amplification and clipping stages and conversion to the output
+// encoding, done block by block through the two halves of the work
+// buffer, so that each sample goes in and out of memory only once.
+
+enum chain_op
+{
+	chain_mix = 0
+,	chain_amp
+,	chain_clip
+,	chain_soft_clip
+};
+
+struct chain_stage
+{
+	enum chain_op op;
+	int channels; // after the stage
+	float volume, offset; // amp
+	double width; // soft clip
+	struct mix_data md; // mix, matrix in the storage after the chain
+	size_t matrix; // offset of the float matrix in that storage
+};
+
+struct chain_data
+{
+	int dst_enc;
+	int src_enc;
+	int src_channels;
+	int block; // PCM frames per round, fitting the most channels
+	int count;
+	size_t floats; // size of the matrix storage
+	struct chain_stage stage[SYN123_CHAIN_STAGES];
+};
+
+// Channels at the end of the chain so far.
+static int chain_channels(struct chain_data *cd)
+{
+	return cd->count ? cd->stage[cd->count-1].channels : cd->src_channels;
+}
+
+// Frames of the given channel count in one half of the work buffer.
+static int chain_block(syn123_handle *sh, int channels)
+{
+	return (int)(sizeof(sh->workbuf[0])/(sizeof(float)*channels));
+}
+
+int attribute_align_arg
+syn123_setup_chain( syn123_handle *sh, int dst_enc, int src_enc
+,	int channels )
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(sh->cd)
+		free(sh->cd);
+	sh->cd = NULL;
+	if(channels < 1 || chain_block(sh, channels) < 1)
+		return SYN123_BAD_FMT;
+	if(!MPG123_SAMPLESIZE(dst_enc) || !MPG123_SAMPLESIZE(src_enc))
+		return SYN123_BAD_ENC;
+	struct chain_data *cd = malloc(sizeof(*cd));
+	if(!cd)
+		return SYN123_DOOM;
+	cd->dst_enc = dst_enc;
+	cd->src_enc = src_enc;
+	cd->src_channels = channels;
+	cd->block = chain_block(sh, channels);
+	cd->count = 0;
+	cd->floats = 0;
+	sh->cd = cd;
+	return SYN123_OK;
+}
+
+// Append a stage, with the last channel count unless it is a mix.
+static struct chain_stage* chain_add(syn123_handle *sh, enum chain_op op)
+{
+	struct chain_data *cd = sh->cd;
+	if(cd->count >= SYN123_CHAIN_STAGES)
+		return NULL;
+	struct chain_stage *st = cd->stage + cd->count;
+	st->op = op;
+	st->channels = chain_channels(cd);
+	++cd->count;
+	return st;
+}
+
+int attribute_align_arg
+syn123_chain_mix( syn123_handle *sh, int dst_channels
+,	const double *mixmatrix )
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(!sh->cd || dst_channels < 1 || chain_block(sh, dst_channels) < 1)
+		return SYN123_BAD_FMT;
+	if(!mixmatrix)
+		return SYN123_BAD_BUF;
+	if(sh->cd->count >= SYN123_CHAIN_STAGES)
+		return SYN123_BAD_SIZE;
+	int src_channels = chain_channels(sh->cd);
+	size_t floats = sh->cd->floats + (size_t)dst_channels*src_channels;
+	struct chain_data *cd = realloc(sh->cd, sizeof(*cd)+sizeof(float)*floats);
+	if(!cd)
+		return SYN123_DOOM;
+	sh->cd = cd;
+	// The matrices moved along.
+	for(int i=0; i<cd->count; ++i)
+		if(cd->stage[i].op == chain_mix)
+			cd->stage[i].md.matrix = (float*)(cd+1) + cd->stage[i].matrix;
+	struct chain_stage *st = chain_add(sh, chain_mix);
+	st->channels = dst_channels;
+	st->matrix = cd->floats;
+	st->md.matrix = (float*)(cd+1) + st->matrix;
+	mix_prepare(&st->md, dst_channels, src_channels, mixmatrix);
+	cd->floats = floats;
+	if(chain_block(sh, dst_channels) < cd->block)
+		cd->block = chain_block(sh, dst_channels);
+	return SYN123_OK;
+}
+
+int attribute_align_arg
+syn123_chain_amp(syn123_handle *sh, double volume, double offset)
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(!sh->cd)
+		return SYN123_BAD_FMT;
+	struct chain_stage *st = chain_add(sh, chain_amp);
+	if(!st)
+		return SYN123_BAD_SIZE;
+	st->volume = (float)volume;
+	st->offset = (float)offset;
+	return SYN123_OK;
+}
+
+int attribute_align_arg
+syn123_chain_clip(syn123_handle *sh)
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(!sh->cd)
+		return SYN123_BAD_FMT;
+	return chain_add(sh, chain_clip) ? SYN123_OK : SYN123_BAD_SIZE;
+}
+
+int attribute_align_arg
+syn123_chain_soft_clip(syn123_handle *sh, double width)
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(!sh->cd)
+		return SYN123_BAD_FMT;
+	struct chain_stage *st = chain_add(sh, chain_soft_clip);
+	if(!st)
+		return SYN123_BAD_SIZE;
+	st->width = width;
+	return SYN123_OK;
+}
+
+// Same as syn123_amp() on float, in place or not.
+static void chain_amp_float( float *y, const float *x, size_t n
+,	float v, float o )
+{
+	for(; n >= convblock; n -= convblock, x += convblock, y += convblock)
+		for(int i=0; i<convblock; ++i)
+			y[i] = v * (x[i] + o);
+	for(size_t i=0; i<n; ++i)
+		y[i] = v * (x[i] + o);
+}
+
+int attribute_align_arg
+syn123_chain( syn123_handle *sh, void * MPG123_RESTRICT dst, size_t dst_size
+,	void * MPG123_RESTRICT src, size_t samples, size_t *dst_bytes
+,	size_t *clipped )
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(!sh->cd)
+		return SYN123_BAD_FMT;
+	if(!dst || !src)
+		return SYN123_BAD_BUF;
+	struct chain_data *cd = sh->cd;
+	int channels = chain_channels(cd);
+	size_t srcframe = MPG123_SAMPLESIZE(cd->src_enc)*cd->src_channels;
+	size_t dstframe = MPG123_SAMPLESIZE(cd->dst_enc)*channels;
+	if(samples > dst_size/dstframe)
+		return SYN123_BAD_SIZE;
+	float *buf[2] = { (float*)sh->workbuf[0], (float*)sh->workbuf[1] };
+	char *cdst = dst;
+	char *csrc = src;
+	size_t clips = 0;
+	int err = SYN123_OK;
+	while(samples)
+	{
+		size_t block = smin(samples, cd->block);
+		// Float input is read in place by the first stage, anything else is
+		// converted to have a block to work on.
+		const float *in = NULL;
+		float *x = NULL;
+		if(cd->src_enc == MPG123_ENC_FLOAT_32)
+			in = (const float*)csrc;
+		else
+		{
+			err = syn123_conv( buf[0], MPG123_ENC_FLOAT_32, sizeof(sh->workbuf[0])
+			,	csrc, cd->src_enc, srcframe*block, NULL, NULL );
+			if(err)
+				break;
+			in = x = buf[0];
+		}
+		for(int s=0; s<cd->count; ++s)
+		{
+			struct chain_stage *st = cd->stage+s;
+			float *other = x == buf[0] ? buf[1] : buf[0];
+			size_t n = block*st->channels;
+			switch(st->op)
+			{
+				case chain_mix:
+				{
+					// The last mix writes float output directly.
+					float *y = s == cd->count-1 && cd->dst_enc == MPG123_ENC_FLOAT_32
+					?	(float*)cdst
+					:	other;
+					mix_prepared(&st->md, y, in, block, TRUE);
+					in = x = y;
+				}
+				break;
+				case chain_amp:
+					if(!x)
+						x = other;
+					chain_amp_float(x, in, n, st->volume, st->offset);
+					in = x;
+				break;
+				case chain_clip:
+				case chain_soft_clip:
+					if(!x)
+					{
+						x = other;
+						memcpy(x, in, sizeof(float)*n);
+						in = x;
+					}
+					clips += st->op == chain_clip
+					?	hard_clip_float(x, n)
+					:	soft_clip_float(x, n, st->width);
+				break;
+			}
+		}
+		if(in != (const float*)cdst)
+		{
+			err = syn123_conv( cdst, cd->dst_enc, dstframe*block
+			,	(void*)in, MPG123_ENC_FLOAT_32, sizeof(float)*block*channels
+			,	NULL, sh );
+			if(err)
+				break;
+		}
+		cdst += dstframe*block;
+		csrc += srcframe*block;
+		samples -= block;
+	}
+	if(dst_bytes)
+		*dst_bytes = (size_t)(cdst-(char*)dst);
+	if(clipped)
+		*clipped = clips;
+	return err;
+}
+
 /* All the byte-swappery for those little big endian boxes. */
 
 #include "swap_bytes_impl.h"
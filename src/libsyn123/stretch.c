@@ -0,0 +1,315 @@
+/*
+	stretch: libsyn123 time stretching without change of pitch
+
+	copyright 2026 by the mpg123 project
+	licensed under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Waveform similarity overlap-add (WSOLA): The output is made of frames of
+	20 ms with a Hann window, overlapping by half, so each one adds 10 ms of
+	output. The input position of the next frame nominally advances by the
+	speed times that, but is moved by up to 10 ms in either direction to
+	where its start looks most like what followed the previous frame in the
+	input. That keeps the periodicity of voices and tones across the seams
+	without any spectral processing, which is good for speech at the usual
+	speed-listening factors.
+
+	The search works on a mono mix with a normalized cross-correlation over
+	the overlap, first on a coarse grid of positions, then around the best
+	one. Those dot products over contiguous floats are the bulk of the work
+	and use compiler vector extensions where available.
+*/
+
+#define NO_SMAX
+#define NO_GROW_BUF
+#include "syn123_int.h"
+#include "debug.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Floats in one vector for the correlation.
+enum { lanes = 8 };
+// Grid of the coarse search.
+enum { coarse = 4 };
+// Fixed point positions, to count output exactly in advance.
+enum { fracbits = 16 };
+
+struct stretch_data
+{
+	int channels;
+	size_t hop;     // output per frame, half the frame length
+	size_t seek;    // search range to either side of the nominal position
+	size_t size;    // capacity of the input buffer in samples
+	size_t fill;    // samples in the input buffer
+	int64_t step;   // input advance per frame, fixed point
+	int64_t next;   // nominal position of the next frame, fixed point
+	size_t prev;    // position of the last frame
+	int started;
+	float *window;  // 2*hop
+	float *in;      // size*channels
+	float *mono;    // size
+	float *olap;    // hop*channels, second half of the last frame
+};
+
+int attribute_align_arg
+syn123_setup_stretch(syn123_handle *sh, long rate, int channels, double speed)
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(sh->sd)
+		free(sh->sd);
+	sh->sd = NULL;
+	if(rate < 1000 || rate > 1000000 || channels < 1)
+		return SYN123_BAD_FMT;
+	if(!(speed >= SYN123_STRETCH_MIN && speed <= SYN123_STRETCH_MAX))
+		return SYN123_BAD_SPEED;
+	// 10 ms, whole vectors for the correlation.
+	size_t hop = ((size_t)rate/100+lanes-1)/lanes*lanes;
+	// The input needed at once goes back by the largest step and the search
+	// range before the next frame and ahead by the search range and the frame
+	// length, 8 hops. Twice that leaves room for new input.
+	size_t size = 16*hop;
+	struct stretch_data *sd = malloc( sizeof(*sd) + sizeof(float)*(2*hop
+	+	size*channels + size + hop*channels) );
+	if(!sd)
+		return SYN123_DOOM;
+	sd->channels = channels;
+	sd->hop = hop;
+	sd->seek = hop;
+	sd->size = size;
+	sd->fill = 0;
+	sd->next = 0;
+	sd->prev = 0;
+	sd->started = FALSE;
+	sd->window = (float*)(sd+1);
+	sd->in = sd->window + 2*hop;
+	sd->mono = sd->in + size*channels;
+	sd->olap = sd->mono + size;
+	// Periodic Hann, the overlapping halves add up to one.
+	for(size_t i=0; i<2*hop; ++i)
+		sd->window[i] = (float)(0.5 - 0.5*cos(M_PI*i/hop));
+	sh->sd = sd;
+	return syn123_stretch_speed(sh, speed);
+}
+
+int attribute_align_arg
+syn123_stretch_speed(syn123_handle *sh, double speed)
+{
+	if(!sh)
+		return SYN123_BAD_HANDLE;
+	if(!sh->sd || !(speed >= SYN123_STRETCH_MIN && speed <= SYN123_STRETCH_MAX))
+		return SYN123_BAD_SPEED;
+	sh->sd->step = (int64_t)(speed*sh->sd->hop*((int64_t)1<<fracbits)+0.5);
+	return SYN123_OK;
+}
+
+// Is the input for the frame at the given nominal position there?
+static int frame_ready(struct stretch_data *sd, int64_t next, size_t fill)
+{
+	return (size_t)(next>>fracbits) + sd->seek + 2*sd->hop <= fill;
+}
+
+size_t attribute_align_arg
+syn123_stretch_count(syn123_handle *sh, size_t samples)
+{
+	if(!sh || !sh->sd)
+		return 0;
+	struct stretch_data *sd = sh->sd;
+	size_t fill = sd->fill + samples;
+	size_t frames = 0;
+	for(int64_t next = sd->next; frame_ready(sd, next, fill); next += sd->step)
+		++frames;
+	return frames*sd->hop;
+}
+
+size_t attribute_align_arg
+syn123_stretch_latency(syn123_handle *sh)
+{
+	if(!sh || !sh->sd)
+		return 0;
+	return sh->sd->seek + 2*sh->sd->hop;
+}
+
+#ifdef HAVE_GCC_VECTORS
+typedef float stretch_vf __attribute__((vector_size(lanes*sizeof(float))));
+
+// Cross-correlation of a and b and energy of a, over n (a multiple of
+// lanes) samples.
+static void correlate( const float *a, const float *b, size_t n
+,	float *cross, float *energy )
+{
+	stretch_vf c = {0., 0., 0., 0., 0., 0., 0., 0.};
+	stretch_vf e = c;
+	for(size_t i=0; i<n; i+=lanes)
+	{
+		stretch_vf x, y;
+		memcpy(&x, a+i, sizeof(x));
+		memcpy(&y, b+i, sizeof(y));
+		c += x*y;
+		e += x*x;
+	}
+	float cs = 0.;
+	float es = 0.;
+	for(int j=0; j<lanes; ++j)
+	{
+		cs += c[j];
+		es += e[j];
+	}
+	*cross = cs;
+	*energy = es;
+}
+#else
+static void correlate( const float *a, const float *b, size_t n
+,	float *cross, float *energy )
+{
+	float c[lanes];
+	float e[lanes];
+	for(int j=0; j<lanes; ++j)
+		c[j] = e[j] = 0.;
+	for(size_t i=0; i<n; i+=lanes)
+		for(int j=0; j<lanes; ++j)
+		{
+			c[j] += a[i+j]*b[i+j];
+			e[j] += a[i+j]*a[i+j];
+		}
+	float cs = 0.;
+	float es = 0.;
+	for(int j=0; j<lanes; ++j)
+	{
+		cs += c[j];
+		es += e[j];
+	}
+	*cross = cs;
+	*energy = es;
+}
+#endif
+
+// Similarity of the candidate at pos with the reference, as the squared
+// normalized correlation with its sign, avoiding a square root.
+static float similarity(struct stretch_data *sd, size_t pos, const float *ref)
+{
+	float cross, energy;
+	correlate(sd->mono+pos, ref, sd->hop, &cross, &energy);
+	return cross*fabsf(cross)/(energy+1e-20f);
+}
+
+// Input position for the frame at nominal base that continues the
+// last frame best.
+static size_t best_match(struct stretch_data *sd, size_t base)
+{
+	const float *ref = sd->mono + sd->prev + sd->hop;
+	size_t lo = base > sd->seek ? base-sd->seek : 0;
+	size_t hi = base + sd->seek;
+	size_t best = base;
+	float bestsim = similarity(sd, base, ref);
+	for(size_t pos=lo; pos<=hi; pos+=coarse)
+	{
+		float sim = similarity(sd, pos, ref);
+		if(sim > bestsim)
+		{
+			bestsim = sim;
+			best = pos;
+		}
+	}
+	size_t flo = best > lo+coarse-1 ? best-(coarse-1) : lo;
+	size_t fhi = best+coarse-1 < hi ? best+coarse-1 : hi;
+	size_t center = best;
+	for(size_t pos=flo; pos<=fhi; ++pos)
+	{
+		if(pos == center)
+			continue;
+		float sim = similarity(sd, pos, ref);
+		if(sim > bestsim)
+		{
+			bestsim = sim;
+			best = pos;
+		}
+	}
+	return best;
+}
+
+// Add the next frame to the output, hop samples.
+static void stretch_frame(struct stretch_data *sd, float *out)
+{
+	size_t hop = sd->hop;
+	int channels = sd->channels;
+	size_t base = (size_t)(sd->next>>fracbits);
+	// The very first frame starts the stream as it is, a step equal to the
+	// hop would find the natural continuation anyway.
+	size_t pos = !sd->started || sd->step == ((int64_t)hop<<fracbits)
+	?	base
+	:	best_match(sd, base);
+	const float *x = sd->in + pos*channels;
+	if(sd->started)
+	{
+		for(size_t i=0; i<hop; ++i)
+			for(int c=0; c<channels; ++c)
+				out[i*channels+c] = sd->olap[i*channels+c]
+				+	sd->window[i]*x[i*channels+c];
+	}
+	else
+		memcpy(out, x, sizeof(float)*hop*channels);
+	x += hop*channels;
+	for(size_t i=0; i<hop; ++i)
+		for(int c=0; c<channels; ++c)
+			sd->olap[i*channels+c] = sd->window[hop+i]*x[i*channels+c];
+	sd->prev = pos;
+	sd->next += sd->step;
+	sd->started = TRUE;
+}
+
+// Drop input that no frame needs anymore.
+static void stretch_drop(struct stretch_data *sd)
+{
+	if(!sd->started)
+		return;
+	size_t base = (size_t)(sd->next>>fracbits);
+	size_t keep = base > sd->seek ? base-sd->seek : 0;
+	if(sd->prev+sd->hop < keep)
+		keep = sd->prev+sd->hop;
+	keep = smin(keep, sd->fill);
+	if(!keep)
+		return;
+	memmove( sd->in, sd->in+keep*sd->channels
+	,	sizeof(float)*(sd->fill-keep)*sd->channels );
+	memmove(sd->mono, sd->mono+keep, sizeof(float)*(sd->fill-keep));
+	sd->fill -= keep;
+	sd->next -= (int64_t)keep<<fracbits;
+	sd->prev -= keep;
+}
+
+size_t attribute_align_arg
+syn123_stretch( syn123_handle *sh, float * MPG123_RESTRICT dst
+,	const float * MPG123_RESTRICT src, size_t samples )
+{
+	if(!sh || !sh->sd || !dst || (samples && !src))
+		return 0;
+	struct stretch_data *sd = sh->sd;
+	int channels = sd->channels;
+	size_t outfill = 0;
+	do
+	{
+		stretch_drop(sd);
+		size_t block = smin(samples, sd->size-sd->fill);
+		memcpy( sd->in+sd->fill*channels, src
+		,	sizeof(float)*block*channels );
+		for(size_t i=0; i<block; ++i)
+		{
+			float sum = 0.;
+			for(int c=0; c<channels; ++c)
+				sum += src[i*channels+c];
+			sd->mono[sd->fill+i] = sum;
+		}
+		sd->fill += block;
+		src += block*channels;
+		samples -= block;
+		while(frame_ready(sd, sd->next, sd->fill))
+		{
+			stretch_frame(sd, dst+outfill*channels);
+			outfill += sd->hop;
+		}
+	} while(samples);
+	return outfill;
+}
@@ -23,6 +23,8 @@
 // allow the compiler to know our loops.
 // An enum is the best integer constant you can define in plain C.
 enum { bufblock = 512 };
+// Fixed inner loop length for vectorized wave computation.
+enum { waveblock = 64 };
 
 struct syn123_wave
 {
@@ -41,8 +43,28 @@ struct syn123_sweep
 	size_t d; // duration
 	size_t post; // amount of samples after sweep to finish period
 	double endphase; // phase for continuing, just after sweep end
+	int fracint; // phases small enough for phasefrac32()
+	// exp sweep: growth of frequency from the start of a block on
+	double growth[waveblock];
 };
 
+// Resampler state, one block of memory (see resample.c).
+struct resample_data;
+// Loudness measurement, also one block (see loudness.c).
+struct loudness_data;
+// Prepared mixing matrix, one block (see sampleconv.c).
+struct mix_data;
+// Biquad cascade with state, one block (see filter.c).
+struct filter_data;
+// Time stretcher with its input buffer, one block (see stretch.c).
+struct stretch_data;
+// Fused processing chain, one block (see sampleconv.c).
+struct chain_data;
+// Dither noise generator state, one block (see sampleconv.c).
+struct dither_data;
+// Pink noise for many channels, one block (see pinknoise.c).
+struct pink_data;
+
 struct syn123_struct
 {
 	// Temporary storage in internal precision.
@@ -71,6 +93,14 @@ struct syn123_struct
 	size_t maxbuf;  // maximum period buffer size in bytes
 	size_t samples; // samples (PCM frames) in period buffer
 	size_t offset;  // offset in buffer for extraction helper
+	struct resample_data *rd; // resampler, simply free()d
+	struct loudness_data *ld; // loudness measurement, simply free()d
+	struct mix_data *md; // mixing matrix, simply free()d
+	struct filter_data *fd; // filter, simply free()d
+	struct stretch_data *sd; // time stretcher, simply free()d
+	struct chain_data *cd; // processing chain, simply free()d
+	struct dither_data *dd; // dither for conversions, simply free()d
+	struct pink_data *pd; // multi-channel pink noise, simply free()d
 };
 
 #ifndef NO_SMIN
@@ -13,6 +13,12 @@
 #include "syn123_int.h"
 #include "debug.h"
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+enum { ampblock = 64 };
+
 static const double db_min = -SYN123_DB_LIMIT;
 static const double db_max =  SYN123_DB_LIMIT;
 
@@ -53,9 +59,18 @@ syn123_amp( void* buf, int encoding, size_t samples
 	switch(encoding)
 	{
 		// This is close to FMA, but only that. It's FAM.
+		// Blocks of known length get vectorized by the compiler.
 		#define AMP_LOOP(type) \
+		{ \
+			type *p = buf; \
+			type v = volume; \
+			type o = offset; \
+			for(; samples >= ampblock; samples -= ampblock, p += ampblock) \
+				for(int i=0; i<ampblock; ++i) \
+					p[i] = v * (p[i] + o); \
 			for(size_t i=0; i<samples; ++i) \
-				((type*)buf)[i] = (type)volume * (((type*)buf)[i] + (type)offset);
+				p[i] = v * (p[i] + o); \
+		}
 		case MPG123_ENC_FLOAT_32:
 			AMP_LOOP(float)
 			return SYN123_OK;
@@ -106,3 +121,107 @@ syn123_amp( void* buf, int encoding, size_t samples
 		return SYN123_OK;
 	}
 }
+
+// Equal-power curve: the gains for fading out and in have squares adding
+// up to one, so uncorrelated signals keep their loudness in the middle.
+// The gains are computed per block of frames and then expanded over the
+// channels, leaving a plain multiply-add over the samples to vectorize.
+int attribute_align_arg
+syn123_crossfade( void *dst, void *src, int encoding, int channels
+,	size_t frames, size_t pos, size_t length, syn123_handle *sh )
+{
+	if(!dst || !src)
+		return SYN123_BAD_BUF;
+	if(channels < 1 || channels > ampblock || !length)
+		return SYN123_BAD_FMT;
+	switch(encoding)
+	{
+		#define FADE_LOOP(type) \
+		{ \
+			type *d = dst; \
+			type *s = src; \
+			int fblock = ampblock/channels; \
+			while(frames) \
+			{ \
+				type gout[ampblock]; \
+				type gin[ampblock]; \
+				int block = (int)smin(frames, fblock); \
+				int n = block*channels; \
+				for(int f=0; f<block; ++f) \
+				{ \
+					double x = pos+f < length \
+					?	M_PI/2*(pos+f)/length \
+					:	M_PI/2; \
+					type go = cos(x); \
+					type gi = sin(x); \
+					for(int c=0; c<channels; ++c) \
+					{ \
+						gout[f*channels+c] = go; \
+						gin[f*channels+c]  = gi; \
+					} \
+				} \
+				for(int i=0; i<n; ++i) \
+					d[i] = gout[i]*d[i] + gin[i]*s[i]; \
+				d += n; \
+				s += n; \
+				pos += block; \
+				frames -= block; \
+			} \
+		}
+		case MPG123_ENC_FLOAT_32:
+			FADE_LOOP(float)
+			return SYN123_OK;
+		case MPG123_ENC_FLOAT_64:
+			FADE_LOOP(double)
+			return SYN123_OK;
+		#undef FADE_LOOP
+	}
+	if(!sh)
+		return SYN123_BAD_ENC;
+	else
+	{
+		char *cdst = dst;
+		char *csrc = src;
+		int mixenc = syn123_mixenc(encoding, encoding);
+		int mixframe = MPG123_SAMPLESIZE(mixenc)*channels;
+		int inframe = MPG123_SAMPLESIZE(encoding)*channels;
+		if(!mixenc || !mixframe || !inframe)
+			return SYN123_BAD_CONV;
+		// One half of the workbuf for each signal.
+		int mbufblock = bufblock*sizeof(double)/mixframe;
+		while(frames)
+		{
+			int block = (int)smin(frames, mbufblock);
+			int err = syn123_conv(
+				sh->workbuf[0], mixenc, sizeof(sh->workbuf[0])
+			,	cdst, encoding, inframe*block
+			,	NULL, NULL );
+			if(!err)
+				err = syn123_conv(
+					sh->workbuf[1], mixenc, sizeof(sh->workbuf[1])
+				,	csrc, encoding, inframe*block
+				,	NULL, NULL );
+			if(!err)
+			{
+				err = syn123_crossfade( sh->workbuf[0], sh->workbuf[1], mixenc
+				,	channels, block, pos, length, NULL );
+				if(err)
+					return err;
+				err = syn123_conv(
+					cdst, encoding, inframe*block
+				,	sh->workbuf[0], mixenc, mixframe*block
+				,	NULL, NULL );
+			}
+			if(err)
+			{
+				mdebug("conv error: %i", err);
+				return SYN123_BAD_CONV;
+			}
+			cdst += block*inframe;
+			csrc += block*inframe;
+			pos += block;
+			frames -= block;
+		}
+		return SYN123_OK;
+	}
+}
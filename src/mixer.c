@@ -0,0 +1,370 @@
+/*
+	mixer: decoding several streams at once into one output
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Each stream has its own decoder, set up to produce stereo float samples
+	at the mixing rate (resampling as needed). Playback goes in rounds: all
+	streams decode a block of audio, spread over a pool of threads, and the
+	main thread adds the blocks up with syn123_mix(), applying the volume per
+	stream, before playing the sum. The output converts the float samples to
+	what the device takes. Streams are only added and removed between rounds,
+	so the threads just need to agree on who decodes which stream.
+*/
+
+#include "mixer.h"
+#include "syn123.h"
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
+#include "debug.h"
+
+/* PCM frames per round, about 0.1 seconds. */
+#define MIX_BLOCK 4096
+#define MIX_CHANNELS 2
+#define MIX_FRAME (MIX_CHANNELS*sizeof(float))
+#define MAX_THREADS 64
+
+struct stream
+{
+	int id;
+	char *name;
+	mpg123_handle *mh;
+	float *buf;
+	size_t fill; /* frames decoded in this round */
+	double volume;
+	int done;
+};
+
+static struct stream **streams = NULL;
+static int count = 0;
+static int next_id = 1;
+static long mixrate = 0;
+static float *mixbuf = NULL;
+static int started = FALSE;
+
+#ifndef NO_THREADS
+static pthread_t *workers = NULL;
+static int workers_n = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int pick = 0; /* next stream to decode in this round */
+static int busy = 0; /* streams not done in this round */
+static int quit = FALSE;
+#endif
+
+/* Changes to the list of streams happen between rounds, but idle workers
+   still look at it. */
+static void lock_streams(void)
+{
+#ifndef NO_THREADS
+	pthread_mutex_lock(&lock);
+#endif
+}
+
+static void unlock_streams(void)
+{
+#ifndef NO_THREADS
+	/* Workers only look for work in a round. */
+	pick = count;
+	pthread_mutex_unlock(&lock);
+#endif
+}
+
+static void decode_stream(struct stream *s)
+{
+	unsigned char *p = (unsigned char*)s->buf;
+	size_t bytes = MIX_BLOCK*MIX_FRAME;
+	size_t got = 0;
+
+	while(!s->done && got < bytes)
+	{
+		size_t done = 0;
+		int err = mpg123_read(s->mh, p+got, bytes-got, &done);
+		got += done;
+		if(err == MPG123_NEW_FORMAT || err == MPG123_OK)
+			continue;
+		if(err != MPG123_DONE && !param.quiet)
+			error2("%s: %s", s->name, mpg123_strerror(s->mh));
+		s->done = TRUE;
+	}
+	s->fill = got/MIX_FRAME;
+}
+
+#ifndef NO_THREADS
+static void *worker(void *arg)
+{
+	pthread_mutex_lock(&lock);
+	for(;;)
+	{
+		struct stream *s;
+		while(!quit && pick >= count)
+			pthread_cond_wait(&work_cond, &lock);
+		if(quit)
+			break;
+		s = streams[pick++];
+		pthread_mutex_unlock(&lock);
+		decode_stream(s);
+		pthread_mutex_lock(&lock);
+		if(!--busy)
+			pthread_cond_signal(&done_cond);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+#endif
+
+static void decode_round(void)
+{
+#ifndef NO_THREADS
+	if(workers_n)
+	{
+		pthread_mutex_lock(&lock);
+		pick = 0;
+		busy = count;
+		pthread_cond_broadcast(&work_cond);
+		while(busy)
+			pthread_cond_wait(&done_cond, &lock);
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+#endif
+	{
+		int i;
+		for(i=0; i<count; ++i)
+			decode_stream(streams[i]);
+	}
+}
+
+int mixer_init(long rate, long threads)
+{
+	if(mixbuf)
+		return 0;
+	mixrate = rate > 0 ? rate : 44100;
+	if(!(mixbuf = malloc(MIX_BLOCK*MIX_FRAME)))
+		return -1;
+#ifndef NO_THREADS
+#ifdef _SC_NPROCESSORS_ONLN
+	if(threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if(threads <= 0)
+		threads = 2;
+	if(threads > MAX_THREADS)
+		threads = MAX_THREADS;
+	/* With a single thread, the main thread decodes itself. */
+	if(threads > 1)
+	{
+		if(!(workers = malloc(sizeof(*workers)*threads)))
+			return -1;
+		quit = FALSE;
+		for(workers_n=0; workers_n<threads; ++workers_n)
+			if(pthread_create(workers+workers_n, NULL, worker, NULL))
+				break;
+	}
+	debug1("mixer with %i threads", workers_n);
+#endif
+	return 0;
+}
+
+static void free_stream(struct stream *s)
+{
+	if(!s)
+		return;
+	if(s->mh)
+	{
+		mpg123_close(s->mh);
+		mpg123_delete(s->mh);
+	}
+	free(s->buf);
+	free(s->name);
+	free(s);
+}
+
+int mixer_add(const char *fname)
+{
+	struct stream *s = NULL;
+	struct stream **ns = NULL;
+	int err = MPG123_OK;
+
+	if(!mixbuf || !(s = malloc(sizeof(*s))))
+		return -1;
+	memset(s, 0, sizeof(*s));
+	s->volume = 1.;
+	if(  !(s->name = compat_strdup(fname))
+	||   !(s->buf  = malloc(MIX_BLOCK*MIX_FRAME)) )
+		goto mixer_add_bad;
+	/* The usual decoder settings, but one fixed format. */
+	if(  !(s->mh = mpg123_new(param.cpu, &err))
+	||   mpg123_param(s->mh, MPG123_RVA, param.rva, 0)
+	||   mpg123_param(s->mh, MPG123_RESYNC_LIMIT, param.resync_limit, 0)
+	||   mpg123_format_none(s->mh)
+	||   mpg123_format(s->mh, mixrate, MIX_CHANNELS, MPG123_ENC_FLOAT_32) )
+	{
+		if(!param.quiet)
+			error1( "cannot set up decoder for mixing: %s", s->mh
+			?	mpg123_strerror(s->mh) : mpg123_plain_strerror(err) );
+		goto mixer_add_bad;
+	}
+	if(mpg123_open(s->mh, fname) != MPG123_OK)
+	{
+		if(!param.quiet)
+			error2("cannot open %s: %s", fname, mpg123_strerror(s->mh));
+		goto mixer_add_bad;
+	}
+	lock_streams();
+	if((ns = realloc(streams, sizeof(*streams)*(count+1))))
+	{
+		streams = ns;
+		streams[count++] = s;
+	}
+	unlock_streams();
+	if(!ns)
+		goto mixer_add_bad;
+	s->id = next_id++;
+	return s->id;
+
+mixer_add_bad:
+	free_stream(s);
+	return -1;
+}
+
+static int find(int id)
+{
+	int i;
+	for(i=0; i<count; ++i)
+		if(streams[i]->id == id)
+			return i;
+	return -1;
+}
+
+static void drop(int i)
+{
+	struct stream *s = streams[i];
+	lock_streams();
+	memmove(streams+i, streams+i+1, sizeof(*streams)*(count-i-1));
+	--count;
+	unlock_streams();
+	free_stream(s);
+}
+
+int mixer_remove(int id)
+{
+	int i = find(id);
+	if(i < 0)
+		return -1;
+	drop(i);
+	return 0;
+}
+
+int mixer_volume(int id, double volume)
+{
+	int i = find(id);
+	if(i < 0 || volume < 0.)
+		return -1;
+	streams[i]->volume = volume;
+	return 0;
+}
+
+int mixer_count(void)
+{
+	return count;
+}
+
+void mixer_list(void (*print)(int id, const char *name, double volume, off_t pos))
+{
+	int i;
+	for(i=0; i<count; ++i)
+		print( streams[i]->id, streams[i]->name, streams[i]->volume
+		,	mpg123_tell(streams[i]->mh) );
+}
+
+int mixer_play(out123_handle *ao, mixer_ended_func ended)
+{
+	size_t frames = 0;
+	int i;
+
+	if(!count)
+		return 0;
+	if(!started)
+	{
+		long flags = 0;
+		/* The device may not take float, let out123 convert. */
+		out123_getparam_int(ao, OUT123_FLAGS, &flags);
+		out123_param_int(ao, OUT123_FLAGS, flags|OUT123_CONVERT);
+		if(out123_start(ao, mixrate, MIX_CHANNELS, MPG123_ENC_FLOAT_32))
+		{
+			error1("cannot start output for mixing: %s", out123_strerror(ao));
+			return -1;
+		}
+		started = TRUE;
+	}
+	decode_round();
+	for(i=0; i<count; ++i)
+		if(streams[i]->fill > frames)
+			frames = streams[i]->fill;
+	memset(mixbuf, 0, frames*MIX_FRAME);
+	for(i=0; i<count; ++i)
+	{
+		struct stream *s = streams[i];
+		double matrix[MIX_CHANNELS*MIX_CHANNELS] = { 0., 0., 0., 0. };
+		matrix[0] = matrix[3] = s->volume;
+		if(s->fill && syn123_mix( mixbuf, MPG123_ENC_FLOAT_32, MIX_CHANNELS
+		,	s->buf, MPG123_ENC_FLOAT_32, MIX_CHANNELS, matrix
+		,	s->fill, FALSE, NULL ))
+			s->done = TRUE;
+	}
+	if(frames && out123_play(ao, mixbuf, frames*MIX_FRAME) < frames*MIX_FRAME
+	&& !intflag )
+	{
+		error1("cannot play mix: %s", out123_strerror(ao));
+		return -1;
+	}
+	for(i=0; i<count; )
+	{
+		if(streams[i]->done && !streams[i]->fill)
+		{
+			if(ended)
+				ended(streams[i]->id, streams[i]->name);
+			drop(i);
+		}
+		else
+			++i;
+	}
+	if(!count)
+		started = FALSE;
+	return count;
+}
+
+void mixer_clear(void)
+{
+	while(count)
+		drop(count-1);
+	started = FALSE;
+}
+
+void mixer_exit(void)
+{
+	mixer_clear();
+#ifndef NO_THREADS
+	if(workers_n)
+	{
+		int i;
+		pthread_mutex_lock(&lock);
+		quit = TRUE;
+		pthread_cond_broadcast(&work_cond);
+		pthread_mutex_unlock(&lock);
+		for(i=0; i<workers_n; ++i)
+			pthread_join(workers[i], NULL);
+	}
+	free(workers);
+	workers = NULL;
+	workers_n = 0;
+#endif
+	free(streams);
+	streams = NULL;
+	free(mixbuf);
+	mixbuf = NULL;
+}
@@ -0,0 +1,39 @@
+/*
+	mixer: decoding several streams at once into one output
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#ifndef MIXER_H
+#define MIXER_H
+
+#include "mpg123app.h"
+#include "out123.h"
+
+/* Called from mixer_play() for each stream that ended. */
+typedef void (*mixer_ended_func)(int id, const char *name);
+
+/* Prepare mixing at the given rate (stereo float, <= 0: 44100 Hz) with that
+   many decoder threads (<= 0: one per processor). Returns 0 on success. */
+int mixer_init(long rate, long threads);
+/* Open a stream and add it to the mix, returning its id (> 0) or -1. */
+int mixer_add(const char *fname);
+/* Remove the stream with that id from the mix. Returns 0 on success. */
+int mixer_remove(int id);
+/* Set the linear volume of a stream (1 is unchanged). */
+int mixer_volume(int id, double volume);
+/* Number of streams in the mix. */
+int mixer_count(void);
+/* Walk over the streams in the mix. */
+void mixer_list(void (*print)(int id, const char *name, double volume, off_t pos));
+/* Decode a block of each stream, sum them up and play that to ao, starting
+   the output as needed. Returns the number of streams still playing, -1 on
+   output errors. */
+int mixer_play(out123_handle *ao, mixer_ended_func ended);
+/* Remove all streams, but keep the threads. */
+void mixer_clear(void);
+/* Free everything. */
+void mixer_exit(void);
+
+#endif
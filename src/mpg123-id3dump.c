@@ -4,6 +4,12 @@
 	copyright 2007 by the mpg123 project - free software under the terms of the LGPL 2.1
 	see COPYING and AUTHORS files in distribution or http://mpg123.org
 	initially written by Thomas Orgis
+
+	With --jobs, a number of threads work on the files, each with its own
+	handle. Their output is collected in memory per file and printed by the
+	main thread in the order of the files. Threads only run a limited number
+	of files ahead of the printing, so one slow file does not pile up the
+	output of all others.
 */
 
 /* Need snprintf(). */
@@ -15,6 +21,10 @@
 #include "getlopt.h"
 #include <errno.h>
 #include <ctype.h>
+#include <stdarg.h>
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
 #include "debug.h"
 #include "win32_support.h"
 
@@ -24,12 +34,64 @@ static struct
 {
 	int store_pics;
 	int do_scan;
+	int recursive;
+	long jobs;
+	int stats;
 } param =
 {
 	  FALSE
 	, TRUE
+	, FALSE
+	, 1
+	, FALSE
+};
+
+/* Output and outcome of one file. Without buffering, the output goes
+   to stdout right away. */
+struct dump
+{
+	int buffered;
+	mpg123_string out;
+	int errors;
+	int tagged;
+	int failed;
+	double secs;
 };
 
+static void say(struct dump *d, const char *fmt, ...)
+{
+	va_list ap;
+
+	if(!d->buffered)
+	{
+		va_start(ap, fmt);
+		vprintf(fmt, ap);
+		va_end(ap);
+		return;
+	}
+	for(;;)
+	{
+		size_t have = d->out.fill ? d->out.fill-1 : 0;
+		size_t room = d->out.size - have;
+		int len;
+		va_start(ap, fmt);
+		len = vsnprintf(d->out.p ? d->out.p+have : NULL, room, fmt, ap);
+		va_end(ap);
+		if(len < 0)
+			return;
+		if((size_t)len < room)
+		{
+			d->out.fill = have+len+1;
+			return;
+		}
+		if(!mpg123_grow_string(&d->out, 2*(have+len+1)))
+		{
+			++d->errors;
+			return;
+		}
+	}
+}
+
 static const char* progname;
 
 static void usage(int err)
@@ -48,6 +110,11 @@ static void usage(int err)
 	fprintf(o," -n     --no-scan           do not scan entire file (just beginning)\n");
 	fprintf(o," -p     --store-pics        write APIC frames (album art pictures) to files\n");
 	fprintf(o,"                            file names using whole input file name as prefix\n");
+	fprintf(o," -r     --recursive         dump all files in directories given, and below\n");
+#ifndef NO_THREADS
+	fprintf(o," -j <n> --jobs <n>          work on <n> files at once, output stays in order\n");
+#endif
+	fprintf(o," -s     --stats             print counts and timing at the end (stderr)\n");
 	fprintf(o,"\nNote that text output will always be in UTF-8, regardless of locale.\n");
 	exit(err);
 }
@@ -61,34 +128,39 @@ static topt opts[] =
 	 {'h', "help",         0,       want_usage, 0,                 0}
 	,{'n', "no-scan",      GLO_INT, 0,          &param.do_scan,    FALSE}
 	,{'p', "store-pics",   GLO_INT, 0,          &param.store_pics, TRUE}
+	,{'r', "recursive",    GLO_INT, 0,          &param.recursive,  TRUE}
+#ifndef NO_THREADS
+	,{'j', "jobs",         GLO_ARG|GLO_LONG, 0, &param.jobs,       0}
+#endif
+	,{'s', "stats",        GLO_INT, 0,          &param.stats,      TRUE}
 	,{0, 0, 0, 0, 0, 0}
 };
 
 /* Helper for v1 printing, get these strings their zero byte. */
-void safe_print(char* name, char *data, size_t size)
+void safe_print(struct dump *d, char* name, char *data, size_t size)
 {
 	char safe[31];
 	if(size>30) return;
 
 	memcpy(safe, data, size);
 	safe[size] = 0;
-	printf("%s: %s\n", name, safe);
+	say(d, "%s: %s\n", name, safe);
 }
 
 /* Print out ID3v1 info. */
-void print_v1(mpg123_id3v1 *v1)
+void print_v1(struct dump *d, mpg123_id3v1 *v1)
 {
-	safe_print("Title",   v1->title,   sizeof(v1->title));
-	safe_print("Artist",  v1->artist,  sizeof(v1->artist));
-	safe_print("Album",   v1->album,   sizeof(v1->album));
-	safe_print("Year",    v1->year,    sizeof(v1->year));
-	safe_print("Comment", v1->comment, sizeof(v1->comment));
-	printf("Genre: %i", v1->genre);
+	safe_print(d, "Title",   v1->title,   sizeof(v1->title));
+	safe_print(d, "Artist",  v1->artist,  sizeof(v1->artist));
+	safe_print(d, "Album",   v1->album,   sizeof(v1->album));
+	safe_print(d, "Year",    v1->year,    sizeof(v1->year));
+	safe_print(d, "Comment", v1->comment, sizeof(v1->comment));
+	say(d, "Genre: %i", v1->genre);
 }
 
 /* Split up a number of lines separated by \n, \r, both or just zero byte
    and print out each line with specified prefix. */
-void print_lines(const char* prefix, mpg123_string *inlines)
+void print_lines(struct dump *d, const char* prefix, mpg123_string *inlines)
 {
 	size_t i;
 	int hadcr = 0, hadlf = 0;
@@ -116,7 +188,7 @@ void print_lines(const char* prefix, mpg123_string *inlines)
 			if(line)
 			{
 				lines[i] = 0;
-				printf("%s%s\n", prefix, line);
+				say(d, "%s%s\n", prefix, line);
 				line = NULL;
 				lines[i] = save;
 			}
@@ -130,14 +202,14 @@ void print_lines(const char* prefix, mpg123_string *inlines)
 }
 
 /* Print out the named ID3v2  fields. */
-void print_v2(mpg123_id3v2 *v2)
+void print_v2(struct dump *d, mpg123_id3v2 *v2)
 {
-	print_lines("Title: ",   v2->title);
-	print_lines("Artist: ",  v2->artist);
-	print_lines("Album: ",   v2->album);
-	print_lines("Year: ",    v2->year);
-	print_lines("Comment: ", v2->comment);
-	print_lines("Genre: ",   v2->genre);
+	print_lines(d, "Title: ",   v2->title);
+	print_lines(d, "Artist: ",  v2->artist);
+	print_lines(d, "Album: ",   v2->album);
+	print_lines(d, "Year: ",    v2->year);
+	print_lines(d, "Comment: ", v2->comment);
+	print_lines(d, "Genre: ",   v2->genre);
 }
 
 /* Easy conversion to string via lookup. */
@@ -173,7 +245,7 @@ static const char* pic_type(int id)
 }
 
 /* Print out all stored ID3v2 fields with their 4-character IDs. */
-void print_raw_v2(mpg123_id3v2 *v2)
+void print_raw_v2(struct dump *d, mpg123_id3v2 *v2)
 {
 	size_t i;
 	for(i=0; i<v2->texts; ++i)
@@ -185,20 +257,20 @@ void print_raw_v2(mpg123_id3v2 *v2)
 		memcpy(lang, v2->text[i].lang, 3);
 		lang[3] = 0;
 		if(v2->text[i].description.fill)
-		printf("%s language(%s) description(%s)\n", id, lang, v2->text[i].description.p);
-		else printf("%s language(%s)\n", id, lang);
+		say(d, "%s language(%s) description(%s)\n", id, lang, v2->text[i].description.p);
+		else say(d, "%s language(%s)\n", id, lang);
 
-		print_lines(" ", &v2->text[i].text);
+		print_lines(d, " ", &v2->text[i].text);
 	}
 	for(i=0; i<v2->extras; ++i)
 	{
 		char id[5];
 		memcpy(id, v2->extra[i].id, 4);
 		id[4] = 0;
-		printf( "%s description(%s)\n",
+		say( d, "%s description(%s)\n",
 		        id,
 		        v2->extra[i].description.fill ? v2->extra[i].description.p : "" );
-		print_lines(" ", &v2->extra[i].text);
+		print_lines(d, " ", &v2->extra[i].text);
 	}
 	for(i=0; i<v2->comments; ++i)
 	{
@@ -208,11 +280,11 @@ void print_raw_v2(mpg123_id3v2 *v2)
 		id[4] = 0;
 		memcpy(lang, v2->comment_list[i].lang, 3);
 		lang[3] = 0;
-		printf( "%s description(%s) language(%s):\n",
+		say( d, "%s description(%s) language(%s):\n",
 		        id,
 		        v2->comment_list[i].description.fill ? v2->comment_list[i].description.p : "",
 		        lang );
-		print_lines(" ", &v2->comment_list[i].text);
+		print_lines(d, " ", &v2->comment_list[i].text);
 	}
 	for(i=0; i<v2->pictures; ++i)
 	{
@@ -221,7 +293,7 @@ void print_raw_v2(mpg123_id3v2 *v2)
 		pic = &v2->picture[i];
 		fprintf(stderr, "APIC type(%i, %s) mime(%s) size(%"SIZE_P")\n",
 			pic->type, pic_type(pic->type), pic->mime_type.p, (size_p)pic->size);
-		print_lines(" ", &pic->description);
+		print_lines(d, " ", &pic->description);
 	}
 }
 
@@ -261,7 +333,7 @@ static char* mime2end(mpg123_string* mime)
 /* Construct a sane file name without introducing spaces, then open.
    Example: /some/where/some.mp3.front_cover.jpeg
    If multiple ones are there: some.mp3.front_cover2.jpeg */
-int open_picfile(const char* prefix, mpg123_picture* pic)
+int open_picfile(struct dump *d, const char* prefix, mpg123_picture* pic)
 {
 	char *end, *typestr, *pfn;
 	const char* pictype;
@@ -301,11 +373,11 @@ int open_picfile(const char* prefix, mpg123_picture* pic)
 		errno = 0;		
 		fd = compat_open(pfn, O_CREAT|O_WRONLY|O_EXCL);
 	}
-	printf("writing %s\n", pfn);
+	say(d, "writing %s\n", pfn);
 	if(fd < 0)
 	{
 		error("Cannot open for writing (counter exhaust? permissions?).");
-		++errors;
+		++d->errors;
 	}
 
 	free(end);
@@ -314,7 +386,7 @@ int open_picfile(const char* prefix, mpg123_picture* pic)
 	return fd;
 }
 
-static void store_pictures(const char* prefix, mpg123_id3v2 *v2)
+static void store_pictures(struct dump *d, const char* prefix, mpg123_id3v2 *v2)
 {
 	int i;
 
@@ -324,7 +396,7 @@ static void store_pictures(const char* prefix, mpg123_id3v2 *v2)
 		mpg123_picture* pic;
 
 		pic = &v2->picture[i];
-		fd = open_picfile(prefix, pic);
+		fd = open_picfile(d, prefix, pic);
 		if(fd >= 0)
 		{ /* stream I/O for not having to care about interruptions */
 			FILE* picfile = compat_fdopen(fd, "w");
@@ -333,27 +405,291 @@ static void store_pictures(const char* prefix, mpg123_id3v2 *v2)
 				if(fwrite(pic->data, pic->size, 1, picfile) != 1)
 				{
 					error("Failure to write data.");
-					++errors;
+					++d->errors;
 				}
 				if(fclose(picfile))
 				{
 					error("Failure to close (flush?).");
-					++errors;
+					++d->errors;
 				}
 			}
 			else
 			{
 				error1("Unable to fdopen output: %s)", strerror(errno));
-				++errors;
+				++d->errors;
 			}
 		}
 	}
 }
 
+static double wall_since(struct timeval *start)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + 1e-6*(now.tv_usec - start->tv_usec);
+}
+
+/* Going through the tags does not need a decoder, and only the tag frames
+   that are asked for need conversion. */
+static mpg123_handle *new_handle(void)
+{
+	mpg123_handle *m = mpg123_new(NULL, NULL);
+	if(m)
+		mpg123_param( m, MPG123_ADD_FLAGS
+		,	MPG123_PICTURE|MPG123_LAZY_ID3|MPG123_META_ONLY, 0. );
+	return m;
+}
+
+static void dump_file(mpg123_handle *m, const char *fname, struct dump *d)
+{
+	mpg123_id3v1 *v1;
+	mpg123_id3v2 *v2;
+	int meta;
+	struct timeval start;
+
+	gettimeofday(&start, NULL);
+	if(mpg123_open(m, fname) != MPG123_OK)
+	{
+		fprintf(stderr, "Cannot open %s: %s\n", fname, mpg123_strerror(m));
+		d->failed = TRUE;
+		return;
+	}
+	if(param.do_scan) mpg123_scan(m);
+	mpg123_seek(m, 0, SEEK_SET);
+	meta = mpg123_meta_check(m);
+	if(meta & MPG123_ID3 && mpg123_id3(m, &v1, &v2) == MPG123_OK)
+	{
+		d->tagged = TRUE;
+		say(d, "FILE: %s\n", fname);
+		say(d, "\n====      ID3v1       ====\n");
+		if(v1 != NULL) print_v1(d, v1);
+
+		say(d, "\n====      ID3v2       ====\n");
+		if(v2 != NULL) print_v2(d, v2);
+
+		say(d, "\n==== ID3v2 Raw frames ====\n");
+		if(v2 != NULL)
+		{
+			print_raw_v2(d, v2);
+			if(param.store_pics)
+			store_pictures(d, fname, v2);
+		}
+	}
+	else say(d, "Nothing found for %s.\n", fname);
+
+	mpg123_close(m);
+	d->secs = wall_since(&start);
+}
+
+/* All files to work on, in order, with the outcome once done. */
+struct job
+{
+	char *fname;
+	struct dump d;
+};
+
+static struct job *jobs = NULL;
+static size_t jobs_n = 0;
+static size_t jobs_size = 0;
+
+static struct
+{
+	size_t files;
+	size_t tagged;
+	size_t failed;
+	double secs;
+} stats = { 0, 0, 0, 0. };
+
+static void account(struct dump *d)
+{
+	++stats.files;
+	if(d->tagged)
+		++stats.tagged;
+	if(d->failed)
+		++stats.failed;
+	stats.secs += d->secs;
+	errors += d->errors;
+}
+
+static void add_file(const char *fname)
+{
+	if(jobs_n == jobs_size)
+	{
+		size_t news = jobs_size ? 2*jobs_size : 256;
+		struct job *nj = safe_realloc(jobs, sizeof(*jobs)*news);
+		if(!nj) exit(11);
+		jobs = nj;
+		jobs_size = news;
+	}
+	memset(jobs+jobs_n, 0, sizeof(*jobs));
+	if(!(jobs[jobs_n].fname = compat_strdup(fname))) exit(11);
+	++jobs_n;
+}
+
+static int name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/* Sorted names of the files or directories in dir, NULL-terminated. */
+static char **dir_entries(char *dir, int dirs)
+{
+	struct compat_dir *cd;
+	char **names = NULL;
+	size_t n = 0;
+	size_t size = 0;
+	char *name;
+
+	if(!(cd = compat_diropen(dir)))
+		return NULL;
+	while((name = dirs ? compat_nextdir(cd) : compat_nextfile(cd)))
+	{
+		if(dirs && (!strcmp(name, ".") || !strcmp(name, "..")))
+		{
+			free(name);
+			continue;
+		}
+		if(n+1 >= size)
+		{
+			char **nn;
+			size = size ? 2*size : 64;
+			if(!(nn = safe_realloc(names, sizeof(*names)*size))) exit(11);
+			names = nn;
+		}
+		names[n++] = name;
+	}
+	compat_dirclose(cd);
+	if(names)
+	{
+		qsort(names, n, sizeof(*names), name_cmp);
+		names[n] = NULL;
+	}
+	return names;
+}
+
+/* Files of a directory first, then the subdirectories, all sorted by name. */
+static void add_dir(char *dir)
+{
+	int dirs;
+	for(dirs=0; dirs<2; ++dirs)
+	{
+		char **names = dir_entries(dir, dirs);
+		size_t i;
+		if(!names)
+			continue;
+		for(i=0; names[i]; ++i)
+		{
+			char *path = compat_catpath(dir, names[i]);
+			if(!path) exit(11);
+			if(dirs)
+				add_dir(path);
+			else
+				add_file(path);
+			free(path);
+			free(names[i]);
+		}
+		free(names);
+	}
+}
+
+#ifndef NO_THREADS
+/* Threads do not take files further ahead of the printing than that. */
+#define JOB_WINDOW 256
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+static size_t job_next = 0;    /* next file to take */
+static size_t job_printed = 0; /* files printed so far */
+static char *job_done = NULL;
+
+static void *job_worker(void *arg)
+{
+	mpg123_handle *m = new_handle();
+
+	pthread_mutex_lock(&job_lock);
+	while(m && job_next < jobs_n)
+	{
+		size_t i;
+		if(job_next >= job_printed + JOB_WINDOW)
+		{
+			pthread_cond_wait(&job_cond, &job_lock);
+			continue;
+		}
+		i = job_next++;
+		pthread_mutex_unlock(&job_lock);
+		jobs[i].d.buffered = TRUE;
+		dump_file(m, jobs[i].fname, &jobs[i].d);
+		pthread_mutex_lock(&job_lock);
+		job_done[i] = TRUE;
+		pthread_cond_broadcast(&job_cond);
+	}
+	if(!m)
+	{
+		/* Nobody is going to do them now. */
+		error("Cannot create handle.");
+		while(job_next < jobs_n)
+		{
+			jobs[job_next].d.failed = TRUE;
+			job_done[job_next++] = TRUE;
+		}
+		pthread_cond_broadcast(&job_cond);
+	}
+	pthread_mutex_unlock(&job_lock);
+	mpg123_delete(m);
+	return NULL;
+}
+
+/* Returns FALSE if there are no threads to do it. */
+static int run_jobs(void)
+{
+	pthread_t *threads;
+	long started = 0;
+	size_t i;
+
+	if(  !(threads = malloc(sizeof(*threads)*param.jobs))
+	  || !(job_done = calloc(jobs_n ? jobs_n : 1, 1)) )
+		exit(11);
+	for(started=0; started<param.jobs; ++started)
+		if(pthread_create(threads+started, NULL, job_worker, NULL))
+			break;
+	if(!started)
+	{
+		free(job_done);
+		free(threads);
+		return FALSE;
+	}
+	for(i=0; i<jobs_n; ++i)
+	{
+		struct dump *d = &jobs[i].d;
+		pthread_mutex_lock(&job_lock);
+		while(!job_done[i])
+			pthread_cond_wait(&job_cond, &job_lock);
+		pthread_mutex_unlock(&job_lock);
+		if(d->out.fill)
+			fwrite(d->out.p, d->out.fill-1, 1, stdout);
+		mpg123_free_string(&d->out);
+		account(d);
+		free(jobs[i].fname);
+		jobs[i].fname = NULL;
+		pthread_mutex_lock(&job_lock);
+		job_printed = i+1;
+		pthread_cond_broadcast(&job_cond);
+		pthread_mutex_unlock(&job_lock);
+	}
+	while(started)
+		pthread_join(threads[--started], NULL);
+	free(job_done);
+	free(threads);
+	return TRUE;
+}
+#endif
+
 int main(int argc, char **argv)
 {
 	int i, result;
 	mpg123_handle* m;
+	struct timeval start;
+	size_t j;
 #if defined(WANT_WIN32_UNICODE)
 	win32_cmdline_utf8(&argc,&argv);
 #endif
@@ -376,47 +712,35 @@ int main(int argc, char **argv)
 #endif
 	if(loptind >= argc) usage(1);
 
+	gettimeofday(&start, NULL);
 	mpg123_init();
-	m = mpg123_new(NULL, NULL);
-	mpg123_param(m, MPG123_ADD_FLAGS, MPG123_PICTURE, 0.);
-
 	for(i=loptind; i < argc; ++i)
 	{
-		mpg123_id3v1 *v1;
-		mpg123_id3v2 *v2;
-		int meta;
-		if(mpg123_open(m, argv[i]) != MPG123_OK)
-		{
-			fprintf(stderr, "Cannot open %s: %s\n", argv[i], mpg123_strerror(m));
-			continue;
-		}
-		if(param.do_scan) mpg123_scan(m);
-		mpg123_seek(m, 0, SEEK_SET);
-		meta = mpg123_meta_check(m);
-		if(meta & MPG123_ID3 && mpg123_id3(m, &v1, &v2) == MPG123_OK)
-		{
-			printf("FILE: %s\n", argv[i]);
-			printf("\n====      ID3v1       ====\n");
-			if(v1 != NULL) print_v1(v1);
-
-			printf("\n====      ID3v2       ====\n");
-			if(v2 != NULL) print_v2(v2);
-
-			printf("\n==== ID3v2 Raw frames ====\n");
-			if(v2 != NULL)
-			{
-				print_raw_v2(v2);
-				if(param.store_pics)
-				store_pictures(argv[i], v2);
-			}
-		}
-		else printf("Nothing found for %s.\n", argv[i]);
-
-		mpg123_close(m);
+		if(param.recursive && compat_isdir(argv[i]))
+			add_dir(argv[i]);
+		else
+			add_file(argv[i]);
+	}
+#ifndef NO_THREADS
+	if(param.jobs > 1 && run_jobs())
+		jobs_n = 0;
+#endif
+	m = jobs_n ? new_handle() : NULL;
+	for(j=0; m && j < jobs_n; ++j)
+	{
+		dump_file(m, jobs[j].fname, &jobs[j].d);
+		account(&jobs[j].d);
+		free(jobs[j].fname);
 	}
 	mpg123_delete(m);
+	free(jobs);
 	mpg123_exit();
 
+	if(param.stats)
+		fprintf( stderr, "%"SIZE_P" files (%"SIZE_P" with ID3, %"SIZE_P" failed)"
+			" in %.2f s wall time, %.2f s working on files with %li jobs\n"
+		,	(size_p)stats.files, (size_p)stats.tagged, (size_p)stats.failed
+		,	wall_since(&start), stats.secs, param.jobs > 1 ? param.jobs : 1 );
 	if(errors) error1("Encountered %i errors along the way.", errors);
 	return errors != 0;
 #if defined(WANT_WIN32_UNICODE)
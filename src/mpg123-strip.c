@@ -1,28 +1,68 @@
 /*
 	extract_frams: utlize the framebyframe API and mpg123_framedata to extract the MPEG frames out of a stream (strip off anything else).
 
-	copyright 2011-2013 by the mpg123 project - free software under the terms of the LGPL 2.1
+	copyright 2011-2020 by the mpg123 project - free software under the terms of the LGPL 2.1
 	see COPYING and AUTHORS files in distribution or http://mpg123.org
 	initially written by Thomas Orgis
+
+	Frames are collected in a big output buffer instead of written one by
+	one. If the input is a regular file, it is even simpler: The positions
+	of the frames tell which stretches of the file are MPEG data, and these
+	runs are copied over directly from the input, in the kernel with
+	copy_file_range() where possible.
+
+	With --cut or more than one input file, the frames are edited on the
+	way, still without decoding anything: Cut stretches of frames are left
+	out and the inputs are joined one after another. Layer III frames take
+	main data from the bit reservoir in the frames before them
+	(main_data_begin), which are gone after a cut. The first frame that
+	is kept gets its reservoir bytes copied into the free end of the main
+	data of the output frames before it, with silent filler frames added
+	if there is not enough room. The Xing/LAME info frame of the first
+	input is rewritten at the end to match the edited stream.
 */
 
+/* copy_file_range() */
+#define _GNU_SOURCE
 #include "config.h"
 #include "compat.h"
 #include <mpg123.h>
+#include <errno.h>
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
 
 #include "getlopt.h"
 
+#if defined(HAVE_PREAD) && !defined(WIN32)
+#define COPY_RUNS
+#endif
+
+/* Bytes per write, and per read when copying runs. */
+#define OUT_BLOCK (1<<20)
+/* When editing, the last bytes stay in the buffer for the reservoir
+   bytes of the next frames to be put into. */
+#define OUT_HOLD (1<<17)
+/* Output frames to remember for that, enough for the reservoir. */
+#define MD_FRAMES 64
+/* The most main data bytes a frame can take from the frames before. */
+#define MAX_RESERVOIR 511
+/* Stretches of frames to cut out. */
+#define MAX_CUTS 128
+
 
 static struct
 {
 	int info;
 	long icy_interval;
 	int verbose;
+	int runs;
 } param =
 {
 	 TRUE
 	,0
 	,0
+	,TRUE
 };
 
 static const char* progname;
@@ -38,11 +78,18 @@ static void usage(int err)
 	fprintf(o, "Extract only MPEG frames from a stream using libmpg123 (stdin to stdout)\n");
 	fprintf(o, "\tversion %s; written and copyright by Thomas Orgis and the mpg123 project\n", PACKAGE_VERSION);
 	fprintf(o,"\nusage: %s [option(s)] < input > output\n", progname);
+	fprintf(o,"   or: %s [option(s)] input [input ...] > output\n", progname);
+	fprintf(o,"\nSeveral inputs are joined into one stream.\n");
 	fprintf(o,"\noptions:\n");
+	fprintf(o," -c <f:t> --cut <f:t>       cut out audio frames f to before t (to the end\n");
+	fprintf(o,"                            without t), counted from 0 over all inputs\n");
+	fprintf(o,"                            without info frames; can be given repeatedly\n");
 	fprintf(o," -h     --help              give usage help\n");
 	fprintf(o," -i <n> --icy-interval <n>  stream has ICY metadata present with this interval\n");
 	fprintf(o," -n     --no-info           also strip info frame at beginning\n");
 	fprintf(o," -v[*]  --verbose           increase verbosity level\n");
+	fprintf(o,"        --no-runs           always copy frame by frame, not whole runs of\n");
+	fprintf(o,"                            frames from a regular input file\n");
 	exit(err);
 }
 
@@ -56,16 +103,58 @@ static void set_verbose (char *arg)
     param.verbose++;
 }
 
+/* Audio frames from <= n < to to leave out, to < 0 for the end. */
+static struct
+{
+	long from;
+	long to;
+} cuts[MAX_CUTS];
+static int cut_count = 0;
+
+static void set_cut(char *arg)
+{
+	char *end;
+	long from = strtol(arg, &end, 10);
+	long to = -1;
+	int good = end != arg && from >= 0 && *end == ':';
+
+	if(good && *++end)
+	{
+		char *toarg = end;
+		to = strtol(toarg, &end, 10);
+		good = end != toarg && !*end && to > from;
+	}
+	if(!good || cut_count == MAX_CUTS)
+	{
+		fprintf(stderr, "%s: Bad cut (or too many): %s\n", progname, arg);
+		usage(1);
+	}
+	cuts[cut_count].from = from;
+	cuts[cut_count].to = to;
+	++cut_count;
+}
+
+static int cut_frame(long n)
+{
+	int i;
+	for(i=0; i<cut_count; ++i)
+		if(n >= cuts[i].from && (cuts[i].to < 0 || n < cuts[i].to))
+			return TRUE;
+	return FALSE;
+}
+
 static topt opts[] =
 {
-	 {'h', "help", 0, want_usage, 0, 0}
+	 {'c', "cut", GLO_ARG, set_cut, 0, 0}
+	,{'h', "help", 0, want_usage, 0, 0}
 	,{'i', "icy-interval", GLO_ARG|GLO_LONG, 0, &param.icy_interval, 0}
 	,{'n', "no-info", GLO_INT, 0, &param.info, FALSE}
 	,{'v', "verbose", 0, set_verbose, 0, 0}
+	,{0, "no-runs", GLO_INT, 0, &param.runs, FALSE}
 	,{0, 0, 0, 0, 0, 0}
 };
 
-int do_work(mpg123_handle *m);
+int do_work(mpg123_handle *m, int inputs, char **names);
 
 int main(int argc, char **argv)
 {
@@ -111,7 +200,7 @@ int main(int argc, char **argv)
 			ret = mpg123_param(m, MPG123_ICY_INTERVAL, param.icy_interval, 0);
 		}
 
-		if(ret == MPG123_OK) ret = do_work(m);
+		if(ret == MPG123_OK) ret = do_work(m, argc-loptind, argv+loptind);
 
 		if(ret != MPG123_OK) fprintf(stderr, "Some error occured: %s\n", mpg123_strerror(m));
 
@@ -122,37 +211,685 @@ int main(int argc, char **argv)
 	return ret;
 }
 
-int do_work(mpg123_handle *m)
+static unsigned char *outbuf = NULL;
+static size_t outfill = 0;
+
+static int write_all(const unsigned char *data, size_t bytes)
+{
+	while(bytes)
+	{
+		ssize_t got = write(STDOUT_FILENO, data, bytes);
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got <= 0)
+		{
+			fprintf(stderr, "Cannot write output: %s\n", strerror(errno));
+			return -1;
+		}
+		data  += got;
+		bytes -= got;
+	}
+	return 0;
+}
+
+static int flush_out(void)
+{
+	int ret = write_all(outbuf, outfill);
+	outfill = 0;
+	return ret;
+}
+
+static int put_out(const unsigned char *data, size_t bytes)
+{
+	if(outfill + bytes > OUT_BLOCK)
+	{
+		if(flush_out())
+			return -1;
+		if(bytes > OUT_BLOCK)
+			return write_all(data, bytes);
+	}
+	memcpy(outbuf+outfill, data, bytes);
+	outfill += bytes;
+	return 0;
+}
+
+/* Need to extract the 4 header bytes from the native storage in the correct order. */
+static void header_bytes(unsigned long header, unsigned char *hbuf)
+{
+	int i;
+	for(i=0; i<4; ++i) hbuf[i] = (unsigned char) ((header >> ((3-i)*8)) & 0xff);
+}
+
+#ifdef COPY_RUNS
+/* Copy the given range of the input file to the output. */
+static int copy_run(int fd, off_t start, off_t end)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+	/* Only works between files (on the same file system with older
+	   kernels), so remember failure. */
+	static int in_kernel = TRUE;
+	while(in_kernel && start < end)
+	{
+		loff_t off = start;
+		ssize_t got = copy_file_range( fd, &off, STDOUT_FILENO, NULL
+		,	(size_t)(end-start), 0 );
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got <= 0)
+		{
+			if(param.verbose > 1)
+				fprintf(stderr, "copy_file_range() not usable: %s\n", strerror(errno));
+			in_kernel = FALSE;
+			break;
+		}
+		start += got;
+	}
+#endif
+	while(start < end)
+	{
+		size_t block = end-start > OUT_BLOCK ? OUT_BLOCK : (size_t)(end-start);
+		ssize_t got = pread(fd, outbuf, block, start);
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got <= 0)
+		{
+			fprintf(stderr, "Cannot read input again: %s\n"
+			,	got ? strerror(errno) : "file got shorter");
+			return -1;
+		}
+		if(write_all(outbuf, got))
+			return -1;
+		start += got;
+	}
+	return 0;
+}
+
+/* Only for a regular file that starts at the beginning, without ICY
+   data in between. */
+static int runs_possible(int fd)
+{
+	struct stat st;
+	return param.runs && param.icy_interval <= 0
+	&&	!fstat(fd, &st) && S_ISREG(st.st_mode)
+	&&	lseek(fd, 0, SEEK_CUR) == 0;
+}
+#endif
+
+/* Editing: cutting and joining. */
+
+#define LAYER(h)     (4 - (int)((h)>>17 & 3))
+#define LSF(h)       (((h)>>19 & 3) != 3)
+#define CHANNELS(h)  (((h)>>6 & 3) == 3 ? 1 : 2)
+#define CRC_BYTES(h) ((h)>>16 & 1 ? 0 : 2)
+
+enum info_tag { NO_TAG = 0, XING_TAG, VBRI_TAG };
+
+static struct
+{
+	int seekable;     /* The info frame can be updated at the end. */
+	off_t out_start;  /* Output file position at the beginning. */
+	off_t out_base;   /* Output position of outbuf[0]. */
+	long frame;       /* Audio frames of the inputs so far. */
+	int discontinuity;
+	int first_cut;
+	int last_cut;
+	/* The last main data of the input, for the reservoir. */
+	unsigned char res[MAX_RESERVOIR];
+	size_t res_fill;
+	/* Main data of the output, the whole of it and the end of what the
+	   frames so far use. */
+	off_t md_len;
+	off_t md_used;
+	struct
+	{
+		off_t md;   /* position in the main data */
+		off_t pos;  /* position in the output */
+		size_t len;
+	} md_frames[MD_FRAMES];
+	long md_count;
+	/* Output positions of the audio frames, for the seek table. */
+	off_t *offsets;
+	long out_frames;
+	long offsets_size;
+	long fillers;
+	long lead_fillers;
+	/* The info frame at the beginning of the output. */
+	unsigned char *info;
+	size_t info_bytes;
+	size_t xing_off;
+	size_t lame_off; /* 0 without LAME tag */
+	int delay;
+	int padding;     /* of the last input */
+	unsigned short music_crc;
+} ed;
+
+#define OUT_POS (ed.out_base + (off_t)outfill)
+
+static unsigned long get_be32(const unsigned char *p)
+{
+	return (unsigned long)p[0]<<24 | (unsigned long)p[1]<<16
+	|	(unsigned long)p[2]<<8 | p[3];
+}
+
+static void put_be32(unsigned char *p, unsigned long val)
+{
+	p[0] = (val>>24) & 0xff;
+	p[1] = (val>>16) & 0xff;
+	p[2] = (val>>8) & 0xff;
+	p[3] = val & 0xff;
+}
+
+/* The CRC-16 of the LAME tag, polynomial 0x8005 (reflected), zero start. */
+static unsigned short crc16(unsigned short crc, const unsigned char *data, size_t bytes)
+{
+	while(bytes--)
+	{
+		int i;
+		crc ^= *data++;
+		for(i=0; i<8; ++i)
+			crc = crc & 1 ? (crc>>1) ^ 0xa001 : crc>>1;
+	}
+	return crc;
+}
+
+static int frame_samples(unsigned long header)
+{
+	switch(LAYER(header))
+	{
+		case 1:  return 384;
+		case 3:  return LSF(header) ? 576 : 1152;
+		default: return 1152;
+	}
+}
+
+static size_t side_bytes(unsigned long header)
+{
+	return LSF(header)
+	?	(CHANNELS(header) == 1 ?  9 : 17)
+	:	(CHANNELS(header) == 1 ? 17 : 32);
+}
+
+static unsigned long getbits(const unsigned char *p, size_t *bit, int n)
+{
+	unsigned long val = 0;
+	while(n--)
+	{
+		val = val<<1 | (p[*bit>>3] >> (7-(*bit&7)) & 1);
+		++*bit;
+	}
+	return val;
+}
+
+/* Layer III side info: main_data_begin and the main data bytes used
+   by the granules. */
+static void main_data(unsigned long header, const unsigned char *side
+,	long *begin, size_t *bytes)
+{
+	int lsf = LSF(header);
+	int channels = CHANNELS(header);
+	unsigned long bits = 0;
+	size_t bit = 0;
+	int gr, ch;
+
+	*begin = (long)getbits(side, &bit, lsf ? 8 : 9);
+	/* private bits, scfsi */
+	bit += lsf ? channels : (channels == 1 ? 5 : 3) + 4*channels;
+	for(gr=0; gr<(lsf ? 1 : 2); ++gr)
+	for(ch=0; ch<channels; ++ch)
+	{
+		bits += getbits(side, &bit, 12); /* part2_3_length */
+		bit += lsf ? 51 : 47;
+	}
+	*bytes = (size_t)((bits+7)/8);
+}
+
+static enum info_tag info_tag(unsigned long header, const unsigned char *body, size_t bytes)
+{
+	size_t xo;
+	if(LAYER(header) != 3)
+		return NO_TAG;
+	xo = CRC_BYTES(header) + side_bytes(header);
+	if( bytes >= xo+8
+	&&	(!memcmp(body+xo, "Xing", 4) || !memcmp(body+xo, "Info", 4)) )
+		return XING_TAG;
+	if(bytes >= 32+26 && !memcmp(body+32, "VBRI", 4))
+		return VBRI_TAG;
+	return NO_TAG;
+}
+
+/* Offset of the LAME tag in a frame with Xing header at xo, 0 for none. */
+static size_t lame_offset(const unsigned char *frame, size_t bytes, size_t xo)
+{
+	unsigned long flags = get_be32(frame+xo+4);
+	size_t off = xo + 8;
+	if(flags & 1) off += 4;
+	if(flags & 2) off += 4;
+	if(flags & 4) off += 100;
+	if(flags & 8) off += 4;
+	return off+36 <= bytes && frame[off] ? off : 0;
+}
+
+static void res_add(const unsigned char *data, size_t bytes)
+{
+	if(bytes >= MAX_RESERVOIR)
+	{
+		memcpy(ed.res, data+bytes-MAX_RESERVOIR, MAX_RESERVOIR);
+		ed.res_fill = MAX_RESERVOIR;
+		return;
+	}
+	if(ed.res_fill + bytes > MAX_RESERVOIR)
+	{
+		size_t drop = ed.res_fill + bytes - MAX_RESERVOIR;
+		memmove(ed.res, ed.res+drop, ed.res_fill-drop);
+		ed.res_fill -= drop;
+	}
+	memcpy(ed.res+ed.res_fill, data, bytes);
+	ed.res_fill += bytes;
+}
+
+/* The music CRC covers all after the info frame. */
+static void music_crc(size_t bytes)
+{
+	size_t skip = 0;
+	if(ed.out_base < (off_t)ed.info_bytes)
+		skip = (size_t)((off_t)ed.info_bytes - ed.out_base);
+	if(skip < bytes)
+		ed.music_crc = crc16(ed.music_crc, outbuf+skip, bytes-skip);
+}
+
+static int edit_out(const unsigned char *data, size_t bytes)
+{
+	if(outfill + bytes > OUT_BLOCK)
+	{
+		size_t flush = outfill > OUT_HOLD ? outfill-OUT_HOLD : outfill;
+		music_crc(flush);
+		if(write_all(outbuf, flush))
+			return -1;
+		memmove(outbuf, outbuf+flush, outfill-flush);
+		outfill -= flush;
+		ed.out_base += flush;
+		if(outfill + bytes > OUT_BLOCK)
+		{
+			fprintf(stderr, "Frame too big for editing.\n");
+			return -1;
+		}
+	}
+	if(data)
+		memcpy(outbuf+outfill, data, bytes);
+	else
+		memset(outbuf+outfill, 0, bytes);
+	outfill += bytes;
+	return 0;
+}
+
+/* An audio frame, body NULL for zeros, with main data at area. */
+static int edit_frame_out( unsigned long header, const unsigned char *body
+,	size_t bytes, size_t area, size_t area_len )
+{
+	unsigned char hbuf[4];
+	off_t pos = OUT_POS;
+
+	if(ed.out_frames == ed.offsets_size)
+	{
+		long size = ed.offsets_size ? 2*ed.offsets_size : 1024;
+		off_t *offsets = realloc(ed.offsets, sizeof(off_t)*size);
+		if(!offsets)
+		{
+			fprintf(stderr, "Out of memory.\n");
+			return -1;
+		}
+		ed.offsets = offsets;
+		ed.offsets_size = size;
+	}
+	ed.offsets[ed.out_frames++] = pos;
+	if(area_len)
+	{
+		int i = ed.md_count++ % MD_FRAMES;
+		ed.md_frames[i].md  = ed.md_len;
+		ed.md_frames[i].pos = pos + 4 + (off_t)area;
+		ed.md_frames[i].len = area_len;
+		ed.md_len += area_len;
+	}
+	header_bytes(header, hbuf);
+	return edit_out(hbuf, 4) || edit_out(body, bytes);
+}
+
+/* A silent frame of the same size: no CRC, side info and main data all
+   zero. */
+static int put_filler(unsigned long header, size_t bytes)
+{
+	header |= 1UL<<16;
+	if(ed.out_frames == ed.lead_fillers)
+		++ed.lead_fillers;
+	++ed.fillers;
+	return edit_frame_out( header, NULL, bytes
+	,	side_bytes(header), bytes - side_bytes(header) );
+}
+
+/* Put the last bytes of the input main data at the end of the output
+   main data, where the next frame expects its reservoir. */
+static int patch_reservoir(size_t bytes)
+{
+	off_t md = ed.md_len - (off_t)bytes;
+	const unsigned char *src = ed.res + ed.res_fill - bytes;
+	size_t done = 0;
+	long i;
+
+	for(i=ed.md_count-1; i>=0 && i>=ed.md_count-MD_FRAMES && done<bytes; --i)
+	{
+		int j = i % MD_FRAMES;
+		off_t from = md > ed.md_frames[j].md ? md : ed.md_frames[j].md;
+		off_t to = ed.md_frames[j].md + (off_t)ed.md_frames[j].len;
+		off_t pos = ed.md_frames[j].pos + (from - ed.md_frames[j].md);
+		if(from >= to)
+			break;
+		if(pos < ed.out_base)
+			return -1;
+		memcpy(outbuf+(pos-ed.out_base), src+(from-md), (size_t)(to-from));
+		done += (size_t)(to-from);
+	}
+	return done == bytes ? 0 : -1;
+}
+
+/* Keep the first info frame at the beginning to update it at the end,
+   drop all others. */
+static int edit_info( unsigned long header, const unsigned char *body
+,	size_t bytes, enum info_tag tag )
+{
+	unsigned char *frame;
+	size_t xo, lo;
+
+	if(tag != XING_TAG)
+	{
+		if(param.verbose)
+			fprintf(stderr, "Dropping VBRI info frame.\n");
+		return 0;
+	}
+	if(!(frame = malloc(bytes+4)))
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return -1;
+	}
+	header_bytes(header, frame);
+	memcpy(frame+4, body, bytes);
+	xo = 4 + CRC_BYTES(header) + side_bytes(header);
+	lo = lame_offset(frame, bytes+4, xo);
+	if(lo)
+		ed.padding = (frame[lo+22] & 0xf)<<8 | frame[lo+23];
+	if(!ed.info && OUT_POS == 0)
+	{
+		if(ed.seekable)
+		{
+			ed.info = frame;
+			ed.info_bytes = bytes+4;
+			ed.xing_off = xo;
+			ed.lame_off = lo;
+			ed.delay = lo ? frame[lo+21]<<4 | frame[lo+22]>>4 : 0;
+			return edit_out(frame, bytes+4);
+		}
+		fprintf( stderr, "Note: Output not seekable, leaving out the info frame"
+			" that would need updating at the end.\n");
+	}
+	else if(param.verbose)
+		fprintf(stderr, "Dropping info frame of later input.\n");
+	free(frame);
+	return 0;
+}
+
+static int edit_frame( unsigned long header, const unsigned char *body
+,	size_t bytes, int first )
+{
+	size_t area = 0;
+	size_t area_len = 0;
+	size_t used = 0;
+	long begin = 0;
+
+	if(first)
+	{
+		enum info_tag tag = info_tag(header, body, bytes);
+		ed.res_fill = 0;
+		ed.discontinuity = TRUE;
+		ed.padding = 0;
+		if(tag != NO_TAG)
+			return edit_info(header, body, bytes, tag);
+	}
+	if(LAYER(header) == 3 && CRC_BYTES(header) + side_bytes(header) < bytes)
+	{
+		area = CRC_BYTES(header) + side_bytes(header);
+		area_len = bytes - area;
+		main_data(header, body+CRC_BYTES(header), &begin, &used);
+	}
+	if(cut_frame(ed.frame++))
+	{
+		if(ed.frame == 1)
+			ed.first_cut = TRUE;
+		ed.last_cut = TRUE;
+		ed.discontinuity = TRUE;
+		res_add(body+area, area_len);
+		return 0;
+	}
+	ed.last_cut = FALSE;
+	if(ed.discontinuity && begin > 0 && area_len && (size_t)begin <= ed.res_fill)
+	{
+		while(ed.md_len - ed.md_used < begin)
+			if(put_filler(header, bytes))
+				return -1;
+		if(patch_reservoir((size_t)begin))
+			fprintf( stderr, "Warning: Cannot put reservoir bytes for frame %li"
+				", expect a glitch.\n", ed.frame-1 );
+	}
+	ed.discontinuity = FALSE;
+	res_add(body+area, area_len);
+	if(area_len && ed.md_len - begin + (off_t)used > ed.md_used)
+		ed.md_used = ed.md_len - begin + (off_t)used;
+	return edit_frame_out(header, body, bytes, area, area_len);
+}
+
+/* Frame count, byte count, seek table and LAME tag for the edited stream. */
+static void update_info(off_t total)
+{
+	unsigned char *frame = ed.info;
+	unsigned long flags = get_be32(frame+ed.xing_off+4);
+	size_t p = ed.xing_off + 8;
+
+	if(flags & 1)
+	{
+		put_be32(frame+p, (unsigned long)ed.out_frames);
+		p += 4;
+	}
+	if(flags & 2)
+	{
+		put_be32(frame+p, (unsigned long)total);
+		p += 4;
+	}
+	if(flags & 4)
+	{
+		int i;
+		for(i=0; i<100; ++i)
+		{
+			double val = ed.out_frames
+			?	256.*ed.offsets[(long)((double)i*ed.out_frames/100)]/total
+			:	0.;
+			frame[p+i] = val > 255. ? 255 : (unsigned char)val;
+		}
+	}
+	if(ed.lame_off)
+	{
+		unsigned char *lame = frame + ed.lame_off;
+		long delay = ed.first_cut
+		?	ed.lead_fillers*frame_samples(get_be32(frame))
+		:	ed.delay;
+		int padding = ed.last_cut ? 0 : ed.padding;
+		if(delay > 4095)
+			delay = 4095;
+		lame[21] = (unsigned char)(delay>>4);
+		lame[22] = (unsigned char)((delay & 0xf)<<4 | padding>>8);
+		lame[23] = (unsigned char)(padding & 0xff);
+		put_be32(lame+28, (unsigned long)total);
+		lame[32] = ed.music_crc>>8;
+		lame[33] = ed.music_crc & 0xff;
+		ed.music_crc = crc16(0, frame, ed.lame_off+34);
+		lame[34] = ed.music_crc>>8;
+		lame[35] = ed.music_crc & 0xff;
+	}
+}
+
+static int edit_finish(void)
+{
+	int err = 0;
+
+	music_crc(outfill);
+	if(ed.info)
+	{
+		update_info(OUT_POS);
+		if(ed.out_base == 0)
+			memcpy(outbuf, ed.info, ed.info_bytes);
+	}
+	err = write_all(outbuf, outfill);
+	outfill = 0;
+#ifdef HAVE_PWRITE
+	if(!err && ed.info && ed.out_base > 0)
+	{
+		ssize_t got;
+		while( (got = pwrite(STDOUT_FILENO, ed.info, ed.info_bytes, ed.out_start)) < 0
+		&&	errno == EINTR ) {}
+		if(got != (ssize_t)ed.info_bytes)
+		{
+			fprintf(stderr, "Cannot update info frame: %s\n"
+			,	got < 0 ? strerror(errno) : "short write");
+			err = -1;
+		}
+	}
+#endif
+	if(param.verbose)
+		fprintf( stderr, "Wrote %li audio frames, %li of them silent fillers.\n"
+		,	ed.out_frames, ed.fillers );
+	return err;
+}
+
+/* Pass on the frames of one input. */
+static int strip_input(mpg123_handle *m, int fd, int editing, size_t *count)
 {
 	int ret;
-	size_t count = 0;
-	ret = mpg123_open_fd(m, STDIN_FILENO);
-	if(ret != MPG123_OK) return ret;
+	int err = 0;
+	int first = TRUE;
+#ifdef COPY_RUNS
+	int runs = !editing && runs_possible(fd);
+	off_t run_start = 0;
+	off_t run_end = 0;
+	size_t run_count = 0;
+#endif
 
-	while( (ret = mpg123_framebyframe_next(m)) == MPG123_OK || ret == MPG123_NEW_FORMAT )
+	while( !err
+	&&	((ret = mpg123_framebyframe_next(m)) == MPG123_OK || ret == MPG123_NEW_FORMAT) )
 	{
 		unsigned long header;
 		unsigned char *bodydata;
 		size_t bodybytes;
 		if(mpg123_framedata(m, &header, &bodydata, &bodybytes) == MPG123_OK)
 		{
-			/* Need to extract the 4 header bytes from the native storage in the correct order. */
-			unsigned char hbuf[4];
-			int i;
-			for(i=0; i<4; ++i) hbuf[i] = (unsigned char) ((header >> ((3-i)*8)) & 0xff);
-
-			/* Now write out both header and data, fire and forget. */
-			write(STDOUT_FILENO, hbuf, 4);
-			write(STDOUT_FILENO, bodydata, bodybytes);
+			if(editing)
+				err = edit_frame(header, bodydata, bodybytes, first);
+			else
+#ifdef COPY_RUNS
+			if(runs)
+			{
+				off_t pos = mpg123_framepos(m);
+				if(pos != run_end)
+				{
+					/* Something else in between, the run ends. */
+					if(run_end > run_start)
+					{
+						err = copy_run(fd, run_start, run_end);
+						++run_count;
+					}
+					run_start = pos;
+				}
+				run_end = pos + 4 + (off_t)bodybytes;
+			}
+			else
+#endif
+			{
+				unsigned char hbuf[4];
+				header_bytes(header, hbuf);
+				err = put_out(hbuf, 4) || put_out(bodydata, bodybytes);
+			}
+			first = FALSE;
 			if(param.verbose)
 			fprintf(stderr, "%"SIZE_P": header 0x%08lx, %"SIZE_P" body bytes\n"
-			, (size_p)++count, header, (size_p)bodybytes);
+			, (size_p)++*count, header, (size_p)bodybytes);
 		}
 	}
-
-	if(ret != MPG123_DONE)
+#ifdef COPY_RUNS
+	if(!err && run_end > run_start)
+	{
+		err = copy_run(fd, run_start, run_end);
+		++run_count;
+	}
+	if(param.verbose && runs)
+		fprintf(stderr, "Copied as %"SIZE_P" runs from the input file.\n"
+		,	(size_p)run_count);
+#endif
+	if(!err && ret != MPG123_DONE)
 	fprintf(stderr, "Some error occured (non-fatal?): %s\n", mpg123_strerror(m));
 
+	return err;
+}
+
+int do_work(mpg123_handle *m, int inputs, char **names)
+{
+	int ret = MPG123_OK;
+	int err = 0;
+	int editing = cut_count || inputs > 1;
+	size_t count = 0;
+	int i;
+
+	if(!(outbuf = malloc(OUT_BLOCK)))
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return MPG123_OUT_OF_MEM;
+	}
+	if(editing)
+	{
+		ed.out_start = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+#ifdef HAVE_PWRITE
+		ed.seekable = ed.out_start >= 0;
+#endif
+		if(param.verbose)
+			fprintf( stderr, "Editing %i input(s) with %i cut(s).\n"
+			,	inputs ? inputs : 1, cut_count );
+	}
+
+	for(i=0; !err && ret == MPG123_OK && i<(inputs ? inputs : 1); ++i)
+	{
+		int fd = STDIN_FILENO;
+		if(inputs && (fd = compat_open(names[i], O_RDONLY)) < 0)
+		{
+			fprintf(stderr, "Cannot open %s: %s\n", names[i], strerror(errno));
+			err = -1;
+			break;
+		}
+		if(param.verbose && inputs)
+			fprintf(stderr, "Input: %s\n", names[i]);
+		ret = mpg123_open_fd(m, fd);
+		if(ret == MPG123_OK)
+			err = strip_input(m, fd, editing, &count);
+		mpg123_close(m);
+		if(inputs)
+			compat_close(fd);
+	}
+	if(!err && ret == MPG123_OK)
+		err = editing ? edit_finish() : flush_out();
+	free(outbuf);
+	outbuf = NULL;
+	free(ed.offsets);
+	free(ed.info);
+
+	if(ret != MPG123_OK)
+		return ret;
+	if(err)
+		return MPG123_ERR;
+
 	if(param.verbose) fprintf(stderr, "Done with %"SIZE_P" MPEG frames.\n"
 	, (size_p)count);
 
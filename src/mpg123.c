@@ -27,6 +27,14 @@
 #include <sched.h>
 #endif
 
+/* Parallel batch decoding forks one process per track. */
+#if !defined(WIN32) && !defined(GENERIC) && defined(HAVE_SYS_WAIT_H)
+#define PARALLEL_JOBS
+#define BATCH_MODE (param.jobs > 1 || param.segments > 1)
+#else
+#define BATCH_MODE 0
+#endif
+
 /* be paranoid about setpriority support */
 #ifndef PRIO_PROCESS
 #undef HAVE_SETPRIORITY
@@ -41,6 +49,10 @@
 #include "metaprint.h"
 #include "httpget.h"
 #include "streamdump.h"
+#include "rtpget.h"
+#include "prefetch.h"
+#include "crossfade.h"
+#include "mixer.h"
 
 #include "debug.h"
 
@@ -116,6 +128,24 @@ struct parameter param = {
 	,0 /* ICY interval */
 	,"mpg123" /* name */
 	,0. /* device buffer */
+	,1 /* jobs */
+	,0 /* file buffer */
+	,0. /* preload time */
+	,0. /* refill time */
+	,0 /* prefetch */
+	,0. /* crossfade */
+	,0 /* mixer */
+	,0 /* mixer threads */
+	,0.1 /* stat interval */
+	,FALSE /* machine stat */
+	,256 /* stream dump buffer */
+	,0 /* stream dump chunk */
+	,0 /* rtprio */
+	,0 /* cpumask */
+	,0 /* output rtprio */
+	,0 /* output cpumask */
+	,FALSE /* lock memory */
+	,1 /* segments */
 };
 
 mpg123_handle *mh = NULL;
@@ -156,6 +186,28 @@ static size_t prebuffer_size = 0;
 static size_t prebuffer_fill = 0;
 static size_t minbytes = 0;
 
+#if !defined(WIN32) && !defined(GENERIC)
+#define STARTUP_TRACE
+/* Launch time for the startup trace with -v, cleared after the first audio. */
+static struct timeval launch_time;
+static int startup_traced = TRUE;
+#endif
+
+/* Tell how long the way to the first sound takes, step by step. */
+static void startup_trace(const char *what)
+{
+#ifdef STARTUP_TRACE
+	struct timeval now;
+
+	if(startup_traced || !param.verbose || param.quiet)
+		return;
+	gettimeofday(&now, NULL);
+	fprintf( stderr, "Startup: %s after %.1f ms\n", what
+	,	1e3*(now.tv_sec - launch_time.tv_sec)
+	+	1e-3*(now.tv_usec - launch_time.tv_usec) );
+#endif
+}
+
 void set_intflag()
 {
 	debug("set_intflag TRUE");
@@ -241,6 +293,7 @@ static void controlled_drain(void)
 	size_t drain_block;
 
 	play_prebuffer();
+	crossfade_flush(ao);
 
 	if(intflag || !out123_buffered(ao))
 		return;
@@ -272,8 +325,11 @@ void safe_exit(int code)
 		free(prebuffer);
 
 	dump_close();
+	track_prefetch_exit();
 	if(!code)
 		controlled_drain();
+	crossfade_exit();
+	mixer_exit();
 	if(intflag)
 		out123_drop(ao);
 	out123_del(ao);
@@ -350,6 +406,31 @@ static void set_output_l(char *a)
 	set_output_flag(OUT123_LINE_OUT);
 }
 
+static void set_output_native(char *a)
+{
+	set_output_flag(OUT123_NATIVE);
+}
+
+static void set_output_drift(char *a)
+{
+	set_output_flag(OUT123_DRIFT);
+}
+
+static void set_buffer_prefault(char *a)
+{
+	set_output_flag(OUT123_BUFFER_PREFAULT);
+}
+
+static void set_buffer_lock(char *a)
+{
+	set_output_flag(OUT123_BUFFER_LOCK);
+}
+
+static void set_buffer_huge(char *a)
+{
+	set_output_flag(OUT123_BUFFER_HUGE);
+}
+
 static void set_output(char *arg)
 {
 	/* If single letter, it's the legacy output switch for AIX/HP/Sun.
@@ -419,6 +500,34 @@ static void set_out_stdout1(char *arg)
 	param.output_device = NULL;
 }
 
+static long parse_cpus(char *arg)
+{
+	long mask = cpu_list_mask(arg);
+	if(mask < 0)
+	{
+		error1("\"%s\" is no valid CPU list", arg);
+		safe_exit(1);
+	}
+	return mask;
+}
+
+static void set_cpus(char *arg)
+{
+	param.cpumask = parse_cpus(arg);
+}
+
+static void set_output_cpus(char *arg)
+{
+	param.output_cpumask = parse_cpus(arg);
+}
+
+/* A forked buffer process needs to lock its own memory. */
+static void set_lock_memory(char *arg)
+{
+	param.lock_memory = TRUE;
+	set_output_flag(OUT123_BUFFER_LOCK);
+}
+
 #if !defined (HAVE_SCHED_SETSCHEDULER) && !defined (HAVE_WINDOWS_H)
 static void realtime_not_compiled(char *arg)
 {
@@ -426,6 +535,17 @@ static void realtime_not_compiled(char *arg)
 }
 #endif
 
+#ifndef PARALLEL_JOBS
+static void jobs_not_compiled(char *arg)
+{
+	fprintf(stderr,"Option '-j / --jobs' not compiled into this binary.\n");
+}
+static void segments_not_compiled(char *arg)
+{
+	fprintf(stderr,"Option '--segments' not compiled into this binary.\n");
+}
+#endif
+
 static int frameflag; /* ugly, but that's the way without hacking getlopt */
 static void set_frameflag(char *arg)
 {
@@ -508,6 +628,8 @@ topt opts[] = {
 	{'c', "check",       GLO_INT,  0, &param.checkrange, TRUE},
 	{'v', "verbose",     0,        set_verbose, 0,           0},
 	{'q', "quiet",       0,        set_quiet,   0,           0},
+	{0, "stat-interval", GLO_ARG|GLO_DOUBLE, 0, &param.stat_interval, 0},
+	{0, "machine-stat",  GLO_INT,  0, &param.machine_stat, TRUE},
 	{'y', "no-resync",      GLO_INT,  set_frameflag, &frameflag, MPG123_NO_RESYNC},
 	/* compatibility, no-resync is to be used nowadays */
 	{0, "resync",      GLO_INT,  set_frameflag, &frameflag, MPG123_NO_RESYNC},
@@ -543,6 +665,8 @@ topt opts[] = {
 	{'b', "buffer",      GLO_ARG | GLO_LONG, 0, &param.usebuffer,  0},
 	{0,  "smooth",      GLO_INT,  0, &param.smooth, 1},
 	{0, "preload", GLO_ARG|GLO_DOUBLE, 0, &param.preload, 0},
+	{0, "preload-time", GLO_ARG|GLO_DOUBLE, 0, &param.preload_time, 0},
+	{0, "refill-time", GLO_ARG|GLO_DOUBLE, 0, &param.refill_time, 0},
 #endif
 	{'R', "remote",      GLO_INT,  0, &param.remote, TRUE},
 	{0,   "remote-err",  GLO_INT,  0, &param.remote_err, TRUE},
@@ -568,6 +692,7 @@ topt opts[] = {
 	#endif
 	{0, "cpu", GLO_ARG | GLO_CHAR, 0, &param.cpu,  0},
 	{0, "test-cpu",  GLO_INT,  0, &param.test_cpu, TRUE},
+	{0, "pipeline", GLO_INT, set_frameflag, &frameflag, MPG123_PIPELINE},
 	{0, "list-cpu", GLO_INT,  0, &param.list_cpu , 1},
 #ifdef NETWORK
 	{'u', "auth",        GLO_ARG | GLO_CHAR, 0, &httpauth,   0},
@@ -581,6 +706,13 @@ topt opts[] = {
 	#ifdef HAVE_WINDOWS_H
 	{0, "priority", GLO_ARG | GLO_INT, 0, &param.w32_priority, 0},
 	#endif
+	{0, "rtprio", GLO_ARG|GLO_INT, 0, &param.rtprio, 0},
+	{0, "cpus", GLO_ARG|GLO_CHAR, set_cpus, 0, 0},
+	{0, "mlockall", 0, set_lock_memory, 0, 0},
+#ifndef NOXFERMEM
+	{0, "output-rtprio", GLO_ARG|GLO_INT, 0, &param.output_rtprio, 0},
+	{0, "output-cpus", GLO_ARG|GLO_CHAR, set_output_cpus, 0, 0},
+#endif
 	{0, "title",         GLO_INT,  0, &param.xterm_title, TRUE },
 	{'w', "wav",         GLO_ARG | GLO_CHAR, set_out_wav, 0, 0 },
 	{0, "cdr",           GLO_ARG | GLO_CHAR, set_out_cdr, 0, 0 },
@@ -606,6 +738,9 @@ topt opts[] = {
 	{0, "loop", GLO_ARG | GLO_LONG, 0, &param.loop, 0},
 	{'i', "index", GLO_INT, 0, &param.index, 1},
 	{'D', "delay", GLO_ARG | GLO_INT, 0, &param.delay, 0},
+	{0, "crossfade", GLO_ARG|GLO_DOUBLE, 0, &param.crossfade, 0},
+	{0, "mixer", GLO_INT, 0, &param.mixer, TRUE},
+	{0, "mixer-threads", GLO_ARG|GLO_LONG, 0, &param.mixer_threads, 0},
 	{0, "resync-limit", GLO_ARG | GLO_LONG, 0, &param.resync_limit, 0},
 	{0, "pitch", GLO_ARG|GLO_DOUBLE, 0, &param.pitch, 0},
 #ifdef NETWORK
@@ -617,14 +752,35 @@ topt opts[] = {
 	{0, "fuzzy", GLO_INT,  set_frameflag, &frameflag, MPG123_FUZZY},
 	{0, "index-size", GLO_ARG|GLO_LONG, 0, &param.index_size, 0},
 	{0, "no-seekbuffer", GLO_INT, unset_frameflag, &frameflag, MPG123_SEEKBUFFER},
+	{0, "mmap", GLO_INT, set_frameflag, &frameflag, MPG123_MMAP},
+	{0, "check-crc", GLO_INT, set_frameflag, &frameflag, MPG123_CHECK_CRC},
+	{0, "conceal", GLO_INT, set_frameflag, &frameflag, MPG123_CONCEAL},
+	{0, "prefetch", GLO_ARG|GLO_LONG, 0, &param.prefetch, 0},
 	{'e', "encoding", GLO_ARG|GLO_CHAR, 0, &param.force_encoding, 0},
 	{0, "preframes", GLO_ARG|GLO_LONG, 0, &param.preframes, 0},
 	{0, "skip-id3v2", GLO_INT, set_frameflag, &frameflag, MPG123_SKIP_ID3V2},
 	{0, "streamdump", GLO_ARG|GLO_CHAR, 0, &param.streamdump, 0},
+	{0, "streamdump-buffer", GLO_ARG|GLO_LONG, 0, &param.streamdump_buffer, 0},
+	{0, "streamdump-chunk", GLO_ARG|GLO_LONG, 0, &param.streamdump_chunk, 0},
 	{0, "icy-interval", GLO_ARG|GLO_LONG, 0, &param.icy_interval, 0},
 	{0, "ignore-streamlength", GLO_INT, set_frameflag, &frameflag, MPG123_IGNORE_STREAMLENGTH},
 	{0, "name", GLO_ARG|GLO_CHAR, 0, &param.name, 0},
 	{0, "devbuffer", GLO_ARG|GLO_DOUBLE, 0, &param.device_buffer, 0},
+	{0, "filebuffer", GLO_ARG|GLO_LONG, 0, &param.file_buffer, 0},
+	{0, "native", 0, set_output_native, 0, 0},
+#ifndef NOXFERMEM
+	{0, "drift", 0, set_output_drift, 0, 0},
+	{0, "buffer-prefault", 0, set_buffer_prefault, 0, 0},
+	{0, "buffer-lock", 0, set_buffer_lock, 0, 0},
+	{0, "buffer-huge", 0, set_buffer_huge, 0, 0},
+#endif
+#ifdef PARALLEL_JOBS
+	{'j', "jobs", GLO_ARG|GLO_LONG, 0, &param.jobs, 0},
+	{0, "segments", GLO_ARG|GLO_LONG, 0, &param.segments, 0},
+#else
+	{'j', "jobs", GLO_ARG|GLO_CHAR, jobs_not_compiled, 0, 0},
+	{0, "segments", GLO_ARG|GLO_CHAR, segments_not_compiled, 0, 0},
+#endif
 	{0, 0, 0, 0, 0, 0}
 };
 
@@ -690,6 +846,23 @@ int open_track(char *fname)
 		error1("Cannot set ICY interval: %s", mpg123_strerror(mh));
 		if(param.verbose > 1) fprintf(stderr, "Info: ICY interval %li\n", (long)htd.icy_interval);
 	}
+	else if(rtp_url(fname)) /* RTP or UDP, unicast or multicast */
+	{
+		if((filept = rtp_open(fname)) < 0)
+			return 0;
+		network_sockets_used = 1;
+		/* The stream dump reads through rtp_read(), too. */
+		if( !param.streamdump
+		&&  MPG123_OK != mpg123_replace_reader(mh, rtp_read, NULL) )
+		{
+			error1("Cannot set up reader: %s", mpg123_strerror(mh));
+			rtp_close(filept);
+			close(filept);
+			filept = -1;
+			return 0;
+		}
+		return open_track_fd();
+	}
 
 	if(param.icy_interval > 0)
 	{
@@ -698,6 +871,22 @@ int open_track(char *fname)
 		if(param.verbose > 1) fprintf(stderr, "Info: Forced ICY interval %li\n", param.icy_interval);
 	}
 
+#if !defined (WANT_WIN32_SOCKETS)
+	/* Seekable HTTP resources need their own reader functions.
+	   The stream dump has its own reader, without seeking over HTTP. */
+	if( !param.streamdump && MPG123_OK != mpg123_replace_reader( mh
+	,	http_seekable(filept) ? http_read : NULL
+	,	http_seekable(filept) ? http_seek : NULL ) )
+		error1("Cannot set up reader: %s", mpg123_strerror(mh));
+	/* The ID3v1 tag would be another request before the first frame. */
+	mpg123_param( mh, MPG123_PEEK_END_LATER
+	,	!param.streamdump && http_seekable(filept), 0 );
+#endif
+	/* A local file might have been opened in the background already. */
+	if( filept < 0 && param.prefetch > 0 && !param.streamdump
+	&&  !(param.flags & MPG123_MMAP) )
+		filept = track_prefetch_take(mh, fname);
+
 	debug("OK... going to finally open.");
 	/* Now hook up the decoder on the opened stream or the file. */
 	if(filept > -1)
@@ -726,20 +915,52 @@ void close_track(void)
 	return;
 #endif
 	network_sockets_used = 0;
+	http_close(filept);
+	rtp_close(filept);
 	if(filept > -1) close(filept);
 	filept = -1;
 }
 
+/* Decode the next frame right into the memory of the output buffer,
+   sparing the copy into it. Returns the region to commit, with mc, audio
+   and bytes as from mpg123_decode_frame(), or NULL if nothing happened. */
+static void *decode_direct(int *mc, unsigned char **audio, size_t *bytes)
+{
+	void *region;
+	size_t size = mpg123_outblock(mh);
+	size_t frames = 0;
+
+	if(out123_play_begin(ao, &region, &size) != OUT123_OK)
+		return NULL;
+	*mc = mpg123_decode_frames(mh, region, size, NULL, 1, &frames, bytes);
+	if(*mc == MPG123_NO_SPACE)
+	{
+		out123_play_commit(ao, 0);
+		return NULL;
+	}
+	/* The decoder already counts the frame as done. */
+	framenum = mpg123_tellframe(mh) - (frames ? 1 : 0);
+	*audio = region;
+	return region;
+}
+
 /* return 1 on success, 0 on failure */
 int play_frame(void)
 {
 	unsigned char *audio;
+	void *region = NULL;
 	int mc;
 	size_t bytes = 0;
 	debug("play_frame");
-	mc = mpg123_decode_frame(mh, &framenum, &audio, &bytes);
+	/* Played data must not get in between, as held or postponed audio. */
+	if(param.usebuffer && !prebuffer_fill && !crossfade_active())
+		region = decode_direct(&mc, &audio, &bytes);
+	if(!region)
+		mc = mpg123_decode_frame(mh, &framenum, &audio, &bytes);
 	mpg123_getstate(mh, MPG123_FRESH_DECODER, &new_header, NULL);
 
+	/* The end of a track might be held back for mixing with the next. */
+	crossfade_audio(mh, ao, audio, &bytes);
 	/* Play what is there to play (starting with second decode_frame call!) */
 	if(bytes)
 	{
@@ -804,13 +1025,32 @@ int play_frame(void)
 		/* Interrupt here doesn't necessarily interrupt out123_play().
 		   I wonder if that makes us miss errors. Actual issues should
 		   just be postponed. */
-		if(bytes && !intflag) /* Previous piece could already be interrupted. */
-		if(out123_play(ao, playbuf, bytes) < bytes && !intflag)
+		if(region)
 		{
-			error("Deep trouble! Cannot flush to my output anymore!");
-			safe_exit(133);
+			/* Already there, only to be handed over. */
+			region = NULL;
+			if(out123_play_commit(ao, bytes) < bytes && !intflag)
+			{
+				error("Deep trouble! Cannot flush to my output anymore!");
+				safe_exit(133);
+			}
 		}
+		else if(bytes && !intflag) /* Previous piece could already be interrupted. */
+		{
+			if(out123_play(ao, playbuf, bytes) < bytes && !intflag)
+			{
+				error("Deep trouble! Cannot flush to my output anymore!");
+				safe_exit(133);
+			}
+		}
+		startup_trace("first audio played");
+#ifdef STARTUP_TRACE
+		startup_traced = TRUE;
+#endif
 	}
+	/* Nothing to play from the region, maybe postponed. */
+	if(region)
+		out123_play_commit(ao, 0);
 	/* Special actions and errors. */
 	if(mc != MPG123_OK)
 	{
@@ -846,7 +1086,9 @@ int play_frame(void)
 				,	rate, channels, encname ? encname : "???" );
 			}
 			new_header = TRUE;
+			crossfade_format(ao, rate, channels, encoding);
 			check_fatal_output(out123_start(ao, rate, channels, encoding));
+			startup_trace("output started");
 			/* We may take some time feeding proper data, so pause by default. */
 			out123_pause(ao);
 		}
@@ -863,6 +1105,39 @@ int play_frame(void)
 	return 1;
 }
 
+/* Play all tracks of the playlist at once, mixed together. */
+static int run_mix(void)
+{
+	size_t tracks = 0;
+	size_t i;
+	int playing = 0;
+	int ret = 0;
+
+	if(mixer_init(param.force_rate, param.mixer_threads))
+	{
+		error("cannot set up the mixer");
+		return 1;
+	}
+	/* Each entry once, looping makes no sense here. */
+	playlist_pos(&tracks, NULL);
+	for(i=0; i<tracks; ++i)
+	{
+		char *fname = get_next_file();
+		if(!fname)
+			break;
+		if(mixer_add(fname) < 0)
+			ret = 1;
+		else if(!param.quiet)
+			fprintf(stderr, "Mixing: %s\n", fname);
+	}
+	while(!intflag && (playing = mixer_play(ao, NULL)) > 0)
+		;
+	if(playing < 0)
+		ret = 1;
+	mixer_clear();
+	return ret;
+}
+
 /* Return TRUE if we should continue (second interrupt happens quickly), skipping tracks, or FALSE if we should die. */
 #if !defined(WIN32) && !defined(GENERIC)
 int skip_or_die(struct timeval *start_time)
@@ -917,6 +1192,212 @@ int skip_or_die(struct timeval *start_time)
 #define skip_or_die(a) TRUE
 #endif
 
+#ifdef PARALLEL_JOBS
+/* Output name for one track in batch mode: The first %s in the pattern is
+   replaced by the track's file name without directory and suffix.
+   NULL pattern (test output) stays NULL. */
+static char *job_outname(const char *pattern, const char *fname)
+{
+	const char *base, *pos;
+	size_t baselen;
+	char *name;
+
+	if(!pattern)
+		return NULL;
+	pos  = strstr(pattern, "%s");
+	base = strrchr(fname, '/');
+	base = base ? base+1 : fname;
+	baselen = strlen(base);
+	if(strrchr(base, '.') > base)
+		baselen = strrchr(base, '.') - base;
+	name = malloc(strlen(pattern) - 2 + baselen + 1);
+	if(!name)
+		return NULL;
+	memcpy(name, pattern, pos-pattern);
+	memcpy(name+(pos-pattern), base, baselen);
+	strcpy(name+(pos-pattern)+baselen, pos+2);
+	return name;
+}
+
+static double wall_since(struct timeval *start)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + 1e-6*(now.tv_usec - start->tv_usec);
+}
+
+/* Decode a seekable HTTP resource in one go, with param.segments byte
+   ranges fetched and decoded at once, each over its own connection.
+   Returns -1 if the track is not such a resource, else the exit code. */
+static int job_segments(char *fname, double *secs)
+{
+	unsigned char *audio = NULL;
+	size_t bytes = 0;
+	size_t framebytes;
+	long rate;
+	int channels, encoding;
+	int ret;
+	mpg123_threads *pool;
+	void *io = http_handle(filept);
+
+	if(!io)
+		return -1;
+	if(mpg123_reader64( mh, http_handle_read, http_handle_seek
+	,	http_handle_close ) != MPG123_OK)
+	{
+		http_handle_close(io);
+		return -1;
+	}
+	/* Waiting for the network, not the CPUs, so threads for all of them. */
+	pool = mpg123_threads_new((int)param.segments, NULL);
+	mpg123_use_threads(mh, pool);
+	mpg123_param(mh, MPG123_SCAN_THREADS, param.segments, 0);
+	ret = mpg123_decode_parallel_handle( mh, io, http_handle_dup
+	,	(int)param.segments, &audio, &bytes );
+	mpg123_use_threads(mh, NULL);
+	mpg123_threads_delete(pool);
+	if(  ret != MPG123_OK
+	  || mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK )
+	{
+		error2("%s: segmented decoding failed: %s", fname, mpg123_strerror(mh));
+		return 1;
+	}
+	framebytes = (size_t)channels*mpg123_encsize(encoding);
+	*secs = (double)(bytes/framebytes)/rate;
+	out123_param_int(ao, OUT123_FILELENGTH, (long)(bytes/framebytes));
+	if(  out123_start(ao, rate, channels, encoding)
+	  || out123_play(ao, audio, bytes) < bytes )
+	{
+		error2("%s: output failed: %s", fname, out123_strerror(ao));
+		free(audio);
+		return 1;
+	}
+	free(audio);
+	out123_drain(ao);
+	return 0;
+}
+
+/* Decode one track to its own output, in the forked job process.
+   Returns the exit code for the job. */
+static int job_track(char *fname, const char *outname, int report)
+{
+	struct timeval start;
+	double secs = 0.;
+	double wall;
+	int segmented;
+
+	gettimeofday(&start, NULL);
+	if(out123_open(ao, param.output_module, outname))
+	{
+		error2( "cannot open output %s: %s", outname ? outname : "<none>"
+		,	out123_strerror(ao) );
+		return 1;
+	}
+	out123_getparam_int(ao, OUT123_PROPFLAGS, &output_propflags);
+	audio_capabilities(ao, mh);
+	if(!open_track(fname))
+		return 1;
+	segmented = param.segments > 1 && param.start_frame <= 0
+	&&	param.frame_number < 0 ? job_segments(fname, &secs) : -1;
+	if(segmented < 0)
+	{
+		/* One track per file: Let the output reserve the space. */
+		out123_param_int(ao, OUT123_FILELENGTH, (long)mpg123_length(mh));
+		if(param.start_frame > 0 && mpg123_seek_frame(mh, param.start_frame, SEEK_SET) < 0)
+		{
+			error2("%s: initial seek failed: %s", fname, mpg123_strerror(mh));
+			close_track();
+			return 1;
+		}
+		frames_left = param.frame_number;
+		while(!intflag && (param.frame_number < 0 || frames_left > 0))
+			if(!play_frame())
+				break;
+		if(!intflag)
+		{
+			play_prebuffer();
+			out123_drain(ao);
+		}
+		mpg123_position(mh, 0, 0, NULL, NULL, &secs, NULL);
+	}
+	close_track();
+	out123_close(ao);
+	wall = wall_since(&start);
+	if(report && segmented <= 0)
+		fprintf( stderr, "%s: %.2f s of audio in %.2f s (%.1fx realtime)\n"
+		,	fname, secs, wall, wall > 0. ? secs/wall : 0. );
+	return intflag || segmented > 0 ? 1 : 0;
+}
+
+/* Wait for one job to finish, recording failure in *ret.
+   Returns 0 when there was nothing to wait for. */
+static int job_wait(int *ret)
+{
+	int status;
+	pid_t pid;
+	while((pid = waitpid(-1, &status, 0)) < 0 && errno == EINTR)
+		;
+	if(pid < 0)
+		return 0;
+	if(!WIFEXITED(status) || WEXITSTATUS(status))
+		*ret = 1;
+	return 1;
+}
+
+/* Batch mode: Decode the playlist with up to param.jobs tracks at a time,
+   each in a child process with its own decoder and output. */
+static int run_jobs(void)
+{
+	struct timeval start;
+	char *fname;
+	long running = 0;
+	size_t tracks = 0;
+	int report = !param.quiet;
+	int ret = 0;
+
+	gettimeofday(&start, NULL);
+	while(!intflag && (fname = get_next_file()))
+	{
+		char *outname;
+		pid_t pid;
+
+		if(running >= param.jobs && job_wait(&ret))
+			--running;
+		outname = job_outname(param.output_device, fname);
+		if(param.output_device && !outname)
+		{
+			error("out of memory");
+			ret = 1;
+			break;
+		}
+		fflush(stdout);
+		pid = fork();
+		if(pid == 0)
+		{
+			/* The per-frame chatter of parallel jobs would be garbled. */
+			param.quiet = TRUE;
+			param.verbose = 0;
+			safe_exit(job_track(fname, outname, report));
+		}
+		free(outname);
+		if(pid < 0)
+		{
+			error1("cannot fork job: %s", strerror(errno));
+			ret = 1;
+			break;
+		}
+		++running;
+		++tracks;
+	}
+	while(running && job_wait(&ret))
+		--running;
+	if(report)
+		fprintf( stderr, "%"SIZE_P" tracks in %.2f s wall time with %li jobs\n"
+		,	(size_p)tracks, wall_since(&start), param.jobs );
+	return ret;
+}
+#endif
+
 int main(int sys_argc, char ** sys_argv)
 {
 	int result;
@@ -927,6 +1408,10 @@ int main(int sys_argc, char ** sys_argv)
 	mpg123_pars *mp;
 #if !defined(WIN32) && !defined(GENERIC)
 	struct timeval start_time;
+#endif
+#ifdef STARTUP_TRACE
+	gettimeofday(&launch_time, NULL);
+	startup_traced = FALSE;
 #endif
 	aux_out = stdout; /* Need to initialize here because stdout is not a constant?! */
 #if defined (WANT_WIN32_UNICODE)
@@ -1055,6 +1540,24 @@ int main(int sys_argc, char ** sys_argv)
 	}
 
 	if (loptind >= argc && !param.listname && !param.remote) usage(1);
+#ifdef PARALLEL_JOBS
+	if(BATCH_MODE)
+	{
+		/* Each job writes its own file, named after the track. */
+		if( param.remote
+		||	!( !strcmp(param.output_module, "test")
+		||	(param.output_device && strstr(param.output_device, "%s")) ) )
+		{
+			error( "--jobs and --segments need file output with %%s in the name "
+				"for the track, like -w %%s.wav, or -t" );
+			safe_exit(1);
+		}
+		param.usebuffer = 0;
+#ifdef HAVE_TERMIOS
+		param.term_ctrl = FALSE;
+#endif
+	}
+#endif
 	/* Init audio as early as possible.
 	   If there is the buffer process to be spawned, it shouldn't carry the mpg123_handle with it. */
 
@@ -1159,6 +1662,13 @@ int main(int sys_argc, char ** sys_argv)
 	    error("Can't get realtime priority\n");
 	}
 #endif
+	/* The buffer inherits these unless it has its own settings. */
+	if(param.rtprio)
+		set_rtprio(param.rtprio);
+	if(param.cpumask)
+		set_cpumask(param.cpumask);
+	if(param.lock_memory)
+		lock_memory();
 
 /* make sure not Cygwin, it doesn't need it */
 #if defined(WIN32) && defined(HAVE_WINDOWS_H)
@@ -1183,11 +1693,16 @@ int main(int sys_argc, char ** sys_argv)
 	( 0
 	||	out123_param_int(ao, OUT123_FLAGS, param.output_flags)
 	|| out123_param_float(ao, OUT123_PRELOAD, param.preload)
+	|| out123_param_float(ao, OUT123_PRELOADTIME, param.preload_time)
+	|| out123_param_float(ao, OUT123_REFILLTIME, param.refill_time)
 	|| out123_param_int(ao, OUT123_GAIN, param.gain)
 	|| out123_param_int(ao, OUT123_VERBOSE, param.verbose)
 	|| out123_param_string(ao, OUT123_NAME, param.name)
 	|| out123_param_string(ao, OUT123_BINDIR, binpath)
 	|| out123_param_float(ao, OUT123_DEVICEBUFFER, param.device_buffer)
+	|| out123_param_int(ao, OUT123_FILEBUFFER, param.file_buffer*1024)
+	|| out123_param_int(ao, OUT123_RTPRIO, param.output_rtprio)
+	|| out123_param_int(ao, OUT123_CPUMASK, param.output_cpumask)
 	)
 	{
 		if(!param.quiet)
@@ -1195,11 +1710,17 @@ int main(int sys_argc, char ** sys_argv)
 		safe_exit(98);
 	}
 	check_fatal_output(out123_set_buffer(ao, param.usebuffer*1024));
-	check_fatal_output(out123_open( ao
-	,	param.output_module, param.output_device ));
-	out123_getparam_int(ao, OUT123_PROPFLAGS, &output_propflags);
+	/* Batch jobs open their outputs themselves. */
+	if(!BATCH_MODE)
+	{
+		check_fatal_output(out123_open( ao
+		,	param.output_module, param.output_device ));
+		out123_getparam_int(ao, OUT123_PROPFLAGS, &output_propflags);
+		startup_trace("output opened");
+	}
 
 	if(!param.remote) prepare_playlist(argc, argv);
+	if(!param.remote) crossfade_setup(param.crossfade);
 
 #if !defined(WIN32) && !defined(GENERIC)
 	/* Remote mode is special... but normal console and terminal-controlled operation needs to catch the SIGINT.
@@ -1210,10 +1731,25 @@ int main(int sys_argc, char ** sys_argv)
 	/* Need to catch things to exit cleanly, not messing up the terminal. */
 	catchsignal(SIGTERM, catch_fatal_term);
 	catchsignal(SIGPIPE, catch_fatal_pipe);
+#endif
+#ifdef PARALLEL_JOBS
+	if(BATCH_MODE)
+	{
+		int ret = run_jobs();
+		free_playlist();
+		safe_exit(ret);
+	}
 #endif
 	/* Now either check caps myself or query buffer for that. */
 	audio_capabilities(ao, mh);
+	startup_trace("output formats known");
 
+	if(param.mixer && !param.remote)
+	{
+		int ret = run_mix();
+		free_playlist();
+		safe_exit(ret);
+	}
 	if(param.remote) {
 		int ret;
 		ret = control_generic(mh);
@@ -1264,6 +1800,10 @@ int main(int sys_argc, char ** sys_argv)
 			intflag = FALSE;
 			continue;
 		}
+		startup_trace("track opened");
+		crossfade_next();
+		if(param.prefetch > 0)
+			track_prefetch_start(peek_next_file(), (size_t)param.prefetch*1024);
 
 		if(!param.quiet) fprintf(stderr, "\n");
 		if(param.index)
@@ -1294,6 +1834,16 @@ int main(int sys_argc, char ** sys_argv)
 			mpg123_close(mh);
 			continue;
 		}
+		/* A single track in full: File output can write the final header
+		   right away, no need to seek back (think of a pipe). With gapless
+		   info or --index, the length is exact. */
+		{
+			size_t plfill;
+			playlist_pos(&plfill, NULL);
+			if( plfill == 1 && param.loop == 1 && !param.remote
+			&&	param.start_frame == 0 && param.frame_number < 0 )
+				out123_param_int(ao, OUT123_FILELENGTH, (long)mpg123_length(mh));
+		}
 
 		/* Prinout and xterm title need this, possibly independently. */
 		newdir = split_dir_file(fname ? fname : "standard input", &dirname, &filename);
@@ -1378,19 +1928,17 @@ int main(int sys_argc, char ** sys_argv)
 					mpg123_meta_free(mh); /* Do not waste memory after delivering. */
 				}
 			}
-			if(!fresh && param.verbose)
-			{
-				if(param.verbose > 1 || !(framenum & 0x7)) print_stat(mh,0,ao,1);
-			}
+			if(!fresh && (param.verbose || param.machine_stat) && stat_due())
+				print_stat(mh,0,ao,1);
 #ifdef HAVE_TERMIOS
 			if(!param.term_ctrl) continue;
 			else term_control(mh, ao);
 #endif
 		}
 
-	if(!param.smooth && !intflag)
+	if(!param.smooth && !intflag && !crossfade_held())
 		controlled_drain();
-	if(param.verbose) print_stat(mh,0,ao,0);
+	if(param.verbose || param.machine_stat) print_stat(mh,0,ao,0);
 
 	if(!param.quiet)
 	{
@@ -1507,12 +2055,16 @@ static void long_usage(int err)
 	fprintf(o," -n     --frames <n>       play only <n> frames of every stream\n");
 	fprintf(o,"        --fuzzy            Enable fuzzy seeks (guessing byte offsets or using approximate seek points from Xing TOC)\n");
 	fprintf(o," -y     --no-resync        DISABLES resync on error (--resync is deprecated)\n");
+	fprintf(o,"        --check-crc        verify CRC of protected frames, silence corrupted ones\n");
+	fprintf(o,"        --conceal          fade out the last good sound over damaged layer III frames\n");
 #ifdef NETWORK
 	fprintf(o," -p <f> --proxy <f>        set WWW proxy\n");
 	fprintf(o," -u     --auth             set auth values for HTTP access\n");
 	fprintf(o,"        --ignore-mime      ignore HTTP MIME types (content-type)\n");
 #endif
 	fprintf(o,"        --no-seekbuffer    disable seek buffer\n");
+	fprintf(o,"        --mmap             map input files into memory instead of reading\n");
+	fprintf(o,"        --prefetch <n>     read <n> kB of the next file while playing\n");
 	fprintf(o," -@ <f> --list <f>         play songs in playlist <f> (plain list, m3u, pls (shoutcast))\n");
 	fprintf(o," -l <n> --listentry <n>    play nth title in playlist; show whole playlist for n < 0\n");
 	fprintf(o,"        --continue         playlist continuation mode (see man page)\n");
@@ -1527,6 +2079,8 @@ static void long_usage(int err)
 	fprintf(o,"        --preframes  <n>   number of frames to decode in advance after seeking (to keep layer 3 bit reservoir happy)\n");
 	fprintf(o,"        --resync-limit <n> Set number of bytes to search for valid MPEG data; <0 means search whole stream.\n");
 	fprintf(o,"        --streamdump <f>   Dump a copy of input data (as read by libmpg123) to given file.\n");
+	fprintf(o,"        --streamdump-buffer <n> Write the dump from a buffer of <n> kB in the background (0: right away)\n");
+	fprintf(o,"        --streamdump-chunk <n>  Start a new dump file every <n> kB (name-001.ext, ...)\n");
 	fprintf(o,"        --icy-interval <n> Enforce ICY interval in bytes (for playing a stream dump.\n");
 	fprintf(o,"        --ignore-streamlength Ignore header info about length of MPEG streams.");
 	fprintf(o,"\noutput/processing options\n\n");
@@ -1538,11 +2092,14 @@ static void long_usage(int err)
 	fprintf(o," -w <f> --wav <f>          write samples as WAV file in <f> (- is stdout)\n");
 	fprintf(o,"        --au <f>           write samples as Sun AU file in <f> (- is stdout)\n");
 	fprintf(o,"        --cdr <f>          write samples as raw CD audio file in <f> (- is stdout)\n");
+	fprintf(o," -j <n> --jobs <n>         decode <n> tracks in parallel to files (%%s in file name for track)\n");
+	fprintf(o,"        --segments <n>     batch mode, HTTP resources in <n> ranges over parallel connections\n");
 	fprintf(o,"        --reopen           force close/open on audiodevice\n");
 	#ifdef OPT_MULTI
 	fprintf(o,"        --cpu <string>     set cpu optimization\n");
 	fprintf(o,"        --test-cpu         list optimizations possible with cpu and exit\n");
 	fprintf(o,"        --list-cpu         list builtin optimizations and exit\n");
+	fprintf(o,"        --pipeline         layer III synthesis on a second thread\n");
 	#endif
 	#ifdef OPT_3DNOW
 	fprintf(o,"        --test-3dnow       display result of 3DNow! autodetect and exit (obsoleted by --cpu)\n");
@@ -1575,21 +2132,34 @@ static void long_usage(int err)
 	fprintf(o,"        --no-gapless       disable gapless mode, not remove padding/junk\n");
 	fprintf(o,"        --no-infoframe     disable parsing of Xing/Lame/VBR/Info frame\n");
 	fprintf(o," -D n   --delay n          insert a delay of n seconds before each track\n");
+	fprintf(o,"        --crossfade <s>    blend <s> seconds of track ends into the next track\n");
+	fprintf(o,"        --mixer            play all tracks at the same time, mixed together\n");
+	fprintf(o,"        --mixer-threads <n> decode mixed tracks with <n> threads (default: one per CPU)\n");
 	fprintf(o," -o h   --headphones       (aix/hp/sun) output on headphones\n");
 	fprintf(o," -o s   --speaker          (aix/hp/sun) output on speaker\n");
 	fprintf(o," -o l   --lineout          (aix/hp/sun) output to lineout\n");
 #ifndef NOXFERMEM
 	fprintf(o," -b <n> --buffer <n>       set play buffer (\"output cache\")\n");
 	fprintf(o,"        --preload <value>  fraction of buffer to fill before playback\n");
+	fprintf(o,"        --preload-time <s> seconds to buffer before playback (overrides --preload)\n");
+	fprintf(o,"        --refill-time <s>  seconds to buffer again after an underrun\n");
 	fprintf(o,"        --smooth           keep buffer over track boundaries\n");
+	fprintf(o,"        --drift            resample slightly to keep buffer fill steady\n");
+	fprintf(o,"        --buffer-prefault  touch all buffer memory before playback\n");
+	fprintf(o,"        --buffer-lock      lock buffer memory in RAM (mlock)\n");
+	fprintf(o,"        --buffer-huge      back the buffer with huge pages\n");
 #endif
 	fprintf(o,"        --devbuffer <s>    set device buffer in seconds; <= 0 means default\n");
+	fprintf(o,"        --native           only use formats the device plays natively\n");
+	fprintf(o,"        --filebuffer <n>   write files in chunks of <n> kB\n");
 
 	fprintf(o,"\nmisc options\n\n");
 	fprintf(o," -t     --test             only decode, no output (benchmark)\n");
 	fprintf(o," -c     --check            count and display clipped samples\n");
 	fprintf(o," -v[*]  --verbose          increase verboselevel\n");
 	fprintf(o," -q     --quiet            quiet mode\n");
+	fprintf(o,"        --stat-interval <s> seconds between status line updates (0.1)\n");
+	fprintf(o,"        --machine-stat     plain STAT lines on stderr instead of the status line\n");
 	#ifdef HAVE_TERMIOS
 	fprintf(o," -C     --control          enable terminal control keys (else auto detect)\n");
 	fprintf(o,"        --no-control       disable terminal control keys (disable auto detect)\n");
@@ -1623,6 +2193,14 @@ static void long_usage(int err)
 	fprintf(o,"                           accepts -2 to 3 as integer arguments\n");
 	fprintf(o,"                           -2 as idle, 0 as normal and 3 as realtime.\n");
 	#endif
+	fprintf(o,"        --rtprio <n>       real-time priority n for decoding (and buffer),\n");
+	fprintf(o,"                           SCHED_FIFO for n > 0, SCHED_RR with -n for n < 0\n");
+	fprintf(o,"        --cpus <l>         run decoding (and buffer) on CPUs in list l (0,2-3)\n");
+	fprintf(o,"        --mlockall         lock all memory (also of buffer) in RAM\n");
+#ifndef NOXFERMEM
+	fprintf(o,"        --output-rtprio <n> real-time priority for the buffer, like --rtprio\n");
+	fprintf(o,"        --output-cpus <l>  CPU list for the buffer\n");
+#endif
 	fprintf(o," -?     --help             give compact help\n");
 	fprintf(o,"        --longhelp         give this long help listing\n");
 	fprintf(o,"        --version          give name / version string\n");
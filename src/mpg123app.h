@@ -108,6 +108,24 @@ struct parameter
 	long icy_interval;
 	const char* name; /* name for this player instance */
 	double device_buffer; /* output device buffer */
+	long jobs; /* number of tracks to decode in parallel (batch mode) */
+	long file_buffer; /* write buffer for file output in kB */
+	double preload_time; /* buffer preload in seconds, overriding preload */
+	double refill_time; /* buffer preload after underrun in seconds */
+	long prefetch; /* kB to read of the next track in the background */
+	double crossfade; /* seconds to mix the end of a track with the next */
+	int mixer; /* play all tracks at once, mixed */
+	long mixer_threads; /* decoder threads for mixing, <= 0 for one per CPU */
+	double stat_interval; /* seconds between status line updates */
+	int machine_stat; /* plain status lines for programs instead of the terminal */
+	long streamdump_buffer; /* kB for writing the stream dump in the background */
+	long streamdump_chunk; /* kB per stream dump file, 0 for just one file */
+	int rtprio; /* decoding: >0 SCHED_FIFO, <0 SCHED_RR priority */
+	long cpumask; /* CPU affinity for decoding, 0 for inherited */
+	int output_rtprio; /* the same for the buffer */
+	long output_cpumask;
+	int lock_memory; /* mlockall() */
+	long segments; /* byte ranges to fetch and decode at once (batch mode) */
 };
 
 enum mpg123app_flags
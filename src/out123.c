@@ -45,6 +45,10 @@
 #include <errno.h>
 #include <string.h>
 #include <time.h>
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <math.h>
 
 #ifdef HAVE_SCHED_H
 #include <sched.h>
@@ -87,11 +91,18 @@ static char *device = NULL;
 int also_stdout = FALSE;
 size_t buffer_kb = 0;
 static int realtime = FALSE;
+static int rtprio = 0;
+static long cpumask = 0;
+static int output_rtprio = 0;
+static long output_cpumask = 0;
+static int lock_all = FALSE;
 #ifdef HAVE_WINDOWS_H
 static int w32_priority = 0;
 #endif
 static int aggressive = FALSE;
 static double preload = 0.2;
+static double preload_time = 0.;
+static double refill_time = 0.;
 static long outflags = 0;
 double preamp = 0.;
 double preamp_factor = 1.;
@@ -120,6 +131,11 @@ int pink_rows = 0;
 double geiger_activity = 17;
 
 size_t pcmblock = 1152; /* samples (pcm frames) we treat en bloc */
+/* Input in the output format that needs no processing is read straight
+   from the descriptor into the output, in blocks of up to that many bytes. */
+#define PASS_BLOCK 65536
+int passthrough = FALSE;
+size_t passfill = 0; /* bytes of an incomplete frame kept from the last read */
 /* To be set after settling format. */
 size_t pcmframe = 0;
 size_t pcminframe = 0;
@@ -149,6 +165,133 @@ char *binpath; /* Path to myself. */
 static char **argv = NULL;
 static int    argc = 0;
 
+/*
+	--bench: time the calls that hand data to the output and report at the
+	end. Bin i of the histogram counts calls that took less than 2^i
+	microseconds (the last one everything longer). The interval between two
+	calls is compared to the duration of the audio the previous one
+	carried, after the first second, when a paced device should have
+	settled in. Output latency is the device fill plus the buffer.
+*/
+#define BENCH_BINS 24
+static int bench = FALSE;
+static struct
+{
+	double start;
+	double last;        /* end of the previous call */
+	double last_audio;  /* seconds of audio in the previous call */
+	double max_call;
+	unsigned long calls;
+	unsigned long hist[BENCH_BINS];
+	unsigned long intervals;
+	double dev_sum;
+	double dev_sum2;
+	double dev_max;
+	int have_latency;
+	double lat_min, lat_max, lat_sum;
+	unsigned long lat_count;
+} bi;
+
+static double bench_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+/* Account for one output call of the given duration that ended now. */
+static void bench_call(double duration, size_t bytes)
+{
+	double now = bench_now();
+	double us = duration*1e6;
+	int bin = 0;
+	size_t fill;
+
+	while(bin < BENCH_BINS-1 && us >= (double)(1UL<<bin))
+		++bin;
+	++bi.hist[bin];
+	++bi.calls;
+	if(duration > bi.max_call)
+		bi.max_call = duration;
+	if(bi.last > 0. && offset > rate)
+	{
+		double dev = (now - bi.last) - bi.last_audio;
+		++bi.intervals;
+		bi.dev_sum  += dev;
+		bi.dev_sum2 += dev*dev;
+		if(fabs(dev) > bi.dev_max)
+			bi.dev_max = fabs(dev);
+	}
+	bi.last = now;
+	bi.last_audio = (double)bytes/pcmframe/rate;
+	if(!out123_latency(ao, NULL, &fill))
+	{
+		double lat = (double)(fill+out123_buffered(ao))/pcmframe/rate;
+		if(!bi.lat_count || lat < bi.lat_min)
+			bi.lat_min = lat;
+		if(lat > bi.lat_max)
+			bi.lat_max = lat;
+		bi.lat_sum += lat;
+		++bi.lat_count;
+	}
+}
+
+static void bench_report(void)
+{
+	double elapsed = bench_now() - bi.start;
+	double audio_time = (double)offset/rate;
+	double devbuf = 0.;
+	char *drvname = NULL;
+	int bin;
+
+	out123_driver_info(ao, &drvname, NULL);
+	out123_latency(ao, &devbuf, NULL);
+	fprintf(stderr, ME": bench: %s, %li Hz, %i channels, %s\n"
+	,	drvname ? drvname : "???"
+	,	rate, channels, out123_enc_name(encoding) ? out123_enc_name(encoding) : "???" );
+	fprintf(stderr, ME": bench: %.3f s of audio in %.3f s, %.1f x realtime, %.2f MB/s\n"
+	,	audio_time, elapsed, elapsed > 0. ? audio_time/elapsed : 0.
+	,	elapsed > 0. ? (double)offset*pcmframe/elapsed/1e6 : 0. );
+	fprintf(stderr, ME": bench: %lu calls, longest %.3f ms\n"
+	,	bi.calls, bi.max_call*1e3 );
+	for(bin=0; bin<BENCH_BINS; ++bin)
+	{
+		if(!bi.hist[bin])
+			continue;
+		if(bin < BENCH_BINS-1)
+			fprintf(stderr, ME": bench: call < %9lu us: %lu\n"
+			,	1UL<<bin, bi.hist[bin] );
+		else
+			fprintf(stderr, ME": bench: call longer: %lu\n", bi.hist[bin]);
+	}
+	if(bi.intervals)
+	{
+		double mean = bi.dev_sum/bi.intervals;
+		double var  = bi.dev_sum2/bi.intervals - mean*mean;
+		fprintf(stderr, ME": bench: call interval vs. audio: mean %+.3f ms, jitter %.3f ms, max %.3f ms\n"
+		,	mean*1e3, (var > 0. ? sqrt(var) : 0.)*1e3, bi.dev_max*1e3 );
+	}
+	if(bi.lat_count)
+		fprintf(stderr, ME": bench: output latency min %.1f avg %.1f max %.1f ms (device buffer %.1f ms)\n"
+		,	bi.lat_min*1e3, bi.lat_sum/bi.lat_count*1e3, bi.lat_max*1e3, devbuf*1e3 );
+	else
+		fprintf(stderr, ME": bench: output latency unknown to the driver\n");
+	{
+		long underruns = 0, bufruns = 0, minfill = -1;
+		double write_max = 0., xrun_max = 0.;
+		out123_getparam_int(ao, OUT123_UNDERRUNS, &underruns);
+		out123_getparam_float(ao, OUT123_XRUN_RECOVERY, &xrun_max);
+		out123_getparam_float(ao, OUT123_WRITE_MAX, &write_max);
+		fprintf(stderr, ME": bench: device underruns %li (recovery max %.3f ms), longest write %.3f ms\n"
+		,	underruns, xrun_max*1e3, write_max*1e3 );
+		if( buffer_kb
+		&&	!out123_getparam_int(ao, OUT123_BUFFER_UNDERRUNS, &bufruns)
+		&&	!out123_getparam_int(ao, OUT123_BUFFER_MINFILL, &minfill) )
+			fprintf(stderr, ME": bench: buffer underruns %li, minimum fill %li bytes\n"
+			,	bufruns, minfill );
+	}
+}
+
 /* Drain output device/buffer, but still give the option to interrupt things. */
 static void controlled_drain(void)
 {
@@ -176,6 +319,8 @@ static void safe_exit(int code)
 
 	if(!code)
 		controlled_drain();
+	if(bench && !code && bi.start > 0.)
+		bench_report();
 	if(intflag || code)
 		out123_drop(ao);
 	out123_del(ao);
@@ -237,6 +382,23 @@ static void set_output_flag(int flag)
   else outflags |= flag;
 }
 
+#ifndef NOXFERMEM
+static void set_buffer_prefault(char *a)
+{
+	set_output_flag(OUT123_BUFFER_PREFAULT);
+}
+
+static void set_buffer_lock(char *a)
+{
+	set_output_flag(OUT123_BUFFER_LOCK);
+}
+
+static void set_buffer_huge(char *a)
+{
+	set_output_flag(OUT123_BUFFER_HUGE);
+}
+#endif
+
 static void set_output_h(char *a)
 {
 	set_output_flag(OUT123_HEADPHONES);
@@ -320,6 +482,34 @@ static void set_out_stdout1(char *arg)
 	also_stdout = TRUE;
 }
 
+static long parse_cpus(char *arg)
+{
+	long mask = cpu_list_mask(arg);
+	if(mask < 0)
+	{
+		error1("\"%s\" is no valid CPU list", arg);
+		safe_exit(1);
+	}
+	return mask;
+}
+
+static void set_cpus(char *arg)
+{
+	cpumask = parse_cpus(arg);
+}
+
+static void set_output_cpus(char *arg)
+{
+	output_cpumask = parse_cpus(arg);
+}
+
+/* A forked buffer process needs to lock its own memory. */
+static void set_lock_memory(char *arg)
+{
+	lock_all = TRUE;
+	set_output_flag(OUT123_BUFFER_LOCK);
+}
+
 #if !defined (HAVE_SCHED_SETSCHEDULER) && !defined (HAVE_WINDOWS_H)
 static void realtime_not_compiled(char *arg)
 {
@@ -508,6 +698,7 @@ topt opts[] = {
 	{0,   "offset",      GLO_ARG | GLO_DOUBLE, 0, &preamp_offset, 0},
 	{'r', "rate",        GLO_ARG | GLO_LONG, 0, &rate,  0},
 	{0,   "clip",        GLO_INT,  0, &do_clip, TRUE},
+	{0,   "bench",       GLO_INT,  0, &bench, TRUE},
 	{0,   "headphones",  0,                  set_output_h, 0,0},
 	{0,   "speaker",     0,                  set_output_s, 0,0},
 	{0,   "lineout",     0,                  set_output_l, 0,0},
@@ -517,6 +708,11 @@ topt opts[] = {
 #ifndef NOXFERMEM
 	{'b', "buffer",      GLO_ARG | GLO_LONG, 0, &buffer_kb,  0},
 	{0, "preload", GLO_ARG|GLO_DOUBLE, 0, &preload, 0},
+	{0, "preload-time", GLO_ARG|GLO_DOUBLE, 0, &preload_time, 0},
+	{0, "refill-time", GLO_ARG|GLO_DOUBLE, 0, &refill_time, 0},
+	{0, "buffer-prefault", 0, set_buffer_prefault, 0, 0},
+	{0, "buffer-lock", 0, set_buffer_lock, 0, 0},
+	{0, "buffer-huge", 0, set_buffer_huge, 0, 0},
 #endif
 #ifdef HAVE_SETPRIORITY
 	{0,   "aggressive",	 GLO_INT,  0, &aggressive, 2},
@@ -529,6 +725,13 @@ topt opts[] = {
 #endif
 #ifdef HAVE_WINDOWS_H
 	{0, "priority", GLO_ARG | GLO_INT, 0, &w32_priority, 0},
+#endif
+	{0, "rtprio", GLO_ARG|GLO_INT, 0, &rtprio, 0},
+	{0, "cpus", GLO_ARG|GLO_CHAR, set_cpus, 0, 0},
+	{0, "mlockall", 0, set_lock_memory, 0, 0},
+#ifndef NOXFERMEM
+	{0, "output-rtprio", GLO_ARG|GLO_INT, 0, &output_rtprio, 0},
+	{0, "output-cpus", GLO_ARG|GLO_CHAR, set_output_cpus, 0, 0},
 #endif
 	{'w', "wav",         GLO_ARG | GLO_CHAR, set_out_wav, 0, 0 },
 	{0, "cdr",           GLO_ARG | GLO_CHAR, set_out_cdr, 0, 0 },
@@ -867,12 +1070,76 @@ setup_waver_end:
 		free(freq);
 }
 
+/* Read a big block of input without stdio and conversion right into the
+   region from out123_play_begin(), which is the device buffer if the driver
+   allows. An incomplete frame waits in audio for the next region.
+   return 1 on success, 0 on failure */
+static int pass_block(void)
+{
+	size_t want = PASS_BLOCK - PASS_BLOCK % pcmframe;
+	size_t got_samples;
+	size_t got_bytes;
+	unsigned char *region;
+	void *rp;
+	ssize_t got;
+	double t0, t1;
+	if(timelimit >= 0)
+	{
+		if(offset >= timelimit)
+			return 0;
+		else if(timelimit < offset+(off_t)(want/pcmframe))
+			want = (size_t)(timelimit-offset)*pcmframe;
+	}
+	t0 = bench ? bench_now() : 0.;
+	check_fatal_output(out123_play_begin(ao, &rp, &want));
+	if(bench)
+		t0 = bench_now()-t0;
+	region = rp;
+	if(want < pcmframe)
+	{
+		out123_play_commit(ao, 0);
+		return 0;
+	}
+	if(passfill)
+		memcpy(region, audio, passfill);
+	got = read(fileno(input), region+passfill, want-passfill);
+	if(got <= 0)
+	{
+		out123_play_commit(ao, 0);
+		/* An incomplete frame at the end is dropped, as with fread(). */
+		return (got < 0 && errno == EINTR) ? 1 : 0;
+	}
+	got_bytes = passfill+got;
+	got_samples = got_bytes / pcmframe;
+	passfill = got_bytes - got_samples*pcmframe;
+	if(passfill)
+		memcpy(audio, region+got_samples*pcmframe, passfill);
+	errno = 0;
+	if(also_stdout && fwrite(region, pcmframe, got_samples, stdout) < got_samples)
+	{
+		if(!quiet && errno != EINTR)
+			error1( "failed to copy stream to stdout: %s", strerror(errno));
+		out123_play_commit(ao, 0);
+		safe_exit(133);
+	}
+	mdebug("playing %zu bytes", got_samples*pcmframe);
+	t1 = bench ? bench_now() : 0.;
+	check_fatal_output( out123_play_commit(ao, got_samples*pcmframe)
+	<	got_samples*pcmframe );
+	offset += got_samples;
+	if(bench)
+		bench_call(t0+bench_now()-t1, got_samples*pcmframe);
+	return 1;
+}
+
 /* return 1 on success, 0 on failure */
 int play_frame(void)
 {
 	size_t got_samples;
 	size_t get_samples = pcmblock;
 	debug("play_frame");
+	if(passthrough)
+		return pass_block();
 	if(timelimit >= 0)
 	{
 		if(offset >= timelimit)
@@ -916,7 +1183,12 @@ int play_frame(void)
 				fprintf(stderr, ME ": clipped %"SIZE_P" samples\n", clipped);
 		}
 		mdebug("playing %zu bytes", got_bytes);
-		check_fatal_output(out123_play(ao, audio, got_bytes) < (int)got_bytes);
+		{
+			double t0 = bench ? bench_now() : 0.;
+			check_fatal_output(out123_play(ao, audio, got_bytes) < (int)got_bytes);
+			if(bench)
+				bench_call(bench_now()-t0, got_bytes);
+		}
 		if(also_stdout && fwrite(audio, pcmframe, got_samples, stdout) < got_samples)
 		{
 			if(!quiet && errno != EINTR)
@@ -1022,10 +1294,14 @@ int main(int sys_argc, char ** sys_argv)
 	( 0
 	||	out123_param_int(ao, OUT123_FLAGS, outflags)
 	|| out123_param_float(ao, OUT123_PRELOAD, preload)
+	|| out123_param_float(ao, OUT123_PRELOADTIME, preload_time)
+	|| out123_param_float(ao, OUT123_REFILLTIME, refill_time)
 	|| out123_param_int(ao, OUT123_VERBOSE, verbose)
 	|| out123_param_string(ao, OUT123_NAME, name)
 	|| out123_param_string(ao, OUT123_BINDIR, binpath)
 	|| out123_param_float(ao, OUT123_DEVICEBUFFER, device_buffer)
+	|| out123_param_int(ao, OUT123_RTPRIO, output_rtprio)
+	|| out123_param_int(ao, OUT123_CPUMASK, output_cpumask)
 	)
 	{
 		error("Error setting output parameters. Do you need a usage reminder?");
@@ -1054,6 +1330,13 @@ int main(int sys_argc, char ** sys_argv)
 			error("Can't get realtime priority\n");
 	}
 #endif
+	/* The buffer inherits these unless it has its own settings. */
+	if(rtprio)
+		set_rtprio(rtprio);
+	if(cpumask)
+		set_cpumask(cpumask);
+	if(lock_all)
+		lock_memory();
 
 /* make sure not Cygwin, it doesn't need it */
 #if defined(WIN32) && defined(HAVE_WINDOWS_H)
@@ -1192,7 +1475,17 @@ int main(int sys_argc, char ** sys_argv)
 	if(strcmp(signal_source, "file"))
 		generate = TRUE;
 	setup_wavegen(); // Used also for conversion/mixing.
+	// Data that just goes through can skip stdio and be read in bigger blocks.
+	if( !generate && inaudio == audio && preamp_factor == 1. && preamp_offset == 0.
+	&&	!(do_clip && encoding & MPG123_ENC_FLOAT) && pcmframe <= PASS_BLOCK/2 )
+	{
+		passthrough = TRUE;
+		if(verbose > 1)
+			fprintf(stderr, ME": passing input through in blocks of %i bytes\n", PASS_BLOCK);
+	}
 
+	if(bench)
+		bi.start = bench_now();
 	while(play_frame() && !intflag)
 	{
 		/* be happy */
@@ -1323,10 +1616,16 @@ static void long_usage(int err)
 #ifndef NOXFERMEM
 	fprintf(o," -b <n> --buffer <n>       set play buffer (\"output cache\")\n");
 	fprintf(o,"        --preload <value>  fraction of buffer to fill before playback\n");
+	fprintf(o,"        --preload-time <s> seconds to buffer before playback (overrides --preload)\n");
+	fprintf(o,"        --refill-time <s>  seconds to buffer again after an underrun\n");
+	fprintf(o,"        --buffer-prefault  touch all buffer memory before playback\n");
+	fprintf(o,"        --buffer-lock      lock buffer memory in RAM (mlock)\n");
+	fprintf(o,"        --buffer-huge      back the buffer with huge pages\n");
 #endif
 	fprintf(o,"        --devbuffer <s>    set device buffer in seconds; <= 0 means default\n");
 	fprintf(o,"        --timelimit <s>    set time limit in PCM samples if >= 0\n");
 	fprintf(o,"        --seconds <s>      set time limit in seconds if >= 0\n");
+	fprintf(o,"        --bench            report throughput, timing of output calls and latency\n");
 	fprintf(o,"        --source <s>       choose signal source: file (default),\n");
 	fprintf(o,"                           wave, sweep, pink, geiger; implied by\n");
 	fprintf(o,"                           --wave-freq, --wave-sweep,\n");
@@ -1380,6 +1679,14 @@ static void long_usage(int err)
 	fprintf(o,"                           accepts -2 to 3 as integer arguments\n");
 	fprintf(o,"                           -2 as idle, 0 as normal and 3 as realtime.\n");
 	#endif
+	fprintf(o,"        --rtprio <n>       real-time priority n (also for buffer),\n");
+	fprintf(o,"                           SCHED_FIFO for n > 0, SCHED_RR with -n for n < 0\n");
+	fprintf(o,"        --cpus <l>         run (also buffer) on CPUs in list l (0,2-3)\n");
+	fprintf(o,"        --mlockall         lock all memory (also of buffer) in RAM\n");
+#ifndef NOXFERMEM
+	fprintf(o,"        --output-rtprio <n> real-time priority for the buffer, like --rtprio\n");
+	fprintf(o,"        --output-cpus <l>  CPU list for the buffer\n");
+#endif
 	fprintf(o," -?     --help             give compact help\n");
 	fprintf(o,"        --longhelp         give this long help listing\n");
 	fprintf(o,"        --version          give name / version string\n");
@@ -5,6 +5,11 @@
 	see COPYING and AUTHORS files in distribution or http://mpg123.org
 	initially written by Michael Hipp, outsourced/reorganized by Thomas Orgis
 
+	Entries are read as they are needed when playing straight through,
+	so huge playlists start right away. Only shuffling, random play and
+	the like read all of them up front. The strings of entries from list
+	files are packed into big blocks instead of one allocation each.
+
 	If we officially support Windows again, we should have this reworked to really cope with Windows paths, too.
 */
 
@@ -31,16 +36,25 @@
 
 /* increase linebuf in blocks of ... bytes */
 #define LINEBUF_STEP 100
+/* Copies of playlist entries are packed into blocks of (at least) that size. */
+#define ARENA_BLOCK 65536
 
 enum playlist_type { UNKNOWN = 0, M3U, PLS, NO_LIST };
 
 typedef struct listitem
 {
-	char* url; /* the filename */
-	char freeit; /* if it was allocated and should be free()d here */
+	char* url; /* the filename, from argv or the arena */
 	size_t playcount; /* has been played as ...th track in overall counting */
 } listitem;
 
+/* One block of entry strings, with the data following the header. */
+struct arena_block
+{
+	struct arena_block *next;
+	size_t size;
+	size_t fill;
+};
+
 typedef struct playlist_struct
 {
 	FILE* file; /* the current playlist stream */
@@ -51,8 +65,12 @@ typedef struct playlist_struct
 	size_t fill;
 	size_t pos; /* (next) position, internal use */
 	size_t num; /* current track number */
-	size_t alloc_step;
 	struct listitem* list;
+	struct arena_block* arena; /* the latest block first */
+	/* Still reading entries while playing from the given arguments. */
+	int stream;
+	int argc;
+	char **argv;
 	mpg123_string linebuf;
 	mpg123_string dir;
 	enum playlist_type type;
@@ -68,17 +86,29 @@ static int add_next_file (int argc, char *argv[]);
 static void shuffle_playlist(void);
 static void init_playlist(void);
 static int add_copy_to_playlist(char* new_entry);
-static int add_to_playlist(char* new_entry, char freeit);
+static int add_to_playlist(char* new_entry);
+static void playlist_need(size_t n);
 
 /* used to be init_input */
 void prepare_playlist(int argc, char** argv)
 {
 	/*
-		fetch all playlist entries ... I don't consider playlists to be an endless stream.
-		If you want to intentionally hang mpg123 on some other prog that may take infinite time to produce the full list (perhaps load tracks on demand), then just use the remote control and let that program print "load filename" instead of "filename".
-		We may even provide a simple wrapper script that emulates the old playlist reading behaviour (for files and stdin, http playlists are actually a strong point on reading the list in _before_ starting playback since http connections don't last forever).
+		fetch the playlist entries ... all of them before playback for http playlists, since http connections don't last forever, and when the order is shuffled or the full list is shown.
+		Other lists are read while playing. Still, if you want to intentionally hang mpg123 on some other prog that may take infinite time to produce the full list (perhaps load tracks on demand), better use the remote control and let that program print "load filename" instead of "filename".
 	*/
 	init_playlist();
+	pl.argc = argc;
+	pl.argv = argv;
+	/* Unless the whole list is needed right away, start playback after the
+	   first entry and read the rest on demand. */
+	pl.stream = !param.shuffle && param.verbose < 2 && !param.mixer
+	&&	param.listentry >= 0
+	&&	!(param.listname && !strncmp(param.listname, "http://", 7));
+	if(pl.stream)
+	{
+		playlist_need(0);
+		return;
+	}
 	while (add_next_file(argc, argv)) {}
 	if(param.verbose > 1)
 	{
@@ -102,6 +132,20 @@ static size_t rando(size_t n)
 	return (size_t)(ran%n);
 }
 
+/* Read entries until there is one at index n or the list is done. */
+static void playlist_need(size_t n)
+{
+	while(pl.stream && pl.fill <= n)
+	{
+		if(!add_next_file(pl.argc, pl.argv))
+		{
+			pl.stream = 0;
+			mpg123_free_string(&pl.linebuf);
+			mpg123_free_string(&pl.dir);
+		}
+	}
+}
+
 char *get_next_file(void)
 {
 	struct listitem *newitem = NULL;
@@ -117,6 +161,7 @@ char *get_next_file(void)
 	{
 		do
 		{
+			playlist_need(pl.pos);
 			if(pl.pos < pl.fill)
 			{
 				newitem = &pl.list[pl.pos];
@@ -161,8 +206,20 @@ char *get_next_file(void)
 	else return NULL;
 }
 
+char *peek_next_file(void)
+{
+	if(pl.fill == 0 || param.loop == 0 || param.shuffle > 1)
+		return NULL;
+	playlist_need(pl.pos);
+	/* While looping a track, the position stays on it. */
+	return pl.pos < pl.fill ? pl.list[pl.pos].url : NULL;
+}
+
+/* While streaming, the total is the count so far, at least one after the
+   current track if there is another one. */
 size_t playlist_pos(size_t *total, long *loop)
 {
+	playlist_need(pl.num);
 	if(total)
 		*total = pl.fill;
 	if(loop)
@@ -186,6 +243,7 @@ void playlist_jump(ssize_t incr)
 			pl.pos -= off > pl.pos ? pl.pos : off;
 		else
 		{
+			playlist_need(pl.pos+off);
 			if(off >= pl.fill - pl.pos)
 				pl.pos = pl.fill; /* Any value >= pl.fill would actually be OK. */
 			else
@@ -215,7 +273,7 @@ void playlist_next_dir(void)
 	if(pl.fill && param.shuffle < 2)
 	{
 		size_t npos = pl.pos ? pl.pos-1 : 0;
-		do ++npos;
+		do playlist_need(++npos);
 		while(npos < pl.fill && !cmp_dir(pl.list[npos-1].url, pl.list[npos].url));
 		pl.pos = npos;
 	}
@@ -245,18 +303,25 @@ void playlist_prev_dir(void)
    Make sure you don't free() an item of argv! */
 void free_playlist(void)
 {
+	if(pl.stream)
+	{
+		if(pl.file && pl.file != stdin) fclose(pl.file);
+		pl.file = NULL;
+		pl.stream = 0;
+	}
+	while(pl.arena != NULL)
+	{
+		struct arena_block *next = pl.arena->next;
+		free(pl.arena);
+		pl.arena = next;
+	}
 	if(pl.list != NULL)
 	{
 		debug("going to free() the playlist");
-		while(pl.fill)
-		{
-			--pl.fill;
-			debug1("free()ing entry %lu", (unsigned long)pl.fill);
-			if(pl.list[pl.fill].freeit) free(pl.list[pl.fill].url);
-		}
 		free(pl.list);
 		pl.list = NULL;
 		pl.size = 0;
+		pl.fill = 0;
 		debug("free()d the playlist");
 	}
 	mpg123_free_string(&pl.linebuf);
@@ -278,7 +343,8 @@ static void init_playlist(void)
 	pl.pos = param.listentry - 1;
 
 	pl.list = NULL;
-	pl.alloc_step = 10;
+	pl.arena = NULL;
+	pl.stream = 0;
 	mpg123_init_string(&pl.dir);
 	mpg123_init_string(&pl.linebuf);
 	pl.type = UNKNOWN;
@@ -376,7 +442,7 @@ static int add_next_file (int argc, char *argv[])
 							else
 							{
 								fprintf(stderr, "Note: MIME type indicates that this is no playlist but an mpeg audio file... reopening as such.\n");
-								add_to_playlist(param.listname, 0);
+								add_to_playlist(param.listname);
 								return 1;
 							}
 						}
@@ -611,7 +677,7 @@ static int add_next_file (int argc, char *argv[])
 	}
 	if(loptind < argc)
 	{
-		add_to_playlist(argv[loptind++], 0);
+		add_to_playlist(argv[loptind++]);
 		return 1;
 	}
 	return 0;
@@ -659,6 +725,7 @@ static void shuffle_playlist(void)
 void print_playlist(FILE* out, int showpos)
 {
 	size_t loop;
+	playlist_need((size_t)-1);
 	for (loop = 0; loop < pl.fill; loop++)
 	{
 		char *pre = "";
@@ -670,25 +737,41 @@ void print_playlist(FILE* out, int showpos)
 }
 
 
+/* Copy the entry to the end of the current arena block, or a new one. */
 static int add_copy_to_playlist(char* new_entry)
 {
+	size_t len = strlen(new_entry)+1;
 	char* cop;
-	if((cop = (char*) malloc(strlen(new_entry)+1)) != NULL)
+	if(pl.arena == NULL || pl.arena->size - pl.arena->fill < len)
 	{
-		strcpy(cop, new_entry);
-		return add_to_playlist(cop, 1);
+		size_t size = len > ARENA_BLOCK ? len : ARENA_BLOCK;
+		struct arena_block *block = malloc(sizeof(struct arena_block)+size);
+		if(block == NULL)
+			return 0;
+		block->next = pl.arena;
+		block->size = size;
+		block->fill = 0;
+		pl.arena = block;
+	}
+	cop = (char*)(pl.arena+1) + pl.arena->fill;
+	memcpy(cop, new_entry, len);
+	if(add_to_playlist(cop))
+	{
+		pl.arena->fill += len;
+		return 1;
 	}
 	else return 0;
 }
 
 /* add new entry to playlist - no string copy, just the pointer! */
-static int add_to_playlist(char* new_entry, char freeit)
+static int add_to_playlist(char* new_entry)
 {
 	if(pl.fill == pl.size)
 	{
 		struct listitem* tmp = NULL;
-		/* enlarge the list */
-		tmp = (struct listitem*) safe_realloc(pl.list, (pl.size + pl.alloc_step) * sizeof(struct listitem));
+		/* enlarge the list, doubling to keep that linear for long lists */
+		size_t size = pl.size ? 2*pl.size : 16;
+		tmp = (struct listitem*) safe_realloc(pl.list, size * sizeof(struct listitem));
 		if(!tmp)
 		{
 			error("unable to allocate more memory for playlist");
@@ -698,13 +781,12 @@ static int add_to_playlist(char* new_entry, char freeit)
 		else
 		{
 			pl.list = tmp;
-			pl.size += pl.alloc_step;
+			pl.size = size;
 		}
 	}
 	/* paranoid */
 	if(pl.fill < pl.size)
 	{
-		pl.list[pl.fill].freeit = freeit;
 		pl.list[pl.fill].url = new_entry;
 		pl.list[pl.fill].playcount = 0;
 		++pl.fill;
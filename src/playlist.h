@@ -14,6 +14,8 @@
 void prepare_playlist(int argc, char** argv);
 /* returns the next url to play or NULL when there is none left */
 char *get_next_file(void);
+/* What get_next_file() is going to return, NULL if unknown (random play). */
+char *peek_next_file(void);
 /* Get current track number, optionally the total count and loop counter. */
 size_t playlist_pos(size_t *total, long *loop);
 /* frees memory that got allocated in prepare_playlist */
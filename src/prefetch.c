@@ -0,0 +1,192 @@
+/*
+	prefetch: reading the start of the next track while the current one plays
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	On network shares, opening a file and getting its first blocks can take
+	longer than the output device has audio left at the end of a track. A
+	thread does that for the next playlist entry in the meantime, keeping the
+	data in memory. When the track is opened, the decoder reads from that
+	memory first and then continues on the descriptor, which was left at the
+	end of the prefetched part.
+*/
+
+#include "prefetch.h"
+#include <fcntl.h>
+#include <errno.h>
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
+#include "debug.h"
+
+struct prefetch
+{
+	char *name;
+	int fd;
+	unsigned char *data;
+	size_t size;
+	size_t fill; /* bytes read into data, the descriptor is there */
+	size_t pos;  /* read position of the decoder while in data */
+#ifndef NO_THREADS
+	int running;
+	pthread_t thread;
+#endif
+};
+
+#ifndef NO_THREADS
+#define PREFETCH_NONE { NULL, -1, NULL, 0, 0, 0, 0, 0 }
+#else
+#define PREFETCH_NONE { NULL, -1, NULL, 0, 0, 0 }
+#endif
+
+/* The one being fetched and the one the decoder reads from. */
+static struct prefetch next = PREFETCH_NONE;
+static struct prefetch cur  = PREFETCH_NONE;
+
+static void prefetch_free(struct prefetch *pf)
+{
+#ifndef NO_THREADS
+	if(pf->running)
+		pthread_join(pf->thread, NULL);
+	pf->running = 0;
+#endif
+	if(pf->fd > -1)
+		compat_close(pf->fd);
+	free(pf->name);
+	free(pf->data);
+	pf->name = NULL;
+	pf->data = NULL;
+	pf->fd   = -1;
+	pf->size = pf->fill = pf->pos = 0;
+}
+
+#ifndef NO_THREADS
+static void *fetch_thread(void *arg)
+{
+	struct prefetch *pf = arg;
+
+	pf->fd = compat_open(pf->name, O_RDONLY);
+	if(pf->fd < 0)
+		return NULL;
+#ifdef WIN32
+	_setmode(pf->fd, _O_BINARY);
+#endif
+	while(pf->fill < pf->size)
+	{
+		ssize_t got = read(pf->fd, pf->data+pf->fill, pf->size-pf->fill);
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got <= 0)
+			break;
+		pf->fill += got;
+	}
+	return NULL;
+}
+#endif
+
+void track_prefetch_start(const char *fname, size_t bytes)
+{
+	prefetch_free(&next);
+#ifndef NO_THREADS
+	if(!fname || !bytes || !strcmp(fname, "-") || strstr(fname, "://"))
+		return;
+	if(  !(next.name = compat_strdup(fname))
+	||   !(next.data = malloc(bytes)) )
+	{
+		prefetch_free(&next);
+		return;
+	}
+	next.size = bytes;
+	if(pthread_create(&next.thread, NULL, fetch_thread, &next))
+	{
+		prefetch_free(&next);
+		return;
+	}
+	next.running = 1;
+	debug2("prefetching %"SIZE_P" bytes of %s", (size_p)bytes, fname);
+#endif
+}
+
+static ssize_t prefetch_read(int fd, void *buf, size_t count)
+{
+	if(fd == cur.fd && cur.pos < cur.fill)
+	{
+		if(count > cur.fill - cur.pos)
+			count = cur.fill - cur.pos;
+		memcpy(buf, cur.data+cur.pos, count);
+		cur.pos += count;
+		return (ssize_t)count;
+	}
+	return read(fd, buf, count);
+}
+
+static off_t prefetch_seek(int fd, off_t pos, int whence)
+{
+	off_t target;
+
+	if(fd != cur.fd)
+		return lseek(fd, pos, whence);
+	switch(whence)
+	{
+		case SEEK_SET:
+			target = pos;
+		break;
+		case SEEK_CUR:
+			if(cur.pos < cur.fill)
+				target = (off_t)cur.pos + pos;
+			else if((target = lseek(fd, 0, SEEK_CUR)) >= 0)
+				target += pos;
+		break;
+		default:
+			target = lseek(fd, pos, whence);
+	}
+	if(target < 0)
+		return target;
+	/* Inside the data, the descriptor stays at its end. */
+	if(target < (off_t)cur.fill)
+	{
+		if(lseek(fd, (off_t)cur.fill, SEEK_SET) < 0)
+			return -1;
+		cur.pos = (size_t)target;
+		return target;
+	}
+	cur.pos = cur.fill;
+	return lseek(fd, target, SEEK_SET);
+}
+
+int track_prefetch_take(mpg123_handle *mh, const char *fname)
+{
+	/* The previous track closed its descriptor already. */
+	cur.fd = -1;
+	prefetch_free(&cur);
+	if(!next.name || strcmp(next.name, fname))
+		return -1;
+#ifndef NO_THREADS
+	if(next.running)
+		pthread_join(next.thread, NULL);
+	next.running = 0;
+#endif
+	cur = next;
+	next.name = NULL;
+	next.data = NULL;
+	next.fd   = -1;
+	next.size = next.fill = next.pos = 0;
+	if(cur.fd < 0 || mpg123_replace_reader(mh, prefetch_read, prefetch_seek)
+		!= MPG123_OK )
+	{
+		prefetch_free(&cur);
+		return -1;
+	}
+	debug2( "taking %"SIZE_P" prefetched bytes of %s"
+	,	(size_p)cur.fill, fname );
+	/* The descriptor is closed with the track. */
+	return cur.fd;
+}
+
+void track_prefetch_exit(void)
+{
+	prefetch_free(&next);
+	cur.fd = -1;
+	prefetch_free(&cur);
+}
@@ -0,0 +1,25 @@
+/*
+	prefetch: reading the start of the next track while the current one plays
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "mpg123app.h"
+
+/* Start opening the given file and reading up to bytes of it in the
+   background, replacing any prefetch that was not taken. Only local files
+   are handled, URLs and standard input are ignored as is everything without
+   thread support. */
+void track_prefetch_start(const char *fname, size_t bytes);
+/* If fname is what was prefetched, wait for that to finish and return the
+   descriptor, with readers of mh replaced to serve the prefetched data
+   first. The caller owns the descriptor then. Returns -1 otherwise. */
+int track_prefetch_take(mpg123_handle *mh, const char *fname);
+/* Drop all prefetched data. */
+void track_prefetch_exit(void);
+
+#endif
@@ -36,6 +36,10 @@
 #include <sys/types.h>
 #endif
 #include <unistd.h>
+#include <time.h>
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
 #include "debug.h"
 
 int split_url(mpg123_string *url, mpg123_string *auth, mpg123_string *host, mpg123_string *port, mpg123_string *path)
@@ -170,79 +174,231 @@ static void block(int sock)
 	fcntl(sock, F_SETFL, flags);
 }
 
-/* If we want a timeout, connect non-blocking and wait for that long... */
-static int timeout_connect(int sockfd, const struct sockaddr *serv_addr, socklen_t addrlen)
+/* One address to try for a host. */
+struct address
 {
-	if(param.timeout > 0)
-	{
-		int err;
-		nonblock(sockfd);
-		err = connect(sockfd, serv_addr, addrlen);
-		if(err == 0)
-		{
-			debug("immediately successful");
-			block(sockfd);
-			return 0;
-		}
-		else if(errno == EINPROGRESS)
-		{
-			struct timeval tv;
-			fd_set fds;
-			tv.tv_sec = param.timeout;
-			tv.tv_usec = 0;
+	int family, socktype, protocol;
+#ifdef IPV6
+	struct sockaddr_storage addr;
+#else
+	struct sockaddr_in addr;
+#endif
+	socklen_t addrlen;
+};
+
+#define MAX_ADDRESSES 16
+/* Milliseconds to give a connection attempt before starting the next
+   one in parallel (as in RFC 8305, happy eyeballs). */
+#define CONNECT_DELAY 250
 
-			debug("in progress, waiting...");
+/*
+	Try the addresses in order, but without waiting for each to fail: The
+	next attempt starts CONNECT_DELAY after the previous one while
+	that is still pending. The first connection that comes up wins, the
+	others are closed. So a dead IPv6 route costs a quarter of a second
+	instead of the whole timeout before IPv4 is tried. Returns the
+	blocking socket and sets *which to the address used, -1 if none worked
+	(within param.timeout, if set).
+*/
+static int connect_any(struct address *a, int count, int *which)
+{
+	int socks[MAX_ADDRESSES];
+	int started = 0;
+	int pending = 0;
+	int winner = -1;
+	int i;
+	time_t deadline = param.timeout > 0 ? time(NULL) + param.timeout : 0;
 
-			FD_ZERO(&fds);
-			FD_SET(sockfd, &fds);
-			err = select(sockfd+1, NULL, &fds, NULL, &tv);
-			if(err > 0)
+	while(winner < 0 && (pending || started < count))
+	{
+		struct timeval tv;
+		struct timeval *tvp = NULL;
+		fd_set fds;
+		int maxfd = -1;
+		int ret;
+
+		if(started < count)
+		{
+			int sock = socket(a[started].family, a[started].socktype, a[started].protocol);
+			socks[started] = -1;
+			if(sock >= 0)
 			{
-				socklen_t len = sizeof(err);
-				if(   (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len) == 0)
-				   && (err == 0) )
+				nonblock(sock);
+				if(!connect(sock, (struct sockaddr*)&a[started].addr, a[started].addrlen))
 				{
-					debug("non-blocking connect has been successful");
-					block(sockfd);
-					return 0;
+					debug("immediately successful");
+					socks[started] = sock;
+					winner = started++;
+					break;
+				}
+				if(errno == EINPROGRESS)
+				{
+					socks[started] = sock;
+					++pending;
 				}
 				else
 				{
-					error1("connection error: %s", strerror(err));
-					return -1;
+					if(param.verbose > 1)
+						fprintf(stderr, "Note: connection failed: %s\n", strerror(errno));
+					close(sock);
 				}
 			}
-			else if(err == 0)
+			else
+				error1("Cannot create socket: %s", strerror(errno));
+			++started;
+			if(!pending)
+				continue;
+		}
+		FD_ZERO(&fds);
+		for(i=0; i<started; ++i)
+			if(socks[i] >= 0)
 			{
-				error("connection timed out");
-				return -1;
+				FD_SET(socks[i], &fds);
+				if(socks[i] > maxfd)
+					maxfd = socks[i];
 			}
-			else
+		if(started < count)
+		{
+			tv.tv_sec = 0;
+			tv.tv_usec = CONNECT_DELAY*1000;
+			tvp = &tv;
+		}
+		if(deadline)
+		{
+			time_t left = deadline - time(NULL);
+			if(left < 0)
+				left = 0;
+			if(!tvp || left < tv.tv_sec)
 			{
-				error1("error from select(): %s", strerror(errno));
-				return -1;
+				tv.tv_sec = left;
+				tv.tv_usec = 0;
+				tvp = &tv;
 			}
 		}
-		else
+		ret = select(maxfd+1, NULL, &fds, NULL, tvp);
+		if(ret < 0 && errno != EINTR)
 		{
-			error1("connection failed: %s", strerror(errno));
-			return err;
+			error1("error from select(): %s", strerror(errno));
+			break;
 		}
-	}
-	else
-	{
-		if(connect(sockfd, serv_addr, addrlen))
+		if(ret == 0 && deadline && time(NULL) >= deadline)
+		{
+			error("connection timed out");
+			break;
+		}
+		for(i=0; ret > 0 && i<started; ++i)
 		{
-			error1("connection failed: %s", strerror(errno));
-			return -1;
+			int err = 0;
+			socklen_t len = sizeof(err);
+			if(socks[i] < 0 || !FD_ISSET(socks[i], &fds))
+				continue;
+			if(!getsockopt(socks[i], SOL_SOCKET, SO_ERROR, &err, &len) && !err)
+			{
+				debug1("non-blocking connect %d has been successful", i);
+				winner = i;
+				break;
+			}
+			if(param.verbose > 1)
+				fprintf(stderr, "Note: connection failed: %s\n", strerror(err));
+			close(socks[i]);
+			socks[i] = -1;
+			--pending;
 		}
-		else return 0; /* _good_ */
 	}
+	for(i=0; i<started; ++i)
+		if(i != winner && socks[i] >= 0)
+			close(socks[i]);
+	if(winner < 0)
+		return -1;
+	block(socks[winner]);
+	*which = winner;
+	return socks[winner];
 }
 
+/*
+	Hosts looked up recently are remembered for DNS_CACHE_TTL seconds, so
+	that reconnects to the same server (relocations, ranged requests for
+	seeking, playlists of one station) skip the name lookup. The resolver
+	API does not tell the real time to live of records, hence a short fixed
+	one. The address that connected last is moved to the front. If none of
+	the cached addresses works, the host is resolved again. Connections
+	for HTTP ranges are also opened from decoder threads, hence the lock.
+*/
+#define DNS_CACHE_SIZE 8
+#define DNS_CACHE_TTL 60
 
-/* So, this then is the only routine that should know about IPv4 or v6 in future. */
-int open_connection(mpg123_string *host, mpg123_string *port)
+static struct resolved
+{
+	mpg123_string host;
+	mpg123_string port;
+	time_t when;
+	int count;
+	struct address addr[MAX_ADDRESSES];
+} dns_cache[DNS_CACHE_SIZE];
+#ifndef NO_THREADS
+static pthread_mutex_t dns_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static struct resolved *cache_find(mpg123_string *host, mpg123_string *port)
+{
+	int i;
+	time_t now = time(NULL);
+	for(i=0; i<DNS_CACHE_SIZE; ++i)
+	{
+		struct resolved *r = dns_cache+i;
+		if( r->count && now - r->when >= 0 && now - r->when < DNS_CACHE_TTL
+		&&	!strcmp(r->host.p, host->p) && !strcmp(r->port.p, port->p) )
+			return r;
+	}
+	return NULL;
+}
+
+/* A free or the oldest entry, with the names set. */
+static struct resolved *cache_new(mpg123_string *host, mpg123_string *port)
+{
+	struct resolved *r = dns_cache;
+	int i;
+	for(i=1; i<DNS_CACHE_SIZE && r->count; ++i)
+		if(!dns_cache[i].count || dns_cache[i].when < r->when)
+			r = dns_cache+i;
+	r->count = 0;
+	if( !mpg123_copy_string(host, &r->host)
+	||	!mpg123_copy_string(port, &r->port) )
+		return NULL;
+	r->when = time(NULL);
+	return r;
+}
+
+static void cache_add(struct resolved *r, int family, int socktype, int protocol
+,	const struct sockaddr *addr, socklen_t addrlen)
+{
+	struct address *a;
+	if(r->count >= MAX_ADDRESSES || addrlen > sizeof(a->addr))
+		return;
+	a = r->addr + r->count++;
+	a->family   = family;
+	a->socktype = socktype;
+	a->protocol = protocol;
+	memcpy(&a->addr, addr, addrlen);
+	a->addrlen = addrlen;
+}
+
+/* Connect to one of the addresses, returning the socket or -1. */
+static int cache_connect(struct resolved *r)
+{
+	int which = 0;
+	int sock = connect_any(r->addr, r->count, &which);
+	if(sock >= 0 && which)
+	{
+		struct address a = r->addr[which];
+		memmove(r->addr+1, r->addr, sizeof(*r->addr)*which);
+		r->addr[0] = a;
+	}
+	return sock;
+}
+
+/* Fill the cache entry with the addresses of the host, FALSE on failure. */
+static int resolve(struct resolved *r, mpg123_string *host, mpg123_string *port)
 {
 #ifndef IPV6 /* The legacy code for IPv4. No real change to keep all compatibility. */
 #ifndef INADDR_NONE
@@ -250,11 +406,12 @@ int open_connection(mpg123_string *host, mpg123_string *port)
 #endif
 	struct sockaddr_in server;
 	struct hostent *myhostent;
-	struct in_addr myaddr;
 	int isip = 1;
 	char *cptr = host->p;
-	int sock = -1;
 	if(param.verbose>1) fprintf(stderr, "Note: Attempting old-style connection to %s\n", host->p);
+	memset(&server, 0, sizeof(server));
+	server.sin_port = htons(atoi(port->p));
+	server.sin_family = AF_INET;
 	/* Resolve to IP; parse port number. */
 	while(*cptr) /* Iterate over characters of hostname, check if it's an IP or name. */
 	{
@@ -267,29 +424,29 @@ int open_connection(mpg123_string *host, mpg123_string *port)
 	}
 	if(!isip)
 	{ /* Name lookup. */
-		if (!(myhostent = gethostbyname(host->p))) return -1;
+		char **ha;
+		if (!(myhostent = gethostbyname(host->p))) return FALSE;
 
-		memcpy (&myaddr, myhostent->h_addr, sizeof(myaddr));
-		server.sin_addr.s_addr = myaddr.s_addr;
+		for(ha = myhostent->h_addr_list; *ha; ++ha)
+		{
+			memcpy(&server.sin_addr, *ha, sizeof(server.sin_addr));
+			cache_add( r, PF_INET, SOCK_STREAM, 6
+			,	(struct sockaddr *)&server, sizeof(server) );
+		}
 	}
 	else  /* Just use the IP. */
-	if((server.sin_addr.s_addr = inet_addr(host->p)) == INADDR_NONE)
-	return -1;
-
-	server.sin_port = htons(atoi(port->p));
-	server.sin_family = AF_INET;
-
-	if((sock = socket(PF_INET, SOCK_STREAM, 6)) < 0)
 	{
-		error1("Cannot create socket: %s", strerror(errno));
-		return -1;
+		if((server.sin_addr.s_addr = inet_addr(host->p)) == INADDR_NONE)
+		return FALSE;
+		cache_add( r, PF_INET, SOCK_STREAM, 6
+		,	(struct sockaddr *)&server, sizeof(server) );
 	}
-	if(timeout_connect(sock, (struct sockaddr *)&server, sizeof(server)))
-	return -1;
-#else /* Host lookup and connection in a protocol independent manner. */
+#else /* Host lookup in a protocol independent manner. */
 	struct addrinfo hints;
 	struct addrinfo *addr, *addrlist;
-	int ret, sock = -1;
+	int ret;
+	int first_family;
+	int pass;
 
 	if(param.verbose>1) fprintf(stderr, "Note: Attempting new-style connection to %s\n", host->p);
 	memset(&hints, 0, sizeof(struct addrinfo));
@@ -303,29 +460,70 @@ int open_connection(mpg123_string *host, mpg123_string *port)
 	if(ret != 0)
 	{
 		error3("Resolving %s:%s: %s", host->p, port->p, gai_strerror(ret));
-		return -1;
+		return FALSE;
 	}
-
-	addr = addrlist;
-	while(addr != NULL)
+	/* Keep the preferred order, but alternate between the preferred
+	   family and the others, so that one broken family does not hold up
+	   all attempts. */
+	first_family = addrlist ? addrlist->ai_family : AF_UNSPEC;
 	{
-		sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-		if(sock >= 0)
+		struct addrinfo *next[2];
+		next[0] = next[1] = addrlist;
+		for(pass=0; next[0] || next[1]; pass = !pass)
 		{
-			if(timeout_connect(sock, addr->ai_addr, addr->ai_addrlen) == 0)
-			break;
-
-			close(sock);
-			sock=-1;
+			addr = next[pass];
+			while(addr && (addr->ai_family == first_family) != !pass)
+				addr = addr->ai_next;
+			if(addr)
+			{
+				cache_add( r, addr->ai_family, addr->ai_socktype, addr->ai_protocol
+				,	addr->ai_addr, addr->ai_addrlen );
+				addr = addr->ai_next;
+			}
+			next[pass] = addr;
 		}
-		addr=addr->ai_next;
 	}
-	if(sock < 0) error2("Cannot resolve/connect to %s:%s!", host->p, port->p);
-
 	freeaddrinfo(addrlist);
 #endif
+	return r->count > 0;
+}
+
+/* So, this then is the only routine that should know about IPv4 or v6 in future. */
+static int locked_connection(mpg123_string *host, mpg123_string *port)
+{
+	struct resolved *r;
+	int sock = -1;
+
+	if((r = cache_find(host, port)))
+	{
+		if(param.verbose>1) fprintf(stderr, "Note: Reusing addresses of %s\n", host->p);
+		if((sock = cache_connect(r)) >= 0)
+			return sock;
+		r->count = 0;
+	}
+	if((r = cache_new(host, port)) && resolve(r, host, port))
+		sock = cache_connect(r);
+	if(sock < 0)
+	{
+		if(r)
+			r->count = 0;
+		error2("Cannot resolve/connect to %s:%s!", host->p, port->p);
+	}
 	return sock; /* Hopefully, that's an open socket to talk with. */
 }
+
+int open_connection(mpg123_string *host, mpg123_string *port)
+{
+	int sock;
+#ifndef NO_THREADS
+	pthread_mutex_lock(&dns_lock);
+#endif
+	sock = locked_connection(host, port);
+#ifndef NO_THREADS
+	pthread_mutex_unlock(&dns_lock);
+#endif
+	return sock;
+}
 #endif /* !defined (WANT_WIN32_SOCKETS) */
 #else /* NETWORK */
 
@@ -0,0 +1,463 @@
+/*
+	rtpget: RTP and plain UDP input, unicast or multicast
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	An URL like rtp://@239.1.2.3:5004 (or udp://...) binds to the port and
+	joins the group, without a host it takes unicast packets to any local
+	address. The datagrams are received in batches with recvmmsg() straight
+	into a pool of packet buffers, which are queued by RTP sequence number.
+	A missing packet is waited for until RTP_JITTER later ones arrived, then
+	it is given up for lost and the decoder resyncs on the next frame
+	header. With udp:// the datagrams are taken as they come, all payload.
+	For RTP, payload type 14 (MPEG audio, RFC 2250) has its 4 byte header
+	stripped, others are passed on after the RTP header.
+	There is only one such stream at a time.
+*/
+
+/* For recvmmsg(). */
+#define _GNU_SOURCE
+#include "mpg123app.h"
+#include "rtpget.h"
+
+#if defined(NETWORK) && !defined(WANT_WIN32_SOCKETS)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <errno.h>
+#include "true.h"
+#endif
+
+#include "debug.h"
+
+int rtp_url(const char *url)
+{
+	return url && (!strncmp(url, "rtp://", 6) || !strncmp(url, "udp://", 6));
+}
+
+#if defined(NETWORK) && !defined(WANT_WIN32_SOCKETS)
+
+/* Buffers in the pool, also the reordering window. */
+#define RTP_PACKETS 64
+/* Datagrams fetched by one call. */
+#define RTP_BATCH 16
+/* Largest datagram taken, bigger ones are dropped. */
+#define RTP_PACKET_SIZE 8192
+/* Later packets to wait for before a missing one is given up. */
+#define RTP_JITTER 8
+/* Socket buffer asked for, to survive bursts while decoding. */
+#define RTP_RCVBUF (1<<20)
+
+static struct
+{
+	int fd;      /* socket handed out, -1 for none */
+	int rtp;     /* RTP headers, else raw UDP payload */
+	unsigned char *mem; /* RTP_PACKETS buffers of RTP_PACKET_SIZE */
+	size_t start[RTP_PACKETS]; /* payload in each buffer */
+	size_t end[RTP_PACKETS];
+	int order[RTP_PACKETS]; /* buffer for sequence number % RTP_PACKETS */
+	int freelist[RTP_PACKETS];
+	int nfree;
+	int queued;
+	int started;
+	uint16_t next; /* sequence number to hand out next */
+	uint16_t top;  /* highest one received */
+	uint16_t rawseq; /* counting plain UDP datagrams */
+	int cur;       /* buffer being read, -1 for none */
+	size_t off;
+	unsigned long lost;
+	unsigned long late;
+} rtpin = { -1, 0, NULL, {0}, {0}, {0}, {0}, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+#define RTP_BUF(b) (rtpin.mem+(size_t)(b)*RTP_PACKET_SIZE)
+
+static void free_packet(int b)
+{
+	rtpin.freelist[rtpin.nfree++] = b;
+}
+
+/* Payload range and sequence number of a received RTP packet, FALSE if it
+   is none. */
+static int parse_rtp(int b, size_t len, uint16_t *seq)
+{
+	unsigned char *p = RTP_BUF(b);
+	size_t start = 12;
+	size_t end = len;
+
+	if(len < 12 || (p[0]>>6) != 2)
+		return FALSE;
+	start += 4*(p[0] & 0x0f); /* CSRC list */
+	if((p[0] & 0x10) && start+4 <= end) /* header extension */
+		start += 4 + 4*(((size_t)p[start+2]<<8) | p[start+3]);
+	if((p[0] & 0x20) && end > start) /* padding */
+		end -= p[len-1];
+	if((p[1] & 0x7f) == 14) /* MPA: MBZ and fragment offset */
+		start += 4;
+	if(start > end)
+		return FALSE;
+	*seq = ((uint16_t)p[2]<<8) | p[3];
+	rtpin.start[b] = start;
+	rtpin.end[b] = end;
+	return TRUE;
+}
+
+/* Put a received datagram into its place in the sequence. */
+static void queue_packet(int b, size_t len)
+{
+	uint16_t seq;
+	int16_t d;
+	int slot;
+
+	if(rtpin.rtp)
+	{
+		if(!parse_rtp(b, len, &seq))
+		{
+			free_packet(b);
+			return;
+		}
+	}
+	else
+	{
+		seq = rtpin.rawseq++;
+		rtpin.start[b] = 0;
+		rtpin.end[b] = len;
+	}
+	if(!rtpin.started)
+	{
+		rtpin.started = TRUE;
+		rtpin.next = rtpin.top = seq;
+	}
+	d = (int16_t)(uint16_t)(seq - rtpin.next);
+	if(d < 0)
+	{
+		/* Too late or a duplicate of something played already. */
+		++rtpin.late;
+		free_packet(b);
+		return;
+	}
+	if(d >= RTP_PACKETS)
+	{
+		/* A jump, the sender restarted or we fell far behind. */
+		int i;
+		debug2("RTP jump from %u to %u", (unsigned)rtpin.next, (unsigned)seq);
+		for(i=0; i<RTP_PACKETS; ++i)
+			if(rtpin.order[i] >= 0)
+			{
+				free_packet(rtpin.order[i]);
+				rtpin.order[i] = -1;
+			}
+		rtpin.lost += (uint16_t)(seq - rtpin.next);
+		rtpin.queued = 0;
+		rtpin.next = rtpin.top = seq;
+	}
+	slot = seq % RTP_PACKETS;
+	if(rtpin.order[slot] >= 0)
+	{
+		++rtpin.late;
+		free_packet(b);
+		return;
+	}
+	rtpin.order[slot] = b;
+	++rtpin.queued;
+	if((int16_t)(uint16_t)(seq - rtpin.top) > 0)
+		rtpin.top = seq;
+}
+
+/* Fetch at least one datagram, as many as there are without waiting.
+   Returns -1 on error. */
+static int receive_packets(void)
+{
+	int n = rtpin.nfree < RTP_BATCH ? rtpin.nfree : RTP_BATCH;
+	int i;
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr msgs[RTP_BATCH];
+	struct iovec iov[RTP_BATCH];
+	int bufs[RTP_BATCH];
+	int got;
+
+	memset(msgs, 0, sizeof(msgs));
+	for(i=0; i<n; ++i)
+	{
+		bufs[i] = rtpin.freelist[rtpin.nfree-1-i];
+		iov[i].iov_base = RTP_BUF(bufs[i]);
+		iov[i].iov_len = RTP_PACKET_SIZE;
+		msgs[i].msg_hdr.msg_iov = iov+i;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	got = recvmmsg(rtpin.fd, msgs, n, MSG_WAITFORONE, NULL);
+	if(got < 0)
+		return -1;
+	rtpin.nfree -= n;
+	for(i=0; i<n; ++i)
+	{
+		if(i >= got || (msgs[i].msg_hdr.msg_flags & MSG_TRUNC))
+			free_packet(bufs[i]);
+		else
+			queue_packet(bufs[i], msgs[i].msg_len);
+	}
+#else
+	ssize_t got;
+	int b;
+	if(n < 1)
+		return -1;
+	(void)i;
+	b = rtpin.freelist[rtpin.nfree-1];
+	got = recv(rtpin.fd, RTP_BUF(b), RTP_PACKET_SIZE, 0);
+	if(got < 0)
+		return -1;
+	--rtpin.nfree;
+	queue_packet(b, (size_t)got);
+#endif
+	return 0;
+}
+
+/* The next buffer in sequence, skipping what is given up, or -1. */
+static int next_packet(void)
+{
+	while(rtpin.queued)
+	{
+		int slot = rtpin.next % RTP_PACKETS;
+		int b = rtpin.order[slot];
+		if(b >= 0)
+		{
+			rtpin.order[slot] = -1;
+			--rtpin.queued;
+			++rtpin.next;
+			return b;
+		}
+		/* Waited long enough, or there is no buffer left to receive more. */
+		if( (uint16_t)(rtpin.top - rtpin.next) < RTP_JITTER
+		&&  rtpin.nfree )
+			break;
+		++rtpin.lost;
+		++rtpin.next;
+	}
+	return -1;
+}
+
+#ifdef IPV6
+static int rtp_addr(const char *host, const char *port, struct sockaddr_storage *sa, socklen_t *salen)
+{
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_PASSIVE;
+	if(getaddrinfo(*host ? host : NULL, port, &hints, &res) || !res)
+		return -1;
+	memcpy(sa, res->ai_addr, res->ai_addrlen);
+	*salen = res->ai_addrlen;
+	freeaddrinfo(res);
+	return 0;
+}
+#else
+static int rtp_addr(const char *host, const char *port, struct sockaddr_storage *sa, socklen_t *salen)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in*)sa;
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons((unsigned short)atoi(port));
+	sin->sin_addr.s_addr = *host ? inet_addr(host) : htonl(INADDR_ANY);
+	if(sin->sin_addr.s_addr == INADDR_NONE)
+		return -1;
+	*salen = sizeof(*sin);
+	return 0;
+}
+#endif
+
+/* Membership in the group of a multicast address. */
+static int join_group(int sock, struct sockaddr_storage *sa)
+{
+	if(sa->ss_family == AF_INET)
+	{
+		struct sockaddr_in *sin = (struct sockaddr_in*)sa;
+		struct ip_mreq mreq;
+		if(!IN_MULTICAST(ntohl(sin->sin_addr.s_addr)))
+			return 0;
+		mreq.imr_multiaddr = sin->sin_addr;
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		return setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+	}
+#ifdef IPV6
+	if(sa->ss_family == AF_INET6)
+	{
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)sa;
+		struct ipv6_mreq mreq;
+		if(!IN6_IS_ADDR_MULTICAST(&sin6->sin6_addr))
+			return 0;
+		mreq.ipv6mr_multiaddr = sin6->sin6_addr;
+		mreq.ipv6mr_interface = 0;
+		return setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq, sizeof(mreq));
+	}
+#endif
+	return 0;
+}
+
+int rtp_open(const char *url)
+{
+	char *host = NULL;
+	char *port;
+	char *end;
+	struct sockaddr_storage sa;
+	socklen_t salen;
+	int sock = -1;
+	int one = 1;
+	int rcvbuf = RTP_RCVBUF;
+	int i;
+
+	if(rtpin.fd >= 0)
+	{
+		error("Only one RTP/UDP stream at a time.");
+		return -1;
+	}
+	if(!rtp_url(url) || !(host = compat_strdup(url+6)))
+		goto rtp_fail;
+	/* rtp://@group:port as in other players, [v6addr]:port */
+	end = host + (host[0] == '@' ? 1 : 0);
+	memmove(host, end, strlen(end)+1);
+	if((end = strchr(host, '/')))
+		*end = 0;
+	if(host[0] == '[' && (end = strchr(host, ']')))
+	{
+		*end = 0;
+		port = end[1] == ':' ? end+2 : NULL;
+		memmove(host, host+1, strlen(host+1)+1);
+	}
+	else if((port = strrchr(host, ':')))
+		*port++ = 0;
+	if(!port || !*port)
+	{
+		error1("No port in %s.", url);
+		goto rtp_fail;
+	}
+	if(rtp_addr(host, port, &sa, &salen))
+	{
+		error1("Cannot make an address from %s.", url);
+		goto rtp_fail;
+	}
+	if((sock = socket(sa.ss_family, SOCK_DGRAM, 0)) < 0)
+	{
+		error1("Cannot create socket: %s", strerror(errno));
+		goto rtp_fail;
+	}
+	/* Several listeners for the same group on one machine. */
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if(setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) && param.verbose > 1)
+		fprintf(stderr, "Note: Cannot enlarge socket receive buffer.\n");
+	if(bind(sock, (struct sockaddr*)&sa, salen))
+	{
+		error2("Cannot bind to %s: %s", url, strerror(errno));
+		goto rtp_fail;
+	}
+	if(join_group(sock, &sa))
+	{
+		error2("Cannot join multicast group of %s: %s", url, strerror(errno));
+		goto rtp_fail;
+	}
+	if(!(rtpin.mem = malloc((size_t)RTP_PACKETS*RTP_PACKET_SIZE)))
+	{
+		error("Cannot allocate RTP packet buffers.");
+		goto rtp_fail;
+	}
+	rtpin.fd = sock;
+	rtpin.rtp = !strncmp(url, "rtp://", 6);
+	for(i=0; i<RTP_PACKETS; ++i)
+	{
+		rtpin.order[i] = -1;
+		rtpin.freelist[i] = i;
+	}
+	rtpin.nfree = RTP_PACKETS;
+	rtpin.queued = 0;
+	rtpin.started = FALSE;
+	rtpin.rawseq = 0;
+	rtpin.cur = -1;
+	rtpin.off = 0;
+	rtpin.lost = rtpin.late = 0;
+	if(param.verbose > 1)
+		fprintf(stderr, "Note: Listening for %s on port %s.\n"
+		,	rtpin.rtp ? "RTP" : "UDP", port);
+	free(host);
+	return sock;
+
+rtp_fail:
+	if(sock >= 0)
+		close(sock);
+	if(host)
+		free(host);
+	return -1;
+}
+
+ssize_t rtp_read(int fd, void *buf, size_t count)
+{
+	size_t got = 0;
+
+	if(fd < 0 || fd != rtpin.fd)
+		return read(fd, buf, count);
+	while(got < count)
+	{
+		size_t piece;
+		if(rtpin.cur < 0)
+		{
+			int b = next_packet();
+			if(b < 0)
+			{
+				/* Rather return what is there than wait for more. */
+				if(got)
+					break;
+				if(receive_packets())
+					return -1;
+				continue;
+			}
+			rtpin.cur = b;
+			rtpin.off = rtpin.start[b];
+		}
+		piece = rtpin.end[rtpin.cur] - rtpin.off;
+		if(piece > count-got)
+			piece = count-got;
+		memcpy((char*)buf+got, RTP_BUF(rtpin.cur)+rtpin.off, piece);
+		got += piece;
+		rtpin.off += piece;
+		if(rtpin.off == rtpin.end[rtpin.cur])
+		{
+			free_packet(rtpin.cur);
+			rtpin.cur = -1;
+		}
+	}
+	return (ssize_t)got;
+}
+
+void rtp_close(int fd)
+{
+	if(fd < 0 || fd != rtpin.fd)
+		return;
+	if(param.verbose > 1 && rtpin.rtp)
+		fprintf( stderr, "Note: RTP packets lost: %lu, late: %lu\n"
+		,	rtpin.lost, rtpin.late );
+	free(rtpin.mem);
+	rtpin.mem = NULL;
+	rtpin.fd = -1;
+}
+
+#else
+
+/* stubs */
+int rtp_open(const char *url)
+{
+	if(!param.quiet)
+		error("RTP/UDP support not built in.");
+	return -1;
+}
+
+ssize_t rtp_read(int fd, void *buf, size_t count)
+{
+	return read(fd, buf, count);
+}
+
+void rtp_close(int fd)
+{
+}
+#endif
+
+/* EOF */
@@ -0,0 +1,24 @@
+/*
+	rtpget: RTP and plain UDP input, unicast or multicast (the header)
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#ifndef _RTPGET_H_
+#define _RTPGET_H_
+
+#include "mpg123app.h"
+
+/* TRUE for names starting with rtp:// or udp://. */
+int rtp_url(const char *url);
+/* Bind to the port of the URL (rtp://[@]group:port or udp://...), joining
+   the group if it is multicast. Returns the socket, -1 on error. */
+int rtp_open(const char *url);
+/* Reader function for libmpg123 that hands out the payload in sequence
+   order. Other descriptors get plain read(). */
+ssize_t rtp_read(int fd, void *buf, size_t count);
+/* Forget about fd before closing it. */
+void rtp_close(int fd);
+
+#endif
@@ -4,23 +4,220 @@
 	copyright 2010 by the mpg123 project - free software under the terms of the LGPL 2.1
 	see COPYING and AUTHORS files in distribution or http://mpg123.org
 	initially written by Michael Hipp
+
+	Writing to the dump file happens in a thread by default, from a buffer of
+	--streamdump-buffer kB, so that a slow disk does not stall playback of a
+	live stream. When the buffer is full, reading waits for the writer. With
+	--streamdump-chunk, the dump is split into files of that size.
 */
 
 #include "streamdump.h"
+#include "rtpget.h"
 #include <fcntl.h>
 #include <errno.h>
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
 #include "debug.h"
 
 /* Stream dump descriptor. */
 static int dump_fd = -1;
+/* Position in the whole dump, the current chunk file and how many there are. */
+static off_t dump_pos = 0;
+static off_t dump_chunk = -1;
+static off_t dump_chunks = 0;
+
+#ifndef NO_THREADS
+static struct
+{
+	unsigned char *data;
+	size_t size;
+	size_t head; /* next byte for the writer */
+	size_t fill; /* bytes not written yet, including the ones being written */
+	int quit;
+	int error;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} ring; /* set up in dump_open() */
+#endif
+
+/* Open the dump file for the given chunk. The first visit of a chunk
+   truncates, a seek back into it does not. */
+static int chunk_file(off_t chunk)
+{
+	const char *dot  = strrchr(param.streamdump, '.');
+	const char *base = strrchr(param.streamdump, '/');
+	size_t stem;
+	char *name;
+	int fd;
+
+	if(dot == NULL || (base != NULL && dot < base))
+		dot = param.streamdump+strlen(param.streamdump);
+	stem = (size_t)(dot-param.streamdump);
+	/* Enough for a dash and the digits of any off_t. */
+	name = malloc(strlen(param.streamdump)+2+3*sizeof(off_t));
+	if(name == NULL)
+		return -1;
+	sprintf(name, "%.*s-%03"OFF_P"%s", (int)stem, param.streamdump, (off_p)chunk+1, dot);
+	fd = compat_open(name, chunk < dump_chunks ? O_RDWR : O_CREAT|O_TRUNC|O_RDWR);
+	if(fd < 0)
+		error2("Failed to open dump file %s: %s", name, strerror(errno));
+	else
+	{
+#ifdef WIN32
+		_setmode(fd, _O_BINARY);
+#endif
+		if(!param.quiet && chunk >= dump_chunks)
+			fprintf(stderr, "Note: Dumping stream to %s\n", name);
+	}
+	free(name);
+	return fd;
+}
+
+/* Switch to the chunk file at the current position. Chunks skipped by a
+   seek forward are created on the way, so that all before the last one
+   belong to this dump. */
+static int chunk_open(void)
+{
+	off_t chunk_bytes = (off_t)param.streamdump_chunk*1024;
+	off_t chunk = dump_pos/chunk_bytes;
+
+	if(dump_fd > -1)
+		compat_close(dump_fd);
+	dump_fd = -1;
+	for(; dump_chunks < chunk; ++dump_chunks)
+	{
+		int fd = chunk_file(dump_chunks);
+		if(fd < 0)
+			return -1;
+		compat_close(fd);
+	}
+	dump_fd = chunk_file(chunk);
+	if(dump_fd < 0)
+		return -1;
+	if(chunk >= dump_chunks)
+		dump_chunks = chunk+1;
+	dump_chunk = chunk;
+	return lseek(dump_fd, dump_pos % chunk_bytes, SEEK_SET) < 0 ? -1 : 0;
+}
+
+/* Write at the current dump position, crossing into the next chunk file
+   as needed. */
+static int dump_write(const unsigned char *buf, size_t count)
+{
+	while(count)
+	{
+		size_t n = count;
+		ssize_t ret;
+		if(param.streamdump_chunk > 0)
+		{
+			off_t chunk_bytes = (off_t)param.streamdump_chunk*1024;
+			off_t left = chunk_bytes - dump_pos % chunk_bytes;
+			if(dump_chunk != dump_pos/chunk_bytes && chunk_open())
+				return -1;
+			if((off_t)n > left)
+				n = (size_t)left;
+		}
+		ret = write(dump_fd, buf, n);
+		if(ret < 0 && errno == EINTR)
+			continue;
+		if(ret < 0)
+		{
+			error1("Failed to write stream dump: %s", strerror(errno));
+			return -1;
+		}
+		buf      += ret;
+		count    -= ret;
+		dump_pos += ret;
+	}
+	return 0;
+}
+
+/* Mirror the new input position in the dump. */
+static void dump_moveto(off_t pos)
+{
+	dump_pos = pos;
+	if(param.streamdump_chunk > 0)
+		dump_chunk = -1; /* The right file is opened on the next write. */
+	else
+		lseek(dump_fd, pos, SEEK_SET);
+}
+
+#ifndef NO_THREADS
+static void *dump_thread(void *arg)
+{
+	pthread_mutex_lock(&ring.lock);
+	for(;;)
+	{
+		size_t n;
+		int err;
+		while(!ring.fill && !ring.quit)
+			pthread_cond_wait(&ring.cond, &ring.lock);
+		if(!ring.fill)
+			break;
+		n = ring.size - ring.head;
+		if(n > ring.fill)
+			n = ring.fill;
+		/* The reader only adds behind fill, the bytes stay put meanwhile. */
+		pthread_mutex_unlock(&ring.lock);
+		err = dump_write(ring.data+ring.head, n);
+		pthread_mutex_lock(&ring.lock);
+		ring.head  = (ring.head+n) % ring.size;
+		ring.fill -= n;
+		if(err)
+		{
+			ring.error = 1;
+			ring.fill = 0;
+		}
+		pthread_cond_broadcast(&ring.cond);
+		if(err)
+			break;
+	}
+	pthread_mutex_unlock(&ring.lock);
+	return NULL;
+}
+
+/* Copy into the ring, waiting for space when the writer lags behind. */
+static void ring_add(const unsigned char *buf, size_t count)
+{
+	pthread_mutex_lock(&ring.lock);
+	while(count && !ring.error)
+	{
+		size_t tail = (ring.head+ring.fill) % ring.size;
+		size_t n = ring.size - ring.fill;
+		if(!n)
+		{
+			pthread_cond_wait(&ring.cond, &ring.lock);
+			continue;
+		}
+		if(n > ring.size-tail)
+			n = ring.size-tail;
+		if(n > count)
+			n = count;
+		memcpy(ring.data+tail, buf, n);
+		ring.fill += n;
+		buf   += n;
+		count -= n;
+		pthread_cond_broadcast(&ring.cond);
+	}
+	pthread_mutex_unlock(&ring.lock);
+}
+#endif
 
 /* Read data from input, write copy to dump file. */
 static ssize_t dump_read(int fd, void *buf, size_t count)
 {
-	ssize_t ret = read(fd, buf, count);
+	ssize_t ret = rtp_read(fd, buf, count);
 	if(ret > 0 && dump_fd > -1)
 	{
-		write(dump_fd, buf, ret);
+#ifndef NO_THREADS
+		if(ring.data)
+			ring_add(buf, (size_t)ret);
+		else
+#endif
+		if(dump_write(buf, (size_t)ret))
+			dump_close();
 	}
 	return ret;
 }
@@ -31,7 +228,19 @@ static off_t dump_seek(int fd, off_t pos, int whence)
 	off_t ret = lseek(fd, pos, whence);
 	if(ret >= 0 && dump_fd > -1)
 	{
-		lseek(dump_fd, pos, whence);
+#ifndef NO_THREADS
+		if(ring.data)
+		{
+			/* Let the writer finish at the old position first. */
+			pthread_mutex_lock(&ring.lock);
+			while(ring.fill)
+				pthread_cond_wait(&ring.cond, &ring.lock);
+			dump_moveto(ret);
+			pthread_mutex_unlock(&ring.lock);
+		}
+		else
+#endif
+		dump_moveto(ret);
 	}
 	return ret;
 }
@@ -43,17 +252,57 @@ int dump_open(mpg123_handle *mh)
 
 	if(param.streamdump == NULL) return 0;
 
-	if(!param.quiet) fprintf(stderr, "Note: Dumping stream to %s\n", param.streamdump);
-
-	dump_fd = compat_open(param.streamdump, O_CREAT|O_TRUNC|O_RDWR);
-	if(dump_fd < 0)
+	dump_pos = 0;
+	dump_chunk = -1;
+	dump_chunks = 0;
+	if(param.streamdump_chunk > 0)
 	{
-		error1("Failed to open dump file: %s\n", strerror(errno));
-		return -1;
+		/* Get the first chunk file right now to see if that works. */
+		if(chunk_open())
+		{
+			dump_close();
+			return -1;
+		}
 	}
+	else
+	{
+		if(!param.quiet) fprintf(stderr, "Note: Dumping stream to %s\n", param.streamdump);
+
+		dump_fd = compat_open(param.streamdump, O_CREAT|O_TRUNC|O_RDWR);
+		if(dump_fd < 0)
+		{
+			error1("Failed to open dump file: %s\n", strerror(errno));
+			return -1;
+		}
 
 #ifdef WIN32
-	_setmode(dump_fd, _O_BINARY);
+		_setmode(dump_fd, _O_BINARY);
+#endif
+	}
+
+#ifndef NO_THREADS
+	if(param.streamdump_buffer > 0)
+	{
+		ring.size = (size_t)param.streamdump_buffer*1024;
+		ring.data = malloc(ring.size);
+		ring.head = ring.fill = 0;
+		ring.quit = ring.error = 0;
+		pthread_mutex_init(&ring.lock, NULL);
+		pthread_cond_init(&ring.cond, NULL);
+		if(ring.data && pthread_create(&ring.thread, NULL, dump_thread, NULL))
+		{
+			free(ring.data);
+			ring.data = NULL;
+		}
+		/* Not fatal, just writing right away then. */
+		if(!ring.data)
+		{
+			pthread_cond_destroy(&ring.cond);
+			pthread_mutex_destroy(&ring.lock);
+			if(!param.quiet)
+				fprintf(stderr, "Warning: Cannot write the stream dump in the background.\n");
+		}
+	}
 #endif
 
 	ret = mpg123_replace_reader(mh, dump_read, dump_seek);
@@ -68,6 +317,21 @@ int dump_open(mpg123_handle *mh)
 
 void dump_close(void)
 {
+#ifndef NO_THREADS
+	if(ring.data)
+	{
+		/* The writer empties the ring before it quits. */
+		pthread_mutex_lock(&ring.lock);
+		ring.quit = 1;
+		pthread_cond_broadcast(&ring.cond);
+		pthread_mutex_unlock(&ring.lock);
+		pthread_join(ring.thread, NULL);
+		pthread_cond_destroy(&ring.cond);
+		pthread_mutex_destroy(&ring.lock);
+		free(ring.data);
+		ring.data = NULL;
+	}
+#endif
 	if(dump_fd > -1) compat_close(dump_fd);
 
 	dump_fd = -1;
@@ -6,8 +6,18 @@
 	initially written by Michael Hipp (dissected/renamed by Thomas Orgis)
 */
 
+/* CPU_SET() and friends for sched_setaffinity(). */
+#define _GNU_SOURCE
+
 #include "mpg123app.h"
 #include <sys/stat.h>
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
+#ifdef HAVE_MLOCKALL
+#include <sys/mman.h>
+#endif
+#include <errno.h>
 #include "sysutil.h"
 
 #include "debug.h"
@@ -86,3 +96,85 @@ int split_dir_file (const char *path, char **dname, char **fname)
 		return 0;
 	}
 }
+
+long cpu_list_mask(const char *list)
+{
+	unsigned long mask = 0;
+	const char *p = list;
+
+	do
+	{
+		char *end;
+		long first, last;
+		first = last = strtol(p, &end, 10);
+		if(end == p)
+			return -1;
+		if(*end == '-')
+		{
+			p = end+1;
+			last = strtol(p, &end, 10);
+			if(end == p)
+				return -1;
+		}
+		if(first < 0 || last < first || last >= (long)sizeof(long)*8)
+			return -1;
+		for(; first <= last; ++first)
+			mask |= 1UL<<first;
+		p = end;
+	} while(*p++ == ',');
+	return p[-1] ? -1 : (long)mask;
+}
+
+int set_rtprio(int prio)
+{
+#ifdef HAVE_SCHED_SETSCHEDULER
+	struct sched_param sp;
+	memset(&sp, 0, sizeof(sp));
+	sp.sched_priority = prio > 0 ? prio : -prio;
+	if(sched_setscheduler(0, prio > 0 ? SCHED_FIFO : SCHED_RR, &sp))
+	{
+		error1("Can't get real-time priority: %s", strerror(errno));
+		return -1;
+	}
+	return 0;
+#else
+	error("No support for real-time priority.");
+	return -1;
+#endif
+}
+
+int set_cpumask(long mask)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	cpu_set_t set;
+	unsigned int i;
+	CPU_ZERO(&set);
+	for(i=0; i<sizeof(mask)*8; ++i)
+		if((unsigned long)mask>>i & 1)
+			CPU_SET(i, &set);
+	if(sched_setaffinity(0, sizeof(set), &set))
+	{
+		error1("Can't set CPU affinity: %s", strerror(errno));
+		return -1;
+	}
+	return 0;
+#else
+	error("No support for setting CPU affinity.");
+	return -1;
+#endif
+}
+
+int lock_memory(void)
+{
+#ifdef HAVE_MLOCKALL
+	if(mlockall(MCL_CURRENT|MCL_FUTURE))
+	{
+		error1("Can't lock memory: %s", strerror(errno));
+		return -1;
+	}
+	return 0;
+#else
+	error("No support for locking memory.");
+	return -1;
+#endif
+}
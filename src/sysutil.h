@@ -13,5 +13,16 @@ int split_dir_file(const char *path, char **dname, char **fname);
 /* Length of directory part in given path. */
 size_t dir_length(const char *path);
 
+/* Parse a CPU list like 0,2-3 into a bit mask, -1 on bad syntax or CPU
+   numbers beyond the bits of a long. */
+long cpu_list_mask(const char *list);
+/* These work on the calling thread (of the main process), returning 0 on
+   success and a message on stderr otherwise. */
+/* Real-time scheduling: prio > 0 for SCHED_FIFO, < 0 for SCHED_RR. */
+int set_rtprio(int prio);
+int set_cpumask(long mask);
+/* Lock all current and future memory of the process. */
+int lock_memory(void);
+
 #endif
 
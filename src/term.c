@@ -323,10 +323,16 @@ static void term_handle_key(mpg123_handle *fr, out123_handle *ao, char val)
 			/* Not really sure if that is what is wanted
 				 This jumps in audio output, but has direct reaction to pausing loop. */
 			out123_param_float(ao, OUT123_PRELOAD, 0.);
+			out123_param_float(ao, OUT123_PRELOADTIME, 0.);
+			out123_param_float(ao, OUT123_REFILLTIME, 0.);
 			pause_recycle(fr);
 		}
 		else
+		{
 			out123_param_float(ao, OUT123_PRELOAD, param.preload);
+			out123_param_float(ao, OUT123_PRELOADTIME, param.preload_time);
+			out123_param_float(ao, OUT123_REFILLTIME, param.refill_time);
+		}
 		if(stopped)
 			stopped=0;
 		if(param.verbose)
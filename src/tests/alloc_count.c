@@ -0,0 +1,148 @@
+/*
+	alloc_count: check that decoding with MPG123_FIXED_MEMORY does not
+	allocate after the first frame
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The counting happens in allocator hooks given to mpg123_allocator(). Each
+	file is decoded via mpg123_read() and via the feeder, with a growing
+	index in addition. Files with ID3v2 tags or ICY metadata inside the
+	stream are the interesting ones.
+*/
+
+/* The hooks below want the real thing. */
+#define COMPAT_SYSTEM_ALLOC
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+static long allocs = 0;
+static int counting = 0;
+
+static void *count_alloc(void *handle, size_t size)
+{
+	if(counting) ++allocs;
+	return malloc(size);
+}
+
+static void *count_realloc(void *handle, void *ptr, size_t size)
+{
+	if(counting) ++allocs;
+	return realloc(ptr, size);
+}
+
+static void count_free(void *handle, void *ptr)
+{
+	free(ptr);
+}
+
+static unsigned char outbuf[4608];
+
+static mpg123_handle *new_handle(long index_size)
+{
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+	if(mh == NULL)
+		return NULL;
+	if( mpg123_param(mh, MPG123_FIXED_MEMORY, 1, 0) != MPG123_OK
+	||  mpg123_param(mh, MPG123_INDEX_SIZE, index_size, 0) != MPG123_OK )
+	{
+		error1("cannot set parameters: %s", mpg123_strerror(mh));
+		mpg123_delete(mh);
+		return NULL;
+	}
+	return mh;
+}
+
+/* Count allocations while decoding with mpg123_read(), after the first
+   frame is out. */
+static int test_read(const char *path, long index_size)
+{
+	mpg123_handle *mh;
+	size_t done;
+	int ret;
+
+	if(!(mh = new_handle(index_size)))
+		return -1;
+	if(mpg123_open(mh, path) != MPG123_OK)
+	{
+		error1("cannot open: %s", mpg123_strerror(mh));
+		mpg123_delete(mh);
+		return -1;
+	}
+	allocs = 0;
+	while((ret = mpg123_read(mh, outbuf, sizeof(outbuf), &done)) == MPG123_NEW_FORMAT)
+		continue;
+	counting = 1;
+	while(ret == MPG123_OK || ret == MPG123_NEW_FORMAT)
+		ret = mpg123_read(mh, outbuf, sizeof(outbuf), &done);
+	counting = 0;
+	mpg123_delete(mh);
+	if(ret != MPG123_DONE)
+		return -1;
+	fprintf(stdout, "read, index %ld: %ld allocations\n", index_size, allocs);
+	return allocs ? -1 : 0;
+}
+
+/* The same with the feeder, in small pieces that fit the feed pool. */
+static int test_feed(const char *path, long index_size)
+{
+	mpg123_handle *mh;
+	unsigned char inbuf[1024];
+	size_t done, got;
+	FILE *in;
+	int ret = MPG123_NEED_MORE;
+
+	if(!(mh = new_handle(index_size)))
+		return -1;
+	if(mpg123_open_feed(mh) != MPG123_OK || !(in = fopen(path, "rb")))
+	{
+		mpg123_delete(mh);
+		return -1;
+	}
+	allocs = 0;
+	while(ret != MPG123_ERR && (got = fread(inbuf, 1, sizeof(inbuf), in)) > 0)
+	{
+		ret = mpg123_decode(mh, inbuf, got, outbuf, sizeof(outbuf), &done);
+		while(ret == MPG123_OK || ret == MPG123_NEW_FORMAT)
+		{
+			if(ret == MPG123_OK && done)
+				counting = 1;
+			ret = mpg123_decode(mh, NULL, 0, outbuf, sizeof(outbuf), &done);
+		}
+	}
+	counting = 0;
+	fclose(in);
+	mpg123_delete(mh);
+	if(ret == MPG123_ERR)
+		return -1;
+	fprintf(stdout, "feed, index %ld: %ld allocations\n", index_size, allocs);
+	return allocs ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int i, errsum = 0;
+	if(argc < 2)
+	{
+		printf("Gimme MPEG file names...\n");
+		return 0;
+	}
+	if(mpg123_allocator(count_alloc, count_realloc, count_free, NULL) != MPG123_OK)
+		return 1;
+	mpg123_init();
+	for(i=1; i<argc; ++i)
+	{
+		int err = 0;
+		fprintf(stdout, "%s\n", argv[i]);
+		err += test_read(argv[i], 1000);
+		err += test_read(argv[i], -100);
+		err += test_feed(argv[i], 1000);
+		err += test_feed(argv[i], -100);
+		fprintf(stdout, "%s\n", err == 0 ? "PASS" : "FAIL");
+		errsum += err;
+	}
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
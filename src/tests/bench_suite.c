@@ -0,0 +1,758 @@
+/*
+	bench_suite: throughput of decoding, seeking, scanning, sample conversion
+	and file output on a fixed corpus, for tracking regressions
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The corpus is synthesized from a fixed seed, so that every build runs on
+	the same bits without shipping any files: Layer I, II and III, CBR, VBR
+	and free format, mono, stereo and joint stereo, MPEG 1, 2 and 2.5. The
+	frames carry pseudo-random, but valid, audio data. Layer I and II use a
+	bit allocation that fills the frame, Layer III codes only count1 quads
+	(with table B) without using the bit reservoir. That is not what an
+	encoder produces, but it keeps dequantization, stereo processing and
+	synthesis as busy as with real music. With -w, the corpus is also
+	written to files to give to other programs, like decoder_bench.
+
+	The results go to standard output, one line per test with tab-separated
+	fields: test, input, item count, item unit, CPU seconds, items per second
+	and a checksum of the output (- for none). Lines starting with # are
+	comments. The checksums of decoded audio depend on the decoder, the one
+	of syn123_conv() and of the written file have to stay the same.
+*/
+
+#include "config.h"
+#include "compat.h"
+#include <mpg123.h>
+#include <syn123.h>
+#include <out123.h>
+#include <time.h>
+#include "debug.h"
+
+#define COUNT(a) (sizeof(a)/sizeof(*(a)))
+
+// The stream description. A bitrate of 0 is free format with the given
+// frame size, vbr picks a new bitrate index for each frame.
+struct spec
+{
+	const char *name;
+	int version; // header bits: 3 for MPEG 1, 2 for MPEG 2, 0 for MPEG 2.5
+	int layer;
+	int mode;    // 0 stereo, 1 joint stereo, 3 mono
+	int mode_ext;
+	int rate_index;
+	int bitrate_index;
+	int vbr;
+	int free_size;
+};
+
+static const struct spec corpus[] =
+{
+	{ "l1_stereo",     3, 1, 0, 0, 1, 12, 0, 0 }
+,	{ "l1_joint",      3, 1, 1, 2, 1,  9, 0, 0 }
+,	{ "l1_lsf_mono",   2, 1, 3, 0, 1,  8, 0, 0 }
+,	{ "l2_stereo",     3, 2, 0, 0, 1, 10, 0, 0 }
+,	{ "l2_joint",      3, 2, 1, 1, 1, 10, 0, 0 }
+,	{ "l2_lsf_mono",   2, 2, 3, 0, 1,  8, 0, 0 }
+,	{ "l3_cbr_stereo", 3, 3, 0, 0, 1,  9, 0, 0 }
+,	{ "l3_vbr_joint",  3, 3, 1, 2, 0,  9, 1, 0 }
+,	{ "l3_mono",       3, 3, 3, 0, 2,  5, 0, 0 }
+,	{ "l3_lsf_joint",  2, 3, 1, 2, 0,  8, 0, 0 }
+,	{ "l3_mpeg25",     0, 3, 3, 0, 1,  4, 0, 0 }
+,	{ "l3_free",       3, 3, 0, 0, 1,  0, 0, 1200 }
+};
+
+static const long rates[4][3] =
+{
+	{ 11025, 12000,  8000 } // MPEG 2.5
+,	{     0,     0,     0 }
+,	{ 22050, 24000, 16000 } // MPEG 2
+,	{ 44100, 48000, 32000 } // MPEG 1
+};
+
+// kbps by MPEG 1 layer, then MPEG 2/2.5 Layer I and II/III
+static const int bitrates[5][15] =
+{
+	{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 }
+,	{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 }
+,	{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 }
+,	{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 }
+,	{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+};
+
+static uint32_t rnd(uint32_t *seed)
+{
+	*seed = *seed*1103515245u + 12345u;
+	return *seed >> 8;
+}
+
+static double now(void)
+{
+	return (double)clock()/CLOCKS_PER_SEC;
+}
+
+static unsigned long checksum(unsigned long sum, const unsigned char *buf, size_t bytes)
+{
+	for(size_t i=0; i<bytes; ++i)
+		sum = sum*31 + buf[i];
+	return sum;
+}
+
+struct bitwriter
+{
+	unsigned char *p;
+	size_t pos;
+};
+
+static void put(struct bitwriter *bw, uint32_t val, int bits)
+{
+	while(bits--)
+	{
+		if(val>>bits & 1)
+			bw->p[bw->pos>>3] |= 0x80 >> (bw->pos&7);
+		++bw->pos;
+	}
+}
+
+static int spec_channels(const struct spec *s)
+{
+	return s->mode == 3 ? 1 : 2;
+}
+
+static long spec_rate(const struct spec *s)
+{
+	return rates[s->version][s->rate_index];
+}
+
+static int spec_samples(const struct spec *s)
+{
+	return s->layer == 1 ? 384 : (s->layer == 3 && s->version != 3 ? 576 : 1152);
+}
+
+static int frame_bytes(const struct spec *s, int bitrate_index)
+{
+	long rate = spec_rate(s);
+	int kbps;
+	if(!bitrate_index)
+		return s->free_size;
+	kbps = bitrates[s->version == 3 ? s->layer-1 : (s->layer == 1 ? 3 : 4)][bitrate_index];
+	switch(s->layer)
+	{
+		case 1:  return 12000*kbps/rate*4;
+		case 2:  return 144000*kbps/rate;
+		default: return (s->version == 3 ? 144000 : 72000)*kbps/rate;
+	}
+}
+
+static void header(struct bitwriter *bw, const struct spec *s, int bitrate_index)
+{
+	put(bw, 0x7ff, 11);
+	put(bw, s->version, 2);
+	put(bw, 4-s->layer, 2);
+	put(bw, 1, 1); // no CRC
+	put(bw, bitrate_index, 4);
+	put(bw, s->rate_index, 2);
+	put(bw, 0, 2); // no padding, private bit
+	put(bw, s->mode, 2);
+	put(bw, s->mode_ext, 2);
+	put(bw, 0, 4); // copyright, original, emphasis
+}
+
+// Allocation from 14 bits per sample going down with frequency, as much
+// as fits. Never a sample of all ones, which would look like a sync word.
+static void layer1(struct bitwriter *bw, const struct spec *s, long bits, uint32_t *seed)
+{
+	int ch = spec_channels(s);
+	int jsbound = s->mode == 1 ? s->mode_ext*4+4 : 32;
+	int alloc[32];
+	for(int top=14; top>0; --top)
+	{
+		long need = ch == 2 ? jsbound*8 + (32-jsbound)*4 : 32*4;
+		for(int sb=0; sb<32; ++sb)
+		{
+			alloc[sb] = top - sb/2 > 0 ? top - sb/2 : 0;
+			if(alloc[sb])
+				need += 6*ch + 12*(alloc[sb]+1)*(sb < jsbound ? ch : 1);
+		}
+		if(need <= bits)
+			break;
+	}
+	for(int sb=0; sb<32; ++sb)
+		for(int c=0; c<(sb < jsbound ? ch : 1); ++c)
+			put(bw, alloc[sb], 4);
+	for(int sb=0; sb<32; ++sb)
+		for(int c=0; c<ch; ++c)
+			if(alloc[sb])
+				put(bw, 14 + rnd(seed)%20, 6);
+	for(int gr=0; gr<12; ++gr)
+		for(int sb=0; sb<32; ++sb)
+			for(int c=0; c<(sb < jsbound ? ch : 1); ++c)
+				if(alloc[sb])
+					put(bw, rnd(seed) % ((2u<<alloc[sb])-1), alloc[sb]+1);
+}
+
+// The allocation table as chosen by the decoder, as count of subbands for
+// 4, 3 and 2 bits of allocation.
+static const int l2_nbal[5][3] =
+{
+	{ 11, 12, 4 }, { 11, 12, 7 }, { 2, 6, 0 }, { 2, 10, 0 }, { 4, 7, 19 }
+};
+
+static int l2_table(const struct spec *s, int bitrate_index)
+{
+	static const int translate[3][2][16] =
+	{
+		{ { 0,2,2,2,2,2,2,0,0,0,1,1,1,1,1,0 }, { 0,2,2,0,0,0,1,1,1,1,1,1,1,1,1,0 } }
+	,	{ { 0,2,2,2,2,2,2,0,0,0,0,0,0,0,0,0 }, { 0,2,2,0,0,0,0,0,0,0,0,0,0,0,0,0 } }
+	,	{ { 0,3,3,3,3,3,3,0,0,0,1,1,1,1,1,0 }, { 0,3,3,0,0,0,1,1,1,1,1,1,1,1,1,0 } }
+	};
+	if(s->version != 3)
+		return 4;
+	return translate[s->rate_index][2-spec_channels(s)][bitrate_index];
+}
+
+// Allocation index 1 is the grouped 3-level quantizer in every table,
+// used for the lowest subbands that fit.
+static void layer2(struct bitwriter *bw, const struct spec *s, long bits, uint32_t *seed)
+{
+	const int *nbal = l2_nbal[l2_table(s, s->bitrate_index)];
+	int sblimit = nbal[0] + nbal[1] + nbal[2];
+	int ch = spec_channels(s);
+	int jsbound = s->mode == 1 ? s->mode_ext*4+4 : sblimit;
+	int balbits[32];
+	int active = 0;
+	long need = 0;
+
+	if(jsbound > sblimit)
+		jsbound = sblimit;
+	for(int sb=0; sb<sblimit; ++sb)
+	{
+		balbits[sb] = sb < nbal[0] ? 4 : (sb < nbal[0]+nbal[1] ? 3 : 2);
+		need += balbits[sb]*(sb < jsbound ? ch : 1);
+	}
+	for(; active<sblimit; ++active)
+	{
+		need += ch*(2+18) + 12*5*(active < jsbound ? ch : 1);
+		if(need > bits)
+			break;
+	}
+	for(int sb=0; sb<sblimit; ++sb)
+		for(int c=0; c<(sb < jsbound ? ch : 1); ++c)
+			put(bw, sb < active, balbits[sb]);
+	for(int i=0; i<ch*active; ++i)
+		put(bw, 0, 2); // scfsi
+	for(int i=0; i<3*ch*active; ++i)
+		put(bw, 14 + rnd(seed)%20, 6);
+	for(int gr=0; gr<12; ++gr)
+		for(int sb=0; sb<active; ++sb)
+			for(int c=0; c<(sb < jsbound ? ch : 1); ++c)
+				put(bw, rnd(seed)%27, 5);
+}
+
+#define QUADS 120
+
+// Only count1 quads of table B (4 bits inverted, then the signs), in the
+// main data of this frame, exactly filling part2_3_length.
+static void layer3(struct bitwriter *bw, const struct spec *s, long bits, uint32_t *seed)
+{
+	int ch = spec_channels(s);
+	int lsf = s->version != 3;
+	int granules = lsf ? 1 : 2;
+	unsigned char quad[2][2][QUADS];
+	int quads[2][2];
+	int length[2][2];
+	long budget;
+
+	bits -= lsf ? 8 + (ch == 1 ? 1 : 2) + ch*63 : 9 + (ch == 1 ? 5 : 3) + ch*(4+2*59);
+	budget = bits/(granules*ch);
+	for(int gr=0; gr<granules; ++gr)
+		for(int c=0; c<ch; ++c)
+		{
+			quads[gr][c] = length[gr][c] = 0;
+			while(quads[gr][c] < QUADS)
+			{
+				unsigned q = 0;
+				int len = 4;
+				for(int i=0; i<4; ++i)
+					if(rnd(seed)%3 == 0)
+					{
+						q |= 8>>i;
+						++len;
+					}
+				if(length[gr][c] + len > budget)
+					break;
+				quad[gr][c][quads[gr][c]++] = q;
+				length[gr][c] += len;
+			}
+		}
+	put(bw, 0, lsf ? 8 : 9); // main_data_begin
+	put(bw, 0, lsf ? (ch == 1 ? 1 : 2) : (ch == 1 ? 5 : 3)); // private
+	if(!lsf)
+		put(bw, 0, 4*ch); // scfsi
+	for(int gr=0; gr<granules; ++gr)
+		for(int c=0; c<ch; ++c)
+		{
+			put(bw, length[gr][c], 12);
+			put(bw, 0, 9); // big_values
+			put(bw, 172 + rnd(seed)%12, 8); // global_gain
+			put(bw, 0, lsf ? 9 : 4); // scalefac_compress
+			put(bw, 0, 1); // window switching
+			put(bw, 0, 15+4+3); // table_select, region counts
+			if(!lsf)
+				put(bw, 0, 1); // preflag
+			put(bw, 0, 1); // scalefac_scale
+			put(bw, 1, 1); // count1table_select
+		}
+	for(int gr=0; gr<granules; ++gr)
+		for(int c=0; c<ch; ++c)
+			for(int i=0; i<quads[gr][c]; ++i)
+			{
+				put(bw, 15-quad[gr][c][i], 4);
+				for(int k=0; k<4; ++k)
+					if(quad[gr][c][i] & 8>>k)
+						put(bw, rnd(seed)&1, 1);
+			}
+}
+
+struct memfile
+{
+	unsigned char *data;
+	size_t size;
+	size_t pos;
+};
+
+static int generate(const struct spec *s, long frames, struct memfile *mf)
+{
+	uint32_t seed = 0x5eed;
+	size_t size = 0;
+
+	for(const char *c = s->name; *c; ++c)
+		seed = seed*31 + (unsigned char)*c;
+	mf->size = 0;
+	mf->pos = 0;
+	mf->data = NULL;
+	for(long f=0; f<frames; ++f)
+	{
+		int index = s->vbr ? 5 + rnd(&seed)%10 : s->bitrate_index;
+		int bytes = frame_bytes(s, index);
+		struct bitwriter bw;
+		if(mf->size + bytes > size)
+		{
+			size_t newsize = size ? 2*size : 64*1024;
+			unsigned char *nd = realloc(mf->data, newsize);
+			if(!nd)
+			{
+				free(mf->data);
+				return -1;
+			}
+			mf->data = nd;
+			size = newsize;
+		}
+		bw.p = mf->data + mf->size;
+		bw.pos = 0;
+		memset(bw.p, 0, bytes);
+		header(&bw, s, index);
+		switch(s->layer)
+		{
+			case 1: layer1(&bw, s, 8L*bytes-32, &seed); break;
+			case 2: layer2(&bw, s, 8L*bytes-32, &seed); break;
+			default: layer3(&bw, s, 8L*bytes-32, &seed);
+		}
+		mf->size += bytes;
+	}
+	return 0;
+}
+
+static ssize_t mem_read(void *handle, void *buf, size_t count)
+{
+	struct memfile *mf = handle;
+	if(count > mf->size - mf->pos)
+		count = mf->size - mf->pos;
+	memcpy(buf, mf->data + mf->pos, count);
+	mf->pos += count;
+	return (ssize_t)count;
+}
+
+static int64_t mem_seek(void *handle, int64_t offset, int whence)
+{
+	struct memfile *mf = handle;
+	int64_t pos;
+	switch(whence)
+	{
+		case SEEK_SET: pos = offset; break;
+		case SEEK_CUR: pos = (int64_t)mf->pos + offset; break;
+		case SEEK_END: pos = (int64_t)mf->size + offset; break;
+		default: pos = -1;
+	}
+	if(pos < 0 || pos > (int64_t)mf->size)
+		return -1;
+	mf->pos = (size_t)pos;
+	return pos;
+}
+
+static const char *decoder = NULL;
+
+static mpg123_handle *open_mem(struct memfile *mf)
+{
+	mpg123_handle *mh = mpg123_new(decoder, NULL);
+	if(!mh)
+		return NULL;
+	mf->pos = 0;
+	if( mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0.) != MPG123_OK
+	||	mpg123_reader64(mh, mem_read, mem_seek, NULL) != MPG123_OK
+	||	mpg123_open_handle64(mh, mf) != MPG123_OK )
+	{
+		mpg123_delete(mh);
+		return NULL;
+	}
+	return mh;
+}
+
+static void result( const char *test, const char *input, double items
+,	const char *unit, double time, const char *check )
+{
+	printf( "%s\t%s\t%.0f\t%s\t%.6f\t%.1f\t%s\n", test, input, items, unit
+	,	time, time > 0 ? items/time : 0., check );
+}
+
+static void result_sum( const char *test, const char *input, double items
+,	const char *unit, double time, unsigned long sum )
+{
+	char check[32];
+	snprintf(check, sizeof(check), "%08lx", sum & 0xffffffffUL);
+	result(test, input, items, unit, time, check);
+}
+
+// Decode all, returning the frame count or -1 on error.
+static long decode_all(mpg123_handle *mh, unsigned long *sum)
+{
+	long frames = 0;
+	int err;
+	do
+	{
+		off_t num;
+		unsigned char *audio;
+		size_t bytes;
+		err = mpg123_decode_frame(mh, &num, &audio, &bytes);
+		if(err == MPG123_OK)
+		{
+			++frames;
+			if(sum)
+				*sum = checksum(*sum, audio, bytes);
+		}
+	} while(err == MPG123_OK || err == MPG123_NEW_FORMAT);
+	return err == MPG123_DONE ? frames : -1;
+}
+
+static int bench_decode(const struct spec *s, struct memfile *mf, long frames, int rounds)
+{
+	unsigned long sum = 0;
+	double time = 0;
+	mpg123_handle *mh;
+
+	// An untimed pass to check the corpus and get the checksum.
+	if(!(mh = open_mem(mf)) || decode_all(mh, &sum) != frames)
+	{
+		error1("%s: decoding the corpus failed", s->name);
+		mpg123_delete(mh);
+		return -1;
+	}
+	mpg123_delete(mh);
+	for(int r=0; r<rounds; ++r)
+	{
+		if(!(mh = open_mem(mf)))
+			return -1;
+		double start = now();
+		long fr = decode_all(mh, NULL);
+		time += now() - start;
+		mpg123_delete(mh);
+		if(fr != frames)
+			return -1;
+	}
+	result_sum("decode", s->name, (double)frames*rounds, "frames", time, sum);
+	return 0;
+}
+
+#define SEEKS 100
+
+// Random sample offsets, each followed by decoding a frame.
+static int bench_seek(const struct spec *s, struct memfile *mf, long frames, int rounds)
+{
+	int64_t samples = (int64_t)frames*spec_samples(s);
+	double time = 0;
+
+	for(int r=0; r<rounds; ++r)
+	{
+		uint32_t seed = 0x5eed;
+		mpg123_handle *mh = open_mem(mf);
+		if(!mh)
+			return -1;
+		double start = now();
+		for(int i=0; i<SEEKS; ++i)
+		{
+			int64_t target = (int64_t)((double)rnd(&seed)/(1<<24)*samples);
+			off_t num;
+			unsigned char *audio;
+			size_t bytes;
+			int err;
+			if(mpg123_seek64(mh, target, SEEK_SET) < 0)
+			{
+				mpg123_delete(mh);
+				return -1;
+			}
+			do err = mpg123_decode_frame(mh, &num, &audio, &bytes);
+			while(err == MPG123_NEW_FORMAT);
+			if(err != MPG123_OK && err != MPG123_DONE)
+			{
+				mpg123_delete(mh);
+				return -1;
+			}
+		}
+		time += now() - start;
+		mpg123_delete(mh);
+	}
+	result("seek", s->name, (double)SEEKS*rounds, "seeks", time, "-");
+	return 0;
+}
+
+static int bench_scan(const struct spec *s, struct memfile *mf, long frames, int rounds)
+{
+	int64_t samples = (int64_t)frames*spec_samples(s);
+	double time = 0;
+
+	for(int r=0; r<rounds; ++r)
+	{
+		mpg123_handle *mh = open_mem(mf);
+		if(!mh)
+			return -1;
+		double start = now();
+		int err = mpg123_scan(mh);
+		time += now() - start;
+		if(err != MPG123_OK || mpg123_length64(mh) != samples)
+		{
+			error1("%s: scan failed or gave the wrong length", s->name);
+			mpg123_delete(mh);
+			return -1;
+		}
+		mpg123_delete(mh);
+	}
+	result("scan", s->name, (double)frames*rounds, "frames", time, "-");
+	return 0;
+}
+
+static const struct { int src; int dst; const char *name; } convs[] =
+{
+	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_SIGNED_16, "f32_s16" }
+,	{ MPG123_ENC_SIGNED_16, MPG123_ENC_FLOAT_32,  "s16_f32" }
+,	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_SIGNED_24, "f32_s24" }
+,	{ MPG123_ENC_SIGNED_32, MPG123_ENC_SIGNED_16, "s32_s16" }
+,	{ MPG123_ENC_FLOAT_64,  MPG123_ENC_FLOAT_32,  "f64_f32" }
+};
+
+#define CONV_SAMPLES (1024*1024)
+
+// Noise in the source encoding from float, converted over and over in
+// blocks that fit the buffer of the syn123 handle.
+static int bench_conv(int rounds)
+{
+	size_t block = 4096;
+	float *noise = malloc(CONV_SAMPLES*sizeof(float));
+	unsigned char *src = malloc(CONV_SAMPLES*8);
+	unsigned char *dst = malloc(CONV_SAMPLES*8);
+	syn123_handle *sh = syn123_new(48000, 1, MPG123_ENC_FLOAT_32, 0, NULL);
+	uint32_t seed = 0x5eed;
+	int ret = 0;
+
+	if(!noise || !src || !dst || !sh)
+	{
+		error("out of memory");
+		ret = -1;
+		goto conv_end;
+	}
+	for(size_t i=0; i<CONV_SAMPLES; ++i)
+		noise[i] = (float)((double)rnd(&seed)/(1<<23) - 1.);
+	for(size_t ci=0; ci<COUNT(convs) && !ret; ++ci)
+	{
+		size_t srcsize = MPG123_SAMPLESIZE(convs[ci].src);
+		size_t dstsize = MPG123_SAMPLESIZE(convs[ci].dst);
+		unsigned long sum = 0;
+		double time = 0;
+		size_t bytes;
+		if(syn123_conv( src, convs[ci].src, CONV_SAMPLES*srcsize, noise
+		,	MPG123_ENC_FLOAT_32, CONV_SAMPLES*sizeof(float), NULL, NULL ))
+		{
+			ret = -1;
+			break;
+		}
+		for(int r=0; r<rounds && !ret; ++r)
+		{
+			double start = now();
+			for(size_t i=0; i<CONV_SAMPLES; i+=block)
+				if(syn123_conv( dst+i*dstsize, convs[ci].dst, block*dstsize
+				,	src+i*srcsize, convs[ci].src, block*srcsize, &bytes, sh ))
+				{
+					ret = -1;
+					break;
+				}
+			time += now() - start;
+		}
+		if(ret)
+			break;
+		sum = checksum(sum, dst, CONV_SAMPLES*dstsize);
+		result_sum( "syn123_conv", convs[ci].name, (double)CONV_SAMPLES*rounds
+		,	"samples", time, sum );
+	}
+	if(ret)
+		error("syn123_conv() failed");
+conv_end:
+	syn123_del(sh);
+	free(dst);
+	free(src);
+	free(noise);
+	return ret;
+}
+
+#define WAV_BYTES (16*1024*1024)
+
+// 16 bit stereo for the WAV writer of libout123, in chunks of 4 KiB.
+static int bench_wav(const char *path, int rounds)
+{
+	unsigned char *pcm = malloc(WAV_BYTES);
+	size_t chunk = 4096;
+	uint32_t seed = 0x5eed;
+	double time = 0;
+	unsigned long sum = 0;
+	int ret = 0;
+
+	if(!pcm)
+	{
+		error("out of memory");
+		return -1;
+	}
+	for(size_t i=0; i<WAV_BYTES; ++i)
+		pcm[i] = rnd(&seed) & 0xff;
+	for(int r=0; r<rounds && !ret; ++r)
+	{
+		out123_handle *ao = out123_new();
+		if(!ao)
+		{
+			ret = -1;
+			break;
+		}
+		out123_param_int(ao, OUT123_FLAGS, OUT123_QUIET);
+		double start = now();
+		if( out123_open(ao, "wav", path) || out123_start(ao, 48000, 2
+		,	MPG123_ENC_SIGNED_16 ) )
+			ret = -1;
+		for(size_t i=0; !ret && i<WAV_BYTES; i+=chunk)
+			if(out123_play(ao, pcm+i, chunk) != chunk)
+				ret = -1;
+		out123_del(ao);
+		time += now() - start;
+	}
+	if(!ret)
+	{
+		FILE *f = fopen(path, "rb");
+		unsigned char buf[4096];
+		size_t got;
+		if(!f)
+			ret = -1;
+		else
+		{
+			while((got = fread(buf, 1, sizeof(buf), f)))
+				sum = checksum(sum, buf, got);
+			fclose(f);
+		}
+	}
+	free(pcm);
+	if(ret)
+	{
+		error1("writing %s failed", path);
+		return -1;
+	}
+	result_sum("out123_wav", "s16_stereo", (double)WAV_BYTES*rounds, "bytes", time, sum);
+	return 0;
+}
+
+static int write_corpus(const char *dir, const struct spec *s, struct memfile *mf)
+{
+	char path[1024];
+	FILE *f;
+	snprintf(path, sizeof(path), "%s/%s.mp%d", dir, s->name, s->layer);
+	if(!(f = fopen(path, "wb")))
+		return -1;
+	if(fwrite(mf->data, 1, mf->size, f) != mf->size)
+	{
+		fclose(f);
+		return -1;
+	}
+	return fclose(f) ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = 3;
+	long frames = 1000;
+	const char *corpus_dir = NULL;
+	const char *wav = "bench_suite.wav";
+	int ret = 0;
+	int i;
+
+	for(i=1; i+1<argc && argv[i][0] == '-'; i+=2)
+	{
+		if(!strcmp(argv[i], "-r"))
+			rounds = atoi(argv[i+1]);
+		else if(!strcmp(argv[i], "-n"))
+			frames = atol(argv[i+1]);
+		else if(!strcmp(argv[i], "-d"))
+			decoder = argv[i+1];
+		else if(!strcmp(argv[i], "-w"))
+			corpus_dir = argv[i+1];
+		else if(!strcmp(argv[i], "-o"))
+			wav = argv[i+1];
+		else
+			break;
+	}
+	if(i < argc || rounds < 1 || frames < 1)
+	{
+		fprintf( stderr, "Usage: %s [-r rounds] [-n frames] [-d decoder]"
+			" [-w corpus directory] [-o wav file]\n", argv[0] );
+		return 1;
+	}
+	mpg123_init();
+	printf("# bench_suite: %d rounds, %ld frames per input\n", rounds, frames);
+	printf("# decoder: %s\n", decoder ? decoder : "default");
+	printf("# test\tinput\titems\tunit\tseconds\tper_second\tchecksum\n");
+	for(size_t si=0; si<COUNT(corpus); ++si)
+	{
+		const struct spec *s = &corpus[si];
+		struct memfile mf;
+		if(generate(s, frames, &mf))
+		{
+			error("out of memory");
+			return 1;
+		}
+		if(corpus_dir && write_corpus(corpus_dir, s, &mf))
+		{
+			error2("cannot write %s to %s", s->name, corpus_dir);
+			ret = 1;
+		}
+		if( bench_decode(s, &mf, frames, rounds)
+		||	bench_seek(s, &mf, frames, rounds)
+		||	bench_scan(s, &mf, frames, rounds) )
+		{
+			fprintf(stderr, "%s: failed\n", s->name);
+			ret = 1;
+		}
+		free(mf.data);
+	}
+	if(bench_conv(rounds))
+		ret = 1;
+	if(bench_wav(wav, rounds))
+		ret = 1;
+	else
+		remove(wav);
+	mpg123_exit();
+	return ret;
+}
@@ -0,0 +1,141 @@
+/*
+	chain: check that syn123_chain() gives what the separate calls of
+	syn123_conv(), syn123_mix(), syn123_amp() and syn123_soft_clip() give
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "compat.h"
+#include <syn123.h>
+#include <math.h>
+#include "debug.h"
+
+#define SAMPLES 10007
+#define MAXCHANNELS 8
+
+static const double up[2*1]   = { 0.7, 0.8 };
+static const double down[1*2] = { 0.6, 0.5 };
+static const double wide[8*2] =
+{
+	1., 0., 0., 1., 0.5, 0.5, 0.2, 0.2
+,	0.7, 0.3, 0.3, 0.7, 1., 0., 0., 1.
+};
+
+/* The same processing in whole buffers. */
+static int separate( syn123_handle *sh, void *dst, int dst_enc, void *src
+,	int src_enc, int channels, int mixchannels, const double *matrix
+,	double volume, double width, size_t *clipped )
+{
+	float *a = malloc(sizeof(float)*SAMPLES*MAXCHANNELS);
+	float *b = malloc(sizeof(float)*SAMPLES*MAXCHANNELS);
+	int err = !a || !b;
+	if(!err)
+		err = syn123_conv( a, MPG123_ENC_FLOAT_32, sizeof(float)*SAMPLES*channels
+		,	src, src_enc, MPG123_SAMPLESIZE(src_enc)*SAMPLES*channels, NULL, NULL );
+	if(!err && matrix)
+	{
+		memset(b, 0, sizeof(float)*SAMPLES*mixchannels);
+		err = syn123_mix( b, MPG123_ENC_FLOAT_32, mixchannels, a
+		,	MPG123_ENC_FLOAT_32, channels, matrix, SAMPLES, 0, NULL );
+		float *t = a;
+		a = b;
+		b = t;
+		channels = mixchannels;
+	}
+	if(!err)
+		err = syn123_amp(a, MPG123_ENC_FLOAT_32, SAMPLES*channels, volume, 0., NULL);
+	if(!err)
+		*clipped = syn123_soft_clip(a, MPG123_ENC_FLOAT_32, SAMPLES*channels, width);
+	if(!err)
+		err = syn123_conv( dst, dst_enc, MPG123_SAMPLESIZE(dst_enc)*SAMPLES*channels
+		,	a, MPG123_ENC_FLOAT_32, sizeof(float)*SAMPLES*channels, NULL, sh );
+	free(a);
+	free(b);
+	return err;
+}
+
+static int test( syn123_handle *sh, int dst_enc, int src_enc, int channels
+,	int mixchannels, const double *matrix )
+{
+	int outchannels = matrix ? mixchannels : channels;
+	size_t srcsize = MPG123_SAMPLESIZE(src_enc)*SAMPLES*channels;
+	size_t dstsize = MPG123_SAMPLESIZE(dst_enc)*SAMPLES*outchannels;
+	float *in = malloc(sizeof(float)*SAMPLES*channels);
+	char *src = malloc(srcsize);
+	char *ref = malloc(dstsize);
+	char *out = malloc(dstsize);
+	size_t refclips = 0, clips = 0, bytes = 0;
+	int err = !in || !src || !ref || !out;
+	if(!err)
+	{
+		for(size_t i=0; i<SAMPLES*channels; ++i)
+			in[i] = (float)(0.9*sin(0.01*i*(i%channels+1)));
+		err = syn123_conv( src, src_enc, srcsize, in, MPG123_ENC_FLOAT_32
+		,	sizeof(float)*SAMPLES*channels, NULL, NULL );
+	}
+	if(!err)
+		err = separate( sh, ref, dst_enc, src, src_enc, channels, mixchannels
+		,	matrix, 1.3, 0.1, &refclips );
+	if( !err && ( syn123_setup_chain(sh, dst_enc, src_enc, channels)
+	||  (matrix && syn123_chain_mix(sh, mixchannels, matrix))
+	||  syn123_chain_amp(sh, 1.3, 0.)
+	||  syn123_chain_soft_clip(sh, 0.1)
+	||  syn123_chain(sh, out, dstsize, src, SAMPLES, &bytes, &clips) ) )
+		err = 1;
+	if(!err && (bytes != dstsize || clips != refclips))
+		err = 1;
+	/* Vector and scalar rounding of the float steps may differ a bit. */
+	if(!err)
+	{
+		float *a = (float*)ref;
+		float *b = (float*)out;
+		if(dst_enc == MPG123_ENC_FLOAT_32)
+		{
+			for(size_t i=0; i<SAMPLES*outchannels; ++i)
+				if(fabsf(a[i]-b[i]) > 1e-6)
+					err = 1;
+		}
+		else
+		{
+			int16_t *x = (int16_t*)ref;
+			int16_t *y = (int16_t*)out;
+			for(size_t i=0; i<SAMPLES*outchannels; ++i)
+				if(abs(x[i]-y[i]) > 1)
+					err = 1;
+		}
+	}
+	printf( "0x%x to 0x%x, %d to %d channels: %lu clipped: %s\n"
+	,	src_enc, dst_enc, channels, outchannels, (unsigned long)clips
+	,	err ? "FAIL" : "PASS" );
+	free(out);
+	free(ref);
+	free(src);
+	free(in);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	int errsum = 0;
+	syn123_handle *sh = syn123_new(44100, 2, MPG123_ENC_FLOAT_32, 0, NULL);
+	if(!sh)
+		return 1;
+	errsum += test(sh, MPG123_ENC_SIGNED_16, MPG123_ENC_SIGNED_16, 2, 0, NULL);
+	errsum += test(sh, MPG123_ENC_SIGNED_16, MPG123_ENC_SIGNED_16, 2, 1, down);
+	errsum += test(sh, MPG123_ENC_SIGNED_16, MPG123_ENC_SIGNED_16, 1, 2, up);
+	errsum += test(sh, MPG123_ENC_FLOAT_32, MPG123_ENC_FLOAT_32, 2, 8, wide);
+	errsum += test(sh, MPG123_ENC_SIGNED_16, MPG123_ENC_FLOAT_32, 2, 8, wide);
+	errsum += test(sh, MPG123_ENC_FLOAT_32, MPG123_ENC_SIGNED_16, 2, 1, down);
+	errsum += test(sh, MPG123_ENC_FLOAT_32, MPG123_ENC_FLOAT_32, 3, 0, NULL);
+	if( syn123_chain(sh, NULL, 0, NULL, 0, NULL, NULL) != SYN123_BAD_BUF
+	||  syn123_setup_chain(sh, MPG123_ENC_SIGNED_16, 0, 2) != SYN123_BAD_ENC
+	||  syn123_chain_amp(sh, 1., 0.) != SYN123_BAD_FMT )
+	{
+		printf("bad setup accepted: FAIL\n");
+		++errsum;
+	}
+	syn123_del(sh);
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
@@ -0,0 +1,362 @@
+/*
+	conformance: accuracy of all decoders against reference output, with speed
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Give pairs of MPEG stream and reference output, typically the ISO/IEC
+	11172-4 compliance streams with their reference decodings. A reference
+	ending in .hex is text with one 24 bit sample per line in hex, like the
+	FhG compliance files (and the hex output of out123), anything else is
+	raw doubles in native byte order. Several reference files separated by
+	commas hold one channel each, else the channels are interleaved.
+
+	Each entry of mpg123_supported_decoders() decodes each stream to 16 and
+	32 bit integer and to float, at native rate. The deviation to the
+	reference is measured relative to full scale. As in ISO/IEC 11172-4, a
+	decoder has full accuracy with an RMS error below 2^-15/sqrt(12) and no
+	sample off by more than 2^-14, limited accuracy with an RMS error below
+	2^-11/sqrt(12). With 16 bit output, rounding alone is about at the limit
+	of full accuracy.
+
+	The results go to standard output as tab-separated fields: decoder,
+	encoding, stream, frames decoded per CPU second, RMS and maximum error
+	and the accuracy (full, limited, none, or length for a sample count
+	that does not match the reference). At the end, the fastest decoder
+	with full accuracy on all streams is named for each encoding.
+*/
+
+#include "config.h"
+#include "compat.h"
+#include <mpg123.h>
+#include <math.h>
+#include <time.h>
+#include "debug.h"
+
+static const struct { int enc; const char *name; } encs[] =
+{
+	{ MPG123_ENC_SIGNED_16, "s16" }
+,	{ MPG123_ENC_SIGNED_32, "s32" }
+,	{ MPG123_ENC_FLOAT_32,  "f32" }
+};
+
+#define COUNT(a) (sizeof(a)/sizeof(*(a)))
+
+static double now(void)
+{
+	return (double)clock()/CLOCKS_PER_SEC;
+}
+
+struct reference
+{
+	double *samples; // interleaved
+	size_t count;
+	int channels;
+};
+
+static int append(struct reference *ref, size_t *size, double val)
+{
+	if(ref->count == *size)
+	{
+		size_t newsize = *size ? 2 * *size : 1<<16;
+		double *ns = realloc(ref->samples, newsize*sizeof(double));
+		if(!ns)
+			return -1;
+		ref->samples = ns;
+		*size = newsize;
+	}
+	ref->samples[ref->count++] = val;
+	return 0;
+}
+
+// One channel or interleaved channels from a file.
+static int read_file(const char *path, struct reference *ref)
+{
+	size_t len = strlen(path);
+	size_t size = 0;
+	int err = 0;
+	FILE *f = compat_fopen(path, len > 4 && !strcmp(path+len-4, ".hex") ? "r" : "rb");
+
+	ref->samples = NULL;
+	ref->count = 0;
+	if(!f)
+		return -1;
+	if(len > 4 && !strcmp(path+len-4, ".hex"))
+	{
+		unsigned long val;
+		while(!err && fscanf(f, "%lx", &val) == 1)
+		{
+			long s = (long)(val & 0xffffff);
+			if(s & 0x800000)
+				s -= 0x1000000;
+			err = append(ref, &size, s/8388608.);
+		}
+	}
+	else
+	{
+		double val;
+		while(!err && fread(&val, sizeof(val), 1, f) == 1)
+			err = append(ref, &size, val);
+	}
+	if(ferror(f))
+		err = -1;
+	compat_fclose(f);
+	return err;
+}
+
+static int load_reference(const char *spec, struct reference *ref)
+{
+	char *list = compat_strdup(spec);
+	char *path, *next;
+	struct reference chan[8];
+	int channels = 0;
+	int err = 0;
+
+	if(!list)
+		return -1;
+	for(path = list; path && !err; path = next)
+	{
+		if((next = strchr(path, ',')))
+			*next++ = 0;
+		if(channels == COUNT(chan))
+			err = -1;
+		else if(!(err = read_file(path, &chan[channels])))
+			++channels;
+	}
+	free(list);
+	ref->samples = NULL;
+	ref->count = 0;
+	ref->channels = channels;
+	if(!err && channels == 1)
+	{
+		*ref = chan[0];
+		ref->channels = 0; // interleaved, as decoded
+		return 0;
+	}
+	if(!err)
+	{
+		size_t length = chan[0].count;
+		for(int c=1; c<channels; ++c)
+			if(chan[c].count < length)
+				length = chan[c].count;
+		ref->samples = malloc(length*channels*sizeof(double));
+		if(ref->samples)
+		{
+			for(size_t i=0; i<length; ++i)
+				for(int c=0; c<channels; ++c)
+					ref->samples[i*channels+c] = chan[c].samples[i];
+			ref->count = length*channels;
+		}
+		else
+			err = -1;
+	}
+	for(int c=0; c<channels; ++c)
+		free(chan[c].samples);
+	return err;
+}
+
+static mpg123_handle *open_dec(const char *decoder, const char *path, int enc)
+{
+	int err = MPG123_OK;
+	mpg123_handle *mh = mpg123_new(decoder, &err);
+	if(!mh)
+		return NULL;
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0.);
+	if(err == MPG123_OK)
+		err = mpg123_format_none(mh);
+	if(err == MPG123_OK)
+		err = mpg123_format(mh, 0, MPG123_MONO|MPG123_STEREO, enc);
+	if(err == MPG123_OK)
+		err = mpg123_open(mh, path);
+	if(err != MPG123_OK)
+	{
+		mpg123_delete(mh);
+		return NULL;
+	}
+	return mh;
+}
+
+static double sample_value(const unsigned char *buf, size_t i, int enc)
+{
+	switch(enc)
+	{
+		case MPG123_ENC_SIGNED_16:
+			return ((const short*)buf)[i]/32768.;
+		case MPG123_ENC_SIGNED_32:
+			return ((const int32_t*)buf)[i]/2147483648.;
+		default:
+			return ((const float*)buf)[i];
+	}
+}
+
+struct result
+{
+	double time;
+	long frames;
+	double rms;
+	double max;
+	const char *accuracy;
+};
+
+static int measure( const char *decoder, int enc, const char *path
+,	const struct reference *ref, int rounds, struct result *res )
+{
+	mpg123_handle *mh;
+	size_t ssize = MPG123_SAMPLESIZE(enc);
+	size_t count = 0;
+	double sqerr = 0;
+	int err;
+
+	res->time = 0;
+	res->frames = 0;
+	res->max = 0;
+	for(int r=0; r<rounds; ++r)
+	{
+		if(!(mh = open_dec(decoder, path, enc)))
+			return -1;
+		double start = now();
+		do
+		{
+			off_t num;
+			unsigned char *audio;
+			size_t bytes;
+			err = mpg123_decode_frame(mh, &num, &audio, &bytes);
+			if(err == MPG123_OK)
+				++res->frames;
+		} while(err == MPG123_OK || err == MPG123_NEW_FORMAT);
+		res->time += now() - start;
+		mpg123_delete(mh);
+		if(err != MPG123_DONE)
+			return -1;
+	}
+	if(!(mh = open_dec(decoder, path, enc)))
+		return -1;
+	if(ref->channels > 1)
+	{
+		long rate;
+		int channels, encoding;
+		if( mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK
+		||	channels != ref->channels )
+		{
+			error1("%s: channel count does not match the reference", path);
+			mpg123_delete(mh);
+			return -1;
+		}
+	}
+	do
+	{
+		off_t num;
+		unsigned char *audio;
+		size_t bytes;
+		err = mpg123_decode_frame(mh, &num, &audio, &bytes);
+		if(err != MPG123_OK)
+			continue;
+		for(size_t i=0; i<bytes/ssize; ++i, ++count)
+		{
+			if(count >= ref->count)
+				continue;
+			double d = fabs(sample_value(audio, i, enc) - ref->samples[count]);
+			if(d > res->max)
+				res->max = d;
+			sqerr += d*d;
+		}
+	} while(err == MPG123_OK || err == MPG123_NEW_FORMAT);
+	mpg123_delete(mh);
+	if(err != MPG123_DONE)
+		return -1;
+	size_t compared = count < ref->count ? count : ref->count;
+	res->rms = compared ? sqrt(sqerr/compared) : 0.;
+	if(count != ref->count)
+		res->accuracy = "length";
+	else if(res->rms < pow(2., -15)/sqrt(12.) && res->max <= pow(2., -14))
+		res->accuracy = "full";
+	else if(res->rms < pow(2., -11)/sqrt(12.))
+		res->accuracy = "limited";
+	else
+		res->accuracy = "none";
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = 1;
+	int first = 1;
+	int ret = 0;
+	struct reference *refs;
+
+	if(argc > 3 && !strcmp(argv[1], "-r"))
+	{
+		rounds = atoi(argv[2]);
+		first = 3;
+	}
+	if(argc <= first || (argc-first) % 2 || rounds < 1)
+	{
+		fprintf( stderr, "Usage: %s [-r rounds] stream reference[,reference ...] ...\n"
+		,	argv[0] );
+		return 1;
+	}
+	int streams = (argc-first)/2;
+	char **args = argv+first;
+	refs = malloc(sizeof(*refs)*streams);
+	if(!refs)
+	{
+		error("out of memory");
+		return 1;
+	}
+	for(int s=0; s<streams; ++s)
+		if(load_reference(args[2*s+1], &refs[s]))
+		{
+			error1("cannot read reference %s", args[2*s+1]);
+			while(s--)
+				free(refs[s].samples);
+			free(refs);
+			return 1;
+		}
+	mpg123_init();
+
+	const char **decs = mpg123_supported_decoders();
+	printf("# decoder\tencoding\tstream\tframes_per_s\trms\tmax\taccuracy\n");
+	for(size_t ei=0; ei<COUNT(encs); ++ei)
+	{
+		const char *best = NULL;
+		double best_speed = 0;
+		for(int d=0; decs[d]; ++d)
+		{
+			double time = 0;
+			long frames = 0;
+			int full = 1;
+			for(int s=0; s<streams; ++s)
+			{
+				struct result res;
+				if(measure(decs[d], encs[ei].enc, args[2*s], &refs[s], rounds, &res))
+				{
+					fprintf( stderr, "%s %s %s: not supported or failed\n"
+					,	decs[d], encs[ei].name, args[2*s] );
+					ret = 1;
+					full = 0;
+					continue;
+				}
+				printf( "%s\t%s\t%s\t%.1f\t%.3g\t%.3g\t%s\n", decs[d]
+				,	encs[ei].name, args[2*s], res.time > 0 ? res.frames/res.time : 0.
+				,	res.rms, res.max, res.accuracy );
+				if(strcmp(res.accuracy, "full"))
+					full = 0;
+				time += res.time;
+				frames += res.frames;
+			}
+			double speed = time > 0 ? frames/time : 0.;
+			if(full && (!best || speed > best_speed))
+			{
+				best = decs[d];
+				best_speed = speed;
+			}
+		}
+		printf( "# fastest with full accuracy for %s: %s\n", encs[ei].name
+		,	best ? best : "none" );
+	}
+	for(int s=0; s<streams; ++s)
+		free(refs[s].samples);
+	free(refs);
+	mpg123_exit();
+	return ret;
+}
@@ -0,0 +1,339 @@
+/*
+	decoder_bench: speed and accuracy of all decoders, encodings and resampling modes
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	For each file, each entry of mpg123_supported_decoders() decodes to
+	16 and 32 bit integer and float, at native, half and quarter rate and
+	with NtoM resampling (to 48 kHz, or 44.1 kHz for 48 kHz input).
+	The timing pass only decodes, then a second pass compares the output
+	frame by frame to the generic decoder. Integer output of the optimized
+	decoders is not necessarily bit-exact, so the error is reported relative
+	to full scale.
+
+	Timing is CPU time summed over all files. Cycles come from the time stamp
+	counter on x86, which is only an approximation on CPUs with frequency
+	scaling. On Linux, level 1 data cache read misses are counted via
+	perf_event_open(), if the kernel permits that (perf_event_paranoid).
+*/
+
+#include "config.h"
+#include "compat.h"
+#include <mpg123.h>
+#include <math.h>
+#include <time.h>
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "debug.h"
+
+static const struct { int enc; const char *name; } encs[] =
+{
+	{ MPG123_ENC_SIGNED_16, "s16" }
+,	{ MPG123_ENC_SIGNED_32, "s32" }
+,	{ MPG123_ENC_FLOAT_32,  "f32" }
+};
+
+/* Value of MPG123_DOWN_SAMPLE, or -1 for NtoM via MPG123_FORCE_RATE. */
+static const struct { int down; const char *name; } modes[] =
+{
+	{  0, "1to1" }
+,	{  1, "2to1" }
+,	{  2, "4to1" }
+,	{ -1, "ntom" }
+};
+
+#define COUNT(a) (sizeof(a)/sizeof(*(a)))
+
+static double now(void)
+{
+	return (double)clock()/CLOCKS_PER_SEC;
+}
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_CYCLES
+static unsigned long long cycles(void)
+{
+	unsigned int lo, hi;
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((unsigned long long)hi << 32) | lo;
+}
+#endif
+
+#if defined(HAVE_LINUX_PERF_EVENT_H) && defined(__NR_perf_event_open)
+#define HAVE_CACHE_MISSES
+static int cache_fd = -1;
+
+static void cache_open(void)
+{
+	struct perf_event_attr pe;
+	memset(&pe, 0, sizeof(pe));
+	pe.type = PERF_TYPE_HW_CACHE;
+	pe.size = sizeof(pe);
+	pe.config = PERF_COUNT_HW_CACHE_L1D
+	|	(PERF_COUNT_HW_CACHE_OP_READ << 8)
+	|	(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	pe.exclude_kernel = 1;
+	pe.exclude_hv = 1;
+	cache_fd = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+static unsigned long long cache_misses(void)
+{
+	unsigned long long val = 0;
+	if(cache_fd < 0 || read(cache_fd, &val, sizeof(val)) != sizeof(val))
+		return 0;
+	return val;
+}
+#endif
+
+/* Rate for NtoM, 0 if the file is not readable. */
+static long ntom_rate(const char *path)
+{
+	long rate = 0;
+	int channels, enc;
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+	if(!mh)
+		return 0;
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0.);
+	if( mpg123_open(mh, path) == MPG123_OK
+	&&	mpg123_getformat(mh, &rate, &channels, &enc) == MPG123_OK )
+		rate = rate == 48000 ? 44100 : 48000;
+	else
+		rate = 0;
+	mpg123_delete(mh);
+	return rate;
+}
+
+static mpg123_handle *open_dec( const char *decoder, const char *path
+,	int enc, int down, long rate )
+{
+	int err = MPG123_OK;
+	mpg123_handle *mh = mpg123_new(decoder, &err);
+	if(!mh)
+		return NULL;
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET|MPG123_GAPLESS, 0.);
+	if(down >= 0)
+		err = mpg123_param(mh, MPG123_DOWN_SAMPLE, down, 0.);
+	else
+		err = mpg123_param(mh, MPG123_FORCE_RATE, rate, 0.);
+	if(err == MPG123_OK)
+		err = mpg123_format_none(mh);
+	if(err == MPG123_OK)
+		err = mpg123_format(mh, 0, MPG123_MONO|MPG123_STEREO, enc);
+	if(err == MPG123_OK)
+		err = mpg123_open(mh, path);
+	if(err != MPG123_OK)
+	{
+		mpg123_delete(mh);
+		return NULL;
+	}
+	return mh;
+}
+
+/* Decode the whole file, returning the frame count or -1 on error. */
+static long decode_all(mpg123_handle *mh, size_t *samples)
+{
+	long frames = 0;
+	int err;
+	do
+	{
+		off_t num;
+		unsigned char *audio;
+		size_t bytes;
+		err = mpg123_decode_frame(mh, &num, &audio, &bytes);
+		if(err == MPG123_OK)
+		{
+			++frames;
+			*samples += bytes;
+		}
+	} while(err == MPG123_OK || err == MPG123_NEW_FORMAT);
+	return err == MPG123_DONE ? frames : -1;
+}
+
+static double sample_value(const unsigned char *buf, size_t i, int enc)
+{
+	switch(enc)
+	{
+		case MPG123_ENC_SIGNED_16:
+			return ((const short*)buf)[i]/32768.;
+		case MPG123_ENC_SIGNED_32:
+			return ((const int32_t*)buf)[i]/2147483648.;
+		default:
+			return ((const float*)buf)[i];
+	}
+}
+
+/* Frame by frame against the generic decoder. Nonzero if the output
+   lengths differ. */
+static int compare( mpg123_handle *mh, mpg123_handle *ref, int enc
+,	double *maxerr, double *sqerr, size_t *count, size_t *diffs )
+{
+	size_t ssize = MPG123_SAMPLESIZE(enc);
+	int err, referr;
+	do
+	{
+		off_t num;
+		unsigned char *audio, *refaudio;
+		size_t bytes, refbytes;
+		do err = mpg123_decode_frame(mh, &num, &audio, &bytes);
+		while(err == MPG123_NEW_FORMAT);
+		do referr = mpg123_decode_frame(ref, &num, &refaudio, &refbytes);
+		while(referr == MPG123_NEW_FORMAT);
+		if(err != referr || (err == MPG123_OK && bytes != refbytes))
+			return -1;
+		if(err != MPG123_OK)
+			break;
+		if(!memcmp(audio, refaudio, bytes))
+		{
+			*count += bytes/ssize;
+			continue;
+		}
+		for(size_t i=0; i<bytes/ssize; ++i)
+		{
+			double d = fabs( sample_value(audio, i, enc)
+			-	sample_value(refaudio, i, enc) );
+			if(d > 0)
+				++*diffs;
+			if(d > *maxerr)
+				*maxerr = d;
+			*sqerr += d*d;
+		}
+		*count += bytes/ssize;
+	} while(1);
+	return err == MPG123_DONE ? 0 : -1;
+}
+
+static int bench( const char *decoder, int ei, int mi
+,	int files, char **paths, long *rates, int rounds )
+{
+	long frames = 0;
+	size_t bytes = 0;
+	double time = 0;
+#ifdef HAVE_CYCLES
+	unsigned long long cyc = 0;
+#endif
+#ifdef HAVE_CACHE_MISSES
+	unsigned long long misses = 0;
+#endif
+	double maxerr = 0, sqerr = 0;
+	size_t count = 0, diffs = 0;
+	int enc = encs[ei].enc;
+	int down = modes[mi].down;
+
+	for(int f=0; f<files; ++f)
+	{
+		if(!rates[f])
+			continue;
+		for(int r=0; r<rounds; ++r)
+		{
+			mpg123_handle *mh = open_dec(decoder, paths[f], enc, down, rates[f]);
+			if(!mh)
+				return -1;
+			double start = now();
+#ifdef HAVE_CYCLES
+			unsigned long long cstart = cycles();
+#endif
+#ifdef HAVE_CACHE_MISSES
+			unsigned long long mstart = cache_misses();
+#endif
+			long fr = decode_all(mh, &bytes);
+#ifdef HAVE_CACHE_MISSES
+			misses += cache_misses() - mstart;
+#endif
+#ifdef HAVE_CYCLES
+			cyc  += cycles() - cstart;
+#endif
+			time += now() - start;
+			mpg123_delete(mh);
+			if(fr < 0)
+				return -1;
+			frames += fr;
+		}
+		mpg123_handle *mh  = open_dec(decoder, paths[f], enc, down, rates[f]);
+		mpg123_handle *ref = open_dec("generic", paths[f], enc, down, rates[f]);
+		int err = !mh || !ref
+		||	compare(mh, ref, enc, &maxerr, &sqerr, &count, &diffs);
+		mpg123_delete(ref);
+		mpg123_delete(mh);
+		if(err)
+		{
+			error2("%s: output of %s differs in length", paths[f], decoder);
+			return -1;
+		}
+	}
+	size_t samples = bytes/MPG123_SAMPLESIZE(enc);
+	printf( "%-16s %s %s %9.1f frames/s %7.2f ns/sample"
+	,	decoder, encs[ei].name, modes[mi].name
+	,	time > 0 ? frames/time : 0., samples ? time*1e9/samples : 0. );
+#ifdef HAVE_CYCLES
+	printf(" %8.0f cycles/frame", frames ? (double)cyc/frames : 0.);
+#endif
+#ifdef HAVE_CACHE_MISSES
+	if(cache_fd >= 0)
+		printf(" %6.0f L1d misses/frame", frames ? (double)misses/frames : 0.);
+#endif
+	if(!diffs)
+		printf("  exact\n");
+	else
+		printf( "  max err %.3g, rms %.1f dB, %.2f%% differ\n", maxerr
+		,	10*log10(sqerr/count), 100.*diffs/count );
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = 1;
+	int first = 1;
+	int ret = 0;
+	long *rates;
+
+	if(argc > 3 && !strcmp(argv[1], "-r"))
+	{
+		rounds = atoi(argv[2]);
+		first = 3;
+	}
+	if(argc <= first || rounds < 1)
+	{
+		fprintf(stderr, "Usage: %s [-r rounds] file ...\n", argv[0]);
+		return 1;
+	}
+	mpg123_init();
+#ifdef HAVE_CACHE_MISSES
+	cache_open();
+#endif
+	int files = argc-first;
+	char **paths = argv+first;
+	rates = malloc(sizeof(long)*files);
+	if(!rates)
+	{
+		error("out of memory");
+		return 1;
+	}
+	for(int f=0; f<files; ++f)
+		if(!(rates[f] = ntom_rate(paths[f])))
+		{
+			error1("cannot decode %s, skipping", paths[f]);
+			ret = 1;
+		}
+
+	const char **decs = mpg123_supported_decoders();
+	for(size_t mi=0; mi<COUNT(modes); ++mi)
+		for(size_t ei=0; ei<COUNT(encs); ++ei)
+			for(int d=0; decs[d]; ++d)
+				if(bench(decs[d], ei, mi, files, paths, rates, rounds))
+				{
+					fprintf( stderr, "%s %s %s: not supported or failed\n"
+					,	decs[d], encs[ei].name, modes[mi].name );
+					ret = 1;
+				}
+	free(rates);
+#ifdef HAVE_CACHE_MISSES
+	if(cache_fd >= 0)
+		close(cache_fd);
+#endif
+	return ret;
+}
@@ -0,0 +1,141 @@
+/*
+	dither: check that syn123_setup_dither() makes syn123_conv() add
+	noise of the promised shape and size, and nothing without it
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "compat.h"
+#include <syn123.h>
+#include <math.h>
+#include "debug.h"
+
+#define CHANNELS 2
+#define SAMPLES 100003
+
+/* Convert the input and measure the error in LSB of the output: mean,
+   power and correlation of neighbouring samples in a channel. */
+static int measure( syn123_handle *sh, int dst_enc, int src_enc
+,	const float *in, double lsb, double *mean, double *power, double *corr )
+{
+	size_t srcframe = MPG123_SAMPLESIZE(src_enc);
+	size_t dstframe = MPG123_SAMPLESIZE(dst_enc);
+	char *src = malloc(srcframe*SAMPLES*CHANNELS);
+	char *dst = malloc(dstframe*SAMPLES*CHANNELS);
+	float *out = malloc(sizeof(float)*SAMPLES*CHANNELS);
+	float *ref = malloc(sizeof(float)*SAMPLES*CHANNELS);
+	int err = !src || !dst || !out || !ref;
+	if(!err)
+		err = syn123_conv( src, src_enc, srcframe*SAMPLES*CHANNELS
+		,	(void*)in, MPG123_ENC_FLOAT_32, sizeof(float)*SAMPLES*CHANNELS
+		,	NULL, NULL );
+	if(!err)
+		err = syn123_conv( ref, MPG123_ENC_FLOAT_32, sizeof(float)*SAMPLES*CHANNELS
+		,	src, src_enc, srcframe*SAMPLES*CHANNELS, NULL, NULL );
+	/* Several calls to have the noise continue over blocks. */
+	for(size_t pos=0, block=1; !err && pos<SAMPLES*CHANNELS; block=block*3+1)
+	{
+		size_t n = block < SAMPLES*CHANNELS-pos ? block : SAMPLES*CHANNELS-pos;
+		err = syn123_conv( dst+pos*dstframe, dst_enc, n*dstframe
+		,	src+pos*srcframe, src_enc, n*srcframe, NULL, sh );
+		pos += n;
+	}
+	if(!err)
+		err = syn123_conv( out, MPG123_ENC_FLOAT_32, sizeof(float)*SAMPLES*CHANNELS
+		,	dst, dst_enc, dstframe*SAMPLES*CHANNELS, NULL, NULL );
+	if(!err)
+	{
+		double sum = 0., sq = 0., prod = 0.;
+		for(size_t i=0; i<SAMPLES*CHANNELS; ++i)
+		{
+			double e = (out[i]-ref[i])/lsb;
+			sum += e;
+			sq += e*e;
+			if(i >= CHANNELS)
+				prod += e*(out[i-CHANNELS]-ref[i-CHANNELS])/lsb;
+		}
+		*mean = sum/(SAMPLES*CHANNELS);
+		*power = sq/(SAMPLES*CHANNELS);
+		*corr = prod/sq;
+	}
+	free(ref);
+	free(out);
+	free(dst);
+	free(src);
+	return err;
+}
+
+static int test( syn123_handle *sh, const char *name, int dither
+,	int dst_enc, int src_enc, const float *in, double lsb, double level )
+{
+	double mean = 0., power = 0., corr = 0.;
+	int err = syn123_setup_dither(sh, dither, CHANNELS) != SYN123_OK
+	||	measure(sh, dst_enc, src_enc, in, lsb, &mean, &power, &corr);
+	/* The input is a fraction of an LSB off the grid. Rounding always
+	   errs the same, dither makes the output right on average with
+	   error power of 1/12 for rounding plus 1/6 for triangular noise,
+	   the highpass noise having a correlation of -1/2 to the sample
+	   before. */
+	if(!err) switch(dither)
+	{
+		case SYN123_DITHER_NONE:
+			if(fabs(mean+level) > 1e-3 || fabs(power-level*level) > 1e-3)
+				err = 1;
+		break;
+		case SYN123_DITHER_HP_TPDF_16BIT:
+		case SYN123_DITHER_HP_TPDF_24BIT:
+			if(fabs(corr+0.5*(1./6.)/(1./4.)) > 0.05)
+				err = 1;
+		/* fall through */
+		default:
+			if(fabs(mean) > 0.02 || fabs(power-0.25) > 0.03)
+				err = 1;
+			if(dither == SYN123_DITHER_TPDF_16BIT && fabs(corr) > 0.03)
+				err = 1;
+	}
+	printf( "%s: mean %.4f, power %.4f, correlation %.4f: %s\n", name
+	,	mean, power, corr, err ? "FAIL" : "PASS");
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	int errsum = 0;
+	syn123_handle *sh = syn123_new(44100, CHANNELS, MPG123_ENC_FLOAT_32, 0, NULL);
+	float *in16 = malloc(sizeof(float)*SAMPLES*CHANNELS);
+	float *in8 = malloc(sizeof(float)*SAMPLES*CHANNELS);
+	if(!sh || !in16 || !in8)
+		return 1;
+	/* A slow ramp over the grid, a quarter LSB above it. */
+	for(size_t i=0; i<SAMPLES*CHANNELS; ++i)
+	{
+		in16[i] = (float)(((long)(i%2000)-1000+0.25)/32767.);
+		in8[i] = (float)(((long)(i%200)-100+0.25)/127.);
+	}
+	errsum += test( sh, "f32 -> s16 plain", SYN123_DITHER_NONE
+	,	MPG123_ENC_SIGNED_16, MPG123_ENC_FLOAT_32, in16, 1./32767., 0.25 );
+	errsum += test( sh, "f32 -> s16 TPDF", SYN123_DITHER_TPDF_16BIT
+	,	MPG123_ENC_SIGNED_16, MPG123_ENC_FLOAT_32, in16, 1./32767., 0.25 );
+	errsum += test( sh, "f64 -> s16 highpass", SYN123_DITHER_HP_TPDF_16BIT
+	,	MPG123_ENC_SIGNED_16, MPG123_ENC_FLOAT_64, in16, 1./32767., 0.25 );
+	errsum += test( sh, "s32 -> s16 TPDF", SYN123_DITHER_TPDF_24BIT
+	,	MPG123_ENC_SIGNED_16, MPG123_ENC_SIGNED_32, in16, 1./32767., 0.25 );
+	errsum += test( sh, "f32 -> u8 highpass", SYN123_DITHER_HP_TPDF_16BIT
+	,	MPG123_ENC_UNSIGNED_8, MPG123_ENC_FLOAT_32, in8, 1./127., 0.25 );
+	errsum += test( sh, "f32 -> u8 TPDF", SYN123_DITHER_TPDF_16BIT
+	,	MPG123_ENC_UNSIGNED_8, MPG123_ENC_FLOAT_32, in8, 1./127., 0.25 );
+	/* The 24 bit choice includes the smaller outputs. */
+	errsum += test( sh, "f32 -> s16 after 24 bit setup", SYN123_DITHER_TPDF_24BIT
+	,	MPG123_ENC_SIGNED_16, MPG123_ENC_FLOAT_32, in16, 1./32767., 0.25 );
+	if(syn123_setup_dither(sh, 99, CHANNELS) != SYN123_BAD_DITHER)
+	{
+		printf("bad dither accepted: FAIL\n");
+		++errsum;
+	}
+	free(in8);
+	free(in16);
+	syn123_del(sh);
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+/*
+	list: check that mpg123_open_list() gives the samples of the single
+	files one after another, and seeks over them
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+static unsigned char *full = NULL;
+static size_t full_bytes = 0;
+static size_t framesize = 0; /* bytes per sample frame, all channels */
+
+/* Read the rest of the stream, appending to *mem. */
+static int read_all(mpg123_handle *mh, unsigned char **mem, size_t *bytes)
+{
+	int ret;
+	do
+	{
+		size_t done = 0;
+		unsigned char *nmem = realloc(*mem, *bytes+16384);
+		if(!nmem)
+			return -1;
+		*mem = nmem;
+		ret = mpg123_read(mh, *mem+*bytes, 16384, &done);
+		*bytes += done;
+	} while(ret == MPG123_OK || ret == MPG123_NEW_FORMAT);
+	return ret == MPG123_DONE ? 0 : -1;
+}
+
+static mpg123_handle *new_handle(void)
+{
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+	if(mh == NULL)
+		return NULL;
+	/* Fixed output format for all files. */
+	if( mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0) != MPG123_OK
+	||  mpg123_format_none(mh) != MPG123_OK
+	||  mpg123_format(mh, 44100, MPG123_STEREO, MPG123_ENC_SIGNED_16) != MPG123_OK )
+	{
+		mpg123_delete(mh);
+		return NULL;
+	}
+	framesize = 4;
+	return mh;
+}
+
+static int check(const char *what, const unsigned char *mem, size_t bytes
+,	size_t want_off, size_t want_bytes)
+{
+	int err = 0;
+	if(want_off > full_bytes)
+		want_off = full_bytes;
+	if(want_bytes > full_bytes-want_off)
+		want_bytes = full_bytes-want_off;
+	if(bytes != want_bytes || (bytes && memcmp(mem, full+want_off, bytes)))
+		err = 1;
+	fprintf( stdout, "%s: %lu samples, expected %lu: %s\n", what
+	,	(unsigned long)(bytes/framesize), (unsigned long)(want_bytes/framesize)
+	,	err ? "FAIL" : "PASS" );
+	return err;
+}
+
+/* Decode from start to end (or the end for end < 0) via seek or range. */
+static int test_part(char **paths, int count, int64_t start, int64_t end)
+{
+	mpg123_handle *mh;
+	unsigned char *mem = NULL;
+	size_t bytes = 0;
+	char what[100];
+	int err = 0;
+
+	if(!(mh = new_handle()))
+		return 1;
+	if( mpg123_open_list(mh, (const char * const *)paths, count) != MPG123_OK
+	||  mpg123_scan(mh) != MPG123_OK
+	||  (end < 0
+		?	mpg123_seek(mh, (off_t)start, SEEK_SET) != (off_t)start
+		:	mpg123_range(mh, start, end) != MPG123_OK)
+	||  read_all(mh, &mem, &bytes) )
+	{
+		error1("list decoding failed: %s", mpg123_strerror(mh));
+		err = 1;
+	}
+	mpg123_delete(mh);
+	if(!err)
+	{
+		sprintf( what, "%s %"PRIi64" to %"PRIi64, end < 0 ? "seek" : "range"
+		,	start, end );
+		err = check( what, mem, bytes, (size_t)start*framesize
+		,	end < 0 ? full_bytes : (size_t)(end-start)*framesize );
+	}
+	free(mem);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	int errsum = 0;
+	int64_t samples;
+	int64_t start = 0;
+	int64_t *starts;
+	mpg123_handle *mh;
+	unsigned char *mem = NULL;
+	size_t bytes = 0;
+	size_t index;
+	int i;
+
+	if(argc < 3)
+	{
+		printf("Gimme some MPEG file names...\n");
+		return 0;
+	}
+	mpg123_init();
+	if(!(starts = malloc(sizeof(*starts)*argc)) || !(mh = new_handle()))
+		return 1;
+	/* The files one by one. */
+	for(i=1; i<argc; ++i)
+	{
+		starts[i-1] = full_bytes/framesize;
+		if(mpg123_open(mh, argv[i]) != MPG123_OK || read_all(mh, &full, &full_bytes))
+		{
+			error2("cannot decode %s: %s", argv[i], mpg123_strerror(mh));
+			return 1;
+		}
+	}
+	starts[argc-1] = samples = full_bytes/framesize;
+	fprintf(stdout, "%"PRIi64" samples in total\n", samples);
+
+	/* All in one go. */
+	if(mpg123_open_list(mh, (const char * const *)argv+1, argc-1) != MPG123_OK)
+	{
+		error1("cannot open list: %s", mpg123_strerror(mh));
+		return 1;
+	}
+	if(read_all(mh, &mem, &bytes))
+	{
+		error1("list decoding failed: %s", mpg123_strerror(mh));
+		++errsum;
+	}
+	errsum += check("whole list", mem, bytes, 0, full_bytes);
+	free(mem);
+	if( mpg123_list_index(mh, &index, &start) != MPG123_OK
+	||  index != (size_t)argc-2 || start != starts[argc-2]
+	||  mpg123_length(mh) != samples || mpg123_tell(mh) != samples )
+	{
+		fprintf( stdout, "end at entry %lu from %"PRIi64", length %"PRIi64
+			", position %"PRIi64": FAIL\n", (unsigned long)index, start
+		,	(int64_t)mpg123_length(mh), (int64_t)mpg123_tell(mh) );
+		++errsum;
+	}
+	mpg123_delete(mh);
+
+	errsum += test_part(argv+1, argc-1, samples/3, -1);
+	errsum += test_part(argv+1, argc-1, starts[1], -1);
+	errsum += test_part( argv+1, argc-1, starts[1] > 1000 ? starts[1]-1000 : 0
+	,	starts[1]+1000 );
+	errsum += test_part(argv+1, argc-1, 100, samples-100);
+
+	free(starts);
+	free(full);
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
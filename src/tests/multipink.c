@@ -0,0 +1,85 @@
+/*
+	multipink: check syn123_multipink() against the plain pink noise
+	generator and for independence of the channels
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "compat.h"
+#include <syn123.h>
+#include <math.h>
+#include "debug.h"
+
+#define CHANNELS 19
+#define SAMPLES 100000
+#define ROWS 20
+
+int main(int argc, char **argv)
+{
+	int errsum = 0;
+	syn123_handle *sh = syn123_new(48000, 1, MPG123_ENC_FLOAT_32, 0, NULL);
+	float *mono = malloc(sizeof(float)*SAMPLES);
+	float *multi = malloc(sizeof(float)*SAMPLES*CHANNELS);
+	if(!sh || !mono || !multi)
+		return 1;
+	if( syn123_setup_pink(sh, ROWS, NULL)
+	||  syn123_read(sh, mono, sizeof(float)*SAMPLES) != sizeof(float)*SAMPLES
+	||  syn123_setup_multipink(sh, CHANNELS, ROWS, 0) )
+		return 1;
+	/* In blocks of varying size to have the state go on. */
+	for(size_t pos=0, block=1; pos<SAMPLES; block=block*2+1)
+	{
+		size_t n = block < SAMPLES-pos ? block : SAMPLES-pos;
+		if(syn123_multipink(sh, multi+pos*CHANNELS, n))
+			return 1;
+		pos += n;
+	}
+	int err = 0;
+	for(size_t i=0; i<SAMPLES; ++i)
+		if(multi[i*CHANNELS] != mono[i])
+			err = 1;
+	printf("first channel as syn123_setup_pink(): %s\n", err ? "FAIL" : "PASS");
+	errsum += err;
+	/* Each channel within the bounds of the generator (a bit beyond [-1,1]
+	   in rare cases), with about the same power, and not correlated with
+	   its neighbour. The slow rows make for large chance correlation of
+	   the signals themselves, the differences of successive samples are
+	   better behaved. */
+	err = 0;
+	double power0 = 0.;
+	double maxcorr = 0.;
+	for(int c=0; c<CHANNELS; ++c)
+	{
+		double power = 0., cross = 0., other = 0.;
+		int d = (c+1)%CHANNELS;
+		for(size_t i=1; i<SAMPLES; ++i)
+		{
+			float x = multi[i*CHANNELS+c];
+			if(!(x >= -2.f && x < 2.f))
+				err = 1;
+			x -= multi[(i-1)*CHANNELS+c];
+			float y = multi[i*CHANNELS+d] - multi[(i-1)*CHANNELS+d];
+			power += x*x;
+			other += y*y;
+			cross += x*y;
+		}
+		if(!c)
+			power0 = power;
+		else if(fabs(power/power0-1.) > 0.5)
+			err = 1;
+		double corr = fabs(cross/sqrt(power*other));
+		if(corr > maxcorr)
+			maxcorr = corr;
+	}
+	if(maxcorr > 0.02)
+		err = 1;
+	printf( "%d channels independent, correlation up to %.3f: %s\n", CHANNELS
+	,	maxcorr, err ? "FAIL" : "PASS" );
+	errsum += err;
+	free(multi);
+	free(mono);
+	syn123_del(sh);
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
@@ -0,0 +1,410 @@
+/*
+	pathological: CPU time and memory on malformed input, for resync and
+	tag parsing
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Each kind of bad input is generated at three sizes (the base size, 4
+	and 16 times that) and decoded without a resync limit, via seekable
+	reader callbacks and via the feeder. The work has to grow linearly with
+	the input: the CPU time per byte at the largest size must not exceed the
+	one at the smallest by more than the growth factor (-g, default 3), and
+	the heap memory in use, counted by allocator hooks, must stay below a
+	fixed amount plus a few bytes per byte of input (-m, default 16).
+
+	The small sizes are decoded repeatedly until they took a measurable
+	amount of time. A line with CPU nanoseconds and peak heap bytes per byte
+	of input is printed for each size, then PASS or FAIL for that input.
+*/
+
+/* The hooks below want the real thing. */
+#define COMPAT_SYSTEM_ALLOC
+#include "compat.h"
+#include <mpg123.h>
+#include <time.h>
+#include "debug.h"
+
+/* Memory for the decoder and its buffers, independent of the input. */
+#define MEM_SLACK (2*1024*1024)
+/* Enough CPU time for a stable measure. */
+#define MIN_TIME 0.05
+
+static size_t live = 0;
+static size_t peak = 0;
+
+/* The size in front of each block, with room for any alignment. */
+#define HEAD 16
+
+static void *count_alloc(void *handle, size_t size)
+{
+	unsigned char *p = malloc(size+HEAD);
+	if(!p)
+		return NULL;
+	*(size_t*)p = size;
+	if((live += size) > peak)
+		peak = live;
+	return p+HEAD;
+}
+
+static void *count_realloc(void *handle, void *ptr, size_t size)
+{
+	unsigned char *p = ptr ? (unsigned char*)ptr-HEAD : NULL;
+	size_t old = p ? *(size_t*)p : 0;
+	unsigned char *np = realloc(p, size+HEAD);
+	if(!np)
+		return NULL;
+	*(size_t*)np = size;
+	live = live - old + size;
+	if(live > peak)
+		peak = live;
+	return np+HEAD;
+}
+
+static void count_free(void *handle, void *ptr)
+{
+	unsigned char *p = (unsigned char*)ptr-HEAD;
+	live -= *(size_t*)p;
+	free(p);
+}
+
+static uint32_t rnd(uint32_t *seed)
+{
+	*seed = *seed*1103515245u + 12345u;
+	return *seed >> 8;
+}
+
+static double now(void)
+{
+	return (double)clock()/CLOCKS_PER_SEC;
+}
+
+struct buffer
+{
+	unsigned char *data;
+	size_t size;
+	size_t fill;
+};
+
+static void put(struct buffer *b, const void *data, size_t bytes)
+{
+	if(bytes > b->size - b->fill)
+		bytes = b->size - b->fill;
+	memcpy(b->data+b->fill, data, bytes);
+	b->fill += bytes;
+}
+
+static void put_junk(struct buffer *b, size_t bytes, uint32_t *seed)
+{
+	while(bytes-- && b->fill < b->size)
+	{
+		unsigned char c = rnd(seed) & 0xff;
+		b->data[b->fill++] = c == 0xff ? 0 : c;
+	}
+}
+
+/* MPEG 1 Layer III, 128 kbit/s, 44.1 kHz: 417 bytes of silence. */
+static const unsigned char mpeg_header[4] = { 0xff, 0xfb, 0x90, 0x00 };
+
+static void put_frame(struct buffer *b)
+{
+	put(b, mpeg_header, 4);
+	for(int i=4; i<417 && b->fill < b->size; ++i)
+		b->data[b->fill++] = 0;
+}
+
+static void synchsafe(unsigned char *p, unsigned long val)
+{
+	p[0] = val>>21 & 0x7f;
+	p[1] = val>>14 & 0x7f;
+	p[2] = val>>7  & 0x7f;
+	p[3] = val     & 0x7f;
+}
+
+static void put_id3_head(struct buffer *b, unsigned long length)
+{
+	unsigned char head[10] = { 'I', 'D', '3', 4, 0, 0 };
+	synchsafe(head+6, length);
+	put(b, head, 10);
+}
+
+static void put_id3_frame( struct buffer *b, const char *id
+,	const void *data, unsigned long length, unsigned long size )
+{
+	unsigned char head[10] = { 0 };
+	memcpy(head, id, 4);
+	synchsafe(head+4, size);
+	put(b, head, 10);
+	put(b, data, length);
+}
+
+static void put_ape(struct buffer *b, uint32_t size)
+{
+	unsigned char head[32] = { 'A', 'P', 'E', 'T', 'A', 'G', 'E', 'X'
+	,	2000 & 0xff, 2000 >> 8, 0, 0 };
+	head[12] = size & 0xff;
+	head[13] = size >> 8 & 0xff;
+	head[14] = size >> 16 & 0xff;
+	head[15] = size >> 24;
+	put(b, head, 32);
+}
+
+typedef void (*generator)(struct buffer *b, uint32_t *seed);
+
+/* No sync at all. */
+static void gen_junk(struct buffer *b, uint32_t *seed)
+{
+	put_junk(b, b->size, seed);
+}
+
+/* Valid headers all over, none followed by a matching one. */
+static void gen_fake_sync(struct buffer *b, uint32_t *seed)
+{
+	while(b->fill < b->size)
+	{
+		put(b, mpeg_header, 4);
+		put_junk(b, 16 + rnd(seed)%64, seed);
+	}
+}
+
+/* Pairs of frames between junk, for resync in the stream. */
+static void gen_resync(struct buffer *b, uint32_t *seed)
+{
+	while(b->fill < b->size)
+	{
+		put_frame(b);
+		put_frame(b);
+		put_junk(b, 100 + rnd(seed)%900, seed);
+	}
+}
+
+/* One tag of the whole size, full of tiny text frames. */
+static void gen_id3_frames(struct buffer *b, uint32_t *seed)
+{
+	static const unsigned char text[] = { 3, 'k', 0, 'v' };
+	put_id3_head(b, b->size-10-2*417);
+	while(b->fill + 14 + 2*417 <= b->size)
+		put_id3_frame(b, "TXXX", text, sizeof(text), sizeof(text));
+	while(b->fill < b->size-2*417)
+		b->data[b->fill++] = 0;
+	put_frame(b);
+	put_frame(b);
+}
+
+/* A tag claiming the maximum size, the stream ending long before. */
+static void gen_id3_truncated(struct buffer *b, uint32_t *seed)
+{
+	put_id3_head(b, 0x0fffffff);
+	put_id3_frame(b, "TIT2", "\3title", 6, 0x0fffffff);
+	put_junk(b, b->size, seed);
+}
+
+/* Tag after tag, each with a frame claiming more than the tag holds. */
+static void gen_id3_many(struct buffer *b, uint32_t *seed)
+{
+	while(b->fill < b->size)
+	{
+		put_id3_head(b, 30);
+		put_id3_frame(b, "TIT2", "\3title of the tag", 17, 0x0fffff);
+		put(b, "\0\0\0", 3);
+		if(rnd(seed)%8 == 0)
+			put_frame(b);
+	}
+}
+
+/* APE tags between frames, some with sizes beyond the end. */
+static void gen_ape(struct buffer *b, uint32_t *seed)
+{
+	put_frame(b);
+	while(b->fill < b->size)
+	{
+		uint32_t r = rnd(seed);
+		put_ape(b, r%16 ? 32 + r%64 : 0xffffffff);
+		put_junk(b, 32 + rnd(seed)%64, seed);
+		put_frame(b);
+	}
+}
+
+static const struct { const char *name; generator gen; } inputs[] =
+{
+	{ "junk",          gen_junk }
+,	{ "fake_sync",     gen_fake_sync }
+,	{ "resync",        gen_resync }
+,	{ "id3_frames",    gen_id3_frames }
+,	{ "id3_truncated", gen_id3_truncated }
+,	{ "id3_many",      gen_id3_many }
+,	{ "ape",           gen_ape }
+};
+
+#define COUNT(a) (sizeof(a)/sizeof(*(a)))
+
+struct memfile
+{
+	const unsigned char *data;
+	size_t size;
+	size_t pos;
+};
+
+static ssize_t mem_read(void *handle, void *buf, size_t count)
+{
+	struct memfile *mf = handle;
+	if(count > mf->size - mf->pos)
+		count = mf->size - mf->pos;
+	memcpy(buf, mf->data + mf->pos, count);
+	mf->pos += count;
+	return (ssize_t)count;
+}
+
+static int64_t mem_seek(void *handle, int64_t offset, int whence)
+{
+	struct memfile *mf = handle;
+	int64_t pos;
+	switch(whence)
+	{
+		case SEEK_SET: pos = offset; break;
+		case SEEK_CUR: pos = (int64_t)mf->pos + offset; break;
+		case SEEK_END: pos = (int64_t)mf->size + offset; break;
+		default: pos = -1;
+	}
+	if(pos < 0 || pos > (int64_t)mf->size)
+		return -1;
+	mf->pos = (size_t)pos;
+	return pos;
+}
+
+static unsigned char outbuf[16384];
+
+/* Decode all, until the end or an error. */
+static int decode(const unsigned char *data, size_t size, int feed)
+{
+	int ret;
+	size_t done;
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+
+	if(!mh)
+		return -1;
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0.);
+	mpg123_param(mh, MPG123_RESYNC_LIMIT, -1, 0.);
+	if(feed)
+	{
+		size_t pos = 0;
+		ret = mpg123_open_feed(mh);
+		while(ret == MPG123_OK && pos < size)
+		{
+			size_t chunk = size-pos < 4096 ? size-pos : 4096;
+			ret = mpg123_decode(mh, data+pos, chunk, outbuf, sizeof(outbuf), &done);
+			pos += chunk;
+			while(ret == MPG123_OK || ret == MPG123_NEW_FORMAT)
+				ret = mpg123_decode(mh, NULL, 0, outbuf, sizeof(outbuf), &done);
+			if(ret == MPG123_NEED_MORE)
+				ret = MPG123_OK;
+		}
+	}
+	else
+	{
+		struct memfile mf = { data, size, 0 };
+		ret = mpg123_reader64(mh, mem_read, mem_seek, NULL);
+		if(ret == MPG123_OK)
+			ret = mpg123_open_handle64(mh, &mf);
+		while(ret == MPG123_OK || ret == MPG123_NEW_FORMAT)
+			ret = mpg123_read(mh, outbuf, sizeof(outbuf), &done);
+		if(ret == MPG123_DONE)
+			ret = MPG123_OK;
+	}
+	mpg123_delete(mh);
+	return ret;
+}
+
+/* CPU seconds and peak heap bytes in use for one decode of the input,
+   on average over as many runs as needed. */
+static void measure( const unsigned char *data, size_t size, int feed
+,	double *time, size_t *mem )
+{
+	size_t base = live;
+	double start = now();
+	long runs = 0;
+
+	peak = live;
+	do
+	{
+		decode(data, size, feed);
+		++runs;
+	} while((*time = now() - start) < MIN_TIME);
+	*time /= runs;
+	*mem = peak - base;
+}
+
+int main(int argc, char **argv)
+{
+	size_t base = 64*1024;
+	double growth = 3;
+	double mem_factor = 16;
+	int errsum = 0;
+
+	for(int i=1; i+1<argc; i+=2)
+	{
+		if(!strcmp(argv[i], "-s"))
+			base = (size_t)atol(argv[i+1]);
+		else if(!strcmp(argv[i], "-g"))
+			growth = atof(argv[i+1]);
+		else if(!strcmp(argv[i], "-m"))
+			mem_factor = atof(argv[i+1]);
+		else
+		{
+			argc = 0;
+			break;
+		}
+	}
+	if(!(argc & 1) || base < 4096 || growth < 1 || mem_factor <= 0)
+	{
+		fprintf( stderr, "Usage: %s [-s base size] [-g growth factor]"
+			" [-m memory per byte]\n", argv[0] );
+		return 1;
+	}
+	if(mpg123_allocator(count_alloc, count_realloc, count_free, NULL) != MPG123_OK)
+		return 1;
+	mpg123_init();
+	for(size_t k=0; k<COUNT(inputs); ++k)
+	for(int feed=0; feed<2; ++feed)
+	{
+		double first_rate = 0;
+		int err = 0;
+		for(size_t size=base; size<=16*base; size*=4)
+		{
+			struct buffer b = { malloc(size), size, 0 };
+			uint32_t seed = 0x5eed;
+			double time, rate;
+			size_t mem;
+			if(!b.data)
+			{
+				error("out of memory");
+				return 1;
+			}
+			inputs[k].gen(&b, &seed);
+			measure(b.data, b.fill, feed, &time, &mem);
+			free(b.data);
+			rate = time*1e9/size;
+			printf( "%s %s %lu bytes: %.1f ns/byte, %lu heap bytes (%.2f/byte)\n"
+			,	inputs[k].name, feed ? "feed" : "read", (unsigned long)size
+			,	rate, (unsigned long)mem, (double)mem/size );
+			if(size == base)
+				first_rate = rate;
+			else if(rate > growth*first_rate)
+			{
+				error2("%s: CPU time grows superlinearly (%.1f times per byte)"
+				,	inputs[k].name, rate/first_rate);
+				err = 1;
+			}
+			if(mem > MEM_SLACK + mem_factor*size)
+			{
+				error2("%s: %lu heap bytes is too much", inputs[k].name, (unsigned long)mem);
+				err = 1;
+			}
+		}
+		printf("%s %s: %s\n", inputs[k].name, feed ? "feed" : "read", err ? "FAIL" : "PASS");
+		errsum += err;
+	}
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+/*
+	peek_end: the ID3v1 tag at the end with MPG123_PEEK_END_LATER
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The file is read from memory via mpg123_reader64(), with an ID3v1 tag
+	put at the end if it has none. Without the parameter, the tag is read
+	while opening. With it, nothing is read at the end before the first
+	frame: the tag comes later with MPG123_NEW_ID3 to the meta callback,
+	directly or from the thread of MPG123_PREFETCH. Output and length are
+	the same as without, so is the count of MPG123_NEW_ID3 (including ID3v2
+	tags), and mpg123_id3() right after opening waits for the tag.
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+#define TITLE "peek at the end"
+
+struct memfile
+{
+	unsigned char *data;
+	size_t size;
+	size_t pos;
+	int tailreads; /* reads that got to the last 128 bytes */
+};
+
+static ssize_t mem_read(void *handle, void *buf, size_t count)
+{
+	struct memfile *mf = handle;
+	if(count > mf->size - mf->pos)
+		count = mf->size - mf->pos;
+	memcpy(buf, mf->data+mf->pos, count);
+	mf->pos += count;
+	if(count && mf->pos > mf->size-128)
+		++mf->tailreads;
+	return (ssize_t)count;
+}
+
+static int64_t mem_seek(void *handle, int64_t offset, int whence)
+{
+	struct memfile *mf = handle;
+	int64_t pos;
+	switch(whence)
+	{
+		case SEEK_SET: pos = offset; break;
+		case SEEK_CUR: pos = (int64_t)mf->pos + offset; break;
+		case SEEK_END: pos = (int64_t)mf->size + offset; break;
+		default: return -1;
+	}
+	if(pos < 0 || pos > (int64_t)mf->size)
+		return -1;
+	return (int64_t)(mf->pos = (size_t)pos);
+}
+
+static void count_meta(void *handle, int what)
+{
+	if(what & MPG123_NEW_ID3)
+		++*(int *)handle;
+}
+
+struct result
+{
+	unsigned char *audio;
+	size_t bytes;
+	off_t length;
+	int tailreads_open;  /* at the end before any frame */
+	int tailreads_first; /* ... after the first frame */
+	int notified;
+	int title;           /* mpg123_id3() gives the tag */
+};
+
+static int decode( struct memfile *mf, long later, long prefetch, int ask_first
+,	struct result *res )
+{
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+	mpg123_id3v1 *v1;
+	int frames = 0;
+	int err = 0;
+	int ret;
+
+	memset(res, 0, sizeof(*res));
+	mf->pos = 0;
+	mf->tailreads = 0;
+	if( !mh
+	||	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0) != MPG123_OK
+	||	mpg123_param(mh, MPG123_PEEK_END_LATER, later, 0) != MPG123_OK
+	||	mpg123_param(mh, MPG123_PREFETCH, prefetch, 0) != MPG123_OK
+	||	mpg123_meta_callback(mh, count_meta, &res->notified) != MPG123_OK
+	||	mpg123_reader64(mh, mem_read, mem_seek, NULL) != MPG123_OK
+	||	mpg123_open_handle(mh, mf) != MPG123_OK )
+	{
+		error1("cannot open: %s", mh ? mpg123_strerror(mh) : "no handle");
+		mpg123_delete(mh);
+		return 1;
+	}
+	if(!prefetch)
+		res->tailreads_open = mf->tailreads;
+	if(ask_first && mpg123_id3(mh, &v1, NULL) == MPG123_OK && v1)
+		res->title = !strncmp(v1->title, TITLE, strlen(TITLE));
+	do
+	{
+		off_t num;
+		unsigned char *audio;
+		size_t bytes;
+		ret = mpg123_decode_frame(mh, &num, &audio, &bytes);
+		if(bytes)
+		{
+			unsigned char *na = realloc(res->audio, res->bytes+bytes);
+			if(!na)
+			{
+				err = 1;
+				break;
+			}
+			memcpy(na+res->bytes, audio, bytes);
+			res->audio = na;
+			res->bytes += bytes;
+		}
+		if(ret == MPG123_OK && !frames++)
+			res->tailreads_first = mf->tailreads;
+	} while(ret == MPG123_OK || ret == MPG123_NEW_FORMAT);
+	if(ret != MPG123_DONE)
+	{
+		error1("decoding failed: %s", mpg123_strerror(mh));
+		err = 1;
+	}
+	res->length = mpg123_length(mh);
+	if(!ask_first && mpg123_id3(mh, &v1, NULL) == MPG123_OK && v1)
+		res->title = !strncmp(v1->title, TITLE, strlen(TITLE));
+	mpg123_delete(mh);
+	return err;
+}
+
+static int check( const char *name, struct memfile *mf, long later
+,	long prefetch, int ask_first, struct result *ref )
+{
+	struct result res;
+	int err = decode(mf, later, prefetch, ask_first, &res);
+
+	if( !err && (res.bytes != ref->bytes || memcmp(res.audio, ref->audio, ref->bytes)
+	||	res.length != ref->length || !res.title || res.notified != ref->notified) )
+		err = 1;
+	if(!err && !prefetch && (res.tailreads_open || (!ask_first && res.tailreads_first)))
+		err = 1;
+	printf("%s: %lu bytes, %s\n", name, (unsigned long)res.bytes
+	,	err ? "FAIL" : "PASS");
+	free(res.audio);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	struct memfile mf = { NULL, 0, 0, 0 };
+	struct result ref;
+	unsigned char buf[65536];
+	size_t alloc = 0;
+	size_t got;
+	int errsum = 0;
+	FILE *f;
+
+	if(argc < 2)
+	{
+		printf("Gimme a MPEG file name...\n");
+		return 0;
+	}
+	if(!(f = compat_fopen(argv[1], "rb")))
+		return 1;
+	while((got = fread(buf, 1, sizeof(buf), f)) > 0)
+	{
+		if(mf.size + got + 128 > alloc)
+		{
+			unsigned char *nd;
+			alloc = 2*(mf.size + got + 128);
+			if(!(nd = realloc(mf.data, alloc)))
+				return 1;
+			mf.data = nd;
+		}
+		memcpy(mf.data+mf.size, buf, got);
+		mf.size += got;
+	}
+	compat_fclose(f);
+	if(mf.size < 128)
+		return 1;
+	/* Our own tag, replacing one that is there. */
+	if(memcmp(mf.data+mf.size-128, "TAG", 3))
+		mf.size += 128;
+	memset(mf.data+mf.size-128, 0, 128);
+	memcpy(mf.data+mf.size-128, "TAG", 3);
+	memcpy(mf.data+mf.size-125, TITLE, strlen(TITLE));
+	mpg123_init();
+
+	if(decode(&mf, 0, 0, 0, &ref) || !ref.title || ref.notified < 1 || !ref.tailreads_open)
+	{
+		printf("at opening: FAIL\n");
+		return 1;
+	}
+	printf("at opening: %lu bytes, PASS\n", (unsigned long)ref.bytes);
+	errsum += check("later", &mf, 1, 0, 0, &ref);
+	errsum += check("later, asked first", &mf, 1, 0, 1, &ref);
+	if(mpg123_feature(MPG123_FEATURE_THREADS))
+	{
+		errsum += check("later, prefetch", &mf, 1, 16384, 0, &ref);
+		errsum += check("later, prefetch, asked first", &mf, 1, 16384, 1, &ref);
+	}
+	free(ref.audio);
+	free(mf.data);
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
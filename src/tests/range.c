@@ -0,0 +1,127 @@
+/*
+	range: check that mpg123_range() gives exactly the samples of plain
+	decoding between start and end
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+static unsigned char *full = NULL;
+static size_t full_bytes = 0;
+static size_t framesize = 0; /* bytes per sample frame, all channels */
+
+/* Read the rest of the track, appending to *mem. */
+static int read_all(mpg123_handle *mh, unsigned char **mem, size_t *bytes)
+{
+	int ret;
+	do
+	{
+		size_t done = 0;
+		unsigned char *nmem = realloc(*mem, *bytes+16384);
+		if(!nmem)
+			return -1;
+		*mem = nmem;
+		ret = mpg123_read(mh, *mem+*bytes, 16384, &done);
+		*bytes += done;
+	} while(ret == MPG123_OK || ret == MPG123_NEW_FORMAT);
+	return ret == MPG123_DONE ? 0 : -1;
+}
+
+static mpg123_handle *open_file(const char *path)
+{
+	long rate;
+	int channels, encoding;
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+	if(mh == NULL)
+		return NULL;
+	if( mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0) != MPG123_OK
+	||  mpg123_open(mh, path) != MPG123_OK
+	||  mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK )
+	{
+		error1("cannot open: %s", mpg123_strerror(mh));
+		mpg123_delete(mh);
+		return NULL;
+	}
+	framesize = channels * mpg123_encsize(encoding);
+	return mh;
+}
+
+static int test_range(const char *path, int64_t start, int64_t end)
+{
+	mpg123_handle *mh;
+	unsigned char *mem = NULL;
+	size_t bytes = 0;
+	size_t want_off, want_bytes;
+	int err = 0;
+
+	if(!(mh = open_file(path)))
+		return -1;
+	if(mpg123_range(mh, start, end) != MPG123_OK || read_all(mh, &mem, &bytes))
+	{
+		error1("range decoding failed: %s", mpg123_strerror(mh));
+		err = -1;
+	}
+	mpg123_delete(mh);
+	if(err)
+	{
+		free(mem);
+		return err;
+	}
+	want_off = (size_t)start*framesize;
+	if(want_off > full_bytes)
+		want_off = full_bytes;
+	if(end < 0)
+		want_bytes = full_bytes-want_off;
+	else
+		want_bytes = end > start ? (size_t)(end-start)*framesize : 0;
+	if(want_bytes > full_bytes-want_off)
+		want_bytes = full_bytes-want_off;
+	if(bytes != want_bytes || (bytes && memcmp(mem, full+want_off, bytes)))
+		err = -1;
+	fprintf( stdout, "%"PRIi64" to %"PRIi64": %lu samples, expected %lu: %s\n"
+	,	start, end, (unsigned long)(bytes/framesize)
+	,	(unsigned long)(want_bytes/framesize), err ? "FAIL" : "PASS" );
+	free(mem);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	int errsum = 0;
+	int64_t samples;
+	mpg123_handle *mh;
+
+	if(argc < 2)
+	{
+		printf("Gimme a MPEG file name...\n");
+		return 0;
+	}
+	mpg123_init();
+	if(!(mh = open_file(argv[1])) || read_all(mh, &full, &full_bytes))
+	{
+		mpg123_delete(mh);
+		return 1;
+	}
+	mpg123_delete(mh);
+	samples = full_bytes/framesize;
+	fprintf(stdout, "%"PRIi64" samples in total\n", samples);
+
+	errsum += test_range(argv[1], 0, 100);
+	errsum += test_range(argv[1], 0, 1152);
+	errsum += test_range(argv[1], 300, 700);
+	errsum += test_range(argv[1], 1000, 5000);
+	errsum += test_range(argv[1], samples/3, samples/3+1);
+	errsum += test_range(argv[1], samples/2, samples/2+44100);
+	errsum += test_range(argv[1], samples/2, samples/2);
+	errsum += test_range(argv[1], samples-1000, samples+1000);
+	errsum += test_range(argv[1], 4608, -1);
+
+	free(full);
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
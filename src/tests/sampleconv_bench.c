@@ -0,0 +1,172 @@
+/*
+	sampleconv_bench: throughput of syn123_conv() for common encodings and
+	of interleaving for common channel layouts
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Run this against different builds of libsyn123 to compare. The checksum
+	of the output of each conversion has to stay the same.
+*/
+
+#include "config.h"
+#include "compat.h"
+#include <syn123.h>
+#include <time.h>
+#include "debug.h"
+
+static const struct { int src; int dst; const char *name; } convs[] =
+{
+	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_SIGNED_16, "f32 -> s16" }
+,	{ MPG123_ENC_SIGNED_16, MPG123_ENC_FLOAT_32,  "s16 -> f32" }
+,	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_SIGNED_32, "f32 -> s32" }
+,	{ MPG123_ENC_SIGNED_32, MPG123_ENC_FLOAT_32,  "s32 -> f32" }
+,	{ MPG123_ENC_SIGNED_16, MPG123_ENC_SIGNED_32, "s16 -> s32" }
+,	{ MPG123_ENC_SIGNED_32, MPG123_ENC_SIGNED_16, "s32 -> s16" }
+,	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_SIGNED_24, "f32 -> s24" }
+,	{ MPG123_ENC_SIGNED_24, MPG123_ENC_FLOAT_32,  "s24 -> f32" }
+,	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_ULAW_8,    "f32 -> ulaw" }
+,	{ MPG123_ENC_ULAW_8,    MPG123_ENC_FLOAT_32,  "ulaw -> f32" }
+,	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_ALAW_8,    "f32 -> alaw" }
+,	{ MPG123_ENC_SIGNED_16, MPG123_ENC_ULAW_8,    "s16 -> ulaw" }
+,	{ MPG123_ENC_ALAW_8,    MPG123_ENC_SIGNED_16, "alaw -> s16" }
+};
+
+// Channel layouts for interleaving, the samples given as total count over
+// all channels.
+static const struct { int channels; size_t samplesize; const char *name; } layouts[] =
+{
+	{ 2, 2, "2 x 16 bit" }
+,	{ 2, 4, "2 x 32 bit" }
+,	{ 6, 4, "6 x 32 bit" }
+,	{ 8, 2, "8 x 16 bit" }
+,	{ 2, 8, "2 x 64 bit" }
+,	{ 3, 3, "3 x 24 bit" }
+};
+
+static double now(void)
+{
+	return (double)clock()/CLOCKS_PER_SEC;
+}
+
+static unsigned long checksum(const unsigned char *buf, size_t bytes)
+{
+	unsigned long sum = 0;
+	for(size_t i=0; i<bytes; ++i)
+		sum = sum*31 + buf[i];
+	return sum;
+}
+
+int main(int argc, char **argv)
+{
+	size_t samples = 1<<20;
+	int rounds = 50;
+	int ret = 0;
+
+	fprintf(stderr, "Note: You could give the number of rounds as argument.\n");
+	if(argc > 1)
+		rounds = atoi(argv[1]);
+	syn123_handle *sh = syn123_new(48000, 1, MPG123_ENC_FLOAT_32, 0, NULL);
+	float *input = malloc(samples*sizeof(float));
+	unsigned char *src = malloc(samples*sizeof(int32_t));
+	unsigned char *dst = malloc(samples*sizeof(int32_t));
+	if(!sh || !input || !src || !dst)
+	{
+		error("out of memory");
+		return 1;
+	}
+	// Some clipping, too.
+	srand(123);
+	for(size_t i=0; i<samples; ++i)
+		input[i] = 2.2*rand()/RAND_MAX - 1.1;
+
+	for(size_t c=0; c<sizeof(convs)/sizeof(*convs); ++c)
+	{
+		size_t srcbytes = samples*MPG123_SAMPLESIZE(convs[c].src);
+		size_t dstbytes = 0;
+		int err = syn123_conv( src, convs[c].src, samples*sizeof(int32_t)
+		,	input, MPG123_ENC_FLOAT_32, samples*sizeof(float), NULL, sh );
+		double start = now();
+		for(int r=0; !err && r<rounds; ++r)
+			err = syn123_conv( dst, convs[c].dst, samples*sizeof(int32_t)
+			,	src, convs[c].src, srcbytes, &dstbytes, sh );
+		double time = now() - start;
+		if(err)
+		{
+			error2("%s: %s", convs[c].name, syn123_strerror(err));
+			ret = 1;
+			continue;
+		}
+		printf( "%s: %8.1f Msamples/s, checksum %08lx\n", convs[c].name
+		,	time > 0 ? (double)samples*rounds/time/1e6 : 0.
+		,	checksum(dst, dstbytes) & 0xffffffffUL );
+	}
+	// The same reduction to 16 bit with dither, flat and highpass.
+	static const struct { int dither; const char *name; } dithers[] =
+	{
+		{ SYN123_DITHER_TPDF_16BIT,    "f32 -> s16 (TPDF)" }
+	,	{ SYN123_DITHER_HP_TPDF_16BIT, "f32 -> s16 (highpass TPDF)" }
+	};
+	for(size_t d=0; d<sizeof(dithers)/sizeof(*dithers); ++d)
+	{
+		size_t dstbytes = 0;
+		int err = syn123_setup_dither(sh, dithers[d].dither, 2);
+		double start = now();
+		for(int r=0; !err && r<rounds; ++r)
+			err = syn123_conv( dst, MPG123_ENC_SIGNED_16, samples*sizeof(int32_t)
+			,	input, MPG123_ENC_FLOAT_32, samples*sizeof(float), &dstbytes, sh );
+		double time = now() - start;
+		syn123_setup_dither(sh, SYN123_DITHER_NONE, 1);
+		if(err)
+		{
+			error2("%s: %s", dithers[d].name, syn123_strerror(err));
+			ret = 1;
+			continue;
+		}
+		printf( "%s: %8.1f Msamples/s, checksum %08lx\n", dithers[d].name
+		,	time > 0 ? (double)samples*rounds/time/1e6 : 0.
+		,	checksum(dst, dstbytes) & 0xffffffffUL );
+	}
+	// The input bytes as they are, interleaved and back.
+	for(size_t l=0; l<sizeof(layouts)/sizeof(*layouts); ++l)
+	{
+		int channels = layouts[l].channels;
+		size_t samplesize = layouts[l].samplesize;
+		size_t count = samples*sizeof(float)/(channels*samplesize);
+		void *planes[8];
+		for(int c=0; c<channels; ++c)
+			planes[c] = (char*)input + c*count*samplesize;
+		double start = now();
+		for(int r=0; r<rounds; ++r)
+			syn123_interleave(dst, planes, channels, samplesize, count);
+		double itime = now() - start;
+		unsigned long isum = checksum(dst, count*channels*samplesize);
+		for(int c=0; c<channels; ++c)
+			planes[c] = src + c*count*samplesize;
+		start = now();
+		for(int r=0; r<rounds; ++r)
+			syn123_deinterleave(planes, dst, channels, samplesize, count);
+		double dtime = now() - start;
+		if(memcmp(src, input, count*channels*samplesize))
+		{
+			error1("%s: deinterleaving is not the inverse", layouts[l].name);
+			ret = 1;
+		}
+		start = now();
+		for(int r=0; r<rounds; ++r)
+			syn123_mono2many(dst, input, channels, samplesize, count);
+		double mtime = now() - start;
+		double total = (double)count*channels*rounds/1e6;
+		printf( "%s: interleave %8.1f, deinterleave %8.1f, mono2many %8.1f"
+			" Msamples/s, checksums %08lx %08lx\n", layouts[l].name
+		,	itime > 0 ? total/itime : 0., dtime > 0 ? total/dtime : 0.
+		,	mtime > 0 ? total/mtime : 0., isum & 0xffffffffUL
+		,	checksum(dst, count*channels*samplesize) & 0xffffffffUL );
+	}
+
+	free(dst);
+	free(src);
+	free(input);
+	syn123_del(sh);
+	return ret;
+}
@@ -0,0 +1,97 @@
+/*
+	scan_threads: check that mpg123_scan() with MPG123_SCAN_THREADS gives
+	the same frame count, length and index as the sequential scan
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+struct scan_result
+{
+	off_t frames;
+	off_t samples;
+	off_t *index;
+	off_t step;
+	size_t fill;
+};
+
+static int scan(const char *path, long threads, struct scan_result *res)
+{
+	off_t *offsets;
+	int err = 0;
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+	/* As many threads as ranges, also with fewer CPUs. */
+	mpg123_threads *pool = mpg123_threads_new(threads > 1 ? (int)threads : 1, NULL);
+
+	if(mh == NULL || pool == NULL)
+	{
+		mpg123_delete(mh);
+		mpg123_threads_delete(pool);
+		return 1;
+	}
+	/* A growing index, to compare every entry. */
+	if( mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0) != MPG123_OK
+	||  mpg123_param(mh, MPG123_INDEX_SIZE, -1000, 0) != MPG123_OK
+	||  mpg123_param(mh, MPG123_SCAN_THREADS, threads, 0) != MPG123_OK
+	||  mpg123_use_threads(mh, pool) != MPG123_OK
+	||  mpg123_open(mh, path) != MPG123_OK
+	||  mpg123_scan(mh) != MPG123_OK
+	||  (res->frames = mpg123_framelength(mh)) < 0
+	||  (res->samples = mpg123_length(mh)) < 0
+	||  mpg123_index(mh, &offsets, &res->step, &res->fill) != MPG123_OK )
+	{
+		error2("scan with %li threads failed: %s", threads, mpg123_strerror(mh));
+		err = 1;
+	}
+	else if(res->fill)
+	{
+		if((res->index = malloc(res->fill*sizeof(off_t))))
+			memcpy(res->index, offsets, res->fill*sizeof(off_t));
+		else
+			err = 1;
+	}
+	mpg123_delete(mh);
+	mpg123_threads_delete(pool);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	struct scan_result seq = { 0, 0, NULL, 0, 0 };
+	long threads[] = { 2, 3, 8 };
+	int errsum = 0;
+	int i;
+
+	if(argc < 2)
+	{
+		printf("Gimme a MPEG file name (of some MiB)...\n");
+		return 0;
+	}
+	mpg123_init();
+	if(scan(argv[1], 0, &seq))
+		return 1;
+	fprintf( stdout, "sequential: %"PRIi64" frames, %"PRIi64" samples, %lu index entries\n"
+	,	(int64_t)seq.frames, (int64_t)seq.samples, (unsigned long)seq.fill );
+	for(i=0; i<sizeof(threads)/sizeof(*threads); ++i)
+	{
+		struct scan_result par = { 0, 0, NULL, 0, 0 };
+		int err = scan(argv[1], threads[i], &par);
+		if(!err && ( par.frames != seq.frames || par.samples != seq.samples
+		||  par.step != seq.step || par.fill != seq.fill
+		||  (par.fill && memcmp(par.index, seq.index, par.fill*sizeof(off_t))) ))
+			err = 1;
+		fprintf( stdout, "%li threads: %"PRIi64" frames, %"PRIi64" samples, %lu index entries: %s\n"
+		,	threads[i], (int64_t)par.frames, (int64_t)par.samples
+		,	(unsigned long)par.fill, err ? "FAIL" : "PASS" );
+		errsum += err;
+		free(par.index);
+	}
+	free(seq.index);
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
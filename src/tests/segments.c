@@ -0,0 +1,327 @@
+/*
+	segments: feed a Layer III stream in segments with mpg123_feed_segment()
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The file (Layer III, no free format) is cut into segments at frame
+	boundaries. Checked are the plain split against decoding in one go, a
+	frame cut off at the end of a segment being dropped without resync,
+	and segments that each start with a LAME header frame carrying delay
+	and padding, against the plain output with those samples cut.
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+#define SEGMENTS 3
+#define GAPLESS_DELAY 529
+
+struct buf
+{
+	unsigned char *data;
+	size_t size;
+	size_t alloc;
+};
+
+static int append(struct buf *b, const unsigned char *data, size_t size)
+{
+	if(b->size + size > b->alloc)
+	{
+		size_t na = b->alloc ? b->alloc : 1<<16;
+		unsigned char *nd;
+		while(na < b->size + size)
+			na *= 2;
+		if(!(nd = realloc(b->data, na)))
+			return -1;
+		b->data = nd;
+		b->alloc = na;
+	}
+	memcpy(b->data+b->size, data, size);
+	b->size += size;
+	return 0;
+}
+
+static unsigned long header(const unsigned char *p)
+{
+	return (unsigned long)p[0]<<24 | (unsigned long)p[1]<<16 | (unsigned long)p[2]<<8 | p[3];
+}
+
+/* Bytes of the Layer III frame with that header, 0 if it is none. */
+static size_t frame_size(unsigned long h)
+{
+	static const int bitrates[2][16] =
+	{
+		{ 0,32,40,48,56,64,80,96,112,128,160,192,224,256,320,0 }
+	,	{ 0, 8,16,24,32,40,48,56, 64, 80, 96,112,128,144,160,0 }
+	};
+	static const long rates[3][3] =
+	{ { 44100, 48000, 32000 }, { 22050, 24000, 16000 }, { 11025, 12000, 8000 } };
+	int ver = (h>>19)&3;
+	int br  = (h>>12)&15;
+	int sr  = (h>>10)&3;
+	int lsf = ver != 3;
+
+	if((h & 0xffe00000) != 0xffe00000 || ver == 1 || ((h>>17)&3) != 1
+	||	br == 0 || br == 15 || sr == 3 )
+		return 0;
+	return (lsf ? 72 : 144)*1000L*bitrates[lsf][br]
+	/	rates[ver == 3 ? 0 : (ver == 2 ? 1 : 2)][sr] + ((h>>9)&1);
+}
+
+static int spf(unsigned long h)
+{
+	return ((h>>19)&3) == 3 ? 1152 : 576;
+}
+
+/* A frame like the one with header h, holding a Xing/Info header for that
+   many frames and LAME data with encoder delay and padding. */
+static int info_frame(struct buf *b, unsigned long h, long frames, long delay, long padding)
+{
+	unsigned char frame[2000];
+	size_t size;
+	int lsf = ((h>>19)&3) != 3;
+	int off;
+
+	h |= 1UL<<16; /* no CRC */
+	size = frame_size(h);
+	memset(frame, 0, size);
+	frame[0] = h>>24; frame[1] = h>>16; frame[2] = h>>8; frame[3] = h;
+	off = 4 + (((h>>6)&3) == 3 ? (lsf ? 9 : 17) : (lsf ? 17 : 32));
+	memcpy(frame+off, "Info", 4);
+	frame[off+7] = 1; /* flags: frame count */
+	frame[off+8]  = frames>>24; frame[off+9]  = frames>>16;
+	frame[off+10] = frames>>8;  frame[off+11] = frames;
+	memcpy(frame+off+12, "LAME3.100", 9);
+	off += 12+21;
+	frame[off]   = delay>>4;
+	frame[off+1] = (delay&15)<<4 | (padding>>8);
+	frame[off+2] = padding&0xff;
+	return append(b, frame, size);
+}
+
+/* Feed in small pieces, announcing the segments at their offsets, and
+   collect the output. */
+static int decode( struct buf *in, const size_t *segpos, int segs
+,	const long *delay, const long *padding, int gapless, struct buf *out
+,	size_t *framebytes )
+{
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+	unsigned char audio[16384];
+	size_t pos = 0;
+	int s = 0;
+	int err = 0;
+
+	out->size = 0;
+	if( !mh
+	||	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0) != MPG123_OK
+	||	mpg123_param(mh, gapless ? MPG123_ADD_FLAGS : MPG123_REMOVE_FLAGS
+		,	MPG123_GAPLESS, 0) != MPG123_OK
+	||	mpg123_open_feed(mh) != MPG123_OK )
+		err = 1;
+	while(!err && pos <= in->size)
+	{
+		size_t piece = 997;
+		int ret;
+		if(s < segs && pos == segpos[s])
+		{
+			if(mpg123_feed_segment(mh, delay ? delay[s] : -1, padding ? padding[s] : -1) != MPG123_OK)
+				err = 1;
+			++s;
+		}
+		if(s < segs && pos + piece > segpos[s])
+			piece = segpos[s] - pos;
+		if(pos + piece > in->size)
+			piece = in->size - pos;
+		if(!piece && pos == in->size)
+			break;
+		if(mpg123_feed(mh, in->data+pos, piece) != MPG123_OK)
+			err = 1;
+		pos += piece;
+		do
+		{
+			size_t done = 0;
+			ret = mpg123_read(mh, audio, sizeof(audio), &done);
+			if(done && append(out, audio, done))
+				err = 1;
+			if(ret == MPG123_NEW_FORMAT)
+			{
+				long rate;
+				int channels, enc;
+				mpg123_getformat(mh, &rate, &channels, &enc);
+				*framebytes = channels*MPG123_SAMPLESIZE(enc);
+			}
+		} while(!err && (ret == MPG123_OK || ret == MPG123_NEW_FORMAT));
+		if(ret != MPG123_NEED_MORE && ret != MPG123_DONE)
+		{
+			error1("decoding failed: %s", mpg123_strerror(mh));
+			err = 1;
+		}
+	}
+	mpg123_delete(mh);
+	return err;
+}
+
+static int report(const char *name, int err)
+{
+	printf("%s: %s\n", name, err ? "FAIL" : "PASS");
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	struct buf file  = { NULL, 0, 0 };
+	struct buf plain = { NULL, 0, 0 };
+	struct buf out   = { NULL, 0, 0 };
+	struct buf in    = { NULL, 0, 0 };
+	size_t *frames = NULL;
+	size_t count = 0;
+	size_t segpos[SEGMENTS];
+	size_t segframe[SEGMENTS+1];
+	size_t framebytes = 0;
+	size_t pos, i;
+	unsigned char rbuf[65536];
+	size_t got;
+	int errsum = 0;
+	int s;
+	FILE *f;
+
+	if(argc < 2)
+	{
+		printf("Gimme a MPEG file name...\n");
+		return 0;
+	}
+	if(!(f = compat_fopen(argv[1], "rb")))
+		return 1;
+	while((got = fread(rbuf, 1, sizeof(rbuf), f)) > 0)
+		if(append(&file, rbuf, got))
+			return 1;
+	compat_fclose(f);
+	/* Only the frames, from the first to the last complete one. */
+	for(pos = 0; pos+4 <= file.size; )
+	{
+		size_t size = frame_size(header(file.data+pos));
+		if(!size || pos+size > file.size)
+		{
+			if(count)
+				break;
+			++pos;
+			continue;
+		}
+		if(!(count % 1024) && !(frames = realloc(frames, sizeof(*frames)*(count+1024))))
+			return 1;
+		frames[count++] = pos;
+		pos += size;
+	}
+	/* A Xing/Info or VBRI header frame is none of the audio. */
+	if(count > 1)
+	{
+		unsigned char *body = file.data+frames[0]+4;
+		size_t size = frames[1]-frames[0]-4;
+		for(i=0; i+4 <= size && i <= 36; ++i)
+			if( !memcmp(body+i, "Xing", 4) || !memcmp(body+i, "Info", 4)
+			||	!memcmp(body+i, "VBRI", 4) )
+			{
+				memmove(frames, frames+1, sizeof(*frames)*--count);
+				break;
+			}
+	}
+	if(count < 4*SEGMENTS)
+	{
+		error("need a Layer III file of some frames, without free format");
+		return 1;
+	}
+	for(s=0; s<=SEGMENTS; ++s)
+		segframe[s] = s*count/SEGMENTS;
+	mpg123_init();
+
+	/* The whole stream, also just fed in pieces. */
+	if(append(&in, file.data+frames[0], pos-frames[0]))
+		return 1;
+	errsum += report("plain", decode(&in, NULL, 0, NULL, NULL, 0, &plain, &framebytes));
+
+	for(s=0; s<SEGMENTS; ++s)
+		segpos[s] = frames[segframe[s]] - frames[0];
+	errsum += report( "split", decode(&in, segpos, SEGMENTS, NULL, NULL, 0, &out, &framebytes)
+	||	out.size != plain.size || memcmp(out.data, plain.data, plain.size) );
+
+	/* Half of the last frame in the first segment is missing. */
+	{
+		size_t last = segframe[1]-1;
+		size_t cut = (frames[last+1]-frames[last])/2;
+		size_t keep = frames[last]-frames[0];
+		in.size = 0;
+		append(&in, file.data+frames[0], pos-frames[0]);
+		memmove(in.data+keep+cut, in.data+keep+2*cut, in.size-keep-2*cut);
+		in.size -= cut;
+		for(s=1; s<SEGMENTS; ++s)
+			segpos[s] -= cut;
+		errsum += report( "truncated", decode(&in, segpos, SEGMENTS, NULL, NULL, 0, &out, &framebytes)
+		||	out.size != plain.size - spf(header(file.data+frames[0]))*framebytes
+		||	memcmp(out.data, plain.data, last*spf(header(file.data+frames[0]))*framebytes) );
+	}
+
+	/* A LAME header frame for each segment, with delay and padding. */
+	{
+		static const long delay[SEGMENTS]   = { 576, 1105, 0 };
+		static const long padding[SEGMENTS] = { 1300, 700, 600 };
+		long samples = spf(header(file.data+frames[0]));
+		size_t total = plain.size/framebytes;
+		char *keep = malloc(total);
+		struct buf expect = { NULL, 0, 0 };
+		int err;
+
+		in.size = 0;
+		for(s=0; s<SEGMENTS; ++s)
+		{
+			size_t begin = frames[segframe[s]];
+			size_t end = segframe[s+1] < count ? frames[segframe[s+1]] : pos;
+			segpos[s] = in.size;
+			info_frame( &in, header(file.data+begin), (long)(segframe[s+1]-segframe[s])
+			,	delay[s], padding[s] );
+			append(&in, file.data+begin, end-begin);
+		}
+		errsum += report( "headers without gapless"
+		,	decode(&in, segpos, SEGMENTS, NULL, NULL, 0, &out, &framebytes)
+		||	out.size != plain.size || memcmp(out.data, plain.data, plain.size) );
+
+		if(!keep)
+			return 1;
+		memset(keep, 1, total);
+		for(s=0; s<SEGMENTS; ++s)
+		{
+			long base = (long)segframe[s]*samples;
+			long end = (long)segframe[s+1]*samples;
+			long a = s ? base+GAPLESS_DELAY : 0;
+			long b = base+GAPLESS_DELAY+delay[s];
+			for(i=a; i<(size_t)b && i<total; ++i)
+				keep[i] = 0;
+			for(i=end-padding[s]+GAPLESS_DELAY; i<(size_t)end+GAPLESS_DELAY && i<total; ++i)
+				keep[i] = 0;
+		}
+		for(i=0; i<total; ++i)
+			if(keep[i])
+				append(&expect, plain.data+i*framebytes, framebytes);
+		err = decode(&in, segpos, SEGMENTS, NULL, NULL, 1, &out, &framebytes);
+		errsum += report( "gapless from headers", err
+		||	out.size != expect.size || memcmp(out.data, expect.data, expect.size) );
+		/* Given values count instead of those in the headers, here the same. */
+		err = decode(&in, segpos, SEGMENTS, delay, padding, 1, &out, &framebytes);
+		errsum += report( "gapless given", err
+		||	out.size != expect.size || memcmp(out.data, expect.data, expect.size) );
+		printf("%lu of %lu samples kept\n", (unsigned long)(expect.size/framebytes)
+		,	(unsigned long)total);
+		free(expect.data);
+		free(keep);
+	}
+
+	free(frames);
+	free(file.data);
+	free(plain.data);
+	free(out.data);
+	free(in.data);
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
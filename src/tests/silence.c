@@ -0,0 +1,227 @@
+/*
+	silence: check that MPG123_SILENCE gives the same output as plain
+	decoding, with digital silence spliced into a layer III file, and that
+	the frames dropped with MPG123_SILENCE 2 are reported where they were
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+/* Frames of silence after that many frames of the file. */
+#define SILENCE_AT 20
+#define SILENCE_FRAMES 60
+
+struct output
+{
+	unsigned char *data;
+	size_t fill;
+};
+
+struct dropped
+{
+	int64_t start[SILENCE_FRAMES];
+	int64_t samples[SILENCE_FRAMES];
+	int count;
+};
+
+static int append(struct output *out, const void *data, size_t bytes)
+{
+	unsigned char *nd = realloc(out->data, out->fill+bytes);
+	if(!nd)
+		return -1;
+	out->data = nd;
+	memcpy(out->data+out->fill, data, bytes);
+	out->fill += bytes;
+	return 0;
+}
+
+/* Frames with just the header of another one and no bits for any granule
+   are as silent as it gets. */
+static int make_stream(const char *path, struct output *stream)
+{
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+	unsigned long header;
+	unsigned char *body;
+	size_t bodybytes;
+	int frames = 0;
+	int err = 0;
+	int ret;
+
+	if( !mh
+	||  mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0) != MPG123_OK
+	||  mpg123_open(mh, path) != MPG123_OK )
+		return -1;
+	while( !err && ((ret = mpg123_framebyframe_next(mh)) == MPG123_OK
+	||	ret == MPG123_NEW_FORMAT) )
+	{
+		struct mpg123_frameinfo fi;
+		unsigned char head[4];
+		if( mpg123_framedata(mh, &header, &body, &bodybytes) != MPG123_OK
+		||  mpg123_info(mh, &fi) != MPG123_OK )
+			break;
+		if(fi.layer != 3)
+		{
+			error("need a layer III file");
+			err = -1;
+			break;
+		}
+		head[0] = (header>>24) & 0xff;
+		head[1] = (header>>16) & 0xff;
+		head[2] = (header>>8)  & 0xff;
+		head[3] = header & 0xff;
+		if(++frames == SILENCE_AT)
+		{
+			unsigned char *zero = calloc(1, bodybytes);
+			int i;
+			/* Without CRC, zero side info needs no checksum. */
+			head[1] |= 0x1;
+			for(i=0; zero && i<SILENCE_FRAMES; ++i)
+				if(append(stream, head, 4) || append(stream, zero, bodybytes))
+					break;
+			if(!zero || i < SILENCE_FRAMES)
+				err = -1;
+			free(zero);
+			head[1] = (header>>16) & 0xff;
+		}
+		if(append(stream, head, 4) || append(stream, body, bodybytes))
+			err = -1;
+	}
+	mpg123_delete(mh);
+	return err || frames <= SILENCE_AT ? -1 : 0;
+}
+
+static void silence_cb(void *handle, int64_t start, int64_t samples)
+{
+	struct dropped *d = handle;
+	if(d->count < SILENCE_FRAMES)
+	{
+		d->start[d->count] = start;
+		d->samples[d->count] = samples;
+	}
+	++d->count;
+}
+
+static int decode( struct output *stream, long silence, int encoding
+,	long flags, long down, struct output *out, struct dropped *d
+,	size_t *framesize )
+{
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+	unsigned char buf[16384];
+	size_t got;
+	int ret;
+	long rate;
+	int channels, enc;
+
+	if( !mh
+	||  mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET|flags, 0) != MPG123_OK
+	||  mpg123_param(mh, MPG123_SILENCE, silence, 0) != MPG123_OK
+	||  mpg123_param(mh, MPG123_DOWN_SAMPLE, down, 0) != MPG123_OK
+	||  mpg123_silence_callback(mh, silence_cb, d) != MPG123_OK
+	||  mpg123_format_none(mh) != MPG123_OK
+	||  mpg123_format(mh, 0, MPG123_MONO|MPG123_STEREO, encoding) != MPG123_OK
+	||  mpg123_open_feed(mh) != MPG123_OK )
+	{
+		mpg123_delete(mh);
+		return -1;
+	}
+	ret = mpg123_decode(mh, stream->data, stream->fill, buf, sizeof(buf), &got);
+	while(ret == MPG123_OK || ret == MPG123_NEW_FORMAT)
+	{
+		if(append(out, buf, got))
+			break;
+		ret = mpg123_decode(mh, NULL, 0, buf, sizeof(buf), &got);
+	}
+	if(ret == MPG123_NEED_MORE)
+		ret = append(out, buf, got) ? MPG123_ERR : MPG123_OK;
+	if(mpg123_getformat(mh, &rate, &channels, &enc) == MPG123_OK)
+		*framesize = mpg123_encsize(enc)*channels;
+	else
+		ret = MPG123_ERR;
+	mpg123_delete(mh);
+	return ret == MPG123_OK ? 0 : -1;
+}
+
+/* The plain output, once more with skipping and with dropping. */
+static int test(struct output *stream, int encoding, long flags, long down)
+{
+	struct output plain = { NULL, 0 };
+	struct output skip = { NULL, 0 };
+	struct output drop = { NULL, 0 };
+	struct dropped d = { {0}, {0}, 0 };
+	size_t framesize = 0;
+	int err = 0;
+
+	if( decode(stream, 0, encoding, flags, down, &plain, &d, &framesize)
+	||  decode(stream, 1, encoding, flags, down, &skip, &d, &framesize)
+	||  d.count
+	||  decode(stream, 2, encoding, flags, down, &drop, &d, &framesize) )
+		err = 1;
+	if(!err && (plain.fill != skip.fill || memcmp(plain.data, skip.data, plain.fill)))
+		err = 1;
+	/* All but the first silent frame, which still has the filterbank
+	   settle, are dropped, and they were zeros where they were reported. */
+	if(!err && d.count != SILENCE_FRAMES-1)
+		err = 1;
+	if(!err)
+	{
+		int i;
+		size_t pos = 0; /* in the dropping output */
+		size_t at = 0;  /* in the plain output */
+		for(i=0; i<d.count && !err; ++i)
+		{
+			size_t start = (size_t)d.start[i]*framesize;
+			size_t end = start + (size_t)d.samples[i]*framesize;
+			size_t j;
+			if( start < at || end > plain.fill || pos+(start-at) > drop.fill
+			||  memcmp(plain.data+at, drop.data+pos, start-at) )
+				err = 1;
+			for(j=start; !err && j<end; ++j)
+				if(plain.data[j] != plain.data[start])
+					err = 1;
+			pos += start-at;
+			at = end;
+		}
+		if( !err && ( plain.fill-at != drop.fill-pos
+		||  memcmp(plain.data+at, drop.data+pos, drop.fill-pos) ) )
+			err = 1;
+	}
+	printf( "encoding 0x%x, down-sampling %li%s: %lu bytes, %d frames dropped: %s\n"
+	,	encoding, down, flags & MPG123_PIPELINE ? " (pipelined)" : ""
+	,	(unsigned long)plain.fill, d.count, err ? "FAIL" : "PASS" );
+	free(plain.data);
+	free(skip.data);
+	free(drop.data);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	struct output stream = { NULL, 0 };
+	int errsum = 0;
+
+	if(argc < 2)
+	{
+		printf("Gimme a layer III file name...\n");
+		return 0;
+	}
+	mpg123_init();
+	if(make_stream(argv[1], &stream))
+	{
+		error1("cannot make a stream from %s", argv[1]);
+		return 1;
+	}
+	errsum += test(&stream, MPG123_ENC_SIGNED_16, 0, 0);
+	errsum += test(&stream, MPG123_ENC_UNSIGNED_8, 0, 0);
+	errsum += test(&stream, MPG123_ENC_FLOAT_32, 0, 0);
+	errsum += test(&stream, MPG123_ENC_SIGNED_16, MPG123_PIPELINE, 0);
+	errsum += test(&stream, MPG123_ENC_SIGNED_16, 0, 1);
+	errsum += test(&stream, MPG123_ENC_SIGNED_16, 0, 2);
+	free(stream.data);
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
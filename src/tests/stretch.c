@@ -0,0 +1,124 @@
+/*
+	stretch: check syn123_stretch() for exact output counts and for keeping
+	the pitch and smoothness of a tone at different speeds
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "compat.h"
+#include <syn123.h>
+#include <math.h>
+#include "debug.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define RATE 44100
+#define CHANNELS 2
+#define FREQ 220.
+#define SECONDS 4
+
+static float *in = NULL;
+static size_t insamples = RATE*SECONDS;
+
+/* Stretch all the input in blocks of varying size, checking that each one
+   gives what syn123_stretch_count() promised. */
+static float *stretch_all(syn123_handle *sh, double speed, size_t *outsamples)
+{
+	float *out = NULL;
+	size_t fill = 0;
+	size_t pos = 0;
+	size_t block = 1;
+	if(syn123_setup_stretch(sh, RATE, CHANNELS, speed) != SYN123_OK)
+		return NULL;
+	while(pos < insamples)
+	{
+		size_t n = block < insamples-pos ? block : insamples-pos;
+		size_t want = syn123_stretch_count(sh, n);
+		float *nout = realloc(out, sizeof(float)*CHANNELS*(fill+want+1));
+		if(!nout)
+			break;
+		out = nout;
+		size_t got = syn123_stretch(sh, out+fill*CHANNELS, in+pos*CHANNELS, n);
+		if(got != want)
+		{
+			error2("got %lu instead of %lu samples", (unsigned long)got
+			,	(unsigned long)want);
+			free(out);
+			return NULL;
+		}
+		fill += got;
+		pos += n;
+		block = block*3+7 < 20000 ? block*3+7 : 1;
+	}
+	*outsamples = fill;
+	return out;
+}
+
+static int test_speed(syn123_handle *sh, double speed)
+{
+	size_t outsamples = 0;
+	float *out = stretch_all(sh, speed, &outsamples);
+	int err = 0;
+	if(!out)
+		return 1;
+	/* The length, up to the latency. */
+	size_t expect = (size_t)(insamples/speed);
+	size_t slack = syn123_stretch_latency(sh)/speed + RATE/100;
+	if(outsamples > expect+slack || outsamples+slack < expect)
+		err = 1;
+	/* The pitch from zero crossings, and no jumps at the seams beyond the
+	   steepest slope of the tone. */
+	size_t crossings = 0;
+	float maxstep = 0.;
+	for(size_t i=1; i<outsamples; ++i)
+	{
+		float a = out[(i-1)*CHANNELS];
+		float b = out[i*CHANNELS];
+		if((a < 0.) != (b < 0.))
+			++crossings;
+		if(fabsf(b-a) > maxstep)
+			maxstep = fabsf(b-a);
+	}
+	double freq = 0.5*crossings*RATE/outsamples;
+	double slope = 0.5*2.*M_PI*FREQ/RATE;
+	if(fabs(freq-FREQ) > 0.01*FREQ || maxstep > 1.2*slope)
+		err = 1;
+	/* At normal speed, the input comes out as it is. */
+	if(speed == 1.)
+		for(size_t i=0; i<outsamples*CHANNELS; ++i)
+			if(fabsf(out[i]-in[i]) > 1e-6)
+				err = 1;
+	printf( "speed %g: %lu of %lu samples, %.2f Hz, step %.4f of %.4f: %s\n"
+	,	speed, (unsigned long)outsamples, (unsigned long)expect, freq
+	,	maxstep, slope, err ? "FAIL" : "PASS" );
+	free(out);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	double speeds[] = { 1., 1.25, 1.5, 2., 3., 0.5, 0.8 };
+	int errsum = 0;
+	syn123_handle *sh = syn123_new(RATE, CHANNELS, MPG123_ENC_FLOAT_32, 0, NULL);
+	in = malloc(sizeof(float)*CHANNELS*insamples);
+	if(!sh || !in)
+		return 1;
+	for(size_t i=0; i<insamples; ++i)
+		for(int c=0; c<CHANNELS; ++c)
+			in[i*CHANNELS+c] = (float)(0.5*sin(2.*M_PI*FREQ*i/RATE));
+	for(size_t i=0; i<sizeof(speeds)/sizeof(*speeds); ++i)
+		errsum += test_speed(sh, speeds[i]);
+	if( syn123_setup_stretch(sh, RATE, CHANNELS, 5.) != SYN123_BAD_SPEED
+	||  syn123_stretch_speed(sh, 2.) != SYN123_BAD_SPEED )
+	{
+		printf("bad speed accepted: FAIL\n");
+		++errsum;
+	}
+	free(in);
+	syn123_del(sh);
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}
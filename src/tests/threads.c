@@ -0,0 +1,140 @@
+/*
+	threads: check that mpg123_decode_parallel() gives the same output on
+	pools of different sizes, on an executor of the application and with
+	the parallel scan nested in it, as on a single thread
+
+	copyright 2026 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
+#include "debug.h"
+
+struct output
+{
+	unsigned char *data;
+	size_t bytes;
+};
+
+#ifndef NO_THREADS
+struct job
+{
+	void (*task)(void *);
+	void *arg;
+};
+
+static void *job_thread(void *arg)
+{
+	struct job *j = arg;
+	j->task(j->arg);
+	free(j);
+	return NULL;
+}
+
+/* A thread for each task, refusing every third one. */
+static int executor(void *ctx, void (*task)(void *), void *arg)
+{
+	int *count = ctx;
+	struct job *j;
+	pthread_t tid;
+
+	if(++*count % 3 == 0 || !(j = malloc(sizeof(*j))))
+		return -1;
+	j->task = task;
+	j->arg = arg;
+	if(pthread_create(&tid, NULL, job_thread, j))
+	{
+		free(j);
+		return -1;
+	}
+	pthread_detach(tid);
+	return 0;
+}
+#endif
+
+static int decode( const char *path, mpg123_threads *pool, int pieces
+,	long scan, struct output *out )
+{
+	mpg123_handle *mh = mpg123_new(NULL, NULL);
+	int err = 0;
+
+	out->data = NULL;
+	out->bytes = 0;
+	if( !mh
+	||  mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0) != MPG123_OK
+	||  mpg123_param(mh, MPG123_SCAN_THREADS, scan, 0) != MPG123_OK
+	||  mpg123_use_threads(mh, pool) != MPG123_OK
+	||  mpg123_decode_parallel(mh, path, pieces, &out->data, &out->bytes) != MPG123_OK )
+	{
+		error1("decoding failed: %s", mh ? mpg123_strerror(mh) : "no handle");
+		err = 1;
+	}
+	mpg123_delete(mh);
+	return err;
+}
+
+static int test( const char *name, const char *path, mpg123_threads *pool
+,	int pieces, long scan, struct output *ref )
+{
+	struct output out;
+	int err = decode(path, pool, pieces, scan, &out);
+
+	if(!err && (out.bytes != ref->bytes || memcmp(out.data, ref->data, ref->bytes)))
+		err = 1;
+	printf("%s, %d pieces: %lu bytes: %s\n", name, pieces
+	,	(unsigned long)out.bytes, err ? "FAIL" : "PASS");
+	free(out.data);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	struct output ref;
+	mpg123_threads *pool;
+	int errsum = 0;
+
+	if(argc < 2)
+	{
+		printf("Gimme a MPEG file name...\n");
+		return 0;
+	}
+	mpg123_init();
+	pool = mpg123_threads_new(1, NULL);
+	if(!pool || decode(argv[1], pool, 1, 0, &ref))
+		return 1;
+	printf("one thread: %lu bytes\n", (unsigned long)ref.bytes);
+	errsum += test("pool of 1", argv[1], pool, 4, 0, &ref);
+	mpg123_threads_delete(pool);
+	errsum += test("default pool", argv[1], NULL, 4, 0, &ref);
+	if((pool = mpg123_threads_new(4, NULL)))
+	{
+		errsum += test("pool of 4", argv[1], pool, 4, 0, &ref);
+		errsum += test("pool of 4", argv[1], pool, 16, 0, &ref);
+		/* The scan tasks are queued by the caller before decoding. */
+		errsum += test("pool of 4 with scan", argv[1], pool, 4, 4, &ref);
+		mpg123_threads_delete(pool);
+	}
+	else
+		++errsum;
+#ifndef NO_THREADS
+	{
+		int submitted = 0;
+		if((pool = mpg123_threads_executor(4, executor, &submitted, NULL)))
+		{
+			errsum += test("executor", argv[1], pool, 4, 4, &ref);
+			mpg123_threads_delete(pool);
+			printf("%d tasks for the executor\n", submitted);
+		}
+		else
+			++errsum;
+	}
+#endif
+	free(ref.data);
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum ? 1 : 0;
+}